@@ -0,0 +1,125 @@
+/**
+ ******************************************************************************
+ * @file           : can_capture.h
+ * @brief          : Bus capture into a byte ring with delta-encoded records.
+ *
+ * CANCAP_FRAME (RX interrupt) encodes a received frame into the ring and the
+ * consumer streams the ring out with CANCAP_PEEK/CANCAP_RELEASE. There is one
+ * producer and one consumer, so no lock is needed.
+ *
+ * Stream layout: the 4-byte CANCAP_MAGIC and a version byte, a START event,
+ * then one record per frame or event:
+ *   varint  delta time, in nominal bit times since the previous record
+ *   byte    control: DLC[3:0] | FDF << 4 | BRS << 5 | XTD << 6 | B7 << 7,
+ *           where B7 is RTR for Classic frames and ESI for FD frames
+ *   varint  identifier
+ *   bytes   payload, as many as the DLC gives (none for remote frames)
+ * A control byte with BRS set and FDF clear is impossible on the bus and
+ * marks an event instead: the low nibble is the CANCAP_EVT_* type, followed
+ * by its varint arguments. Varints are LEB128, 7 bits per byte, low first.
+ *
+ * Time comes from the 16-bit FDCAN RX timestamp counting bit times (TSCC
+ * TCP = 1). It wraps every 65536 bits, so it is placed on a 64-bit clock
+ * that GetTicks advances and GetTimestamp (the live counter, TSCV) keeps in
+ * phase, on every CANCAP_FRAME and CANCAP_POLL call. GetTicks must not wrap
+ * between two calls.
+ ******************************************************************************
+ */
+
+#ifndef __CAN_CAPTURE_H
+#define __CAN_CAPTURE_H
+
+#include <stdint.h>
+#include "fdcan_frame.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef CANCAP_RING_BYTES
+#define CANCAP_RING_BYTES           4096U // Power of two
+#endif
+
+#define CANCAP_MAGIC                "CCAP"
+#define CANCAP_VERSION              1U
+#define CANCAP_HEADER_BYTES         5U
+#define CANCAP_RECORD_MAX           (10U + 1U + 5U + 64U) // Delta, control, ID, payload
+
+/***** Control Byte *****/
+#define CANCAP_CTRL_DLC_MASK        0x0FU
+#define CANCAP_CTRL_FDF_POS         4
+#define CANCAP_CTRL_BRS_POS         5
+#define CANCAP_CTRL_XTD_POS         6
+#define CANCAP_CTRL_B7_POS          7     // RTR (Classic) or ESI (FD)
+#define CANCAP_CTRL_EVENT           (1U << CANCAP_CTRL_BRS_POS) // BRS without FDF
+
+/***** Events *****/
+#define CANCAP_EVT_START            0     // Args: nominal kbit/s, data kbit/s
+#define CANCAP_EVT_DROP             1     // Args: frames lost to a full ring
+
+/***** Decoded Record *****/
+typedef struct {
+	uint64_t Time;                 // Bit times since the START event
+	uint8_t IsEvent;
+	uint8_t Event;                 // CANCAP_EVT_*, events only
+	uint32_t Args[2];              // Event arguments
+	FDCAN_FrameTypeDef_t Frame;    // Frames only: ID, flags, DLC and payload
+} CANCAP_RecordTypeDef_t;
+
+/***** Hooks *****/
+/* Free-running tick counter, the coarse clock that resolves timestamp wraps */
+typedef uint32_t (*CANCAP_GetTicks_t)(void);
+
+/* Live value of the counter the RX timestamps are taken from */
+typedef uint16_t (*CANCAP_GetTimestamp_t)(void);
+
+/***** Capture Structure *****/
+typedef struct {
+	/* Configuration, filled in before CANCAP_INIT */
+	uint32_t NominalKbps;
+	uint32_t DataKbps;
+	uint32_t TicksPerBit;          // GetTicks counts per nominal bit time
+	CANCAP_GetTicks_t GetTicks;
+	CANCAP_GetTimestamp_t GetTimestamp;
+
+	/* Ring, written by the producer up to Head, read by the consumer from Tail */
+	uint8_t Ring[CANCAP_RING_BYTES];
+	volatile uint32_t Head;
+	volatile uint32_t Tail;
+
+	/* Clock */
+	uint64_t NowBits;              // Bit times, low 16 bits in phase with TSCV
+	uint32_t LastTicks;
+	uint32_t TickRemainder;
+	uint64_t LastRecordBits;
+
+	/* Statistics */
+	uint32_t Frames;               // Frames recorded
+	uint32_t Dropped;              // Frames lost to a full ring
+	uint32_t PendingDrops;         // Lost since the last DROP event
+	uint32_t HighWater;            // Most bytes ever waiting in the ring
+	uint64_t Bytes;                // Bytes written
+} CANCAP_HandleTypeDef_t;
+
+/***** Capture API *****/
+void CANCAP_INIT(CANCAP_HandleTypeDef_t *hCap);
+void CANCAP_POLL(CANCAP_HandleTypeDef_t *hCap);
+uint8_t CANCAP_FRAME(CANCAP_HandleTypeDef_t *hCap,
+		const FDCAN_FrameTypeDef_t *pFrame);
+uint32_t CANCAP_PEEK(const CANCAP_HandleTypeDef_t *hCap, const uint8_t **ppData);
+void CANCAP_RELEASE(CANCAP_HandleTypeDef_t *hCap, uint32_t bytes);
+uint32_t CANCAP_PARSE(const uint8_t *pData, uint32_t length,
+		CANCAP_RecordTypeDef_t *pRecord, uint64_t *pTime);
+
+/**
+ * @brief  Bytes waiting in the ring
+ */
+FDCAN_INLINE uint32_t CANCAP_USED(const CANCAP_HandleTypeDef_t *hCap) {
+	return hCap->Head - hCap->Tail;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CAN_CAPTURE_H */
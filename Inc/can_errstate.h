@@ -0,0 +1,161 @@
+/**
+ ******************************************************************************
+ * @file           : can_errstate.h
+ * @brief          : CAN fault confinement state manager: error active,
+ *                   warning, error passive, bus-off and automatic recovery.
+ *
+ * The manager is driver independent: PSR and ECR snapshots are fed in with
+ * CANERR_IRQ (from the EP/EW/BO/PEA/PED interrupt) and CANERR_UPDATE (from
+ * polling), the
+ * bus-off backoff runs off GetTicks from CANERR_POLL, and recovery is
+ * started through the Restart hook, which on FDCAN clears CCCR.INIT so the
+ * controller begins its 128 x 11 recessive bit count.
+ *
+ * Backoff: the first CANERR_FAST_ATTEMPTS bus-offs in a row wait
+ * FastBackoffMs before restarting, later ones SlowBackoffMs. The count is
+ * reset once the node has stayed off bus-off for StableMs.
+ *
+ * Time is accounted per state in ticks, so downtime (bus-off plus
+ * recovering) can be read back at any time with CANERR_TIME_IN_STATE_US.
+ ******************************************************************************
+ */
+
+#ifndef __CAN_ERRSTATE_H
+#define __CAN_ERRSTATE_H
+
+#include <stdint.h>
+#include "fdcan_frame.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***** Default Recovery Policy *****/
+#ifndef CANERR_FAST_BACKOFF_MS
+#define CANERR_FAST_BACKOFF_MS      10U   // Wait before a quick restart
+#endif
+#ifndef CANERR_FAST_ATTEMPTS
+#define CANERR_FAST_ATTEMPTS        5U    // Quick restarts before slowing down
+#endif
+#ifndef CANERR_SLOW_BACKOFF_MS
+#define CANERR_SLOW_BACKOFF_MS      1000U // Wait before later restarts
+#endif
+#ifndef CANERR_STABLE_MS
+#define CANERR_STABLE_MS            1000U // Clean time that resets the attempt count
+#endif
+
+/***** FDCAN PSR Fields *****/
+#define CANERR_PSR_LEC_POS          0     // Last error code, arbitration phase
+#define CANERR_PSR_ACT_POS          3     // Activity
+#define CANERR_PSR_EP_POS           5     // Error passive
+#define CANERR_PSR_EW_POS           6     // Warning status
+#define CANERR_PSR_BO_POS           7     // Bus-off
+#define CANERR_PSR_DLEC_POS         8     // Last error code, data phase
+
+/***** FDCAN ECR Fields *****/
+#define CANERR_ECR_TEC_POS          0     // Transmit error counter (8 bits)
+#define CANERR_ECR_REC_POS          8     // Receive error counter (7 bits)
+#define CANERR_ECR_RP_POS           15    // REC reached the passive level
+#define CANERR_ECR_CEL_POS          16    // Error logging count (8 bits, clear on read)
+
+/***** FDCAN IR / IE Fields *****/
+/* STM32H5 layout (RM0492); the STM32H7 M_CAN puts these at 23-28 */
+#define CANERR_IR_EP_POS            17    // Error passive status changed
+#define CANERR_IR_EW_POS            18    // Warning status changed
+#define CANERR_IR_BO_POS            19    // Bus-off status changed
+#define CANERR_IR_PEA_POS           21    // Protocol error, arbitration phase
+#define CANERR_IR_PED_POS           22    // Protocol error, data phase
+#define CANERR_IR_STATUS_FLAGS      ((1UL << CANERR_IR_EP_POS) \
+		| (1UL << CANERR_IR_EW_POS) | (1UL << CANERR_IR_BO_POS))
+#define CANERR_IR_PROTOCOL_FLAGS    ((1UL << CANERR_IR_PEA_POS) \
+		| (1UL << CANERR_IR_PED_POS))
+#define CANERR_IR_FLAGS             (CANERR_IR_STATUS_FLAGS | CANERR_IR_PROTOCOL_FLAGS)
+
+/***** Last Error Codes (LEC / DLEC) *****/
+#define CANERR_LEC_NONE             0
+#define CANERR_LEC_STUFF            1
+#define CANERR_LEC_FORM             2
+#define CANERR_LEC_ACK              3
+#define CANERR_LEC_BIT1             4     // Sent recessive, saw dominant
+#define CANERR_LEC_BIT0             5     // Sent dominant, saw recessive
+#define CANERR_LEC_CRC              6
+#define CANERR_LEC_NO_CHANGE        7     // Nothing since the last PSR read
+#define CANERR_LEC_COUNT            8
+
+/***** States *****/
+#define CANERR_STATE_ACTIVE         0     // TEC and REC below 96
+#define CANERR_STATE_WARNING        1     // TEC or REC at 96 or more
+#define CANERR_STATE_PASSIVE        2     // TEC or REC at 128 or more
+#define CANERR_STATE_BUS_OFF        3     // TEC above 255, waiting out the backoff
+#define CANERR_STATE_RECOVERING     4     // Restarted, counting 128 x 11 recessive bits
+#define CANERR_STATE_COUNT          5
+
+/***** Hooks *****/
+/* Free-running tick counter for the backoff and state times */
+typedef uint32_t (*CANERR_GetTicks_t)(void);
+
+/* Leave bus-off: start the controller's recovery sequence */
+typedef void (*CANERR_Restart_t)(void *ctx);
+
+/* The state changed from 'from' to 'to' */
+typedef void (*CANERR_StateChange_t)(void *ctx, uint8_t from, uint8_t to);
+
+/***** Error State Manager Structure *****/
+typedef struct {
+	/* Configuration, filled in before CANERR_INIT */
+	uint32_t TicksPerUs;           // GetTicks rate
+	CANERR_GetTicks_t GetTicks;
+	CANERR_Restart_t Restart;
+	CANERR_StateChange_t StateChange; // Optional
+	void *Ctx;                     // Passed back to every hook
+	uint32_t FastBackoffMs;        // 0 in all three: CANERR_INIT uses the defaults
+	uint32_t SlowBackoffMs;
+	uint32_t StableMs;
+	uint8_t FastAttempts;
+
+	/* State */
+	uint8_t State;
+	uint8_t Attempts;              // Bus-offs since the node was last stable
+	uint32_t RestartDeadline;      // BUS_OFF: when to call Restart
+	uint32_t BusOffTicks;          // Start of the current bus-off
+	uint32_t LastBusOffEnd;        // Return to the bus, for the stable time
+	uint32_t LastTicks;            // Time accounted up to here
+	uint64_t StateTicks[CANERR_STATE_COUNT]; // Time spent in each state
+
+	/* Error counters as last read */
+	uint8_t Tec;
+	uint8_t Rec;
+	uint8_t TecMax;
+	uint8_t RecMax;
+
+	/* Statistics */
+	uint32_t Entered[CANERR_STATE_COUNT]; // Transitions into each state
+	uint32_t Recoveries;           // Bus-offs that ended back on the bus
+	uint32_t ArbErrors[CANERR_LEC_COUNT];  // PSR.LEC events by code
+	uint32_t DataErrors[CANERR_LEC_COUNT]; // PSR.DLEC events by code
+	uint32_t LoggedErrors;         // Sum of ECR.CEL
+	uint32_t DowntimeMaxUs;        // Longest bus-off to back-on-bus
+	uint32_t DowntimeLastUs;
+} CANERR_HandleTypeDef_t;
+
+/***** Error State API *****/
+void CANERR_INIT(CANERR_HandleTypeDef_t *hErr);
+void CANERR_UPDATE(CANERR_HandleTypeDef_t *hErr, uint32_t psr, uint32_t ecr);
+uint32_t CANERR_IRQ(CANERR_HandleTypeDef_t *hErr, uint32_t ir, uint32_t psr,
+		uint32_t ecr);
+void CANERR_POLL(CANERR_HandleTypeDef_t *hErr);
+uint64_t CANERR_TIME_IN_STATE_US(CANERR_HandleTypeDef_t *hErr, uint8_t state);
+const char* CANERR_STATE_NAME(uint8_t state);
+
+/**
+ * @brief  1 while the node cannot send: bus-off or recovering
+ */
+FDCAN_INLINE uint8_t CANERR_OFF_BUS(const CANERR_HandleTypeDef_t *hErr) {
+	return hErr->State >= CANERR_STATE_BUS_OFF;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CAN_ERRSTATE_H */
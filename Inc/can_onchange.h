@@ -0,0 +1,115 @@
+/**
+ ******************************************************************************
+ * @file           : can_onchange.h
+ * @brief          : Send-on-change transmit filter with per-signal deadbands.
+ *
+ * Each filtered identifier keeps a shadow of the payload it last sent. A new
+ * frame goes out only if
+ *   - a bit outside the deadband signals differs from the shadow,
+ *   - a deadband signal moved further than its deadband from the value last
+ *     sent (so a slow drift is sent once it adds up), or
+ *   - RefreshMs has passed since the last frame sent (heartbeat).
+ *
+ * The exact part is one XOR and AND per payload word against a mask built by
+ * CANCHG_INIT with the deadband signal bits cleared; only the few deadband
+ * signals are extracted, from a 64-bit window of two payload words.
+ * Identifiers without an entry always pass.
+ *
+ * Signals follow the DBC layout: start bit and length, Intel (little-endian)
+ * or Motorola (big-endian, start bit = MSB), at most 32 bits long.
+ ******************************************************************************
+ */
+
+#ifndef __CAN_ONCHANGE_H
+#define __CAN_ONCHANGE_H
+
+#include <stdint.h>
+#include "fdcan_frame.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***** Sizes *****/
+#ifndef CANCHG_MAX_WORDS
+#define CANCHG_MAX_WORDS            2U    // Shadow per entry, longer frames always pass
+#endif
+#define CANCHG_MAX_SIGNALS          8U    // Deadband signals per entry
+
+/***** Byte Orders *****/
+#define CANCHG_INTEL                0     // DBC @1
+#define CANCHG_MOTOROLA             1     // DBC @0
+
+/***** Filter Results *****/
+#define CANCHG_SUPPRESS             0
+#define CANCHG_SEND                 1
+
+/***** Hooks *****/
+/* Free-running tick counter for the refresh period */
+typedef uint32_t (*CANCHG_GetTicks_t)(void);
+
+/***** Deadband Signal *****/
+typedef struct {
+	uint16_t StartBit;             // DBC start bit
+	uint8_t Length;                // 1 to 32 bits
+	uint8_t ByteOrder;             // CANCHG_INTEL or CANCHG_MOTOROLA
+	uint8_t Signed;
+	uint32_t Deadband;             // Raw units, a larger change is sent
+} CANCHG_SignalTypeDef_t;
+
+/***** Filtered Identifier *****/
+typedef struct {
+	/* Configuration */
+	uint32_t Id;
+	uint8_t Extended;
+	uint32_t RefreshMs;            // Sent at least this often, 0 = only on change
+	const CANCHG_SignalTypeDef_t *Signals;
+	uint8_t SignalCount;
+
+	/* Built by CANCHG_INIT */
+	uint32_t Key;                  // T0 identifier bits
+	uint32_t ExactMask[CANCHG_MAX_WORDS]; // Payload bits compared exactly
+	uint8_t Window[CANCHG_MAX_SIGNALS];   // First word of each signal's window
+	uint8_t Shift[CANCHG_MAX_SIGNALS];    // Signal LSB within the window
+
+	/* Last frame sent */
+	uint8_t Valid;
+	uint32_t LastW1;               // DLC and format
+	uint32_t LastData[CANCHG_MAX_WORDS];
+	uint32_t LastTicks;
+
+	/* Statistics */
+	uint32_t Offered;
+	uint32_t Sent;
+	uint32_t Refreshed;            // Sent only because RefreshMs ran out
+} CANCHG_EntryTypeDef_t;
+
+/***** Filter Structure *****/
+typedef struct {
+	/* Configuration, filled in before CANCHG_INIT */
+	CANCHG_EntryTypeDef_t *Entries;
+	uint16_t EntryCount;
+	uint32_t TicksPerMs;           // GetTicks rate
+	CANCHG_GetTicks_t GetTicks;
+
+	/* Statistics */
+	uint32_t Offered;              // Frames of filtered identifiers
+	uint32_t Suppressed;
+} CANCHG_HandleTypeDef_t;
+
+/***** Send-on-Change API *****/
+uint8_t CANCHG_INIT(CANCHG_HandleTypeDef_t *hChg);
+uint8_t CANCHG_FILTER(CANCHG_HandleTypeDef_t *hChg,
+		const FDCAN_FrameTypeDef_t *pFrame);
+void CANCHG_INVALIDATE(CANCHG_HandleTypeDef_t *hChg,
+		const FDCAN_FrameTypeDef_t *pFrame);
+CANCHG_EntryTypeDef_t* CANCHG_FIND(CANCHG_HandleTypeDef_t *hChg,
+		const FDCAN_FrameTypeDef_t *pFrame);
+uint32_t CANCHG_SIGNAL_RAW(const CANCHG_EntryTypeDef_t *e, uint32_t signal,
+		const uint32_t *pData);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CAN_ONCHANGE_H */
@@ -0,0 +1,127 @@
+/**
+ ******************************************************************************
+ * @file           : can_ratelimit.h
+ * @brief          : Token-bucket TX rate limiter per identifier and per class.
+ *
+ * A frame may be charged to two buckets: the one of its identifier, if it
+ * has an entry, and the one of the first traffic class whose ID range holds
+ * it. It passes only if both hold a token, and then takes one from each.
+ *
+ * Buckets count tokens in millionths of a frame, so a rate in frames per
+ * second refills exactly that many units per microsecond; Burst frames is
+ * the capacity. A frame refused by a CANRL_DROP bucket is dropped; one
+ * refused by a CANRL_QUEUE bucket waits in the limiter's queue until
+ * CANRL_POLL finds tokens for it. Frames sharing a bucket leave the queue in
+ * the order they came, and a new frame whose bucket has frames waiting goes
+ * behind them even if a token is free.
+ ******************************************************************************
+ */
+
+#ifndef __CAN_RATELIMIT_H
+#define __CAN_RATELIMIT_H
+
+#include <stdint.h>
+#include "fdcan_frame.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***** Sizes *****/
+#ifndef CANRL_QUEUE_LEN
+#define CANRL_QUEUE_LEN             8U    // Frames held back by CANRL_QUEUE buckets
+#endif
+#define CANRL_TOKEN                 1000000U // One frame, in bucket units
+#define CANRL_NONE                  0xFFU // No bucket
+#define CANRL_IDLE                  0xFFFFFFFFU // CANRL_NEXT_US: nothing queued
+
+/***** Policies *****/
+#define CANRL_DROP                  0     // Refused frames are dropped
+#define CANRL_QUEUE                 1     // Refused frames wait for a token
+
+/***** Submit Results *****/
+#define CANRL_DROPPED               0
+#define CANRL_PASS                  1     // Send it now
+#define CANRL_QUEUED                2     // Taken by the limiter, CANRL_POLL sends it
+
+/***** Hooks *****/
+/* Free-running microsecond counter */
+typedef uint32_t (*CANRL_GetUs_t)(void);
+/* Queue a frame for transmission, 1 if it was taken */
+typedef uint8_t (*CANRL_Transmit_t)(void *ctx, const FDCAN_FrameTypeDef_t *pFrame);
+
+/***** Bucket *****/
+typedef struct {
+	/* Configuration */
+	uint32_t RatePerSec;           // Frames per second, refill per microsecond in units
+	uint16_t Burst;                // Capacity in frames, 1 to 4294
+	uint8_t Policy;                // CANRL_DROP or CANRL_QUEUE
+
+	/* State */
+	uint32_t Tokens;               // Units of 1/CANRL_TOKEN frame
+	uint32_t LastUs;               // Last refill
+	uint8_t Waiting;               // Frames in the queue charged to this bucket
+
+	/* Statistics */
+	uint32_t Passed;               // Frames sent, at once or from the queue
+	uint32_t Queued;
+	uint32_t Dropped;              // Refused, or the queue was full
+} CANRL_BucketTypeDef_t;
+
+/***** Limited Identifier *****/
+typedef struct {
+	uint32_t Id;
+	uint8_t Extended;
+	CANRL_BucketTypeDef_t Bucket;
+	uint32_t Key;                  // T0 identifier bits, built by CANRL_INIT
+} CANRL_IdTypeDef_t;
+
+/***** Traffic Class *****/
+typedef struct {
+	uint32_t IdMin;                // Identifier range, inclusive
+	uint32_t IdMax;
+	uint8_t Extended;
+	CANRL_BucketTypeDef_t Bucket;
+} CANRL_ClassTypeDef_t;
+
+/***** Queued Frame *****/
+typedef struct {
+	FDCAN_FrameTypeDef_t Frame;
+	uint8_t IdEntry;               // Buckets to charge, CANRL_NONE if not limited there
+	uint8_t Class;
+} CANRL_QueuedTypeDef_t;
+
+/***** Limiter Structure *****/
+typedef struct {
+	/* Configuration, filled in before CANRL_INIT */
+	CANRL_IdTypeDef_t *Ids;
+	uint8_t IdCount;
+	CANRL_ClassTypeDef_t *Classes;
+	uint8_t ClassCount;
+	CANRL_GetUs_t GetUs;
+	CANRL_Transmit_t Transmit;     // Used by CANRL_POLL
+	void *Ctx;
+
+	/* Queue, oldest first */
+	CANRL_QueuedTypeDef_t Queue[CANRL_QUEUE_LEN];
+	uint8_t QueueCount;
+
+	/* Statistics */
+	uint32_t Submitted;
+	uint32_t Unlimited;            // Frames with neither an entry nor a class
+	uint32_t QueueFull;            // CANRL_QUEUE frames dropped for lack of room
+	uint8_t QueuePeak;
+} CANRL_HandleTypeDef_t;
+
+/***** Rate Limiter API *****/
+void CANRL_INIT(CANRL_HandleTypeDef_t *hRl);
+uint8_t CANRL_SUBMIT(CANRL_HandleTypeDef_t *hRl,
+		const FDCAN_FrameTypeDef_t *pFrame);
+uint32_t CANRL_POLL(CANRL_HandleTypeDef_t *hRl);
+uint32_t CANRL_NEXT_US(CANRL_HandleTypeDef_t *hRl);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CAN_RATELIMIT_H */
@@ -0,0 +1,127 @@
+/**
+ ******************************************************************************
+ * @file           : can_replay.h
+ * @brief          : Trace replay: a recorded log fed back through an RX path,
+ *                   as recorded, time-scaled or as fast as it is taken.
+ *
+ * The log is a memory image, a file read on the host or a RAM or flash
+ * region on target, in one of two formats told apart by the first bytes:
+ *   candump -L text, one frame per line:
+ *     (1436509052.249713) can0 123#DEADBEEF
+ *     (1436509052.249800) can0 18FEF100##1112233   FD, flags nibble 1 = BRS
+ *     (1436509052.250000) can0 7DF#R               remote frame
+ *   Text ends at the first NUL or 0xFF byte (erased flash) or at Length.
+ *   A can_capture.h stream, the output of the bus sniffer.
+ *
+ * Frames arrive in an RX FIFO model of FifoDepth elements at their recorded
+ * time, or at that time divided by the scale, and leave it through the
+ * Deliver hook when CANRP_POLL runs. A frame arriving while the FIFO is
+ * full is an overrun, lost as RX FIFO 0 in blocking mode would lose it:
+ * the application did not keep up. In CANRP_FAST mode the next frame
+ * arrives as soon as there is room, so nothing is lost and the rate is the
+ * one the application sustains.
+ ******************************************************************************
+ */
+
+#ifndef __CAN_REPLAY_H
+#define __CAN_REPLAY_H
+
+#include <stdint.h>
+#include "fdcan_frame.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***** Sizes *****/
+#ifndef CANRP_FIFO_MAX
+#define CANRP_FIFO_MAX              8U    // Largest FifoDepth
+#endif
+
+/***** Timing Modes *****/
+#define CANRP_AS_RECORDED           0
+#define CANRP_SCALED                1     // Recorded time / (ScalePermille / 1000)
+#define CANRP_FAST                  2     // As fast as the FIFO empties
+
+/***** Image Formats *****/
+#define CANRP_FMT_CANDUMP           0
+#define CANRP_FMT_CAPTURE           1
+
+#define CANRP_IDLE                  0xFFFFFFFFU // CANRP_NEXT_US: replay finished
+
+/***** CANRP_PARSE_CANDUMP Results *****/
+#define CANRP_LINE_BAD              0
+#define CANRP_LINE_FRAME            1
+#define CANRP_LINE_SKIP             2     // Comment, blank, error frame, other interface
+
+/***** Hooks *****/
+/* Free-running microsecond counter */
+typedef uint32_t (*CANRP_GetUs_t)(void);
+/* Acceptance filtering at arrival, may edit the frame; 0 = not stored */
+typedef uint8_t (*CANRP_Accept_t)(void *ctx, FDCAN_FrameTypeDef_t *pFrame);
+/* Hand one frame from the FIFO to the RX path */
+typedef void (*CANRP_Deliver_t)(void *ctx, const FDCAN_FrameTypeDef_t *pFrame);
+
+/***** Replay Structure *****/
+typedef struct {
+	/* Configuration, filled in before CANRP_INIT */
+	const uint8_t *Image;
+	uint32_t Length;
+	const char *Interface;         // candump: only this interface, NULL = all
+	uint8_t Mode;                  // CANRP_AS_RECORDED, CANRP_SCALED or CANRP_FAST
+	uint32_t ScalePermille;        // CANRP_SCALED: 2000 = twice as fast
+	uint8_t FifoDepth;             // RX FIFO elements, 1 to CANRP_FIFO_MAX
+	CANRP_GetUs_t GetUs;
+	CANRP_Accept_t Accept;         // Optional
+	CANRP_Deliver_t Deliver;
+	void *Ctx;
+
+	/* Source */
+	uint8_t Format;                // CANRP_FMT_*
+	uint32_t Pos;                  // Next byte of Image
+	uint32_t CaptureKbps;          // Capture: nominal rate from the START event
+	uint64_t CaptureBits;          // Capture: running record time
+	uint8_t HaveNext;              // Next frame parsed, not yet arrived
+	FDCAN_FrameTypeDef_t Next;
+	uint64_t NextRecUs;            // Its recorded time
+	uint8_t HaveFirst;
+	uint64_t FirstRecUs;           // Recorded time of the first frame
+
+	/* FIFO model, Fifo[FifoHead] oldest */
+	FDCAN_FrameTypeDef_t Fifo[CANRP_FIFO_MAX];
+	uint64_t FifoDueUs[CANRP_FIFO_MAX]; // Arrival, replay time
+	uint8_t FifoHead;
+	uint8_t FifoCount;
+
+	/* Clock: replay time since the first poll */
+	uint8_t Started;
+	uint32_t LastUs;
+	uint64_t ElapsedUs;
+	uint64_t DoneUs;               // Replay time the last frame left the FIFO
+	uint8_t Done;
+
+	/* Statistics */
+	uint32_t Frames;               // Parsed from the image
+	uint32_t Filtered;             // Refused by Accept
+	uint32_t Overruns;             // Arrived at a full FIFO: not kept up with
+	uint32_t Delivered;
+	uint32_t Skipped;              // Other interfaces, error frames, comments
+	uint32_t Malformed;            // Lines or records that do not parse
+	uint32_t SourceDropped;        // Frames the capture itself lost
+	uint8_t FifoPeak;
+	uint64_t LatencySumUs;         // Arrival to delivery, timed modes
+	uint32_t LatencyMaxUs;
+} CANRP_HandleTypeDef_t;
+
+/***** Trace Replay API *****/
+void CANRP_INIT(CANRP_HandleTypeDef_t *hRp);
+uint32_t CANRP_POLL(CANRP_HandleTypeDef_t *hRp, uint32_t budget);
+uint32_t CANRP_NEXT_US(const CANRP_HandleTypeDef_t *hRp);
+uint8_t CANRP_PARSE_CANDUMP(const uint8_t *pLine, uint32_t length,
+		const char *interface, FDCAN_FrameTypeDef_t *pFrame, uint64_t *pUs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CAN_REPLAY_H */
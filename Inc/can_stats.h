@@ -0,0 +1,128 @@
+/**
+ ******************************************************************************
+ * @file           : can_stats.h
+ * @brief          : Bus-load and per-ID traffic statistics with fixed memory.
+ *
+ * Every frame seen on the RX and TX paths is fed to CANSTATS_FRAME, which
+ *   - charges its worst-case wire time to the current load bucket, and
+ *   - counts frames and bytes for its identifier.
+ *
+ * Wire time includes worst-case dynamic bit stuffing, the fixed stuff bits
+ * of the FD CRC field, and for BRS frames the data phase at the data bit
+ * rate. It is looked up in a table built by CANSTATS_INIT for every
+ * (format, DLC) pair, so the per-frame cost is a table load, a hash probe
+ * and a few adds.
+ *
+ * Load history is a ring of CANSTATS_BUCKETS buckets of BucketMs each; any
+ * window up to BucketMs * CANSTATS_BUCKETS is summed on request. Identifiers
+ * live in an open-addressing table of CANSTATS_ID_SLOTS entries; frames of
+ * identifiers that find no slot still count towards the load and are
+ * reported as Untracked.
+ ******************************************************************************
+ */
+
+#ifndef __CAN_STATS_H
+#define __CAN_STATS_H
+
+#include <stdint.h>
+#include "fdcan_frame.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***** Table Sizes *****/
+#ifndef CANSTATS_ID_SLOTS
+#define CANSTATS_ID_SLOTS           64U   // Power of two
+#endif
+#ifndef CANSTATS_BUCKETS
+#define CANSTATS_BUCKETS            100U  // Load history length in buckets
+#endif
+#define CANSTATS_PROBE_LIMIT        8U    // Slots tried before a frame is untracked
+
+/***** Frame Direction *****/
+#define CANSTATS_RX                 0
+#define CANSTATS_TX                 1
+
+/***** Frame Formats (wire time table rows) *****/
+#define CANSTATS_FMT_CLASSIC        0
+#define CANSTATS_FMT_FD             1     // FD, data phase at the nominal rate
+#define CANSTATS_FMT_FD_BRS         2     // FD with bit rate switch
+#define CANSTATS_FMT_COUNT          3
+
+/***** Hooks *****/
+/* Free-running tick counter for the load buckets and last-seen times */
+typedef uint32_t (*CANSTATS_GetTicks_t)(void);
+
+/***** Per-ID Entry *****/
+typedef struct {
+	uint32_t Key;                  // ID | XTD << 29 | valid << 31, 0 = free
+	uint32_t RxFrames;
+	uint32_t TxFrames;
+	uint32_t Bytes;
+	uint64_t WireNs;               // Worst-case bus time of all its frames
+	uint32_t LastTicks;            // Time of the last frame
+} CANSTATS_IdEntryTypeDef_t;
+
+/***** Statistics Structure *****/
+typedef struct {
+	/* Configuration, filled in before CANSTATS_INIT */
+	uint32_t NominalKbps;          // Arbitration bit rate
+	uint32_t DataKbps;             // FD data bit rate (BRS frames)
+	uint32_t BucketMs;             // Load bucket length
+	uint32_t TicksPerUs;           // GetTicks rate
+	CANSTATS_GetTicks_t GetTicks;
+
+	/* Worst-case wire time in ns, by [format][extended][DLC] */
+	uint32_t WireNsTable[CANSTATS_FMT_COUNT][2][16];
+	uint32_t WireBitsTable[CANSTATS_FMT_COUNT][2][16]; // Bits on the wire
+
+	/* Load history */
+	uint32_t BucketNs[CANSTATS_BUCKETS]; // Busy time per bucket
+	uint32_t BucketIndex;          // Bucket being filled
+	uint32_t BucketStart;          // Tick the current bucket started
+	uint32_t BucketTicks;
+	uint32_t BucketsDone;          // Complete buckets, saturates at CANSTATS_BUCKETS
+	uint32_t PeakBucketNs;         // Busiest complete bucket
+
+	/* Per-ID table */
+	CANSTATS_IdEntryTypeDef_t Ids[CANSTATS_ID_SLOTS];
+	uint32_t IdCount;
+
+	/* Totals */
+	uint32_t Frames[2];            // By direction
+	uint64_t Bytes;
+	uint64_t WireBits;
+	uint64_t WireNs;
+	uint32_t Untracked;            // Frames whose ID found no slot
+	uint32_t StartTicks;
+} CANSTATS_HandleTypeDef_t;
+
+/***** Statistics API *****/
+void CANSTATS_INIT(CANSTATS_HandleTypeDef_t *hStats);
+void CANSTATS_FRAME(CANSTATS_HandleTypeDef_t *hStats,
+		const FDCAN_FrameTypeDef_t *pFrame, uint8_t direction);
+uint32_t CANSTATS_LOAD_PERMILLE(CANSTATS_HandleTypeDef_t *hStats,
+		uint32_t windowMs);
+uint32_t CANSTATS_PEAK_PERMILLE(const CANSTATS_HandleTypeDef_t *hStats);
+const CANSTATS_IdEntryTypeDef_t* CANSTATS_FIND(
+		const CANSTATS_HandleTypeDef_t *hStats, uint32_t id, uint8_t extended);
+uint32_t CANSTATS_WIRE_BITS(uint8_t format, uint8_t extended, uint32_t bytes,
+		uint32_t *pDataBits);
+
+/**
+ * @brief  Identifier of a used table entry
+ */
+FDCAN_INLINE uint32_t CANSTATS_ENTRY_ID(const CANSTATS_IdEntryTypeDef_t *e) {
+	return e->Key & FDCAN_ELEM_EXTID_MASK;
+}
+
+FDCAN_INLINE uint8_t CANSTATS_ENTRY_EXTENDED(const CANSTATS_IdEntryTypeDef_t *e) {
+	return (uint8_t) ((e->Key >> 29) & 0x1U);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CAN_STATS_H */
@@ -0,0 +1,130 @@
+/**
+ ******************************************************************************
+ * @file           : can_timesync.h
+ * @brief          : Global time over CAN, after AUTOSAR CanTSyn: a master
+ *                   sends SYNC and FUP, slaves correct a local clock to it.
+ *
+ * Master: CANTS_MASTER_SYNC builds a SYNC carrying the seconds of its global
+ * time and tags it for a TX event; it may be built well before it is sent.
+ * When the TX event gives the start of frame time of that SYNC (T0),
+ * CANTS_MASTER_TX_EVENT builds the FUP with the nanoseconds from those
+ * seconds to T0; whole seconds beyond go in OVS.
+ *
+ * Slave: CANTS_SLAVE_RX takes each frame with the local time of its start
+ * of frame, from the RX timestamp. A SYNC and the FUP of the same sequence
+ * counter give the global time at the SYNC's start of frame, so interrupt
+ * and queueing delays on either node drop out. Every such pair sets the
+ * offset; pairs at least RateWindowNs apart give the rate of the master
+ * clock against the local one, in parts per billion.
+ *
+ * Times are in nanoseconds: local times of a free-running 64-bit clock the
+ * caller keeps (and turns hardware timestamps into), global times since the
+ * master's epoch.
+ *
+ * Frames, 8 bytes, the not CRC-secured CanTSyn types:
+ *   byte 0     Type: CANTS_TYPE_SYNC or CANTS_TYPE_FUP
+ *   byte 1     User byte, 0
+ *   byte 2     Domain (high nibble), sequence counter 0-15 (low nibble)
+ *   byte 3     FUP: SGW (bit 2), OVS (bits 0-1); SYNC: 0
+ *   bytes 4-7  SYNC: seconds; FUP: nanoseconds; big-endian
+ ******************************************************************************
+ */
+
+#ifndef __CAN_TIMESYNC_H
+#define __CAN_TIMESYNC_H
+
+#include <stdint.h>
+#include "fdcan_frame.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***** Frame Types *****/
+#define CANTS_TYPE_SYNC             0x10U
+#define CANTS_TYPE_FUP              0x18U
+#define CANTS_FRAME_BYTES           8U
+
+#define CANTS_NS_PER_SEC            1000000000ULL
+#define CANTS_MARKER(seq)           (0xC0U | (seq)) // TX event marker of a SYNC
+
+/***** Slave Status *****/
+#define CANTS_UNSYNCED              0     // No SYNC/FUP pair yet
+#define CANTS_SYNCED                1
+#define CANTS_TIMEOUT               2     // No pair for TimeoutNs, still estimated
+
+/***** Master Structure *****/
+typedef struct {
+	/* Configuration */
+	uint32_t Id;                   // SYNC and FUP identifier
+	uint8_t Extended;
+	uint8_t Domain;                // 0-15
+	uint64_t EpochNs;              // Global time at local time 0
+
+	/* State: SYNCs built and not yet confirmed by a TX event, by counter */
+	uint8_t Sequence;              // Counter of the next SYNC
+	uint16_t Pending;              // Bit per sequence counter
+	uint32_t PendingSec[16];
+
+	/* Statistics */
+	uint32_t Syncs;
+	uint32_t Fups;
+	uint32_t Unmatched;            // TX events matching no pending SYNC
+	uint32_t Overflows;            // T0 more than 3 s past the SYNC seconds
+} CANTS_MasterTypeDef_t;
+
+/***** Slave Structure *****/
+typedef struct {
+	/* Configuration */
+	uint32_t Id;
+	uint8_t Extended;
+	uint8_t Domain;
+	uint64_t FollowUpTimeoutNs;    // Longest SYNC to FUP gap
+	uint64_t TimeoutNs;            // No pair for this long: CANTS_TIMEOUT
+	uint64_t RateWindowNs;         // Shortest rate measurement, 0 = no rate correction
+	int32_t MaxRatePpb;            // Larger measured rates are rejected
+
+	/* Last SYNC */
+	uint8_t SyncValid;
+	uint8_t SyncSeq;
+	uint32_t SyncSec;
+	uint64_t SyncLocalNs;
+
+	/* Clock: global = RefGlobalNs + elapsed local * (1 + RatePpb / 1e9) */
+	uint8_t Synced;
+	uint64_t RefLocalNs;
+	uint64_t RefGlobalNs;
+	int32_t RatePpb;
+	uint64_t RateLocalNs;          // Start of the rate measurement
+	uint64_t RateGlobalNs;
+
+	/* Statistics */
+	uint32_t Syncs;
+	uint32_t Fups;
+	uint32_t Pairs;                // Offset corrections
+	uint32_t Discarded;            // Wrong domain or type, FUP without its SYNC, late
+	uint32_t RateUpdates;
+	uint32_t RateRejected;
+	int64_t LastErrorNs;           // Estimate minus master time at the last pair
+	uint64_t MaxErrorNs;           // Largest |LastErrorNs| once the rate is known
+} CANTS_SlaveTypeDef_t;
+
+/***** Time Sync API *****/
+void CANTS_MASTER_INIT(CANTS_MasterTypeDef_t *hMaster);
+void CANTS_MASTER_SYNC(CANTS_MasterTypeDef_t *hMaster,
+		FDCAN_FrameTypeDef_t *pFrame, uint64_t localNs);
+uint8_t CANTS_MASTER_TX_EVENT(CANTS_MasterTypeDef_t *hMaster, uint8_t marker,
+		uint64_t t0LocalNs, FDCAN_FrameTypeDef_t *pFup);
+uint64_t CANTS_MASTER_GLOBAL(const CANTS_MasterTypeDef_t *hMaster,
+		uint64_t localNs);
+void CANTS_SLAVE_INIT(CANTS_SlaveTypeDef_t *hSlave);
+void CANTS_SLAVE_RX(CANTS_SlaveTypeDef_t *hSlave,
+		const FDCAN_FrameTypeDef_t *pFrame, uint64_t rxLocalNs);
+uint8_t CANTS_SLAVE_GLOBAL(const CANTS_SlaveTypeDef_t *hSlave,
+		uint64_t localNs, uint64_t *pGlobalNs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CAN_TIMESYNC_H */
@@ -0,0 +1,127 @@
+/**
+ ******************************************************************************
+ * @file           : can_traffic.h
+ * @brief          : Traffic generator for bus stress and soak tests: frames
+ *                   from configurable streams at a target bus load.
+ *
+ * A stream draws each frame's identifier and DLC uniformly from its ranges,
+ * and sends it as FD with FdPermille odds, with BRS on BrsPermille of those.
+ * Streams with a PeriodUs are periodic: a frame every period, up to JitterUs
+ * late. The others are fill streams: they share whatever bus time the target
+ * load leaves, by Weight.
+ *
+ * The target is a share of bus time in permille: LoadPermille, or
+ * BurstLoadPermille for the first BurstLengthUs of every BurstPeriodUs.
+ * Bus time the target allows accrues as credit; every frame queued spends
+ * its worst-case wire time (the can_stats.c frame model at the configured
+ * bit rates), periodic frames included. Fill frames go out while the credit
+ * is positive, so a 1000 permille target keeps the TX FIFO full. Credit
+ * saved while the FIFO is full is capped at CANGEN_CREDIT_CAP_US, so a
+ * stalled bus does not turn into a burst later.
+ *
+ * CANGEN_POLL queues what is due through the Transmit hook; call it from a
+ * timer when CANGEN_NEXT_US comes due and whenever the TX FIFO frees an
+ * element. A frame the hook refused is kept and offered first next time.
+ ******************************************************************************
+ */
+
+#ifndef __CAN_TRAFFIC_H
+#define __CAN_TRAFFIC_H
+
+#include <stdint.h>
+#include "fdcan_frame.h"
+#include "can_stats.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***** Limits *****/
+#ifndef CANGEN_CREDIT_CAP_US
+#define CANGEN_CREDIT_CAP_US        2000U // Most bus time saved up while stalled
+#endif
+#define CANGEN_IDLE                 0xFFFFFFFFU // CANGEN_NEXT_US: only a TX slot helps
+#define CANGEN_NONE                 0xFFU // No stream
+
+/***** Hooks *****/
+/* Free-running microsecond counter */
+typedef uint32_t (*CANGEN_GetUs_t)(void);
+/* Queue a frame for transmission, 1 if it was taken */
+typedef uint8_t (*CANGEN_Transmit_t)(void *ctx, const FDCAN_FrameTypeDef_t *pFrame);
+
+/***** Stream *****/
+typedef struct {
+	/* Configuration */
+	uint32_t IdMin;                // Identifier range, inclusive
+	uint32_t IdMax;
+	uint8_t Extended;
+	uint8_t DlcMin;                // DLC range, inclusive; classic frames stop at 8
+	uint8_t DlcMax;
+	uint16_t FdPermille;           // Frames sent as FD
+	uint16_t BrsPermille;          // FD frames with bit rate switch
+	uint32_t PeriodUs;             // Periodic stream, 0 = fill stream
+	uint32_t JitterUs;             // Periodic: release up to this much late
+	uint16_t Weight;               // Fill: share of the fill frames
+
+	/* State */
+	uint32_t NextUs;               // Periodic: start of the next period
+	uint32_t ReleaseUs;            // Periodic: its release, jitter added
+
+	/* Statistics */
+	uint32_t Frames;
+	uint64_t WireNs;
+	uint32_t Skipped;              // Periodic: periods lost behind a full FIFO
+} CANGEN_StreamTypeDef_t;
+
+/***** Generator Structure *****/
+typedef struct {
+	/* Configuration, filled in before CANGEN_INIT */
+	CANGEN_StreamTypeDef_t *Streams;
+	uint8_t StreamCount;
+	uint32_t NominalKbps;
+	uint32_t DataKbps;             // 0 = nominal rate
+	uint16_t LoadPermille;         // Target bus load
+	uint16_t BurstLoadPermille;    // Target during bursts
+	uint32_t BurstPeriodUs;        // 0 = no bursts
+	uint32_t BurstLengthUs;
+	uint32_t Seed;                 // Random sequence, 0 = fixed default
+	CANGEN_GetUs_t GetUs;
+	CANGEN_Transmit_t Transmit;
+	void *Ctx;
+
+	/* Worst-case wire time in ns, by [format][extended][DLC] */
+	uint32_t WireNsTable[CANSTATS_FMT_COUNT][2][16];
+
+	/* State */
+	uint32_t Random;
+	uint32_t LastUs;
+	uint64_t ElapsedUs;            // Since CANGEN_INIT, beyond the 32-bit wrap
+	int64_t CreditNs;              // Bus time allowed and not yet spent
+	uint32_t WeightTotal;
+	uint8_t Held;                  // Frame built and refused by Transmit
+	uint8_t HeldStream;
+	uint32_t HeldNs;
+	FDCAN_FrameTypeDef_t HeldFrame;
+
+	/* Statistics */
+	uint64_t RequestedNs;          // Bus time the target asked for
+	uint64_t WireNs;               // Bus time of the frames queued
+	uint32_t Frames;
+	uint32_t FdFrames;
+	uint32_t BrsFrames;
+	uint32_t FifoFull;             // Refusals by Transmit
+	uint32_t CreditCapped;         // Polls that dropped saved-up credit
+} CANGEN_HandleTypeDef_t;
+
+/***** Traffic Generator API *****/
+void CANGEN_INIT(CANGEN_HandleTypeDef_t *hGen);
+uint32_t CANGEN_POLL(CANGEN_HandleTypeDef_t *hGen);
+uint32_t CANGEN_NEXT_US(const CANGEN_HandleTypeDef_t *hGen);
+uint32_t CANGEN_LOAD_PERMILLE(const CANGEN_HandleTypeDef_t *hGen,
+		uint32_t *pRequested);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CAN_TRAFFIC_H */
@@ -0,0 +1,95 @@
+/**
+ ******************************************************************************
+ * @file           : can_txlatest.h
+ * @brief          : Latest-value transmission over the FDCAN TX FIFO.
+ *
+ * A frame submitted while an older frame of the same identifier is still
+ * pending in the TX FIFO asks the FDCAN to cancel the older one, so the bus
+ * never carries an older value than the newest submitted. Nothing waits for
+ * the cancel: the policy requests it through a hook and returns, and
+ * CANTXL_COMPLETE settles finished cancels from the FIFO registers, called
+ * from the TCF (cancellation finished) interrupt and again by the next
+ * submit.
+ *
+ * In FIFO mode a cancel frees a slot only at the get index. With a free
+ * slot the new frame is queued at once behind the one being cancelled; with
+ * the FIFO full it is parked until the cancel of the get index finishes, and
+ * a newer frame of the same identifier overwrites it there. With the FIFO
+ * full and the older frame further back, the new one is dropped as a plain
+ * transmit would drop it.
+ ******************************************************************************
+ */
+
+#ifndef __CAN_TXLATEST_H
+#define __CAN_TXLATEST_H
+
+#include <stdint.h>
+#include "fdcan_frame.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***** Sizes *****/
+#define CANTXL_SLOTS                3U    // TX FIFO elements, fixed on the H5
+
+/***** Submit Results *****/
+#define CANTXL_DROPPED              0     // As a failed transmit
+#define CANTXL_QUEUED               1
+#define CANTXL_REPLACED             2     // An older frame of the ID is being cancelled or was parked
+
+/***** TX FIFO Snapshot *****/
+typedef struct {
+	uint32_t Pending;              // TXBRP: transmission requested, bit per slot
+	uint32_t Sent;                 // TXBTO: transmission occurred
+	uint32_t T0[CANTXL_SLOTS];     // Word 0 of each element: XTD, RTR, identifier
+	uint8_t FreeLevel;             // TXFQS.TFFL
+	uint8_t GetIndex;              // TXFQS.TFGI
+} CANTXL_FifoTypeDef_t;
+
+/***** Hooks *****/
+/* Read the TX FIFO registers */
+typedef void (*CANTXL_Read_t)(void *ctx, CANTXL_FifoTypeDef_t *pFifo);
+/* Request the cancel of TX FIFO slot 'slot' (TXBCR) */
+typedef void (*CANTXL_Cancel_t)(void *ctx, uint8_t slot);
+/* Queue a frame for transmission, 1 if it was taken */
+typedef uint8_t (*CANTXL_Transmit_t)(void *ctx, const FDCAN_FrameTypeDef_t *pFrame);
+/* A parked frame found no slot once its cancel finished: its submit had
+ * already returned CANTXL_REPLACED, and it never reaches the bus */
+typedef void (*CANTXL_Lost_t)(void *ctx, const FDCAN_FrameTypeDef_t *pFrame);
+
+/***** Latest-value Structure *****/
+typedef struct {
+	/* Configuration, filled in before CANTXL_INIT */
+	CANTXL_Read_t Read;
+	CANTXL_Cancel_t Cancel;
+	CANTXL_Transmit_t Transmit;
+	CANTXL_Lost_t Lost;            // Optional
+	void *Ctx;
+
+	/* Cancels in flight */
+	uint8_t Cancelling;            // Slots with a cancel requested, bit per slot
+	uint32_t CancelKey[CANTXL_SLOTS]; // Identifier bits of the frame being cancelled
+	uint8_t Parked;                // ParkedFrame waits for the cancel of ParkedSlot
+	uint8_t ParkedSlot;
+	FDCAN_FrameTypeDef_t ParkedFrame;
+
+	/* Statistics */
+	uint32_t Cancels;              // Cancels requested
+	uint32_t Cancelled;            // Older frame removed before it went out
+	uint32_t Late;                 // Older frame was on the bus and went out
+	uint32_t Parks;                // Submits parked behind a cancel, FIFO full
+	uint32_t Dropped;              // Submit or parked frame found no slot
+} CANTXL_HandleTypeDef_t;
+
+/***** Latest-value API *****/
+void CANTXL_INIT(CANTXL_HandleTypeDef_t *hTxl);
+uint8_t CANTXL_SUBMIT(CANTXL_HandleTypeDef_t *hTxl,
+		const FDCAN_FrameTypeDef_t *pFrame);
+uint32_t CANTXL_COMPLETE(CANTXL_HandleTypeDef_t *hTxl);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CAN_TXLATEST_H */
@@ -0,0 +1,130 @@
+/**
+ ******************************************************************************
+ * @file           : e2e.h
+ * @brief          : End-to-end protection profiles: CRC and sequence counter
+ *                   written into a payload on TX and checked on RX.
+ *
+ * Profiles, after the AUTOSAR E2E profiles of the same number:
+ *   E2E_P11  CRC-8/SAE-J1850 at byte Offset and a 4-bit counter (0-14) in the
+ *            nibble at bit CounterBit. The CRC covers the two Data ID bytes
+ *            (low first), then every payload byte but its own. Classic CAN.
+ *   E2E_P5   CRC-16/CCITT-FALSE little-endian at Offset, 8-bit counter at
+ *            Offset + 2. The CRC covers the payload without its two bytes,
+ *            then the Data ID, low byte first.
+ *   E2E_P4   12-byte header at Offset, big-endian: length 16, counter 16,
+ *            Data ID 32, CRC-32/AUTOSAR 32. The CRC covers the payload
+ *            without its four bytes. CAN FD, 16 bytes and more.
+ *
+ * The CRC is computed by an engine hook (the STM32H5 CRC unit in main.c),
+ * by slice-by-E2E_SLICES tables built into caller storage, or bit by bit if
+ * neither is given. All three give the same register values, so engines can
+ * be chained and mixed. Nothing is allocated.
+ ******************************************************************************
+ */
+
+#ifndef __E2E_H
+#define __E2E_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***** CRC Types *****/
+#define E2E_CRC8                    0     // CRC-8/SAE-J1850: 0x1D, init and xorout 0xFF
+#define E2E_CRC16                   1     // CRC-16/CCITT-FALSE: 0x1021, init 0xFFFF
+#define E2E_CRC32                   2     // CRC-32/AUTOSAR: 0xF4ACFB13 reflected, init and xorout ~0
+#define E2E_CRC_COUNT               3
+
+/***** Profiles *****/
+#define E2E_P11                     0
+#define E2E_P5                      1
+#define E2E_P4                      2
+
+#define E2E_P4_HEADER_BYTES         12U
+
+/***** Check Results *****/
+#define E2E_OK                      0     // Next counter value
+#define E2E_INITIAL                 1     // First valid frame since E2E_CHANNEL_INIT
+#define E2E_REPEATED                2     // Same counter as the last frame
+#define E2E_OK_SOME_LOST            3     // Up to MaxDeltaCounter frames missed
+#define E2E_WRONG_SEQUENCE          4     // Counter jumped further, resynchronised
+#define E2E_ERROR                   5     // CRC, length or Data ID mismatch
+#define E2E_STATUS_COUNT            6
+
+/***** Table Sizes *****/
+#ifndef E2E_SLICES
+#define E2E_SLICES                  4U    // Bytes per table step: 1, 2, 4 or 8
+#endif
+
+/***** CRC Parameters *****/
+typedef struct {
+	uint8_t Width;                 // 8, 16 or 32 bits
+	uint8_t Reflected;             // LSB-first input and output
+	uint32_t Poly;                 // Normal (MSB-first) form
+	uint32_t Init;
+	uint32_t XorOut;
+	uint32_t Check;                // CRC of "123456789"
+} E2E_CrcParamTypeDef_t;
+
+extern const E2E_CrcParamTypeDef_t E2E_CRC_PARAMS[E2E_CRC_COUNT];
+
+/* Slice tables, 1 KB per slice and CRC type. Non-reflected CRCs are kept
+ * left-aligned in 32 bits so every width shares one table step. */
+typedef struct {
+	uint32_t T[E2E_CRC_COUNT][E2E_SLICES][256];
+} E2E_CrcTablesTypeDef_t;
+
+/***** Hooks *****/
+/* Fold 'length' bytes into the CRC register 'reg' (not yet xored out) */
+typedef uint32_t (*E2E_CrcEngine_t)(void *ctx, uint8_t type, uint32_t reg,
+		const uint8_t *pData, uint32_t length);
+
+/***** CRC Engine *****/
+typedef struct {
+	E2E_CrcEngine_t Engine;        // Optional, used first
+	void *Ctx;
+	const E2E_CrcTablesTypeDef_t *Tables; // Optional, bitwise without both
+} E2E_HandleTypeDef_t;
+
+/***** Protected Channel *****/
+typedef struct {
+	/* Configuration */
+	uint8_t Profile;               // E2E_P11, E2E_P5 or E2E_P4
+	uint32_t DataId;               // 16 bits for P11 and P5
+	uint16_t Offset;               // Byte of the CRC (P11, P5) or header (P4)
+	uint8_t CounterBit;            // P11: counter nibble, bit 0, 4, 8...
+	uint16_t MaxDeltaCounter;      // RX: counter steps still E2E_OK_SOME_LOST
+
+	/* State */
+	uint16_t Counter;              // TX: next to send; RX: last received
+	uint8_t Synced;                // RX: Counter holds a received value
+	uint8_t LastStatus;            // RX
+
+	/* Statistics */
+	uint32_t Frames;
+	uint32_t Status[E2E_STATUS_COUNT]; // RX results
+} E2E_ChannelTypeDef_t;
+
+/***** E2E API *****/
+void E2E_TABLES_INIT(E2E_CrcTablesTypeDef_t *pTables);
+uint32_t E2E_CRC_BITWISE(uint8_t type, uint32_t reg, const uint8_t *pData,
+		uint32_t length);
+uint32_t E2E_CRC_TABLE(const E2E_CrcTablesTypeDef_t *pTables, uint8_t type,
+		uint32_t reg, const uint8_t *pData, uint32_t length);
+uint32_t E2E_CRC_UPDATE(const E2E_HandleTypeDef_t *hE2e, uint8_t type,
+		uint32_t reg, const uint8_t *pData, uint32_t length);
+uint32_t E2E_CRC(const E2E_HandleTypeDef_t *hE2e, uint8_t type,
+		const uint8_t *pData, uint32_t length);
+void E2E_CHANNEL_INIT(E2E_ChannelTypeDef_t *pCh);
+uint8_t E2E_PROTECT(const E2E_HandleTypeDef_t *hE2e, E2E_ChannelTypeDef_t *pCh,
+		uint8_t *pData, uint32_t length);
+uint8_t E2E_CHECK(const E2E_HandleTypeDef_t *hE2e, E2E_ChannelTypeDef_t *pCh,
+		const uint8_t *pData, uint32_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __E2E_H */
@@ -0,0 +1,195 @@
+/**
+ ******************************************************************************
+ * @file           : fdcan_frame.h
+ * @brief          : Compact FDCAN frame stored in message RAM word format.
+ *
+ * The header of a frame is kept exactly as the FDCAN message RAM expects it:
+ * word 0 holds T0/R0 (ESI, XTD, RTR, identifier) and word 1 holds T1/R1
+ * (message marker / filter index, EFC, FDF, BRS, DLC, timestamp). Copying a
+ * frame into or out of message RAM is two header word moves plus the payload
+ * words, with no field-by-field packing on the hot path.
+ ******************************************************************************
+ */
+
+#ifndef __FDCAN_FRAME_H
+#define __FDCAN_FRAME_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Payload capacity of one frame. 64 covers CAN FD; a Classic-only build can
+ * define this as 8 to shrink every frame (and every queue of frames) to 16 bytes. */
+#ifndef FDCAN_FRAME_MAX_DATA
+#define FDCAN_FRAME_MAX_DATA        64U
+#endif
+
+#define FDCAN_FRAME_DATA_WORDS      ((FDCAN_FRAME_MAX_DATA + 3U) / 4U)
+
+/* Accessors are forced inline so the -O0 Debug build does not turn every
+ * field access into a call (and, with FDCAN_RAM_EXEC, a call back to flash) */
+#define FDCAN_INLINE static inline __attribute__((always_inline))
+
+/***** Element word 0 (T0 / R0) bit fields *****/
+#define FDCAN_ELEM_ESI_POS          31    // Error State Indicator
+#define FDCAN_ELEM_XTD_POS          30    // Extended Identifier
+#define FDCAN_ELEM_RTR_POS          29    // Remote Transmission Request
+#define FDCAN_ELEM_STDID_POS        18    // Standard ID is left aligned in the 29-bit field
+#define FDCAN_ELEM_STDID_MASK       0x7FFU
+#define FDCAN_ELEM_EXTID_MASK       0x1FFFFFFFU
+
+/***** Element word 1 (T1 / R1) bit fields *****/
+#define FDCAN_ELEM_ANMF_POS         31    // RX: Accepted Non-matching Frame
+#define FDCAN_ELEM_FIDX_POS         24    // RX: Filter Index (7 bits)
+#define FDCAN_ELEM_MM_POS           24    // TX: Message Marker (8 bits)
+#define FDCAN_ELEM_EFC_POS          23    // TX: Event FIFO Control
+#define FDCAN_ELEM_FDF_POS          21    // FD Format
+#define FDCAN_ELEM_BRS_POS          20    // Bit Rate Switching
+#define FDCAN_ELEM_DLC_POS          16    // Data Length Code (4 bits)
+#define FDCAN_ELEM_RXTS_MASK        0xFFFFU // RX: Timestamp (16 bits)
+
+/***** Compact Frame Structure *****/
+typedef struct {
+	uint32_t w0;                            // T0/R0 word as stored in message RAM
+	uint32_t w1;                            // T1/R1 word as stored in message RAM
+	uint32_t data[FDCAN_FRAME_DATA_WORDS];  // Payload, little-endian byte order
+} FDCAN_FrameTypeDef_t;
+
+/**
+ * @brief  Convert a DLC code (0-15) to the number of payload bytes
+ */
+FDCAN_INLINE uint8_t FDCAN_DLC_TO_BYTES(uint32_t dlc) {
+	static const uint8_t dlcBytes[16] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 12, 16,
+			20, 24, 32, 48, 64 };
+	return dlcBytes[dlc & 0xF];
+}
+
+/**
+ * @brief  Convert a payload length to the smallest DLC code that holds it
+ */
+FDCAN_INLINE uint8_t FDCAN_BYTES_TO_DLC(uint32_t len) {
+	if (len <= 8U) {
+		return (uint8_t) len;
+	} else if (len <= 24U) {
+		return (uint8_t) (8U + ((len - 8U + 3U) >> 2)); // 12, 16, 20, 24
+	} else if (len <= 32U) {
+		return 0xD;
+	} else if (len <= 48U) {
+		return 0xE;
+	}
+	return 0xF;
+}
+
+/***** Identifier accessors (word 0) *****/
+FDCAN_INLINE uint8_t FDCAN_FRAME_IS_EXTENDED(const FDCAN_FrameTypeDef_t *f) {
+	return (uint8_t) ((f->w0 >> FDCAN_ELEM_XTD_POS) & 0x1U);
+}
+
+FDCAN_INLINE uint8_t FDCAN_FRAME_IS_REMOTE(const FDCAN_FrameTypeDef_t *f) {
+	return (uint8_t) ((f->w0 >> FDCAN_ELEM_RTR_POS) & 0x1U);
+}
+
+FDCAN_INLINE uint8_t FDCAN_FRAME_GET_ESI(const FDCAN_FrameTypeDef_t *f) {
+	return (uint8_t) ((f->w0 >> FDCAN_ELEM_ESI_POS) & 0x1U);
+}
+
+FDCAN_INLINE uint32_t FDCAN_FRAME_GET_ID(const FDCAN_FrameTypeDef_t *f) {
+	if (FDCAN_FRAME_IS_EXTENDED(f)) {
+		return f->w0 & FDCAN_ELEM_EXTID_MASK;
+	}
+	return (f->w0 >> FDCAN_ELEM_STDID_POS) & FDCAN_ELEM_STDID_MASK;
+}
+
+/**
+ * @brief  Set identifier and ID type, clearing ESI and RTR
+ * @param  extended: 0 for an 11-bit ID, 1 for a 29-bit ID
+ */
+FDCAN_INLINE void FDCAN_FRAME_SET_ID(FDCAN_FrameTypeDef_t *f, uint32_t id,
+		uint8_t extended) {
+	if (extended) {
+		f->w0 = (1UL << FDCAN_ELEM_XTD_POS) | (id & FDCAN_ELEM_EXTID_MASK);
+	} else {
+		f->w0 = (id & FDCAN_ELEM_STDID_MASK) << FDCAN_ELEM_STDID_POS;
+	}
+}
+
+FDCAN_INLINE void FDCAN_FRAME_SET_REMOTE(FDCAN_FrameTypeDef_t *f) {
+	f->w0 |= (1UL << FDCAN_ELEM_RTR_POS);
+}
+
+/***** Control accessors (word 1) *****/
+FDCAN_INLINE uint8_t FDCAN_FRAME_GET_DLC(const FDCAN_FrameTypeDef_t *f) {
+	return (uint8_t) ((f->w1 >> FDCAN_ELEM_DLC_POS) & 0xFU);
+}
+
+FDCAN_INLINE uint8_t FDCAN_FRAME_GET_LEN(const FDCAN_FrameTypeDef_t *f) {
+	return FDCAN_DLC_TO_BYTES(FDCAN_FRAME_GET_DLC(f));
+}
+
+FDCAN_INLINE uint8_t FDCAN_FRAME_IS_FD(const FDCAN_FrameTypeDef_t *f) {
+	return (uint8_t) ((f->w1 >> FDCAN_ELEM_FDF_POS) & 0x1U);
+}
+
+FDCAN_INLINE uint8_t FDCAN_FRAME_IS_BRS(const FDCAN_FrameTypeDef_t *f) {
+	return (uint8_t) ((f->w1 >> FDCAN_ELEM_BRS_POS) & 0x1U);
+}
+
+FDCAN_INLINE uint16_t FDCAN_FRAME_GET_TIMESTAMP(const FDCAN_FrameTypeDef_t *f) {
+	return (uint16_t) (f->w1 & FDCAN_ELEM_RXTS_MASK);
+}
+
+FDCAN_INLINE uint8_t FDCAN_FRAME_GET_FILTER_INDEX(const FDCAN_FrameTypeDef_t *f) {
+	return (uint8_t) ((f->w1 >> FDCAN_ELEM_FIDX_POS) & 0x7FU);
+}
+
+FDCAN_INLINE uint8_t FDCAN_FRAME_IS_NON_MATCHING(const FDCAN_FrameTypeDef_t *f) {
+	return (uint8_t) ((f->w1 >> FDCAN_ELEM_ANMF_POS) & 0x1U);
+}
+
+/**
+ * @brief  Set the TX control word in one store
+ * @param  dlc: DLC code (use FDCAN_BYTES_TO_DLC for a byte length)
+ * @param  fd: 1 for CAN FD format
+ * @param  brs: 1 for bit rate switching (FD only)
+ */
+FDCAN_INLINE void FDCAN_FRAME_SET_CONTROL(FDCAN_FrameTypeDef_t *f, uint8_t dlc,
+		uint8_t fd, uint8_t brs) {
+	f->w1 = ((uint32_t) (dlc & 0xFU) << FDCAN_ELEM_DLC_POS)
+			| ((uint32_t) (fd & 0x1U) << FDCAN_ELEM_FDF_POS)
+			| ((uint32_t) (brs & 0x1U) << FDCAN_ELEM_BRS_POS);
+}
+
+/**
+ * @brief  Request a TX event FIFO entry tagged with a message marker
+ */
+FDCAN_INLINE void FDCAN_FRAME_SET_MARKER(FDCAN_FrameTypeDef_t *f,
+		uint8_t marker) {
+	f->w1 = (f->w1 & ~(0xFFUL << FDCAN_ELEM_MM_POS))
+			| ((uint32_t) marker << FDCAN_ELEM_MM_POS)
+			| (1UL << FDCAN_ELEM_EFC_POS);
+}
+
+/***** Payload accessors *****/
+FDCAN_INLINE uint8_t* FDCAN_FRAME_DATA(FDCAN_FrameTypeDef_t *f) {
+	return (uint8_t*) f->data;
+}
+
+FDCAN_INLINE const uint8_t* FDCAN_FRAME_CDATA(const FDCAN_FrameTypeDef_t *f) {
+	return (const uint8_t*) f->data;
+}
+
+/**
+ * @brief  Number of payload words that must be moved for this frame
+ */
+FDCAN_INLINE uint32_t FDCAN_FRAME_DATA_WORD_COUNT(const FDCAN_FrameTypeDef_t *f) {
+	uint32_t words = ((uint32_t) FDCAN_FRAME_GET_LEN(f) + 3U) >> 2;
+	return (words > FDCAN_FRAME_DATA_WORDS) ? FDCAN_FRAME_DATA_WORDS : words;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __FDCAN_FRAME_H */
@@ -0,0 +1,121 @@
+/**
+ ******************************************************************************
+ * @file           : fw_update.h
+ * @brief          : Streaming firmware update into an inactive flash region.
+ *
+ * The image arrives in blocks (one UDS TransferData each) and goes into one
+ * of two RAM buffers. While the next block fills the other buffer, the flash
+ * engine programs the committed one quad-word (16 bytes) at a time, so the
+ * flash time hides behind the bus time. Sectors are erased ahead of the
+ * data whenever the flash has nothing to program.
+ *
+ * The engine never waits for the flash: Erase and Program only start an
+ * operation, and the caller reports its end with FWU_FLASH_DONE, from the
+ * flash end-of-operation interrupt on target. Each buffer is read back from
+ * flash once programmed and folded into a CRC-32, so the check at the end
+ * covers what really is in flash and costs nothing extra.
+ *
+ * Every block except the last must be a multiple of FWU_QUAD_WORD bytes and
+ * at most FWU_BUFFER_BYTES long. FWU_WRITE, FWU_BLOCK_END, FWU_FINISH,
+ * FWU_ABORT and FWU_FLASH_DONE must not preempt each other.
+ ******************************************************************************
+ */
+
+#ifndef __FW_UPDATE_H
+#define __FW_UPDATE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***** Sizes *****/
+#define FWU_QUAD_WORD               16U   // Flash programming unit
+#ifndef FWU_BUFFER_BYTES
+#define FWU_BUFFER_BYTES            2048U // Per buffer, two of them
+#endif
+#define FWU_ERASED_BYTE             0xFFU // Pads the last quad-word
+
+/***** Results *****/
+#define FWU_OK                      0
+#define FWU_BUSY                    1     // No free buffer yet, or flash still working
+#define FWU_ERR_RANGE               2     // Image outside the region or misaligned
+#define FWU_ERR_SEQUENCE            3     // Data outside the block being filled
+#define FWU_ERR_FLASH               4     // Erase or program reported an error
+
+/***** Update States *****/
+#define FWU_STATE_IDLE              0
+#define FWU_STATE_RECEIVING         1     // Between FWU_BEGIN and FWU_FINISH
+#define FWU_STATE_DONE              2     // Everything programmed and read back
+#define FWU_STATE_FAILED            3
+
+/***** Flash Operations *****/
+#define FWU_OP_NONE                 0
+#define FWU_OP_ERASE                1
+#define FWU_OP_PROGRAM              2
+
+/***** Hooks *****/
+/* Start erasing the sector at 'address', return 0 if started */
+typedef uint8_t (*FWU_Erase_t)(void *ctx, uint32_t address);
+
+/* Start programming one quad-word at 'address', return 0 if started */
+typedef uint8_t (*FWU_Program_t)(void *ctx, uint32_t address,
+		const uint32_t *pQuadWord);
+
+/***** Update Structure *****/
+typedef struct {
+	/* Configuration, filled in before FWU_INIT */
+	uint32_t RegionAddress;        // Flash the image may go to
+	uint32_t RegionSize;
+	uint32_t SectorSize;           // Erase unit, the region is sector aligned
+	const uint8_t *RegionData;     // Where the region reads back
+	FWU_Erase_t Erase;
+	FWU_Program_t Program;
+	void *Ctx;                     // Passed back to every hook
+
+	/* Image */
+	uint8_t State;
+	uint8_t Error;                 // FWU_ERR_* once FAILED
+	uint32_t Address;              // Image start, quad-word aligned
+	uint32_t Size;
+	uint32_t Committed;            // Bytes handed to the flash engine
+	uint32_t Programmed;           // Bytes programmed and read back
+	uint32_t Crc;                  // CRC-32 of the Programmed bytes, read from flash
+
+	/* Double buffer */
+	uint32_t Buffer[2][FWU_BUFFER_BYTES / 4U]; // Word aligned for the flash
+	uint32_t BufferOffset[2];      // Image offset of the buffer's first byte
+	uint32_t BufferLength[2];      // Data bytes, without padding
+	uint8_t Fill;                  // Buffer taking the current block
+	uint32_t FillLength;
+	uint8_t Queued;                // Bit per buffer waiting for or in the flash
+
+	/* Flash engine */
+	uint8_t FlashOp;               // Operation in progress
+	uint8_t Prog;                  // Buffer being programmed
+	uint32_t ProgOffset;           // Its next quad-word
+	uint32_t ErasedEnd;            // Address below which the image area is erased
+
+	/* Statistics */
+	uint32_t Erases;
+	uint32_t QuadWords;
+	uint32_t Stalls;               // Blocks that had to wait for a free buffer
+} FWU_HandleTypeDef_t;
+
+/***** Firmware Update API *****/
+void FWU_INIT(FWU_HandleTypeDef_t *hFwu);
+uint8_t FWU_BEGIN(FWU_HandleTypeDef_t *hFwu, uint32_t address, uint32_t size);
+uint8_t FWU_WRITE(FWU_HandleTypeDef_t *hFwu, uint32_t offset,
+		const uint8_t *pData, uint32_t length);
+uint8_t FWU_BLOCK_END(FWU_HandleTypeDef_t *hFwu);
+uint8_t FWU_FINISH(FWU_HandleTypeDef_t *hFwu);
+void FWU_ABORT(FWU_HandleTypeDef_t *hFwu);
+void FWU_FLASH_DONE(FWU_HandleTypeDef_t *hFwu, uint8_t failed);
+uint32_t FWU_CRC32(uint32_t crc, const uint8_t *pData, uint32_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __FW_UPDATE_H */
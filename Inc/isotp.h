@@ -0,0 +1,173 @@
+/**
+ ******************************************************************************
+ * @file           : isotp.h
+ * @brief          : ISO 15765-2 (ISO-TP) transport over compact FDCAN frames.
+ *
+ * Segments and reassembles messages of up to 4 GB into Single, First and
+ * Consecutive Frames with Flow Control, for Classic CAN (TX_DL = 8) and
+ * CAN FD (TX_DL = 12..64). Payload is read straight from the caller's buffer
+ * when sending, and handed to the caller frame by frame when receiving, so no
+ * full-message copy is made inside the layer.
+ *
+ * The layer is driver independent: frames leave through the SendFrame hook,
+ * received frames are fed in with ISOTP_RX_FRAME, and timing (STmin, N_Bs,
+ * N_Cr) runs off the GetTicks hook, driven by ISOTP_POLL.
+ ******************************************************************************
+ */
+
+#ifndef __ISOTP_H
+#define __ISOTP_H
+
+#include <stdint.h>
+#include "fdcan_frame.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***** Protocol Control Information (high nibble of byte 0) *****/
+#define ISOTP_PCI_SF                0x0   // Single Frame
+#define ISOTP_PCI_FF                0x1   // First Frame
+#define ISOTP_PCI_CF                0x2   // Consecutive Frame
+#define ISOTP_PCI_FC                0x3   // Flow Control
+
+/***** Flow Status *****/
+#define ISOTP_FS_CTS                0x0   // Continue To Send
+#define ISOTP_FS_WAIT               0x1   // Wait for another FC
+#define ISOTP_FS_OVFLW              0x2   // Message too large for the receiver
+
+/***** Result Codes (TxDone / RxDone) *****/
+#define ISOTP_OK                    0     // Transfer complete
+#define ISOTP_BUSY                  1     // A transfer is already in progress
+#define ISOTP_ERR_LENGTH            2     // Zero length or malformed length field
+#define ISOTP_ERR_TIMEOUT_BS        3     // N_Bs: no Flow Control in time
+#define ISOTP_ERR_TIMEOUT_CR        4     // N_Cr: no Consecutive Frame in time
+#define ISOTP_ERR_SEQUENCE          5     // Wrong Consecutive Frame sequence number
+#define ISOTP_ERR_OVERFLOW          6     // Receiver cannot hold the message
+#define ISOTP_ERR_WFT_OVRN          7     // Too many FC.WAIT in a row
+#define ISOTP_ERR_ABORTED           8     // Reception replaced by a new SF/FF
+#define ISOTP_ERR_CONFIG            9     // ISOTP_INIT: RxBuffer without RxBufferSize
+
+/***** Transmit States *****/
+#define ISOTP_TX_IDLE               0
+#define ISOTP_TX_SEND_FIRST         1     // SF or FF waiting for a free TX slot
+#define ISOTP_TX_WAIT_FC            2     // FF or block sent, waiting for FC
+#define ISOTP_TX_SEND_CF            3     // Sending Consecutive Frames
+
+/***** Receive States *****/
+#define ISOTP_RX_IDLE               0
+#define ISOTP_RX_SEND_FC            1     // FC waiting for a free TX slot
+#define ISOTP_RX_RECEIVING          2     // Waiting for Consecutive Frames
+
+/***** Protocol Limits and Defaults *****/
+#define ISOTP_FF_DL12_MAX           4095U // Larger messages use the 32-bit FF_DL escape
+#define ISOTP_TIMEOUT_BS_MS         1000U // N_Bs
+#define ISOTP_TIMEOUT_CR_MS         1000U // N_Cr
+#define ISOTP_MAX_WFT               8U    // FC.WAIT frames accepted in a row
+
+/***** Hooks *****/
+/* Queue one frame for transmission, return 1 if queued, 0 if no TX slot is free */
+typedef uint8_t (*ISOTP_SendFrame_t)(void *ctx, const FDCAN_FrameTypeDef_t *pFrame);
+
+/* Free-running tick counter for STmin and timeouts */
+typedef uint32_t (*ISOTP_GetTicks_t)(void);
+
+/* Received payload bytes [offset, offset + len) of the current message.
+ * 'data' points into the received frame and is only valid during the call. */
+typedef void (*ISOTP_RxChunk_t)(void *ctx, uint32_t offset,
+		const uint8_t *data, uint32_t len);
+
+/* First Frame or Single Frame seen: 'length' bytes are on their way */
+typedef void (*ISOTP_RxStart_t)(void *ctx, uint32_t length);
+
+/* Reception finished with 'result' after 'length' bytes */
+typedef void (*ISOTP_RxDone_t)(void *ctx, uint32_t length, uint8_t result);
+
+/* Transmission finished with 'result' */
+typedef void (*ISOTP_TxDone_t)(void *ctx, uint8_t result);
+
+/***** ISO-TP Channel Structure *****/
+typedef struct {
+	/* Configuration, filled in before ISOTP_INIT */
+	uint32_t TxId;                 // Identifier of frames we send
+	uint32_t RxId;                 // Identifier of frames we accept
+	uint8_t IdExtended;            // 1 for 29-bit identifiers
+	uint8_t TxDataLength;          // TX_DL: 8 for Classic, up to 64 for FD
+	uint8_t BitRateSwitch;         // FD frames with BRS
+	uint8_t BlockSize;             // BS we advertise in our FC (0 = no limit)
+	uint8_t STmin;                 // STmin we advertise in our FC (ISO encoding)
+	uint8_t PadFrames;             // Pad Classic frames to 8 bytes
+	uint8_t PadByte;               // Value of padding bytes
+	uint32_t TicksPerUs;           // GetTicks rate
+	ISOTP_GetTicks_t GetTicks;
+	ISOTP_SendFrame_t SendFrame;
+	void *Ctx;                     // Passed back to every hook
+
+	/* Receive sink: RxBuffer and/or RxChunk. RxBuffer needs RxBufferSize, its
+	 * length in bytes: ISOTP_INIT refuses RxBuffer with RxBufferSize 0. With
+	 * only RxChunk, 0 means the message size is not limited by RAM and a
+	 * non-zero RxBufferSize still caps it. */
+	uint8_t *RxBuffer;
+	uint32_t RxBufferSize;
+	ISOTP_RxStart_t RxStart;
+	ISOTP_RxChunk_t RxChunk;
+	ISOTP_RxDone_t RxDone;
+	ISOTP_TxDone_t TxDone;
+
+	/* Transmit state */
+	const uint8_t *TxData;         // Caller buffer, valid until TxDone
+	uint32_t TxLength;
+	uint32_t TxOffset;             // Next byte to send
+	uint32_t TxDeadline;           // N_Bs expiry or next CF time (STmin)
+	uint32_t TxStminTicks;         // Receiver's STmin
+	uint8_t TxState;
+	uint8_t TxSeq;                 // Next CF sequence number
+	uint8_t TxBlockLeft;           // CFs left in this block, 0 = unlimited
+	uint8_t TxBlockSize;           // Receiver's BS
+	uint8_t TxWaitCount;           // Consecutive FC.WAIT
+
+	/* Receive state */
+	uint32_t RxLength;             // FF_DL of the current message
+	uint32_t RxOffset;             // Bytes received so far
+	uint32_t RxDeadline;           // N_Cr expiry
+	uint8_t RxState;
+	uint8_t RxSeq;                 // Expected CF sequence number
+	uint8_t RxBlockLeft;           // CFs left before our next FC
+	uint8_t RxFlowStatus;          // Flow status of the pending FC
+
+	/* Statistics */
+	uint32_t TxFrames;
+	uint32_t RxFrames;
+	uint32_t TxMessages;
+	uint32_t RxMessages;
+	uint32_t Errors;
+} ISOTP_HandleTypeDef_t;
+
+/***** ISO-TP API *****/
+uint8_t ISOTP_INIT(ISOTP_HandleTypeDef_t *hIsoTp);
+uint8_t ISOTP_SEND(ISOTP_HandleTypeDef_t *hIsoTp, const uint8_t *pData,
+		uint32_t length);
+uint8_t ISOTP_RX_FRAME(ISOTP_HandleTypeDef_t *hIsoTp,
+		const FDCAN_FrameTypeDef_t *pFrame);
+void ISOTP_POLL(ISOTP_HandleTypeDef_t *hIsoTp);
+uint32_t ISOTP_STMIN_TO_US(uint8_t stmin);
+
+/**
+ * @brief  1 while a message is being sent
+ */
+FDCAN_INLINE uint8_t ISOTP_TX_BUSY(const ISOTP_HandleTypeDef_t *hIsoTp) {
+	return hIsoTp->TxState != ISOTP_TX_IDLE;
+}
+
+/**
+ * @brief  1 while a message is being received
+ */
+FDCAN_INLINE uint8_t ISOTP_RX_BUSY(const ISOTP_HandleTypeDef_t *hIsoTp) {
+	return hIsoTp->RxState != ISOTP_RX_IDLE;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ISOTP_H */
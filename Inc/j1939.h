@@ -0,0 +1,250 @@
+/**
+ ******************************************************************************
+ * @file           : j1939.h
+ * @brief          : SAE J1939 node: PGN addressing, address claim and the
+ *                   BAM / CMDT multi-packet transport protocol.
+ *
+ * A 29-bit J1939 identifier is laid out as
+ *   [28:26] priority  [25] EDP  [24] DP  [23:16] PF  [15:8] PS  [7:0] SA
+ * PF < 240 (PDU1): PS is the destination address and not part of the PGN.
+ * PF >= 240 (PDU2): PS is the group extension and the message is broadcast.
+ *
+ * Transport sessions live in fixed slot tables sized at compile time, so no
+ * allocation happens at run time and a full table is reported, not grown.
+ * Like the ISO-TP layer, the node is driver independent: frames leave through
+ * SendFrame, received frames are fed to J1939_RX_FRAME and timers run off
+ * GetTicks from J1939_POLL.
+ ******************************************************************************
+ */
+
+#ifndef __J1939_H
+#define __J1939_H
+
+#include <stdint.h>
+#include "fdcan_frame.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***** Session Table Sizes *****/
+#ifndef J1939_TP_RX_SESSIONS
+#define J1939_TP_RX_SESSIONS        2     // Concurrent incoming BAM/CMDT messages
+#endif
+#ifndef J1939_TP_TX_SESSIONS
+#define J1939_TP_TX_SESSIONS        2     // Concurrent outgoing BAM/CMDT messages
+#endif
+#ifndef J1939_TP_BUFFER_SIZE
+#define J1939_TP_BUFFER_SIZE        1785U // Reassembly buffer per RX slot (protocol max)
+#endif
+#ifndef J1939_TP_CTS_PACKETS
+#define J1939_TP_CTS_PACKETS        16U   // Packets we grant per CTS
+#endif
+
+/***** Identifier Fields *****/
+#define J1939_PRIORITY_POS          26
+#define J1939_DP_POS                24    // EDP/DP, part of the PGN
+#define J1939_PF_POS                16
+#define J1939_PS_POS                8
+#define J1939_PF_PDU2               240U  // PF from here on is broadcast (PDU2)
+
+/***** Addresses *****/
+#define J1939_ADDR_GLOBAL           0xFFU
+#define J1939_ADDR_NULL             0xFEU // Source address of "cannot claim"
+#define J1939_ADDR_DYNAMIC_MIN      128U  // Range used by arbitrary address capable nodes
+#define J1939_ADDR_DYNAMIC_MAX      247U
+
+/***** Parameter Group Numbers *****/
+#define J1939_PGN_REQUEST           0x0EA00U
+#define J1939_PGN_ADDRESS_CLAIMED   0x0EE00U
+#define J1939_PGN_TP_CM             0x0EC00U // Transport connection management
+#define J1939_PGN_TP_DT             0x0EB00U // Transport data transfer
+
+/***** Default Priorities *****/
+#define J1939_PRIORITY_CONTROL      3U
+#define J1939_PRIORITY_DEFAULT      6U
+#define J1939_PRIORITY_TP           7U
+
+/***** TP.CM Control Bytes *****/
+#define J1939_TP_CM_RTS             16U
+#define J1939_TP_CM_CTS             17U
+#define J1939_TP_CM_EOMA            19U   // End of message acknowledge
+#define J1939_TP_CM_BAM             32U
+#define J1939_TP_CM_ABORT           255U
+
+/***** TP Abort Reasons *****/
+#define J1939_ABORT_BUSY            1U    // Already in a session with this node
+#define J1939_ABORT_RESOURCES       2U    // No slot or message too large
+#define J1939_ABORT_TIMEOUT         3U
+#define J1939_ABORT_BAD_SEQUENCE    7U    // Data packet out of order
+
+/***** TP Limits and Timeouts (J1939-21) *****/
+#define J1939_TP_PACKET_DATA        7U
+#define J1939_TP_MAX_SIZE           1785U // 255 packets of 7 bytes
+#define J1939_TP_BAM_INTERVAL_MS    50U   // Gap between BAM data packets (50-200 ms)
+#define J1939_TP_T1_MS              750U  // Receiver: gap between data packets
+#define J1939_TP_T2_MS              1250U // Receiver: CTS sent, no data
+#define J1939_TP_T3_MS              1250U // Sender: waiting for CTS or EOMA
+#define J1939_TP_T4_MS              1050U // Sender: held by CTS with 0 packets
+#define J1939_CLAIM_WAIT_MS         250U  // Address claim contention window
+
+/***** Result Codes *****/
+#define J1939_OK                    0
+#define J1939_BUSY                  1     // No free session slot or TX slot
+#define J1939_ERR_LENGTH            2     // Zero length or above J1939_TP_MAX_SIZE
+#define J1939_ERR_NO_ADDRESS        3     // Address not (yet) claimed
+#define J1939_ERR_ABORTED           4     // Peer sent TP.CM Abort
+#define J1939_ERR_TIMEOUT           5
+
+/***** Address Claim States *****/
+#define J1939_CLAIM_IDLE            0
+#define J1939_CLAIM_PENDING         1     // Claim sent, contention window open
+#define J1939_CLAIM_DONE            2     // Address usable
+#define J1939_CLAIM_LOST            3     // Cannot claim, node is silent
+
+/***** Session States *****/
+#define J1939_TP_FREE               0
+#define J1939_TP_RX_BAM             1
+#define J1939_TP_RX_CMDT            2
+#define J1939_TP_TX_BAM             3
+#define J1939_TP_TX_CMDT_WAIT_CTS   4
+#define J1939_TP_TX_CMDT_DATA       5
+#define J1939_TP_TX_CMDT_WAIT_EOMA  6
+
+/***** Hooks *****/
+/* Queue one frame for transmission, return 1 if queued, 0 if no TX slot is free */
+typedef uint8_t (*J1939_SendFrame_t)(void *ctx, const FDCAN_FrameTypeDef_t *pFrame);
+
+/* Free-running tick counter for claim and transport timers */
+typedef uint32_t (*J1939_GetTicks_t)(void);
+
+/* A complete message for us: single frame or reassembled transport message.
+ * 'data' is only valid during the call. */
+typedef void (*J1939_RxMessage_t)(void *ctx, uint32_t pgn, uint8_t sa,
+		uint8_t da, const uint8_t *data, uint32_t len);
+
+/* A transport transmission finished with 'result' */
+typedef void (*J1939_TxDone_t)(void *ctx, uint32_t pgn, uint8_t da,
+		uint8_t result);
+
+/***** Transport Session Slot *****/
+typedef struct {
+	uint8_t State;
+	uint8_t Peer;                  // RX: source address, TX: destination
+	uint8_t PendingCm;             // TP.CM control byte still to send, 0 = none
+	uint8_t AbortReason;           // Reason for a pending abort
+	uint32_t Pgn;
+	uint32_t Size;
+	uint8_t Packets;               // Total data packets
+	uint16_t NextSeq;              // Next packet to send or expect (1-based, up to 256)
+	uint16_t WindowEnd;            // Last packet of the current CTS window
+	uint8_t MaxPerCts;             // RTS: peer limit on packets per CTS
+	uint32_t Deadline;             // Timeout or BAM pacing
+	const uint8_t *TxData;         // Caller buffer, valid until TxDone
+} J1939_TpSessionTypeDef_t;
+
+typedef struct {
+	J1939_TpSessionTypeDef_t Session;
+	uint8_t Buffer[J1939_TP_BUFFER_SIZE];
+} J1939_TpRxSlotTypeDef_t;
+
+/***** J1939 Node Structure *****/
+typedef struct {
+	/* Configuration, filled in before J1939_INIT */
+	uint64_t Name;                 // 64-bit NAME, lower value wins a claim
+	uint8_t PreferredAddress;
+	uint32_t TicksPerUs;           // GetTicks rate
+	J1939_GetTicks_t GetTicks;
+	J1939_SendFrame_t SendFrame;
+	J1939_RxMessage_t RxMessage;
+	J1939_TxDone_t TxDone;
+	void *Ctx;                     // Passed back to every hook
+
+	/* Address claim */
+	uint8_t Address;               // Current source address
+	uint8_t ClaimState;
+	uint8_t ClaimPending;          // Address Claimed frame still to send
+	uint32_t ClaimDeadline;
+	uint32_t AddressInUse[8];      // Bitmap of addresses claimed by others
+
+	/* Transport session slots */
+	J1939_TpRxSlotTypeDef_t RxSlots[J1939_TP_RX_SESSIONS];
+	J1939_TpSessionTypeDef_t TxSlots[J1939_TP_TX_SESSIONS];
+
+	/* Statistics */
+	uint32_t TxFrames;
+	uint32_t RxFrames;
+	uint32_t TpRxMessages;
+	uint32_t TpTxMessages;
+	uint32_t TpAborts;
+	uint32_t TpSlotFull;           // RTS/BAM refused for lack of a slot
+} J1939_HandleTypeDef_t;
+
+/***** Identifier Helpers *****/
+FDCAN_INLINE uint8_t J1939_ID_GET_PRIORITY(uint32_t id) {
+	return (uint8_t) ((id >> J1939_PRIORITY_POS) & 0x7U);
+}
+
+FDCAN_INLINE uint8_t J1939_ID_GET_SA(uint32_t id) {
+	return (uint8_t) id;
+}
+
+FDCAN_INLINE uint8_t J1939_ID_GET_PF(uint32_t id) {
+	return (uint8_t) (id >> J1939_PF_POS);
+}
+
+/**
+ * @brief  Parameter group number, PS excluded for PDU1
+ */
+FDCAN_INLINE uint32_t J1939_ID_GET_PGN(uint32_t id) {
+	uint32_t pgn = (id >> J1939_PS_POS) & 0x3FFFFU;
+	if (J1939_ID_GET_PF(id) < J1939_PF_PDU2) {
+		pgn &= 0x3FF00U;
+	}
+	return pgn;
+}
+
+/**
+ * @brief  Destination address, global for PDU2
+ */
+FDCAN_INLINE uint8_t J1939_ID_GET_DA(uint32_t id) {
+	if (J1939_ID_GET_PF(id) < J1939_PF_PDU2) {
+		return (uint8_t) (id >> J1939_PS_POS);
+	}
+	return J1939_ADDR_GLOBAL;
+}
+
+/**
+ * @brief  Build a 29-bit identifier; 'da' is ignored for PDU2 PGNs
+ */
+FDCAN_INLINE uint32_t J1939_ID_MAKE(uint8_t priority, uint32_t pgn, uint8_t da,
+		uint8_t sa) {
+	uint32_t id = ((uint32_t) (priority & 0x7U) << J1939_PRIORITY_POS)
+			| ((pgn & 0x3FFFFU) << J1939_PS_POS) | sa;
+	if (((pgn >> 8) & 0xFFU) < J1939_PF_PDU2) {
+		id = (id & ~(0xFFUL << J1939_PS_POS)) | ((uint32_t) da << J1939_PS_POS);
+	}
+	return id;
+}
+
+/***** J1939 API *****/
+void J1939_INIT(J1939_HandleTypeDef_t *hJ1939);
+uint8_t J1939_SEND(J1939_HandleTypeDef_t *hJ1939, uint8_t priority,
+		uint32_t pgn, uint8_t da, const uint8_t *pData, uint32_t length);
+uint8_t J1939_REQUEST(J1939_HandleTypeDef_t *hJ1939, uint32_t pgn, uint8_t da);
+uint8_t J1939_RX_FRAME(J1939_HandleTypeDef_t *hJ1939,
+		const FDCAN_FrameTypeDef_t *pFrame);
+void J1939_POLL(J1939_HandleTypeDef_t *hJ1939);
+
+/**
+ * @brief  1 once the node owns an address and may send
+ */
+FDCAN_INLINE uint8_t J1939_ADDRESS_CLAIMED(const J1939_HandleTypeDef_t *hJ1939) {
+	return hJ1939->ClaimState == J1939_CLAIM_DONE;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __J1939_H */
@@ -0,0 +1,239 @@
+/**
+ ******************************************************************************
+ * @file           : uds.h
+ * @brief          : UDS (ISO 14229-1) diagnostic server over ISO-TP.
+ *
+ * Services: DiagnosticSessionControl, ECUReset, ReadDataByIdentifier (any
+ * number of DIDs per request), WriteDataByIdentifier, RoutineControl,
+ * RequestDownload, TransferData, RequestTransferExit and TesterPresent.
+ *
+ * DIDs and routines live in const tables sorted by identifier, so they stay
+ * in flash and a lookup is a binary search. UDS_INIT checks the order once
+ * and refuses unsorted tables.
+ *
+ * TransferData is never buffered whole: ISO-TP hands the block over frame by
+ * frame and the data goes straight to the download sink, so the block length
+ * offered to the tester is not limited by RAM.
+ *
+ * A hook that needs more time returns UDS_NRC_RESPONSE_PENDING: the server
+ * sends NRC 0x78 and calls the hook again from UDS_POLL, repeating 0x78
+ * before P2* runs out, until it returns a final result.
+ *
+ * The server owns its ISO-TP channel. Fill in the addressing and frame
+ * format of IsoTp (TxId, RxId, IdExtended, TxDataLength, BitRateSwitch,
+ * PadFrames, PadByte, BlockSize, STmin, TicksPerUs, GetTicks) and SendFrame
+ * and Ctx here; UDS_INIT installs the ISO-TP hooks. UDS_RX_FRAME and
+ * UDS_POLL must not preempt each other.
+ ******************************************************************************
+ */
+
+#ifndef __UDS_H
+#define __UDS_H
+
+#include <stdint.h>
+#include "isotp.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***** Buffer Sizes *****/
+#ifndef UDS_MAX_REQUEST
+#define UDS_MAX_REQUEST             128U  // Every request except TransferData
+#endif
+#ifndef UDS_MAX_RESPONSE
+#define UDS_MAX_RESPONSE            256U  // ReadDataByIdentifier batches included
+#endif
+#ifndef UDS_MAX_BLOCK_LENGTH
+#define UDS_MAX_BLOCK_LENGTH        4095U // TransferData, SID and counter included
+#endif
+
+/***** Service Identifiers *****/
+#define UDS_SID_SESSION_CONTROL     0x10U
+#define UDS_SID_ECU_RESET           0x11U
+#define UDS_SID_READ_DID            0x22U
+#define UDS_SID_WRITE_DID           0x2EU
+#define UDS_SID_ROUTINE_CONTROL     0x31U
+#define UDS_SID_REQUEST_DOWNLOAD    0x34U
+#define UDS_SID_TRANSFER_DATA       0x36U
+#define UDS_SID_TRANSFER_EXIT       0x37U
+#define UDS_SID_TESTER_PRESENT      0x3EU
+#define UDS_SID_NEGATIVE_RESPONSE   0x7FU
+#define UDS_POSITIVE_RESPONSE       0x40U // Added to the SID
+#define UDS_SUPPRESS_POS_RSP        0x80U // Sub-function bit
+
+/***** Negative Response Codes *****/
+#define UDS_NRC_GENERAL_REJECT      0x10U
+#define UDS_NRC_SERVICE_NOT_SUPPORTED 0x11U
+#define UDS_NRC_SUBFUNCTION_NOT_SUPPORTED 0x12U
+#define UDS_NRC_INCORRECT_LENGTH    0x13U
+#define UDS_NRC_RESPONSE_TOO_LONG   0x14U
+#define UDS_NRC_CONDITIONS_NOT_CORRECT 0x22U
+#define UDS_NRC_REQUEST_SEQUENCE_ERROR 0x24U
+#define UDS_NRC_REQUEST_OUT_OF_RANGE 0x31U
+#define UDS_NRC_UPLOAD_DOWNLOAD_NOT_ACCEPTED 0x70U
+#define UDS_NRC_TRANSFER_DATA_SUSPENDED 0x71U
+#define UDS_NRC_GENERAL_PROGRAMMING_FAILURE 0x72U
+#define UDS_NRC_WRONG_BLOCK_SEQUENCE 0x73U
+#define UDS_NRC_RESPONSE_PENDING    0x78U
+#define UDS_NRC_SERVICE_NOT_IN_SESSION 0x7FU
+
+/***** Sessions *****/
+#define UDS_SESSION_DEFAULT         0x01U
+#define UDS_SESSION_PROGRAMMING     0x02U
+#define UDS_SESSION_EXTENDED        0x03U
+#define UDS_IN(session)             (1U << (session)) // Session mask bit
+#define UDS_IN_ALL                  (UDS_IN(UDS_SESSION_DEFAULT) \
+		| UDS_IN(UDS_SESSION_PROGRAMMING) | UDS_IN(UDS_SESSION_EXTENDED))
+
+/***** Routine Control Types *****/
+#define UDS_ROUTINE_START           0x01U
+#define UDS_ROUTINE_STOP            0x02U
+#define UDS_ROUTINE_RESULTS         0x03U
+
+/***** Timing *****/
+#define UDS_P2_MS                   50U   // Reported in the session response
+#define UDS_P2_STAR_MS              5000U // Limit after NRC 0x78
+#define UDS_PENDING_REPEAT_MS       2000U // NRC 0x78 repeat, well inside P2*
+#define UDS_S3_MS                   5000U // Back to the default session
+
+/***** Hooks *****/
+/* Queue one frame for transmission, return 1 if queued, 0 if no TX slot is free */
+typedef uint8_t (*UDS_SendFrame_t)(void *ctx, const FDCAN_FrameTypeDef_t *pFrame);
+
+/* Fill the Length bytes of a DID record, return 0 or an NRC */
+typedef uint8_t (*UDS_DidRead_t)(void *ctx, uint16_t did, uint8_t *pOut);
+
+/* Store the Length bytes of a DID record, return 0 or an NRC */
+typedef uint8_t (*UDS_DidWrite_t)(void *ctx, uint16_t did, const uint8_t *pData);
+
+/* Run one routine control type. *pOutLength is the room in pOut on entry and
+ * the status record length on return. Return 0, an NRC, or
+ * UDS_NRC_RESPONSE_PENDING to be called again. */
+typedef uint8_t (*UDS_Routine_t)(void *ctx, uint16_t rid, const uint8_t *pIn,
+		uint32_t inLength, uint8_t *pOut, uint32_t *pOutLength);
+
+/* ECUReset, called once the positive response has been queued */
+typedef void (*UDS_Reset_t)(void *ctx, uint8_t resetType);
+
+/***** DID and Routine Tables *****/
+typedef struct {
+	uint16_t Id;
+	uint16_t Length;               // Record bytes
+	uint8_t ReadSessions;          // UDS_IN() mask, 0 = not readable
+	uint8_t WriteSessions;         // UDS_IN() mask, 0 = read only
+	void *Data;                    // Record in memory, used when a hook is NULL
+	UDS_DidRead_t Read;
+	UDS_DidWrite_t Write;
+} UDS_DidTypeDef_t;
+
+typedef struct {
+	uint16_t Id;
+	uint8_t Sessions;              // UDS_IN() mask
+	UDS_Routine_t Start;           // NULL: sub-function not supported
+	UDS_Routine_t Stop;
+	UDS_Routine_t Results;
+} UDS_RoutineTypeDef_t;
+
+/***** Download Sink *****/
+typedef struct {
+	/* RequestDownload: 0, an NRC or UDS_NRC_RESPONSE_PENDING */
+	uint8_t (*Start)(void *ctx, uint32_t address, uint32_t size);
+	/* Data of the current TransferData block as it arrives; 'offset' counts
+	 * from the start of the download. A block that failed in transport is
+	 * sent again from its first byte. An NRC is answered once the block is
+	 * complete. */
+	uint8_t (*Write)(void *ctx, uint32_t offset, const uint8_t *pData,
+			uint32_t length);
+	/* Block complete: 0, an NRC or UDS_NRC_RESPONSE_PENDING; NULL = 0 */
+	uint8_t (*BlockEnd)(void *ctx);
+	/* RequestTransferExit: 0, an NRC or UDS_NRC_RESPONSE_PENDING; NULL = 0 */
+	uint8_t (*Exit)(void *ctx);
+	/* Download abandoned: session change or S3 timeout */
+	void (*Abort)(void *ctx);
+} UDS_DownloadSinkTypeDef_t;
+
+/***** Per-Service Statistics *****/
+#define UDS_STATS_SERVICES          9U    // One per supported SID
+
+typedef struct {
+	uint8_t Sid;
+	uint32_t Requests;
+	uint32_t Negative;
+	uint32_t Pending;              // NRC 0x78 sent
+	uint32_t TicksTotal;           // Request complete to response queued
+	uint32_t TicksMax;
+} UDS_ServiceStatsTypeDef_t;
+
+/***** UDS Server Structure *****/
+typedef struct {
+	/* Configuration, filled in before UDS_INIT */
+	ISOTP_HandleTypeDef_t IsoTp;   // Addressing and frame format, see above
+	UDS_SendFrame_t SendFrame;
+	void *Ctx;                     // Passed back to every hook
+	const UDS_DidTypeDef_t *Dids;  // Sorted by Id
+	uint16_t DidCount;
+	const UDS_RoutineTypeDef_t *Routines; // Sorted by Id
+	uint16_t RoutineCount;
+	const UDS_DownloadSinkTypeDef_t *Sink; // NULL: no download
+	uint16_t MaxBlockLength;       // Offered for TransferData, 0 = UDS_MAX_BLOCK_LENGTH
+	UDS_Reset_t Reset;             // NULL: ECUReset not supported
+
+	/* Session */
+	uint8_t Session;
+	uint32_t S3Deadline;
+
+	/* Request being received or served */
+	uint8_t Request[UDS_MAX_REQUEST];
+	uint32_t RequestLength;
+	uint32_t RequestTicks;         // Reception complete
+	uint8_t RequestIgnored;        // Arrived while the last one is served
+	uint8_t RequestNrc;            // Latched while the request streams in
+	uint8_t Suppress;              // suppressPosRspMsgIndicationBit
+	uint8_t Busy;                  // A hook asked for more time
+	uint32_t PendingDeadline;      // Next NRC 0x78
+	uint8_t PendingSent;           // 0x78 sent: the final answer is never suppressed
+	uint8_t PendingResponse[3];    // 7F SID 78, apart from Response
+
+	/* Response */
+	uint8_t Response[UDS_MAX_RESPONSE];
+	uint32_t ResponseLength;
+	uint8_t ResponseQueued;        // Waiting for the ISO-TP transmitter
+	uint8_t ResetType;             // ECUReset to run after the response, 0 = none
+
+	/* Download */
+	uint8_t Downloading;
+	uint32_t DownloadAddress;
+	uint32_t DownloadSize;
+	uint32_t DownloadOffset;       // Bytes of completed blocks
+	uint8_t BlockCounter;          // Expected blockSequenceCounter
+	uint8_t BlockRepeat;           // Current block repeats the last one
+
+	/* Statistics */
+	UDS_ServiceStatsTypeDef_t Stats[UDS_STATS_SERVICES];
+	uint32_t Ignored;              // Requests dropped while busy
+	uint32_t S3Timeouts;
+} UDS_HandleTypeDef_t;
+
+/***** UDS API *****/
+uint8_t UDS_INIT(UDS_HandleTypeDef_t *hUds);
+void UDS_POLL(UDS_HandleTypeDef_t *hUds);
+const UDS_DidTypeDef_t* UDS_FIND_DID(const UDS_HandleTypeDef_t *hUds,
+		uint16_t did);
+const UDS_RoutineTypeDef_t* UDS_FIND_ROUTINE(const UDS_HandleTypeDef_t *hUds,
+		uint16_t rid);
+
+/**
+ * @brief  Offer a received frame to the server
+ * @retval 1 if the frame belongs to its ISO-TP channel
+ */
+FDCAN_INLINE uint8_t UDS_RX_FRAME(UDS_HandleTypeDef_t *hUds,
+		const FDCAN_FrameTypeDef_t *pFrame) {
+	return ISOTP_RX_FRAME(&hUds->IsoTp, pFrame);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __UDS_H */
@@ -0,0 +1,398 @@
+/**
+ ******************************************************************************
+ * @file           : vehicle_signals.h
+ * @brief          : Signal pack/unpack for Tools/vehicle.dbc.
+ *
+ * Generated by Tools/dbc_gen.c, do not edit. Regenerate with:
+ *   ./dbc_gen Tools/vehicle.dbc Inc/vehicle_signals.h VEH
+ ******************************************************************************
+ */
+
+#ifndef __VEHICLE_SIGNALS_H
+#define __VEHICLE_SIGNALS_H
+
+#include <stdint.h>
+#include "fdcan_frame.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef DBC_REV32
+#define DBC_REV32(x) __builtin_bswap32(x) // REV on Cortex-M33
+#endif
+#ifndef DBC_LE64
+#define DBC_LE64(f, k) (((uint64_t) (f)->data[(k) + 1] << 32) | (f)->data[k])
+#define DBC_BE64(f, k) (((uint64_t) DBC_REV32((f)->data[k]) << 32) | DBC_REV32((f)->data[(k) + 1]))
+#endif
+
+/***** EngineData *****/
+#define VEH_ENGINEDATA_ID               0x100U
+#define VEH_ENGINEDATA_EXTENDED         0
+#define VEH_ENGINEDATA_LEN              8U  // Payload bytes
+#define VEH_ENGINEDATA_ENGINESPEED_FACTOR (0.125)
+#define VEH_ENGINEDATA_ENGINESPEED_OFFSET (0)
+#define VEH_ENGINEDATA_COOLANTTEMP_FACTOR (1)
+#define VEH_ENGINEDATA_COOLANTTEMP_OFFSET (-40)
+#define VEH_ENGINEDATA_THROTTLEPOS_FACTOR (0.1)
+#define VEH_ENGINEDATA_THROTTLEPOS_OFFSET (0)
+#define VEH_ENGINEDATA_ENGINETORQUE_FACTOR (0.5)
+#define VEH_ENGINEDATA_ENGINETORQUE_OFFSET (0)
+#define VEH_ENGINEDATA_FUELRATE_FACTOR (0.001)
+#define VEH_ENGINEDATA_FUELRATE_OFFSET (0)
+
+typedef struct {
+	uint16_t EngineSpeed;    // 0|16@1+
+	uint8_t CoolantTemp;     // 16|8@1+
+	uint16_t ThrottlePos;    // 24|10@1+
+	int16_t EngineTorque;    // 34|12@1-
+	uint32_t FuelRate;       // 46|18@1+
+} VEH_ENGINEDATA_TypeDef_t;
+
+FDCAN_INLINE void VEH_ENGINEDATA_UNPACK(VEH_ENGINEDATA_TypeDef_t *m,
+		const FDCAN_FrameTypeDef_t *f) {
+	m->EngineSpeed = (uint16_t) ((f->data[0] >> 0U) & 0xFFFFU);
+	m->CoolantTemp = (uint8_t) ((f->data[0] >> 16U) & 0xFFU);
+	m->ThrottlePos = (uint16_t) ((DBC_LE64(f, 0) >> 24U) & 0x3FFULL);
+	m->EngineTorque = (int16_t) ((int32_t) (f->data[1] << 18U) >> 20U);
+	m->FuelRate = (uint32_t) (f->data[1] >> 14U);
+}
+
+FDCAN_INLINE void VEH_ENGINEDATA_PACK(FDCAN_FrameTypeDef_t *f,
+		const VEH_ENGINEDATA_TypeDef_t *m) {
+	uint32_t le0 = 0;
+	uint32_t le1 = 0;
+	le0 |= ((uint32_t) m->EngineSpeed & 0xFFFFU) << 0U;
+	le0 |= ((uint32_t) m->CoolantTemp & 0xFFU) << 16U;
+	{
+		uint64_t v = ((uint64_t) m->ThrottlePos & 0x3FFULL) << 24U;
+		le0 |= (uint32_t) v;
+		le1 |= (uint32_t) (v >> 32);
+	}
+	le1 |= ((uint32_t) m->EngineTorque & 0xFFFU) << 2U;
+	le1 |= ((uint32_t) m->FuelRate & 0x3FFFFU) << 14U;
+	FDCAN_FRAME_SET_ID(f, VEH_ENGINEDATA_ID, VEH_ENGINEDATA_EXTENDED);
+	FDCAN_FRAME_SET_CONTROL(f, FDCAN_BYTES_TO_DLC(VEH_ENGINEDATA_LEN), 0, 0);
+	f->data[0] = le0;
+	f->data[1] = le1;
+}
+
+/***** BrakeStatus *****/
+#define VEH_BRAKESTATUS_ID              0x200U
+#define VEH_BRAKESTATUS_EXTENDED        0
+#define VEH_BRAKESTATUS_LEN             8U  // Payload bytes
+#define VEH_BRAKESTATUS_WHEELSPEEDFL_FACTOR (0.01)
+#define VEH_BRAKESTATUS_WHEELSPEEDFL_OFFSET (0)
+#define VEH_BRAKESTATUS_YAWRATE_FACTOR (0.5)
+#define VEH_BRAKESTATUS_YAWRATE_OFFSET (0)
+#define VEH_BRAKESTATUS_WHEELSPEEDFR_FACTOR (0.01)
+#define VEH_BRAKESTATUS_WHEELSPEEDFR_OFFSET (0)
+#define VEH_BRAKESTATUS_WHEELSPEEDRL_FACTOR (0.01)
+#define VEH_BRAKESTATUS_WHEELSPEEDRL_OFFSET (0)
+#define VEH_BRAKESTATUS_BRAKEPRESSURE_FACTOR (4)
+#define VEH_BRAKESTATUS_BRAKEPRESSURE_OFFSET (0)
+#define VEH_BRAKESTATUS_BRAKEACTIVE_FACTOR (1)
+#define VEH_BRAKESTATUS_BRAKEACTIVE_OFFSET (0)
+#define VEH_BRAKESTATUS_ABSACTIVE_FACTOR (1)
+#define VEH_BRAKESTATUS_ABSACTIVE_OFFSET (0)
+
+typedef struct {
+	uint16_t WheelSpeedFL;   // 7|16@0+
+	int8_t YawRate;          // 23|8@0-
+	uint16_t WheelSpeedFR;   // 31|16@0+
+	uint16_t WheelSpeedRL;   // 47|16@0+
+	uint8_t BrakePressure;   // 63|6@0+
+	uint8_t BrakeActive;     // 57|1@0+
+	uint8_t AbsActive;       // 56|1@0+
+} VEH_BRAKESTATUS_TypeDef_t;
+
+FDCAN_INLINE void VEH_BRAKESTATUS_UNPACK(VEH_BRAKESTATUS_TypeDef_t *m,
+		const FDCAN_FrameTypeDef_t *f) {
+	m->WheelSpeedFL = (uint16_t) (DBC_REV32(f->data[0]) >> 16U);
+	m->YawRate = (int8_t) ((int32_t) (DBC_REV32(f->data[0]) << 16U) >> 24U);
+	m->WheelSpeedFR = (uint16_t) ((DBC_BE64(f, 0) >> 24U) & 0xFFFFULL);
+	m->WheelSpeedRL = (uint16_t) ((DBC_REV32(f->data[1]) >> 8U) & 0xFFFFU);
+	m->BrakePressure = (uint8_t) ((DBC_REV32(f->data[1]) >> 2U) & 0x3FU);
+	m->BrakeActive = (uint8_t) ((DBC_REV32(f->data[1]) >> 1U) & 0x1U);
+	m->AbsActive = (uint8_t) ((DBC_REV32(f->data[1]) >> 0U) & 0x1U);
+}
+
+FDCAN_INLINE void VEH_BRAKESTATUS_PACK(FDCAN_FrameTypeDef_t *f,
+		const VEH_BRAKESTATUS_TypeDef_t *m) {
+	uint32_t be0 = 0;
+	uint32_t be1 = 0;
+	be0 |= ((uint32_t) m->WheelSpeedFL & 0xFFFFU) << 16U;
+	be0 |= ((uint32_t) m->YawRate & 0xFFU) << 8U;
+	{
+		uint64_t v = ((uint64_t) m->WheelSpeedFR & 0xFFFFULL) << 24U;
+		be1 |= (uint32_t) v;
+		be0 |= (uint32_t) (v >> 32);
+	}
+	be1 |= ((uint32_t) m->WheelSpeedRL & 0xFFFFU) << 8U;
+	be1 |= ((uint32_t) m->BrakePressure & 0x3FU) << 2U;
+	be1 |= ((uint32_t) m->BrakeActive & 0x1U) << 1U;
+	be1 |= ((uint32_t) m->AbsActive & 0x1U) << 0U;
+	FDCAN_FRAME_SET_ID(f, VEH_BRAKESTATUS_ID, VEH_BRAKESTATUS_EXTENDED);
+	FDCAN_FRAME_SET_CONTROL(f, FDCAN_BYTES_TO_DLC(VEH_BRAKESTATUS_LEN), 0, 0);
+	f->data[0] = DBC_REV32(be0);
+	f->data[1] = DBC_REV32(be1);
+}
+
+/***** Heartbeat *****/
+#define VEH_HEARTBEAT_ID                0x300U
+#define VEH_HEARTBEAT_EXTENDED          0
+#define VEH_HEARTBEAT_LEN               3U  // Payload bytes
+#define VEH_HEARTBEAT_COUNTER_FACTOR (1)
+#define VEH_HEARTBEAT_COUNTER_OFFSET (0)
+#define VEH_HEARTBEAT_STATE_FACTOR (1)
+#define VEH_HEARTBEAT_STATE_OFFSET (0)
+#define VEH_HEARTBEAT_SUPPLYVOLTAGE_FACTOR (0.001)
+#define VEH_HEARTBEAT_SUPPLYVOLTAGE_OFFSET (0)
+
+typedef struct {
+	uint8_t Counter;         // 0|4@1+
+	uint8_t State;           // 4|4@1+
+	uint16_t SupplyVoltage;  // 8|16@1+
+} VEH_HEARTBEAT_TypeDef_t;
+
+FDCAN_INLINE void VEH_HEARTBEAT_UNPACK(VEH_HEARTBEAT_TypeDef_t *m,
+		const FDCAN_FrameTypeDef_t *f) {
+	m->Counter = (uint8_t) ((f->data[0] >> 0U) & 0xFU);
+	m->State = (uint8_t) ((f->data[0] >> 4U) & 0xFU);
+	m->SupplyVoltage = (uint16_t) ((f->data[0] >> 8U) & 0xFFFFU);
+}
+
+FDCAN_INLINE void VEH_HEARTBEAT_PACK(FDCAN_FrameTypeDef_t *f,
+		const VEH_HEARTBEAT_TypeDef_t *m) {
+	uint32_t le0 = 0;
+	le0 |= ((uint32_t) m->Counter & 0xFU) << 0U;
+	le0 |= ((uint32_t) m->State & 0xFU) << 4U;
+	le0 |= ((uint32_t) m->SupplyVoltage & 0xFFFFU) << 8U;
+	FDCAN_FRAME_SET_ID(f, VEH_HEARTBEAT_ID, VEH_HEARTBEAT_EXTENDED);
+	FDCAN_FRAME_SET_CONTROL(f, FDCAN_BYTES_TO_DLC(VEH_HEARTBEAT_LEN), 0, 0);
+	f->data[0] = le0;
+}
+
+/***** EEC1 *****/
+#define VEH_EEC1_ID                     0xCF00500U
+#define VEH_EEC1_EXTENDED               1
+#define VEH_EEC1_LEN                    8U  // Payload bytes
+#define VEH_EEC1_ENGTORQUEMODE_FACTOR (1)
+#define VEH_EEC1_ENGTORQUEMODE_OFFSET (0)
+#define VEH_EEC1_DRIVERDEMANDTORQUE_FACTOR (1)
+#define VEH_EEC1_DRIVERDEMANDTORQUE_OFFSET (-125)
+#define VEH_EEC1_ACTUALTORQUE_FACTOR (1)
+#define VEH_EEC1_ACTUALTORQUE_OFFSET (-125)
+#define VEH_EEC1_ENGINESPEED_FACTOR (0.125)
+#define VEH_EEC1_ENGINESPEED_OFFSET (0)
+#define VEH_EEC1_SOURCEADDRESS_FACTOR (1)
+#define VEH_EEC1_SOURCEADDRESS_OFFSET (0)
+#define VEH_EEC1_STARTERMODE_FACTOR (1)
+#define VEH_EEC1_STARTERMODE_OFFSET (0)
+#define VEH_EEC1_DEMANDTORQUE_FACTOR (1)
+#define VEH_EEC1_DEMANDTORQUE_OFFSET (-125)
+
+typedef struct {
+	uint8_t EngTorqueMode;   // 0|4@1+
+	uint8_t DriverDemandTorque; // 8|8@1+
+	uint8_t ActualTorque;    // 16|8@1+
+	uint16_t EngineSpeed;    // 24|16@1+
+	uint8_t SourceAddress;   // 40|8@1+
+	uint8_t StarterMode;     // 48|4@1+
+	uint8_t DemandTorque;    // 56|8@1+
+} VEH_EEC1_TypeDef_t;
+
+FDCAN_INLINE void VEH_EEC1_UNPACK(VEH_EEC1_TypeDef_t *m,
+		const FDCAN_FrameTypeDef_t *f) {
+	m->EngTorqueMode = (uint8_t) ((f->data[0] >> 0U) & 0xFU);
+	m->DriverDemandTorque = (uint8_t) ((f->data[0] >> 8U) & 0xFFU);
+	m->ActualTorque = (uint8_t) ((f->data[0] >> 16U) & 0xFFU);
+	m->EngineSpeed = (uint16_t) ((DBC_LE64(f, 0) >> 24U) & 0xFFFFULL);
+	m->SourceAddress = (uint8_t) ((f->data[1] >> 8U) & 0xFFU);
+	m->StarterMode = (uint8_t) ((f->data[1] >> 16U) & 0xFU);
+	m->DemandTorque = (uint8_t) (f->data[1] >> 24U);
+}
+
+FDCAN_INLINE void VEH_EEC1_PACK(FDCAN_FrameTypeDef_t *f,
+		const VEH_EEC1_TypeDef_t *m) {
+	uint32_t le0 = 0;
+	uint32_t le1 = 0;
+	le0 |= ((uint32_t) m->EngTorqueMode & 0xFU) << 0U;
+	le0 |= ((uint32_t) m->DriverDemandTorque & 0xFFU) << 8U;
+	le0 |= ((uint32_t) m->ActualTorque & 0xFFU) << 16U;
+	{
+		uint64_t v = ((uint64_t) m->EngineSpeed & 0xFFFFULL) << 24U;
+		le0 |= (uint32_t) v;
+		le1 |= (uint32_t) (v >> 32);
+	}
+	le1 |= ((uint32_t) m->SourceAddress & 0xFFU) << 8U;
+	le1 |= ((uint32_t) m->StarterMode & 0xFU) << 16U;
+	le1 |= ((uint32_t) m->DemandTorque & 0xFFU) << 24U;
+	FDCAN_FRAME_SET_ID(f, VEH_EEC1_ID, VEH_EEC1_EXTENDED);
+	FDCAN_FRAME_SET_CONTROL(f, FDCAN_BYTES_TO_DLC(VEH_EEC1_LEN), 0, 0);
+	f->data[0] = le0;
+	f->data[1] = le1;
+}
+
+/***** BatteryCells *****/
+#define VEH_BATTERYCELLS_ID             0x400U
+#define VEH_BATTERYCELLS_EXTENDED       0
+#define VEH_BATTERYCELLS_LEN            64U  // Payload bytes
+#define VEH_BATTERYCELLS_CELL1_FACTOR (0.001)
+#define VEH_BATTERYCELLS_CELL1_OFFSET (0)
+#define VEH_BATTERYCELLS_CELL2_FACTOR (0.001)
+#define VEH_BATTERYCELLS_CELL2_OFFSET (0)
+#define VEH_BATTERYCELLS_CELL3_FACTOR (0.001)
+#define VEH_BATTERYCELLS_CELL3_OFFSET (0)
+#define VEH_BATTERYCELLS_CELL4_FACTOR (0.001)
+#define VEH_BATTERYCELLS_CELL4_OFFSET (0)
+#define VEH_BATTERYCELLS_CELL5_FACTOR (0.001)
+#define VEH_BATTERYCELLS_CELL5_OFFSET (0)
+#define VEH_BATTERYCELLS_CELL6_FACTOR (0.001)
+#define VEH_BATTERYCELLS_CELL6_OFFSET (0)
+#define VEH_BATTERYCELLS_CELL7_FACTOR (0.001)
+#define VEH_BATTERYCELLS_CELL7_OFFSET (0)
+#define VEH_BATTERYCELLS_CELL8_FACTOR (0.001)
+#define VEH_BATTERYCELLS_CELL8_OFFSET (0)
+#define VEH_BATTERYCELLS_PACKCURRENT_FACTOR (0.001)
+#define VEH_BATTERYCELLS_PACKCURRENT_OFFSET (0)
+#define VEH_BATTERYCELLS_PACKVOLTAGE_FACTOR (0.01)
+#define VEH_BATTERYCELLS_PACKVOLTAGE_OFFSET (0)
+#define VEH_BATTERYCELLS_STATEOFCHARGE_FACTOR (0.5)
+#define VEH_BATTERYCELLS_STATEOFCHARGE_OFFSET (0)
+
+typedef struct {
+	uint16_t Cell1;          // 0|16@1+
+	uint16_t Cell2;          // 16|16@1+
+	uint16_t Cell3;          // 32|16@1+
+	uint16_t Cell4;          // 48|16@1+
+	uint16_t Cell5;          // 64|16@1+
+	uint16_t Cell6;          // 80|16@1+
+	uint16_t Cell7;          // 96|16@1+
+	uint16_t Cell8;          // 112|16@1+
+	int32_t PackCurrent;     // 200|32@1-
+	uint32_t PackVoltage;    // 255|24@0+
+	uint8_t StateOfCharge;   // 271|8@0+
+} VEH_BATTERYCELLS_TypeDef_t;
+
+FDCAN_INLINE void VEH_BATTERYCELLS_UNPACK(VEH_BATTERYCELLS_TypeDef_t *m,
+		const FDCAN_FrameTypeDef_t *f) {
+	m->Cell1 = (uint16_t) ((f->data[0] >> 0U) & 0xFFFFU);
+	m->Cell2 = (uint16_t) (f->data[0] >> 16U);
+	m->Cell3 = (uint16_t) ((f->data[1] >> 0U) & 0xFFFFU);
+	m->Cell4 = (uint16_t) (f->data[1] >> 16U);
+	m->Cell5 = (uint16_t) ((f->data[2] >> 0U) & 0xFFFFU);
+	m->Cell6 = (uint16_t) (f->data[2] >> 16U);
+	m->Cell7 = (uint16_t) ((f->data[3] >> 0U) & 0xFFFFU);
+	m->Cell8 = (uint16_t) (f->data[3] >> 16U);
+	m->PackCurrent = (int32_t) ((int64_t) (DBC_LE64(f, 6) << 24U) >> 32U);
+	m->PackVoltage = (uint32_t) ((DBC_BE64(f, 7) >> 16U) & 0xFFFFFFULL);
+	m->StateOfCharge = (uint8_t) ((DBC_REV32(f->data[8]) >> 16U) & 0xFFU);
+}
+
+FDCAN_INLINE void VEH_BATTERYCELLS_PACK(FDCAN_FrameTypeDef_t *f,
+		const VEH_BATTERYCELLS_TypeDef_t *m) {
+	uint32_t le0 = 0;
+	uint32_t le1 = 0;
+	uint32_t le2 = 0;
+	uint32_t le3 = 0;
+	uint32_t le6 = 0;
+	uint32_t le7 = 0;
+	uint32_t be7 = 0;
+	uint32_t be8 = 0;
+	le0 |= ((uint32_t) m->Cell1 & 0xFFFFU) << 0U;
+	le0 |= ((uint32_t) m->Cell2 & 0xFFFFU) << 16U;
+	le1 |= ((uint32_t) m->Cell3 & 0xFFFFU) << 0U;
+	le1 |= ((uint32_t) m->Cell4 & 0xFFFFU) << 16U;
+	le2 |= ((uint32_t) m->Cell5 & 0xFFFFU) << 0U;
+	le2 |= ((uint32_t) m->Cell6 & 0xFFFFU) << 16U;
+	le3 |= ((uint32_t) m->Cell7 & 0xFFFFU) << 0U;
+	le3 |= ((uint32_t) m->Cell8 & 0xFFFFU) << 16U;
+	{
+		uint64_t v = ((uint64_t) m->PackCurrent & 0xFFFFFFFFULL) << 8U;
+		le6 |= (uint32_t) v;
+		le7 |= (uint32_t) (v >> 32);
+	}
+	{
+		uint64_t v = ((uint64_t) m->PackVoltage & 0xFFFFFFULL) << 16U;
+		be8 |= (uint32_t) v;
+		be7 |= (uint32_t) (v >> 32);
+	}
+	be8 |= ((uint32_t) m->StateOfCharge & 0xFFU) << 16U;
+	FDCAN_FRAME_SET_ID(f, VEH_BATTERYCELLS_ID, VEH_BATTERYCELLS_EXTENDED);
+	FDCAN_FRAME_SET_CONTROL(f, FDCAN_BYTES_TO_DLC(VEH_BATTERYCELLS_LEN), 1, 0);
+	f->data[0] = le0;
+	f->data[1] = le1;
+	f->data[2] = le2;
+	f->data[3] = le3;
+	f->data[4] = 0;
+	f->data[5] = 0;
+	f->data[6] = le6;
+	f->data[7] = le7 | DBC_REV32(be7);
+	f->data[8] = DBC_REV32(be8);
+	f->data[9] = 0;
+	f->data[10] = 0;
+	f->data[11] = 0;
+	f->data[12] = 0;
+	f->data[13] = 0;
+	f->data[14] = 0;
+	f->data[15] = 0;
+}
+
+#ifdef VEH_SIGNAL_TABLE
+#include <stddef.h>
+
+typedef struct {
+	uint32_t Id;
+	uint16_t StartBit;
+	uint8_t Length;
+	uint8_t Intel;
+	uint8_t Signed;
+	uint8_t Size;                  // Bytes of the raw field
+	uint16_t Offset;               // offsetof the raw field
+} VEH_SignalInfoTypeDef_t;
+
+static const VEH_SignalInfoTypeDef_t VEHSignalTable[] = {
+	{ VEH_ENGINEDATA_ID, 0, 16, 1, 0, sizeof(uint16_t), offsetof(VEH_ENGINEDATA_TypeDef_t, EngineSpeed) },
+	{ VEH_ENGINEDATA_ID, 16, 8, 1, 0, sizeof(uint8_t), offsetof(VEH_ENGINEDATA_TypeDef_t, CoolantTemp) },
+	{ VEH_ENGINEDATA_ID, 24, 10, 1, 0, sizeof(uint16_t), offsetof(VEH_ENGINEDATA_TypeDef_t, ThrottlePos) },
+	{ VEH_ENGINEDATA_ID, 34, 12, 1, 1, sizeof(int16_t), offsetof(VEH_ENGINEDATA_TypeDef_t, EngineTorque) },
+	{ VEH_ENGINEDATA_ID, 46, 18, 1, 0, sizeof(uint32_t), offsetof(VEH_ENGINEDATA_TypeDef_t, FuelRate) },
+	{ VEH_BRAKESTATUS_ID, 7, 16, 0, 0, sizeof(uint16_t), offsetof(VEH_BRAKESTATUS_TypeDef_t, WheelSpeedFL) },
+	{ VEH_BRAKESTATUS_ID, 23, 8, 0, 1, sizeof(int8_t), offsetof(VEH_BRAKESTATUS_TypeDef_t, YawRate) },
+	{ VEH_BRAKESTATUS_ID, 31, 16, 0, 0, sizeof(uint16_t), offsetof(VEH_BRAKESTATUS_TypeDef_t, WheelSpeedFR) },
+	{ VEH_BRAKESTATUS_ID, 47, 16, 0, 0, sizeof(uint16_t), offsetof(VEH_BRAKESTATUS_TypeDef_t, WheelSpeedRL) },
+	{ VEH_BRAKESTATUS_ID, 63, 6, 0, 0, sizeof(uint8_t), offsetof(VEH_BRAKESTATUS_TypeDef_t, BrakePressure) },
+	{ VEH_BRAKESTATUS_ID, 57, 1, 0, 0, sizeof(uint8_t), offsetof(VEH_BRAKESTATUS_TypeDef_t, BrakeActive) },
+	{ VEH_BRAKESTATUS_ID, 56, 1, 0, 0, sizeof(uint8_t), offsetof(VEH_BRAKESTATUS_TypeDef_t, AbsActive) },
+	{ VEH_HEARTBEAT_ID, 0, 4, 1, 0, sizeof(uint8_t), offsetof(VEH_HEARTBEAT_TypeDef_t, Counter) },
+	{ VEH_HEARTBEAT_ID, 4, 4, 1, 0, sizeof(uint8_t), offsetof(VEH_HEARTBEAT_TypeDef_t, State) },
+	{ VEH_HEARTBEAT_ID, 8, 16, 1, 0, sizeof(uint16_t), offsetof(VEH_HEARTBEAT_TypeDef_t, SupplyVoltage) },
+	{ VEH_EEC1_ID, 0, 4, 1, 0, sizeof(uint8_t), offsetof(VEH_EEC1_TypeDef_t, EngTorqueMode) },
+	{ VEH_EEC1_ID, 8, 8, 1, 0, sizeof(uint8_t), offsetof(VEH_EEC1_TypeDef_t, DriverDemandTorque) },
+	{ VEH_EEC1_ID, 16, 8, 1, 0, sizeof(uint8_t), offsetof(VEH_EEC1_TypeDef_t, ActualTorque) },
+	{ VEH_EEC1_ID, 24, 16, 1, 0, sizeof(uint16_t), offsetof(VEH_EEC1_TypeDef_t, EngineSpeed) },
+	{ VEH_EEC1_ID, 40, 8, 1, 0, sizeof(uint8_t), offsetof(VEH_EEC1_TypeDef_t, SourceAddress) },
+	{ VEH_EEC1_ID, 48, 4, 1, 0, sizeof(uint8_t), offsetof(VEH_EEC1_TypeDef_t, StarterMode) },
+	{ VEH_EEC1_ID, 56, 8, 1, 0, sizeof(uint8_t), offsetof(VEH_EEC1_TypeDef_t, DemandTorque) },
+	{ VEH_BATTERYCELLS_ID, 0, 16, 1, 0, sizeof(uint16_t), offsetof(VEH_BATTERYCELLS_TypeDef_t, Cell1) },
+	{ VEH_BATTERYCELLS_ID, 16, 16, 1, 0, sizeof(uint16_t), offsetof(VEH_BATTERYCELLS_TypeDef_t, Cell2) },
+	{ VEH_BATTERYCELLS_ID, 32, 16, 1, 0, sizeof(uint16_t), offsetof(VEH_BATTERYCELLS_TypeDef_t, Cell3) },
+	{ VEH_BATTERYCELLS_ID, 48, 16, 1, 0, sizeof(uint16_t), offsetof(VEH_BATTERYCELLS_TypeDef_t, Cell4) },
+	{ VEH_BATTERYCELLS_ID, 64, 16, 1, 0, sizeof(uint16_t), offsetof(VEH_BATTERYCELLS_TypeDef_t, Cell5) },
+	{ VEH_BATTERYCELLS_ID, 80, 16, 1, 0, sizeof(uint16_t), offsetof(VEH_BATTERYCELLS_TypeDef_t, Cell6) },
+	{ VEH_BATTERYCELLS_ID, 96, 16, 1, 0, sizeof(uint16_t), offsetof(VEH_BATTERYCELLS_TypeDef_t, Cell7) },
+	{ VEH_BATTERYCELLS_ID, 112, 16, 1, 0, sizeof(uint16_t), offsetof(VEH_BATTERYCELLS_TypeDef_t, Cell8) },
+	{ VEH_BATTERYCELLS_ID, 200, 32, 1, 1, sizeof(int32_t), offsetof(VEH_BATTERYCELLS_TypeDef_t, PackCurrent) },
+	{ VEH_BATTERYCELLS_ID, 255, 24, 0, 0, sizeof(uint32_t), offsetof(VEH_BATTERYCELLS_TypeDef_t, PackVoltage) },
+	{ VEH_BATTERYCELLS_ID, 271, 8, 0, 0, sizeof(uint8_t), offsetof(VEH_BATTERYCELLS_TypeDef_t, StateOfCharge) },
+};
+
+#define VEH_SIGNAL_COUNT 33U
+#endif /* VEH_SIGNAL_TABLE */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __VEHICLE_SIGNALS_H */
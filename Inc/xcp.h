@@ -0,0 +1,236 @@
+/**
+ ******************************************************************************
+ * @file           : xcp.h
+ * @brief          : XCP on CAN slave (ASAM MCD-1 XCP 1.1): memory upload and
+ *                   download for calibration, dynamic DAQ lists.
+ *
+ * The master sends commands (CTO) on CroId; responses, error packets and DAQ
+ * packets (DTO) go back on DtoId. MAX_CTO and MAX_DTO both equal FrameBytes:
+ * 8 on Classic CAN, up to 64 on CAN FD. Byte order is Intel, address
+ * granularity is one byte, and DAQ packets are identified by their absolute
+ * ODT number (PID 0..XCP_MAX_ODT-1).
+ *
+ * The master can only reach memory through the Regions table. On the target
+ * a region's Address is simply its location; a host build maps the target
+ * addresses onto its own buffers the same way.
+ *
+ * XCP_RX_FRAME handles one command in the caller's context. XCP_EVENT samples
+ * the DAQ lists bound to an event channel and is meant for a timer interrupt:
+ * ODT entry addresses are resolved when the master writes them, so a sample
+ * is a bounded run of copies, and a list goes into the frame queue whole or
+ * not at all. XCP_TX_PUMP moves the pending response, then queued DAQ
+ * frames, to the driver. The caller must keep the three from preempting one
+ * another.
+ ******************************************************************************
+ */
+
+#ifndef __XCP_H
+#define __XCP_H
+
+#include <stdint.h>
+#include "fdcan_frame.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***** Resource Limits *****/
+#ifndef XCP_MAX_DAQ
+#define XCP_MAX_DAQ                 8U    // DAQ lists
+#endif
+#ifndef XCP_MAX_ODT
+#define XCP_MAX_ODT                 32U   // ODTs over all lists, at most 0x7C
+#endif
+#ifndef XCP_MAX_ODT_ENTRIES
+#define XCP_MAX_ODT_ENTRIES         128U  // ODT entries over all ODTs
+#endif
+#ifndef XCP_DTO_QUEUE_FRAMES
+#define XCP_DTO_QUEUE_FRAMES        32U   // Power of two
+#endif
+
+#define XCP_MAX_FRAME_BYTES         64U
+#define XCP_TIMESTAMP_BYTES         4U    // DWORD, 1 us per tick
+
+/***** Packet Identifiers (slave to master) *****/
+#define XCP_PID_RES                 0xFFU // Positive response
+#define XCP_PID_ERR                 0xFEU // Error packet
+#define XCP_PID_OVERLOAD            0x80U // Set on the first DAQ packet after lost samples
+
+/***** Commands *****/
+#define XCP_CMD_CONNECT             0xFFU
+#define XCP_CMD_DISCONNECT          0xFEU
+#define XCP_CMD_GET_STATUS          0xFDU
+#define XCP_CMD_SYNCH               0xFCU
+#define XCP_CMD_GET_COMM_MODE_INFO  0xFBU
+#define XCP_CMD_GET_ID              0xFAU
+#define XCP_CMD_SET_MTA             0xF6U
+#define XCP_CMD_UPLOAD              0xF5U
+#define XCP_CMD_SHORT_UPLOAD        0xF4U
+#define XCP_CMD_DOWNLOAD            0xF0U
+#define XCP_CMD_SHORT_DOWNLOAD      0xEDU
+#define XCP_CMD_SET_DAQ_PTR         0xE2U
+#define XCP_CMD_WRITE_DAQ           0xE1U
+#define XCP_CMD_SET_DAQ_LIST_MODE   0xE0U
+#define XCP_CMD_GET_DAQ_LIST_MODE   0xDFU
+#define XCP_CMD_START_STOP_DAQ_LIST 0xDEU
+#define XCP_CMD_START_STOP_SYNCH    0xDDU
+#define XCP_CMD_GET_DAQ_CLOCK       0xDCU
+#define XCP_CMD_GET_DAQ_PROCESSOR_INFO 0xDAU
+#define XCP_CMD_GET_DAQ_RESOLUTION_INFO 0xD9U
+#define XCP_CMD_GET_DAQ_EVENT_INFO  0xD7U
+#define XCP_CMD_FREE_DAQ            0xD6U
+#define XCP_CMD_ALLOC_DAQ           0xD5U
+#define XCP_CMD_ALLOC_ODT           0xD4U
+#define XCP_CMD_ALLOC_ODT_ENTRY     0xD3U
+
+/***** Error Codes *****/
+#define XCP_ERR_CMD_SYNCH           0x00U // Answer to SYNCH
+#define XCP_ERR_DAQ_ACTIVE          0x11U // DAQ list running
+#define XCP_ERR_CMD_UNKNOWN         0x20U
+#define XCP_ERR_CMD_SYNTAX          0x21U // Command too short
+#define XCP_ERR_OUT_OF_RANGE        0x22U // Parameter or address out of range
+#define XCP_ERR_WRITE_PROTECTED     0x23U // Region is read only
+#define XCP_ERR_ACCESS_DENIED       0x24U // Transfer runs past the region
+#define XCP_ERR_MODE_NOT_VALID      0x27U // DAQ list mode not supported
+#define XCP_ERR_SEQUENCE            0x29U // FREE/ALLOC order broken
+#define XCP_ERR_DAQ_CONFIG          0x2AU // ODT does not fit a frame, list not set up
+#define XCP_ERR_MEMORY_OVERFLOW     0x30U // DAQ pools exhausted
+
+/***** DAQ List Mode (SET_DAQ_LIST_MODE / GET_DAQ_LIST_MODE) *****/
+#define XCP_DAQ_MODE_SELECTED       0x01U // Picked for START_STOP_SYNCH
+#define XCP_DAQ_MODE_DIRECTION      0x02U // STIM, not supported
+#define XCP_DAQ_MODE_TIMESTAMP      0x10U // First ODT carries the timestamp
+#define XCP_DAQ_MODE_PID_OFF        0x20U // Not supported
+#define XCP_DAQ_MODE_RUNNING        0x40U
+
+/***** DAQ Allocation Sequence *****/
+#define XCP_ALLOC_FREED             0
+#define XCP_ALLOC_DAQ               1
+#define XCP_ALLOC_ODT               2
+#define XCP_ALLOC_ENTRY             3
+
+/***** Hooks *****/
+/* Queue one frame for transmission, return 1 if queued, 0 if no TX slot is free */
+typedef uint8_t (*XCP_SendFrame_t)(void *ctx, const FDCAN_FrameTypeDef_t *pFrame);
+
+/* DAQ timestamp, 1 us per tick */
+typedef uint32_t (*XCP_GetTimestamp_t)(void);
+
+/***** Memory Region *****/
+typedef struct {
+	uint32_t Address;              // Address the master uses
+	uint8_t *Base;                 // Where the bytes are in this build
+	uint32_t Length;
+	uint8_t Writable;              // DOWNLOAD allowed
+} XCP_RegionTypeDef_t;
+
+/***** Event Channel *****/
+typedef struct {
+	const char *Name;
+	uint32_t PeriodUs;             // Reported cycle, 0 for a sporadic event
+	uint8_t Priority;
+} XCP_EventTypeDef_t;
+
+/***** DAQ Tables *****/
+typedef struct {
+	const uint8_t *Address;        // Resolved by WRITE_DAQ
+	uint8_t Size;
+} XCP_OdtEntryTypeDef_t;
+
+typedef struct {
+	uint16_t FirstEntry;
+	uint8_t EntryCount;
+	uint8_t Bytes;                 // Sum of the entry sizes
+	uint8_t FrameBytes;            // PID, timestamp and data, set on start
+	uint8_t PadTo;                 // Frame length after padding, set on start
+	uint32_t Control;              // Frame word 1 (DLC, FDF, BRS), set on start
+} XCP_OdtTypeDef_t;
+
+typedef struct {
+	uint8_t FirstOdt;              // Absolute ODT number, the PID of its first packet
+	uint8_t OdtCount;
+	uint8_t Mode;                  // XCP_DAQ_MODE_*
+	uint8_t Prescaler;             // Sample every Nth event
+	uint8_t PrescalerCount;
+	uint8_t Priority;
+	uint16_t Event;
+	uint32_t Samples;
+	uint32_t Overruns;             // Samples lost to a full queue
+} XCP_DaqTypeDef_t;
+
+/***** XCP Slave Structure *****/
+typedef struct {
+	/* Configuration, filled in before XCP_INIT */
+	uint32_t CroId;                // Commands from the master
+	uint32_t DtoId;                // Responses and DAQ packets
+	uint8_t IdExtended;            // 1 for 29-bit identifiers
+	uint8_t FrameBytes;            // MAX_CTO and MAX_DTO: 8, or up to 64 on FD
+	uint8_t BitRateSwitch;         // FD frames with BRS
+	uint8_t PadFrames;             // Pad every frame to FrameBytes
+	uint8_t PadByte;
+	const XCP_RegionTypeDef_t *Regions;
+	uint8_t RegionCount;
+	const XCP_EventTypeDef_t *Events;
+	uint8_t EventCount;
+	const char *Identifier;        // GET_ID type 1: A2L file name, no extension
+	XCP_GetTimestamp_t GetTimestamp; // NULL: DAQ without timestamps
+	XCP_SendFrame_t SendFrame;
+	void *Ctx;                     // Passed back to SendFrame
+
+	/* Session */
+	uint32_t DtoWord0;             // Frame word 0 (ID) of every DTO
+	uint8_t Connected;
+	uint8_t *Mta;                  // Memory transfer address
+	uint32_t MtaLeft;              // Bytes to the end of its region
+	uint8_t MtaWritable;
+	uint8_t Response[XCP_MAX_FRAME_BYTES];
+	uint8_t ResponseLength;
+	uint8_t ResponsePending;       // Waiting for a free TX slot
+
+	/* DAQ configuration */
+	XCP_DaqTypeDef_t Daq[XCP_MAX_DAQ];
+	XCP_OdtTypeDef_t Odt[XCP_MAX_ODT];
+	XCP_OdtEntryTypeDef_t Entry[XCP_MAX_ODT_ENTRIES];
+	uint8_t DaqCount;
+	uint8_t OdtCount;
+	uint16_t EntryCount;
+	uint8_t AllocState;            // XCP_ALLOC_*
+	uint16_t PtrDaq;               // SET_DAQ_PTR
+	uint8_t PtrOdt;
+	uint8_t PtrEntry;
+	volatile uint8_t DaqRunning;   // At least one list running
+	uint8_t Overload;              // Samples lost since the last DAQ packet
+
+	/* DTO queue, filled by XCP_EVENT and drained by XCP_TX_PUMP */
+	FDCAN_FrameTypeDef_t Queue[XCP_DTO_QUEUE_FRAMES];
+	volatile uint32_t QueueHead;
+	volatile uint32_t QueueTail;
+
+	/* Statistics */
+	uint32_t Commands;
+	uint32_t NegativeResponses;
+	uint32_t DaqFrames;            // DAQ packets queued
+	uint32_t DaqBytes;             // Measurement bytes in them
+	uint32_t Overruns;             // Samples lost to a full queue
+	uint32_t QueueHighWater;
+} XCP_HandleTypeDef_t;
+
+/***** XCP API *****/
+void XCP_INIT(XCP_HandleTypeDef_t *hXcp);
+uint8_t XCP_RX_FRAME(XCP_HandleTypeDef_t *hXcp,
+		const FDCAN_FrameTypeDef_t *pFrame);
+uint32_t XCP_EVENT(XCP_HandleTypeDef_t *hXcp, uint16_t event);
+uint32_t XCP_TX_PUMP(XCP_HandleTypeDef_t *hXcp);
+
+/**
+ * @brief  Frames waiting in the DTO queue, the pending response included
+ */
+FDCAN_INLINE uint32_t XCP_QUEUED(const XCP_HandleTypeDef_t *hXcp) {
+	return (hXcp->QueueHead - hXcp->QueueTail) + hXcp->ResponsePending;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __XCP_H */
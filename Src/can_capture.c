@@ -0,0 +1,286 @@
+/**
+ ******************************************************************************
+ * @file           : can_capture.c
+ * @brief          : Bus capture ring, record encoder and decoder.
+ *
+ * A record is built on the stack and copied into the ring only if it fits
+ * whole, so the consumer never sees a partial record. A frame that does not
+ * fit is counted, and a DROP event goes in ahead of the next frame that
+ * does. Head is published after the bytes with a release store, so the
+ * consumer on another context reads complete data.
+ ******************************************************************************
+ */
+
+#include <string.h>
+#include "can_capture.h"
+
+/***** Private Helpers *****/
+FDCAN_INLINE uint32_t CANCAP_PUT_VARINT(uint8_t *p, uint64_t value) {
+	uint32_t n = 0;
+	while (value >= 0x80U) {
+		p[n++] = (uint8_t) (value | 0x80U);
+		value >>= 7;
+	}
+	p[n++] = (uint8_t) value;
+	return n;
+}
+
+/* Returns the bytes used, 0 if the varint runs past 'length' */
+FDCAN_INLINE uint32_t CANCAP_GET_VARINT(const uint8_t *p, uint32_t length,
+		uint64_t *pValue) {
+	uint64_t value = 0;
+	for (uint32_t n = 0; n < length && n < 10U; n++) {
+		value |= (uint64_t) (p[n] & 0x7FU) << (7U * n);
+		if ((p[n] & 0x80U) == 0) {
+			*pValue = value;
+			return n + 1U;
+		}
+	}
+	return 0;
+}
+
+/* Advance the bit clock by GetTicks, then lock its low bits to the counter */
+static void CANCAP_CLOCK(CANCAP_HandleTypeDef_t *hCap) {
+	uint32_t now = hCap->GetTicks();
+	uint32_t elapsed = (now - hCap->LastTicks) + hCap->TickRemainder;
+
+	hCap->LastTicks = now;
+	hCap->NowBits += elapsed / hCap->TicksPerBit;
+	hCap->TickRemainder = elapsed % hCap->TicksPerBit;
+	if (hCap->GetTimestamp != NULL) {
+		hCap->NowBits += (int16_t) (hCap->GetTimestamp()
+				- (uint16_t) hCap->NowBits);
+	}
+}
+
+/* Bit times since the last record written; time never runs backwards */
+FDCAN_INLINE uint64_t CANCAP_DELTA(const CANCAP_HandleTypeDef_t *hCap,
+		uint64_t bits) {
+	return ((int64_t) (bits - hCap->LastRecordBits) > 0) ?
+			bits - hCap->LastRecordBits : 0;
+}
+
+static uint32_t CANCAP_EVENT(uint8_t *p, uint64_t delta, uint8_t event,
+		const uint32_t *args, uint32_t count) {
+	uint32_t n = CANCAP_PUT_VARINT(p, delta);
+	p[n++] = (uint8_t) (CANCAP_CTRL_EVENT | event);
+	for (uint32_t i = 0; i < count; i++) {
+		n += CANCAP_PUT_VARINT(&p[n], args[i]);
+	}
+	return n;
+}
+
+/* Copy a whole record into the ring, or nothing */
+static uint8_t CANCAP_WRITE(CANCAP_HandleTypeDef_t *hCap, const uint8_t *p,
+		uint32_t length) {
+	uint32_t head = hCap->Head;
+	uint32_t used = head - hCap->Tail;
+
+	if (length > CANCAP_RING_BYTES - used) {
+		return 0;
+	}
+	uint32_t index = head & (CANCAP_RING_BYTES - 1U);
+	uint32_t first = CANCAP_RING_BYTES - index;
+	if (first >= length) {
+		memcpy(&hCap->Ring[index], p, length);
+	} else {
+		memcpy(&hCap->Ring[index], p, first);
+		memcpy(hCap->Ring, &p[first], length - first);
+	}
+	__atomic_store_n(&hCap->Head, head + length, __ATOMIC_RELEASE);
+
+	used += length;
+	if (used > hCap->HighWater) {
+		hCap->HighWater = used;
+	}
+	hCap->Bytes += length;
+	return 1;
+}
+
+/***** Public API *****/
+
+/**
+ * @brief  Empty the ring and start the stream with its header and START
+ */
+void CANCAP_INIT(CANCAP_HandleTypeDef_t *hCap) {
+	uint8_t record[CANCAP_HEADER_BYTES + CANCAP_RECORD_MAX];
+	uint32_t args[2] = { hCap->NominalKbps, hCap->DataKbps };
+
+	hCap->Head = hCap->Tail = 0;
+	hCap->Frames = hCap->Dropped = hCap->PendingDrops = 0;
+	hCap->HighWater = 0;
+	hCap->Bytes = 0;
+	hCap->LastTicks = hCap->GetTicks();
+	hCap->TickRemainder = 0;
+	hCap->NowBits = (hCap->GetTimestamp != NULL) ? hCap->GetTimestamp() : 0;
+	hCap->LastRecordBits = hCap->NowBits;
+
+	memcpy(record, CANCAP_MAGIC, 4);
+	record[4] = CANCAP_VERSION;
+	uint32_t n = CANCAP_HEADER_BYTES
+			+ CANCAP_EVENT(&record[CANCAP_HEADER_BYTES], 0, CANCAP_EVT_START,
+					args, 2);
+	CANCAP_WRITE(hCap, record, n);
+}
+
+/**
+ * @brief  Keep the bit clock in phase while no frames arrive
+ * @note   Call more often than GetTicks wraps
+ */
+void CANCAP_POLL(CANCAP_HandleTypeDef_t *hCap) {
+	CANCAP_CLOCK(hCap);
+}
+
+/**
+ * @brief  Encode one received frame into the ring
+ * @retval 1 if recorded, 0 if the ring was full and the frame was dropped
+ * @note   Producer side: call from one context only (the RX interrupt),
+ *         serialized with CANCAP_POLL
+ */
+uint8_t CANCAP_FRAME(CANCAP_HandleTypeDef_t *hCap,
+		const FDCAN_FrameTypeDef_t *pFrame) {
+	uint8_t record[CANCAP_RECORD_MAX];
+	uint32_t w1 = pFrame->w1;
+	uint8_t fd = (w1 >> FDCAN_ELEM_FDF_POS) & 0x1U;
+	uint8_t dlc = FDCAN_FRAME_GET_DLC(pFrame);
+	uint8_t b7 = fd ? FDCAN_FRAME_GET_ESI(pFrame) : FDCAN_FRAME_IS_REMOTE(pFrame);
+	uint32_t length = FDCAN_DLC_TO_BYTES(dlc);
+
+	CANCAP_CLOCK(hCap);
+	uint16_t back = (uint16_t) ((uint16_t) hCap->NowBits
+			- FDCAN_FRAME_GET_TIMESTAMP(pFrame));
+	uint64_t bits = hCap->NowBits - back;
+
+	if (hCap->PendingDrops != 0) {
+		uint32_t lost = hCap->PendingDrops;
+		uint32_t n = CANCAP_EVENT(record, CANCAP_DELTA(hCap, bits),
+				CANCAP_EVT_DROP, &lost, 1);
+		if (!CANCAP_WRITE(hCap, record, n)) {
+			hCap->Dropped++;       // Still full: the DROP event goes first
+			hCap->PendingDrops++;
+			return 0;
+		}
+		hCap->PendingDrops = 0;
+		if ((int64_t) (bits - hCap->LastRecordBits) > 0) {
+			hCap->LastRecordBits = bits;
+		}
+	}
+
+	if (!fd && length > 8U) {
+		length = 8U;               // Classic DLC 9..15
+	}
+	if (!fd && b7) {
+		length = 0;                // Remote frame
+	}
+
+	uint32_t n = CANCAP_PUT_VARINT(record, CANCAP_DELTA(hCap, bits));
+	record[n++] = (uint8_t) (dlc | (fd << CANCAP_CTRL_FDF_POS)
+			| (((w1 >> FDCAN_ELEM_BRS_POS) & 0x1U) << CANCAP_CTRL_BRS_POS)
+			| (FDCAN_FRAME_IS_EXTENDED(pFrame) << CANCAP_CTRL_XTD_POS)
+			| (b7 << CANCAP_CTRL_B7_POS));
+	n += CANCAP_PUT_VARINT(&record[n], FDCAN_FRAME_GET_ID(pFrame));
+	memcpy(&record[n], FDCAN_FRAME_CDATA(pFrame), length);
+	n += length;
+
+	if (!CANCAP_WRITE(hCap, record, n)) {
+		hCap->Dropped++;
+		hCap->PendingDrops++;
+		return 0;
+	}
+	if ((int64_t) (bits - hCap->LastRecordBits) > 0) {
+		hCap->LastRecordBits = bits;
+	}
+	hCap->Frames++;
+	return 1;
+}
+
+/**
+ * @brief  Contiguous bytes ready for the consumer
+ * @param  ppData: Receives the address of the first byte
+ * @retval Byte count, up to the end of the ring; call again after
+ *         CANCAP_RELEASE for the wrapped part
+ */
+uint32_t CANCAP_PEEK(const CANCAP_HandleTypeDef_t *hCap, const uint8_t **ppData) {
+	uint32_t head = __atomic_load_n(&hCap->Head, __ATOMIC_ACQUIRE);
+	uint32_t tail = hCap->Tail;
+	uint32_t index = tail & (CANCAP_RING_BYTES - 1U);
+	uint32_t length = head - tail;
+
+	if (length > CANCAP_RING_BYTES - index) {
+		length = CANCAP_RING_BYTES - index;
+	}
+	*ppData = &hCap->Ring[index];
+	return length;
+}
+
+/**
+ * @brief  Hand 'bytes' from CANCAP_PEEK back to the producer
+ */
+void CANCAP_RELEASE(CANCAP_HandleTypeDef_t *hCap, uint32_t bytes) {
+	__atomic_store_n(&hCap->Tail, hCap->Tail + bytes, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief  Decode one record (the stream header must already be skipped)
+ * @param  pTime: Running stream time, advanced by the record's delta
+ * @retval Bytes used, 0 if 'length' ends inside the record
+ */
+uint32_t CANCAP_PARSE(const uint8_t *pData, uint32_t length,
+		CANCAP_RecordTypeDef_t *pRecord, uint64_t *pTime) {
+	uint64_t delta, value;
+	uint32_t n = CANCAP_GET_VARINT(pData, length, &delta);
+
+	if (n == 0 || n >= length) {
+		return 0;
+	}
+	uint8_t ctrl = pData[n++];
+	memset(pRecord, 0, sizeof(*pRecord));
+
+	if ((ctrl & ((1U << CANCAP_CTRL_FDF_POS) | CANCAP_CTRL_EVENT))
+			== CANCAP_CTRL_EVENT) {
+		uint32_t count = (ctrl & 0x0FU) == CANCAP_EVT_START ? 2U : 1U;
+		pRecord->IsEvent = 1;
+		pRecord->Event = ctrl & 0x0FU;
+		for (uint32_t i = 0; i < count; i++) {
+			uint32_t used = CANCAP_GET_VARINT(&pData[n], length - n, &value);
+			if (used == 0) {
+				return 0;
+			}
+			pRecord->Args[i] = (uint32_t) value;
+			n += used;
+		}
+	} else {
+		uint8_t fd = (ctrl >> CANCAP_CTRL_FDF_POS) & 0x1U;
+		uint8_t b7 = (ctrl >> CANCAP_CTRL_B7_POS) & 0x1U;
+		uint8_t dlc = ctrl & CANCAP_CTRL_DLC_MASK;
+		uint32_t bytes = FDCAN_DLC_TO_BYTES(dlc);
+		uint32_t used = CANCAP_GET_VARINT(&pData[n], length - n, &value);
+
+		if (!fd && bytes > 8U) {
+			bytes = 8U;
+		}
+		if (!fd && b7) {
+			bytes = 0;
+		}
+		if (used == 0 || n + used + bytes > length) {
+			return 0;
+		}
+		n += used;
+
+		FDCAN_FRAME_SET_ID(&pRecord->Frame, (uint32_t) value,
+				(ctrl >> CANCAP_CTRL_XTD_POS) & 0x1U);
+		FDCAN_FRAME_SET_CONTROL(&pRecord->Frame, dlc, fd,
+				(ctrl >> CANCAP_CTRL_BRS_POS) & 0x1U);
+		if (b7 && fd) {
+			pRecord->Frame.w0 |= 1UL << FDCAN_ELEM_ESI_POS;
+		} else if (b7) {
+			FDCAN_FRAME_SET_REMOTE(&pRecord->Frame);
+		}
+		memcpy(FDCAN_FRAME_DATA(&pRecord->Frame), &pData[n], bytes);
+		n += bytes;
+	}
+
+	*pTime += delta;
+	pRecord->Time = *pTime;
+	return n;
+}
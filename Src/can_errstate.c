@@ -0,0 +1,197 @@
+/**
+ ******************************************************************************
+ * @file           : can_errstate.c
+ * @brief          : CAN fault confinement state manager.
+ *
+ * State follows PSR: BO wins over EP, EP over EW. The exceptions are the two
+ * off-bus states: BUS_OFF holds until the backoff expires and Restart is
+ * called, RECOVERING holds until PSR.BO clears, which the controller does
+ * after 128 occurrences of 11 recessive bits.
+ ******************************************************************************
+ */
+
+#include <string.h>
+#include "can_errstate.h"
+
+/***** Private Helpers *****/
+FDCAN_INLINE uint32_t CANERR_NOW(const CANERR_HandleTypeDef_t *hErr) {
+	return hErr->GetTicks();
+}
+
+/* Wrap-safe "deadline has passed" on a free-running tick counter */
+FDCAN_INLINE uint8_t CANERR_EXPIRED(uint32_t now, uint32_t deadline) {
+	return (int32_t) (now - deadline) >= 0;
+}
+
+FDCAN_INLINE uint32_t CANERR_MS_TO_TICKS(const CANERR_HandleTypeDef_t *hErr,
+		uint32_t ms) {
+	return ms * 1000U * hErr->TicksPerUs;
+}
+
+/**
+ * @brief  Charge the time since the last call to the current state
+ * @note   Called often enough (every POLL), a 32-bit tick counter that wraps
+ *         in seconds still gives exact 64-bit totals
+ */
+static void CANERR_ACCOUNT(CANERR_HandleTypeDef_t *hErr, uint32_t now) {
+	hErr->StateTicks[hErr->State] += now - hErr->LastTicks;
+	hErr->LastTicks = now;
+}
+
+static void CANERR_ENTER(CANERR_HandleTypeDef_t *hErr, uint8_t state,
+		uint32_t now) {
+	uint8_t from = hErr->State;
+
+	if (state == from) {
+		return;
+	}
+	CANERR_ACCOUNT(hErr, now);
+	hErr->State = state;
+	hErr->Entered[state]++;
+
+	if (state == CANERR_STATE_BUS_OFF) {
+		uint32_t backoff = (hErr->Attempts < hErr->FastAttempts) ?
+				hErr->FastBackoffMs : hErr->SlowBackoffMs;
+		if (hErr->Attempts < 0xFFU) {
+			hErr->Attempts++;
+		}
+		hErr->BusOffTicks = now;
+		hErr->RestartDeadline = now + CANERR_MS_TO_TICKS(hErr, backoff);
+	} else if (from >= CANERR_STATE_BUS_OFF && state < CANERR_STATE_BUS_OFF) {
+		uint32_t downUs = (now - hErr->BusOffTicks) / hErr->TicksPerUs;
+		hErr->Recoveries++;
+		hErr->DowntimeLastUs = downUs;
+		if (downUs > hErr->DowntimeMaxUs) {
+			hErr->DowntimeMaxUs = downUs;
+		}
+		hErr->LastBusOffEnd = now;
+	}
+
+	if (hErr->StateChange != NULL) {
+		hErr->StateChange(hErr->Ctx, from, state);
+	}
+}
+
+/***** Public API *****/
+
+/**
+ * @brief  Reset the manager to error active; zero policy fields get defaults
+ */
+void CANERR_INIT(CANERR_HandleTypeDef_t *hErr) {
+	if (hErr->FastBackoffMs == 0 && hErr->SlowBackoffMs == 0
+			&& hErr->StableMs == 0) {
+		hErr->FastBackoffMs = CANERR_FAST_BACKOFF_MS;
+		hErr->SlowBackoffMs = CANERR_SLOW_BACKOFF_MS;
+		hErr->StableMs = CANERR_STABLE_MS;
+		hErr->FastAttempts = CANERR_FAST_ATTEMPTS;
+	}
+
+	hErr->State = CANERR_STATE_ACTIVE;
+	hErr->Attempts = 0;
+	hErr->Tec = hErr->Rec = 0;
+	hErr->TecMax = hErr->RecMax = 0;
+	hErr->Recoveries = 0;
+	hErr->LoggedErrors = 0;
+	hErr->DowntimeMaxUs = hErr->DowntimeLastUs = 0;
+	memset(hErr->StateTicks, 0, sizeof(hErr->StateTicks));
+	memset(hErr->Entered, 0, sizeof(hErr->Entered));
+	memset(hErr->ArbErrors, 0, sizeof(hErr->ArbErrors));
+	memset(hErr->DataErrors, 0, sizeof(hErr->DataErrors));
+	hErr->LastTicks = CANERR_NOW(hErr);
+	hErr->LastBusOffEnd = hErr->LastTicks;
+}
+
+/**
+ * @brief  Feed one PSR/ECR snapshot
+ * @note   Reading PSR resets LEC/DLEC and reading ECR resets CEL, so every
+ *         read of those registers should end up here to keep the counts
+ */
+void CANERR_UPDATE(CANERR_HandleTypeDef_t *hErr, uint32_t psr, uint32_t ecr) {
+	uint32_t now = CANERR_NOW(hErr);
+	uint8_t lec = (uint8_t) ((psr >> CANERR_PSR_LEC_POS) & 0x7U);
+	uint8_t dlec = (uint8_t) ((psr >> CANERR_PSR_DLEC_POS) & 0x7U);
+
+	if (lec != CANERR_LEC_NONE && lec != CANERR_LEC_NO_CHANGE) {
+		hErr->ArbErrors[lec]++;
+	}
+	if (dlec != CANERR_LEC_NONE && dlec != CANERR_LEC_NO_CHANGE) {
+		hErr->DataErrors[dlec]++;
+	}
+
+	hErr->Tec = (uint8_t) (ecr >> CANERR_ECR_TEC_POS);
+	hErr->Rec = (uint8_t) ((ecr >> CANERR_ECR_REC_POS) & 0x7FU);
+	hErr->LoggedErrors += (ecr >> CANERR_ECR_CEL_POS) & 0xFFU;
+	if (hErr->Tec > hErr->TecMax) {
+		hErr->TecMax = hErr->Tec;
+	}
+	if (hErr->Rec > hErr->RecMax) {
+		hErr->RecMax = hErr->Rec;
+	}
+
+	uint8_t busOff = (psr >> CANERR_PSR_BO_POS) & 0x1U;
+	uint8_t state;
+	if (busOff) {
+		// Already off: BUS_OFF waits for its backoff, RECOVERING for BO to clear
+		state = CANERR_OFF_BUS(hErr) ? hErr->State : CANERR_STATE_BUS_OFF;
+	} else if (hErr->State == CANERR_STATE_BUS_OFF) {
+		state = CANERR_STATE_BUS_OFF; // BO only clears after our Restart
+	} else if ((psr >> CANERR_PSR_EP_POS) & 0x1U) {
+		state = CANERR_STATE_PASSIVE;
+	} else if ((psr >> CANERR_PSR_EW_POS) & 0x1U) {
+		state = CANERR_STATE_WARNING;
+	} else {
+		state = CANERR_STATE_ACTIVE;
+	}
+	CANERR_ENTER(hErr, state, now);
+}
+
+/**
+ * @brief  Error interrupt: IR flags, already cleared, and PSR/ECR read after
+ * @retval IE bits to mask until the next poll re-arms them. PEA/PED fire on
+ *         every protocol error; LEC keeps the codes on a noisy bus meanwhile.
+ */
+uint32_t CANERR_IRQ(CANERR_HandleTypeDef_t *hErr, uint32_t ir, uint32_t psr,
+		uint32_t ecr) {
+	if ((ir & CANERR_IR_FLAGS) == 0) {
+		return 0;
+	}
+	CANERR_UPDATE(hErr, psr, ecr);
+	return ir & CANERR_IR_PROTOCOL_FLAGS;
+}
+
+/**
+ * @brief  Run the bus-off backoff and the state clocks
+ * @note   Call at least once per tick counter wrap
+ */
+void CANERR_POLL(CANERR_HandleTypeDef_t *hErr) {
+	uint32_t now = CANERR_NOW(hErr);
+
+	CANERR_ACCOUNT(hErr, now);
+
+	if (hErr->State == CANERR_STATE_BUS_OFF
+			&& CANERR_EXPIRED(now, hErr->RestartDeadline)) {
+		CANERR_ENTER(hErr, CANERR_STATE_RECOVERING, now);
+		hErr->Restart(hErr->Ctx);
+	}
+
+	if (hErr->Attempts != 0 && !CANERR_OFF_BUS(hErr)
+			&& CANERR_EXPIRED(now,
+					hErr->LastBusOffEnd
+							+ CANERR_MS_TO_TICKS(hErr, hErr->StableMs))) {
+		hErr->Attempts = 0;        // Stable again: next bus-off restarts fast
+	}
+}
+
+/**
+ * @brief  Total time spent in 'state' since CANERR_INIT, up to now
+ */
+uint64_t CANERR_TIME_IN_STATE_US(CANERR_HandleTypeDef_t *hErr, uint8_t state) {
+	CANERR_ACCOUNT(hErr, CANERR_NOW(hErr));
+	return hErr->StateTicks[state] / hErr->TicksPerUs;
+}
+
+const char* CANERR_STATE_NAME(uint8_t state) {
+	static const char *const names[CANERR_STATE_COUNT] = { "Active",
+			"Warning", "Passive", "Bus-off", "Recovering" };
+	return (state < CANERR_STATE_COUNT) ? names[state] : "?";
+}
@@ -0,0 +1,208 @@
+/**
+ ******************************************************************************
+ * @file           : can_onchange.c
+ * @brief          : Send-on-change transmit filter with per-signal deadbands.
+ *
+ * Payload words are little-endian: DBC bit b of an Intel signal is bit b % 32
+ * of word b / 32. Motorola signals are numbered MSB first instead, bit 7 of
+ * byte 0 being 0; they are read from the byte-reversed two-word window.
+ ******************************************************************************
+ */
+
+#include <stddef.h>
+#include "can_onchange.h"
+
+#define CANCHG_ID_MASK              ((1UL << FDCAN_ELEM_XTD_POS) \
+		| (1UL << FDCAN_ELEM_RTR_POS) | FDCAN_ELEM_EXTID_MASK)
+
+#ifndef CANCHG_REV32
+#define CANCHG_REV32(x) __builtin_bswap32(x) // REV on Cortex-M33
+#endif
+
+/***** Private Helpers *****/
+
+/* MSB-first position of DBC bit 'bit' */
+FDCAN_INLINE uint32_t CANCHG_SEQ(uint32_t bit) {
+	return (bit & ~7U) + 7U - (bit & 7U);
+}
+
+/* DBC bit at MSB-first position 'seq' */
+FDCAN_INLINE uint32_t CANCHG_UNSEQ(uint32_t seq) {
+	return (seq & ~7U) + 7U - (seq & 7U);
+}
+
+/* Deadband signal value as a signed number */
+FDCAN_INLINE int64_t CANCHG_VALUE(const CANCHG_SignalTypeDef_t *s,
+		uint32_t raw) {
+	if (s->Signed && s->Length < 32U) {
+		uint32_t up = 32U - s->Length;
+		return (int32_t) (raw << up) >> up;
+	}
+	return s->Signed ? (int32_t) raw : (int64_t) raw;
+}
+
+/**
+ * @brief  Build the exact-compare masks and signal windows of every entry
+ * @retval 0 on success, 1 if a signal is too long or outside the shadow
+ */
+uint8_t CANCHG_INIT(CANCHG_HandleTypeDef_t *hChg) {
+	hChg->Offered = 0;
+	hChg->Suppressed = 0;
+
+	for (uint32_t n = 0; n < hChg->EntryCount; n++) {
+		CANCHG_EntryTypeDef_t *e = &hChg->Entries[n];
+		FDCAN_FrameTypeDef_t key;
+
+		FDCAN_FRAME_SET_ID(&key, e->Id, e->Extended);
+		e->Key = key.w0;
+		for (uint32_t w = 0; w < CANCHG_MAX_WORDS; w++) {
+			e->ExactMask[w] = 0xFFFFFFFFU;
+		}
+		if (e->SignalCount > CANCHG_MAX_SIGNALS) {
+			return 1;
+		}
+
+		for (uint32_t i = 0; i < e->SignalCount; i++) {
+			const CANCHG_SignalTypeDef_t *s = &e->Signals[i];
+			uint32_t first;            // Lowest bit in its own numbering
+			if (s->Length == 0 || s->Length > 32U) {
+				return 1;
+			}
+			if (s->ByteOrder == CANCHG_INTEL) {
+				first = s->StartBit;
+				e->Window[i] = (uint8_t) (first / 32U);
+				e->Shift[i] = (uint8_t) (first % 32U);
+			} else {
+				first = CANCHG_SEQ(s->StartBit);
+				uint32_t last = first + s->Length - 1U; // LSB, MSB first
+				e->Window[i] = (uint8_t) (first / 32U);
+				e->Shift[i] = (uint8_t) (63U - (last - 32U * e->Window[i]));
+			}
+			if (first + s->Length > CANCHG_MAX_WORDS * 32U) {
+				return 1;
+			}
+
+			// Its bits leave the exact compare
+			for (uint32_t k = first; k < first + s->Length; k++) {
+				uint32_t bit = (s->ByteOrder == CANCHG_INTEL) ?
+						k : CANCHG_UNSEQ(k);
+				e->ExactMask[bit / 32U] &= ~(1UL << (bit % 32U));
+			}
+		}
+
+		e->Valid = 0;
+		e->Offered = 0;
+		e->Sent = 0;
+		e->Refreshed = 0;
+	}
+	return 0;
+}
+
+/**
+ * @brief  Entry of the frame's identifier
+ * @retval NULL if the identifier is not filtered
+ */
+CANCHG_EntryTypeDef_t* CANCHG_FIND(CANCHG_HandleTypeDef_t *hChg,
+		const FDCAN_FrameTypeDef_t *pFrame) {
+	uint32_t key = pFrame->w0 & CANCHG_ID_MASK;
+
+	for (uint32_t n = 0; n < hChg->EntryCount; n++) {
+		if (hChg->Entries[n].Key == key) {
+			return &hChg->Entries[n];
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief  Raw value of deadband signal 'signal' in the payload words pData
+ */
+uint32_t CANCHG_SIGNAL_RAW(const CANCHG_EntryTypeDef_t *e, uint32_t signal,
+		const uint32_t *pData) {
+	const CANCHG_SignalTypeDef_t *s = &e->Signals[signal];
+	uint32_t w = e->Window[signal];
+	uint32_t lo = pData[w];
+	uint32_t hi = (w + 1U < CANCHG_MAX_WORDS) ? pData[w + 1U] : 0;
+	uint64_t window;
+
+	if (s->ByteOrder == CANCHG_INTEL) {
+		window = ((uint64_t) hi << 32) | lo;
+	} else {
+		window = ((uint64_t) CANCHG_REV32(lo) << 32) | CANCHG_REV32(hi);
+	}
+	uint64_t mask = (1ULL << s->Length) - 1U;
+	return (uint32_t) ((window >> e->Shift[signal]) & mask);
+}
+
+/**
+ * @brief  Decide whether a frame about to be queued is worth sending
+ * @note   A frame that passes becomes the new shadow of its identifier, so
+ *         call this only right before queueing it
+ * @retval CANCHG_SEND or CANCHG_SUPPRESS
+ */
+uint8_t CANCHG_FILTER(CANCHG_HandleTypeDef_t *hChg,
+		const FDCAN_FrameTypeDef_t *pFrame) {
+	CANCHG_EntryTypeDef_t *e = CANCHG_FIND(hChg, pFrame);
+	if (e == NULL) {
+		return CANCHG_SEND;
+	}
+	uint32_t length = FDCAN_FRAME_GET_LEN(pFrame);
+	uint32_t words = (length + 3U) / 4U;
+	if (words > CANCHG_MAX_WORDS) {
+		return CANCHG_SEND;
+	}
+
+	uint32_t now = hChg->GetTicks();
+	e->Offered++;
+	hChg->Offered++;
+
+	uint8_t send = !e->Valid || pFrame->w1 != e->LastW1;
+	if (!send && words != 0) {
+		// Bytes past the DLC in the last word are not compared
+		uint32_t tail = (length & 3U) ?
+				(1UL << (8U * (length & 3U))) - 1U : 0xFFFFFFFFU;
+		uint32_t diff = 0;
+		for (uint32_t w = 0; w + 1U < words; w++) {
+			diff |= (pFrame->data[w] ^ e->LastData[w]) & e->ExactMask[w];
+		}
+		diff |= (pFrame->data[words - 1U] ^ e->LastData[words - 1U])
+				& e->ExactMask[words - 1U] & tail;
+		send = (diff != 0);
+	}
+	for (uint32_t i = 0; !send && i < e->SignalCount; i++) {
+		const CANCHG_SignalTypeDef_t *s = &e->Signals[i];
+		int64_t delta = CANCHG_VALUE(s, CANCHG_SIGNAL_RAW(e, i, pFrame->data))
+				- CANCHG_VALUE(s, CANCHG_SIGNAL_RAW(e, i, e->LastData));
+		send = (delta > (int64_t) s->Deadband || -delta > (int64_t) s->Deadband);
+	}
+	if (!send && e->RefreshMs != 0
+			&& now - e->LastTicks >= e->RefreshMs * hChg->TicksPerMs) {
+		send = 1;
+		e->Refreshed++;
+	}
+	if (!send) {
+		hChg->Suppressed++;
+		return CANCHG_SUPPRESS;
+	}
+
+	e->Valid = 1;
+	e->LastW1 = pFrame->w1;
+	for (uint32_t w = 0; w < CANCHG_MAX_WORDS; w++) {
+		e->LastData[w] = (w < words) ? pFrame->data[w] : 0;
+	}
+	e->LastTicks = now;
+	e->Sent++;
+	return CANCHG_SEND;
+}
+
+/**
+ * @brief  Forget the shadow of a frame that passed but could not be queued,
+ *         so the next frame of its identifier is sent whatever it holds
+ */
+void CANCHG_INVALIDATE(CANCHG_HandleTypeDef_t *hChg,
+		const FDCAN_FrameTypeDef_t *pFrame) {
+	CANCHG_EntryTypeDef_t *e = CANCHG_FIND(hChg, pFrame);
+	if (e != NULL) {
+		e->Valid = 0;
+	}
+}
@@ -0,0 +1,276 @@
+/**
+ ******************************************************************************
+ * @file           : can_ratelimit.c
+ * @brief          : Token-bucket TX rate limiter per identifier and per class.
+ *
+ * Buckets are refilled lazily, from the time since their last refill, when a
+ * frame charged to them is submitted or polled; nothing runs per tick.
+ ******************************************************************************
+ */
+
+#include <stddef.h>
+#include "can_ratelimit.h"
+
+#define CANRL_ID_MASK               ((1UL << FDCAN_ELEM_XTD_POS) \
+		| (1UL << FDCAN_ELEM_RTR_POS) | FDCAN_ELEM_EXTID_MASK)
+
+/***** Private Helpers *****/
+
+/* Add the tokens earned since the last refill, up to the burst */
+static void CANRL_REFILL(CANRL_BucketTypeDef_t *b, uint32_t now) {
+	uint64_t tokens = b->Tokens
+			+ (uint64_t) (now - b->LastUs) * b->RatePerSec;
+	uint32_t capacity = (uint32_t) b->Burst * CANRL_TOKEN;
+
+	b->Tokens = (tokens > capacity) ? capacity : (uint32_t) tokens;
+	b->LastUs = now;
+}
+
+/* Bucket of the frame's identifier entry, index into Ids */
+static uint8_t CANRL_FIND_ID(const CANRL_HandleTypeDef_t *hRl,
+		const FDCAN_FrameTypeDef_t *pFrame) {
+	uint32_t key = pFrame->w0 & CANRL_ID_MASK;
+
+	for (uint8_t n = 0; n < hRl->IdCount; n++) {
+		if (hRl->Ids[n].Key == key) {
+			return n;
+		}
+	}
+	return CANRL_NONE;
+}
+
+/* First class whose range holds the frame, index into Classes */
+static uint8_t CANRL_FIND_CLASS(const CANRL_HandleTypeDef_t *hRl,
+		const FDCAN_FrameTypeDef_t *pFrame) {
+	uint32_t id = FDCAN_FRAME_GET_ID(pFrame);
+	uint8_t extended = FDCAN_FRAME_IS_EXTENDED(pFrame);
+
+	for (uint8_t n = 0; n < hRl->ClassCount; n++) {
+		const CANRL_ClassTypeDef_t *c = &hRl->Classes[n];
+		if (c->Extended == extended && id >= c->IdMin && id <= c->IdMax) {
+			return n;
+		}
+	}
+	return CANRL_NONE;
+}
+
+FDCAN_INLINE CANRL_BucketTypeDef_t* CANRL_ID_BUCKET(CANRL_HandleTypeDef_t *hRl,
+		uint8_t n) {
+	return (n == CANRL_NONE) ? NULL : &hRl->Ids[n].Bucket;
+}
+
+FDCAN_INLINE CANRL_BucketTypeDef_t* CANRL_CLASS_BUCKET(
+		CANRL_HandleTypeDef_t *hRl, uint8_t n) {
+	return (n == CANRL_NONE) ? NULL : &hRl->Classes[n].Bucket;
+}
+
+FDCAN_INLINE uint8_t CANRL_HAS_TOKEN(const CANRL_BucketTypeDef_t *b) {
+	return b == NULL || b->Tokens >= CANRL_TOKEN;
+}
+
+/* Count a frame against a bucket that may be absent */
+#define CANRL_COUNT(b, field)       do { if ((b) != NULL) { (b)->field++; } } while (0)
+
+/* Microseconds until the bucket holds a token, CANRL_IDLE if never */
+static uint32_t CANRL_WAIT_US(const CANRL_BucketTypeDef_t *b) {
+	if (CANRL_HAS_TOKEN(b)) {
+		return 0;
+	}
+	if (b->RatePerSec == 0) {
+		return CANRL_IDLE;
+	}
+	return (CANRL_TOKEN - b->Tokens + b->RatePerSec - 1U) / b->RatePerSec;
+}
+
+/* 1 if no frame ahead of queue slot 'k' is charged to one of its buckets */
+static uint8_t CANRL_IS_FIRST(const CANRL_HandleTypeDef_t *hRl, uint32_t k) {
+	const CANRL_QueuedTypeDef_t *q = &hRl->Queue[k];
+
+	for (uint32_t j = 0; j < k; j++) {
+		const CANRL_QueuedTypeDef_t *p = &hRl->Queue[j];
+		if ((q->IdEntry != CANRL_NONE && p->IdEntry == q->IdEntry)
+				|| (q->Class != CANRL_NONE && p->Class == q->Class)) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/**
+ * @brief  Build the identifier keys and fill every bucket to its burst
+ */
+void CANRL_INIT(CANRL_HandleTypeDef_t *hRl) {
+	uint32_t now = hRl->GetUs();
+
+	for (uint8_t n = 0; n < hRl->IdCount; n++) {
+		CANRL_IdTypeDef_t *e = &hRl->Ids[n];
+		FDCAN_FrameTypeDef_t key;
+		FDCAN_FRAME_SET_ID(&key, e->Id, e->Extended);
+		e->Key = key.w0;
+		e->Bucket.Tokens = (uint32_t) e->Bucket.Burst * CANRL_TOKEN;
+		e->Bucket.LastUs = now;
+		e->Bucket.Waiting = 0;
+		e->Bucket.Passed = e->Bucket.Queued = e->Bucket.Dropped = 0;
+	}
+	for (uint8_t n = 0; n < hRl->ClassCount; n++) {
+		CANRL_BucketTypeDef_t *b = &hRl->Classes[n].Bucket;
+		b->Tokens = (uint32_t) b->Burst * CANRL_TOKEN;
+		b->LastUs = now;
+		b->Waiting = 0;
+		b->Passed = b->Queued = b->Dropped = 0;
+	}
+	hRl->QueueCount = 0;
+	hRl->Submitted = 0;
+	hRl->Unlimited = 0;
+	hRl->QueueFull = 0;
+	hRl->QueuePeak = 0;
+}
+
+/**
+ * @brief  Charge a frame about to be queued for transmission
+ * @retval CANRL_PASS to send it now, CANRL_QUEUED if the limiter took a
+ *         copy, CANRL_DROPPED if it must not be sent
+ */
+uint8_t CANRL_SUBMIT(CANRL_HandleTypeDef_t *hRl,
+		const FDCAN_FrameTypeDef_t *pFrame) {
+	hRl->Submitted++;
+	uint8_t idEntry = CANRL_FIND_ID(hRl, pFrame);
+	uint8_t class = CANRL_FIND_CLASS(hRl, pFrame);
+	if (idEntry == CANRL_NONE && class == CANRL_NONE) {
+		hRl->Unlimited++;
+		return CANRL_PASS;
+	}
+
+	CANRL_BucketTypeDef_t *idB = CANRL_ID_BUCKET(hRl, idEntry);
+	CANRL_BucketTypeDef_t *clB = CANRL_CLASS_BUCKET(hRl, class);
+	uint32_t now = hRl->GetUs();
+	if (idB != NULL) {
+		CANRL_REFILL(idB, now);
+	}
+	if (clB != NULL) {
+		CANRL_REFILL(clB, now);
+	}
+
+	// Frames already waiting in one of its buckets go first
+	uint8_t waiting = (idB != NULL && idB->Waiting != 0)
+			|| (clB != NULL && clB->Waiting != 0);
+	if (!waiting && CANRL_HAS_TOKEN(idB) && CANRL_HAS_TOKEN(clB)) {
+		if (idB != NULL) {
+			idB->Tokens -= CANRL_TOKEN;
+		}
+		if (clB != NULL) {
+			clB->Tokens -= CANRL_TOKEN;
+		}
+		CANRL_COUNT(idB, Passed);
+		CANRL_COUNT(clB, Passed);
+		return CANRL_PASS;
+	}
+
+	uint8_t drop = (idB != NULL && idB->Policy == CANRL_DROP
+			&& !CANRL_HAS_TOKEN(idB))
+			|| (clB != NULL && clB->Policy == CANRL_DROP
+					&& !CANRL_HAS_TOKEN(clB));
+	if (!drop && hRl->QueueCount == CANRL_QUEUE_LEN) {
+		hRl->QueueFull++;
+		drop = 1;
+	}
+	if (drop) {
+		CANRL_COUNT(idB, Dropped);
+		CANRL_COUNT(clB, Dropped);
+		return CANRL_DROPPED;
+	}
+
+	CANRL_QueuedTypeDef_t *q = &hRl->Queue[hRl->QueueCount++];
+	q->Frame = *pFrame;
+	q->IdEntry = idEntry;
+	q->Class = class;
+	if (hRl->QueueCount > hRl->QueuePeak) {
+		hRl->QueuePeak = hRl->QueueCount;
+	}
+	CANRL_COUNT(idB, Waiting);
+	CANRL_COUNT(clB, Waiting);
+	CANRL_COUNT(idB, Queued);
+	CANRL_COUNT(clB, Queued);
+	return CANRL_QUEUED;
+}
+
+/**
+ * @brief  Send the queued frames whose buckets hold a token again
+ * @note   Stops at the first frame Transmit refuses; it is kept
+ * @retval Frames sent
+ */
+uint32_t CANRL_POLL(CANRL_HandleTypeDef_t *hRl) {
+	uint32_t now = hRl->GetUs();
+	uint32_t sent = 0;
+	uint32_t k = 0;
+
+	while (k < hRl->QueueCount) {
+		CANRL_QueuedTypeDef_t *q = &hRl->Queue[k];
+		CANRL_BucketTypeDef_t *idB = CANRL_ID_BUCKET(hRl, q->IdEntry);
+		CANRL_BucketTypeDef_t *clB = CANRL_CLASS_BUCKET(hRl, q->Class);
+		if (idB != NULL) {
+			CANRL_REFILL(idB, now);
+		}
+		if (clB != NULL) {
+			CANRL_REFILL(clB, now);
+		}
+		if (!CANRL_IS_FIRST(hRl, k) || !CANRL_HAS_TOKEN(idB)
+				|| !CANRL_HAS_TOKEN(clB)) {
+			k++;
+			continue;
+		}
+		if (!hRl->Transmit(hRl->Ctx, &q->Frame)) {
+			break;                     // TX FIFO full, try again later
+		}
+
+		if (idB != NULL) {
+			idB->Tokens -= CANRL_TOKEN;
+			idB->Waiting--;
+		}
+		if (clB != NULL) {
+			clB->Tokens -= CANRL_TOKEN;
+			clB->Waiting--;
+		}
+		CANRL_COUNT(idB, Passed);
+		CANRL_COUNT(clB, Passed);
+		sent++;
+
+		// Keep the queue oldest first
+		hRl->QueueCount--;
+		for (uint32_t j = k; j < hRl->QueueCount; j++) {
+			hRl->Queue[j] = hRl->Queue[j + 1U];
+		}
+	}
+	return sent;
+}
+
+/**
+ * @brief  Time until CANRL_POLL can send a queued frame
+ * @retval Microseconds, 0 if one is ready now, CANRL_IDLE if none waits or
+ *         only frames of zero-rate buckets do
+ */
+uint32_t CANRL_NEXT_US(CANRL_HandleTypeDef_t *hRl) {
+	uint32_t now = hRl->GetUs();
+	uint32_t next = CANRL_IDLE;
+
+	for (uint32_t k = 0; k < hRl->QueueCount; k++) {
+		const CANRL_QueuedTypeDef_t *q = &hRl->Queue[k];
+		if (!CANRL_IS_FIRST(hRl, k)) {
+			continue;
+		}
+		CANRL_BucketTypeDef_t *idB = CANRL_ID_BUCKET(hRl, q->IdEntry);
+		CANRL_BucketTypeDef_t *clB = CANRL_CLASS_BUCKET(hRl, q->Class);
+		uint32_t wait = 0;
+		if (idB != NULL) {
+			CANRL_REFILL(idB, now);
+			wait = CANRL_WAIT_US(idB);
+		}
+		if (clB != NULL) {
+			CANRL_REFILL(clB, now);
+			uint32_t w = CANRL_WAIT_US(clB);
+			wait = (w > wait) ? w : wait;
+		}
+		next = (wait < next) ? wait : next;
+	}
+	return next;
+}
@@ -0,0 +1,410 @@
+/**
+ ******************************************************************************
+ * @file           : can_replay.c
+ * @brief          : Trace replay of candump logs and capture streams.
+ *
+ * One frame of the image is parsed ahead into Next. The replay clock is the
+ * sum of GetUs deltas since the first poll; a frame arrives in the FIFO
+ * model once its recorded time, relative to the first frame and scaled,
+ * is behind that clock. Each delivery re-reads the clock, so the time the
+ * RX path spends on a frame lets the following ones pile up as they would
+ * in the hardware FIFO.
+ ******************************************************************************
+ */
+
+#include <string.h>
+#include "can_replay.h"
+#include "can_capture.h"
+
+#define CANRP_DEFAULT_KBPS          500U  // Capture without a START event
+
+/***** Private Helpers *****/
+
+static int32_t CANRP_HEX(uint8_t c) {
+	if (c >= '0' && c <= '9') {
+		return c - '0';
+	} else if (c >= 'A' && c <= 'F') {
+		return c - 'A' + 10;
+	} else if (c >= 'a' && c <= 'f') {
+		return c - 'a' + 10;
+	}
+	return -1;
+}
+
+FDCAN_INLINE uint8_t CANRP_BLANK(uint8_t c) {
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+/* End of the text part of a candump image */
+FDCAN_INLINE uint8_t CANRP_TEXT_END(uint8_t c) {
+	return c == 0 || c == 0xFFU;
+}
+
+/* Replay time at which a frame recorded at recUs arrives */
+static uint64_t CANRP_DUE_US(const CANRP_HandleTypeDef_t *hRp, uint64_t recUs) {
+	uint64_t us = (recUs > hRp->FirstRecUs) ? recUs - hRp->FirstRecUs : 0;
+	return (hRp->Mode == CANRP_SCALED) ? us * 1000U / hRp->ScalePermille : us;
+}
+
+/* Next frame of a candump image, 0 at the end */
+static uint8_t CANRP_NEXT_CANDUMP(CANRP_HandleTypeDef_t *hRp) {
+	while (hRp->Pos < hRp->Length && !CANRP_TEXT_END(hRp->Image[hRp->Pos])) {
+		const uint8_t *line = &hRp->Image[hRp->Pos];
+		uint32_t n = 0;
+		while (hRp->Pos + n < hRp->Length && line[n] != '\n'
+				&& !CANRP_TEXT_END(line[n])) {
+			n++;
+		}
+		hRp->Pos += n;
+		if (hRp->Pos < hRp->Length && hRp->Image[hRp->Pos] == '\n') {
+			hRp->Pos++;
+		}
+		uint8_t res = CANRP_PARSE_CANDUMP(line, n, hRp->Interface, &hRp->Next,
+				&hRp->NextRecUs);
+		if (res == CANRP_LINE_FRAME) {
+			return 1;
+		} else if (res == CANRP_LINE_SKIP) {
+			hRp->Skipped += (n != 0);
+		} else {
+			hRp->Malformed++;
+		}
+	}
+	return 0;
+}
+
+/* Next frame of a capture stream, 0 at the end */
+static uint8_t CANRP_NEXT_CAPTURE(CANRP_HandleTypeDef_t *hRp) {
+	CANCAP_RecordTypeDef_t r;
+	while (hRp->Pos < hRp->Length) {
+		uint32_t used = CANCAP_PARSE(&hRp->Image[hRp->Pos],
+				hRp->Length - hRp->Pos, &r, &hRp->CaptureBits);
+		if (used == 0) {
+			// Erased flash after the stream is its end, anything else is cut off
+			hRp->Malformed += !CANRP_TEXT_END(hRp->Image[hRp->Pos]);
+			hRp->Pos = hRp->Length;
+			break;
+		}
+		hRp->Pos += used;
+		if (!r.IsEvent) {
+			hRp->Next = r.Frame;
+			hRp->NextRecUs = r.Time * 1000U / hRp->CaptureKbps;
+			return 1;
+		} else if (r.Event == CANCAP_EVT_START && r.Args[0] != 0) {
+			hRp->CaptureKbps = r.Args[0];
+		} else if (r.Event == CANCAP_EVT_DROP) {
+			hRp->SourceDropped += r.Args[0];
+		}
+	}
+	return 0;
+}
+
+/* Parse ahead into Next */
+static void CANRP_LOAD(CANRP_HandleTypeDef_t *hRp) {
+	if (hRp->HaveNext) {
+		return;
+	}
+	hRp->HaveNext = (hRp->Format == CANRP_FMT_CAPTURE) ?
+			CANRP_NEXT_CAPTURE(hRp) : CANRP_NEXT_CANDUMP(hRp);
+	if (hRp->HaveNext) {
+		hRp->Frames++;
+		if (!hRp->HaveFirst) {
+			hRp->HaveFirst = 1;
+			hRp->FirstRecUs = hRp->NextRecUs;
+		}
+	}
+}
+
+static void CANRP_CLOCK(CANRP_HandleTypeDef_t *hRp) {
+	uint32_t now = hRp->GetUs();
+	if (!hRp->Started) {
+		hRp->Started = 1;
+		hRp->ElapsedUs = 0;
+	} else {
+		hRp->ElapsedUs += (uint32_t) (now - hRp->LastUs);
+	}
+	hRp->LastUs = now;
+}
+
+/* Next frame into the FIFO, through the acceptance filter */
+static void CANRP_ARRIVE(CANRP_HandleTypeDef_t *hRp, uint64_t dueUs) {
+	hRp->HaveNext = 0;
+	if (hRp->Accept != NULL && !hRp->Accept(hRp->Ctx, &hRp->Next)) {
+		hRp->Filtered++;
+	} else if (hRp->FifoCount == hRp->FifoDepth) {
+		hRp->Overruns++;
+	} else {
+		uint8_t slot = (uint8_t) ((hRp->FifoHead + hRp->FifoCount)
+				% hRp->FifoDepth);
+		hRp->Fifo[slot] = hRp->Next;
+		hRp->FifoDueUs[slot] = dueUs;
+		hRp->FifoCount++;
+		if (hRp->FifoCount > hRp->FifoPeak) {
+			hRp->FifoPeak = hRp->FifoCount;
+		}
+	}
+	CANRP_LOAD(hRp);
+}
+
+/* Every frame due by now; in fast mode, as many as there is room for */
+static void CANRP_ARRIVALS(CANRP_HandleTypeDef_t *hRp) {
+	if (hRp->Mode == CANRP_FAST) {
+		while (hRp->HaveNext && hRp->FifoCount < hRp->FifoDepth) {
+			CANRP_ARRIVE(hRp, hRp->ElapsedUs);
+		}
+		return;
+	}
+	while (hRp->HaveNext) {
+		uint64_t due = CANRP_DUE_US(hRp, hRp->NextRecUs);
+		if (due > hRp->ElapsedUs) {
+			break;
+		}
+		CANRP_ARRIVE(hRp, due);
+	}
+}
+
+/***** Trace Replay API *****/
+
+/**
+ * @brief  Detect the image format, reset the statistics and parse the
+ *         first frame. The replay clock starts at the first CANRP_POLL.
+ */
+void CANRP_INIT(CANRP_HandleTypeDef_t *hRp) {
+	hRp->Format = CANRP_FMT_CANDUMP;
+	hRp->Pos = 0;
+	if (hRp->Length >= CANCAP_HEADER_BYTES
+			&& memcmp(hRp->Image, CANCAP_MAGIC, 4) == 0) {
+		hRp->Format = CANRP_FMT_CAPTURE;
+		hRp->Pos = CANCAP_HEADER_BYTES;
+	}
+	if (hRp->FifoDepth == 0 || hRp->FifoDepth > CANRP_FIFO_MAX) {
+		hRp->FifoDepth = (hRp->FifoDepth == 0) ? 1U : CANRP_FIFO_MAX;
+	}
+	if (hRp->ScalePermille == 0) {
+		hRp->ScalePermille = 1000U;
+	}
+	hRp->CaptureKbps = CANRP_DEFAULT_KBPS;
+	hRp->CaptureBits = 0;
+	hRp->HaveNext = 0;
+	hRp->HaveFirst = 0;
+	hRp->FirstRecUs = 0;
+	hRp->FifoHead = 0;
+	hRp->FifoCount = 0;
+	hRp->Started = 0;
+	hRp->LastUs = 0;
+	hRp->ElapsedUs = 0;
+	hRp->DoneUs = 0;
+	hRp->Done = 0;
+	hRp->Frames = 0;
+	hRp->Filtered = 0;
+	hRp->Overruns = 0;
+	hRp->Delivered = 0;
+	hRp->Skipped = 0;
+	hRp->Malformed = 0;
+	hRp->SourceDropped = 0;
+	hRp->FifoPeak = 0;
+	hRp->LatencySumUs = 0;
+	hRp->LatencyMaxUs = 0;
+	CANRP_LOAD(hRp);
+}
+
+/**
+ * @brief  Let the frames due arrive and deliver up to 'budget' of them
+ * @retval Frames delivered
+ */
+uint32_t CANRP_POLL(CANRP_HandleTypeDef_t *hRp, uint32_t budget) {
+	uint32_t delivered = 0;
+	if (hRp->Done) {
+		return 0;
+	}
+	for (;;) {
+		CANRP_CLOCK(hRp);
+		CANRP_ARRIVALS(hRp);
+		if (hRp->FifoCount == 0 || delivered == budget) {
+			break;
+		}
+		uint8_t slot = hRp->FifoHead;
+		hRp->FifoHead = (uint8_t) ((slot + 1U) % hRp->FifoDepth);
+		hRp->FifoCount--;
+		if (hRp->Mode != CANRP_FAST) {
+			uint64_t late = hRp->ElapsedUs - hRp->FifoDueUs[slot];
+			uint32_t lateUs = (late > 0xFFFFFFFFU) ? 0xFFFFFFFFU : (uint32_t) late;
+			hRp->LatencySumUs += lateUs;
+			if (lateUs > hRp->LatencyMaxUs) {
+				hRp->LatencyMaxUs = lateUs;
+			}
+		}
+		// The hook may run long: the FIFO slot is free before it is called
+		hRp->Deliver(hRp->Ctx, &hRp->Fifo[slot]);
+		hRp->Delivered++;
+		delivered++;
+	}
+	if (!hRp->HaveNext && hRp->FifoCount == 0) {
+		hRp->Done = 1;
+		hRp->DoneUs = hRp->ElapsedUs;
+	}
+	return delivered;
+}
+
+/**
+ * @brief  Microseconds until CANRP_POLL has work, 0 = now
+ * @retval CANRP_IDLE once the image is replayed
+ */
+uint32_t CANRP_NEXT_US(const CANRP_HandleTypeDef_t *hRp) {
+	if (hRp->Done) {
+		return CANRP_IDLE;
+	} else if (hRp->FifoCount != 0 || !hRp->HaveNext || !hRp->Started
+			|| hRp->Mode == CANRP_FAST) {
+		return 0;
+	}
+	uint64_t due = CANRP_DUE_US(hRp, hRp->NextRecUs);
+	if (due <= hRp->ElapsedUs) {
+		return 0;
+	}
+	due -= hRp->ElapsedUs;
+	return (due >= CANRP_IDLE) ? CANRP_IDLE - 1U : (uint32_t) due;
+}
+
+/**
+ * @brief  Parse one candump -L line, without its line end:
+ *         "(sec.usec) iface ID#data", "ID##<flags>data" or "ID#R[len]".
+ *         An ID of more than three digits is extended; classic data may end
+ *         in "_<dlc>" for a DLC over 8, and bytes may be separated by '.'.
+ * @param  interface: Only frames of this interface, NULL = all
+ * @retval CANRP_LINE_FRAME with the frame and its time in us, CANRP_LINE_SKIP
+ *         or CANRP_LINE_BAD
+ */
+uint8_t CANRP_PARSE_CANDUMP(const uint8_t *pLine, uint32_t length,
+		const char *interface, FDCAN_FrameTypeDef_t *pFrame, uint64_t *pUs) {
+	uint32_t i = 0;
+	while (i < length && CANRP_BLANK(pLine[i])) {
+		i++;
+	}
+	if (i == length || pLine[i] == '#') {
+		return CANRP_LINE_SKIP;
+	}
+
+	// Timestamp, fraction scaled to microseconds
+	if (pLine[i++] != '(') {
+		return CANRP_LINE_BAD;
+	}
+	uint64_t sec = 0;
+	uint32_t digits = 0;
+	for (; i < length && pLine[i] >= '0' && pLine[i] <= '9'; i++, digits++) {
+		sec = sec * 10U + (pLine[i] - '0');
+	}
+	if (digits == 0 || i == length || pLine[i++] != '.') {
+		return CANRP_LINE_BAD;
+	}
+	uint32_t usec = 0;
+	for (digits = 0; i < length && pLine[i] >= '0' && pLine[i] <= '9'; i++) {
+		if (digits < 6U) {
+			usec = usec * 10U + (pLine[i] - '0');
+			digits++;
+		}
+	}
+	if (digits == 0 || i == length || pLine[i++] != ')') {
+		return CANRP_LINE_BAD;
+	}
+	for (; digits < 6U; digits++) {
+		usec *= 10U;
+	}
+
+	// Interface
+	while (i < length && CANRP_BLANK(pLine[i])) {
+		i++;
+	}
+	uint32_t name = i;
+	while (i < length && !CANRP_BLANK(pLine[i])) {
+		i++;
+	}
+	if (i == name || i == length) {
+		return CANRP_LINE_BAD;
+	}
+	if (interface != NULL && (strlen(interface) != i - name
+			|| memcmp(&pLine[name], interface, i - name) != 0)) {
+		return CANRP_LINE_SKIP;
+	}
+	while (i < length && CANRP_BLANK(pLine[i])) {
+		i++;
+	}
+
+	// Identifier
+	uint32_t id = 0;
+	for (digits = 0; i < length && CANRP_HEX(pLine[i]) >= 0; i++, digits++) {
+		id = (id << 4) | (uint32_t) CANRP_HEX(pLine[i]);
+	}
+	if (digits == 0 || digits > 8U || i == length || pLine[i++] != '#') {
+		return CANRP_LINE_BAD;
+	}
+	uint8_t extended = digits > 3U;
+	if (extended && id > FDCAN_ELEM_EXTID_MASK) {
+		return CANRP_LINE_SKIP; // Error frame, CAN_ERR_FLAG set
+	} else if (!extended && id > 0x7FFU) {
+		return CANRP_LINE_BAD;
+	}
+	memset(pFrame, 0, sizeof(*pFrame));
+	FDCAN_FRAME_SET_ID(pFrame, id, extended);
+
+	if (i < length && pLine[i] == 'R') {
+		int32_t dlc = (i + 1U < length) ? CANRP_HEX(pLine[i + 1U]) : -1;
+		i += (dlc >= 0) ? 2U : 1U;
+		if (dlc > 8) {
+			return CANRP_LINE_BAD;
+		}
+		FDCAN_FRAME_SET_CONTROL(pFrame, (uint8_t) ((dlc < 0) ? 0 : dlc), 0, 0);
+		FDCAN_FRAME_SET_REMOTE(pFrame);
+	} else {
+		uint8_t fd = 0, brs = 0, esi = 0;
+		if (i < length && pLine[i] == '#') {
+			int32_t flags = (i + 1U < length) ? CANRP_HEX(pLine[i + 1U]) : -1;
+			if (flags < 0) {
+				return CANRP_LINE_BAD;
+			}
+			fd = 1;
+			brs = (flags & 0x1) != 0;
+			esi = (flags & 0x2) != 0;
+			i += 2U;
+		}
+		uint32_t maxBytes = fd ? FDCAN_FRAME_MAX_DATA : 8U;
+		uint8_t *data = FDCAN_FRAME_DATA(pFrame);
+		uint32_t bytes = 0;
+		while (i < length) {
+			if (pLine[i] == '.') {
+				i++;
+				continue;
+			}
+			int32_t hi = CANRP_HEX(pLine[i]);
+			int32_t lo = (i + 1U < length) ? CANRP_HEX(pLine[i + 1U]) : -1;
+			if (hi < 0) {
+				break;
+			} else if (lo < 0 || bytes == maxBytes) {
+				return CANRP_LINE_BAD;
+			}
+			data[bytes++] = (uint8_t) ((hi << 4) | lo);
+			i += 2U;
+		}
+		uint8_t dlc = FDCAN_BYTES_TO_DLC(bytes);
+		if (fd && FDCAN_DLC_TO_BYTES(dlc) != bytes) {
+			return CANRP_LINE_BAD;
+		}
+		if (!fd && i + 1U < length && pLine[i] == '_') {
+			int32_t len8 = CANRP_HEX(pLine[i + 1U]);
+			if (bytes != 8U || len8 < 9) {
+				return CANRP_LINE_BAD;
+			}
+			dlc = (uint8_t) len8;
+			i += 2U;
+		}
+		FDCAN_FRAME_SET_CONTROL(pFrame, dlc, fd, brs);
+		if (esi) {
+			pFrame->w0 |= (1UL << FDCAN_ELEM_ESI_POS);
+		}
+	}
+
+	// Anything after the frame, a direction flag for instance, is set apart
+	if (i < length && !CANRP_BLANK(pLine[i])) {
+		return CANRP_LINE_BAD;
+	}
+	*pUs = sec * 1000000U + usec;
+	return CANRP_LINE_FRAME;
+}
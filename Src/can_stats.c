@@ -0,0 +1,276 @@
+/**
+ ******************************************************************************
+ * @file           : can_stats.c
+ * @brief          : Bus-load and per-ID traffic statistics.
+ *
+ * Frame lengths follow ISO 11898-1:2015. Worst-case dynamic stuffing adds one
+ * bit per 4 after the first over the stuffed region (SOF up to the CRC in
+ * Classic CAN, SOF up to the data in FD). The FD stuff count and CRC carry a
+ * fixed stuff bit every 4 bits instead. The CRC delimiter, ACK, EOF and the
+ * 3-bit intermission are at the nominal rate in both formats.
+ ******************************************************************************
+ */
+
+#include <string.h>
+#include "can_stats.h"
+
+/***** Frame Field Lengths in Bits *****/
+#define CANSTATS_CLASSIC_STD_BITS   34U   // SOF to CRC without data, 11-bit ID
+#define CANSTATS_CLASSIC_EXT_BITS   54U   // Same with 29-bit ID
+#define CANSTATS_FD_STD_ARB_BITS    17U   // SOF to BRS, 11-bit ID
+#define CANSTATS_FD_EXT_ARB_BITS    36U   // SOF to BRS, 29-bit ID
+#define CANSTATS_FD_CTRL_BITS       5U    // ESI and DLC, data phase
+#define CANSTATS_FD_SBC_BITS        4U    // Stuff bit count with parity
+#define CANSTATS_FD_CRC17_BITS      (17U + 6U) // CRC plus fixed stuff bits
+#define CANSTATS_FD_CRC21_BITS      (21U + 7U)
+#define CANSTATS_TAIL_BITS          13U   // CRC delimiter, ACK, EOF, intermission
+
+/***** Private Helpers *****/
+
+/* Worst-case dynamic stuff bits over 'bits' stuffed bits */
+FDCAN_INLINE uint32_t CANSTATS_STUFF_BITS(uint32_t bits) {
+	return (bits - 1U) / 4U;
+}
+
+/* Key of an identifier: never 0, so 0 marks a free slot */
+FDCAN_INLINE uint32_t CANSTATS_KEY(uint32_t id, uint8_t extended) {
+	return id | ((uint32_t) extended << 29) | (1UL << 31);
+}
+
+FDCAN_INLINE uint32_t CANSTATS_HASH(uint32_t key) {
+	return ((key * 0x9E3779B1U) >> 16) & (CANSTATS_ID_SLOTS - 1U);
+}
+
+/* Bit times in ns at 'kbps', rounded up */
+FDCAN_INLINE uint32_t CANSTATS_BITS_TO_NS(uint32_t bits, uint32_t kbps) {
+	return (uint32_t) (((uint64_t) bits * 1000000U + kbps - 1U) / kbps);
+}
+
+/**
+ * @brief  Close the buckets that ended before 'now' and open the current one
+ * @note   Idle buckets are zeroed on the way, so a quiet bus reads as 0 % even
+ *         if no frame arrives to move the ring along
+ */
+static void CANSTATS_ADVANCE(CANSTATS_HandleTypeDef_t *hStats, uint32_t now) {
+	uint32_t steps = 0;
+
+	while ((now - hStats->BucketStart) >= hStats->BucketTicks) {
+		uint32_t busy = hStats->BucketNs[hStats->BucketIndex];
+		if (busy > hStats->PeakBucketNs) {
+			hStats->PeakBucketNs = busy;
+		}
+		if (hStats->BucketsDone < CANSTATS_BUCKETS) {
+			hStats->BucketsDone++;
+		}
+		if (++hStats->BucketIndex >= CANSTATS_BUCKETS) {
+			hStats->BucketIndex = 0;
+		}
+		hStats->BucketNs[hStats->BucketIndex] = 0;
+		hStats->BucketStart += hStats->BucketTicks;
+
+		if (++steps >= CANSTATS_BUCKETS) {
+			// Idle longer than the history: everything is zero, resync
+			hStats->BucketStart = now;
+			break;
+		}
+	}
+}
+
+/***** Public API *****/
+
+/**
+ * @brief  Worst-case length of one frame on the wire
+ * @param  format: CANSTATS_FMT_CLASSIC, _FD or _FD_BRS
+ * @param  bytes: Payload length (at most 8 for Classic, 64 for FD)
+ * @param  pDataBits: Receives the bits sent at the data rate (0 unless
+ *         BRS), may be NULL
+ * @retval Total bits, intermission included
+ */
+uint32_t CANSTATS_WIRE_BITS(uint8_t format, uint8_t extended, uint32_t bytes,
+		uint32_t *pDataBits) {
+	uint32_t total, dataPhase = 0;
+
+	if (format == CANSTATS_FMT_CLASSIC) {
+		uint32_t stuffed = (extended ? CANSTATS_CLASSIC_EXT_BITS :
+				CANSTATS_CLASSIC_STD_BITS) + 8U * bytes;
+		total = stuffed + CANSTATS_STUFF_BITS(stuffed) + CANSTATS_TAIL_BITS;
+	} else {
+		uint32_t arb = extended ? CANSTATS_FD_EXT_ARB_BITS : CANSTATS_FD_STD_ARB_BITS;
+		uint32_t data = CANSTATS_FD_CTRL_BITS + 8U * bytes;
+		uint32_t arbStuff = CANSTATS_STUFF_BITS(arb);
+		uint32_t dataStuff = CANSTATS_STUFF_BITS(arb + data) - arbStuff;
+		uint32_t crc = (bytes > 16U) ? CANSTATS_FD_CRC21_BITS : CANSTATS_FD_CRC17_BITS;
+
+		dataPhase = data + dataStuff + CANSTATS_FD_SBC_BITS + crc;
+		total = arb + arbStuff + dataPhase + CANSTATS_TAIL_BITS;
+		if (format != CANSTATS_FMT_FD_BRS) {
+			dataPhase = 0;
+		}
+	}
+	if (pDataBits != NULL) {
+		*pDataBits = dataPhase;
+	}
+	return total;
+}
+
+/**
+ * @brief  Build the wire time table and clear all counters
+ * @note   BucketMs of 0 defaults to 10 ms, DataKbps of 0 to NominalKbps
+ */
+void CANSTATS_INIT(CANSTATS_HandleTypeDef_t *hStats) {
+	if (hStats->BucketMs == 0) {
+		hStats->BucketMs = 10U;
+	}
+	if (hStats->DataKbps == 0) {
+		hStats->DataKbps = hStats->NominalKbps;
+	}
+
+	for (uint8_t fmt = 0; fmt < CANSTATS_FMT_COUNT; fmt++) {
+		for (uint8_t ext = 0; ext < 2; ext++) {
+			for (uint8_t dlc = 0; dlc < 16; dlc++) {
+				uint32_t bytes = FDCAN_DLC_TO_BYTES(dlc);
+				uint32_t dataBits;
+				if (fmt == CANSTATS_FMT_CLASSIC && bytes > 8U) {
+					bytes = 8U;    // Classic DLC 9..15 still carries 8 bytes
+				}
+				uint32_t bits = CANSTATS_WIRE_BITS(fmt, ext, bytes, &dataBits);
+				hStats->WireBitsTable[fmt][ext][dlc] = bits;
+				hStats->WireNsTable[fmt][ext][dlc] =
+						CANSTATS_BITS_TO_NS(bits - dataBits, hStats->NominalKbps)
+								+ CANSTATS_BITS_TO_NS(dataBits, hStats->DataKbps);
+			}
+		}
+	}
+
+	memset(hStats->BucketNs, 0, sizeof(hStats->BucketNs));
+	memset(hStats->Ids, 0, sizeof(hStats->Ids));
+	memset(hStats->Frames, 0, sizeof(hStats->Frames));
+	hStats->BucketIndex = 0;
+	hStats->BucketsDone = 0;
+	hStats->PeakBucketNs = 0;
+	hStats->BucketTicks = hStats->BucketMs * 1000U * hStats->TicksPerUs;
+	hStats->IdCount = 0;
+	hStats->Bytes = hStats->WireBits = hStats->WireNs = 0;
+	hStats->Untracked = 0;
+	hStats->StartTicks = hStats->GetTicks();
+	hStats->BucketStart = hStats->StartTicks;
+}
+
+/**
+ * @brief  Account one frame seen on the bus
+ * @note   Not reentrant: callers in different interrupt priorities must
+ *         serialize around it
+ */
+void CANSTATS_FRAME(CANSTATS_HandleTypeDef_t *hStats,
+		const FDCAN_FrameTypeDef_t *pFrame, uint8_t direction) {
+	uint32_t now = hStats->GetTicks();
+	uint32_t w1 = pFrame->w1;
+	uint8_t ext = FDCAN_FRAME_IS_EXTENDED(pFrame);
+	uint8_t fmt = ((w1 >> FDCAN_ELEM_FDF_POS) & 0x1U) ?
+			(uint8_t) (CANSTATS_FMT_FD + ((w1 >> FDCAN_ELEM_BRS_POS) & 0x1U)) :
+			CANSTATS_FMT_CLASSIC;
+	uint8_t dlc = FDCAN_FRAME_IS_REMOTE(pFrame) ? 0 : FDCAN_FRAME_GET_DLC(pFrame);
+	uint32_t bytes = FDCAN_DLC_TO_BYTES(dlc);
+	uint32_t ns = hStats->WireNsTable[fmt][ext][dlc];
+
+	if (fmt == CANSTATS_FMT_CLASSIC && bytes > 8U) {
+		bytes = 8U;
+	}
+
+	/* Bus load */
+	if ((now - hStats->BucketStart) >= hStats->BucketTicks) {
+		CANSTATS_ADVANCE(hStats, now);
+	}
+	hStats->BucketNs[hStats->BucketIndex] += ns;
+	hStats->Frames[direction]++;
+	hStats->Bytes += bytes;
+	hStats->WireBits += hStats->WireBitsTable[fmt][ext][dlc];
+	hStats->WireNs += ns;
+
+	/* Per-ID counters */
+	uint32_t key = CANSTATS_KEY(FDCAN_FRAME_GET_ID(pFrame), ext);
+	uint32_t slot = CANSTATS_HASH(key);
+	for (uint32_t probe = 0; probe < CANSTATS_PROBE_LIMIT; probe++) {
+		CANSTATS_IdEntryTypeDef_t *e = &hStats->Ids[slot];
+		if (e->Key != key) {
+			if (e->Key != 0) {
+				slot = (slot + 1U) & (CANSTATS_ID_SLOTS - 1U);
+				continue;
+			}
+			e->Key = key;
+			hStats->IdCount++;
+		}
+		if (direction == CANSTATS_TX) {
+			e->TxFrames++;
+		} else {
+			e->RxFrames++;
+		}
+		e->Bytes += bytes;
+		e->WireNs += ns;
+		e->LastTicks = now;
+		return;
+	}
+	hStats->Untracked++;
+}
+
+/**
+ * @brief  Bus load over the most recent complete buckets covering 'windowMs'
+ * @retval Load in 0.1 % units; can exceed 1000 only if the worst-case
+ *         stuffing estimate does
+ * @note   The window is rounded down to whole buckets (at least one) and
+ *         limited to the history collected so far
+ */
+uint32_t CANSTATS_LOAD_PERMILLE(CANSTATS_HandleTypeDef_t *hStats,
+		uint32_t windowMs) {
+	uint32_t buckets = windowMs / hStats->BucketMs;
+	uint64_t busyNs = 0;
+
+	CANSTATS_ADVANCE(hStats, hStats->GetTicks());
+	if (buckets == 0) {
+		buckets = 1;
+	}
+	if (buckets > hStats->BucketsDone) {
+		buckets = hStats->BucketsDone;
+	}
+	if (buckets == 0) {
+		return 0;
+	}
+	if (buckets >= CANSTATS_BUCKETS) {
+		buckets = CANSTATS_BUCKETS - 1U; // The current bucket is still filling
+	}
+
+	uint32_t index = hStats->BucketIndex;
+	for (uint32_t i = 0; i < buckets; i++) {
+		index = (index == 0) ? CANSTATS_BUCKETS - 1U : index - 1U;
+		busyNs += hStats->BucketNs[index];
+	}
+	return (uint32_t) (busyNs / ((uint64_t) buckets * hStats->BucketMs * 1000U));
+}
+
+/**
+ * @brief  Load of the busiest single bucket since CANSTATS_INIT, 0.1 % units
+ */
+uint32_t CANSTATS_PEAK_PERMILLE(const CANSTATS_HandleTypeDef_t *hStats) {
+	return hStats->PeakBucketNs / (hStats->BucketMs * 1000U);
+}
+
+/**
+ * @brief  Counters of one identifier, NULL if it was never seen or untracked
+ */
+const CANSTATS_IdEntryTypeDef_t* CANSTATS_FIND(
+		const CANSTATS_HandleTypeDef_t *hStats, uint32_t id, uint8_t extended) {
+	uint32_t key = CANSTATS_KEY(id, extended);
+	uint32_t slot = CANSTATS_HASH(key);
+
+	for (uint32_t probe = 0; probe < CANSTATS_PROBE_LIMIT; probe++) {
+		const CANSTATS_IdEntryTypeDef_t *e = &hStats->Ids[slot];
+		if (e->Key == key) {
+			return e;
+		}
+		if (e->Key == 0) {
+			break;
+		}
+		slot = (slot + 1U) & (CANSTATS_ID_SLOTS - 1U);
+	}
+	return NULL;
+}
@@ -0,0 +1,249 @@
+/**
+ ******************************************************************************
+ * @file           : can_timesync.c
+ * @brief          : Global time over CAN, after AUTOSAR CanTSyn: a master
+ *                   sends SYNC and FUP, slaves correct a local clock to it.
+ ******************************************************************************
+ */
+
+#include <stddef.h>
+#include "can_timesync.h"
+
+#define CANTS_OVS_MAX               3U    // Whole seconds FUP can add
+
+/***** Private Helpers *****/
+
+static void CANTS_PUT_BE32(uint8_t *p, uint32_t v) {
+	p[0] = (uint8_t) (v >> 24);
+	p[1] = (uint8_t) (v >> 16);
+	p[2] = (uint8_t) (v >> 8);
+	p[3] = (uint8_t) v;
+}
+
+static uint32_t CANTS_GET_BE32(const uint8_t *p) {
+	return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16)
+			| ((uint32_t) p[2] << 8) | p[3];
+}
+
+/* Empty 8-byte frame of the time domain */
+static uint8_t* CANTS_FRAME(FDCAN_FrameTypeDef_t *pFrame, uint32_t id,
+		uint8_t extended, uint8_t type, uint8_t domain, uint8_t seq) {
+	uint8_t *d = FDCAN_FRAME_DATA(pFrame);
+
+	FDCAN_FRAME_SET_ID(pFrame, id, extended);
+	FDCAN_FRAME_SET_CONTROL(pFrame, FDCAN_BYTES_TO_DLC(CANTS_FRAME_BYTES), 0,
+			0);
+	for (uint32_t i = 0; i < CANTS_FRAME_BYTES; i++) {
+		d[i] = 0;
+	}
+	d[0] = type;
+	d[2] = (uint8_t) ((domain << 4) | (seq & 0xFU));
+	return d;
+}
+
+/* x * ppb / 1e9 without overflow for any x a clock can hold */
+static int64_t CANTS_SCALE_PPB(int64_t x, int32_t ppb) {
+	int64_t ns = (int64_t) CANTS_NS_PER_SEC;
+	return (x / ns) * ppb + ((x % ns) * ppb) / ns;
+}
+
+/* Slave estimate of the global time at a local time */
+static uint64_t CANTS_ESTIMATE(const CANTS_SlaveTypeDef_t *hSlave,
+		uint64_t localNs) {
+	int64_t elapsed = (int64_t) (localNs - hSlave->RefLocalNs);
+	return hSlave->RefGlobalNs + (uint64_t) (elapsed
+			+ CANTS_SCALE_PPB(elapsed, hSlave->RatePpb));
+}
+
+/* Measure the rate once the window since the last measurement is long enough */
+static void CANTS_RATE(CANTS_SlaveTypeDef_t *hSlave, uint64_t localNs,
+		uint64_t globalNs) {
+	if (hSlave->RateWindowNs == 0) {
+		return;
+	}
+	if (hSlave->Pairs == 0) {
+		hSlave->RateLocalNs = localNs;
+		hSlave->RateGlobalNs = globalNs;
+		return;
+	}
+	uint64_t spanLocal = localNs - hSlave->RateLocalNs;
+	if (spanLocal < hSlave->RateWindowNs) {
+		return;
+	}
+
+	int64_t diff = (int64_t) (globalNs - hSlave->RateGlobalNs)
+			- (int64_t) spanLocal;
+	int64_t limit = CANTS_SCALE_PPB((int64_t) spanLocal, hSlave->MaxRatePpb);
+	if (diff > limit || diff < -limit) {
+		hSlave->RateRejected++;    // Master clock stepped, measure again
+	} else {
+		hSlave->RatePpb = (int32_t) ((diff * (int64_t) CANTS_NS_PER_SEC)
+				/ (int64_t) spanLocal);
+		hSlave->RateUpdates++;
+	}
+	hSlave->RateLocalNs = localNs;
+	hSlave->RateGlobalNs = globalNs;
+}
+
+/**
+ * @brief  Clear the master's state and counters
+ */
+void CANTS_MASTER_INIT(CANTS_MasterTypeDef_t *hMaster) {
+	hMaster->Sequence = 0;
+	hMaster->Pending = 0;
+	hMaster->Syncs = 0;
+	hMaster->Fups = 0;
+	hMaster->Unmatched = 0;
+	hMaster->Overflows = 0;
+}
+
+/**
+ * @brief  Master global time at a local time
+ */
+uint64_t CANTS_MASTER_GLOBAL(const CANTS_MasterTypeDef_t *hMaster,
+		uint64_t localNs) {
+	return hMaster->EpochNs + localNs;
+}
+
+/**
+ * @brief  Build the next SYNC, tagged for a TX event with CANTS_MARKER
+ * @param  localNs: now; the SYNC carries the seconds of this time, and
+ *         must be sent within CANTS_OVS_MAX seconds
+ */
+void CANTS_MASTER_SYNC(CANTS_MasterTypeDef_t *hMaster,
+		FDCAN_FrameTypeDef_t *pFrame, uint64_t localNs) {
+	uint8_t seq = hMaster->Sequence;
+	uint32_t sec = (uint32_t) (CANTS_MASTER_GLOBAL(hMaster, localNs)
+			/ CANTS_NS_PER_SEC);
+	uint8_t *d = CANTS_FRAME(pFrame, hMaster->Id, hMaster->Extended,
+			CANTS_TYPE_SYNC, hMaster->Domain, seq);
+
+	CANTS_PUT_BE32(&d[4], sec);
+	FDCAN_FRAME_SET_MARKER(pFrame, CANTS_MARKER(seq));
+	hMaster->PendingSec[seq] = sec;
+	hMaster->Pending |= (uint16_t) (1U << seq);
+	hMaster->Sequence = (uint8_t) ((seq + 1U) & 0xFU);
+	hMaster->Syncs++;
+}
+
+/**
+ * @brief  Take a TX event: build the FUP of the SYNC it confirms
+ * @param  t0LocalNs: local time of the SYNC's start of frame
+ * @retval 1 if pFup holds a FUP to send
+ */
+uint8_t CANTS_MASTER_TX_EVENT(CANTS_MasterTypeDef_t *hMaster, uint8_t marker,
+		uint64_t t0LocalNs, FDCAN_FrameTypeDef_t *pFup) {
+	uint8_t seq = marker & 0xFU;
+	if ((marker & 0xF0U) != CANTS_MARKER(0)
+			|| (hMaster->Pending & (1U << seq)) == 0) {
+		hMaster->Unmatched++;
+		return 0;
+	}
+	hMaster->Pending &= (uint16_t) ~(1U << seq);
+
+	uint64_t t0 = CANTS_MASTER_GLOBAL(hMaster, t0LocalNs);
+	uint64_t base = (uint64_t) hMaster->PendingSec[seq] * CANTS_NS_PER_SEC;
+	uint64_t ns = t0 - base;
+	uint64_t ovs = ns / CANTS_NS_PER_SEC;
+	if (t0 < base || ovs > CANTS_OVS_MAX) {
+		hMaster->Overflows++;
+		return 0;
+	}
+
+	uint8_t *d = CANTS_FRAME(pFup, hMaster->Id, hMaster->Extended,
+			CANTS_TYPE_FUP, hMaster->Domain, seq);
+	d[3] = (uint8_t) ovs;          // SGW 0: synchronized to the time master
+	CANTS_PUT_BE32(&d[4], (uint32_t) (ns % CANTS_NS_PER_SEC));
+	hMaster->Fups++;
+	return 1;
+}
+
+/**
+ * @brief  Forget any SYNC and clock estimate, clear the counters
+ */
+void CANTS_SLAVE_INIT(CANTS_SlaveTypeDef_t *hSlave) {
+	hSlave->SyncValid = 0;
+	hSlave->Synced = 0;
+	hSlave->RatePpb = 0;
+	hSlave->Syncs = hSlave->Fups = hSlave->Pairs = hSlave->Discarded = 0;
+	hSlave->RateUpdates = hSlave->RateRejected = 0;
+	hSlave->LastErrorNs = 0;
+	hSlave->MaxErrorNs = 0;
+}
+
+/**
+ * @brief  Take a SYNC or FUP of the slave's identifier
+ * @param  rxLocalNs: local time of its start of frame
+ */
+void CANTS_SLAVE_RX(CANTS_SlaveTypeDef_t *hSlave,
+		const FDCAN_FrameTypeDef_t *pFrame, uint64_t rxLocalNs) {
+	if (FDCAN_FRAME_GET_ID(pFrame) != hSlave->Id
+			|| FDCAN_FRAME_IS_EXTENDED(pFrame) != hSlave->Extended) {
+		return;
+	}
+	const uint8_t *d = FDCAN_FRAME_CDATA(pFrame);
+	uint8_t seq = d[2] & 0xFU;
+	if (FDCAN_FRAME_GET_LEN(pFrame) < CANTS_FRAME_BYTES
+			|| (d[2] >> 4) != hSlave->Domain) {
+		hSlave->Discarded++;
+		return;
+	}
+
+	if (d[0] == CANTS_TYPE_SYNC) {
+		hSlave->Syncs++;
+		hSlave->SyncValid = 1;
+		hSlave->SyncSeq = seq;
+		hSlave->SyncSec = CANTS_GET_BE32(&d[4]);
+		hSlave->SyncLocalNs = rxLocalNs;
+		return;
+	}
+	if (d[0] != CANTS_TYPE_FUP) {
+		hSlave->Discarded++;
+		return;
+	}
+
+	hSlave->Fups++;
+	uint32_t ns = CANTS_GET_BE32(&d[4]);
+	if (!hSlave->SyncValid || seq != hSlave->SyncSeq
+			|| rxLocalNs - hSlave->SyncLocalNs > hSlave->FollowUpTimeoutNs
+			|| ns >= CANTS_NS_PER_SEC) {
+		hSlave->SyncValid = 0;
+		hSlave->Discarded++;
+		return;
+	}
+	hSlave->SyncValid = 0;
+
+	// Global time at the SYNC's start of frame
+	uint64_t global = ((uint64_t) hSlave->SyncSec + (d[3] & 0x3U))
+			* CANTS_NS_PER_SEC + ns;
+	if (hSlave->Synced) {
+		int64_t err = (int64_t) (CANTS_ESTIMATE(hSlave, hSlave->SyncLocalNs)
+				- global);
+		uint64_t mag = (uint64_t) ((err < 0) ? -err : err);
+		hSlave->LastErrorNs = err;
+		// Until the rate is known the error is mostly the clocks' drift
+		if ((hSlave->RateUpdates != 0 || hSlave->RateWindowNs == 0)
+				&& mag > hSlave->MaxErrorNs) {
+			hSlave->MaxErrorNs = mag;
+		}
+	}
+	CANTS_RATE(hSlave, hSlave->SyncLocalNs, global);
+	hSlave->RefLocalNs = hSlave->SyncLocalNs;
+	hSlave->RefGlobalNs = global;
+	hSlave->Synced = 1;
+	hSlave->Pairs++;
+}
+
+/**
+ * @brief  Slave global time at a local time
+ * @retval CANTS_UNSYNCED (pGlobalNs untouched), CANTS_SYNCED or CANTS_TIMEOUT
+ */
+uint8_t CANTS_SLAVE_GLOBAL(const CANTS_SlaveTypeDef_t *hSlave,
+		uint64_t localNs, uint64_t *pGlobalNs) {
+	if (!hSlave->Synced) {
+		return CANTS_UNSYNCED;
+	}
+	*pGlobalNs = CANTS_ESTIMATE(hSlave, localNs);
+	return (localNs - hSlave->RefLocalNs > hSlave->TimeoutNs) ?
+			CANTS_TIMEOUT : CANTS_SYNCED;
+}
@@ -0,0 +1,294 @@
+/**
+ ******************************************************************************
+ * @file           : can_traffic.c
+ * @brief          : Traffic generator for bus stress and soak tests.
+ *
+ * The target is kept as a running integral: bus time requested from
+ * CANGEN_INIT up to a moment is the load times the elapsed time, plus the
+ * extra load times the burst time in it. Each poll adds the difference to
+ * the credit, so the load stays exact however irregularly it is polled.
+ * Times are in microseconds and loads in permille, which makes their
+ * product nanoseconds of bus time.
+ ******************************************************************************
+ */
+
+#include <stddef.h>
+#include "can_traffic.h"
+
+#define CANGEN_DEFAULT_SEED         0x2545F491U
+
+/***** Private Helpers *****/
+
+/* xorshift32: a few cycles, enough for identifier and length choices */
+FDCAN_INLINE uint32_t CANGEN_RANDOM(CANGEN_HandleTypeDef_t *hGen) {
+	uint32_t x = hGen->Random;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	hGen->Random = x;
+	return x;
+}
+
+/* Uniform in lo..hi inclusive */
+FDCAN_INLINE uint32_t CANGEN_RANGE(CANGEN_HandleTypeDef_t *hGen, uint32_t lo,
+		uint32_t hi) {
+	return (hi > lo) ? lo + CANGEN_RANDOM(hGen) % (hi - lo + 1U) : lo;
+}
+
+FDCAN_INLINE uint8_t CANGEN_CHANCE(CANGEN_HandleTypeDef_t *hGen,
+		uint16_t permille) {
+	return permille != 0 && CANGEN_RANDOM(hGen) % 1000U < permille;
+}
+
+/* Time spent in bursts during the first 'us' microseconds */
+static uint64_t CANGEN_BURST_US(const CANGEN_HandleTypeDef_t *hGen,
+		uint64_t us) {
+	if (hGen->BurstPeriodUs == 0) {
+		return 0;
+	}
+	uint64_t into = us % hGen->BurstPeriodUs;
+	return (us / hGen->BurstPeriodUs) * hGen->BurstLengthUs
+			+ ((into < hGen->BurstLengthUs) ? into : hGen->BurstLengthUs);
+}
+
+/* Bus time requested during the first 'us' microseconds, in ns */
+static uint64_t CANGEN_TARGET_NS(const CANGEN_HandleTypeDef_t *hGen,
+		uint64_t us) {
+	int64_t extra = (int64_t) hGen->BurstLoadPermille - hGen->LoadPermille;
+	return (uint64_t) ((int64_t) (us * hGen->LoadPermille)
+			+ extra * (int64_t) CANGEN_BURST_US(hGen, us));
+}
+
+/* Draw a release time in the period starting at NextUs */
+static void CANGEN_SCHEDULE(CANGEN_HandleTypeDef_t *hGen,
+		CANGEN_StreamTypeDef_t *s) {
+	s->ReleaseUs = s->NextUs + CANGEN_RANGE(hGen, 0, s->JitterUs);
+}
+
+/* First periodic stream whose release has come, CANGEN_NONE if none */
+static uint8_t CANGEN_DUE(const CANGEN_HandleTypeDef_t *hGen, uint32_t now) {
+	for (uint8_t n = 0; n < hGen->StreamCount; n++) {
+		const CANGEN_StreamTypeDef_t *s = &hGen->Streams[n];
+		if (s->PeriodUs != 0 && (int32_t) (now - s->ReleaseUs) >= 0) {
+			return n;
+		}
+	}
+	return CANGEN_NONE;
+}
+
+/* Fill stream by weight */
+static uint8_t CANGEN_PICK_FILL(CANGEN_HandleTypeDef_t *hGen) {
+	uint32_t r = CANGEN_RANDOM(hGen) % hGen->WeightTotal;
+	uint8_t n = 0;
+
+	for (; n < hGen->StreamCount; n++) {
+		const CANGEN_StreamTypeDef_t *s = &hGen->Streams[n];
+		if (s->PeriodUs != 0) {
+			continue;
+		}
+		if (r < s->Weight) {
+			break;
+		}
+		r -= s->Weight;
+	}
+	return n;
+}
+
+/* Draw the next frame of a stream into the held slot */
+static void CANGEN_BUILD(CANGEN_HandleTypeDef_t *hGen, uint8_t n) {
+	const CANGEN_StreamTypeDef_t *s = &hGen->Streams[n];
+	FDCAN_FrameTypeDef_t *f = &hGen->HeldFrame;
+	uint32_t id = CANGEN_RANGE(hGen, s->IdMin, s->IdMax);
+	uint8_t dlc = (uint8_t) CANGEN_RANGE(hGen, s->DlcMin, s->DlcMax);
+	uint8_t fd = CANGEN_CHANCE(hGen, s->FdPermille);
+	uint8_t brs = fd && CANGEN_CHANCE(hGen, s->BrsPermille);
+	uint8_t format = brs ? CANSTATS_FMT_FD_BRS :
+			(fd ? CANSTATS_FMT_FD : CANSTATS_FMT_CLASSIC);
+
+	if (!fd && dlc > 8U) {
+		dlc = 8U;
+	}
+	FDCAN_FRAME_SET_ID(f, id, s->Extended);
+	FDCAN_FRAME_SET_CONTROL(f, dlc, fd, brs);
+	for (uint32_t w = 0; w < FDCAN_FRAME_DATA_WORD_COUNT(f); w++) {
+		f->data[w] = CANGEN_RANDOM(hGen);
+	}
+	hGen->Held = 1;
+	hGen->HeldStream = n;
+	hGen->HeldNs = hGen->WireNsTable[format][s->Extended ? 1 : 0][dlc];
+}
+
+/***** Public API *****/
+
+/**
+ * @brief  Build the wire time table, schedule the periodic streams and
+ *         start the load from now
+ */
+void CANGEN_INIT(CANGEN_HandleTypeDef_t *hGen) {
+	uint32_t dataKbps = hGen->DataKbps ? hGen->DataKbps : hGen->NominalKbps;
+
+	for (uint8_t fmt = 0; fmt < CANSTATS_FMT_COUNT; fmt++) {
+		for (uint8_t ext = 0; ext < 2; ext++) {
+			for (uint8_t dlc = 0; dlc < 16; dlc++) {
+				uint32_t dataBits;
+				uint32_t bytes = FDCAN_DLC_TO_BYTES(dlc);
+				if (fmt == CANSTATS_FMT_CLASSIC && bytes > 8U) {
+					bytes = 8U;
+				}
+				uint32_t bits = CANSTATS_WIRE_BITS(fmt, ext, bytes, &dataBits);
+				hGen->WireNsTable[fmt][ext][dlc] = (uint32_t) (((uint64_t)
+						(bits - dataBits) * 1000000U + hGen->NominalKbps - 1U)
+						/ hGen->NominalKbps)
+						+ (uint32_t) (((uint64_t) dataBits * 1000000U
+								+ dataKbps - 1U) / dataKbps);
+			}
+		}
+	}
+
+	hGen->Random = hGen->Seed ? hGen->Seed : CANGEN_DEFAULT_SEED;
+	hGen->LastUs = hGen->GetUs();
+	hGen->ElapsedUs = 0;
+	hGen->CreditNs = 0;
+	hGen->Held = 0;
+	hGen->WeightTotal = 0;
+	for (uint8_t n = 0; n < hGen->StreamCount; n++) {
+		CANGEN_StreamTypeDef_t *s = &hGen->Streams[n];
+		s->Frames = s->Skipped = 0;
+		s->WireNs = 0;
+		if (s->PeriodUs != 0) {
+			s->NextUs = hGen->LastUs;
+			CANGEN_SCHEDULE(hGen, s);
+		} else {
+			hGen->WeightTotal += s->Weight;
+		}
+	}
+
+	hGen->RequestedNs = hGen->WireNs = 0;
+	hGen->Frames = hGen->FdFrames = hGen->BrsFrames = 0;
+	hGen->FifoFull = hGen->CreditCapped = 0;
+}
+
+/**
+ * @brief  Queue every periodic frame that is due, then fill frames while
+ *         the target leaves bus time for them
+ * @note   Not reentrant: call it from one interrupt priority
+ * @retval Frames queued
+ */
+uint32_t CANGEN_POLL(CANGEN_HandleTypeDef_t *hGen) {
+	uint32_t now = hGen->GetUs();
+	uint64_t from = hGen->ElapsedUs;
+	uint32_t sent = 0;
+
+	hGen->ElapsedUs += now - hGen->LastUs;
+	hGen->LastUs = now;
+	uint64_t add = CANGEN_TARGET_NS(hGen, hGen->ElapsedUs)
+			- CANGEN_TARGET_NS(hGen, from);
+	hGen->RequestedNs += add;
+	hGen->CreditNs += (int64_t) add;
+	if (hGen->CreditNs > (int64_t) CANGEN_CREDIT_CAP_US * 1000) {
+		hGen->CreditNs = (int64_t) CANGEN_CREDIT_CAP_US * 1000;
+		hGen->CreditCapped++;
+	}
+
+	while (1) {
+		if (!hGen->Held) {
+			uint8_t n = CANGEN_DUE(hGen, now);
+			if (n != CANGEN_NONE) {
+				CANGEN_StreamTypeDef_t *s = &hGen->Streams[n];
+				s->NextUs += s->PeriodUs;
+				if ((int32_t) (now - s->NextUs) >= 0) {
+					// Periods that went by behind a full FIFO are not caught up
+					uint32_t behind = (now - s->NextUs) / s->PeriodUs + 1U;
+					s->Skipped += behind;
+					s->NextUs += behind * s->PeriodUs;
+				}
+				CANGEN_SCHEDULE(hGen, s);
+			} else if (hGen->CreditNs > 0 && hGen->WeightTotal != 0) {
+				n = CANGEN_PICK_FILL(hGen);
+			} else {
+				break;
+			}
+			CANGEN_BUILD(hGen, n);
+		}
+
+		if (!hGen->Transmit(hGen->Ctx, &hGen->HeldFrame)) {
+			hGen->FifoFull++;
+			break;
+		}
+		CANGEN_StreamTypeDef_t *s = &hGen->Streams[hGen->HeldStream];
+		hGen->Held = 0;
+		hGen->CreditNs -= hGen->HeldNs;
+		hGen->WireNs += hGen->HeldNs;
+		hGen->Frames++;
+		hGen->FdFrames += FDCAN_FRAME_IS_FD(&hGen->HeldFrame);
+		hGen->BrsFrames += FDCAN_FRAME_IS_BRS(&hGen->HeldFrame);
+		s->Frames++;
+		s->WireNs += hGen->HeldNs;
+		sent++;
+	}
+	return sent;
+}
+
+/**
+ * @brief  Time until CANGEN_POLL has a frame to queue
+ * @retval Microseconds, 0 if one is due now; CANGEN_IDLE if a refused frame
+ *         waits for a TX slot or nothing will ever be due
+ */
+uint32_t CANGEN_NEXT_US(const CANGEN_HandleTypeDef_t *hGen) {
+	uint32_t now = hGen->GetUs();
+	uint32_t since = now - hGen->LastUs;
+	uint32_t next = CANGEN_IDLE;
+
+	if (hGen->Held) {
+		return CANGEN_IDLE;
+	}
+	for (uint8_t n = 0; n < hGen->StreamCount; n++) {
+		const CANGEN_StreamTypeDef_t *s = &hGen->Streams[n];
+		if (s->PeriodUs != 0) {
+			int32_t wait = (int32_t) (s->ReleaseUs - now);
+			next = (wait <= 0) ? 0 : (((uint32_t) wait < next) ? (uint32_t) wait : next);
+		}
+	}
+	if (hGen->WeightTotal == 0 || next == 0) {
+		return next;
+	}
+
+	// Fill: until the credit turns positive at the rate of the current
+	// phase, or until the phase ends and the rate changes
+	uint64_t t = hGen->ElapsedUs;
+	uint32_t rate = hGen->LoadPermille;
+	uint64_t phaseLeft = UINT64_MAX;
+	if (hGen->BurstPeriodUs != 0) {
+		uint64_t into = t % hGen->BurstPeriodUs;
+		if (into < hGen->BurstLengthUs) {
+			rate = hGen->BurstLoadPermille;
+			phaseLeft = hGen->BurstLengthUs - into;
+		} else {
+			phaseLeft = hGen->BurstPeriodUs - into;
+		}
+	}
+	uint64_t wait = phaseLeft;
+	if (hGen->CreditNs > 0) {
+		wait = 0;
+	} else if (rate != 0) {
+		uint64_t need = (uint64_t) (-hGen->CreditNs) / rate + 1U;
+		wait = (need < phaseLeft) ? need : phaseLeft;
+	}
+	wait = (wait > since) ? wait - since : 0;
+	return (wait < next) ? (uint32_t) wait : next;
+}
+
+/**
+ * @brief  Bus load queued since CANGEN_INIT, against the target
+ * @param  pRequested: Load the target asked for in the same time, may be NULL
+ * @retval Achieved load in permille, as of the last poll
+ */
+uint32_t CANGEN_LOAD_PERMILLE(const CANGEN_HandleTypeDef_t *hGen,
+		uint32_t *pRequested) {
+	uint64_t us = hGen->ElapsedUs ? hGen->ElapsedUs : 1U;
+
+	if (pRequested != NULL) {
+		*pRequested = (uint32_t) (hGen->RequestedNs / us);
+	}
+	return (uint32_t) (hGen->WireNs / us);
+}
@@ -0,0 +1,135 @@
+/**
+ ******************************************************************************
+ * @file           : can_txlatest.c
+ * @brief          : Latest-value transmission over the FDCAN TX FIFO.
+ *
+ * A cancel is settled once its slot no longer holds the frame it was asked
+ * for: TXBRP cleared, or the slot already reused by another identifier.
+ * TXBTO then tells a frame that went out anyway from one removed in time.
+ ******************************************************************************
+ */
+
+#include <stddef.h>
+#include "can_txlatest.h"
+
+#define CANTXL_ID_MASK              ((1UL << FDCAN_ELEM_XTD_POS) \
+		| (1UL << FDCAN_ELEM_RTR_POS) | FDCAN_ELEM_EXTID_MASK)
+
+/***** Private Helpers *****/
+
+FDCAN_INLINE uint8_t CANTXL_SAME_ID(uint32_t w0, uint32_t key) {
+	return ((w0 ^ key) & CANTXL_ID_MASK) == 0;
+}
+
+/* Hand a frame to the transmit hook, counting it if it found no slot */
+static uint8_t CANTXL_TRANSMIT(CANTXL_HandleTypeDef_t *hTxl,
+		const FDCAN_FrameTypeDef_t *pFrame) {
+	if (!hTxl->Transmit(hTxl->Ctx, pFrame)) {
+		hTxl->Dropped++;
+		return 0;
+	}
+	return 1;
+}
+
+/**
+ * @brief  Clear the cancel state and the counters
+ */
+void CANTXL_INIT(CANTXL_HandleTypeDef_t *hTxl) {
+	hTxl->Cancelling = 0;
+	hTxl->Parked = 0;
+	hTxl->Cancels = 0;
+	hTxl->Cancelled = 0;
+	hTxl->Late = 0;
+	hTxl->Parks = 0;
+	hTxl->Dropped = 0;
+}
+
+/**
+ * @brief  Settle the cancels that finished, queue a parked frame whose slot
+ *         came free
+ * @retval Cancels settled
+ */
+uint32_t CANTXL_COMPLETE(CANTXL_HandleTypeDef_t *hTxl) {
+	if (hTxl->Cancelling == 0) {
+		return 0;
+	}
+
+	CANTXL_FifoTypeDef_t fifo;
+	uint32_t settled = 0;
+	hTxl->Read(hTxl->Ctx, &fifo);
+
+	for (uint8_t i = 0; i < CANTXL_SLOTS; i++) {
+		uint32_t bit = 1UL << i;
+		if (!(hTxl->Cancelling & bit)) {
+			continue;
+		}
+		uint8_t same = CANTXL_SAME_ID(fifo.T0[i], hTxl->CancelKey[i]);
+		if ((fifo.Pending & bit) && same) {
+			continue;                  // Still in arbitration or on the bus
+		}
+
+		hTxl->Cancelling &= (uint8_t) ~bit;
+		settled++;
+		if (same && (fifo.Sent & bit)) {
+			hTxl->Late++;
+		} else {
+			hTxl->Cancelled++;
+		}
+		if (hTxl->Parked && hTxl->ParkedSlot == i) {
+			hTxl->Parked = 0;
+			if (!CANTXL_TRANSMIT(hTxl, &hTxl->ParkedFrame)
+					&& hTxl->Lost != NULL) {
+				hTxl->Lost(hTxl->Ctx, &hTxl->ParkedFrame);
+			}
+		}
+	}
+	return settled;
+}
+
+/**
+ * @brief  Queue a frame, cancelling a pending older frame of its identifier
+ * @note   Never waits: a cancel still in flight is settled by the next
+ *         CANTXL_COMPLETE. Must not be preempted by CANTXL_COMPLETE.
+ * @retval CANTXL_REPLACED, CANTXL_QUEUED or CANTXL_DROPPED
+ */
+uint8_t CANTXL_SUBMIT(CANTXL_HandleTypeDef_t *hTxl,
+		const FDCAN_FrameTypeDef_t *pFrame) {
+	(void) CANTXL_COMPLETE(hTxl);
+
+	// Newer payload for the frame waiting on a cancel: it was never queued
+	if (hTxl->Parked && CANTXL_SAME_ID(hTxl->ParkedFrame.w0, pFrame->w0)) {
+		hTxl->ParkedFrame = *pFrame;
+		return CANTXL_REPLACED;
+	}
+
+	CANTXL_FifoTypeDef_t fifo;
+	hTxl->Read(hTxl->Ctx, &fifo);
+
+	for (uint8_t i = 0; i < CANTXL_SLOTS; i++) {
+		uint32_t bit = 1UL << i;
+		if (!(fifo.Pending & bit) || (hTxl->Cancelling & bit)
+				|| !CANTXL_SAME_ID(fifo.T0[i], pFrame->w0)) {
+			continue;
+		}
+		if (fifo.FreeLevel == 0 && i != fifo.GetIndex) {
+			hTxl->Dropped++;           // The cancel would not free a slot
+			return CANTXL_DROPPED;
+		}
+
+		hTxl->Cancel(hTxl->Ctx, i);
+		hTxl->Cancelling |= (uint8_t) bit;
+		hTxl->CancelKey[i] = fifo.T0[i];
+		hTxl->Cancels++;
+		if (fifo.FreeLevel == 0) {
+			// Its slot is the one being cancelled
+			hTxl->Parked = 1;
+			hTxl->ParkedSlot = i;
+			hTxl->ParkedFrame = *pFrame;
+			hTxl->Parks++;
+			return CANTXL_REPLACED;
+		}
+		return CANTXL_TRANSMIT(hTxl, pFrame) ? CANTXL_REPLACED : CANTXL_DROPPED;
+	}
+
+	return CANTXL_TRANSMIT(hTxl, pFrame) ? CANTXL_QUEUED : CANTXL_DROPPED;
+}
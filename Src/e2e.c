@@ -0,0 +1,360 @@
+/**
+ ******************************************************************************
+ * @file           : e2e.c
+ * @brief          : End-to-end protection profiles: CRC and sequence counter
+ *                   written into a payload on TX and checked on RX.
+ *
+ * CRC registers are passed around in their natural form: right-aligned for
+ * the MSB-first CRCs, LSB-first for the reflected one, before the final xor.
+ * The table step works on the register left-aligned in 32 bits (MSB-first)
+ * or as it is (reflected), E2E_SLICES bytes per step.
+ ******************************************************************************
+ */
+
+#include <stddef.h>
+#include "e2e.h"
+
+const E2E_CrcParamTypeDef_t E2E_CRC_PARAMS[E2E_CRC_COUNT] = {
+	[E2E_CRC8] = { 8, 0, 0x1DU, 0xFFU, 0xFFU, 0x4BU },
+	[E2E_CRC16] = { 16, 0, 0x1021U, 0xFFFFU, 0x0000U, 0x29B1U },
+	[E2E_CRC32] = { 32, 1, 0xF4ACFB13U, 0xFFFFFFFFU, 0xFFFFFFFFU, 0x1697D06AU },
+};
+
+/* Counter range per profile */
+static const uint32_t e2eCounterRange[] = {
+	[E2E_P11] = 15U, [E2E_P5] = 256U, [E2E_P4] = 65536U,
+};
+
+/* CRC type per profile */
+static const uint8_t e2eCrcType[] = {
+	[E2E_P11] = E2E_CRC8, [E2E_P5] = E2E_CRC16, [E2E_P4] = E2E_CRC32,
+};
+
+/***** Private Helpers *****/
+
+/* Bit-reverse the low 'width' bits */
+static uint32_t E2E_REFLECT(uint32_t x, uint8_t width) {
+	uint32_t r = 0;
+	for (uint8_t i = 0; i < width; i++) {
+		r = (r << 1) | ((x >> i) & 1U);
+	}
+	return r;
+}
+
+/* Bits of a CRC of the given width */
+static uint32_t E2E_WIDTH_MASK(uint8_t width) {
+	return (width == 32U) ? 0xFFFFFFFFU : ((1UL << width) - 1U);
+}
+
+static void E2E_PUT_BE16(uint8_t *p, uint32_t v) {
+	p[0] = (uint8_t) (v >> 8);
+	p[1] = (uint8_t) v;
+}
+
+static void E2E_PUT_BE32(uint8_t *p, uint32_t v) {
+	E2E_PUT_BE16(p, v >> 16);
+	E2E_PUT_BE16(p + 2, v);
+}
+
+static uint32_t E2E_GET_BE16(const uint8_t *p) {
+	return ((uint32_t) p[0] << 8) | p[1];
+}
+
+static uint32_t E2E_GET_BE32(const uint8_t *p) {
+	return (E2E_GET_BE16(p) << 16) | E2E_GET_BE16(p + 2);
+}
+
+/**
+ * @brief  Build the slice tables of every CRC type
+ */
+void E2E_TABLES_INIT(E2E_CrcTablesTypeDef_t *pTables) {
+	for (uint8_t type = 0; type < E2E_CRC_COUNT; type++) {
+		const E2E_CrcParamTypeDef_t *c = &E2E_CRC_PARAMS[type];
+		uint32_t (*t)[256] = pTables->T[type];
+
+		if (c->Reflected) {
+			uint32_t poly = E2E_REFLECT(c->Poly, c->Width);
+			for (uint32_t i = 0; i < 256U; i++) {
+				uint32_t r = i;
+				for (uint8_t b = 0; b < 8U; b++) {
+					r = (r & 1U) ? (r >> 1) ^ poly : r >> 1;
+				}
+				t[0][i] = r;
+			}
+			for (uint32_t k = 1; k < E2E_SLICES; k++) {
+				for (uint32_t i = 0; i < 256U; i++) {
+					t[k][i] = (t[k - 1U][i] >> 8) ^ t[0][t[k - 1U][i] & 0xFFU];
+				}
+			}
+		} else {
+			uint32_t poly = c->Poly << (32U - c->Width);
+			for (uint32_t i = 0; i < 256U; i++) {
+				uint32_t r = i << 24;
+				for (uint8_t b = 0; b < 8U; b++) {
+					r = (r & 0x80000000U) ? (r << 1) ^ poly : r << 1;
+				}
+				t[0][i] = r;
+			}
+			for (uint32_t k = 1; k < E2E_SLICES; k++) {
+				for (uint32_t i = 0; i < 256U; i++) {
+					t[k][i] = (t[k - 1U][i] << 8) ^ t[0][t[k - 1U][i] >> 24];
+				}
+			}
+		}
+	}
+}
+
+/**
+ * @brief  Fold bytes into a CRC register one bit at a time (reference)
+ */
+uint32_t E2E_CRC_BITWISE(uint8_t type, uint32_t reg, const uint8_t *pData,
+		uint32_t length) {
+	const E2E_CrcParamTypeDef_t *c = &E2E_CRC_PARAMS[type];
+
+	if (c->Reflected) {
+		uint32_t poly = E2E_REFLECT(c->Poly, c->Width);
+		for (uint32_t i = 0; i < length; i++) {
+			reg ^= pData[i];
+			for (uint8_t b = 0; b < 8U; b++) {
+				reg = (reg & 1U) ? (reg >> 1) ^ poly : reg >> 1;
+			}
+		}
+		return reg;
+	}
+
+	uint32_t shift = 32U - c->Width;
+	uint32_t poly = c->Poly << shift;
+	reg <<= shift;
+	for (uint32_t i = 0; i < length; i++) {
+		reg ^= (uint32_t) pData[i] << 24;
+		for (uint8_t b = 0; b < 8U; b++) {
+			reg = (reg & 0x80000000U) ? (reg << 1) ^ poly : reg << 1;
+		}
+	}
+	return reg >> shift;
+}
+
+/**
+ * @brief  Fold bytes into a CRC register with the slice tables
+ */
+uint32_t E2E_CRC_TABLE(const E2E_CrcTablesTypeDef_t *pTables, uint8_t type,
+		uint32_t reg, const uint8_t *pData, uint32_t length) {
+	const E2E_CrcParamTypeDef_t *c = &E2E_CRC_PARAMS[type];
+	const uint32_t (*t)[256] = pTables->T[type];
+	uint32_t i = 0;
+
+	if (c->Reflected) {
+		for (; i + E2E_SLICES <= length; i += E2E_SLICES) {
+			uint32_t acc = (E2E_SLICES < 4U) ? reg >> (8U * E2E_SLICES) : 0;
+			for (uint32_t k = 0; k < E2E_SLICES; k++) {
+				uint32_t in = (k < 4U) ? (reg >> (8U * k)) & 0xFFU : 0;
+				acc ^= t[E2E_SLICES - 1U - k][pData[i + k] ^ in];
+			}
+			reg = acc;
+		}
+		for (; i < length; i++) {
+			reg = (reg >> 8) ^ t[0][(reg ^ pData[i]) & 0xFFU];
+		}
+		return reg;
+	}
+
+	uint32_t shift = 32U - c->Width;
+	reg <<= shift;
+	for (; i + E2E_SLICES <= length; i += E2E_SLICES) {
+		uint32_t acc = (E2E_SLICES < 4U) ? reg << (8U * E2E_SLICES) : 0;
+		for (uint32_t k = 0; k < E2E_SLICES; k++) {
+			uint32_t in = (k < 4U) ? (reg >> (24U - 8U * k)) & 0xFFU : 0;
+			acc ^= t[E2E_SLICES - 1U - k][pData[i + k] ^ in];
+		}
+		reg = acc;
+	}
+	for (; i < length; i++) {
+		reg = (reg << 8) ^ t[0][(reg >> 24) ^ pData[i]];
+	}
+	return reg >> shift;
+}
+
+/**
+ * @brief  Fold bytes into a CRC register with the best engine available
+ */
+uint32_t E2E_CRC_UPDATE(const E2E_HandleTypeDef_t *hE2e, uint8_t type,
+		uint32_t reg, const uint8_t *pData, uint32_t length) {
+	if (length == 0) {
+		return reg;
+	}
+	if (hE2e->Engine != NULL) {
+		return hE2e->Engine(hE2e->Ctx, type, reg, pData, length);
+	}
+	if (hE2e->Tables != NULL) {
+		return E2E_CRC_TABLE(hE2e->Tables, type, reg, pData, length);
+	}
+	return E2E_CRC_BITWISE(type, reg, pData, length);
+}
+
+/**
+ * @brief  Complete CRC of a buffer, initial value and final xor applied
+ */
+uint32_t E2E_CRC(const E2E_HandleTypeDef_t *hE2e, uint8_t type,
+		const uint8_t *pData, uint32_t length) {
+	const E2E_CrcParamTypeDef_t *c = &E2E_CRC_PARAMS[type];
+	uint32_t reg = E2E_CRC_UPDATE(hE2e, type, c->Init, pData, length);
+	return (reg ^ c->XorOut) & E2E_WIDTH_MASK(c->Width);
+}
+
+/**
+ * @brief  Restart the counter and clear the statistics of a channel
+ */
+void E2E_CHANNEL_INIT(E2E_ChannelTypeDef_t *pCh) {
+	pCh->Counter = 0;
+	pCh->Synced = 0;
+	pCh->LastStatus = E2E_OK;
+	pCh->Frames = 0;
+	for (uint32_t s = 0; s < E2E_STATUS_COUNT; s++) {
+		pCh->Status[s] = 0;
+	}
+}
+
+/* 1 if the channel's fields fit in 'length' bytes */
+static uint8_t E2E_FITS(const E2E_ChannelTypeDef_t *pCh, uint32_t length) {
+	switch (pCh->Profile) {
+	case E2E_P11:
+		return pCh->Offset < length && pCh->CounterBit / 8U < length
+				&& pCh->CounterBit / 8U != pCh->Offset
+				&& (pCh->CounterBit & 3U) == 0;
+	case E2E_P5:
+		return pCh->Offset + 3U <= length;
+	case E2E_P4:
+		return pCh->Offset + E2E_P4_HEADER_BYTES <= length
+				&& length <= 0xFFFFU;
+	default:
+		return 0;
+	}
+}
+
+/* CRC of a payload whose counter (and P4 header) is in place */
+static uint32_t E2E_PROFILE_CRC(const E2E_HandleTypeDef_t *hE2e,
+		const E2E_ChannelTypeDef_t *pCh, const uint8_t *pData,
+		uint32_t length) {
+	uint8_t type = e2eCrcType[pCh->Profile];
+	const E2E_CrcParamTypeDef_t *c = &E2E_CRC_PARAMS[type];
+	uint8_t id[2] = { (uint8_t) pCh->DataId, (uint8_t) (pCh->DataId >> 8) };
+	uint32_t at = pCh->Offset;
+	uint32_t reg = c->Init;
+
+	switch (pCh->Profile) {
+	case E2E_P11:
+		reg = E2E_CRC_UPDATE(hE2e, type, reg, id, 2U);
+		reg = E2E_CRC_UPDATE(hE2e, type, reg, pData, at);
+		reg = E2E_CRC_UPDATE(hE2e, type, reg, pData + at + 1U,
+				length - at - 1U);
+		break;
+	case E2E_P5:
+		reg = E2E_CRC_UPDATE(hE2e, type, reg, pData, at);
+		reg = E2E_CRC_UPDATE(hE2e, type, reg, pData + at + 2U,
+				length - at - 2U);
+		reg = E2E_CRC_UPDATE(hE2e, type, reg, id, 2U);
+		break;
+	default:                       // E2E_P4: header up to the CRC, then the rest
+		reg = E2E_CRC_UPDATE(hE2e, type, reg, pData, at + 8U);
+		reg = E2E_CRC_UPDATE(hE2e, type, reg, pData + at + 12U,
+				length - at - 12U);
+		break;
+	}
+	return (reg ^ c->XorOut) & E2E_WIDTH_MASK(c->Width);
+}
+
+/**
+ * @brief  Write the counter and CRC of the channel's profile into a payload
+ * @retval 0 on success, 1 if the payload is too short for the profile
+ */
+uint8_t E2E_PROTECT(const E2E_HandleTypeDef_t *hE2e, E2E_ChannelTypeDef_t *pCh,
+		uint8_t *pData, uint32_t length) {
+	if (!E2E_FITS(pCh, length)) {
+		return 1;
+	}
+	uint32_t at = pCh->Offset;
+	uint32_t crc;
+
+	switch (pCh->Profile) {
+	case E2E_P11: {
+		uint8_t *p = &pData[pCh->CounterBit / 8U];
+		uint8_t shift = pCh->CounterBit % 8U;
+		*p = (uint8_t) ((*p & ~(0xFU << shift)) | (pCh->Counter << shift));
+		pData[at] = (uint8_t) E2E_PROFILE_CRC(hE2e, pCh, pData, length);
+		break;
+	}
+	case E2E_P5:
+		pData[at + 2U] = (uint8_t) pCh->Counter;
+		crc = E2E_PROFILE_CRC(hE2e, pCh, pData, length);
+		pData[at] = (uint8_t) crc;
+		pData[at + 1U] = (uint8_t) (crc >> 8);
+		break;
+	default:
+		E2E_PUT_BE16(&pData[at], length);
+		E2E_PUT_BE16(&pData[at + 2U], pCh->Counter);
+		E2E_PUT_BE32(&pData[at + 4U], pCh->DataId);
+		crc = E2E_PROFILE_CRC(hE2e, pCh, pData, length);
+		E2E_PUT_BE32(&pData[at + 8U], crc);
+		break;
+	}
+	pCh->Counter = (uint16_t) ((pCh->Counter + 1U)
+			% e2eCounterRange[pCh->Profile]);
+	pCh->Frames++;
+	return 0;
+}
+
+/**
+ * @brief  Check the CRC and counter of a received payload
+ * @retval E2E_OK, E2E_INITIAL, E2E_REPEATED, E2E_OK_SOME_LOST,
+ *         E2E_WRONG_SEQUENCE or E2E_ERROR
+ */
+uint8_t E2E_CHECK(const E2E_HandleTypeDef_t *hE2e, E2E_ChannelTypeDef_t *pCh,
+		const uint8_t *pData, uint32_t length) {
+	uint8_t status = E2E_ERROR;
+	uint32_t at = pCh->Offset;
+	uint32_t counter = 0;
+
+	pCh->Frames++;
+	if (E2E_FITS(pCh, length)) {
+		uint32_t crc = E2E_PROFILE_CRC(hE2e, pCh, pData, length);
+		uint8_t valid;
+		switch (pCh->Profile) {
+		case E2E_P11:
+			counter = (pData[pCh->CounterBit / 8U] >> (pCh->CounterBit % 8U))
+					& 0xFU;
+			valid = pData[at] == crc && counter < e2eCounterRange[E2E_P11];
+			break;
+		case E2E_P5:
+			counter = pData[at + 2U];
+			valid = (pData[at] | ((uint32_t) pData[at + 1U] << 8)) == crc;
+			break;
+		default:
+			counter = E2E_GET_BE16(&pData[at + 2U]);
+			valid = E2E_GET_BE32(&pData[at + 8U]) == crc
+					&& E2E_GET_BE16(&pData[at]) == length
+					&& E2E_GET_BE32(&pData[at + 4U]) == pCh->DataId;
+			break;
+		}
+
+		if (valid) {
+			uint32_t range = e2eCounterRange[pCh->Profile];
+			uint32_t delta = (counter + range - pCh->Counter) % range;
+			if (!pCh->Synced) {
+				status = E2E_INITIAL;
+			} else if (delta == 0) {
+				status = E2E_REPEATED;
+			} else if (delta == 1U) {
+				status = E2E_OK;
+			} else if (delta <= pCh->MaxDeltaCounter) {
+				status = E2E_OK_SOME_LOST;
+			} else {
+				status = E2E_WRONG_SEQUENCE;
+			}
+			pCh->Counter = (uint16_t) counter;
+			pCh->Synced = 1;
+		}
+	}
+	pCh->Status[status]++;
+	pCh->LastStatus = status;
+	return status;
+}
@@ -0,0 +1,308 @@
+/**
+ ******************************************************************************
+ * @file           : fw_update.c
+ * @brief          : Streaming firmware update into an inactive flash region.
+ *
+ * Image offset    0          L0         L0+L1
+ *                 | block 1  | block 2  | block 3 ...
+ * Buffer          | A        | B        | A ...
+ *
+ * Buffer A programs while block 2 fills B, and so on. A block that finds
+ * its buffer still queued waits in FWU_BLOCK_END (FWU_BUSY); the caller
+ * retries once FWU_FLASH_DONE has freed it. The flash engine runs one
+ * operation at a time: the queued buffer first (erasing its sector if
+ * needed), otherwise the next sector of the image is erased ahead.
+ ******************************************************************************
+ */
+
+#include <string.h>
+#include "fw_update.h"
+
+/* CRC-32 (IEEE 802.3, reflected 0xEDB88320), one byte per lookup */
+static const uint32_t fwuCrcTable[256] = {
+	0x00000000U, 0x77073096U, 0xEE0E612CU, 0x990951BAU, 0x076DC419U, 0x706AF48FU,
+	0xE963A535U, 0x9E6495A3U, 0x0EDB8832U, 0x79DCB8A4U, 0xE0D5E91EU, 0x97D2D988U,
+	0x09B64C2BU, 0x7EB17CBDU, 0xE7B82D07U, 0x90BF1D91U, 0x1DB71064U, 0x6AB020F2U,
+	0xF3B97148U, 0x84BE41DEU, 0x1ADAD47DU, 0x6DDDE4EBU, 0xF4D4B551U, 0x83D385C7U,
+	0x136C9856U, 0x646BA8C0U, 0xFD62F97AU, 0x8A65C9ECU, 0x14015C4FU, 0x63066CD9U,
+	0xFA0F3D63U, 0x8D080DF5U, 0x3B6E20C8U, 0x4C69105EU, 0xD56041E4U, 0xA2677172U,
+	0x3C03E4D1U, 0x4B04D447U, 0xD20D85FDU, 0xA50AB56BU, 0x35B5A8FAU, 0x42B2986CU,
+	0xDBBBC9D6U, 0xACBCF940U, 0x32D86CE3U, 0x45DF5C75U, 0xDCD60DCFU, 0xABD13D59U,
+	0x26D930ACU, 0x51DE003AU, 0xC8D75180U, 0xBFD06116U, 0x21B4F4B5U, 0x56B3C423U,
+	0xCFBA9599U, 0xB8BDA50FU, 0x2802B89EU, 0x5F058808U, 0xC60CD9B2U, 0xB10BE924U,
+	0x2F6F7C87U, 0x58684C11U, 0xC1611DABU, 0xB6662D3DU, 0x76DC4190U, 0x01DB7106U,
+	0x98D220BCU, 0xEFD5102AU, 0x71B18589U, 0x06B6B51FU, 0x9FBFE4A5U, 0xE8B8D433U,
+	0x7807C9A2U, 0x0F00F934U, 0x9609A88EU, 0xE10E9818U, 0x7F6A0DBBU, 0x086D3D2DU,
+	0x91646C97U, 0xE6635C01U, 0x6B6B51F4U, 0x1C6C6162U, 0x856530D8U, 0xF262004EU,
+	0x6C0695EDU, 0x1B01A57BU, 0x8208F4C1U, 0xF50FC457U, 0x65B0D9C6U, 0x12B7E950U,
+	0x8BBEB8EAU, 0xFCB9887CU, 0x62DD1DDFU, 0x15DA2D49U, 0x8CD37CF3U, 0xFBD44C65U,
+	0x4DB26158U, 0x3AB551CEU, 0xA3BC0074U, 0xD4BB30E2U, 0x4ADFA541U, 0x3DD895D7U,
+	0xA4D1C46DU, 0xD3D6F4FBU, 0x4369E96AU, 0x346ED9FCU, 0xAD678846U, 0xDA60B8D0U,
+	0x44042D73U, 0x33031DE5U, 0xAA0A4C5FU, 0xDD0D7CC9U, 0x5005713CU, 0x270241AAU,
+	0xBE0B1010U, 0xC90C2086U, 0x5768B525U, 0x206F85B3U, 0xB966D409U, 0xCE61E49FU,
+	0x5EDEF90EU, 0x29D9C998U, 0xB0D09822U, 0xC7D7A8B4U, 0x59B33D17U, 0x2EB40D81U,
+	0xB7BD5C3BU, 0xC0BA6CADU, 0xEDB88320U, 0x9ABFB3B6U, 0x03B6E20CU, 0x74B1D29AU,
+	0xEAD54739U, 0x9DD277AFU, 0x04DB2615U, 0x73DC1683U, 0xE3630B12U, 0x94643B84U,
+	0x0D6D6A3EU, 0x7A6A5AA8U, 0xE40ECF0BU, 0x9309FF9DU, 0x0A00AE27U, 0x7D079EB1U,
+	0xF00F9344U, 0x8708A3D2U, 0x1E01F268U, 0x6906C2FEU, 0xF762575DU, 0x806567CBU,
+	0x196C3671U, 0x6E6B06E7U, 0xFED41B76U, 0x89D32BE0U, 0x10DA7A5AU, 0x67DD4ACCU,
+	0xF9B9DF6FU, 0x8EBEEFF9U, 0x17B7BE43U, 0x60B08ED5U, 0xD6D6A3E8U, 0xA1D1937EU,
+	0x38D8C2C4U, 0x4FDFF252U, 0xD1BB67F1U, 0xA6BC5767U, 0x3FB506DDU, 0x48B2364BU,
+	0xD80D2BDAU, 0xAF0A1B4CU, 0x36034AF6U, 0x41047A60U, 0xDF60EFC3U, 0xA867DF55U,
+	0x316E8EEFU, 0x4669BE79U, 0xCB61B38CU, 0xBC66831AU, 0x256FD2A0U, 0x5268E236U,
+	0xCC0C7795U, 0xBB0B4703U, 0x220216B9U, 0x5505262FU, 0xC5BA3BBEU, 0xB2BD0B28U,
+	0x2BB45A92U, 0x5CB36A04U, 0xC2D7FFA7U, 0xB5D0CF31U, 0x2CD99E8BU, 0x5BDEAE1DU,
+	0x9B64C2B0U, 0xEC63F226U, 0x756AA39CU, 0x026D930AU, 0x9C0906A9U, 0xEB0E363FU,
+	0x72076785U, 0x05005713U, 0x95BF4A82U, 0xE2B87A14U, 0x7BB12BAEU, 0x0CB61B38U,
+	0x92D28E9BU, 0xE5D5BE0DU, 0x7CDCEFB7U, 0x0BDBDF21U, 0x86D3D2D4U, 0xF1D4E242U,
+	0x68DDB3F8U, 0x1FDA836EU, 0x81BE16CDU, 0xF6B9265BU, 0x6FB077E1U, 0x18B74777U,
+	0x88085AE6U, 0xFF0F6A70U, 0x66063BCAU, 0x11010B5CU, 0x8F659EFFU, 0xF862AE69U,
+	0x616BFFD3U, 0x166CCF45U, 0xA00AE278U, 0xD70DD2EEU, 0x4E048354U, 0x3903B3C2U,
+	0xA7672661U, 0xD06016F7U, 0x4969474DU, 0x3E6E77DBU, 0xAED16A4AU, 0xD9D65ADCU,
+	0x40DF0B66U, 0x37D83BF0U, 0xA9BCAE53U, 0xDEBB9EC5U, 0x47B2CF7FU, 0x30B5FFE9U,
+	0xBDBDF21CU, 0xCABAC28AU, 0x53B39330U, 0x24B4A3A6U, 0xBAD03605U, 0xCDD70693U,
+	0x54DE5729U, 0x23D967BFU, 0xB3667A2EU, 0xC4614AB8U, 0x5D681B02U, 0x2A6F2B94U,
+	0xB40BBE37U, 0xC30C8EA1U, 0x5A05DF1BU, 0x2D02EF8DU
+};
+
+/**
+ * @brief  Start the next flash operation, if the flash is free
+ */
+static void FWU_KICK(FWU_HandleTypeDef_t *hFwu) {
+	if (hFwu->FlashOp != FWU_OP_NONE || hFwu->State != FWU_STATE_RECEIVING) {
+		return;
+	}
+
+	uint8_t failed;
+	if (hFwu->Queued & (1U << hFwu->Prog)) {
+		uint32_t address = hFwu->Address + hFwu->BufferOffset[hFwu->Prog]
+				+ hFwu->ProgOffset;
+		if (address >= hFwu->ErasedEnd) {
+			hFwu->FlashOp = FWU_OP_ERASE;
+			failed = hFwu->Erase(hFwu->Ctx, hFwu->ErasedEnd);
+		} else {
+			hFwu->FlashOp = FWU_OP_PROGRAM;
+			failed = hFwu->Program(hFwu->Ctx, address,
+					&hFwu->Buffer[hFwu->Prog][hFwu->ProgOffset / 4U]);
+		}
+	} else if (hFwu->ErasedEnd < hFwu->Address + hFwu->Size) {
+		hFwu->FlashOp = FWU_OP_ERASE;  // Nothing to program: erase ahead
+		failed = hFwu->Erase(hFwu->Ctx, hFwu->ErasedEnd);
+	} else {
+		return;
+	}
+
+	if (failed) {
+		FWU_FLASH_DONE(hFwu, 1);
+	}
+}
+
+/**
+ * @brief  Hand the filled buffer to the flash engine and switch buffers
+ */
+static void FWU_COMMIT(FWU_HandleTypeDef_t *hFwu) {
+	uint8_t b = hFwu->Fill;
+	uint8_t *bytes = (uint8_t*) hFwu->Buffer[b];
+	uint32_t padded = (hFwu->FillLength + FWU_QUAD_WORD - 1U)
+			& ~(FWU_QUAD_WORD - 1U);
+
+	memset(&bytes[hFwu->FillLength], FWU_ERASED_BYTE,
+			padded - hFwu->FillLength);
+	hFwu->BufferLength[b] = hFwu->FillLength;
+	hFwu->Committed += hFwu->FillLength;
+	hFwu->Queued |= (uint8_t) (1U << b);
+
+	hFwu->Fill = b ^ 1U;               // Its offset is set by the first write
+	hFwu->FillLength = 0;
+	FWU_KICK(hFwu);
+}
+
+/**
+ * @brief  Fold 'length' bytes into a CRC-32
+ * @param  crc: 0 to start, or the result of the previous call
+ */
+uint32_t FWU_CRC32(uint32_t crc, const uint8_t *pData, uint32_t length) {
+	crc = ~crc;
+	for (uint32_t i = 0; i < length; i++) {
+		crc = fwuCrcTable[(crc ^ pData[i]) & 0xFFU] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+/**
+ * @brief  Reset the updater, after the configuration is filled in
+ */
+void FWU_INIT(FWU_HandleTypeDef_t *hFwu) {
+	hFwu->State = FWU_STATE_IDLE;
+	hFwu->Error = FWU_OK;
+	hFwu->FlashOp = FWU_OP_NONE;
+	hFwu->Queued = 0;
+	hFwu->Erases = 0;
+	hFwu->QuadWords = 0;
+	hFwu->Stalls = 0;
+}
+
+/**
+ * @brief  Start an image: the first sector starts erasing at once
+ * @retval FWU_OK, FWU_BUSY while the last operation of an aborted update
+ *         runs, or FWU_ERR_RANGE
+ */
+uint8_t FWU_BEGIN(FWU_HandleTypeDef_t *hFwu, uint32_t address, uint32_t size) {
+	if (hFwu->FlashOp != FWU_OP_NONE) {
+		return FWU_BUSY;
+	}
+	if ((address & (FWU_QUAD_WORD - 1U)) != 0 || size == 0
+			|| address < hFwu->RegionAddress
+			|| address - hFwu->RegionAddress > hFwu->RegionSize
+			|| size > hFwu->RegionSize - (address - hFwu->RegionAddress)) {
+		return FWU_ERR_RANGE;
+	}
+
+	hFwu->State = FWU_STATE_RECEIVING;
+	hFwu->Error = FWU_OK;
+	hFwu->Address = address;
+	hFwu->Size = size;
+	hFwu->Committed = 0;
+	hFwu->Programmed = 0;
+	hFwu->Crc = 0;
+	hFwu->Fill = 0;
+	hFwu->FillLength = 0;
+	hFwu->Queued = 0;
+	hFwu->Prog = 0;
+	hFwu->ProgOffset = 0;
+	hFwu->ErasedEnd = hFwu->RegionAddress
+			+ (address - hFwu->RegionAddress) / hFwu->SectorSize
+					* hFwu->SectorSize;
+	FWU_KICK(hFwu);
+	return FWU_OK;
+}
+
+/**
+ * @brief  Copy data of the current block into its buffer
+ * @param  offset: image offset. A block sent again starts over at the
+ *         offset of its first byte.
+ * @retval FWU_OK, FWU_ERR_SEQUENCE, or the error of a failed update
+ */
+uint8_t FWU_WRITE(FWU_HandleTypeDef_t *hFwu, uint32_t offset,
+		const uint8_t *pData, uint32_t length) {
+	if (hFwu->State != FWU_STATE_RECEIVING) {
+		return (hFwu->State == FWU_STATE_FAILED) ? hFwu->Error
+				: FWU_ERR_SEQUENCE;
+	}
+	uint32_t base = hFwu->Committed; // The block follows the committed ones
+	if ((hFwu->Queued & (1U << hFwu->Fill)) || offset < base
+			|| offset - base + length > FWU_BUFFER_BYTES
+			|| offset + length > hFwu->Size) {
+		return FWU_ERR_SEQUENCE;
+	}
+
+	hFwu->BufferOffset[hFwu->Fill] = base;
+	memcpy((uint8_t*) hFwu->Buffer[hFwu->Fill] + (offset - base), pData,
+			length);
+	if (offset - base + length > hFwu->FillLength) {
+		hFwu->FillLength = offset - base + length;
+	}
+	return FWU_OK;
+}
+
+/**
+ * @brief  The current block is complete: queue it for programming
+ * @note   Call again while it returns FWU_BUSY; the block is queued by the
+ *         first call, later calls only wait for a free buffer.
+ * @retval FWU_OK when the next block may come, FWU_BUSY, or an error
+ */
+uint8_t FWU_BLOCK_END(FWU_HandleTypeDef_t *hFwu) {
+	if (hFwu->State != FWU_STATE_RECEIVING) {
+		return (hFwu->State == FWU_STATE_FAILED) ? hFwu->Error
+				: FWU_ERR_SEQUENCE;
+	}
+	if (hFwu->FillLength != 0) {
+		uint32_t end = hFwu->Committed + hFwu->FillLength;
+		if ((hFwu->FillLength & (FWU_QUAD_WORD - 1U)) != 0
+				&& end != hFwu->Size) {
+			return FWU_ERR_SEQUENCE;  // Would pad the middle of the image
+		}
+		FWU_COMMIT(hFwu);
+		if (hFwu->Queued & (1U << hFwu->Fill)) {
+			hFwu->Stalls++;
+		}
+	}
+	if (hFwu->State == FWU_STATE_FAILED) {
+		return hFwu->Error;
+	}
+	return (hFwu->Queued & (1U << hFwu->Fill)) ? FWU_BUSY : FWU_OK;
+}
+
+/**
+ * @brief  All blocks are in: wait for the flash to catch up
+ * @retval FWU_OK once everything is programmed and read back into Crc,
+ *         FWU_BUSY before, or an error
+ */
+uint8_t FWU_FINISH(FWU_HandleTypeDef_t *hFwu) {
+	if (hFwu->State == FWU_STATE_DONE) {
+		return FWU_OK;
+	}
+	if (hFwu->State != FWU_STATE_RECEIVING) {
+		return (hFwu->State == FWU_STATE_FAILED) ? hFwu->Error
+				: FWU_ERR_SEQUENCE;
+	}
+	if (hFwu->Committed + hFwu->FillLength != hFwu->Size) {
+		return FWU_ERR_SEQUENCE;
+	}
+	if (hFwu->FillLength != 0) {
+		FWU_COMMIT(hFwu);
+	}
+	if (hFwu->Queued != 0 || hFwu->FlashOp != FWU_OP_NONE) {
+		return FWU_BUSY;
+	}
+	hFwu->State = FWU_STATE_DONE;
+	return FWU_OK;
+}
+
+/**
+ * @brief  Drop the update; an operation in progress still completes
+ */
+void FWU_ABORT(FWU_HandleTypeDef_t *hFwu) {
+	hFwu->State = FWU_STATE_IDLE;
+	hFwu->Queued = 0;
+}
+
+/**
+ * @brief  The erase or program started last has ended: start the next one
+ * @note   Called from the flash interrupt on target. A programmed buffer is
+ *         read back into Crc here.
+ */
+void FWU_FLASH_DONE(FWU_HandleTypeDef_t *hFwu, uint8_t failed) {
+	uint8_t op = hFwu->FlashOp;
+
+	hFwu->FlashOp = FWU_OP_NONE;
+	if (hFwu->State != FWU_STATE_RECEIVING) {
+		return;                    // Aborted meanwhile
+	}
+	if (failed) {
+		hFwu->State = FWU_STATE_FAILED;
+		hFwu->Error = FWU_ERR_FLASH;
+		hFwu->Queued = 0;
+		return;
+	}
+
+	if (op == FWU_OP_ERASE) {
+		hFwu->ErasedEnd += hFwu->SectorSize;
+		hFwu->Erases++;
+	} else if (op == FWU_OP_PROGRAM) {
+		uint8_t b = hFwu->Prog;
+		hFwu->QuadWords++;
+		hFwu->ProgOffset += FWU_QUAD_WORD;
+		if (hFwu->ProgOffset >= hFwu->BufferLength[b]) {
+			uint32_t at = hFwu->Address + hFwu->BufferOffset[b]
+					- hFwu->RegionAddress;
+			hFwu->Crc = FWU_CRC32(hFwu->Crc, &hFwu->RegionData[at],
+					hFwu->BufferLength[b]);
+			hFwu->Programmed += hFwu->BufferLength[b];
+			hFwu->Queued &= (uint8_t) ~(1U << b);
+			hFwu->Prog = b ^ 1U;
+			hFwu->ProgOffset = 0;
+		}
+	}
+	FWU_KICK(hFwu);
+}
@@ -0,0 +1,553 @@
+/**
+ ******************************************************************************
+ * @file           : isotp.c
+ * @brief          : ISO 15765-2 (ISO-TP) transport over compact FDCAN frames.
+ *
+ * Frame layout (byte 0 high nibble = PCI type):
+ *   SF  0L  data...                    L = 1..7
+ *   SF  00 LL data...                  CAN FD only, LL = 8..62
+ *   FF  1L LL data...                  12-bit FF_DL up to 4095
+ *   FF  10 00 LL LL LL LL data...      32-bit FF_DL escape
+ *   CF  2N data...                     N = sequence number 0..15
+ *   FC  3S BS STmin                    S = CTS / WAIT / OVFLW
+ ******************************************************************************
+ */
+
+#include <string.h>
+#include "isotp.h"
+
+/***** Frame Header Sizes *****/
+#define ISOTP_SF_HDR                1U
+#define ISOTP_SF_FD_HDR             2U
+#define ISOTP_FF_HDR                2U
+#define ISOTP_FF_ESC_HDR            6U
+#define ISOTP_CF_HDR                1U
+#define ISOTP_FC_LEN                3U
+#define ISOTP_CLASSIC_DL            8U
+
+/***** Private Helpers *****/
+FDCAN_INLINE uint32_t ISOTP_NOW(const ISOTP_HandleTypeDef_t *hIsoTp) {
+	return hIsoTp->GetTicks();
+}
+
+/* Wrap-safe "deadline has passed" on a free-running tick counter */
+FDCAN_INLINE uint8_t ISOTP_EXPIRED(uint32_t now, uint32_t deadline) {
+	return (int32_t) (now - deadline) >= 0;
+}
+
+FDCAN_INLINE uint32_t ISOTP_MS_TO_TICKS(const ISOTP_HandleTypeDef_t *hIsoTp,
+		uint32_t ms) {
+	return ms * 1000U * hIsoTp->TicksPerUs;
+}
+
+/* Largest payload that fits a Single Frame */
+FDCAN_INLINE uint32_t ISOTP_SF_MAX(const ISOTP_HandleTypeDef_t *hIsoTp) {
+	if (hIsoTp->TxDataLength <= ISOTP_CLASSIC_DL) {
+		return ISOTP_CLASSIC_DL - ISOTP_SF_HDR;
+	}
+	return hIsoTp->TxDataLength - ISOTP_SF_FD_HDR;
+}
+
+/**
+ * @brief  Build a frame from a PCI header and a slice of payload, then queue it
+ * @note   FD frames are padded up to the next valid DLC length; Classic
+ *         frames are padded to 8 bytes when PadFrames is set
+ * @retval 1 if queued, 0 if the driver had no free TX slot
+ */
+static uint8_t ISOTP_SEND_PDU(ISOTP_HandleTypeDef_t *hIsoTp,
+		const uint8_t *pHeader, uint32_t headerLen, const uint8_t *pPayload,
+		uint32_t payloadLen) {
+	FDCAN_FrameTypeDef_t frame;
+	uint32_t total = headerLen + payloadLen;
+	uint32_t frameLen = total;
+	uint8_t dlc;
+	uint8_t fd = (hIsoTp->TxDataLength > ISOTP_CLASSIC_DL);
+
+	if (fd) {
+		dlc = FDCAN_BYTES_TO_DLC(total);
+		frameLen = FDCAN_DLC_TO_BYTES(dlc);
+	} else {
+		if (hIsoTp->PadFrames) {
+			frameLen = ISOTP_CLASSIC_DL;
+		}
+		dlc = (uint8_t) frameLen;
+	}
+
+	FDCAN_FRAME_SET_ID(&frame, hIsoTp->TxId, hIsoTp->IdExtended);
+	FDCAN_FRAME_SET_CONTROL(&frame, dlc, fd, fd && hIsoTp->BitRateSwitch);
+
+	uint8_t *pData = FDCAN_FRAME_DATA(&frame);
+	memcpy(pData, pHeader, headerLen);
+	if (payloadLen != 0) {
+		memcpy(pData + headerLen, pPayload, payloadLen);
+	}
+	if (frameLen > total) {
+		memset(pData + total, hIsoTp->PadByte, frameLen - total);
+	}
+
+	if (!hIsoTp->SendFrame(hIsoTp->Ctx, &frame)) {
+		return 0;
+	}
+	hIsoTp->TxFrames++;
+	return 1;
+}
+
+/***** Transmit Side *****/
+static void ISOTP_TX_COMPLETE(ISOTP_HandleTypeDef_t *hIsoTp, uint8_t result) {
+	hIsoTp->TxState = ISOTP_TX_IDLE;
+	if (result == ISOTP_OK) {
+		hIsoTp->TxMessages++;
+	} else {
+		hIsoTp->Errors++;
+	}
+	if (hIsoTp->TxDone != 0) {
+		hIsoTp->TxDone(hIsoTp->Ctx, result);
+	}
+}
+
+/**
+ * @brief  Queue the Single Frame or First Frame of the current message
+ * @retval 1 if queued
+ */
+static uint8_t ISOTP_TX_FIRST(ISOTP_HandleTypeDef_t *hIsoTp, uint32_t now) {
+	uint8_t header[ISOTP_FF_ESC_HDR];
+	uint32_t length = hIsoTp->TxLength;
+
+	if (length <= ISOTP_SF_MAX(hIsoTp)) {
+		uint32_t headerLen;
+		if (length <= ISOTP_CLASSIC_DL - ISOTP_SF_HDR) {
+			header[0] = (uint8_t) ((ISOTP_PCI_SF << 4) | length);
+			headerLen = ISOTP_SF_HDR;
+		} else {
+			header[0] = (uint8_t) (ISOTP_PCI_SF << 4);
+			header[1] = (uint8_t) length;
+			headerLen = ISOTP_SF_FD_HDR;
+		}
+		if (!ISOTP_SEND_PDU(hIsoTp, header, headerLen, hIsoTp->TxData, length)) {
+			return 0;
+		}
+		hIsoTp->TxOffset = length;
+		ISOTP_TX_COMPLETE(hIsoTp, ISOTP_OK);
+		return 1;
+	}
+
+	uint32_t headerLen;
+	if (length <= ISOTP_FF_DL12_MAX) {
+		header[0] = (uint8_t) ((ISOTP_PCI_FF << 4) | (length >> 8));
+		header[1] = (uint8_t) length;
+		headerLen = ISOTP_FF_HDR;
+	} else {
+		header[0] = (uint8_t) (ISOTP_PCI_FF << 4);
+		header[1] = 0;
+		header[2] = (uint8_t) (length >> 24);
+		header[3] = (uint8_t) (length >> 16);
+		header[4] = (uint8_t) (length >> 8);
+		header[5] = (uint8_t) length;
+		headerLen = ISOTP_FF_ESC_HDR;
+	}
+
+	uint32_t chunk = hIsoTp->TxDataLength - headerLen;
+	if (!ISOTP_SEND_PDU(hIsoTp, header, headerLen, hIsoTp->TxData, chunk)) {
+		return 0;
+	}
+	hIsoTp->TxOffset = chunk;
+	hIsoTp->TxSeq = 1;
+	hIsoTp->TxWaitCount = 0;
+	hIsoTp->TxState = ISOTP_TX_WAIT_FC;
+	hIsoTp->TxDeadline = now + ISOTP_MS_TO_TICKS(hIsoTp, ISOTP_TIMEOUT_BS_MS);
+	return 1;
+}
+
+/**
+ * @brief  Send Consecutive Frames while STmin, the block size and the
+ *         driver's TX slots allow
+ * @note   With STmin = 0 this fills every free TX slot in one call
+ */
+static void ISOTP_TX_CONSECUTIVE(ISOTP_HandleTypeDef_t *hIsoTp, uint32_t now) {
+	uint32_t maxChunk = hIsoTp->TxDataLength - ISOTP_CF_HDR;
+
+	while (hIsoTp->TxState == ISOTP_TX_SEND_CF) {
+		if (!ISOTP_EXPIRED(now, hIsoTp->TxDeadline)) {
+			return;  // STmin not elapsed yet
+		}
+
+		uint32_t remaining = hIsoTp->TxLength - hIsoTp->TxOffset;
+		uint32_t chunk = (remaining < maxChunk) ? remaining : maxChunk;
+		uint8_t header = (uint8_t) ((ISOTP_PCI_CF << 4) | hIsoTp->TxSeq);
+
+		if (!ISOTP_SEND_PDU(hIsoTp, &header, ISOTP_CF_HDR,
+				hIsoTp->TxData + hIsoTp->TxOffset, chunk)) {
+			return;  // TX FIFO full, retry on the next poll
+		}
+		hIsoTp->TxOffset += chunk;
+		hIsoTp->TxSeq = (hIsoTp->TxSeq + 1U) & 0xFU;
+
+		if (hIsoTp->TxOffset >= hIsoTp->TxLength) {
+			ISOTP_TX_COMPLETE(hIsoTp, ISOTP_OK);
+			return;
+		}
+		if (hIsoTp->TxBlockSize != 0 && --hIsoTp->TxBlockLeft == 0) {
+			hIsoTp->TxState = ISOTP_TX_WAIT_FC;
+			hIsoTp->TxDeadline = now
+					+ ISOTP_MS_TO_TICKS(hIsoTp, ISOTP_TIMEOUT_BS_MS);
+			return;
+		}
+
+		/* STmin is timed from when the frame was queued */
+		hIsoTp->TxDeadline = now + hIsoTp->TxStminTicks;
+		if (hIsoTp->TxStminTicks != 0) {
+			return;
+		}
+	}
+}
+
+static void ISOTP_TX_PROCESS(ISOTP_HandleTypeDef_t *hIsoTp, uint32_t now) {
+	switch (hIsoTp->TxState) {
+	case ISOTP_TX_SEND_FIRST:
+		ISOTP_TX_FIRST(hIsoTp, now);
+		break;
+	case ISOTP_TX_WAIT_FC:
+		if (ISOTP_EXPIRED(now, hIsoTp->TxDeadline)) {
+			ISOTP_TX_COMPLETE(hIsoTp, ISOTP_ERR_TIMEOUT_BS);
+		}
+		break;
+	case ISOTP_TX_SEND_CF:
+		ISOTP_TX_CONSECUTIVE(hIsoTp, now);
+		break;
+	default:
+		break;
+	}
+}
+
+/**
+ * @brief  Handle a Flow Control frame from the receiver
+ */
+static void ISOTP_TX_FLOW_CONTROL(ISOTP_HandleTypeDef_t *hIsoTp,
+		const uint8_t *pData, uint32_t len, uint32_t now) {
+	if (hIsoTp->TxState != ISOTP_TX_WAIT_FC || len < ISOTP_FC_LEN) {
+		return;  // Unexpected FC is ignored
+	}
+
+	switch (pData[0] & 0xFU) {
+	case ISOTP_FS_CTS:
+		hIsoTp->TxBlockSize = pData[1];
+		hIsoTp->TxBlockLeft = pData[1];
+		hIsoTp->TxStminTicks = ISOTP_STMIN_TO_US(pData[2]) * hIsoTp->TicksPerUs;
+		hIsoTp->TxWaitCount = 0;
+		hIsoTp->TxState = ISOTP_TX_SEND_CF;
+		hIsoTp->TxDeadline = now;
+		ISOTP_TX_CONSECUTIVE(hIsoTp, now);
+		break;
+	case ISOTP_FS_WAIT:
+		if (++hIsoTp->TxWaitCount > ISOTP_MAX_WFT) {
+			ISOTP_TX_COMPLETE(hIsoTp, ISOTP_ERR_WFT_OVRN);
+		} else {
+			hIsoTp->TxDeadline = now
+					+ ISOTP_MS_TO_TICKS(hIsoTp, ISOTP_TIMEOUT_BS_MS);
+		}
+		break;
+	case ISOTP_FS_OVFLW:
+		ISOTP_TX_COMPLETE(hIsoTp, ISOTP_ERR_OVERFLOW);
+		break;
+	default:
+		break;
+	}
+}
+
+/***** Receive Side *****/
+static void ISOTP_RX_COMPLETE(ISOTP_HandleTypeDef_t *hIsoTp, uint8_t result) {
+	hIsoTp->RxState = ISOTP_RX_IDLE;
+	if (result == ISOTP_OK) {
+		hIsoTp->RxMessages++;
+	} else {
+		hIsoTp->Errors++;
+	}
+	if (hIsoTp->RxDone != 0) {
+		hIsoTp->RxDone(hIsoTp->Ctx, hIsoTp->RxOffset, result);
+	}
+}
+
+/* Hand received bytes to the caller's buffer and/or streaming sink */
+static void ISOTP_RX_DELIVER(ISOTP_HandleTypeDef_t *hIsoTp,
+		const uint8_t *pData, uint32_t len) {
+	if (hIsoTp->RxBuffer != 0) {
+		memcpy(hIsoTp->RxBuffer + hIsoTp->RxOffset, pData, len);
+	}
+	if (hIsoTp->RxChunk != 0) {
+		hIsoTp->RxChunk(hIsoTp->Ctx, hIsoTp->RxOffset, pData, len);
+	}
+	hIsoTp->RxOffset += len;
+}
+
+/* 1 if a message of 'length' bytes has somewhere to go */
+static uint8_t ISOTP_RX_FITS(const ISOTP_HandleTypeDef_t *hIsoTp,
+		uint32_t length) {
+	if (hIsoTp->RxBuffer == 0 && hIsoTp->RxChunk == 0) {
+		return 0;
+	}
+	if (hIsoTp->RxBuffer != 0 || hIsoTp->RxBufferSize != 0) {
+		return length <= hIsoTp->RxBufferSize; // No size, no buffer writes
+	}
+	return 1;                          // RxChunk only, unlimited
+}
+
+/**
+ * @brief  Queue the pending Flow Control frame
+ */
+static void ISOTP_RX_SEND_FLOW(ISOTP_HandleTypeDef_t *hIsoTp, uint32_t now) {
+	uint8_t fc[ISOTP_FC_LEN];
+
+	fc[0] = (uint8_t) ((ISOTP_PCI_FC << 4) | hIsoTp->RxFlowStatus);
+	fc[1] = hIsoTp->BlockSize;
+	fc[2] = hIsoTp->STmin;
+	if (!ISOTP_SEND_PDU(hIsoTp, fc, ISOTP_FC_LEN, 0, 0)) {
+		return;  // Retried from ISOTP_POLL
+	}
+
+	if (hIsoTp->RxFlowStatus == ISOTP_FS_OVFLW) {
+		hIsoTp->RxState = ISOTP_RX_IDLE;  // Error already reported
+		return;
+	}
+	hIsoTp->RxState = ISOTP_RX_RECEIVING;
+	hIsoTp->RxBlockLeft = hIsoTp->BlockSize;
+	hIsoTp->RxDeadline = now + ISOTP_MS_TO_TICKS(hIsoTp, ISOTP_TIMEOUT_CR_MS);
+}
+
+static void ISOTP_RX_SINGLE(ISOTP_HandleTypeDef_t *hIsoTp,
+		const uint8_t *pData, uint32_t len) {
+	uint32_t length = pData[0] & 0xFU;
+	uint32_t headerLen = ISOTP_SF_HDR;
+
+	if (length == 0) {
+		/* SF_DL escape, only valid in frames longer than 8 bytes */
+		if (len <= ISOTP_CLASSIC_DL) {
+			return;
+		}
+		length = pData[1];
+		headerLen = ISOTP_SF_FD_HDR;
+	}
+	if (length == 0 || length > len - headerLen) {
+		return;  // Malformed SF is ignored
+	}
+
+	if (hIsoTp->RxState != ISOTP_RX_IDLE) {
+		ISOTP_RX_COMPLETE(hIsoTp, ISOTP_ERR_ABORTED);
+	}
+
+	hIsoTp->RxLength = length;
+	hIsoTp->RxOffset = 0;
+	if (!ISOTP_RX_FITS(hIsoTp, length)) {
+		ISOTP_RX_COMPLETE(hIsoTp, ISOTP_ERR_OVERFLOW);
+		return;
+	}
+	if (hIsoTp->RxStart != 0) {
+		hIsoTp->RxStart(hIsoTp->Ctx, length);
+	}
+	ISOTP_RX_DELIVER(hIsoTp, pData + headerLen, length);
+	ISOTP_RX_COMPLETE(hIsoTp, ISOTP_OK);
+}
+
+static void ISOTP_RX_FIRST(ISOTP_HandleTypeDef_t *hIsoTp,
+		const uint8_t *pData, uint32_t len, uint32_t now) {
+	uint32_t length = ((uint32_t) (pData[0] & 0xFU) << 8) | pData[1];
+	uint32_t headerLen = ISOTP_FF_HDR;
+
+	if (length == 0) {
+		if (len < ISOTP_FF_ESC_HDR) {
+			return;
+		}
+		length = ((uint32_t) pData[2] << 24) | ((uint32_t) pData[3] << 16)
+				| ((uint32_t) pData[4] << 8) | pData[5];
+		headerLen = ISOTP_FF_ESC_HDR;
+	}
+	if (len <= headerLen || length <= len - headerLen) {
+		return;  // A message this short would have been an SF
+	}
+
+	if (hIsoTp->RxState != ISOTP_RX_IDLE) {
+		ISOTP_RX_COMPLETE(hIsoTp, ISOTP_ERR_ABORTED);
+	}
+
+	hIsoTp->RxLength = length;
+	hIsoTp->RxOffset = 0;
+	hIsoTp->RxSeq = 1;
+
+	if (!ISOTP_RX_FITS(hIsoTp, length)) {
+		/* Report now, then tell the sender with FC.OVFLW */
+		ISOTP_RX_COMPLETE(hIsoTp, ISOTP_ERR_OVERFLOW);
+		hIsoTp->RxFlowStatus = ISOTP_FS_OVFLW;
+		hIsoTp->RxState = ISOTP_RX_SEND_FC;
+		ISOTP_RX_SEND_FLOW(hIsoTp, now);
+		return;
+	}
+
+	if (hIsoTp->RxStart != 0) {
+		hIsoTp->RxStart(hIsoTp->Ctx, length);
+	}
+	ISOTP_RX_DELIVER(hIsoTp, pData + headerLen, len - headerLen);
+	hIsoTp->RxFlowStatus = ISOTP_FS_CTS;
+	hIsoTp->RxState = ISOTP_RX_SEND_FC;
+	ISOTP_RX_SEND_FLOW(hIsoTp, now);
+}
+
+static void ISOTP_RX_CONSECUTIVE(ISOTP_HandleTypeDef_t *hIsoTp,
+		const uint8_t *pData, uint32_t len, uint32_t now) {
+	if (hIsoTp->RxState != ISOTP_RX_RECEIVING) {
+		return;  // Unexpected CF is ignored
+	}
+	if ((pData[0] & 0xFU) != hIsoTp->RxSeq) {
+		ISOTP_RX_COMPLETE(hIsoTp, ISOTP_ERR_SEQUENCE);
+		return;
+	}
+
+	uint32_t remaining = hIsoTp->RxLength - hIsoTp->RxOffset;
+	uint32_t chunk = len - ISOTP_CF_HDR;
+	if (chunk > remaining) {
+		chunk = remaining;  // Drop padding of the last CF
+	}
+	ISOTP_RX_DELIVER(hIsoTp, pData + ISOTP_CF_HDR, chunk);
+	hIsoTp->RxSeq = (hIsoTp->RxSeq + 1U) & 0xFU;
+
+	if (hIsoTp->RxOffset >= hIsoTp->RxLength) {
+		ISOTP_RX_COMPLETE(hIsoTp, ISOTP_OK);
+	} else if (hIsoTp->BlockSize != 0 && --hIsoTp->RxBlockLeft == 0) {
+		hIsoTp->RxFlowStatus = ISOTP_FS_CTS;
+		hIsoTp->RxState = ISOTP_RX_SEND_FC;
+		ISOTP_RX_SEND_FLOW(hIsoTp, now);
+	} else {
+		hIsoTp->RxDeadline = now
+				+ ISOTP_MS_TO_TICKS(hIsoTp, ISOTP_TIMEOUT_CR_MS);
+	}
+}
+
+/***** Public API *****/
+
+/**
+ * @brief  Reset a channel to idle and apply configuration defaults
+ * @note   TxDataLength is rounded to a valid CAN FD length (8 if unset)
+ * @retval ISOTP_OK, or ISOTP_ERR_CONFIG if RxBuffer is set without
+ *         RxBufferSize; the channel then refuses every incoming message
+ */
+uint8_t ISOTP_INIT(ISOTP_HandleTypeDef_t *hIsoTp) {
+	uint32_t txdl = hIsoTp->TxDataLength;
+
+	if (txdl < ISOTP_CLASSIC_DL) {
+		txdl = ISOTP_CLASSIC_DL;
+	} else if (txdl > FDCAN_FRAME_MAX_DATA) {
+		txdl = FDCAN_FRAME_MAX_DATA;
+	}
+	hIsoTp->TxDataLength = FDCAN_DLC_TO_BYTES(FDCAN_BYTES_TO_DLC(txdl));
+	if (hIsoTp->TicksPerUs == 0) {
+		hIsoTp->TicksPerUs = 1;
+	}
+
+	hIsoTp->TxState = ISOTP_TX_IDLE;
+	hIsoTp->RxState = ISOTP_RX_IDLE;
+	hIsoTp->TxFrames = 0;
+	hIsoTp->RxFrames = 0;
+	hIsoTp->TxMessages = 0;
+	hIsoTp->RxMessages = 0;
+	hIsoTp->Errors = 0;
+
+	if (hIsoTp->RxBuffer != 0 && hIsoTp->RxBufferSize == 0) {
+		return ISOTP_ERR_CONFIG;
+	}
+	return ISOTP_OK;
+}
+
+/**
+ * @brief  Start sending a message straight from the caller's buffer
+ * @param  pData: Payload, must stay valid and unchanged until TxDone
+ * @param  length: Payload length in bytes
+ * @retval ISOTP_OK if started, ISOTP_BUSY or ISOTP_ERR_LENGTH otherwise
+ */
+uint8_t ISOTP_SEND(ISOTP_HandleTypeDef_t *hIsoTp, const uint8_t *pData,
+		uint32_t length) {
+	if (hIsoTp->TxState != ISOTP_TX_IDLE) {
+		return ISOTP_BUSY;
+	}
+	if (length == 0) {
+		return ISOTP_ERR_LENGTH;
+	}
+
+	hIsoTp->TxData = pData;
+	hIsoTp->TxLength = length;
+	hIsoTp->TxOffset = 0;
+	hIsoTp->TxState = ISOTP_TX_SEND_FIRST;
+	ISOTP_TX_PROCESS(hIsoTp, ISOTP_NOW(hIsoTp));
+	return ISOTP_OK;
+}
+
+/**
+ * @brief  Offer a received frame to the channel
+ * @retval 1 if the frame belongs to this channel (RxId), 0 otherwise
+ */
+uint8_t ISOTP_RX_FRAME(ISOTP_HandleTypeDef_t *hIsoTp,
+		const FDCAN_FrameTypeDef_t *pFrame) {
+	if (FDCAN_FRAME_IS_EXTENDED(pFrame) != hIsoTp->IdExtended
+			|| FDCAN_FRAME_GET_ID(pFrame) != hIsoTp->RxId) {
+		return 0;
+	}
+
+	uint32_t len = FDCAN_FRAME_GET_LEN(pFrame);
+	if (!FDCAN_FRAME_IS_FD(pFrame) && len > ISOTP_CLASSIC_DL) {
+		len = ISOTP_CLASSIC_DL;  // Classic DLC 9..15 still carries 8 bytes
+	}
+	if (len == 0 || FDCAN_FRAME_IS_REMOTE(pFrame)) {
+		return 1;
+	}
+
+	const uint8_t *pData = FDCAN_FRAME_CDATA(pFrame);
+	uint32_t now = ISOTP_NOW(hIsoTp);
+	hIsoTp->RxFrames++;
+
+	switch (pData[0] >> 4) {
+	case ISOTP_PCI_SF:
+		ISOTP_RX_SINGLE(hIsoTp, pData, len);
+		break;
+	case ISOTP_PCI_FF:
+		ISOTP_RX_FIRST(hIsoTp, pData, len, now);
+		break;
+	case ISOTP_PCI_CF:
+		ISOTP_RX_CONSECUTIVE(hIsoTp, pData, len, now);
+		break;
+	case ISOTP_PCI_FC:
+		ISOTP_TX_FLOW_CONTROL(hIsoTp, pData, len, now);
+		break;
+	default:
+		break;
+	}
+	return 1;
+}
+
+/**
+ * @brief  Drive timers and retry frames that found no free TX slot
+ * @note   Call often: every STmin-spaced Consecutive Frame leaves from here
+ */
+void ISOTP_POLL(ISOTP_HandleTypeDef_t *hIsoTp) {
+	uint32_t now = ISOTP_NOW(hIsoTp);
+
+	ISOTP_TX_PROCESS(hIsoTp, now);
+
+	if (hIsoTp->RxState == ISOTP_RX_SEND_FC) {
+		ISOTP_RX_SEND_FLOW(hIsoTp, now);
+	} else if (hIsoTp->RxState == ISOTP_RX_RECEIVING
+			&& ISOTP_EXPIRED(now, hIsoTp->RxDeadline)) {
+		ISOTP_RX_COMPLETE(hIsoTp, ISOTP_ERR_TIMEOUT_CR);
+	}
+}
+
+/**
+ * @brief  Decode an STmin byte to microseconds
+ * @note   0x00-0x7F: 0-127 ms, 0xF1-0xF9: 100-900 us. Reserved values are
+ *         treated as 127 ms, as ISO 15765-2 requires of the sender.
+ */
+uint32_t ISOTP_STMIN_TO_US(uint8_t stmin) {
+	if (stmin <= 0x7FU) {
+		return (uint32_t) stmin * 1000U;
+	}
+	if (stmin >= 0xF1U && stmin <= 0xF9U) {
+		return (uint32_t) (stmin - 0xF0U) * 100U;
+	}
+	return 127000U;
+}
@@ -0,0 +1,698 @@
+/**
+ ******************************************************************************
+ * @file           : j1939.c
+ * @brief          : SAE J1939 node: PGN addressing, address claim (J1939-81)
+ *                   and BAM / CMDT transport protocol (J1939-21).
+ *
+ * TP.CM layout:   [control, size LSB, size MSB, packets, x, PGN LSB, PGN, PGN MSB]
+ *   RTS  16  x = max packets per CTS (0xFF = no limit)
+ *   CTS  17  [17, packets granted, next packet, 0xFF, 0xFF, PGN]
+ *   EOMA 19  x = 0xFF
+ *   BAM  32  x = 0xFF
+ *   ABORT 255 [255, reason, 0xFF, 0xFF, 0xFF, PGN]
+ * TP.DT layout:   [sequence 1..255, 7 data bytes, 0xFF padded]
+ ******************************************************************************
+ */
+
+#include <string.h>
+#include "j1939.h"
+
+#define J1939_FRAME_LEN             8U
+#define J1939_PAD_BYTE              0xFFU
+
+/***** Private Helpers *****/
+FDCAN_INLINE uint32_t J1939_NOW(const J1939_HandleTypeDef_t *hJ1939) {
+	return hJ1939->GetTicks();
+}
+
+/* Wrap-safe "deadline has passed" on a free-running tick counter */
+FDCAN_INLINE uint8_t J1939_EXPIRED(uint32_t now, uint32_t deadline) {
+	return (int32_t) (now - deadline) >= 0;
+}
+
+FDCAN_INLINE uint32_t J1939_MS_TO_TICKS(const J1939_HandleTypeDef_t *hJ1939,
+		uint32_t ms) {
+	return ms * 1000U * hJ1939->TicksPerUs;
+}
+
+FDCAN_INLINE uint32_t J1939_GET_PGN24(const uint8_t *pData) {
+	return (uint32_t) pData[0] | ((uint32_t) pData[1] << 8)
+			| ((uint32_t) pData[2] << 16);
+}
+
+FDCAN_INLINE void J1939_PUT_PGN24(uint8_t *pData, uint32_t pgn) {
+	pData[0] = (uint8_t) pgn;
+	pData[1] = (uint8_t) (pgn >> 8);
+	pData[2] = (uint8_t) (pgn >> 16);
+}
+
+FDCAN_INLINE uint8_t J1939_ADDRESS_TAKEN(const J1939_HandleTypeDef_t *hJ1939,
+		uint8_t address) {
+	return (hJ1939->AddressInUse[address >> 5] >> (address & 31U)) & 0x1U;
+}
+
+/**
+ * @brief  Queue one Classic extended-ID frame
+ * @retval 1 if queued, 0 if the driver had no free TX slot
+ */
+static uint8_t J1939_SEND_FRAME(J1939_HandleTypeDef_t *hJ1939,
+		uint8_t priority, uint32_t pgn, uint8_t da, uint8_t sa,
+		const uint8_t *pData, uint32_t len) {
+	FDCAN_FrameTypeDef_t frame;
+
+	FDCAN_FRAME_SET_ID(&frame, J1939_ID_MAKE(priority, pgn, da, sa), 1);
+	FDCAN_FRAME_SET_CONTROL(&frame, (uint8_t) len, 0, 0);
+	memcpy(FDCAN_FRAME_DATA(&frame), pData, len);
+
+	if (!hJ1939->SendFrame(hJ1939->Ctx, &frame)) {
+		return 0;
+	}
+	hJ1939->TxFrames++;
+	return 1;
+}
+
+/* TP.CM frame with the PGN in bytes 5-7 */
+static uint8_t J1939_SEND_CM(J1939_HandleTypeDef_t *hJ1939, uint8_t da,
+		uint8_t control, uint8_t b1, uint8_t b2, uint8_t b3, uint8_t b4,
+		uint32_t pgn) {
+	uint8_t cm[J1939_FRAME_LEN] = { control, b1, b2, b3, b4, 0, 0, 0 };
+
+	J1939_PUT_PGN24(&cm[5], pgn);
+	return J1939_SEND_FRAME(hJ1939, J1939_PRIORITY_TP, J1939_PGN_TP_CM, da,
+			hJ1939->Address, cm, J1939_FRAME_LEN);
+}
+
+/***** Address Claim *****/
+
+/**
+ * @brief  Send Address Claimed, or Cannot Claim (SA = NULL) once lost
+ */
+static void J1939_CLAIM_SEND(J1939_HandleTypeDef_t *hJ1939) {
+	uint8_t name[J1939_FRAME_LEN];
+	uint8_t sa = (hJ1939->ClaimState == J1939_CLAIM_LOST) ?
+			J1939_ADDR_NULL : hJ1939->Address;
+
+	for (uint32_t i = 0; i < J1939_FRAME_LEN; i++) {
+		name[i] = (uint8_t) (hJ1939->Name >> (8U * i));
+	}
+	if (J1939_SEND_FRAME(hJ1939, J1939_PRIORITY_DEFAULT,
+			J1939_PGN_ADDRESS_CLAIMED, J1939_ADDR_GLOBAL, sa, name,
+			J1939_FRAME_LEN)) {
+		hJ1939->ClaimPending = 0;
+	}
+}
+
+/* Open a new contention window for the current address */
+static void J1939_CLAIM_START(J1939_HandleTypeDef_t *hJ1939, uint32_t now) {
+	hJ1939->ClaimState = J1939_CLAIM_PENDING;
+	hJ1939->ClaimPending = 1;
+	hJ1939->ClaimDeadline = now + J1939_MS_TO_TICKS(hJ1939, J1939_CLAIM_WAIT_MS);
+	J1939_CLAIM_SEND(hJ1939);
+}
+
+/**
+ * @brief  Another node claimed 'sa' with 'name'
+ * @note   The lower NAME keeps the address. An arbitrary address capable
+ *         loser (NAME bit 63) moves to a free address in 128-247, any other
+ *         loser sends Cannot Claim and goes silent.
+ */
+static void J1939_CLAIM_CONTEST(J1939_HandleTypeDef_t *hJ1939, uint8_t sa,
+		uint64_t name, uint32_t now) {
+	if (sa < J1939_ADDR_NULL) {
+		hJ1939->AddressInUse[sa >> 5] |= (1UL << (sa & 31U));
+	}
+	if (hJ1939->ClaimState == J1939_CLAIM_IDLE
+			|| hJ1939->ClaimState == J1939_CLAIM_LOST
+			|| sa != hJ1939->Address || name == hJ1939->Name) {
+		return;
+	}
+
+	if (hJ1939->Name < name) {
+		hJ1939->ClaimPending = 1;  // We win: claim again
+		return;
+	}
+
+	if (hJ1939->Name >> 63) {
+		for (uint32_t a = J1939_ADDR_DYNAMIC_MIN; a <= J1939_ADDR_DYNAMIC_MAX; a++) {
+			if (!J1939_ADDRESS_TAKEN(hJ1939, (uint8_t) a)) {
+				hJ1939->Address = (uint8_t) a;
+				J1939_CLAIM_START(hJ1939, now);
+				return;
+			}
+		}
+	}
+	hJ1939->ClaimState = J1939_CLAIM_LOST;
+	hJ1939->ClaimPending = 1;
+	J1939_CLAIM_SEND(hJ1939);
+}
+
+/***** Transport Protocol: Receive *****/
+static J1939_TpRxSlotTypeDef_t* J1939_RX_SLOT_FIND(
+		J1939_HandleTypeDef_t *hJ1939, uint8_t sa, uint8_t state) {
+	for (uint32_t i = 0; i < J1939_TP_RX_SESSIONS; i++) {
+		J1939_TpSessionTypeDef_t *s = &hJ1939->RxSlots[i].Session;
+		if (s->State == state && s->Peer == sa) {
+			return &hJ1939->RxSlots[i];
+		}
+	}
+	return 0;
+}
+
+static J1939_TpRxSlotTypeDef_t* J1939_RX_SLOT_ALLOC(
+		J1939_HandleTypeDef_t *hJ1939, uint8_t sa, uint8_t state) {
+	J1939_TpRxSlotTypeDef_t *slot = J1939_RX_SLOT_FIND(hJ1939, sa, state);
+
+	if (slot != 0) {
+		return slot;  // A new announcement restarts the session
+	}
+	for (uint32_t i = 0; i < J1939_TP_RX_SESSIONS; i++) {
+		if (hJ1939->RxSlots[i].Session.State == J1939_TP_FREE) {
+			return &hJ1939->RxSlots[i];
+		}
+	}
+	hJ1939->TpSlotFull++;
+	return 0;
+}
+
+/**
+ * @brief  Send the pending CTS, EOMA or Abort of a CMDT receive session
+ * @note   EOMA and Abort end the session once they are queued
+ */
+static void J1939_RX_SEND_CM(J1939_HandleTypeDef_t *hJ1939,
+		J1939_TpSessionTypeDef_t *s) {
+	uint8_t sent = 0;
+
+	switch (s->PendingCm) {
+	case J1939_TP_CM_CTS: {
+		uint32_t n = (uint32_t) s->Packets - s->NextSeq + 1U;
+		if (n > J1939_TP_CTS_PACKETS) {
+			n = J1939_TP_CTS_PACKETS;
+		}
+		if (n > s->MaxPerCts) {
+			n = s->MaxPerCts;
+		}
+		sent = J1939_SEND_CM(hJ1939, s->Peer, J1939_TP_CM_CTS, (uint8_t) n,
+				(uint8_t) s->NextSeq, 0xFF, 0xFF, s->Pgn);
+		if (sent) {
+			s->WindowEnd = (uint16_t) (s->NextSeq + n - 1U);
+		}
+		break;
+	}
+	case J1939_TP_CM_EOMA:
+		sent = J1939_SEND_CM(hJ1939, s->Peer, J1939_TP_CM_EOMA,
+				(uint8_t) s->Size, (uint8_t) (s->Size >> 8), s->Packets, 0xFF,
+				s->Pgn);
+		break;
+	case J1939_TP_CM_ABORT:
+		sent = J1939_SEND_CM(hJ1939, s->Peer, J1939_TP_CM_ABORT,
+				s->AbortReason, 0xFF, 0xFF, 0xFF, s->Pgn);
+		break;
+	default:
+		break;
+	}
+
+	if (sent) {
+		if (s->PendingCm != J1939_TP_CM_CTS) {
+			s->State = J1939_TP_FREE;
+		}
+		s->PendingCm = 0;
+	}
+}
+
+static void J1939_RX_ABORT(J1939_HandleTypeDef_t *hJ1939,
+		J1939_TpSessionTypeDef_t *s, uint8_t reason) {
+	hJ1939->TpAborts++;
+	if (s->State == J1939_TP_RX_BAM) {
+		s->State = J1939_TP_FREE;  // Broadcasts are never aborted on the bus
+		return;
+	}
+	s->AbortReason = reason;
+	s->PendingCm = J1939_TP_CM_ABORT;
+	J1939_RX_SEND_CM(hJ1939, s);
+}
+
+/**
+ * @brief  Start a BAM or CMDT reception announced by 'cm'
+ */
+static void J1939_RX_ANNOUNCE(J1939_HandleTypeDef_t *hJ1939, uint8_t sa,
+		const uint8_t *cm, uint32_t now) {
+	uint8_t bam = (cm[0] == J1939_TP_CM_BAM);
+	uint32_t size = (uint32_t) cm[1] | ((uint32_t) cm[2] << 8);
+	uint32_t pgn = J1939_GET_PGN24(&cm[5]);
+	uint8_t packets = cm[3];
+
+	if (size <= J1939_FRAME_LEN || packets == 0
+			|| packets != (size + J1939_TP_PACKET_DATA - 1U) / J1939_TP_PACKET_DATA) {
+		return;  // Malformed announcement
+	}
+
+	J1939_TpRxSlotTypeDef_t *slot = J1939_RX_SLOT_ALLOC(hJ1939, sa,
+			bam ? J1939_TP_RX_BAM : J1939_TP_RX_CMDT);
+	if (slot == 0 || size > J1939_TP_BUFFER_SIZE) {
+		if (!bam) {
+			/* Best effort, there is no slot to retry from */
+			J1939_SEND_CM(hJ1939, sa, J1939_TP_CM_ABORT, J1939_ABORT_RESOURCES,
+					0xFF, 0xFF, 0xFF, pgn);
+		}
+		if (slot != 0) {
+			hJ1939->TpAborts++;  // Slot free but message too large
+		}
+		return;
+	}
+
+	J1939_TpSessionTypeDef_t *s = &slot->Session;
+	s->State = bam ? J1939_TP_RX_BAM : J1939_TP_RX_CMDT;
+	s->Peer = sa;
+	s->Pgn = pgn;
+	s->Size = size;
+	s->Packets = packets;
+	s->NextSeq = 1;
+	s->MaxPerCts = (cm[4] == 0) ? 0xFF : cm[4];
+	s->PendingCm = 0;
+
+	if (bam) {
+		s->Deadline = now + J1939_MS_TO_TICKS(hJ1939, J1939_TP_T1_MS);
+	} else {
+		s->PendingCm = J1939_TP_CM_CTS;
+		s->Deadline = now + J1939_MS_TO_TICKS(hJ1939, J1939_TP_T2_MS);
+		J1939_RX_SEND_CM(hJ1939, s);
+	}
+}
+
+/**
+ * @brief  Store one TP.DT packet and advance the session
+ */
+static void J1939_RX_DATA(J1939_HandleTypeDef_t *hJ1939, uint8_t sa,
+		uint8_t da, const uint8_t *dt, uint32_t now) {
+	J1939_TpRxSlotTypeDef_t *slot = J1939_RX_SLOT_FIND(hJ1939, sa,
+			(da == J1939_ADDR_GLOBAL) ? J1939_TP_RX_BAM : J1939_TP_RX_CMDT);
+	if (slot == 0) {
+		return;
+	}
+
+	J1939_TpSessionTypeDef_t *s = &slot->Session;
+	if (s->PendingCm == J1939_TP_CM_EOMA || s->NextSeq > s->Packets) {
+		return;  // Complete, only the EOMA is left to send
+	}
+	if (dt[0] < s->NextSeq) {
+		return;  // Duplicate
+	}
+	if (dt[0] != s->NextSeq) {
+		J1939_RX_ABORT(hJ1939, s, J1939_ABORT_BAD_SEQUENCE);
+		return;
+	}
+
+	uint32_t offset = (uint32_t) (s->NextSeq - 1U) * J1939_TP_PACKET_DATA;
+	uint32_t chunk = s->Size - offset;
+	if (chunk > J1939_TP_PACKET_DATA) {
+		chunk = J1939_TP_PACKET_DATA;
+	}
+	memcpy(&slot->Buffer[offset], &dt[1], chunk);
+	s->NextSeq++;
+
+	if (s->NextSeq > s->Packets) {
+		hJ1939->TpRxMessages++;
+		if (hJ1939->RxMessage != 0) {
+			hJ1939->RxMessage(hJ1939->Ctx, s->Pgn, sa, da, slot->Buffer, s->Size);
+		}
+		if (s->State == J1939_TP_RX_BAM) {
+			s->State = J1939_TP_FREE;
+		} else {
+			s->PendingCm = J1939_TP_CM_EOMA;
+			J1939_RX_SEND_CM(hJ1939, s);
+		}
+		return;
+	}
+
+	if (s->State == J1939_TP_RX_CMDT && s->NextSeq > s->WindowEnd) {
+		s->PendingCm = J1939_TP_CM_CTS;
+		s->Deadline = now + J1939_MS_TO_TICKS(hJ1939, J1939_TP_T2_MS);
+		J1939_RX_SEND_CM(hJ1939, s);
+	} else {
+		s->Deadline = now + J1939_MS_TO_TICKS(hJ1939, J1939_TP_T1_MS);
+	}
+}
+
+/***** Transport Protocol: Transmit *****/
+static void J1939_TX_COMPLETE(J1939_HandleTypeDef_t *hJ1939,
+		J1939_TpSessionTypeDef_t *s, uint8_t result) {
+	s->State = J1939_TP_FREE;
+	if (result == J1939_OK) {
+		hJ1939->TpTxMessages++;
+	} else {
+		hJ1939->TpAborts++;
+	}
+	if (hJ1939->TxDone != 0) {
+		hJ1939->TxDone(hJ1939->Ctx, s->Pgn, s->Peer, result);
+	}
+}
+
+static J1939_TpSessionTypeDef_t* J1939_TX_SLOT_FIND(
+		J1939_HandleTypeDef_t *hJ1939, uint8_t da, uint32_t pgn) {
+	for (uint32_t i = 0; i < J1939_TP_TX_SESSIONS; i++) {
+		J1939_TpSessionTypeDef_t *s = &hJ1939->TxSlots[i];
+		if (s->State != J1939_TP_FREE && s->Peer == da && s->Pgn == pgn) {
+			return s;
+		}
+	}
+	return 0;
+}
+
+/* Send TP.DT packet NextSeq */
+static uint8_t J1939_TX_PACKET(J1939_HandleTypeDef_t *hJ1939,
+		J1939_TpSessionTypeDef_t *s) {
+	uint8_t dt[J1939_FRAME_LEN];
+	uint32_t offset = (uint32_t) (s->NextSeq - 1U) * J1939_TP_PACKET_DATA;
+	uint32_t chunk = s->Size - offset;
+
+	if (chunk > J1939_TP_PACKET_DATA) {
+		chunk = J1939_TP_PACKET_DATA;
+	}
+	dt[0] = (uint8_t) s->NextSeq;
+	memcpy(&dt[1], s->TxData + offset, chunk);
+	memset(&dt[1 + chunk], J1939_PAD_BYTE, J1939_TP_PACKET_DATA - chunk);
+
+	return J1939_SEND_FRAME(hJ1939, J1939_PRIORITY_TP, J1939_PGN_TP_DT,
+			s->Peer, hJ1939->Address, dt, J1939_FRAME_LEN);
+}
+
+/**
+ * @brief  Advance one transmit session: announcement, data and timeouts
+ */
+static void J1939_TX_PROCESS(J1939_HandleTypeDef_t *hJ1939,
+		J1939_TpSessionTypeDef_t *s, uint32_t now) {
+	if (s->PendingCm != 0) {
+		/* RTS or BAM; 0xFF = no limit on packets per CTS */
+		uint8_t bam = (s->PendingCm == J1939_TP_CM_BAM);
+		if (!J1939_SEND_CM(hJ1939, s->Peer, s->PendingCm, (uint8_t) s->Size,
+				(uint8_t) (s->Size >> 8), s->Packets, 0xFF, s->Pgn)) {
+			return;
+		}
+		s->PendingCm = 0;
+		s->Deadline = now + J1939_MS_TO_TICKS(hJ1939,
+				bam ? J1939_TP_BAM_INTERVAL_MS : J1939_TP_T3_MS);
+		return;
+	}
+
+	switch (s->State) {
+	case J1939_TP_TX_BAM:
+		if (!J1939_EXPIRED(now, s->Deadline) || !J1939_TX_PACKET(hJ1939, s)) {
+			return;
+		}
+		s->NextSeq++;
+		s->Deadline = now + J1939_MS_TO_TICKS(hJ1939, J1939_TP_BAM_INTERVAL_MS);
+		if (s->NextSeq > s->Packets) {
+			J1939_TX_COMPLETE(hJ1939, s, J1939_OK);
+		}
+		break;
+	case J1939_TP_TX_CMDT_DATA:
+		/* The receiver paces with CTS, so the window goes out back to back */
+		while (s->NextSeq <= s->WindowEnd) {
+			if (!J1939_TX_PACKET(hJ1939, s)) {
+				return;
+			}
+			s->NextSeq++;
+		}
+		s->State = (s->NextSeq > s->Packets) ?
+				J1939_TP_TX_CMDT_WAIT_EOMA : J1939_TP_TX_CMDT_WAIT_CTS;
+		s->Deadline = now + J1939_MS_TO_TICKS(hJ1939, J1939_TP_T3_MS);
+		break;
+	case J1939_TP_TX_CMDT_WAIT_CTS:
+	case J1939_TP_TX_CMDT_WAIT_EOMA:
+		if (J1939_EXPIRED(now, s->Deadline)) {
+			J1939_SEND_CM(hJ1939, s->Peer, J1939_TP_CM_ABORT,
+					J1939_ABORT_TIMEOUT, 0xFF, 0xFF, 0xFF, s->Pgn);
+			J1939_TX_COMPLETE(hJ1939, s, J1939_ERR_TIMEOUT);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+/**
+ * @brief  Handle TP.CM addressed to us (or BAM to everyone)
+ */
+static void J1939_TP_CM(J1939_HandleTypeDef_t *hJ1939, uint8_t sa,
+		uint8_t da, const uint8_t *cm, uint32_t now) {
+	uint32_t pgn = J1939_GET_PGN24(&cm[5]);
+	J1939_TpSessionTypeDef_t *tx;
+	J1939_TpRxSlotTypeDef_t *rx;
+
+	switch (cm[0]) {
+	case J1939_TP_CM_BAM:
+		if (da == J1939_ADDR_GLOBAL) {
+			J1939_RX_ANNOUNCE(hJ1939, sa, cm, now);
+		}
+		break;
+	case J1939_TP_CM_RTS:
+		if (da != J1939_ADDR_GLOBAL) {
+			J1939_RX_ANNOUNCE(hJ1939, sa, cm, now);
+		}
+		break;
+	case J1939_TP_CM_CTS:
+		tx = J1939_TX_SLOT_FIND(hJ1939, sa, pgn);
+		if (tx == 0 || tx->State == J1939_TP_TX_BAM || tx->PendingCm != 0) {
+			break;
+		}
+		if (cm[1] == 0) {
+			tx->State = J1939_TP_TX_CMDT_WAIT_CTS;  // Hold the connection open
+			tx->Deadline = now + J1939_MS_TO_TICKS(hJ1939, J1939_TP_T4_MS);
+			break;
+		}
+		if (cm[2] == 0 || cm[2] > tx->Packets) {
+			break;
+		}
+		tx->NextSeq = cm[2];
+		tx->WindowEnd = (uint16_t) (cm[2] + cm[1] - 1U);
+		if (tx->WindowEnd > tx->Packets) {
+			tx->WindowEnd = tx->Packets;
+		}
+		tx->State = J1939_TP_TX_CMDT_DATA;
+		J1939_TX_PROCESS(hJ1939, tx, now);
+		break;
+	case J1939_TP_CM_EOMA:
+		tx = J1939_TX_SLOT_FIND(hJ1939, sa, pgn);
+		if (tx != 0 && tx->State == J1939_TP_TX_CMDT_WAIT_EOMA) {
+			J1939_TX_COMPLETE(hJ1939, tx, J1939_OK);
+		}
+		break;
+	case J1939_TP_CM_ABORT:
+		tx = J1939_TX_SLOT_FIND(hJ1939, sa, pgn);
+		if (tx != 0 && tx->State != J1939_TP_TX_BAM) {
+			J1939_TX_COMPLETE(hJ1939, tx, J1939_ERR_ABORTED);
+		}
+		rx = J1939_RX_SLOT_FIND(hJ1939, sa, J1939_TP_RX_CMDT);
+		if (rx != 0 && rx->Session.Pgn == pgn) {
+			rx->Session.State = J1939_TP_FREE;
+			hJ1939->TpAborts++;
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+/***** Public API *****/
+
+/**
+ * @brief  Reset the node, clear all sessions and start claiming PreferredAddress
+ */
+void J1939_INIT(J1939_HandleTypeDef_t *hJ1939) {
+	if (hJ1939->TicksPerUs == 0) {
+		hJ1939->TicksPerUs = 1;
+	}
+	memset(hJ1939->AddressInUse, 0, sizeof(hJ1939->AddressInUse));
+	for (uint32_t i = 0; i < J1939_TP_RX_SESSIONS; i++) {
+		hJ1939->RxSlots[i].Session.State = J1939_TP_FREE;
+	}
+	for (uint32_t i = 0; i < J1939_TP_TX_SESSIONS; i++) {
+		hJ1939->TxSlots[i].State = J1939_TP_FREE;
+	}
+	hJ1939->TxFrames = 0;
+	hJ1939->RxFrames = 0;
+	hJ1939->TpRxMessages = 0;
+	hJ1939->TpTxMessages = 0;
+	hJ1939->TpAborts = 0;
+	hJ1939->TpSlotFull = 0;
+
+	hJ1939->Address = hJ1939->PreferredAddress;
+	J1939_CLAIM_START(hJ1939, J1939_NOW(hJ1939));
+}
+
+/**
+ * @brief  Send a message; above 8 bytes it goes out through the transport
+ *         protocol, as BAM to the global address or CMDT to a node
+ * @param  priority: Used for single frames, transport frames use priority 7
+ * @param  pData: Payload, must stay valid until TxDone for transport messages
+ * @retval J1939_OK, J1939_BUSY (retry later), J1939_ERR_NO_ADDRESS or
+ *         J1939_ERR_LENGTH
+ */
+uint8_t J1939_SEND(J1939_HandleTypeDef_t *hJ1939, uint8_t priority,
+		uint32_t pgn, uint8_t da, const uint8_t *pData, uint32_t length) {
+	if (hJ1939->ClaimState != J1939_CLAIM_DONE) {
+		return J1939_ERR_NO_ADDRESS;
+	}
+	if (length == 0 || length > J1939_TP_MAX_SIZE) {
+		return J1939_ERR_LENGTH;
+	}
+	if (((pgn >> 8) & 0xFFU) >= J1939_PF_PDU2) {
+		da = J1939_ADDR_GLOBAL;
+	}
+
+	if (length <= J1939_FRAME_LEN) {
+		return J1939_SEND_FRAME(hJ1939, priority, pgn, da, hJ1939->Address,
+				pData, length) ? J1939_OK : J1939_BUSY;
+	}
+
+	/* One transport session per destination at a time */
+	J1939_TpSessionTypeDef_t *s = 0;
+	for (uint32_t i = 0; i < J1939_TP_TX_SESSIONS; i++) {
+		if (hJ1939->TxSlots[i].State != J1939_TP_FREE) {
+			if (hJ1939->TxSlots[i].Peer == da) {
+				return J1939_BUSY;
+			}
+		} else if (s == 0) {
+			s = &hJ1939->TxSlots[i];
+		}
+	}
+	if (s == 0) {
+		return J1939_BUSY;
+	}
+
+	s->Peer = da;
+	s->Pgn = pgn;
+	s->Size = length;
+	s->Packets = (uint8_t) ((length + J1939_TP_PACKET_DATA - 1U)
+			/ J1939_TP_PACKET_DATA);
+	s->NextSeq = 1;
+	s->TxData = pData;
+	if (da == J1939_ADDR_GLOBAL) {
+		s->State = J1939_TP_TX_BAM;
+		s->PendingCm = J1939_TP_CM_BAM;
+	} else {
+		s->State = J1939_TP_TX_CMDT_WAIT_CTS;
+		s->PendingCm = J1939_TP_CM_RTS;
+	}
+	J1939_TX_PROCESS(hJ1939, s, J1939_NOW(hJ1939));
+	return J1939_OK;
+}
+
+/**
+ * @brief  Send a Request for 'pgn' to 'da' (J1939_ADDR_GLOBAL for everyone)
+ */
+uint8_t J1939_REQUEST(J1939_HandleTypeDef_t *hJ1939, uint32_t pgn, uint8_t da) {
+	uint8_t req[3];
+	uint8_t sa = (hJ1939->ClaimState == J1939_CLAIM_DONE) ?
+			hJ1939->Address : J1939_ADDR_NULL;
+
+	J1939_PUT_PGN24(req, pgn);
+	return J1939_SEND_FRAME(hJ1939, J1939_PRIORITY_DEFAULT, J1939_PGN_REQUEST,
+			da, sa, req, sizeof(req)) ? J1939_OK : J1939_BUSY;
+}
+
+/**
+ * @brief  Offer a received frame to the node
+ * @retval 1 if the frame was a J1939 frame for this node, 0 otherwise
+ */
+uint8_t J1939_RX_FRAME(J1939_HandleTypeDef_t *hJ1939,
+		const FDCAN_FrameTypeDef_t *pFrame) {
+	if (!FDCAN_FRAME_IS_EXTENDED(pFrame) || FDCAN_FRAME_IS_REMOTE(pFrame)) {
+		return 0;
+	}
+
+	uint32_t id = FDCAN_FRAME_GET_ID(pFrame);
+	uint32_t pgn = J1939_ID_GET_PGN(id);
+	uint8_t sa = J1939_ID_GET_SA(id);
+	uint8_t da = J1939_ID_GET_DA(id);
+	uint32_t len = FDCAN_FRAME_GET_LEN(pFrame);
+	const uint8_t *pData = FDCAN_FRAME_CDATA(pFrame);
+	uint32_t now = J1939_NOW(hJ1939);
+
+	if (len > J1939_FRAME_LEN) {
+		len = J1939_FRAME_LEN;
+	}
+	hJ1939->RxFrames++;
+
+	/* Address claims concern every node, whatever the destination */
+	if (pgn == J1939_PGN_ADDRESS_CLAIMED) {
+		if (len == J1939_FRAME_LEN) {
+			uint64_t name = 0;
+			for (uint32_t i = 0; i < J1939_FRAME_LEN; i++) {
+				name |= (uint64_t) pData[i] << (8U * i);
+			}
+			J1939_CLAIM_CONTEST(hJ1939, sa, name, now);
+		}
+		return 1;
+	}
+
+	if (da != J1939_ADDR_GLOBAL
+			&& (da != hJ1939->Address || hJ1939->ClaimState == J1939_CLAIM_LOST)) {
+		return 0;  // Addressed to another node
+	}
+
+	switch (pgn) {
+	case J1939_PGN_REQUEST:
+		if (len >= 3 && J1939_GET_PGN24(pData) == J1939_PGN_ADDRESS_CLAIMED) {
+			if (hJ1939->ClaimState != J1939_CLAIM_IDLE) {
+				hJ1939->ClaimPending = 1;
+				J1939_CLAIM_SEND(hJ1939);
+			}
+			break;
+		}
+		if (hJ1939->RxMessage != 0) {
+			hJ1939->RxMessage(hJ1939->Ctx, pgn, sa, da, pData, len);
+		}
+		break;
+	case J1939_PGN_TP_CM:
+		if (len == J1939_FRAME_LEN) {
+			J1939_TP_CM(hJ1939, sa, da, pData, now);
+		}
+		break;
+	case J1939_PGN_TP_DT:
+		if (len == J1939_FRAME_LEN) {
+			J1939_RX_DATA(hJ1939, sa, da, pData, now);
+		}
+		break;
+	default:
+		if (hJ1939->RxMessage != 0) {
+			hJ1939->RxMessage(hJ1939->Ctx, pgn, sa, da, pData, len);
+		}
+		break;
+	}
+	return 1;
+}
+
+/**
+ * @brief  Run claim and transport timers, retry frames that found no TX slot
+ * @note   BAM data packets leave from here, one per J1939_TP_BAM_INTERVAL_MS
+ */
+void J1939_POLL(J1939_HandleTypeDef_t *hJ1939) {
+	uint32_t now = J1939_NOW(hJ1939);
+
+	if (hJ1939->ClaimPending) {
+		J1939_CLAIM_SEND(hJ1939);
+	}
+	if (hJ1939->ClaimState == J1939_CLAIM_PENDING && !hJ1939->ClaimPending
+			&& J1939_EXPIRED(now, hJ1939->ClaimDeadline)) {
+		hJ1939->ClaimState = J1939_CLAIM_DONE;
+	}
+
+	for (uint32_t i = 0; i < J1939_TP_RX_SESSIONS; i++) {
+		J1939_TpSessionTypeDef_t *s = &hJ1939->RxSlots[i].Session;
+		if (s->State == J1939_TP_FREE) {
+			continue;
+		}
+		if (s->PendingCm != 0) {
+			J1939_RX_SEND_CM(hJ1939, s);
+		} else if (J1939_EXPIRED(now, s->Deadline)) {
+			J1939_RX_ABORT(hJ1939, s, J1939_ABORT_TIMEOUT);
+		}
+	}
+
+	for (uint32_t i = 0; i < J1939_TP_TX_SESSIONS; i++) {
+		if (hJ1939->TxSlots[i].State != J1939_TP_FREE) {
+			J1939_TX_PROCESS(hJ1939, &hJ1939->TxSlots[i], now);
+		}
+	}
+}
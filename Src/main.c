@@ -2,6 +2,23 @@
 #include <stdio.h>
 #include "stm32h503xx.h"
 #include "core_cm33.h"
+#include "fdcan_frame.h"
+#include "isotp.h"
+#include "j1939.h"
+#include "vehicle_signals.h"
+#include "can_errstate.h"
+#include "can_stats.h"
+#include "can_capture.h"
+#include "xcp.h"
+#include "uds.h"
+#include "fw_update.h"
+#include "can_onchange.h"
+#include "can_ratelimit.h"
+#include "e2e.h"
+#include "can_timesync.h"
+#include "can_traffic.h"
+#include "can_replay.h"
+#include "can_txlatest.h"
 
 // GPIO Mode definitions
 #define GPIO_INPUT_MODE     0x00  // 00: Input mode
@@ -135,15 +152,36 @@
 #define FDCAN_IR_TSW_POS            13    // Timestamp Wraparound bit position
 #define FDCAN_IR_MRAF_POS           14    // Message RAM Access Failure bit position
 #define FDCAN_IR_TOO_POS            15    // Timeout Occurred bit position
-#define FDCAN_IR_DRX_POS            16    // Message stored to Dedicated Rx Buffer bit position
-#define FDCAN_IR_ELO_POS            22    // Error Logging Overflow bit position
-#define FDCAN_IR_EP_POS             23    // Error Passive bit position
-#define FDCAN_IR_EW_POS             24    // Warning Status bit position
-#define FDCAN_IR_BO_POS             25    // Bus_Off Status bit position
-#define FDCAN_IR_WDI_POS            26    // Watchdog Interrupt bit position
-#define FDCAN_IR_PEA_POS            27    // Protocol Error in Arbitration Phase bit position
-#define FDCAN_IR_PED_POS            28    // Protocol Error in Data Phase bit position
-#define FDCAN_IR_ARA_POS            29    // Access to Reserved Address bit position
+// From bit 16 the STM32H5 layout differs from the H7 M_CAN: take it from CMSIS
+#define FDCAN_IR_ELO_POS            FDCAN_IR_ELO_Pos // Error Logging Overflow (16)
+#define FDCAN_IR_EP_POS             FDCAN_IR_EP_Pos  // Error Passive (17)
+#define FDCAN_IR_EW_POS             FDCAN_IR_EW_Pos  // Warning Status (18)
+#define FDCAN_IR_BO_POS             FDCAN_IR_BO_Pos  // Bus_Off Status (19)
+#define FDCAN_IR_WDI_POS            FDCAN_IR_WDI_Pos // Watchdog Interrupt (20)
+#define FDCAN_IR_PEA_POS            FDCAN_IR_PEA_Pos // Protocol Error in Arbitration Phase (21)
+#define FDCAN_IR_PED_POS            FDCAN_IR_PED_Pos // Protocol Error in Data Phase (22)
+#define FDCAN_IR_ARA_POS            FDCAN_IR_ARA_Pos // Access to Reserved Address (23)
+
+// FDCAN Timestamp / Timeout Counter Bit Positions
+#define FDCAN_TSCC_TSS_POS          0     // Timestamp Select bit position
+#define FDCAN_TSCC_TCP_POS          16    // Timestamp Counter Prescaler bit position
+#define FDCAN_TOCC_ETOC_POS         0     // Enable Timeout Counter bit position
+#define FDCAN_TOCC_TOS_POS          1     // Timeout Select bit position
+#define FDCAN_TOCC_TOP_POS          16    // Timeout Period bit position
+#define FDCAN_TSS_INTERNAL          0x1   // Timestamp incremented according to TCP
+#define FDCAN_TOS_RXFIFO0           0x2   // Timeout controlled by RX FIFO 0
+
+// FDCAN TX Event FIFO Bit Positions
+#define FDCAN_TXEFS_EFFL_POS        0     // Event FIFO fill level (3 bits)
+#define FDCAN_TXEFS_EFGI_POS        8     // Event FIFO get index (2 bits)
+#define FDCAN_ELEM_TXTS_MASK        0xFFFFU // TX event: timestamp (16 bits)
+
+// FDCAN RX Interrupt Moderation Definitions
+#define FDCAN_RX_IRQ_PER_FRAME      0     // RF0N: one interrupt per received frame
+#define FDCAN_RX_IRQ_COALESCE       1     // RF0F + TOO: one interrupt per full FIFO or latency budget
+#define FDCAN_RX_IRQ_POLL           2     // No RX interrupt, FDCAN_RX_POLL drains the FIFO
+#define FDCAN_RX_IRQ_ADAPTIVE       3     // RF0N until a burst is seen, then poll until drained
+#define FDCAN_RX_POLL_BUDGET        8     // Max frames handled per FDCAN_RX_POLL call
 
 // FDCAN Frame Type Definitions
 #define FDCAN_FRAME_CLASSIC         0     // Classic CAN frame
@@ -309,7 +347,17 @@
 #define FDCAN_ENABLE_INTERNAL_LOOPBACK(fdcan) do { \
     SET_BIT_FIELD((fdcan)->CCCR, FDCAN_CCCR_TEST_POS); \
     SET_BIT_FIELD((fdcan)->TEST, FDCAN_TEST_LBCK_POS); \
-    SET_BIT_FIELD((fdcan)->TEST, FDCAN_CCCR_MON_POS); \
+    SET_BIT_FIELD((fdcan)->CCCR, FDCAN_CCCR_MON_POS); \
+} while(0)
+
+// Enable FDCAN Bus monitoring mode
+#define FDCAN_ENABLE_BUS_MONITORING(fdcan) do { \
+    SET_BIT_FIELD((fdcan)->CCCR, FDCAN_CCCR_MON_POS); \
+} while(0)
+
+// Enable FDCAN Restricted operation mode
+#define FDCAN_ENABLE_RESTRICTED_MODE(fdcan) do { \
+    SET_BIT_FIELD((fdcan)->CCCR, FDCAN_CCCR_ASM_POS); \
 } while(0)
 
 // Enable FDCAN FD mode
@@ -400,6 +448,9 @@
 // *** TIM2 *** //
 #define TIM2_BASE_ADDR           (0x40000000UL)
 
+// *** CRC *** //
+#define CRC_BASE_ADDR      (0x40023000UL)
+
 // *** GPIO A FOR PA11 (FDCAN1_RX) & PA12 (FDCAN2_TX) *** //
 #define GPIOA_BASE_ADDR (0x42020000)
 
@@ -417,6 +468,8 @@
 #define NVIC_ISPR0_t (0XE000E200)
 #define NVIC_ICPR0_t (0XE000E280)
 #define FDCAN1_IT0_IRQ_t 39
+#define TIM2_IRQ_t 45
+#define FLASH_IRQ_t 6
 #define I2C2_EV_IRQ_t 53
 
 volatile uint32_t *NVIC_ISER0_p = (volatile uint32_t*) NVIC_ISER0_ADDR;
@@ -461,6 +514,110 @@ volatile uint8_t data_to_send;
 /* Read a specific bit field from a register using a mask */
 #define READ_BIT_FIELD(reg, bit, mask) (((reg) >> (bit)) & (mask))
 
+/***** Register Field Macros *****/
+/*
+ * A register field is described once by its mask, built at compile time with
+ * FIELD_MASK(lsb, width). Values for several fields of the same register are
+ * OR-ed together and applied with a single REG_MODIFY (one read, one write)
+ * or REG_WRITE (one write), instead of one volatile read-modify-write per
+ * field with SET_VAL_BIT/CLEAR_VAL_BIT.
+ *
+ * FIELD_CONST rejects at compile time a constant that does not fit its
+ * field; FIELD_PREP is for run-time values and truncates to the field width.
+ */
+#define FIELD_MASK(lsb, width) ((uint32_t) ((((1ULL << (width)) - 1ULL)) << (lsb)))
+#define FIELD_LSB(mask) (__builtin_ctz(mask))
+
+/* Shift a run-time value into a field */
+#define FIELD_PREP(mask, val) ((((uint32_t) (val)) << FIELD_LSB(mask)) & (mask))
+
+/* Shift a constant into a field, failing the build if it is too wide */
+#define FIELD_CONST(mask, val) (__extension__ ({ \
+    _Static_assert((((uint32_t) (val)) & ~((mask) >> FIELD_LSB(mask))) == 0, \
+            "value does not fit in register field"); \
+    FIELD_PREP(mask, val); }))
+
+/* Replace the fields in 'mask' with 'bits' in one read and one write */
+#define REG_MODIFY(reg, mask, bits) ((reg) = (((reg) & ~(mask)) | (bits)))
+
+/* Write a whole register built from fields in one store */
+#define REG_WRITE(reg, bits) ((reg) = (bits))
+
+/***** Register Field Definitions *****/
+#define FLASH_ACR_LATENCY_FLD       FIELD_MASK(0, 4)   // Read latency (wait states)
+#define FLASH_ACR_WRHIGHFREQ_FLD    FIELD_MASK(4, 2)   // Signal delay
+#define FLASH_CR_SNB_FLD            FIELD_MASK(6, 7)   // Sector to erase, within the bank
+
+#define RCC_CR_HSION_FLD            FIELD_MASK(0, 1)   // HSI enable
+#define RCC_CR_HSIDIV_FLD           FIELD_MASK(3, 2)   // HSI divider
+#define RCC_PLL1CFGR_SRC_FLD        FIELD_MASK(0, 2)   // PLL1 source (01: HSI)
+#define RCC_PLL1CFGR_RGE_FLD        FIELD_MASK(2, 2)   // PLL1 input range
+#define RCC_PLL1CFGR_FRACEN_FLD     FIELD_MASK(4, 1)   // Fractional latch enable
+#define RCC_PLL1CFGR_VCOSEL_FLD     FIELD_MASK(5, 1)   // VCO range
+#define RCC_PLL1CFGR_M_FLD          FIELD_MASK(8, 6)   // PLL1M prescaler
+#define RCC_PLL1CFGR_PEN_FLD        FIELD_MASK(16, 1)  // PLL1P output enable
+#define RCC_PLL1CFGR_QEN_FLD        FIELD_MASK(17, 1)  // PLL1Q output enable
+#define RCC_PLL1CFGR_REN_FLD        FIELD_MASK(18, 1)  // PLL1R output enable
+#define RCC_PLL1DIVR_N_FLD          FIELD_MASK(0, 9)   // PLL1N multiplier - 1
+#define RCC_PLL1DIVR_P_FLD          FIELD_MASK(9, 7)   // PLL1P divider - 1
+#define RCC_PLL1DIVR_Q_FLD          FIELD_MASK(16, 7)  // PLL1Q divider - 1
+#define RCC_PLL1DIVR_R_FLD          FIELD_MASK(24, 7)  // PLL1R divider - 1
+#define RCC_PLL1FRACR_FRACN_FLD     FIELD_MASK(3, 13)  // Fractional part of N
+#define RCC_CFGR2_PRESC_FLD         (FIELD_MASK(0, 1) | FIELD_MASK(4, 1) \
+        | FIELD_MASK(8, 1) | FIELD_MASK(12, 1))       // HPRE/PPRE1/2/3 bit 0
+#define RCC_CFGR2_CLKDIS_FLD        (FIELD_MASK(16, 2) | FIELD_MASK(20, 3)) // AHBx/APBx clock disable
+
+#define FDCAN_RXGFC_LSS_FLD         FIELD_MASK(16, 5)  // Standard filter list size
+#define FDCAN_RXGFC_LSE_FLD         FIELD_MASK(24, 4)  // Extended filter list size
+#define FDCAN_RXGFC_ANFS_FLD        FIELD_MASK(4, 2)   // Non-matching standard frames
+#define FDCAN_NBTP_NTSEG2_FLD       FIELD_MASK(0, 7)   // Nominal time segment 2 - 1
+#define FDCAN_NBTP_NTSEG1_FLD       FIELD_MASK(8, 8)   // Nominal time segment 1 - 1
+#define FDCAN_NBTP_NBRP_FLD         FIELD_MASK(16, 9)  // Nominal prescaler - 1
+#define FDCAN_NBTP_NSJW_FLD         FIELD_MASK(25, 7)  // Nominal sync jump width - 1
+
+#define I2C_CR1_DNF_FLD             FIELD_MASK(8, 4)   // Digital noise filter
+#define I2C_CR1_ANFOFF_FLD          FIELD_MASK(12, 1)  // Analog noise filter off
+#define I2C_CR2_SADD_FLD            FIELD_MASK(1, 7)   // 7-bit target address
+#define I2C_CR2_RD_WRN_FLD          FIELD_MASK(10, 1)  // Transfer direction
+#define I2C_CR2_ADD10_FLD           FIELD_MASK(11, 1)  // 10-bit addressing
+#define I2C_CR2_NBYTES_FLD          FIELD_MASK(16, 8)  // Number of bytes
+#define I2C_CR2_AUTOEND_FLD         FIELD_MASK(25, 1)  // Automatic end mode
+#define I2C_TIMINGR_SCLL_FLD        FIELD_MASK(0, 8)   // SCL low period
+#define I2C_TIMINGR_SCLH_FLD        FIELD_MASK(8, 8)   // SCL high period
+#define I2C_TIMINGR_SDADEL_FLD      FIELD_MASK(16, 4)  // Data hold time
+#define I2C_TIMINGR_SCLDEL_FLD      FIELD_MASK(20, 4)  // Data setup time
+#define I2C_TIMINGR_PRESC_FLD       FIELD_MASK(28, 4)  // Timing prescaler
+
+/***** RAM Execution Option *****/
+/*
+ * FDCAN_RAM_EXEC = 1 places the FDCAN ISR, the RX/TX hot path and the vector
+ * table in SRAM. Flash runs at 5 wait states behind ICACHE, so a cache miss
+ * on interrupt entry costs several cycles per fetch; from SRAM every fetch is
+ * zero wait state and the ISR timing no longer depends on cache contents.
+ * Costs ~1 KB of RAM for the vector table plus the size of the moved code.
+ */
+#ifndef FDCAN_RAM_EXEC
+#define FDCAN_RAM_EXEC 0
+#endif
+
+#if FDCAN_RAM_EXEC
+/* Collected into .data by the linker script, copied to SRAM at startup */
+#define FDCAN_RAMFUNC __attribute__((section(".RamFunc"), noinline))
+#else
+#define FDCAN_RAMFUNC
+#endif
+
+/***** Cycle Counter Macros (DWT) *****/
+/* Start the core cycle counter used for instrumentation */
+#define CYCLE_COUNTER_INIT() do { \
+    DCB->DEMCR |= DCB_DEMCR_TRCENA_Msk; \
+    DWT->CYCCNT = 0; \
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk; \
+} while(0)
+
+/* Read the current core cycle count */
+#define CYCLE_COUNTER_READ() (DWT->CYCCNT)
+
 /***** FDCAN ID Type Definitions *****/
 #define FDCAN_STANDARD_ID ((uint32_t)0x00000000U)  // 11-bit standard ID format
 #define FDCAN_EXTENDED_ID ((uint32_t)0x40000000U)  // 29-bit extended ID format
@@ -620,15 +777,46 @@ typedef struct {
 /***** FLASH Register Structure *****/
 typedef struct {
 	volatile uint32_t ACR;             // Access Control Register
+	volatile uint32_t NSKEYR;          // Non-secure Key Register
+	uint32_t RESERVED1;
+	volatile uint32_t OPTKEYR;         // Option Key Register
+	uint32_t RESERVED2[2];
+	volatile uint32_t OPSR;            // Operation Status Register
+	volatile uint32_t OPTCR;           // Option Control Register
+	volatile uint32_t NSSR;            // Non-secure Status Register
+	uint32_t RESERVED3;
+	volatile uint32_t NSCR;            // Non-secure Control Register
+	uint32_t RESERVED4;
+	volatile uint32_t NSCCR;           // Non-secure Clear Control Register
+	uint32_t RESERVED5[7];
+	volatile uint32_t OPTSR_CUR;       // Option Status Register, current
 // Add other FLASH registers as needed
 } FLASH_TypeDef_t;
 
 /***** ICACHE Register Structure *****/
 typedef struct {
 	volatile uint32_t CR;              // Control Register
-// Add other ICACHE registers as needed
+	volatile uint32_t SR;              // Status Register
+	volatile uint32_t IER;             // Interrupt Enable Register
+	volatile uint32_t FCR;             // Flag Clear Register
+	volatile uint32_t HMONR;           // Hit Monitor Register
+	volatile uint32_t MMONR;        // Miss Monitor Register (16 bits, saturates)
 } ICACHE_TypeDef_t;
 
+/***** ICACHE Region Statistics *****/
+typedef struct {
+	const char *Name;                  // Region name used in the report
+	uint32_t Runs;                     // Times the region was executed
+	uint32_t Hits;                     // Accumulated cache hits
+	uint32_t Misses;                   // Accumulated cache misses
+} ICACHE_RegionStats_t;
+
+/***** ICACHE Monitor Snapshot *****/
+typedef struct {
+	uint32_t Hits;
+	uint32_t Misses;
+} ICACHE_Snapshot_t;
+
 /**
  * @brief I2C Register Structure for STM32H503
  * @note All registers are volatile to prevent compiler optimization
@@ -679,6 +867,18 @@ typedef struct {
 	volatile uint32_t DMAR; /*!< TIM DMA address for full transfer,          Address offset: 0x3E0 */
 } TIM_TypeDef_t;
 
+/**
+ * @brief CRC Calculation Unit Register Structure for STM32H503
+ */
+typedef struct {
+	volatile uint32_t DR; /*!< CRC Data register,                          Address offset: 0x00 */
+	volatile uint32_t IDR; /*!< CRC Independent data register,              Address offset: 0x04 */
+	volatile uint32_t CR; /*!< CRC Control register,                       Address offset: 0x08 */
+	volatile uint32_t RESERVED; /*!< Reserved,                                   Address offset: 0x0C */
+	volatile uint32_t INIT; /*!< CRC Initial value register,                 Address offset: 0x10 */
+	volatile uint32_t POL; /*!< CRC Polynomial register,                    Address offset: 0x14 */
+} CRC_TypeDef_t;
+
 /***** Base addresses as pointer instances for peripheral access *****/
 #define RCC_t             ((RCC_TypeDef_t *) RCC_BASE_ADDR)
 #define PWR_t             ((PWR_TypeDef_t *) PWR_BASE_ADDR)
@@ -690,14 +890,384 @@ typedef struct {
 #define ICACHE_t          ((ICACHE_TypeDef_t *) ICACHE_BASE_ADDR)
 #define I2C2_t              ((I2C_TypeDef_t *) I2C2_BASE_ADDR)
 #define TIM2_t                  ((TIM_TypeDef_t *) TIM2_BASE)
+#define CRC_t             ((CRC_TypeDef_t *) CRC_BASE_ADDR)
 
 /***** Clock Enable Macros *****/
 #define GPIOA_CLK_EN()    (SET_BIT_FIELD(RCC->AHB2ENR, 0))   // Enable GPIOA clock
 #define GPIOB_CLK_EN()    (SET_BIT_FIELD(RCC->AHB2ENR, 1))   // Enable GPIOB clock
 #define GPIOC_CLK_EN()    (SET_BIT_FIELD(RCC->AHB2ENR, 2))   // Enable GPIOC clock
 #define ICACHE_EN()       (SET_BIT_FIELD(ICACHE_t->CR, 0))   // Enable Instruction Cache
+
+/***** ICACHE Monitor Bit Positions *****/
+#define ICACHE_CR_CACHEINV_POS      1     // Invalidate the whole cache
+#define ICACHE_SR_BUSYF_POS         0     // Invalidation running
+#define ICACHE_CR_HITMEN_POS        16    // Hit monitor enable
+#define ICACHE_CR_MISSMEN_POS       17    // Miss monitor enable
+#define ICACHE_CR_HITMRST_POS       18    // Hit monitor reset
+#define ICACHE_CR_MISSMRST_POS      19    // Miss monitor reset
+
+/* ICACHE_PROFILE = 1 brackets the FDCAN ISR and the main loop with the
+ * cache hit/miss monitors and prints them every ICACHE_REPORT_PERIOD passes */
+#ifndef ICACHE_PROFILE
+#define ICACHE_PROFILE 0
+#endif
+
+#define ICACHE_REPORT_PERIOD        50    // Main loop passes between reports
+
+/***** Boot Sequence Options *****/
+/*
+ * FAST_BOOT = 1 brings FDCAN up right after the clock and CAN pins, before
+ * the timer, I2C and LCD, so the node is on the bus within about a
+ * millisecond of reset. The LCD then initializes in the background from the
+ * main loop and delayMS, driven by deadlines instead of blocking delays.
+ * FAST_BOOT = 0 keeps the original order (LCD splash first, CAN last).
+ */
+#ifndef FAST_BOOT
+#define FAST_BOOT 1
+#endif
+
+/* Record boot-phase timestamps and report them once boot has completed */
+#ifndef BOOT_PROFILE
+#define BOOT_PROFILE 1
+#endif
+
+/* Time-to-first-frame budget checked by BOOT_REPORT, in microseconds */
+#ifndef BOOT_TTFF_BUDGET_US
+#define BOOT_TTFF_BUDGET_US         1000U
+#endif
+
+#define BOOT_RESET_CLOCK_MHZ        32U   // HSI / 2 out of reset, until SYSTEM_CLOCK_CONFIG
+#define BOOT_SYSCLK_MHZ             250U  // Core clock once PLL1 is selected
+
+/***** Boot Phases (index into bootPhaseCycles) *****/
+#define BOOT_PHASE_CLOCK            0     // System clock switched to PLL1
+#define BOOT_PHASE_CAN_PINS         1     // FDCAN GPIOs configured
+#define BOOT_PHASE_FDCAN            2     // FDCAN out of init mode, on the bus
+#define BOOT_PHASE_TIMER            3     // TIM2 delay timebase running
+#define BOOT_PHASE_LCD              4     // LCD initialized and splash done
+#define BOOT_PHASE_FIRST_TX         5     // First frame queued for transmission
+#define BOOT_PHASE_FIRST_RX         6     // First frame received
+#define BOOT_PHASE_COUNT            7
+
+/***** LCD Background Init States *****/
+#define LCD_BG_RESET                0     // Dummy I2C transaction, wait > 15 ms
+#define LCD_BG_WAKE1                1     // First 0x3, wait > 4.1 ms
+#define LCD_BG_WAKE2                2     // Second 0x3, wait > 100 us
+#define LCD_BG_CONFIG               3     // 4-bit mode, function set, display on, clear
+#define LCD_BG_SPLASH               4     // Entry mode and splash text, hold 1 s
+#define LCD_BG_CLEAR                5     // Clear the splash
+#define LCD_BG_READY                6     // LCD usable from the main loop
+
+/***** ISO-TP Loopback Benchmark *****/
+/* ISOTP_BENCH = 1 runs ISOTP_BENCHMARK once at boot: FDCAN is switched to
+ * internal loopback and one message is sent for every TX_DL/BS/STmin setting */
+#ifndef ISOTP_BENCH
+#define ISOTP_BENCH 0
+#endif
+
+#define ISOTP_BENCH_SIZE            4096U // Bytes per message, needs the 32-bit FF_DL
+#define ISOTP_BENCH_TIMEOUT_MS      3000U // Per run
+#define ISOTP_BENCH_TX_ID           0x7E0U
+#define ISOTP_BENCH_RX_ID           0x7E8U
+
+/***** RX Mode Load Benchmark *****/
+/* RX_LOAD_BENCH = 1 runs RX_LOAD_BENCHMARK once at boot: FDCAN is switched to
+ * internal loopback and frames are sent at each rate of a sweep, once per RX
+ * mode (interrupt, poll, adaptive), reporting FDCAN_RX_LOAD_PERMILLE */
+#ifndef RX_LOAD_BENCH
+#define RX_LOAD_BENCH 0
+#endif
+
+#define RX_LOAD_BENCH_MS            500U  // Measurement window per mode and rate
+#define RX_LOAD_BENCH_ID            0x125U
+
+/***** J1939 Node *****/
+/* J1939_ENABLE = 1 accepts every 29-bit frame into RX FIFO 0 and hands it to
+ * the J1939 node; 11-bit frames keep going through CAN1_Rx */
+#ifndef J1939_ENABLE
+#define J1939_ENABLE 0
+#endif
+
+#ifndef J1939_NODE_NAME
+#define J1939_NODE_NAME             0x8000000000000001ULL // Arbitrary address capable
+#endif
+#ifndef J1939_NODE_ADDRESS
+#define J1939_NODE_ADDRESS          0x80U
+#endif
+
+/***** Periodic TX Scheduler *****/
+/* TX_SCHED = 1 releases the frames added by USER_TX_SCHED_CONFIG from TIM2
+ * compare channel 1; TX_SCHED = 0 sends USER_CAN_TX once per main loop pass */
+#ifndef TX_SCHED
+#define TX_SCHED 1
+#endif
+
+/* TX_SCHED_VEHICLE = 1 adds demo frames of Tools/vehicle.dbc to the "Hi"
+ * frame: EngineData every 10 ms, BrakeStatus every 20 ms and Heartbeat every
+ * 100 ms. Their signals are fixed demo values, not measurements, so they
+ * stay off unless a bench or test bus wants the traffic. */
+#ifndef TX_SCHED_VEHICLE
+#define TX_SCHED_VEHICLE 0
+#endif
+
+#define TX_SCHED_MAX_ENTRIES        8U
+#define TX_SCHED_AUTO_OFFSET        0xFFFFFFFFU // Let TX_SCHED_START pick the offset
+#define TX_SCHED_SLOT_US            250U  // Offset search step, one classic frame at 500 kbit/s
+#define TX_SCHED_REPORT_PERIOD      25    // Main loop passes between jitter reports
+
+/* TX_SCHED_LOCK saved state: interrupts it found enabled and masked */
+#define TX_LOCK_TIM2_POS            0     // TIM2: scheduler, XCP DAQ, rate limiter
+#define TX_LOCK_FDCAN_POS           1     // FDCAN1 IT0: XCP, UDS, J1939, time sync, TX_LATEST
+#define TX_LOCK_FLASH_POS           2     // Flash: FW_UPDATE answers
+
+/* TX_LATEST = 1 gives scheduled frames latest-value semantics: a release
+ * whose previous frame is still pending in the TX FIFO cancels it and
+ * queues the new payload, instead of being dropped behind it. With the FIFO
+ * full the new payload waits for the TCF interrupt of the cancel. */
+#ifndef TX_LATEST
+#define TX_LATEST 0
+#endif
+
+/* TX_ON_CHANGE = 1 sends the node's frames only when their payload changed
+ * beyond the deadbands of txChangeEntries, or once per refresh period */
+#ifndef TX_ON_CHANGE
+#define TX_ON_CHANGE 0
+#endif
+#define TX_ON_CHANGE_REFRESH_MS     1000U // Heartbeat of unchanged frames, below 17 s
+
+/* TX_RATE_LIMIT = 1 charges every frame queued through CAN1_TxFrame and
+ * CAN1_Tx to the token buckets of txRateIds and txRateClasses. Frames held
+ * back by a CANRL_QUEUE bucket leave from TIM2 compare channel 3, and from
+ * the TX FIFO empty interrupt when XCP or UDS has it enabled. */
+#ifndef TX_RATE_LIMIT
+#define TX_RATE_LIMIT 0
+#endif
+#define TX_RATE_RETRY_US            250U  // TX FIFO was full when a held frame was due
+#define TX_RATE_REPORT_PERIOD       25    // Main loop passes between reports
+
+/***** End-to-End Protection *****/
+/* E2E_ENABLE = 1 protects the frames of e2eTxChannels with an E2E profile
+ * (e2e.h) and checks those of e2eRxChannels on reception, CRCs from the CRC
+ * unit. The Heartbeat of TX_SCHED_VEHICLE gains a fourth byte for its E2E_P11
+ * CRC, and its alive counter becomes the E2E counter. E2E_BENCH = 1 runs
+ * E2E_BENCHMARK once at boot: cycles per protected and checked frame of each
+ * profile, bit by bit, with slice tables (12 KB of SRAM at E2E_SLICES 4) and
+ * on the CRC unit. */
+#ifndef E2E_ENABLE
+#define E2E_ENABLE 0
+#endif
+#ifndef E2E_BENCH
+#define E2E_BENCH 0
+#endif
+#define E2E_HEARTBEAT_LEN           4U    // Counter/State, SupplyVoltage, CRC
+#define E2E_PEER_HEARTBEAT_ID       0x301U // Heartbeat of the peer node, E2E_P11
+#define E2E_BENCH_RUNS              1000U // Frames per profile and engine
+#define E2E_REPORT_PERIOD           25    // Main loop passes between reports
+
+/***** Time Synchronization *****/
+/* TIME_SYNC = TIME_SYNC_MASTER sends SYNC and FUP (can_timesync.h) from the
+ * TX scheduler, with the start of frame time of each SYNC from the TX event
+ * FIFO. TIME_SYNC = TIME_SYNC_SLAVE takes them with their RX timestamps
+ * and keeps the master's time against its own 64-bit TIM2 clock, corrected
+ * in offset and rate. The FDCAN timestamp counter wraps after 65536 bit
+ * times (131 ms at 500 kbit/s): RX and TX events must be handled sooner, so
+ * RX FIFO 0 must not be left to a slow main loop. */
+#define TIME_SYNC_OFF               0
+#define TIME_SYNC_MASTER            1
+#define TIME_SYNC_SLAVE             2
+#ifndef TIME_SYNC
+#define TIME_SYNC TIME_SYNC_OFF
+#endif
+#if TIME_SYNC == TIME_SYNC_MASTER && !TX_SCHED
+#error "TIME_SYNC_MASTER sends SYNC from the TX scheduler"
+#endif
+
+#define TIME_SYNC_ID                0x0F0U // SYNC and FUP
+#define TIME_SYNC_DOMAIN            0
+#define TIME_SYNC_PERIOD_US         100000U
+#define TIME_SYNC_TICK_NS           (1000000U / FDCAN1_NOMINAL_KBPS) // Timestamp tick, one bit time
+#define TIME_SYNC_REPORT_PERIOD     25    // Main loop passes between reports
+
+/***** Error State Manager *****/
+/* CAN_ERR_MANAGER = 1 enables the EP/EW/BO/PEA/PED interrupts, tracks the
+ * fault confinement state and restarts the node after bus-off with the
+ * CANERR_* backoff of can_errstate.h */
+#ifndef CAN_ERR_MANAGER
+#define CAN_ERR_MANAGER 1
+#endif
+
+#define CAN_ERR_REPORT_PERIOD       25    // Main loop passes between reports
+
+/***** FDCAN1 Bit Rates *****/
+/* What the USER_FDCAN_INIT timing gives, for the modules that turn frames
+ * into bus time */
+#define FDCAN1_NOMINAL_KBPS         500U
+#define FDCAN1_DATA_KBPS            0U    // FD data phase, 0 = nominal rate
+
+/***** Bus Statistics *****/
+/* CAN_STATS = 1 feeds every frame read or queued on FDCAN1 to can_stats.c
+ * for bus load and per-ID counters. Frames rejected by the acceptance
+ * filters never reach the CPU, so the load only covers what is received. */
+#ifndef CAN_STATS
+#define CAN_STATS 1
+#endif
+
+#define CAN_STATS_BUCKET_MS         10U   // Load resolution
+#define CAN_STATS_REPORT_PERIOD     25    // Main loop passes between reports
+
+/***** Bus Sniffer *****/
+/* CAN_SNIFFER = 1 puts FDCAN1 in bus monitoring mode (listen only, no ACK,
+ * no error frames), accepts every frame and streams a can_capture.h record
+ * stream on ITM stimulus port CAN_SNIFFER_ITM_PORT. The main loop does
+ * nothing else; decode the stream with Tools/cancap_decode.c.
+ * SWO runs at CAN_SNIFFER_SWO_KBPS, set the probe to the same rate. At
+ * 2000 kbit/s the link carries 160 KB/s of capture, which covers a
+ * fully loaded bus of Classic frames up to 1 Mbit/s and of 8-byte FD frames.
+ * 64-byte FD frames fit up to 70% bus load at 2 Mbit/s data rate and 40% at
+ * 5 Mbit/s (Tools/cancap_bench.c); above that frames are dropped and the
+ * stream says how many with CANCAP_EVT_DROP. */
+#ifndef CAN_SNIFFER
+#define CAN_SNIFFER 0
+#endif
+
+#define CAN_SNIFFER_ITM_PORT        1U    // printf keeps port 0
+#define CAN_SNIFFER_REPORT_MS       1000U // Capture statistics on port 0
+#ifndef CAN_SNIFFER_SWO_KBPS
+#define CAN_SNIFFER_SWO_KBPS        2000U // NRZ, the core clock divided down
+#endif
+#if CAN_SNIFFER && (BOOT_SYSCLK_MHZ * 1000U) % CAN_SNIFFER_SWO_KBPS != 0
+#error "CAN_SNIFFER_SWO_KBPS must divide the core clock"
+#endif
+
+/***** Traffic Generator *****/
+/* CAN_TRAFFIC_GEN = 1 turns the node into a load generator for bus stress
+ * and soak tests: the streams of trafficStreams at CAN_TRAFFIC_LOAD_PERMILLE
+ * of the bus, with bursts, through can_traffic.c. Frames go straight into
+ * the TX FIFO from the TIM2 CC4 and transmission completed interrupts; the
+ * main loop only reports achieved against requested load. Like CAN_SNIFFER
+ * it replaces the rest of the application. */
+#ifndef CAN_TRAFFIC_GEN
+#define CAN_TRAFFIC_GEN 0
+#endif
+#if CAN_TRAFFIC_GEN && CAN_SNIFFER
+#error "CAN_TRAFFIC_GEN cannot transmit in the CAN_SNIFFER bus monitoring mode"
+#endif
+
+#define CAN_TRAFFIC_LOAD_PERMILLE   500U  // Target outside bursts, 1000 = line rate
+#define CAN_TRAFFIC_BURST_PERMILLE  1000U // Target during bursts
+#define CAN_TRAFFIC_BURST_PERIOD_US 1000000U // 0 = no bursts
+#define CAN_TRAFFIC_BURST_US        100000U
+#define CAN_TRAFFIC_FD_PERMILLE     (FDCAN1_DATA_KBPS ? 300U : 0U) // Fill frames sent as FD
+#define CAN_TRAFFIC_BRS_PERMILLE    500U  // FD frames with bit rate switch
+#define CAN_TRAFFIC_RETRY_US        1000U // No TX done for this long: poll anyway
+#define CAN_TRAFFIC_REPORT_MS       1000U
+
+/***** Trace Replay *****/
+/* CAN_REPLAY = 1 feeds a recorded log through the RX path of the running
+ * application: frames go through the acceptance filters configured in
+ * message RAM, an RX FIFO model of SRAMCAN_RF0_NBR elements, and then the
+ * same hooks and handlers as frames read from RX FIFO 0, with the header and
+ * receivedData filled in as CAN1_Rx does. It is served next to
+ * FDCAN_RX_POLL in the main loop and delayMS, as a polled RX FIFO would be,
+ * and reports frames lost to overruns and the cycles spent per frame. The
+ * log is a candump -L text or a CAN_SNIFFER capture, in flash or RAM. */
+#ifndef CAN_REPLAY
+#define CAN_REPLAY 0
+#endif
+#if CAN_REPLAY && (CAN_SNIFFER || CAN_TRAFFIC_GEN)
+#error "CAN_REPLAY needs the application that CAN_SNIFFER and CAN_TRAFFIC_GEN replace"
+#endif
+
+#define CAN_REPLAY_IMAGE_ADDR       0U    // Log in flash or RAM, 0 = canReplayDemo
+#define CAN_REPLAY_IMAGE_BYTES      0x8000U // Candump text also ends at erased flash
+#define CAN_REPLAY_INTERFACE        NULL  // Candump interface to replay, NULL = all
+#define CAN_REPLAY_MODE             CANRP_AS_RECORDED // CANRP_SCALED, CANRP_FAST
+#define CAN_REPLAY_SCALE_PERMILLE   1000U // CANRP_SCALED: 2000 = twice as fast
+#define CAN_REPLAY_BUDGET           FDCAN_RX_POLL_BUDGET // Frames per call
+#define CAN_REPLAY_FAST_BUDGET      64U   // CANRP_FAST: frames per call
+#define CAN_REPLAY_REPORT_PERIOD    25    // Main loop passes between reports
+
+/***** XCP Slave *****/
+/* XCP_ENABLE = 1 runs an XCP on CAN slave: the master uploads and downloads
+ * SRAM and the calibration block userCal, and samples DAQ lists on the
+ * 1/10/100 ms event channels of TIM2 CC2. DAQ packets leave from the TIM2
+ * and TX FIFO empty interrupts, never from the main loop. */
+#ifndef XCP_ENABLE
+#define XCP_ENABLE 0
+#endif
+
+#define XCP_CRO_ID                  0x7F0U // Master to slave
+#define XCP_DTO_ID                  0x7F1U // Slave to master
+#define XCP_DAQ_TICK_US             1000U // TIM2 CC2 period, the fastest event
+#define XCP_REPORT_PERIOD           25    // Main loop passes between reports
+
+/***** UDS Server *****/
+/* UDS_ENABLE = 1 runs a UDS (ISO 14229) server on UDS_RX_ID/UDS_TX_ID.
+ * Requests are served from the FDCAN interrupt as their last frame arrives;
+ * hooks answering NRC 0x78 continue from the main loop. UDS_BENCH = 1 runs
+ * UDS_BENCHMARK once at boot: tester and server in FDCAN internal loopback,
+ * round trip time per service and download throughput. */
+#ifndef UDS_ENABLE
+#define UDS_ENABLE 0
+#endif
+#ifndef UDS_BENCH
+#define UDS_BENCH 0
+#endif
+
+#define UDS_RX_ID                   0x7E0U // Physical requests from the tester
+#define UDS_TX_ID                   0x7E8U // Responses
+#define UDS_REPORT_PERIOD           25    // Main loop passes between reports
+#define UDS_BENCH_RUNS              50U   // Requests per service
+#define UDS_BENCH_DOWNLOAD          16384U // Bytes sent with TransferData
+#define UDS_BENCH_TIMEOUT_MS        1000U // Per request
+
+/***** Firmware Update *****/
+/* FW_UPDATE = 1 sends UDS downloads to the inactive flash bank through
+ * fw_update.c: each TransferData block fills one RAM buffer while the one
+ * before is programmed from the flash interrupt, so the update takes about
+ * the bus time. RoutineControl FF02 compares the CRC-32 read back from
+ * flash with the tester's. Switching to the new bank is left to the tester
+ * (option bytes), it is not done here. */
+#ifndef FW_UPDATE
+#define FW_UPDATE 0
+#endif
+#if FW_UPDATE && !UDS_ENABLE
+#error "FW_UPDATE needs UDS_ENABLE"
+#endif
+
+#define FW_UPDATE_REGION_ADDR       0x08010000U // Inactive bank, whichever is mapped there
+#define FW_UPDATE_REGION_BYTES      0x10000U // One bank of 64 KB
+#define FW_UPDATE_SECTOR_BYTES      0x2000U  // 8 KB
+#define FW_UPDATE_KEY1              0x45670123U // NSKEYR unlock sequence
+#define FW_UPDATE_KEY2              0xCDEF89ABU
+
+#define FLASH_SR_EOP_POS            16    // End of operation
+#define FLASH_SR_ERRORS             (0xFUL << 17 | 1UL << 23) // WRPERR to INCERR, OPTCHANGEERR
+#define FLASH_CR_LOCK_POS           0
+#define FLASH_CR_PG_POS             1     // Program
+#define FLASH_CR_SER_POS            2     // Sector erase
+#define FLASH_CR_START_POS          5
+#define FLASH_CR_EOPIE_POS          16
+#define FLASH_CR_ERRIE              (0xFUL << 17 | 1UL << 23) // Error interrupts, as FLASH_SR_ERRORS
+#define FLASH_CR_BKSEL_POS          31    // Bank 2 when set
+#define FLASH_OPTSR_SWAP_BANK_POS   31    // Banks swapped
+
+#define TIM_SR_CC1IF_POS            1
+#define TIM_SR_CC2IF_POS            2
+#define TIM_DIER_CC1IE_POS          1
+#define TIM_DIER_CC2IE_POS          2
+#define TIM_SR_CC3IF_POS            3
+#define TIM_DIER_CC3IE_POS          3
+#define TIM_SR_CC4IF_POS            4
+#define TIM_DIER_CC4IE_POS          4
+#define TIM_EGR_CC1G_POS            1     // Software capture/compare 1 event
+#define CRC_CR_RESET_POS            0     // Load INIT into the data register
+#define CRC_CR_POLYSIZE_POS         3     // 0 = 32, 1 = 16, 2 = 8, 3 = 7 bits
+#define CRC_CR_REV_IN_POS           5     // 1 = bit order reversed by byte
+#define CRC_CR_REV_OUT_POS          7
 #define FDCAN1_CLK_EN()   (SET_BIT_FIELD(RCC_t->APB1HENR, 9)) // Enable FDCAN1 clock
 #define I2C2_CLK_EN() (SET_BIT_FIELD(RCC_t->APB1LENR, 22)) // Enable I2C2 clock
+#define CRC_CLK_EN()  (SET_BIT_FIELD(RCC_t->AHB1ENR, 12)) // Enable CRC unit clock
 
 /***** GPIO Pin Control Macros *****/
 /* Create a pin mask for specified pin number */
@@ -728,8 +1298,30 @@ typedef struct {
 	uint32_t FrameFormat;              // Frame format (classic/FD)
 	uint8_t StdFiltersNbr; // Specifies the number of standard Message ID filters
 	uint8_t ExtFiltersNbr; // Specifies the number of Extended Message ID filters
+	uint8_t TimestampPrescaler;   // Bit times per timestamp/timeout tick (1-16)
+	uint8_t RxIrqMode;            // RX interrupt moderation (per frame/coalesce)
+	uint16_t RxIrqTimeout; // Coalesce latency budget in timestamp ticks (TOP)
+	uint8_t RxBurstFrames; // Adaptive: back-to-back interrupts that switch to polling
+	uint16_t RxBurstGap; // Adaptive: max ticks between interrupts counted as a burst
+	volatile uint8_t RxPolling;        // Adaptive: 1 while RF0N is masked
+	uint8_t RxBurstCount;              // Adaptive: current burst length
+	uint16_t RxLastIrqTime;            // Adaptive: timestamp of last RX interrupt
 } FDCAN_Handle_Typedef_t;
 
+/***** FDCAN RX Interrupt Statistics *****/
+typedef struct {
+	volatile uint32_t IsrCount;        // ISR entries that serviced RX FIFO 0
+	volatile uint32_t FrameCount;      // Frames handed to USER_CAN_RX
+	volatile uint32_t LostCount;       // RF0L events (RX FIFO 0 overrun)
+	volatile uint32_t LatencyMax; // Worst RX timestamp to frame handled, in timestamp ticks
+	volatile uint32_t LatencySum;      // Latency sum, divide by FrameCount for mean
+	volatile uint32_t PollCount;       // FDCAN_RX_POLL calls that handled frames
+	volatile uint32_t PollSwitchCount; // Adaptive: interrupt to polling switches
+	volatile uint32_t RxCycles;        // Core cycles spent handling RX (ISR + poll)
+	volatile uint32_t EntryCyclesMin; // Fastest ISR entry to frame copied out of message RAM
+	volatile uint32_t EntryCyclesMax; // Slowest, (max - min) is the jitter
+} FDCAN_RxIrqStats_t;
+
 typedef struct {
 	uint32_t IdType; /*!< Specifies the identifier type.
 	 This parameter can be a value of @ref FDCAN_id_type       */
@@ -759,6 +1351,35 @@ typedef struct {
 
 } FDCAN_FilterTypeDef_t;
 
+/* Refresh the payload of a scheduled frame, called right after its release */
+typedef void (*TX_SchedUpdate_t)(FDCAN_FrameTypeDef_t *pFrame);
+
+typedef struct {
+	FDCAN_FrameTypeDef_t Frame;        // Prebuilt, copied to the TX FIFO on release
+	uint32_t PeriodUs;
+	uint32_t OffsetUs;                 // Phase within the period
+	TX_SchedUpdate_t Update;           // Optional
+	volatile uint32_t NextRelease;     // TIM2 count of the next release
+
+	/* Release statistics */
+	volatile uint32_t Releases;
+	volatile uint32_t Dropped;         // TX FIFO full at release time
+	volatile uint32_t Replaced;        // Cancel of the pending older frame requested, TX_LATEST
+	volatile uint32_t Suppressed;      // Payload unchanged, TX_ON_CHANGE
+	volatile uint32_t Skipped;         // Periods missed entirely
+	volatile uint32_t LastCycles;      // Cycle counter at the previous release
+	volatile uint32_t LastRelease;     // TIM2 count the previous release was due
+	volatile int32_t DevMinCycles;     // Period error, min and max: jitter is the spread
+	volatile int32_t DevMaxCycles;
+	volatile uint32_t LateMaxUs;       // Worst release after the compare time
+} TX_SchedEntryTypeDef_t;
+
+/* Frame identifier bound to an E2E channel */
+typedef struct {
+	uint32_t Id;                       // Standard identifier
+	E2E_ChannelTypeDef_t Channel;
+} E2E_NodeChannelTypeDef_t;
+
 typedef struct {
 	uint8_t ErrorStateIndicator;
 	uint8_t DataLength;
@@ -824,6 +1445,12 @@ void CAN1_Tx(FDCAN_Handle_Typedef_t *hFDCAN, FDCAN_TxHeaderTypeDef_t *hTXHeader,
 		uint8_t *pTXData); // Transmit CAN message
 void CAN1_Rx(FDCAN_Handle_Typedef_t *hFDCAN, FDCAN_RX_HEADER *hRXHeader,
 		uint8_t *receivedData); // Receive CAN message
+uint8_t CAN1_TxFrame(FDCAN_Handle_Typedef_t *hFDCAN,
+		const FDCAN_FrameTypeDef_t *pFrame); // Transmit compact frame
+uint8_t CAN1_RxFrame(FDCAN_Handle_Typedef_t *hFDCAN,
+		FDCAN_FrameTypeDef_t *pFrame); // Receive compact frame
+void CAN1_RX_DECODE(const FDCAN_FrameTypeDef_t *pFrame,
+		FDCAN_RX_HEADER *hRXHeader, uint8_t *receivedData); // Unpack for CAN1_Rx
 void SYSTEM_CLOCK_CONFIG(void);        // Configure system clock
 void GPIO_INIT_t(GPIO_Handle_Typedef_t *hGPIOx); // Initialize GPIO pin
 void GPIO_OUTPUT_t(GPIO_TypeDef_t *GPIOx, uint8_t pin, uint8_t val); // Set GPIO output
@@ -832,6 +1459,74 @@ void USER_GPIOA_INIT(void);            // Initialize GPIOA pins for FDCAN
 void USER_GPIOB_INIT(void);           // Initialize GPIOB pins for External LEDS
 void USER_GPIOC_INIT(void);            // Initialize GPIOC pins for LED
 void FDCAN_INIT(FDCAN_Handle_Typedef_t *hfdCAN1_Handle_t); // Initialize FDCAN peripheral
+void FDCAN_CONFIG_RX_INTERRUPTS(FDCAN_Handle_Typedef_t *hFDCAN); // Enable RX IRQ sources
+void VECTOR_TABLE_TO_RAM(void);        // Relocate vector table to SRAM
+void ICACHE_MONITOR_INIT(void);        // Enable ICACHE hit/miss monitors
+void ICACHE_MONITOR_RESTART(void);     // Reset monitors before they saturate
+void ICACHE_REPORT(void);              // Print per-region miss rates
+void TIM2_INIT(void);                  // Start the 1 us delay timebase
+void BOOT_FDCAN_START(void);           // Configure FDCAN and join the bus
+void BOOT_I2C_START(void);             // Configure I2C2 and its interrupts
+uint32_t BOOT_PHASE_US(uint32_t phase); // Microseconds from main to a phase
+void BOOT_REPORT(void);                // Print boot phases and time to first frame
+uint8_t LCD_BG_TASK(void);             // Step the background LCD init
+void ISOTP_BENCHMARK(void);            // ISO-TP throughput in FDCAN loopback
+void RX_LOAD_BENCHMARK(void);          // RX load per mode and frame rate in loopback
+void J1939_NODE_INIT(void);            // Start address claim of the J1939 node
+uint8_t J1939_NODE_RX(void);           // Take a 29-bit frame from RX FIFO 0
+void J1939_NODE_POLL(void);            // Claim and transport timers, ISR masked
+uint8_t TX_SCHED_ADD(const FDCAN_FrameTypeDef_t *pFrame, uint32_t periodUs,
+		uint32_t offsetUs, TX_SchedUpdate_t update); // Add a periodic frame
+void USER_TX_SCHED_CONFIG(void);       // Periodic frames of this node
+void TX_SCHED_START(void);             // Spread offsets and arm TIM2 CC1
+void TX_SCHED_REPORT(void);            // Print release jitter per message
+void TX_CHANGE_INIT(void);             // Build the send-on-change masks
+void TX_CHANGE_REPORT(void);           // Print offered and sent frames per ID
+void TX_RATE_INIT(void);               // Fill the token buckets, enable TIM2 CC3
+void TX_RATE_ARM(void);                // TIM2 CC3 at the next held frame's token
+void TX_RATE_REPORT(void);             // Print bucket counters and limiter cost
+void E2E_NODE_INIT(void);              // CRC unit clock, E2E channel state
+void E2E_NODE_PROTECT(FDCAN_FrameTypeDef_t *pFrame); // Counter and CRC of a TX channel
+void E2E_NODE_CHECK(const FDCAN_FrameTypeDef_t *pFrame); // Check an RX channel frame
+void E2E_NODE_REPORT(void);            // Print check results per channel
+void E2E_BENCHMARK(void);              // Cycles per frame of each profile and engine
+uint64_t TSYN_LOCAL_NS(void);          // 64-bit local clock from TIM2
+void TSYN_NODE_INIT(void);             // Time sync master or slave
+void TSYN_NODE_TX_EVENT(void);         // TX event FIFO: FUP of the confirmed SYNC
+void TSYN_NODE_RX(const FDCAN_FrameTypeDef_t *pFrame); // SYNC or FUP received
+void TSYN_NODE_REPORT(void);           // Print sync state and global time
+FDCAN_INLINE uint32_t TX_SCHED_LOCK(void); // Keep TX FIFO writers in interrupts out
+FDCAN_INLINE void TX_SCHED_UNLOCK(uint32_t saved);
+void CAN_ERR_INIT(void);               // Start the error state manager
+void CAN_ERR_IRQ(uint32_t flags);      // EP/EW/BO/PEA/PED from the FDCAN ISR
+void CAN_ERR_TASK(void);               // Bus-off backoff and state clocks
+void CAN_ERR_REPORT(void);             // Print error counters and state times
+void CAN_STATS_INIT(void);             // Build the wire time table, clear counters
+void CAN_STATS_REPORT(void);           // Print bus load and per-ID counters
+void CAN_SNIFFER_INIT(void);           // Start the capture stream
+uint8_t CAN_SNIFFER_RX(void);          // Capture one frame from RX FIFO 0
+void CAN_SNIFFER_TASK(void);           // Stream the capture out over ITM
+void CAN_TRAFFIC_INIT(void);           // Start the load generator
+void CAN_TRAFFIC_POLL(void);           // TIM2 CC4 or TX done: top up the TX FIFO
+void CAN_TRAFFIC_TASK(void);           // Report achieved against requested load
+void CAN_REPLAY_INIT(void);            // Open the log and clear the counters
+void CAN_REPLAY_TASK(void);            // Let due frames arrive, deliver them
+void CAN_REPLAY_REPORT(void);          // Print overruns and cycles per frame
+void XCP_NODE_INIT(void);              // Start the XCP slave and its DAQ clock
+uint8_t XCP_NODE_RX(void);             // Take an XCP command from RX FIFO 0
+void XCP_NODE_FRAME(const FDCAN_FrameTypeDef_t *pFrame); // Command to the slave
+void XCP_NODE_TICK(void);              // TIM2 CC2: sample the due event channels
+void XCP_NODE_TX_EMPTY(void);          // TX FIFO empty: send queued DAQ packets
+void XCP_NODE_REPORT(void);            // Print DAQ throughput and sampler cost
+void UDS_NODE_INIT(void);              // Start the UDS server
+uint8_t UDS_NODE_RX(void);             // Take a diagnostic request frame from RX FIFO 0
+void UDS_NODE_FRAME(const FDCAN_FrameTypeDef_t *pFrame); // Request to the server
+void UDS_NODE_POLL(void);              // Pending hooks, S3 timer, queued responses
+void UDS_NODE_TX_EMPTY(void);          // TX FIFO empty: send the next CFs
+void UDS_NODE_REPORT(void);            // Print server time per service
+void UDS_BENCHMARK(void);              // UDS round trip times in FDCAN loopback
+uint32_t FDCAN_RX_POLL(FDCAN_Handle_Typedef_t *hFDCAN, uint32_t budget); // Poll RX FIFO 0
+uint32_t FDCAN_RX_LOAD_PERMILLE(void); // RX CPU load since last call
 void USER_FDCAN_Config_Filter();
 void FDCAN_FILTER_INIT(FDCAN_FilterTypeDef_t *hFilter);
 void FDCAN_CONFIG_GLOBAL_FILTER(FDCAN_Handle_Typedef_t *hfdCan1,
@@ -849,6 +1544,7 @@ void delayMS(uint32_t ms);
 void I2C_WRITE(uint8_t addr, uint8_t data);
 void lcd_write_4_bit(uint8_t addr, uint8_t nibble, uint8_t rs, uint8_t rw);
 void lcd_send_cmd(uint8_t addr, uint8_t cmd);
+void lcd_write_cmd(uint8_t addr, uint8_t cmd);
 void print_char(uint8_t addr, uint8_t data);
 void lcd_set_cursor(uint8_t row, uint8_t column);
 void print_string(uint8_t addr, char *data);
@@ -872,8 +1568,122 @@ void lcd_clear();
 
 /***** Global Handler Instances *****/
 FDCAN_Handle_Typedef_t hfdCan1;        // FDCAN1 handler
+FDCAN_RxIrqStats_t hRxIrqStats;        // FDCAN1 RX interrupt statistics
+volatile uint32_t rxIsrEntryCycles;    // Cycle count at FDCAN ISR entry, 0 once sampled
+ICACHE_RegionStats_t icacheIsrStats = { "FDCAN ISR", 0, 0, 0 };
+ICACHE_RegionStats_t icacheMainLoopStats = { "Main loop", 0, 0, 0 };
+volatile uint32_t bootPhaseCycles[BOOT_PHASE_COUNT]; // Cycle count at each boot phase, 0 = not reached
+uint8_t lcdBgState = LCD_BG_RESET;     // LCD background init state
+uint32_t lcdBgDeadline;                // Cycle count the current LCD state waits for
+
+/**
+ * @brief  Record the cycle count the first time a boot phase is reached
+ * @note   The cycle counter is started before SYSTEM_CLOCK_CONFIG, so every
+ *         timestamp is relative to the first instruction of main
+ */
+FDCAN_INLINE void BOOT_MARK(uint32_t phase) {
+#if BOOT_PROFILE
+	if (bootPhaseCycles[phase] == 0) {
+		bootPhaseCycles[phase] = CYCLE_COUNTER_READ();
+	}
+#else
+	(void) phase;
+#endif
+}
+
+/****************************************************************************
+ * ICACHE Hit/Miss Monitoring
+ *
+ * HMONR/MMONR count every cache lookup while enabled. A region is measured
+ * as the difference between snapshots taken at its start and end, so regions
+ * may nest (the main loop region includes any ISR that preempted it).
+ ****************************************************************************/
+
+/**
+ * @brief  Snapshot the monitors at the start of a measured region
+ */
+FDCAN_INLINE ICACHE_Snapshot_t ICACHE_REGION_BEGIN(void) {
+	ICACHE_Snapshot_t snap = { 0, 0 };
+#if ICACHE_PROFILE
+	snap.Hits = ICACHE_t->HMONR;
+	snap.Misses = ICACHE_t->MMONR;
+#endif
+	return snap;
+}
+
+/**
+ * @brief  Accumulate hits/misses since 'start' into a region
+ */
+FDCAN_INLINE void ICACHE_REGION_END(ICACHE_RegionStats_t *region,
+		ICACHE_Snapshot_t start) {
+#if ICACHE_PROFILE
+	region->Hits += ICACHE_t->HMONR - start.Hits;
+	region->Misses += (ICACHE_t->MMONR - start.Misses) & 0xFFFF;
+	region->Runs++;
+#else
+	(void) region;
+	(void) start;
+#endif
+}
 FDCAN_FilterTypeDef_t hFilter;
 FDCAN_RX_HEADER hRXHeader;
+#if J1939_ENABLE
+J1939_HandleTypeDef_t hJ1939;          // J1939 node on FDCAN1
+#endif
+CANERR_HandleTypeDef_t hCanErr;        // Error state of FDCAN1
+#if CAN_STATS
+CANSTATS_HandleTypeDef_t hCanStats;    // Bus load and per-ID counters
+uint32_t canStatsCycles;               // Cycles spent in CANSTATS_FRAME
+uint32_t canStatsCyclesMax;
+#endif
+#if CAN_SNIFFER
+CANCAP_HandleTypeDef_t hCapture;       // Capture ring of the bus sniffer
+#endif
+#if CAN_TRAFFIC_GEN
+CANGEN_HandleTypeDef_t hTraffic;       // Load generator on FDCAN1
+uint64_t trafficCycles;                // Cycles spent in CANGEN_POLL, soak runs are long
+uint32_t trafficCyclesMax;
+#endif
+#if CAN_REPLAY
+CANRP_HandleTypeDef_t hReplay;         // Recorded log fed to the RX path
+uint64_t replayCycles;                 // Cycles spent in the RX path on replayed frames
+uint32_t replayCyclesMax;
+#endif
+#if XCP_ENABLE
+XCP_HandleTypeDef_t hXcp;              // XCP slave on FDCAN1
+#endif
+#if UDS_ENABLE || UDS_BENCH
+UDS_HandleTypeDef_t hUds;              // UDS server on FDCAN1
+#endif
+#if FW_UPDATE
+FWU_HandleTypeDef_t hFwu;              // Download into the inactive bank
+#endif
+/* Calibration parameters, in SRAM so an XCP master can tune them */
+typedef struct {
+	uint32_t LedHalfPeriodMs;          // Status LED on and off time
+} USER_CalTypeDef_t;
+USER_CalTypeDef_t userCal = { .LedHalfPeriodMs = 100U };
+TX_SchedEntryTypeDef_t txSchedTable[TX_SCHED_MAX_ENTRIES];
+#if TX_LATEST
+CANTXL_HandleTypeDef_t hTxLatest;      // Latest-value policy of the scheduled frames
+#endif
+#if TX_ON_CHANGE
+CANCHG_HandleTypeDef_t hTxChange;      // Send-on-change filter of the TX paths
+#endif
+#if TX_RATE_LIMIT
+CANRL_HandleTypeDef_t hTxRate;         // Token buckets of the TX paths
+uint32_t txRateCycles;                 // Cycles spent in CANRL_SUBMIT
+uint32_t txRateCyclesMax;
+#endif
+#if E2E_ENABLE
+E2E_HandleTypeDef_t hE2e;              // CRC engine of the E2E profiles
+#endif
+#if TIME_SYNC == TIME_SYNC_MASTER
+CANTS_MasterTypeDef_t hTsynMaster;     // Time master on TIME_SYNC_ID
+#elif TIME_SYNC == TIME_SYNC_SLAVE
+CANTS_SlaveTypeDef_t hTsynSlave;       // Time slave on TIME_SYNC_ID
+#endif
+uint32_t txSchedCount;
 FDCAN_TxHeaderTypeDef_t hTXHeader;
 GPIO_Handle_Typedef_t hGPIOA;          // GPIOA handler
 GPIO_Handle_Typedef_t hGPIOB;          // GPIOC handler
@@ -888,45 +1698,44 @@ uint8_t *send;
  * for the CAN communication demonstration.
  ****************************************************************************/
 int main(void) {
+	/* Start the cycle counter first so boot phases are timed from reset */
+	CYCLE_COUNTER_INIT();              // Boot timestamps and RX load measurement
+
 	/* System initialization */
 	SYSTEM_CLOCK_CONFIG();             // Configure system clock
+	BOOT_MARK(BOOT_PHASE_CLOCK);
 	ICACHE_EN();                     // Enable instruction cache for performance
+#if ICACHE_PROFILE
+	ICACHE_MONITOR_INIT();             // Count cache hits/misses for profiling
+#endif
+#if FDCAN_RAM_EXEC
+	VECTOR_TABLE_TO_RAM();             // Serve interrupt vectors from SRAM
+#endif
 
 	/* Configure PA11 (FDCAN1_RX) and PA12 (FDCAN1_TX) */
 	USER_GPIOA_INIT();                 // Initialize GPIOA pins for FDCAN
+	BOOT_MARK(BOOT_PHASE_CAN_PINS);
+#if E2E_ENABLE
+	E2E_NODE_INIT();                   // Before the first frame is received
+#endif
+
+#if FAST_BOOT
+	/* CAN first: nothing below is needed to send or receive frames */
+	BOOT_FDCAN_START();
+	BOOT_MARK(BOOT_PHASE_FDCAN);
+#endif
 
 	/* Configure GPIOB pins for LED status indicators */
 	USER_GPIOB_INIT();               // Initialize GPIOB pins for LED indicators
 
 	// Config TIMER2
-	// Enable TIM2
-	SET_BIT_FIELD(RCC_t->APB1LENR, 0);
-
-	// Prescaler for TIM2 --> 250Mhz to 1Mhz (each count will be 1us)
-	WRITE_REG_BIT(TIM2_t->PSC, 249, 0);
-
-	// ARR max value
-	WRITE_REG_BIT(TIM2_t->ARR, 0xFFFF, 0);
-
-	// ENABLE COUNTER
-	SET_BIT_FIELD(TIM2_t->CR1, 0);
-
-	// Update interrupt flag
-	while (!READ_BIT_FIELD(TIM2_t->SR, 0, 0x1))
-		;
+	TIM2_INIT();
+	BOOT_MARK(BOOT_PHASE_TIMER);
 
 	// I2C Init
-	I2C_INIT();
-
-	// NVIC I2C2 event interrupt at bit 53
-	*NVIC_ISER1_p |= (1 << (I2C2_EV_IRQ_t % 32));
-
-	// Set TXIE: TX interrupt enable
-	SET_BIT_FIELD(I2C2_t->CR1, 1);
-
-	// Set TCIE: Transfer complete interrupt enable
-	SET_BIT_FIELD(I2C2_t->CR1, 6);
+	BOOT_I2C_START();
 
+#if !FAST_BOOT
 	// LCD Init
 	lcd_init();
 
@@ -939,17 +1748,218 @@ int main(void) {
 
 	delayMS(1000);
 	lcd_clear();
+	lcdBgState = LCD_BG_READY;
+	BOOT_MARK(BOOT_PHASE_LCD);
+
+	/* Configure FDCAN peripheral */
+	BOOT_FDCAN_START();
+	BOOT_MARK(BOOT_PHASE_FDCAN);
+#endif
+
+	/* Configure PC13 for LED blinking */
+	USER_GPIOC_INIT();                 // Initialize GPIOC pin for status LED
+
+#if ISOTP_BENCH
+	ISOTP_BENCHMARK();                 // Report ISO-TP KB/s per BS/STmin
+#endif
+#if RX_LOAD_BENCH
+	RX_LOAD_BENCHMARK();               // Report RX load per mode and frame rate
+#endif
+#if UDS_BENCH
+	UDS_BENCHMARK();                   // Report UDS round trip per service
+#endif
+#if E2E_BENCH
+	E2E_BENCHMARK();                   // Report cycles per frame per E2E profile
+#endif
+
+#if CAN_SNIFFER
+	// Bus monitoring cannot transmit: stream the capture and nothing else
+	while (1) {
+		CAN_SNIFFER_TASK();
+	}
+#endif
+#if CAN_TRAFFIC_GEN
+	// Load generator: the TX FIFO is all its own, only reports run here
+	CAN_TRAFFIC_INIT();
+	while (1) {
+		CAN_TRAFFIC_TASK();
+	}
+#endif
+
+#if TX_ON_CHANGE
+	TX_CHANGE_INIT();                  // Before the first frame is released
+#endif
+#if TX_RATE_LIMIT
+	TX_RATE_INIT();                    // Before the first frame is queued
+#endif
+#if TIME_SYNC
+	TSYN_NODE_INIT();                  // Before the first SYNC is scheduled
+#endif
+#if TX_SCHED
+	USER_TX_SCHED_CONFIG();
+	TX_SCHED_START();                  // Periodic frames from TIM2 compare
+#endif
+#if XCP_ENABLE
+	XCP_NODE_INIT();                   // DAQ events from TIM2 CC2
+#endif
+#if UDS_ENABLE
+	UDS_NODE_INIT();                   // Diagnostic requests on UDS_RX_ID
+#endif
+#if CAN_REPLAY
+	CAN_REPLAY_INIT();                 // After the handlers it feeds
+#endif
+
+	/* Main application loop */
+	uint32_t loopCount = 0;
+	uint8_t bootReported = 0;
+	while (1) {
+		// Measure cache behaviour of one main loop pass
+#if ICACHE_PROFILE
+		ICACHE_MONITOR_RESTART();
+#endif
+		ICACHE_Snapshot_t icacheStart = ICACHE_REGION_BEGIN();
+
+		// Drain RX FIFO 0 if it is owned by polling
+		FDCAN_RX_POLL(&hfdCan1, FDCAN_RX_POLL_BUDGET);
+#if CAN_REPLAY
+		CAN_REPLAY_TASK();             // Replayed frames, served the same way
+#endif
+#if J1939_ENABLE
+		J1939_NODE_POLL();             // Claim and transport timers
+#endif
+#if CAN_ERR_MANAGER
+		CAN_ERR_TASK();                // Restart after bus-off once backed off
+#endif
+#if UDS_ENABLE
+		UDS_NODE_POLL();               // Pending hooks and the S3 timer
+#endif
+
+		// Do CAN operation first
+#if !TX_SCHED
+		USER_CAN_TX();
+#endif
+//		delayMS(10); // Wait for I2C bus to be free
+		// Then do LCD operations, once the background init has finished
+		if (LCD_BG_TASK()) {
+			lcd_clear();
+//			delayMS(5);
+			lcd_set_cursor(1, 1);
+//			delayMS(5);
+			print_string(0x4E, "Sent: ");
+//			delayMS(5);
+			print_string(0x4E, (char*) send);
+//			delayMS(5);
+
+			lcd_set_cursor(2, 1);
+//			delayMS(5);
+			print_string(0x4E, "Received: ");
+//			delayMS(5);
+			print_string(0x4E, (char*) receivedData);
+		}
+
+		// LED operations
+		GPIO_OUTPUT_t(GPIOC_t, 13, LOW);
+		delayMS(userCal.LedHalfPeriodMs);
+		GPIO_OUTPUT_t(GPIOC_t, 13, HIGH);
+		delayMS(userCal.LedHalfPeriodMs);
+
+		ICACHE_REGION_END(&icacheMainLoopStats, icacheStart);
+		loopCount++;
+		if (ICACHE_PROFILE && (loopCount % ICACHE_REPORT_PERIOD) == 0) {
+			ICACHE_REPORT();
+		}
+		if (TX_SCHED && (loopCount % TX_SCHED_REPORT_PERIOD) == 0) {
+			TX_SCHED_REPORT();
+		}
+		if (TX_ON_CHANGE && (loopCount % TX_SCHED_REPORT_PERIOD) == 0) {
+			TX_CHANGE_REPORT();
+		}
+		if (TX_RATE_LIMIT && (loopCount % TX_RATE_REPORT_PERIOD) == 0) {
+			TX_RATE_REPORT();
+		}
+		if (E2E_ENABLE && (loopCount % E2E_REPORT_PERIOD) == 0) {
+			E2E_NODE_REPORT();
+		}
+		if (TIME_SYNC && (loopCount % TIME_SYNC_REPORT_PERIOD) == 0) {
+			TSYN_NODE_REPORT();
+		}
+		if (CAN_ERR_MANAGER && (loopCount % CAN_ERR_REPORT_PERIOD) == 0) {
+			CAN_ERR_REPORT();
+		}
+		if (CAN_STATS && (loopCount % CAN_STATS_REPORT_PERIOD) == 0) {
+			CAN_STATS_REPORT();
+		}
+		if (XCP_ENABLE && (loopCount % XCP_REPORT_PERIOD) == 0) {
+			XCP_NODE_REPORT();
+		}
+		if (UDS_ENABLE && (loopCount % UDS_REPORT_PERIOD) == 0) {
+			UDS_NODE_REPORT();
+		}
+		if (CAN_REPLAY && (loopCount % CAN_REPLAY_REPORT_PERIOD) == 0) {
+			CAN_REPLAY_REPORT();
+		}
+		if (BOOT_PROFILE && !bootReported && lcdBgState == LCD_BG_READY) {
+			BOOT_REPORT();     // Once, when the last boot phase has completed
+			bootReported = 1;
+		}
+	}
+}
+
+/****************************************************************************
+ * Boot Sequence
+ ****************************************************************************/
+
+/**
+ * @brief  Start TIM2 as the 1 us timebase used by delayUS/delayMS
+ * @note   The update event is generated by software so the prescaler is
+ *         loaded at once, instead of waiting for the first overflow
+ */
+void TIM2_INIT(void) {
+	// Enable TIM2
+	SET_BIT_FIELD(RCC_t->APB1LENR, 0);
+
+	// Prescaler for TIM2 --> 250Mhz to 1Mhz (each count will be 1us)
+	WRITE_REG_BIT(TIM2_t->PSC, 249, 0);
+
+	// ARR max value: TIM2 is 32-bit, so the count runs free for 71 minutes
+	// and delays and scheduled releases compare against it without resets
+	WRITE_REG_BIT(TIM2_t->ARR, 0xFFFFFFFFU, 0);
+
+	// UG: load PSC/ARR now
+	WRITE_REG_BIT(TIM2_t->EGR, 1U, 0);
+
+	// ENABLE COUNTER
+	SET_BIT_FIELD(TIM2_t->CR1, 0);
+}
 
+/**
+ * @brief  Configure FDCAN1, its filters and interrupts, and leave init mode
+ * @note   Needs only the system clock and the CAN pins, no delays
+ */
+void BOOT_FDCAN_START(void) {
 	/* Configure FDCAN peripheral */
 	USER_FDCAN_INIT();                 // Setup FDCAN with specific parameters
 
 	USER_FDCAN_Config_Filter();
 
+#if CAN_STATS
+	// Ready before the first frame can be received or queued
+	CAN_STATS_INIT();
+#endif
+#if CAN_SNIFFER
+	CAN_SNIFFER_INIT();
+#endif
+
 	// Enable Interrupt for FDCAN at bit 39 (IRQ39)
 	*NVIC_ISER1_p |= (1 << (FDCAN1_IT0_IRQ_t % 32));
 
-	// Enable the Rx FIFO 0 new message interrupt
-	SET_BIT_FIELD(hfdCan1.Instace->IE, 0);
+	// Enable the Rx FIFO 0 interrupts for the selected moderation mode
+	FDCAN_CONFIG_RX_INTERRUPTS(&hfdCan1);
+
+#if CAN_ERR_MANAGER
+	// Error state interrupts and the bus-off recovery policy
+	CAN_ERR_INIT();
+#endif
 
 	// FDCAN interrupt line select register (FDCAN_ILS)
 	// BIT 0 --> LINE 0
@@ -962,35 +1972,363 @@ int main(void) {
 	/* Exit initialization mode to enter normal operation */
 	FDCAN_EXIT_INIT_MODE(hfdCan1.Instace);
 
-	/* Configure PC13 for LED blinking */
-	USER_GPIOC_INIT();                 // Initialize GPIOC pin for status LED
-	/* Main application loop */
-	while (1) {
-		// Do CAN operation first
-		USER_CAN_TX();
-//		delayMS(10); // Wait for I2C bus to be free
-		// Then do LCD operations
-		lcd_clear();
-//		delayMS(5);
-		lcd_set_cursor(1, 1);
-//		delayMS(5);
-		print_string(0x4E, "Sent: ");
-//		delayMS(5);
-		print_string(0x4E, (char*) send);
-//		delayMS(5);
-
-		lcd_set_cursor(2, 1);
-//		delayMS(5);
-		print_string(0x4E, "Received: ");
-//		delayMS(5);
-		print_string(0x4E, (char*) receivedData);
+#if J1939_ENABLE && !CAN_SNIFFER
+	J1939_NODE_INIT();                 // Claim our J1939 source address
+#endif
+}
 
-		// LED operations
-		GPIO_OUTPUT_t(GPIOC_t, 13, LOW);
-		delayMS(100);
-		GPIO_OUTPUT_t(GPIOC_t, 13, HIGH);
-		delayMS(100);
+/**
+ * @brief  Configure I2C2 for the LCD and enable its event interrupt
+ */
+void BOOT_I2C_START(void) {
+	I2C_INIT();
+
+	// NVIC I2C2 event interrupt at bit 53
+	*NVIC_ISER1_p |= (1 << (I2C2_EV_IRQ_t % 32));
+
+	// Set TXIE: TX interrupt enable
+	SET_BIT_FIELD(I2C2_t->CR1, 1);
+
+	// Set TCIE: Transfer complete interrupt enable
+	SET_BIT_FIELD(I2C2_t->CR1, 6);
+}
+
+/**
+ * @brief  Convert a boot phase timestamp to microseconds since main
+ * @note   Cycles up to BOOT_PHASE_CLOCK ran at the reset clock, the rest at SYSCLK
+ * @retval Microseconds, or 0 if the phase has not been reached
+ */
+uint32_t BOOT_PHASE_US(uint32_t phase) {
+	uint32_t cycles = bootPhaseCycles[phase];
+	uint32_t clockCycles = bootPhaseCycles[BOOT_PHASE_CLOCK];
+
+	if (cycles == 0) {
+		return 0;
+	}
+	if (phase == BOOT_PHASE_CLOCK) {
+		return cycles / BOOT_RESET_CLOCK_MHZ;
+	}
+	return (clockCycles / BOOT_RESET_CLOCK_MHZ)
+			+ ((cycles - clockCycles) / BOOT_SYSCLK_MHZ);
+}
+
+/**
+ * @brief  Print the boot phase timeline and check time-to-first-frame
+ * @note   A phase that has not been reached yet (e.g. no frame received)
+ *         is reported as pending; the budget check uses the first TX
+ */
+void BOOT_REPORT(void) {
+	static const char *phaseNames[BOOT_PHASE_COUNT] = { "Clock", "CAN pins",
+			"FDCAN on bus", "Timer", "LCD ready", "First TX", "First RX" };
+
+	printf("Boot phases (FAST_BOOT=%d):\n", FAST_BOOT);
+	for (uint32_t i = 0; i < BOOT_PHASE_COUNT; i++) {
+		if (bootPhaseCycles[i] == 0) {
+			printf("  %-13s pending\n", phaseNames[i]);
+		} else {
+			printf("  %-13s %8lu us\n", phaseNames[i],
+					(unsigned long) BOOT_PHASE_US(i));
+		}
+	}
+
+	uint32_t ttff = BOOT_PHASE_US(BOOT_PHASE_FIRST_TX);
+	printf("Time to first frame: %lu us (budget %lu us) %s\n",
+			(unsigned long) ttff, (unsigned long) BOOT_TTFF_BUDGET_US,
+			(ttff != 0 && ttff <= BOOT_TTFF_BUDGET_US) ? "PASS" : "FAIL");
+}
+
+/**
+ * @brief  Step the LCD initialization without blocking on its long delays
+ * @note   Called from the main loop and once per millisecond from delayMS.
+ *         Each state issues its short I2C commands, then sets a deadline;
+ *         calls before the deadline return immediately.
+ * @retval 1 once the LCD is ready for use, 0 while still initializing
+ */
+uint8_t LCD_BG_TASK(void) {
+	uint32_t waitUs = 0;
+
+	if (lcdBgState == LCD_BG_READY) {
+		return 1;
+	}
+	if ((int32_t) (CYCLE_COUNTER_READ() - lcdBgDeadline) < 0) {
+		return 0;
+	}
+
+	switch (lcdBgState) {
+	case LCD_BG_RESET:
+		// Bus recovery - ensure I2C bus is in clean state
+		I2C_WRITE(0x4E, 0x00);  // Dummy transaction
+		waitUs = 50000;         // Wait for > 15ms
+		break;
+	case LCD_BG_WAKE1:
+		lcd_write_4_bit(0x4E, 0x3, 0, 0);
+		waitUs = 5000;          // Wait for > 4.1ms
+		break;
+	case LCD_BG_WAKE2:
+		lcd_write_4_bit(0x4E, 0x3, 0, 0);
+		waitUs = 150;           // Wait for > 100us
+		break;
+	case LCD_BG_CONFIG:
+		lcd_write_4_bit(0x4E, 0x3, 0, 0);
+		lcd_write_4_bit(0x4E, 0x2, 0, 0);        // Switch to 4-bit interface
+		lcd_send_cmd(0x4E, FUNCTION_SET);
+		lcd_send_cmd(0x4E, DISPLAY_ON_CURSOR_OFF);
+		lcd_write_cmd(0x4E, DISPLAY_CLEAR);
+		waitUs = 10000;         // Clear needs more time
+		break;
+	case LCD_BG_SPLASH:
+		lcd_send_cmd(0x4E, ENTRY_MODE);
+		lcd_set_cursor(1, 5);
+		print_string(0x4E, "LCD I2C");
+		lcd_set_cursor(2, 3);
+		print_string(0x4E, "Hello World");
+		waitUs = 1000000;       // Splash screen
+		break;
+	case LCD_BG_CLEAR:
+		lcd_write_cmd(0x4E, DISPLAY_CLEAR);
+		waitUs = 10000;
+		break;
+	default:
+		break;
+	}
+
+	lcdBgDeadline = CYCLE_COUNTER_READ() + waitUs * BOOT_SYSCLK_MHZ;
+	if (++lcdBgState == LCD_BG_READY) {
+		BOOT_MARK(BOOT_PHASE_LCD);
+	}
+	return 0;
+}
+
+/****************************************************************************
+ * ISO-TP Loopback Benchmark
+ *
+ * Two ISO-TP channels talk to each other through FDCAN internal loopback:
+ * channel A sends on 0x7E0, channel B answers with Flow Control on 0x7E8.
+ * Every frame really goes through message RAM and the CAN protocol engine,
+ * so the figures include bit time, BS round trips and STmin.
+ ****************************************************************************/
+#if ISOTP_BENCH
+
+/* Cycle counter as the ISO-TP timebase */
+static uint32_t ISOTP_BENCH_TICKS(void) {
+	return CYCLE_COUNTER_READ();
+}
+
+static uint8_t ISOTP_BENCH_SEND(void *ctx, const FDCAN_FrameTypeDef_t *pFrame) {
+	return CAN1_TxFrame((FDCAN_Handle_Typedef_t*) ctx, pFrame);
+}
+
+static volatile uint8_t isotpBenchResult;  // RxDone/TxDone result, 0xFF = running
+
+static void ISOTP_BENCH_RX_DONE(void *ctx, uint32_t length, uint8_t result) {
+	(void) ctx;
+	(void) length;
+	isotpBenchResult = result;
+}
+
+static void ISOTP_BENCH_TX_DONE(void *ctx, uint8_t result) {
+	(void) ctx;
+	if (result != ISOTP_OK) {
+		isotpBenchResult = result;  // Success is reported by the receiver
+	}
+}
+
+/**
+ * @brief  Measure ISO-TP throughput in FDCAN internal loopback
+ * @note   Runs with FDCAN RX interrupts masked and RX FIFO 0 polled, then
+ *         restores the previous FDCAN mode. Prints one line per setting:
+ *         TX_DL, BS, STmin, duration, KB/s and frames sent.
+ */
+void ISOTP_BENCHMARK(void) {
+	static const uint8_t txdlList[] = { 8, 64 };
+	static const uint8_t bsList[] = { 0, 8, 32 };
+	static const uint8_t stminList[] = { 0x00, 0xF5, 0x01 }; // 0, 500 us, 1 ms
+	static uint8_t txBuffer[ISOTP_BENCH_SIZE];
+	static uint8_t rxBuffer[ISOTP_BENCH_SIZE];
+	ISOTP_HandleTypeDef_t isoA = { 0 };
+	ISOTP_HandleTypeDef_t isoB = { 0 };
+	FDCAN_FrameTypeDef_t frame;
+	FDCAN_TypeDef_t *fdcan = hfdCan1.Instace;
+	uint32_t cccrMask = (1U << FDCAN_CCCR_MON_POS) | (1U << FDCAN_CCCR_TEST_POS)
+			| (1U << FDCAN_CCCR_FDOE_POS);
+
+	for (uint32_t i = 0; i < ISOTP_BENCH_SIZE; i++) {
+		txBuffer[i] = (uint8_t) (i * 7U + 1U);
+	}
+
+	/* Internal loopback, FD frames allowed, accept every standard ID */
+	uint32_t savedIe = fdcan->IE;
+	uint32_t savedCccr = fdcan->CCCR & cccrMask;
+	uint32_t savedRxgfc = fdcan->RXGFC;
+	WRITE_ALL_REG(fdcan->IE, 0);
+	FDCAN_ENTER_INIT_MODE(fdcan);
+	FDCAN_ENABLE_INTERNAL_LOOPBACK(fdcan);
+	FDCAN_ENABLE_FD_MODE(fdcan);
+	REG_MODIFY(fdcan->RXGFC, FDCAN_RXGFC_ANFS_FLD, 0);
+	FDCAN_EXIT_INIT_MODE(fdcan);
+
+	printf("ISO-TP loopback, %lu byte messages:\n",
+			(unsigned long) ISOTP_BENCH_SIZE);
+	printf("  TX_DL  BS  STmin      us     KB/s  frames  result\n");
+
+	for (uint32_t d = 0; d < sizeof(txdlList); d++) {
+		for (uint32_t b = 0; b < sizeof(bsList); b++) {
+			for (uint32_t s = 0; s < sizeof(stminList); s++) {
+				/* A sends, B receives and sets BS/STmin in its Flow Control */
+				isoA.TxId = ISOTP_BENCH_TX_ID;
+				isoA.RxId = ISOTP_BENCH_RX_ID;
+				isoA.TxDone = ISOTP_BENCH_TX_DONE;
+				isoB.TxId = ISOTP_BENCH_RX_ID;
+				isoB.RxId = ISOTP_BENCH_TX_ID;
+				isoB.BlockSize = bsList[b];
+				isoB.STmin = stminList[s];
+				isoB.RxBuffer = rxBuffer;
+				isoB.RxBufferSize = sizeof(rxBuffer);
+				isoB.RxDone = ISOTP_BENCH_RX_DONE;
+				isoA.TxDataLength = isoB.TxDataLength = txdlList[d];
+				isoA.PadFrames = isoB.PadFrames = 1;
+				isoA.PadByte = isoB.PadByte = 0xCC;
+				isoA.TicksPerUs = isoB.TicksPerUs = BOOT_SYSCLK_MHZ;
+				isoA.GetTicks = isoB.GetTicks = ISOTP_BENCH_TICKS;
+				isoA.SendFrame = isoB.SendFrame = ISOTP_BENCH_SEND;
+				isoA.Ctx = isoB.Ctx = &hfdCan1;
+				ISOTP_INIT(&isoA);
+				ISOTP_INIT(&isoB);
+
+				for (uint32_t i = 0; i < ISOTP_BENCH_SIZE; i++) {
+					rxBuffer[i] = 0;
+				}
+				isotpBenchResult = 0xFF;
+
+				uint32_t start = CYCLE_COUNTER_READ();
+				uint32_t elapsed = 0;
+				ISOTP_SEND(&isoA, txBuffer, ISOTP_BENCH_SIZE);
+				while (isotpBenchResult == 0xFF) {
+					while (CAN1_RxFrame(&hfdCan1, &frame)) {
+						if (!ISOTP_RX_FRAME(&isoA, &frame)) {
+							ISOTP_RX_FRAME(&isoB, &frame);
+						}
+					}
+					ISOTP_POLL(&isoA);
+					ISOTP_POLL(&isoB);
+
+					elapsed = CYCLE_COUNTER_READ() - start;
+					if (elapsed > ISOTP_BENCH_TIMEOUT_MS * 1000U * BOOT_SYSCLK_MHZ) {
+						isotpBenchResult = ISOTP_ERR_TIMEOUT_CR;
+					}
+				}
+
+				uint32_t us = elapsed / BOOT_SYSCLK_MHZ;
+				uint8_t result = isotpBenchResult;
+				for (uint32_t i = 0; result == ISOTP_OK && i < ISOTP_BENCH_SIZE; i++) {
+					if (rxBuffer[i] != txBuffer[i]) {
+						result = ISOTP_ERR_SEQUENCE;  // Data mismatch
+					}
+				}
+
+				/* bytes per ms == KB/s (1 KB = 1000 bytes) */
+				printf("  %5u %3u   0x%02X %7lu %8lu %7lu  %s\n",
+						txdlList[d], bsList[b], stminList[s],
+						(unsigned long) us,
+						(unsigned long) (us ? (ISOTP_BENCH_SIZE * 1000U) / us : 0),
+						(unsigned long) isoA.TxFrames,
+						(result == ISOTP_OK) ? "ok" : "FAIL");
+			}
+		}
+	}
+
+	/* Drop anything left in RX FIFO 0 and restore the previous mode */
+	while (CAN1_RxFrame(&hfdCan1, &frame))
+		;
+	FDCAN_ENTER_INIT_MODE(fdcan);
+	CLEAR_BIT_FIELD(fdcan->TEST, FDCAN_TEST_LBCK_POS);
+	REG_MODIFY(fdcan->CCCR, cccrMask, savedCccr);
+	WRITE_ALL_REG(fdcan->RXGFC, savedRxgfc);
+	FDCAN_EXIT_INIT_MODE(fdcan);
+	WRITE_ALL_REG(fdcan->IE, savedIe);
+}
+
+#endif /* ISOTP_BENCH */
+
+/****************************************************************************
+ * Vector Table Relocation
+ ****************************************************************************/
+
+/* Number of entries in g_pfnVectors (startup_stm32h503cbux.s) */
+#define VECTOR_TABLE_WORDS 150U
+
+/* VTOR requires alignment to the next power of two above the table size (600 bytes) */
+#if FDCAN_RAM_EXEC
+static uint32_t ramVectorTable[VECTOR_TABLE_WORDS] __attribute__((aligned(1024)));
+#endif
+
+/**
+ * @brief  Copy the vector table to SRAM and point VTOR at it
+ * @note   Only effective with FDCAN_RAM_EXEC; vector fetch on exception entry
+ *         then no longer goes through the flash wait states
+ */
+void VECTOR_TABLE_TO_RAM(void) {
+#if FDCAN_RAM_EXEC
+	extern uint32_t g_pfnVectors[];
+
+	for (uint32_t i = 0; i < VECTOR_TABLE_WORDS; i++) {
+		ramVectorTable[i] = g_pfnVectors[i];
+	}
+
+	__disable_irq();
+	SCB->VTOR = (uint32_t) ramVectorTable;
+	__DSB();
+	__ISB();
+	__enable_irq();
+#endif
+}
+
+/****************************************************************************
+ * ICACHE Monitor Control and Report
+ ****************************************************************************/
+
+/**
+ * @brief  Reset and enable the ICACHE hit and miss monitors
+ */
+void ICACHE_MONITOR_INIT(void) {
+	SET_BIT_FIELD(ICACHE_t->CR, ICACHE_CR_HITMRST_POS);
+	SET_BIT_FIELD(ICACHE_t->CR, ICACHE_CR_MISSMRST_POS);
+	SET_BIT_FIELD(ICACHE_t->CR, ICACHE_CR_HITMEN_POS);
+	SET_BIT_FIELD(ICACHE_t->CR, ICACHE_CR_MISSMEN_POS);
+}
+
+/**
+ * @brief  Reset both monitors so the 16-bit miss counter does not saturate
+ * @note   Call only where no region is open; interrupts are held off so an
+ *         ISR region cannot straddle the reset
+ */
+void ICACHE_MONITOR_RESTART(void) {
+	__disable_irq();
+	SET_BIT_FIELD(ICACHE_t->CR, ICACHE_CR_HITMRST_POS);
+	SET_BIT_FIELD(ICACHE_t->CR, ICACHE_CR_MISSMRST_POS);
+	__enable_irq();
+}
 
+/**
+ * @brief  Print a miss-rate report for every measured region over ITM
+ * @note   A high miss count per run marks code worth moving to RAM
+ *         (FDCAN_RAM_EXEC) or regrouping so it shares cache lines
+ */
+void ICACHE_REPORT(void) {
+	ICACHE_RegionStats_t *regions[] = { &icacheIsrStats, &icacheMainLoopStats };
+
+	printf("ICACHE report: region, runs, hits, misses, miss rate, misses/run\n");
+	for (uint32_t i = 0; i < sizeof(regions) / sizeof(regions[0]); i++) {
+		ICACHE_RegionStats_t *r = regions[i];
+		uint32_t lookups = r->Hits + r->Misses;
+		uint32_t permille = (lookups == 0) ? 0 :
+				(uint32_t) (((uint64_t) r->Misses * 1000U) / lookups);
+
+		printf("  %-10s %8lu %10lu %8lu %3lu.%lu%% %6lu\n", r->Name,
+				(unsigned long) r->Runs, (unsigned long) r->Hits,
+				(unsigned long) r->Misses, (unsigned long) (permille / 10),
+				(unsigned long) (permille % 10),
+				(unsigned long) ((r->Runs == 0) ? 0 : r->Misses / r->Runs));
 	}
 }
 
@@ -1005,7 +2343,7 @@ int main(void) {
  * @note   Sets up bit timing, mode, frame format and other parameters
  */
 void USER_FDCAN_INIT() {
-	hfdCan1.mode = FDCAN_MODE_NORMAL;        // Normal operating mode
+	hfdCan1.mode = CAN_SNIFFER ? FDCAN_MODE_BUS_MONITORING : FDCAN_MODE_NORMAL;
 	hfdCan1.AutoRetransmission = ENABLE;        // Enable auto retransmission
 	hfdCan1.FrameFormat = FDCAN_FRAME_CLASSIC;  // Use classic CAN format
 	hfdCan1.TxFifoQueueMode = FDCAN_TXBUFFER_FIFO; // Use FIFO for transmission
@@ -1014,8 +2352,14 @@ void USER_FDCAN_INIT() {
 	hfdCan1.psc = 25;                           // Prescaler for bit timing
 	hfdCan1.tjw = 1;                            // Resynchronization jump width
 	hfdCan1.Instace = FDCAN1_t;                 // Use FDCAN1 peripheral
-	hfdCan1.StdFiltersNbr = 1;
-	hfdCan1.ExtFiltersNbr = 0;
+	hfdCan1.StdFiltersNbr = 1 + XCP_ENABLE + UDS_ENABLE + E2E_ENABLE
+			+ (TIME_SYNC == TIME_SYNC_SLAVE);
+	hfdCan1.ExtFiltersNbr = J1939_ENABLE ? 1 : 0;
+	hfdCan1.TimestampPrescaler = 1;             // Timestamp tick = 1 bit time
+	hfdCan1.RxIrqMode = FDCAN_RX_IRQ_PER_FRAME; // Interrupt on every frame
+	hfdCan1.RxIrqTimeout = 0;                   // Only used when coalescing
+	hfdCan1.RxBurstFrames = 4;                  // Adaptive: 4 frames in a row...
+	hfdCan1.RxBurstGap = 300;                   // ...less than ~2 frame times apart
 	FDCAN_INIT(&hfdCan1);                       // Apply configuration
 }
 
@@ -1040,45 +2384,36 @@ void FDCAN_INIT(FDCAN_Handle_Typedef_t *hfdCAN1_Handle_t) {
 	} else if (hfdCAN1_Handle_t->mode == FDCAN_MODE_INTERNAL_LOOPBACK) {
 		/* Internal loopback mode: Connected to CAN bus, messages looped back internally */
 		FDCAN_ENABLE_INTERNAL_LOOPBACK(hfdCAN1_Handle_t->Instace);
+	} else if (hfdCAN1_Handle_t->mode == FDCAN_MODE_BUS_MONITORING) {
+		/* Bus monitoring mode: receives everything, never drives the bus
+		 * (no ACK, no error frames), so it cannot disturb the traffic */
+		FDCAN_ENABLE_BUS_MONITORING(hfdCAN1_Handle_t->Instace);
+	} else if (hfdCAN1_Handle_t->mode == FDCAN_MODE_RESTRICTED) {
+		/* Restricted operation: receives and acknowledges, never transmits */
+		FDCAN_ENABLE_RESTRICTED_MODE(hfdCAN1_Handle_t->Instace);
 	} else {
 		/* Normal mode: Connected to CAN bus */
 		/* No specific configuration needed for normal mode */
 	}
 
 	// Number of standard/extended filter elements in the list
-	WRITE_REG_BIT(hfdCAN1_Handle_t->Instace->RXGFC, 0, 16);
-	WRITE_REG_BIT(hfdCAN1_Handle_t->Instace->RXGFC, 0, 24);
-	SET_VAL_BIT(hfdCAN1_Handle_t->Instace->RXGFC,
-			hfdCAN1_Handle_t->StdFiltersNbr, 16);
-	SET_VAL_BIT(hfdCAN1_Handle_t->Instace->RXGFC,
-			hfdCAN1_Handle_t->ExtFiltersNbr, 24);
+	REG_WRITE(hfdCAN1_Handle_t->Instace->RXGFC,
+			FIELD_PREP(FDCAN_RXGFC_LSS_FLD, hfdCAN1_Handle_t->StdFiltersNbr)
+			| FIELD_PREP(FDCAN_RXGFC_LSE_FLD, hfdCAN1_Handle_t->ExtFiltersNbr));
 
 	/* Configure bit timing for classical CAN frame format */
-	if (hfdCAN1_Handle_t->mode == FDCAN_FRAME_CLASSIC) {
-		/* Reset the nominal bit timing register before configuring */
-		WRITE_ALL_REG(hfdCAN1_Handle_t->Instace->NBTP, 0);
-
-		/* Configure time segment 2 (phase2) [bits 0-7] */
-		SET_VAL_BIT(hfdCAN1_Handle_t->Instace->NBTP,
-				hfdCAN1_Handle_t->ntseg2 - 1, 0);
-
-		/* Configure time segment 1 (prop_seg + phase1) [bits 8-15] */
-		SET_VAL_BIT(hfdCAN1_Handle_t->Instace->NBTP,
-				hfdCAN1_Handle_t->ntseg1 - 1, 8);
-
-		/* Configure prescaler (controls time quantum length) [bits 16-24] */
-		SET_VAL_BIT(hfdCAN1_Handle_t->Instace->NBTP, hfdCAN1_Handle_t->psc - 1,
-				16);
-
-		/* Configure sync jump width [bits 25-28] */
-		if (hfdCAN1_Handle_t->tjw == 1) {
-			/* Default TJW, no need to set */
-			CLEAR_BIT_FIELD(hfdCAN1_Handle_t->Instace->NBTP, 25);
-		} else {
-			/* Custom TJW value */
-			SET_VAL_BIT(hfdCAN1_Handle_t->Instace->NBTP,
-					hfdCAN1_Handle_t->tjw - 1, 25);
-		}
+	if (hfdCAN1_Handle_t->FrameFormat == FDCAN_FRAME_CLASSIC) {
+		/* Configure the nominal bit timing register in one store:
+		 * - Time segment 2 (phase2) [bits 0-6]
+		 * - Time segment 1 (prop_seg + phase1) [bits 8-15]
+		 * - Prescaler (controls time quantum length) [bits 16-24]
+		 * - Sync jump width [bits 25-31]
+		 */
+		REG_WRITE(hfdCAN1_Handle_t->Instace->NBTP,
+				FIELD_PREP(FDCAN_NBTP_NTSEG2_FLD, hfdCAN1_Handle_t->ntseg2 - 1)
+				| FIELD_PREP(FDCAN_NBTP_NTSEG1_FLD, hfdCAN1_Handle_t->ntseg1 - 1)
+				| FIELD_PREP(FDCAN_NBTP_NBRP_FLD, hfdCAN1_Handle_t->psc - 1)
+				| FIELD_PREP(FDCAN_NBTP_NSJW_FLD, hfdCAN1_Handle_t->tjw - 1));
 
 		/* Configure for classic CAN mode operation */
 		FDCAN_ENABLE_CLASSICAL_CAN_MODE(hfdCAN1_Handle_t->Instace);
@@ -1099,6 +2434,50 @@ void FDCAN_INIT(FDCAN_Handle_Typedef_t *hfdCAN1_Handle_t) {
 		FDCAN_ENABLE_FIFO0_OVERWRITE(hfdCAN1_Handle_t->Instace);
 	}
 	/* Else: blocking mode is the default (no overwrite) */
+
+	/* Configure timestamp counter, also the time base of the timeout counter */
+	uint32_t tcp = hfdCAN1_Handle_t->TimestampPrescaler;
+	if (tcp == 0) {
+		tcp = 1;
+	}
+	WRITE_ALL_REG(hfdCAN1_Handle_t->Instace->TSCC,
+			((tcp - 1) << FDCAN_TSCC_TCP_POS) | (FDCAN_TSS_INTERNAL << FDCAN_TSCC_TSS_POS));
+
+	/* Configure timeout counter for RX interrupt coalescing.
+	 * Controlled by RX FIFO 0: the counter is held at TOP while the FIFO is
+	 * empty and starts counting down when the first frame is stored, so TOO
+	 * fires at most RxIrqTimeout ticks after the oldest unread frame arrived. */
+	if (hfdCAN1_Handle_t->RxIrqMode == FDCAN_RX_IRQ_COALESCE) {
+		WRITE_ALL_REG(hfdCAN1_Handle_t->Instace->TOCC,
+				((uint32_t) hfdCAN1_Handle_t->RxIrqTimeout << FDCAN_TOCC_TOP_POS)
+				| (FDCAN_TOS_RXFIFO0 << FDCAN_TOCC_TOS_POS)
+				| (1U << FDCAN_TOCC_ETOC_POS));
+	} else {
+		WRITE_ALL_REG(hfdCAN1_Handle_t->Instace->TOCC, 0);
+	}
+}
+
+/**
+ * @brief  Enable RX FIFO 0 interrupt sources for the configured moderation mode
+ * @param  hFDCAN: Pointer to FDCAN handler structure
+ * @note   Per frame: RF0N. Coalesce: RF0F (FIFO 0 holds 3 elements, so at most
+ *         3 frames per interrupt) plus TOO for the latency budget, and RF0L
+ *         so overruns caused by batching are counted.
+ */
+void FDCAN_CONFIG_RX_INTERRUPTS(FDCAN_Handle_Typedef_t *hFDCAN) {
+	CLEAR_VAL_BIT(hFDCAN->Instace->IE, 0x7, FDCAN_IR_RF0N_POS);
+	CLEAR_BIT_FIELD(hFDCAN->Instace->IE, FDCAN_IR_TOO_POS);
+
+	hFDCAN->RxPolling = (hFDCAN->RxIrqMode == FDCAN_RX_IRQ_POLL);
+	hFDCAN->RxBurstCount = 0;
+
+	if (hFDCAN->RxIrqMode == FDCAN_RX_IRQ_COALESCE) {
+		SET_BIT_FIELD(hFDCAN->Instace->IE, FDCAN_IR_RF0F_POS);
+		SET_BIT_FIELD(hFDCAN->Instace->IE, FDCAN_IR_RF0L_POS);
+		SET_BIT_FIELD(hFDCAN->Instace->IE, FDCAN_IR_TOO_POS);
+	} else if (hFDCAN->RxIrqMode != FDCAN_RX_IRQ_POLL) {
+		SET_BIT_FIELD(hFDCAN->Instace->IE, FDCAN_IR_RF0N_POS);
+	}
 }
 
 void USER_FDCAN_Config_Filter() {
@@ -1111,16 +2490,80 @@ void USER_FDCAN_Config_Filter() {
 
 	FDCAN_FILTER_INIT(&hFilter);
 
-	FDCAN_CONFIG_GLOBAL_FILTER(&hfdCan1, FDCAN_FILTER_REMOTE_t,
-	FDCAN_FILTER_REMOTE_t, FDCAN_REJECT_t, FDCAN_REJECT_t);
-}
+#if J1939_ENABLE
+	// Every 29-bit frame, the J1939 node sorts out PGN and address
+	hFilter.IdType = FDCAN_EXTENDED_ID;
+	hFilter.FilterIndex = 0;
+	hFilter.FilterID1 = 0;
+	hFilter.FilterID2 = 0;         // Mask 0: all extended IDs match
+	FDCAN_FILTER_INIT(&hFilter);
+#endif
 
-#define SRAMCAN_FLS_SIZE (1*4)
+#if XCP_ENABLE
+	// Commands from the XCP master
+	hFilter.IdType = FDCAN_STANDARD_ID;
+	hFilter.FilterIndex = 1;
+	hFilter.FilterID1 = XCP_CRO_ID;
+	hFilter.FilterID2 = 0x7FF;
+	FDCAN_FILTER_INIT(&hFilter);
+#endif
 
-void FDCAN_FILTER_INIT(FDCAN_FilterTypeDef_t *hFilter) {
-	uint32_t *FilterAddress = (uint32_t*) (SRAMCAN_BASE_ADDR
-			+ (hFilter->FilterIndex * SRAMCAN_FLS_SIZE));
-// Build Word for Standard message ID filter element
+#if UDS_ENABLE
+	// Physical requests from the diagnostic tester
+	hFilter.IdType = FDCAN_STANDARD_ID;
+	hFilter.FilterIndex = 1 + XCP_ENABLE;
+	hFilter.FilterID1 = UDS_RX_ID;
+	hFilter.FilterID2 = 0x7FF;
+	FDCAN_FILTER_INIT(&hFilter);
+#endif
+
+#if E2E_ENABLE
+	// Protected heartbeat of the peer node
+	hFilter.IdType = FDCAN_STANDARD_ID;
+	hFilter.FilterIndex = 1 + XCP_ENABLE + UDS_ENABLE;
+	hFilter.FilterID1 = E2E_PEER_HEARTBEAT_ID;
+	hFilter.FilterID2 = 0x7FF;
+	FDCAN_FILTER_INIT(&hFilter);
+#endif
+
+#if TIME_SYNC == TIME_SYNC_SLAVE
+	// SYNC and FUP of the time master
+	hFilter.IdType = FDCAN_STANDARD_ID;
+	hFilter.FilterIndex = 1 + XCP_ENABLE + UDS_ENABLE + E2E_ENABLE;
+	hFilter.FilterID1 = TIME_SYNC_ID;
+	hFilter.FilterID2 = 0x7FF;
+	FDCAN_FILTER_INIT(&hFilter);
+#endif
+
+#if CAN_SNIFFER
+	// Frames matching no filter go to RX FIFO 0 as well: capture everything
+	FDCAN_CONFIG_GLOBAL_FILTER(&hfdCan1, FDCAN_FILTER_REMOTE_t,
+	FDCAN_FILTER_REMOTE_t, FDCAN_ACCEPT_IN_RX_FIFO0_t,
+	FDCAN_ACCEPT_IN_RX_FIFO0_t);
+#else
+	FDCAN_CONFIG_GLOBAL_FILTER(&hfdCan1, FDCAN_FILTER_REMOTE_t,
+	FDCAN_FILTER_REMOTE_t, FDCAN_REJECT_t, FDCAN_REJECT_t);
+#endif
+}
+
+#define SRAMCAN_FLS_SIZE (1*4)
+#define SRAMCAN_FLE_SIZE (2*4)
+
+void FDCAN_FILTER_INIT(FDCAN_FilterTypeDef_t *hFilter) {
+	if (hFilter->IdType == FDCAN_EXTENDED_ID) {
+		uint32_t *ExtFilterAddress = (uint32_t*) (SRAMCAN_BASE_ADDR
+				+ FDCAN_EXTID_FILTER_OFFSET
+				+ (hFilter->FilterIndex * SRAMCAN_FLE_SIZE));
+		// F0: EFEC[31:29] EFID1[28:0], F1: EFT[31:30] EFID2[28:0]
+		ExtFilterAddress[0] = (hFilter->FilterConfig << 29
+				| (hFilter->FilterID1 & FDCAN_ELEM_EXTID_MASK));
+		ExtFilterAddress[1] = (hFilter->FilterType << 30
+				| (hFilter->FilterID2 & FDCAN_ELEM_EXTID_MASK));
+		return;
+	}
+	uint32_t *FilterAddress = (uint32_t*) (SRAMCAN_BASE_ADDR
+			+ (hFilter->FilterIndex * SRAMCAN_FLS_SIZE));
+// Build Word for Standard message ID filter element
 	uint32_t firstElement = (hFilter->FilterType << 30
 			| hFilter->FilterConfig << 27 | hFilter->FilterID1 << 16
 			| hFilter->FilterID2 << 0);
@@ -1140,8 +2583,8 @@ void FDCAN_CONFIG_GLOBAL_FILTER(FDCAN_Handle_Typedef_t *hfdCan1,
 	CLEAR_VAL_BIT(hfdCan1->Instace->RXGFC, 0x3, 2);
 	SET_VAL_BIT(hfdCan1->Instace->RXGFC, AcceptNonMatchingFrameExtended, 2);
 
-	CLEAR_VAL_BIT(hfdCan1->Instace->RXGFC, 0x3, 2);
-	SET_VAL_BIT(hfdCan1->Instace->RXGFC, AcceptNonMatchingFrameStandard, 3);
+	CLEAR_VAL_BIT(hfdCan1->Instace->RXGFC, 0x3, 4);
+	SET_VAL_BIT(hfdCan1->Instace->RXGFC, AcceptNonMatchingFrameStandard, 4);
 }
 
 /**
@@ -1279,7 +2722,7 @@ void GPIO_INIT_t(GPIO_Handle_Typedef_t *hGPIOx) {
  * @param  val: Output value (HIGH/LOW)
  * @note   Uses BSRR register for atomic bit set/reset
  */
-void GPIO_OUTPUT_t(GPIO_TypeDef_t *GPIOx, uint8_t pin, uint8_t val) {
+FDCAN_RAMFUNC void GPIO_OUTPUT_t(GPIO_TypeDef_t *GPIOx, uint8_t pin, uint8_t val) {
 	if (val == HIGH) {
 		GPIOx->BSRR = GPIO_PIN_SET(pin);    // Set pin high (atomic operation)
 	} else {
@@ -1301,7 +2744,31 @@ uint8_t GPIO_INPUT_t(GPIO_TypeDef_t *GPIOx, uint8_t pin) {
 	}
 }
 
-void USER_CAN_RX() {
+FDCAN_RAMFUNC void USER_CAN_RX() {
+#if CAN_SNIFFER
+	/* Every frame goes to the capture, without the printf path below */
+	if (CAN_SNIFFER_RX()) {
+		return;
+	}
+#endif
+#if XCP_ENABLE
+	/* Commands on XCP_CRO_ID belong to the XCP slave */
+	if (XCP_NODE_RX()) {
+		return;
+	}
+#endif
+#if UDS_ENABLE
+	/* Requests on UDS_RX_ID belong to the UDS server */
+	if (UDS_NODE_RX()) {
+		return;
+	}
+#endif
+#if J1939_ENABLE
+	/* 29-bit frames belong to the J1939 node */
+	if (J1939_NODE_RX()) {
+		return;
+	}
+#endif
 	/* Receive CAN message */
 	CAN1_Rx(&hfdCan1, &hRXHeader, receivedData); // Receive CAN message
 }
@@ -1318,7 +2785,20 @@ void USER_CAN_TX() {
 	hTXHeader.MessageMarker = 0;
 	hTXHeader.TxEventFifoControl = 0;
 	hTXHeader.TxFrameType = 0;
+	uint32_t lock = TX_SCHED_LOCK();   // XCP and UDS write the TX FIFO from interrupts
+#if TX_ON_CHANGE
+	FDCAN_FrameTypeDef_t frame = { 0 };
+	FDCAN_FRAME_SET_ID(&frame, hTXHeader.Identifier, hTXHeader.IdType);
+	FDCAN_FRAME_SET_CONTROL(&frame, hTXHeader.DataLength, 0, 0);
+	FDCAN_FRAME_DATA(&frame)[0] = send[0];
+	FDCAN_FRAME_DATA(&frame)[1] = send[1];
+	if (CANCHG_FILTER(&hTxChange, &frame) == CANCHG_SUPPRESS) {
+		TX_SCHED_UNLOCK(lock);
+		return;                        // Same "Hi" as last time
+	}
+#endif
 	CAN1_Tx(&hfdCan1, &hTXHeader, (uint8_t*) send);
+	TX_SCHED_UNLOCK(lock);
 }
 
 volatile uint8_t tc = 1;
@@ -1348,16 +2828,320 @@ void I2C2_EV_IRQHandler() {
 
 }
 
-void FDCAN1_IT0_IRQHandler() {
+/* IR flags handed to the error state manager, in its layout */
+#define FDCAN_ERR_IRQ_FLAGS ((1U << FDCAN_IR_EP_POS) | (1U << FDCAN_IR_EW_POS) \
+		| (1U << FDCAN_IR_BO_POS) | (1U << FDCAN_IR_PEA_POS) \
+		| (1U << FDCAN_IR_PED_POS))
+_Static_assert(FDCAN_ERR_IRQ_FLAGS == CANERR_IR_FLAGS,
+		"can_errstate.h IR layout differs from the device header");
+
+/* IR flags serviced in coalescing mode */
+#define FDCAN_RX_IRQ_COALESCE_FLAGS ((1U << FDCAN_IR_RF0N_POS) \
+		| (1U << FDCAN_IR_RF0F_POS) | (1U << FDCAN_IR_RF0L_POS) \
+		| (1U << FDCAN_IR_TOO_POS))
+
+/**
+ * @brief  Record how long the frame just handled waited since reception
+ * @note   Both values come from the FDCAN timestamp counter (16 bits)
+ */
+FDCAN_INLINE void FDCAN_RX_LATENCY_SAMPLE(FDCAN_Handle_Typedef_t *hFDCAN,
+		uint32_t rxTimestamp) {
+	uint32_t latency = (hFDCAN->Instace->TSCV - rxTimestamp) & 0xFFFF;
+
+	hRxIrqStats.FrameCount++;
+	hRxIrqStats.LatencySum += latency;
+	if (latency > hRxIrqStats.LatencyMax) {
+		hRxIrqStats.LatencyMax = latency;
+	}
+}
+
+/**
+ * @brief  Adaptive mode: switch to polling when interrupts arrive back to back
+ * @note   Called from the ISR after a frame is handled. Once RxBurstFrames
+ *         interrupts each come within RxBurstGap ticks of the previous one,
+ *         RF0N is masked and FDCAN_RX_POLL takes over until the FIFO drains.
+ */
+FDCAN_INLINE void FDCAN_RX_BURST_CHECK(FDCAN_Handle_Typedef_t *hFDCAN) {
+	uint16_t now = (uint16_t) hFDCAN->Instace->TSCV;
+	uint16_t gap = (uint16_t) (now - hFDCAN->RxLastIrqTime);
+
+	hFDCAN->RxLastIrqTime = now;
+	if (gap > hFDCAN->RxBurstGap) {
+		hFDCAN->RxBurstCount = 0;
+		return;
+	}
+
+	if (++hFDCAN->RxBurstCount >= hFDCAN->RxBurstFrames) {
+		CLEAR_BIT_FIELD(hFDCAN->Instace->IE, FDCAN_IR_RF0N_POS);
+		hFDCAN->RxBurstCount = 0;
+		hFDCAN->RxPolling = 1;
+		hRxIrqStats.PollSwitchCount++;
+	}
+}
+
+FDCAN_RAMFUNC void FDCAN1_IT0_IRQHandler() {
+	uint32_t startCycles = CYCLE_COUNTER_READ();
+	ICACHE_Snapshot_t icacheStart = ICACHE_REGION_BEGIN();
+	rxIsrEntryCycles = startCycles;
+
+#if CAN_ERR_MANAGER
+	// Error state changes share the interrupt line with RX FIFO 0
+	uint32_t errFlags = hfdCan1.Instace->IR & FDCAN_ERR_IRQ_FLAGS;
+	if (errFlags != 0) {
+		WRITE_ALL_REG(hfdCan1.Instace->IR, errFlags);
+		CAN_ERR_IRQ(errFlags);
+	}
+#endif
+#if TIME_SYNC == TIME_SYNC_MASTER
+	// A SYNC went out: its FUP carries the start of frame time
+	if (READ_BIT_FIELD(hfdCan1.Instace->IR, FDCAN_IR_TEFN_POS, 0x1)) {
+		WRITE_REG_BIT(hfdCan1.Instace->IR, 1, FDCAN_IR_TEFN_POS);
+		TSYN_NODE_TX_EVENT();
+	}
+#endif
+#if TX_LATEST
+	// A cancel finished: a release parked behind it goes out now. TIM2
+	// shares the priority, so this never cuts into CANTXL_SUBMIT, and
+	// TX_SCHED_LOCK keeps it out of the main loop's TX FIFO writes.
+	if (READ_BIT_FIELD(hfdCan1.Instace->IR, FDCAN_IR_TCF_POS, 0x1)) {
+		WRITE_REG_BIT(hfdCan1.Instace->IR, 1, FDCAN_IR_TCF_POS);
+		CANTXL_COMPLETE(&hTxLatest);
+	}
+#endif
+#if CAN_TRAFFIC_GEN
+	// A frame left the TX FIFO: refill its element at once
+	if (READ_BIT_FIELD(hfdCan1.Instace->IR, FDCAN_IR_TC_POS, 0x1)) {
+		WRITE_REG_BIT(hfdCan1.Instace->IR, 1, FDCAN_IR_TC_POS);
+		CAN_TRAFFIC_POLL();
+	}
+#endif
+#if XCP_ENABLE || UDS_ENABLE
+	// TX FIFO drained: refill it from the XCP DAQ queue and UDS responses
+	if (READ_BIT_FIELD(hfdCan1.Instace->IR, FDCAN_IR_TFE_POS, 0x1)) {
+		WRITE_REG_BIT(hfdCan1.Instace->IR, 1, FDCAN_IR_TFE_POS);
+#if TX_RATE_LIMIT
+		// Frames held by the limiter are older than what comes next
+		CANRL_POLL(&hTxRate);
+		TX_RATE_ARM();
+#endif
+#if XCP_ENABLE
+		XCP_NODE_TX_EMPTY();
+#endif
+#if UDS_ENABLE
+		UDS_NODE_TX_EMPTY();
+#endif
+	}
+#endif
+
+	if (hfdCan1.RxIrqMode == FDCAN_RX_IRQ_COALESCE) {
+		uint32_t flags = hfdCan1.Instace->IR & FDCAN_RX_IRQ_COALESCE_FLAGS;
+		if (flags == 0) {
+			return;
+		}
+
+		// Clear before draining, so a frame arriving mid-drain restarts the timeout
+		WRITE_ALL_REG(hfdCan1.Instace->IR, flags);
+		hRxIrqStats.IsrCount++;
+		if (READ_BIT_FIELD(flags, FDCAN_IR_RF0L_POS, 0x1)) {
+			hRxIrqStats.LostCount++;
+		}
+
+		// Drain the whole batch in one ISR entry
+		while (READ_BIT_FIELD(hfdCan1.Instace->RXF0S, 0, 0x7F) != 0) {
+			USER_CAN_RX();
+			FDCAN_RX_LATENCY_SAMPLE(&hfdCan1, hRXHeader.RxTimestamp);
+		}
+		hRxIrqStats.RxCycles += CYCLE_COUNTER_READ() - startCycles;
+		ICACHE_REGION_END(&icacheIsrStats, icacheStart);
+		return;
+	}
+
+	// Late interrupt after switching to polling: the main loop owns the FIFO
+	if (hfdCan1.RxPolling) {
+		WRITE_REG_BIT(hfdCan1.Instace->IR, 1, FDCAN_IR_RF0N_POS);
+		return;
+	}
+
 	// If new message has come
 	if (READ_BIT_FIELD(hfdCan1.Instace->IR, 0, 0x1)) {
 		// A flag is cleared by writing 1 to the corresponding bit position.
 		WRITE_REG_BIT(hfdCan1.Instace->IR, 1, 0);
+		hRxIrqStats.IsrCount++;
 		// Handling RX
 		USER_CAN_RX();
+		FDCAN_RX_LATENCY_SAMPLE(&hfdCan1, hRXHeader.RxTimestamp);
+
+		if (hfdCan1.RxIrqMode == FDCAN_RX_IRQ_ADAPTIVE) {
+			FDCAN_RX_BURST_CHECK(&hfdCan1);
+		}
+		hRxIrqStats.RxCycles += CYCLE_COUNTER_READ() - startCycles;
+		ICACHE_REGION_END(&icacheIsrStats, icacheStart);
+	}
+}
+
+/**
+ * @brief  Poll RX FIFO 0 and handle up to 'budget' frames
+ * @param  hFDCAN: Pointer to FDCAN handler structure
+ * @param  budget: Max frames to handle in this call
+ * @retval Number of frames handled
+ * @note   Does nothing unless the FIFO is owned by polling (poll mode, or
+ *         adaptive mode after a burst). In adaptive mode RF0N is re-enabled
+ *         once the FIFO is empty; a frame that slipped in while RF0N was
+ *         being re-armed keeps us in polling instead of being missed.
+ */
+FDCAN_RAMFUNC uint32_t FDCAN_RX_POLL(FDCAN_Handle_Typedef_t *hFDCAN, uint32_t budget) {
+	if ((hFDCAN->Instace == 0) || !hFDCAN->RxPolling) {
+		return 0;
+	}
+
+	uint32_t startCycles = CYCLE_COUNTER_READ();
+	uint32_t handled = 0;
+
+	while ((handled < budget)
+			&& (READ_BIT_FIELD(hFDCAN->Instace->RXF0S, 0, 0x7F) != 0)) {
+		USER_CAN_RX();
+		FDCAN_RX_LATENCY_SAMPLE(hFDCAN, hRXHeader.RxTimestamp);
+		handled++;
+	}
+
+	if ((hFDCAN->RxIrqMode == FDCAN_RX_IRQ_ADAPTIVE)
+			&& (READ_BIT_FIELD(hFDCAN->Instace->RXF0S, 0, 0x7F) == 0)) {
+		// Drained: hand reception back to the interrupt
+		WRITE_REG_BIT(hFDCAN->Instace->IR, 1, FDCAN_IR_RF0N_POS);
+		hFDCAN->RxPolling = 0;
+		SET_BIT_FIELD(hFDCAN->Instace->IE, FDCAN_IR_RF0N_POS);
+
+		if (READ_BIT_FIELD(hFDCAN->Instace->RXF0S, 0, 0x7F) != 0) {
+			CLEAR_BIT_FIELD(hFDCAN->Instace->IE, FDCAN_IR_RF0N_POS);
+			hFDCAN->RxPolling = 1;
+		}
+	}
+
+	if (handled != 0) {
+		hRxIrqStats.PollCount++;
+		hRxIrqStats.RxCycles += CYCLE_COUNTER_READ() - startCycles;
+	}
+	return handled;
+}
+
+/**
+ * @brief  CPU load spent on RX handling since the previous call
+ * @retval Load in per-mille (0-1000) of core cycles
+ * @note   Each call closes one measurement window and opens the next.
+ *         RX_LOAD_BENCH compares the three RX modes over a frame rate sweep.
+ */
+uint32_t FDCAN_RX_LOAD_PERMILLE(void) {
+	static uint32_t lastCycles;
+
+	// The ISR adds to RxCycles: read and clear it, and close the window, as one
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	uint32_t now = CYCLE_COUNTER_READ();
+	uint32_t rxCycles = hRxIrqStats.RxCycles;
+	hRxIrqStats.RxCycles = 0;
+	__set_PRIMASK(primask);
+
+	uint32_t elapsed = now - lastCycles;
+	lastCycles = now;
+	if (elapsed == 0) {
+		return 0;
+	}
+	return (uint32_t) (((uint64_t) rxCycles * 1000U) / elapsed);
+}
+
+#if RX_LOAD_BENCH
+
+/**
+ * @brief  Sweep the RX frame rate for each RX mode in FDCAN internal loopback
+ * @note   The real RX path runs: FDCAN1_IT0_IRQHandler, or FDCAN_RX_POLL
+ *         called back to back as the main loop would, into USER_CAN_RX.
+ *         Frames are paced from the cycle counter; a frame that finds the
+ *         TX FIFO full is skipped, so 'sent' shows where the bus saturates.
+ *         Prints one line per mode and rate: frames sent and received, RX
+ *         interrupts, adaptive switches to polling, and the RX load.
+ *         The previous mode, filters and interrupt enables are restored.
+ */
+void RX_LOAD_BENCHMARK(void) {
+	static const uint8_t modeList[] = { FDCAN_RX_IRQ_PER_FRAME,
+			FDCAN_RX_IRQ_POLL, FDCAN_RX_IRQ_ADAPTIVE };
+	static const char *const modeName[] = { "irq", "coalesce", "poll",
+			"adaptive" };
+	static const uint32_t rateList[] = { 250, 1000, 2000, 4000, 8000 }; // frames/s
+	FDCAN_FrameTypeDef_t frame = { 0 };
+	FDCAN_TypeDef_t *fdcan = hfdCan1.Instace;
+	uint32_t cccrMask = (1U << FDCAN_CCCR_MON_POS) | (1U << FDCAN_CCCR_TEST_POS);
+	uint8_t savedMode = hfdCan1.RxIrqMode;
+
+	FDCAN_FRAME_SET_ID(&frame, RX_LOAD_BENCH_ID, FDCAN_ID_STANDARD);
+	FDCAN_FRAME_SET_CONTROL(&frame, FDCAN_DLC_BYTES_8, 0, 0);
+
+	/* Internal loopback, accept every standard ID into RX FIFO 0 */
+	uint32_t savedIe = fdcan->IE;
+	uint32_t savedCccr = fdcan->CCCR & cccrMask;
+	uint32_t savedRxgfc = fdcan->RXGFC;
+	FDCAN_ENTER_INIT_MODE(fdcan);
+	FDCAN_ENABLE_INTERNAL_LOOPBACK(fdcan);
+	REG_MODIFY(fdcan->RXGFC, FDCAN_RXGFC_ANFS_FLD, 0);
+	FDCAN_EXIT_INIT_MODE(fdcan);
+
+	printf("RX load loopback, %lu ms per rate:\n",
+			(unsigned long) RX_LOAD_BENCH_MS);
+	printf("  mode      rate/s   sent  rx    irqs  switch  load\n");
+
+	for (uint32_t m = 0; m < sizeof(modeList); m++) {
+		hfdCan1.RxIrqMode = modeList[m];
+		FDCAN_CONFIG_RX_INTERRUPTS(&hfdCan1);
+
+		for (uint32_t r = 0; r < sizeof(rateList) / sizeof(rateList[0]); r++) {
+			uint32_t period = (BOOT_SYSCLK_MHZ * 1000000U) / rateList[r];
+			uint32_t window = RX_LOAD_BENCH_MS * 1000U * BOOT_SYSCLK_MHZ;
+			uint32_t frames0 = hRxIrqStats.FrameCount;
+			uint32_t isr0 = hRxIrqStats.IsrCount;
+			uint32_t switch0 = hRxIrqStats.PollSwitchCount;
+			uint32_t sent = 0;
+
+			FDCAN_RX_LOAD_PERMILLE();  // Open the measurement window
+			uint32_t start = CYCLE_COUNTER_READ();
+			uint32_t next = start;
+			while ((CYCLE_COUNTER_READ() - start) < window) {
+				if ((int32_t) (CYCLE_COUNTER_READ() - next) >= 0) {
+					next += period;
+					FDCAN_FRAME_DATA(&frame)[0] = (uint8_t) sent;
+					sent += CAN1_TxFrame(&hfdCan1, &frame);
+				}
+				FDCAN_RX_POLL(&hfdCan1, FDCAN_RX_POLL_BUDGET);
+			}
+			uint32_t load = FDCAN_RX_LOAD_PERMILLE();
+
+			printf("  %-8s %7lu %6lu %6lu %6lu %6lu  %lu.%lu%%\n",
+					modeName[modeList[m]], (unsigned long) rateList[r],
+					(unsigned long) sent,
+					(unsigned long) (hRxIrqStats.FrameCount - frames0),
+					(unsigned long) (hRxIrqStats.IsrCount - isr0),
+					(unsigned long) (hRxIrqStats.PollSwitchCount - switch0),
+					(unsigned long) (load / 10U), (unsigned long) (load % 10U));
+		}
+
+		/* Let the last frames in flight arrive before switching mode */
+		delayMS(2);
+		while (FDCAN_RX_POLL(&hfdCan1, FDCAN_RX_POLL_BUDGET) != 0)
+			;
 	}
+
+	/* Restore the previous mode */
+	WRITE_ALL_REG(fdcan->IE, 0);
+	FDCAN_ENTER_INIT_MODE(fdcan);
+	CLEAR_BIT_FIELD(fdcan->TEST, FDCAN_TEST_LBCK_POS);
+	REG_MODIFY(fdcan->CCCR, cccrMask, savedCccr);
+	WRITE_ALL_REG(fdcan->RXGFC, savedRxgfc);
+	FDCAN_EXIT_INIT_MODE(fdcan);
+	hfdCan1.RxIrqMode = savedMode;
+	WRITE_ALL_REG(fdcan->IE, savedIe);
+	FDCAN_CONFIG_RX_INTERRUPTS(&hfdCan1);
 }
 
+#endif /* RX_LOAD_BENCH */
+
 /****************************************************************************
  * System Clock Configuration
  *
@@ -1376,58 +3160,45 @@ void SYSTEM_CLOCK_CONFIG() {
 	/* Set voltage scaling to highest performance level (VOS0) */
 	SET_VAL_BIT(PWR_t->VOSCR, 3, 4);
 
-	/* Reset Flash configuration before changing clock */
-	WRITE_ALL_REG(FLASH_t->ACR, 0);
-
 	/* Configure Flash latency and signal delay for high-frequency operation */
-	SET_VAL_BIT(FLASH_t->ACR, 5, 0);   // Set latency to 5 wait states
-	SET_VAL_BIT(FLASH_t->ACR, 2, 4);   // Set delay to 2 cycles
-
-	/* Reset PLL1 configuration register */
-	WRITE_ALL_REG(RCC_t->PLL1CFGR, 0);
-
-	/* Select HSI as PLL clock source */
-	SET_BIT_FIELD(RCC_t->PLL1CFGR, 0);
-
-	/* Set PLL input division factor (PLLM = 4) */
-	SET_VAL_BIT(RCC_t->PLL1CFGR, 4, 8);
-
-	/* Configure PLL fractional divider */
-	WRITE_REG_BIT(RCC_t->PLL1FRACR, 0, 3);     // Clear first
-	WRITE_REG_BIT(RCC_t->PLL1FRACR, 2048, 3);  // Set value
-
-	/* Set PLL1 input frequency range (range 3: 4-8 MHz) */
-	SET_VAL_BIT(RCC_t->PLL1CFGR, 3, 2);
-
-	/* Enable fractional divider */
-	CLEAR_BIT_FIELD(RCC_t->PLL1CFGR, 4);   // Clear first
-	SET_BIT_FIELD(RCC_t->PLL1CFGR, 4);     // Set the enable bit
-
-	/* Set PLL1 VCO selection (wide range for input frequency > 2MHz) */
-	CLEAR_BIT_FIELD(RCC_t->PLL1CFGR, 5);
-
-	/* Enable PLL output clocks: PLL1P and PLL1Q (for FDCAN) */
-	SET_BIT_FIELD(RCC_t->PLL1CFGR, 16);    // Enable PLL1P output
-	SET_BIT_FIELD(RCC_t->PLL1CFGR, 17);    // Enable PLL1Q output
-	CLEAR_BIT_FIELD(RCC_t->PLL1CFGR, 18);  // Disable PLL1R output
+	REG_WRITE(FLASH_t->ACR,
+			FIELD_CONST(FLASH_ACR_LATENCY_FLD, 5)       // 5 wait states
+			| FIELD_CONST(FLASH_ACR_WRHIGHFREQ_FLD, 2)); // Delay of 2 cycles
+
+	/* Configure PLL fractional divider (latched when FRACEN is set below) */
+	REG_WRITE(RCC_t->PLL1FRACR, FIELD_CONST(RCC_PLL1FRACR_FRACN_FLD, 2048));
+
+	/* Configure PLL1 in one store:
+	 * - HSI as PLL clock source
+	 * - PLL input division factor (PLLM = 4)
+	 * - Input frequency range 3 (4-8 MHz)
+	 * - Fractional divider enabled
+	 * - Wide VCO range (VCOSEL = 0, input frequency > 2MHz)
+	 * - PLL1P and PLL1Q (for FDCAN) outputs enabled, PLL1R disabled
+	 */
+	REG_WRITE(RCC_t->PLL1CFGR,
+			FIELD_CONST(RCC_PLL1CFGR_SRC_FLD, 1)
+			| FIELD_CONST(RCC_PLL1CFGR_M_FLD, 4)
+			| FIELD_CONST(RCC_PLL1CFGR_RGE_FLD, 3)
+			| FIELD_CONST(RCC_PLL1CFGR_FRACEN_FLD, 1)
+			| FIELD_CONST(RCC_PLL1CFGR_VCOSEL_FLD, 0)
+			| FIELD_CONST(RCC_PLL1CFGR_PEN_FLD, 1)
+			| FIELD_CONST(RCC_PLL1CFGR_QEN_FLD, 1)
+			| FIELD_CONST(RCC_PLL1CFGR_REN_FLD, 0));
 
 	/* Configure FDCAN clock source (PLL1Q) */
 	SET_BIT_FIELD(RCC_t->CCIPR5, 8);
 
-	/* Initialize PLL1 dividers */
-	WRITE_ALL_REG(RCC_t->PLL1DIVR, 0);
-
 	/* Configure PLL multiplication and division factors */
-	SET_VAL_BIT(RCC_t->PLL1DIVR, 30, 0);   // PLL1N = 31 (multiplication factor)
-	SET_VAL_BIT(RCC_t->PLL1DIVR, 1, 9);    // PLL1P = 2 (division factor)
-	SET_VAL_BIT(RCC_t->PLL1DIVR, 1, 16);   // PLL1Q = 2 (division factor)
-	SET_VAL_BIT(RCC_t->PLL1DIVR, 1, 24);   // PLL1R = 2 (division factor)
-
-	/* Enable High-Speed Internal oscillator (HSI) */
-	SET_BIT_FIELD(RCC_t->CR, 0);
+	REG_WRITE(RCC_t->PLL1DIVR,
+			FIELD_CONST(RCC_PLL1DIVR_N_FLD, 30)   // PLL1N = 31 (multiplication factor)
+			| FIELD_CONST(RCC_PLL1DIVR_P_FLD, 1)  // PLL1P = 2 (division factor)
+			| FIELD_CONST(RCC_PLL1DIVR_Q_FLD, 1)  // PLL1Q = 2 (division factor)
+			| FIELD_CONST(RCC_PLL1DIVR_R_FLD, 1)); // PLL1R = 2 (division factor)
 
-	/* Configure HSI divider to 1 */
-	CLEAR_VAL_BIT(RCC_t->CR, 0x3, 3);
+	/* Enable High-Speed Internal oscillator (HSI) with divider 1 */
+	REG_MODIFY(RCC_t->CR, RCC_CR_HSION_FLD | RCC_CR_HSIDIV_FLD,
+			FIELD_CONST(RCC_CR_HSION_FLD, 1) | FIELD_CONST(RCC_CR_HSIDIV_FLD, 0));
 
 	/* Wait for HSI to stabilize */
 	while (!(READ_BIT_FIELD(RCC_t->CR, 1, 1)))
@@ -1447,21 +3218,12 @@ void SYSTEM_CLOCK_CONFIG() {
 	while (READ_BIT_FIELD(RCC_t->CFGR1, 3, 0x3) != 0x3)
 		;   // Wait until PLL1 is used as system clock source
 
-	/* Configure bus prescalers for optimal performance */
-	CLEAR_BIT_FIELD(RCC_t->CFGR2, 0);    // AHB prescaler = 1 (SYSCLK = HCLK)
-	CLEAR_BIT_FIELD(RCC_t->CFGR2, 4);    // APB1 prescaler = 1 (HCLK = PCLK1)
-	CLEAR_BIT_FIELD(RCC_t->CFGR2, 8);    // APB2 prescaler = 1 (HCLK = PCLK2)
-	CLEAR_BIT_FIELD(RCC_t->CFGR2, 12);   // APB3 prescaler = 1 (HCLK = PCLK3)
-
-	/* Enable AHB and APB clocks */
-	CLEAR_BIT_FIELD(RCC_t->CFGR2, 16);   // Enable AHB1 clock
-	CLEAR_BIT_FIELD(RCC_t->CFGR2, 17);   // Enable AHB2 clock
-	CLEAR_BIT_FIELD(RCC_t->CFGR2, 20);   // Enable APB1 clock
-	CLEAR_BIT_FIELD(RCC_t->CFGR2, 21);   // Enable APB2 clock
-	CLEAR_BIT_FIELD(RCC_t->CFGR2, 22);   // Enable APB3 clock
+	/* Bus prescalers = 1 (SYSCLK = HCLK = PCLK1/2/3) and
+	 * AHB1/AHB2/APB1/APB2/APB3 clocks enabled, in one read-modify-write */
+	REG_MODIFY(RCC_t->CFGR2, RCC_CFGR2_PRESC_FLD | RCC_CFGR2_CLKDIS_FLD, 0);
 }
 
-uint8_t FDCAN_GET_FREE_TXFIFO_LEVEL(FDCAN_Handle_Typedef_t *hFDCAN) {
+FDCAN_RAMFUNC uint8_t FDCAN_GET_FREE_TXFIFO_LEVEL(FDCAN_Handle_Typedef_t *hFDCAN) {
 	return READ_BIT_FIELD(hFDCAN->Instace->TXFQS, 0, 0x7);
 }
 
@@ -1517,10 +3279,199 @@ uint8_t FDCAN_GET_FREE_TXFIFO_LEVEL(FDCAN_Handle_Typedef_t *hFDCAN) {
  * Each element contains header (2 words) and data field (up to 16 words)
  */
 #define SRAMCAN_TFQ_SIZE (18U * 4U)    // Size of each TX FIFO/Queue element
+#define SRAMCAN_TFQ_ELEMENTS 3U         // TX FIFO/Queue elements, fixed on the H5
+_Static_assert(SRAMCAN_TFQ_ELEMENTS == CANTXL_SLOTS,
+		"can_txlatest.h: TX FIFO size");
 
 static const uint8_t DLCtoBytes[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 12, 16, 20, 24,
 		32, 48, 64 };
 
+/* Address of TX FIFO/Queue element 'idx' in message RAM */
+#define FDCAN_TX_ELEMENT_ADDR(idx) ((volatile uint32_t*) (SRAMCAN_BASE_ADDR \
+		+ SRAMCAN_TFQSA + ((idx) * SRAMCAN_TFQ_SIZE)))
+
+/**
+ * @brief  Copy a compact frame into a TX FIFO/Queue element
+ * @note   The header is already in T0/T1 format, so it is two word stores;
+ *         the payload is copied one word at a time up to the DLC length
+ */
+FDCAN_INLINE void FDCAN_WRITE_TX_ELEMENT(uint32_t put_index,
+		const FDCAN_FrameTypeDef_t *pFrame) {
+	volatile uint32_t *tx_address = FDCAN_TX_ELEMENT_ADDR(put_index);
+	uint32_t words = FDCAN_FRAME_DATA_WORD_COUNT(pFrame);
+
+	tx_address[0] = pFrame->w0;   // T0
+	tx_address[1] = pFrame->w1;   // T1
+	for (uint32_t i = 0; i < words; i++) {
+		tx_address[2 + i] = pFrame->data[i];
+	}
+}
+
+/**
+ * @brief  Account one frame in the bus statistics
+ * @note   Called from the FDCAN and TIM2 ISRs and from the main loop, so
+ *         interrupts are masked for the few dozen cycles of the update
+ */
+FDCAN_INLINE void CAN_STATS_FRAME(const FDCAN_FrameTypeDef_t *pFrame,
+		uint8_t direction) {
+#if CAN_STATS
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	uint32_t start = CYCLE_COUNTER_READ();
+	CANSTATS_FRAME(&hCanStats, pFrame, direction);
+	uint32_t cycles = CYCLE_COUNTER_READ() - start;
+	canStatsCycles += cycles;
+	if (cycles > canStatsCyclesMax) {
+		canStatsCyclesMax = cycles;
+	}
+	__set_PRIMASK(primask);
+#else
+	(void) pFrame;
+	(void) direction;
+#endif
+}
+
+/**
+ * @brief  Charge one frame to the TX token buckets
+ * @note   Masks interrupts like CAN_STATS_FRAME; a frame held back arms
+ *         TIM2 CC3 for its token
+ * @retval CANRL_PASS, CANRL_QUEUED or CANRL_DROPPED
+ */
+FDCAN_INLINE uint8_t TX_RATE_SUBMIT(const FDCAN_FrameTypeDef_t *pFrame) {
+#if TX_RATE_LIMIT
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	uint32_t start = CYCLE_COUNTER_READ();
+	uint8_t verdict = CANRL_SUBMIT(&hTxRate, pFrame);
+	uint32_t cycles = CYCLE_COUNTER_READ() - start;
+	txRateCycles += cycles;
+	if (cycles > txRateCyclesMax) {
+		txRateCyclesMax = cycles;
+	}
+	if (verdict == CANRL_QUEUED) {
+		TX_RATE_ARM();
+	}
+	__set_PRIMASK(primask);
+	return verdict;
+#else
+	(void) pFrame;
+	return CANRL_PASS;
+#endif
+}
+
+/**
+ * @brief  Check a received frame of an E2E RX channel
+ */
+FDCAN_INLINE void E2E_RX_FRAME(const FDCAN_FrameTypeDef_t *pFrame) {
+#if E2E_ENABLE
+	E2E_NODE_CHECK(pFrame);
+#else
+	(void) pFrame;
+#endif
+}
+
+/**
+ * @brief  Pass a received SYNC or FUP to the time slave
+ */
+FDCAN_INLINE void TSYN_RX_FRAME(const FDCAN_FrameTypeDef_t *pFrame) {
+#if TIME_SYNC == TIME_SYNC_SLAVE
+	if (FDCAN_FRAME_GET_ID(pFrame) == TIME_SYNC_ID
+			&& !FDCAN_FRAME_IS_EXTENDED(pFrame)) {
+		TSYN_NODE_RX(pFrame);
+	}
+#else
+	(void) pFrame;
+#endif
+}
+
+/**
+ * @brief  Hooks every received frame goes through, whatever path reads it
+ */
+FDCAN_INLINE void CAN1_RX_TAP(const FDCAN_FrameTypeDef_t *pFrame) {
+	CAN_STATS_FRAME(pFrame, CANSTATS_RX);
+	E2E_RX_FRAME(pFrame);
+	TSYN_RX_FRAME(pFrame);
+}
+
+/* Copy a frame into the TX FIFO and request it, 0 if the FIFO is full */
+FDCAN_INLINE uint8_t CAN1_TX_WRITE(FDCAN_Handle_Typedef_t *hFDCAN,
+		const FDCAN_FrameTypeDef_t *pFrame) {
+	if (FDCAN_GET_FREE_TXFIFO_LEVEL(hFDCAN) == 0) {
+		return 0;  // Cannot transmit if FIFO is full
+	}
+
+	uint8_t put_index = READ_BIT_FIELD(hFDCAN->Instace->TXFQS, 16, 0x1F);
+	FDCAN_WRITE_TX_ELEMENT(put_index, pFrame);
+
+	/* TXBAR only acts on bits written as 1, no read-modify-write needed */
+	WRITE_REG_BIT(hFDCAN->Instace->TXBAR, 1U, put_index);
+	BOOT_MARK(BOOT_PHASE_FIRST_TX);
+	CAN_STATS_FRAME(pFrame, CANSTATS_TX);
+	return 1;
+}
+
+/**
+ * @brief  Transmit a compact frame without any field repacking
+ * @param  hFDCAN: Pointer to FDCAN handler structure
+ * @param  pFrame: Frame with T0/T1 words already built
+ * @retval 1 if the frame was queued, or held by the rate limiter to be sent
+ *         later; 0 if the TX FIFO is full or the limiter dropped it
+ */
+FDCAN_RAMFUNC uint8_t CAN1_TxFrame(FDCAN_Handle_Typedef_t *hFDCAN,
+		const FDCAN_FrameTypeDef_t *pFrame) {
+#if TX_RATE_LIMIT
+	if (FDCAN_GET_FREE_TXFIFO_LEVEL(hFDCAN) == 0) {
+		return 0;  // Before the limiter spends a token on it
+	}
+	uint8_t verdict = TX_RATE_SUBMIT(pFrame);
+	if (verdict != CANRL_PASS) {
+		return verdict == CANRL_QUEUED;
+	}
+#endif
+	return CAN1_TX_WRITE(hFDCAN, pFrame);
+}
+
+#if TX_LATEST
+/* TX FIFO state for the latest-value policy */
+static void TX_LATEST_READ(void *ctx, CANTXL_FifoTypeDef_t *pFifo) {
+	FDCAN_Handle_Typedef_t *hFDCAN = ctx;
+	uint32_t txfqs = hFDCAN->Instace->TXFQS;
+
+	pFifo->Pending = hFDCAN->Instace->TXBRP;
+	pFifo->Sent = hFDCAN->Instace->TXBTO;
+	pFifo->FreeLevel = (uint8_t) READ_BIT_FIELD(txfqs, 0, 0x7);
+	pFifo->GetIndex = (uint8_t) READ_BIT_FIELD(txfqs, 8, 0x1F);
+	for (uint32_t i = 0; i < SRAMCAN_TFQ_ELEMENTS; i++) {
+		pFifo->T0[i] = FDCAN_TX_ELEMENT_ADDR(i)[0];
+	}
+}
+
+static void TX_LATEST_CANCEL(void *ctx, uint8_t slot) {
+	WRITE_ALL_REG(((FDCAN_Handle_Typedef_t*) ctx)->Instace->TXBCR, 1UL << slot);
+}
+
+static uint8_t TX_LATEST_TRANSMIT(void *ctx, const FDCAN_FrameTypeDef_t *pFrame) {
+	return CAN1_TxFrame(ctx, pFrame);
+}
+
+/* A parked release was lost after all: count it and let the next one out */
+static void TX_LATEST_LOST(void *ctx, const FDCAN_FrameTypeDef_t *pFrame) {
+	(void) ctx;
+	for (uint32_t i = 0; i < txSchedCount; i++) {
+		TX_SchedEntryTypeDef_t *e = &txSchedTable[i];
+		if (FDCAN_FRAME_GET_ID(&e->Frame) == FDCAN_FRAME_GET_ID(pFrame)
+				&& FDCAN_FRAME_IS_EXTENDED(&e->Frame)
+						== FDCAN_FRAME_IS_EXTENDED(pFrame)) {
+			e->Dropped++;
+			break;
+		}
+	}
+#if TX_ON_CHANGE
+	CANCHG_INVALIDATE(&hTxChange, pFrame); // Not on the bus
+#endif
+}
+#endif
+
 /****************************************************************************
  * CAN Transmit Function
  *
@@ -1535,7 +3486,7 @@ static const uint8_t DLCtoBytes[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 12, 16, 20, 24,
  * @brief  Transmit a CAN message with GPIOB indicator
  * @note   Sends a message with ID 0x123 containing "HELLO" text and controls GPIOB4-6 based on put_index
  */
-void CAN1_Tx(FDCAN_Handle_Typedef_t *hFDCAN, FDCAN_TxHeaderTypeDef_t *hTXHeader,
+FDCAN_RAMFUNC void CAN1_Tx(FDCAN_Handle_Typedef_t *hFDCAN, FDCAN_TxHeaderTypeDef_t *hTXHeader,
 		uint8_t *pTxData) {
 	/* 1. Check if TX FIFO has space available */
 	uint8_t fifo_free_level = FDCAN_GET_FREE_TXFIFO_LEVEL(hFDCAN);
@@ -1551,7 +3502,7 @@ void CAN1_Tx(FDCAN_Handle_Typedef_t *hFDCAN, FDCAN_TxHeaderTypeDef_t *hTXHeader,
 	printf("TX buffer index: %d\n", put_index);
 
 	/* 3. Prepare TX header words for message RAM */
-	uint32_t tx_element_w1, tx_element_w2;
+	FDCAN_FrameTypeDef_t txFrame;
 
 	/* Configure first word of TX element (T0) - Header with ID and control bits */
 
@@ -1559,16 +3510,20 @@ void CAN1_Tx(FDCAN_Handle_Typedef_t *hFDCAN, FDCAN_TxHeaderTypeDef_t *hTXHeader,
 	 * Bit 31: ESI (Error State Indicator)
 	 * Bit 30: XTD (Extended Identifier - 0 for standard ID)
 	 * Bit 29: RTR (Remote Transmission Request)
-	 * Bits 28-18: Standard Identifier (11 bits)
+	 * Bits 28-18: Standard Identifier (11 bits), or
+	 * Bits 28-0: Extended Identifier (29 bits)
+	 * IdType, TxFrameType and ESI are flags: FDCAN_EXTENDED_ID or 1 both
+	 * select a 29-bit ID, so they are tested, never OR-ed in as bits.
 	 */
-	uint8_t ESI = hTXHeader->ErrorStateIndicator;
-	uint8_t idConfig = hTXHeader->IdType;
-	uint8_t RTR = hTXHeader->TxFrameType;
-	uint32_t identifier = (hTXHeader->Identifier << 18); // Standard ID placed at bit position 18
-
-	/* Combine all fields into first word */
-	tx_element_w1 = (ESI | idConfig | RTR | identifier);
-	printf("TX header word 1: 0x%08lx\n", tx_element_w1);
+	FDCAN_FRAME_SET_ID(&txFrame, hTXHeader->Identifier,
+			hTXHeader->IdType != FDCAN_STANDARD_ID);
+	if (hTXHeader->TxFrameType != 0) {
+		FDCAN_FRAME_SET_REMOTE(&txFrame);
+	}
+	if (hTXHeader->ErrorStateIndicator != 0) {
+		txFrame.w0 |= (1UL << FDCAN_ELEM_ESI_POS);
+	}
+	printf("TX header word 1: 0x%08lx\n", txFrame.w0);
 
 	/* Configure second word of TX element (T1) - Contains DLC and other control bits */
 	/* Build the T1 register (second word)
@@ -1585,36 +3540,38 @@ void CAN1_Tx(FDCAN_Handle_Typedef_t *hFDCAN, FDCAN_TxHeaderTypeDef_t *hTXHeader,
 	uint32_t DLC = (hTXHeader->DataLength << 16);
 
 	/* Combine all fields into second word */
-	tx_element_w2 = (messageMaker | eventFifoControl | fdFormat | BRS | DLC);
-	printf("TX header word 2: 0x%08lx\n", tx_element_w2);
-
-	/* 4. Calculate the memory address for this TX element */
-	uint32_t TxFIFOQSA = SRAMCAN_BASE_ADDR + SRAMCAN_TFQSA;
-	uint32_t *tx_address = (uint32_t*) (TxFIFOQSA
-			+ (put_index * SRAMCAN_TFQ_SIZE));
-	printf("TX buffer address: 0x%08lx\n", (uint32_t) tx_address);
-
-	/* 5. Write the header words to the message RAM */
-	*tx_address = tx_element_w1;  // Write T0 register
-	tx_address++;                 // Move to next word
-	*tx_address = tx_element_w2;  // Write T1 register
-	tx_address++;                 // Move to data section
-
-	/* 6. Prepare and write data bytes */
-	uint32_t ByteCounter;
+	txFrame.w1 = (messageMaker | eventFifoControl | fdFormat | BRS | DLC);
+	printf("TX header word 2: 0x%08lx\n", txFrame.w1);
 
-	/* Write Tx payload to the message RAM */
-	for (ByteCounter = 0; ByteCounter < DLCtoBytes[hTXHeader->DataLength];
-			ByteCounter += 4U) {
-		*tx_address = (((uint32_t) pTxData[ByteCounter + 3U] << 24U)
-				| ((uint32_t) pTxData[ByteCounter + 2U] << 16U)
+	/* Pack payload bytes into little-endian words */
+	uint32_t ByteCounter;
+	for (ByteCounter = 0; (ByteCounter < DLCtoBytes[hTXHeader->DataLength])
+			&& (ByteCounter < FDCAN_FRAME_MAX_DATA); ByteCounter += 4U) {
+		txFrame.data[ByteCounter >> 2] = (((uint32_t) pTxData[ByteCounter + 3U]
+				<< 24U) | ((uint32_t) pTxData[ByteCounter + 2U] << 16U)
 				| ((uint32_t) pTxData[ByteCounter + 1U] << 8U)
 				| (uint32_t) pTxData[ByteCounter]);
-		tx_address++;
 	}
+
+#if TX_RATE_LIMIT
+	uint8_t verdict = TX_RATE_SUBMIT(&txFrame);
+	if (verdict != CANRL_PASS) {
+		printf("TX rate limited: %s\n",
+				verdict == CANRL_QUEUED ? "held" : "dropped");
+		return;
+	}
+#endif
+
+	/* 4.-6. Copy header and payload words into the TX element */
+	printf("TX buffer address: 0x%08lx\n",
+			(uint32_t) FDCAN_TX_ELEMENT_ADDR(put_index));
+	FDCAN_WRITE_TX_ELEMENT(put_index, &txFrame);
+
 	/* 7. Request transmission by setting the corresponding bit in TXBAR register */
 	printf("Requesting transmission for buffer %d\n", put_index);
 	SET_BIT_FIELD(hFDCAN->Instace->TXBAR, put_index);
+	BOOT_MARK(BOOT_PHASE_FIRST_TX);
+	CAN_STATS_FRAME(&txFrame, CANSTATS_TX);
 
 	/* 8. Verify if the request was accepted (added to pending list) */
 
@@ -1657,139 +3614,2725 @@ uint8_t FDCAN_GET_FREE_RXFIFO_LEVEL(FDCAN_Handle_Typedef_t *hFDCAN,
 /* Size of each RX FIFO element (same structure as TX element) */
 #define SRAMCAN_RFQ_SIZE (18*4)
 
+/* Number of elements in RX FIFO 0 */
+#define SRAMCAN_RF0_NBR 3U
+
+/* Address of RX FIFO 0 element 'idx' in message RAM */
+#define FDCAN_RX_ELEMENT_ADDR(idx) ((volatile uint32_t*) (SRAMCAN_BASE_ADDR \
+		+ SRAMCAN_RFQSA + ((idx) * SRAMCAN_RFQ_SIZE)))
+
 /**
- * @brief  Configure and check for received CAN messages
- * @note   Reads any available messages from RX FIFO 0
+ * @brief  Copy an RX FIFO 0 element into a compact frame
+ * @note   Two word loads for R0/R1, then only the payload words the DLC needs
  */
+FDCAN_INLINE void FDCAN_READ_RX_ELEMENT(uint32_t get_index,
+		FDCAN_FrameTypeDef_t *pFrame) {
+	volatile uint32_t *rx_address = FDCAN_RX_ELEMENT_ADDR(get_index);
+
+	pFrame->w0 = rx_address[0];   // R0
+	pFrame->w1 = rx_address[1];   // R1
+
+	uint32_t words = FDCAN_FRAME_DATA_WORD_COUNT(pFrame);
+	for (uint32_t i = 0; i < words; i++) {
+		pFrame->data[i] = rx_address[2 + i];
+	}
+}
+
 /**
- * @brief  Configure and check for received CAN messages with GPIOB indicator
- * @note   Reads any available messages from RX FIFO 0 and controls GPIOB4-6 based on get_index
+ * @brief  Record ISR entry to frame-available time for the first frame of an ISR
+ * @note   Compare min/max between FDCAN_RAM_EXEC = 0 and 1 for latency and jitter
  */
-void CAN1_Rx(FDCAN_Handle_Typedef_t *hFDCAN, FDCAN_RX_HEADER *hRXHeader,
-		uint8_t *receivedData) {
-	/* 1. Check if there are any messages in RX FIFO 0 */
-	uint8_t fifo_level = FDCAN_GET_FREE_RXFIFO_LEVEL(hFDCAN,
-	FDCAN_RX_FIFO0_t); // F0FL field
+FDCAN_INLINE void FDCAN_RX_ENTRY_SAMPLE(void) {
+	if (rxIsrEntryCycles == 0) {
+		return;  // Not called from the ISR, or already sampled
+	}
 
-	if (fifo_level == 0) {
-		printf("RX FIFO is empty\n");
-		return;  // No messages to process
+	uint32_t cycles = CYCLE_COUNTER_READ() - rxIsrEntryCycles;
+	rxIsrEntryCycles = 0;
+
+	if ((hRxIrqStats.EntryCyclesMin == 0) || (cycles < hRxIrqStats.EntryCyclesMin)) {
+		hRxIrqStats.EntryCyclesMin = cycles;
+	}
+	if (cycles > hRxIrqStats.EntryCyclesMax) {
+		hRxIrqStats.EntryCyclesMax = cycles;
 	}
+}
 
-	printf("RX FIFO level: %d\n", fifo_level);
+/**
+ * @brief  Get the RX FIFO 0 element to read next
+ * @retval Element index, or 0xFF if the FIFO is empty
+ * @note   In overwrite mode a full FIFO may have its oldest element replaced
+ *         while we read it, so the next element is used instead
+ */
+FDCAN_INLINE uint8_t FDCAN_RX_FIFO0_GET_INDEX(FDCAN_Handle_Typedef_t *hFDCAN) {
+	uint32_t rxf0s = hFDCAN->Instace->RXF0S;
 
-	/* 2. Handle overwrite mode condition if enabled */
-	uint8_t get_index = 0;
+	if (READ_BIT_FIELD(rxf0s, 0, 0x7F) == 0) {
+		return 0xFF;
+	}
 
-	/* Check if FIFO is full and in overwrite mode */
-	if ((READ_BIT_FIELD(hFDCAN->Instace->RXF0S, 24, 0x1) == 1) && // F0F bit (FIFO full)
-			(READ_BIT_FIELD(hFDCAN->Instace->RXGFC, 4, 0x1) == 1)) { // F0OM bit (Overwrite mode)
-		printf("FIFO full in overwrite mode - incrementing get_index\n");
-		get_index = 1;  // Skip oldest message to avoid race condition
+	uint8_t get_index = READ_BIT_FIELD(rxf0s, 8, 0x3);  // F0GI field
+	if ((READ_BIT_FIELD(rxf0s, 24, 0x1) == 1) &&       // F0F bit (FIFO full)
+			(READ_BIT_FIELD(hFDCAN->Instace->RXGFC, 4, 0x1) == 1)) { // F0OM bit
+		get_index = (get_index + 1U) % SRAMCAN_RF0_NBR;
 	}
+	return get_index;
+}
 
-	/* 3. Get current get index from the status register */
-	get_index += READ_BIT_FIELD(hFDCAN->Instace->RXF0S, 8, 0x3);  // F0GI field
-	printf("Get index: %d\n", get_index);
+/**
+ * @brief  Receive one frame from RX FIFO 0 without any field unpacking
+ * @param  hFDCAN: Pointer to FDCAN handler structure
+ * @param  pFrame: Destination frame
+ * @retval 1 if a frame was read, 0 if RX FIFO 0 was empty
+ */
+FDCAN_RAMFUNC uint8_t CAN1_RxFrame(FDCAN_Handle_Typedef_t *hFDCAN,
+		FDCAN_FrameTypeDef_t *pFrame) {
+	uint8_t get_index = FDCAN_RX_FIFO0_GET_INDEX(hFDCAN);
 
-	/* Control GPIOB pins based on get_index value */
-	if (get_index == 0) {
-		/* For get_index = 0: Set B4 HIGH, B5 and B6 LOW */
-		GPIO_OUTPUT_t(GPIOB_t, 0, HIGH);
-		GPIO_OUTPUT_t(GPIOB_t, 1, LOW);
-		GPIO_OUTPUT_t(GPIOB_t, 2, LOW);
-	} else if (get_index == 1) {
-		/* For get_index = 1: Set B5 HIGH, B4 and B6 LOW */
-		GPIO_OUTPUT_t(GPIOB_t, 0, LOW);
-		GPIO_OUTPUT_t(GPIOB_t, 1, HIGH);
-		GPIO_OUTPUT_t(GPIOB_t, 2, LOW);
-	} else if (get_index == 2) {
-		/* For get_index = 2: Set B6 HIGH, B4 and B5 LOW */
-		GPIO_OUTPUT_t(GPIOB_t, 0, LOW);
-		GPIO_OUTPUT_t(GPIOB_t, 1, LOW);
-		GPIO_OUTPUT_t(GPIOB_t, 2, HIGH);
-	} else {
-		/* For any other get_index: Set all pins LOW */
-		GPIO_OUTPUT_t(GPIOB_t, 0, LOW);
-		GPIO_OUTPUT_t(GPIOB_t, 1, LOW);
-		GPIO_OUTPUT_t(GPIOB_t, 2, LOW);
+	if (get_index == 0xFF) {
+		return 0;
 	}
 
-	/* 4. Calculate address of the RX element in message RAM */
-	uint32_t RxFIFOQSA = SRAMCAN_BASE_ADDR + SRAMCAN_RFQSA;
-	uint32_t *rx_address = (uint32_t*) (RxFIFOQSA
-			+ (get_index * SRAMCAN_RFQ_SIZE));
+	FDCAN_READ_RX_ELEMENT(get_index, pFrame);
+	FDCAN_RX_ENTRY_SAMPLE();
+	BOOT_MARK(BOOT_PHASE_FIRST_RX);
+	CAN1_RX_TAP(pFrame);
 
-	printf("RX address: 0x%08X\n", (unsigned int) rx_address);
-
-	/* 5. Extract message information from the RX element */
-	/* Read first word (R0) - Contains ID and frame information */
-	uint32_t word1 = *rx_address;
-	uint8_t ESI = ((word1 >> 31) & 0x1);       // Error state indicator
-	hRXHeader->ErrorStateIndicator = ESI;
-	uint8_t bit_identifier = ((word1 >> 30) & 0x1); // 0=standard, 1=extended
-	hRXHeader->IdType = bit_identifier;
-	uint8_t RTR = ((word1 >> 29) & 0x1);      // Remote transmission request
-	hRXHeader->RxFrameType = RTR;
-	uint32_t identifier;
+	/* Acknowledge so the hardware advances the get index */
+	hFDCAN->Instace->RXF0A = get_index;
+	return 1;
+}
 
-	printf("Word1: 0x%08X\n", (unsigned int) word1);
-	printf("ESI: %d, ID Type: %s, RTR: %d\n", hRXHeader->ErrorStateIndicator,
-			(bit_identifier == 0) ? "Standard" : "Extended",
-			hRXHeader->RxFrameType);
+/****************************************************************************
+ * Periodic TX Scheduler
+ *
+ * Each frame has its own period and offset. TIM2 counts microseconds and
+ * compare channel 1 is always armed for the earliest pending release, so a
+ * frame leaves at its compare time plus only the interrupt latency, whatever
+ * the main loop is doing.
+ ****************************************************************************/
 
-	/* Extract message ID based on format */
-	if (bit_identifier == 0) {  // Standard ID (11 bits)
-		identifier = (word1 >> 18) & 0x7FF;
-		printf("Standard ID: 0x%03lX\n", identifier);
-	} else {  // Extended ID (29 bits)
-		identifier = word1 & 0x1FFFFFFF;
-		printf("Extended ID: 0x%08lX\n", identifier);
-	}
-	hRXHeader->Identifier = identifier;
-
-	/* Read second word (R1) - Contains DLC and additional flags */
-	rx_address++;
-	uint32_t word2 = *rx_address;
-
-	uint8_t ANMF = ((word2 >> 31) & 0x1);     // Accepted non-matching frame
-	hRXHeader->IsFilterMatchingFrame = ANMF;
-	uint8_t FRAME_FORMAT = ((word2 >> 21) & 0x1); // CAN FD format
-	hRXHeader->FDFormat = FRAME_FORMAT;
-	uint8_t BRS = ((word2 >> 20) & 0x1);        // Bit rate switching
-	hRXHeader->BitRateSwitch = BRS;
-	uint8_t DLC = ((word2 >> 16) & 0xFF);       // Data length code
-	hRXHeader->DataLength = DLC;
-
-	printf("Word2: 0x%08X\n", (unsigned int) word2);
-	printf("ANMF: %d, Frame Format: %d, BRS: %d\n", ANMF, FRAME_FORMAT, BRS);
-	printf("DLC: %d\n", DLC);
+/**
+ * @brief  Disable an interrupt in the NVIC
+ * @retval 1 if it was enabled, to hand back to NVIC_IRQ_RESTORE
+ * @note   Sections built on this nest: an inner one, also from an ISR,
+ *         only re-enables what was enabled when it started
+ */
+FDCAN_INLINE uint32_t NVIC_IRQ_SAVE(uint32_t irq) {
+	uint32_t bit = 1UL << (irq % 32);
+	uint32_t enabled = (NVIC_ISER0_p[irq / 32] & bit) != 0;
 
-	/* Move to data section */
-	rx_address++;
+	NVIC_ICER0_p[irq / 32] = bit;
+	return enabled;
+}
 
-	/* Extract and display data bytes */
-	uint8_t *data_ptr = (uint8_t*) rx_address;  // Use a separate pointer
+FDCAN_INLINE void NVIC_IRQ_RESTORE(uint32_t irq, uint32_t enabled) {
+	if (enabled) {
+		NVIC_ISER0_p[irq / 32] = 1UL << (irq % 32);
+	}
+}
 
-	/* Copy data to the receivedData array */
-	for (int i = 0; i < DLC && i < 8; i++) {  // Limit to array size
-		receivedData[i] = data_ptr[i];
+/**
+ * @brief  Keep the scheduler out while the main loop queues a frame
+ * @note   Releases write the same TX FIFO put index as CAN1_Tx/CAN1_TxFrame.
+ *         With XCP, UDS, J1939, a time sync master or TX_LATEST the FDCAN
+ *         interrupt sends frames as well, and with FW_UPDATE the flash interrupt
+ *         answers waiting UDS requests.
+ * @retval Interrupts that were enabled, for TX_SCHED_UNLOCK
+ */
+FDCAN_INLINE uint32_t TX_SCHED_LOCK(void) {
+	uint32_t saved = 0;
+
+	if (TX_SCHED || XCP_ENABLE || UDS_ENABLE || TX_RATE_LIMIT || J1939_ENABLE
+			|| TIME_SYNC == TIME_SYNC_MASTER || TX_LATEST) {
+		saved |= NVIC_IRQ_SAVE(TIM2_IRQ_t) << TX_LOCK_TIM2_POS;
+		if (XCP_ENABLE || UDS_ENABLE || J1939_ENABLE
+				|| TIME_SYNC == TIME_SYNC_MASTER || TX_LATEST) {
+			saved |= NVIC_IRQ_SAVE(FDCAN1_IT0_IRQ_t) << TX_LOCK_FDCAN_POS;
+		}
+		if (FW_UPDATE) {
+			saved |= NVIC_IRQ_SAVE(FLASH_IRQ_t) << TX_LOCK_FLASH_POS;
+		}
+		__DSB();
+		__ISB();
 	}
+	return saved;
+}
 
-	/* Null-terminate if treating as string */
-	if (DLC < 8) {
-		receivedData[DLC] = '\0';
+FDCAN_INLINE void TX_SCHED_UNLOCK(uint32_t saved) {
+	NVIC_IRQ_RESTORE(TIM2_IRQ_t, READ_BIT_FIELD(saved, TX_LOCK_TIM2_POS, 0x1));
+	NVIC_IRQ_RESTORE(FDCAN1_IT0_IRQ_t,
+			READ_BIT_FIELD(saved, TX_LOCK_FDCAN_POS, 0x1));
+	NVIC_IRQ_RESTORE(FLASH_IRQ_t, READ_BIT_FIELD(saved, TX_LOCK_FLASH_POS, 0x1));
+}
+
+/**
+ * @brief  Add a periodic frame, before TX_SCHED_START
+ * @param  offsetUs: phase within the period, or TX_SCHED_AUTO_OFFSET
+ * @retval 1 if added, 0 if the table is full or the period is 0
+ */
+uint8_t TX_SCHED_ADD(const FDCAN_FrameTypeDef_t *pFrame, uint32_t periodUs,
+		uint32_t offsetUs, TX_SchedUpdate_t update) {
+	if (txSchedCount == TX_SCHED_MAX_ENTRIES || periodUs == 0) {
+		return 0;
 	}
+	TX_SchedEntryTypeDef_t *e = &txSchedTable[txSchedCount++];
+	e->Frame = *pFrame;
+	e->PeriodUs = periodUs;
+	e->OffsetUs = offsetUs;
+	e->Update = update;
+	return 1;
+}
 
-	/* Display in hexadecimal format */
-	printf("Data (hex): ");
-	for (int i = 0; i < DLC; i++) {
-		printf("%02X ", data_ptr[i]);  // Use data_ptr for printf
+static uint32_t TX_SCHED_GCD(uint32_t a, uint32_t b) {
+	while (b != 0) {
+		uint32_t t = a % b;
+		a = b;
+		b = t;
 	}
-	printf("\n");
+	return a;
+}
 
-	/* Display as ASCII characters if printable */
-	printf("Data (char): ");
+/**
+ * @brief  Pick offsets for TX_SCHED_AUTO_OFFSET entries, shortest period first
+ * @note   Two frames with periods Pa, Pb and offsets Oa, Ob meet as close as
+ *         (Oa - Ob) mod gcd(Pa, Pb) over the hyperperiod, so each candidate
+ *         offset is scored by its smallest such distance to the frames
+ *         already placed, and the widest one wins.
+ */
+static void TX_SCHED_SPREAD_OFFSETS(void) {
+	uint8_t placed[TX_SCHED_MAX_ENTRIES] = { 0 };
+
+	for (uint32_t i = 0; i < txSchedCount; i++) {
+		if (txSchedTable[i].OffsetUs != TX_SCHED_AUTO_OFFSET) {
+			placed[i] = 1;
+		}
+	}
+
+	for (;;) {
+		/* Next unplaced entry with the shortest period */
+		TX_SchedEntryTypeDef_t *e = NULL;
+		uint32_t idx = 0;
+		for (uint32_t i = 0; i < txSchedCount; i++) {
+			if (!placed[i]
+					&& (e == NULL || txSchedTable[i].PeriodUs < e->PeriodUs)) {
+				e = &txSchedTable[i];
+				idx = i;
+			}
+		}
+		if (e == NULL) {
+			return;
+		}
+
+		uint32_t bestOffset = 0;
+		uint32_t bestDistance = 0;
+		for (uint32_t o = 0; o < e->PeriodUs; o += TX_SCHED_SLOT_US) {
+			uint32_t distance = UINT32_MAX;
+			for (uint32_t j = 0; j < txSchedCount; j++) {
+				if (!placed[j]) {
+					continue;
+				}
+				const TX_SchedEntryTypeDef_t *p = &txSchedTable[j];
+				uint32_t g = TX_SCHED_GCD(e->PeriodUs, p->PeriodUs);
+				uint32_t r = (o + g - (p->OffsetUs % g)) % g;
+				uint32_t d = (r < g - r) ? r : g - r;
+				if (d < distance) {
+					distance = d;
+				}
+			}
+			if (distance > bestDistance) {
+				bestDistance = distance;
+				bestOffset = o;
+			}
+			if (distance == UINT32_MAX) {
+				break;         // Nothing placed yet, offset 0 is as good as any
+			}
+		}
+		e->OffsetUs = bestOffset;
+		placed[idx] = 1;
+	}
+}
+
+/**
+ * @brief  Re-arm TIM2 CC1 for the earliest pending release
+ */
+FDCAN_INLINE void TX_SCHED_ARM(uint32_t now) {
+	uint32_t next = txSchedTable[0].NextRelease;
+	for (uint32_t i = 1; i < txSchedCount; i++) {
+		if ((int32_t) (txSchedTable[i].NextRelease - now)
+				< (int32_t) (next - now)) {
+			next = txSchedTable[i].NextRelease;
+		}
+	}
+	TIM2_t->CCR1 = next;
+}
+
+/**
+ * @brief  Place every frame on the time line and enable the compare interrupt
+ * @note   Needs TIM2 running and FDCAN1 out of init mode
+ */
+void TX_SCHED_START(void) {
+	if (txSchedCount == 0) {
+		return;
+	}
+	TX_SCHED_SPREAD_OFFSETS();
+
+	// Offset 0 is due at once: the first frame counts toward BOOT_TTFF_BUDGET_US
+	uint32_t start = TIM2_t->CNT;
+	for (uint32_t i = 0; i < txSchedCount; i++) {
+		TX_SchedEntryTypeDef_t *e = &txSchedTable[i];
+		e->NextRelease = start + e->OffsetUs;
+		e->DevMinCycles = INT32_MAX;
+		e->DevMaxCycles = INT32_MIN;
+	}
+	TX_SCHED_ARM(TIM2_t->CNT);
+
+#if TX_LATEST
+	hTxLatest.Read = TX_LATEST_READ;
+	hTxLatest.Cancel = TX_LATEST_CANCEL;
+	hTxLatest.Transmit = TX_LATEST_TRANSMIT;
+	hTxLatest.Lost = TX_LATEST_LOST;
+	hTxLatest.Ctx = &hfdCan1;
+	CANTXL_INIT(&hTxLatest);
+
+	// Cancellation finished, for all three TX buffers
+	WRITE_ALL_REG(hfdCan1.Instace->TXBCIE, 0x7U);
+	WRITE_REG_BIT(hfdCan1.Instace->IR, 1, FDCAN_IR_TCF_POS);
+	SET_BIT_FIELD(hfdCan1.Instace->IE, FDCAN_IR_TCF_POS);
+#endif
+	CLEAR_BIT_FIELD(TIM2_t->SR, TIM_SR_CC1IF_POS);
+	SET_BIT_FIELD(TIM2_t->DIER, TIM_DIER_CC1IE_POS);
+	NVIC_ISER0_p[TIM2_IRQ_t / 32] = (1UL << (TIM2_IRQ_t % 32));
+
+	// CNT is already past a compare at 'start': raise CC1 by hand instead
+	WRITE_ALL_REG(TIM2_t->EGR, 1U << TIM_EGR_CC1G_POS);
+}
+
+/**
+ * @brief  TIM2 CC1: release every frame whose time has come
+ * @note   Period jitter is taken from the cycle counter right before the
+ *         TX FIFO write, so it includes the interrupt latency and the
+ *         frames released ahead in the same interrupt. CC2 is the XCP
+ *         DAQ clock, CC3 the rate limiter's, CC4 the traffic generator's.
+ */
+FDCAN_RAMFUNC void TIM2_IRQHandler(void) {
+#if XCP_ENABLE
+	if (READ_BIT_FIELD(TIM2_t->SR, TIM_SR_CC2IF_POS, 0x1)) {
+		WRITE_ALL_REG(TIM2_t->SR, ~(1U << TIM_SR_CC2IF_POS)); // rc_w0
+		XCP_NODE_TICK();
+	}
+#endif
+#if TX_RATE_LIMIT
+	if (READ_BIT_FIELD(TIM2_t->DIER, TIM_DIER_CC3IE_POS, 0x1)
+			&& READ_BIT_FIELD(TIM2_t->SR, TIM_SR_CC3IF_POS, 0x1)) {
+		WRITE_ALL_REG(TIM2_t->SR, ~(1U << TIM_SR_CC3IF_POS)); // rc_w0
+		CANRL_POLL(&hTxRate);
+		TX_RATE_ARM();
+	}
+#endif
+#if CAN_TRAFFIC_GEN
+	if (READ_BIT_FIELD(TIM2_t->DIER, TIM_DIER_CC4IE_POS, 0x1)
+			&& READ_BIT_FIELD(TIM2_t->SR, TIM_SR_CC4IF_POS, 0x1)) {
+		WRITE_ALL_REG(TIM2_t->SR, ~(1U << TIM_SR_CC4IF_POS)); // rc_w0
+		CAN_TRAFFIC_POLL();
+	}
+#endif
+#if XCP_ENABLE || TX_RATE_LIMIT || CAN_TRAFFIC_GEN
+	// CC1IF also sets while the scheduler is idle and CC1IE is off
+	if (!READ_BIT_FIELD(TIM2_t->DIER, TIM_DIER_CC1IE_POS, 0x1)
+			|| !READ_BIT_FIELD(TIM2_t->SR, TIM_SR_CC1IF_POS, 0x1)) {
+		return;
+	}
+#endif
+	WRITE_ALL_REG(TIM2_t->SR, ~(1U << TIM_SR_CC1IF_POS)); // rc_w0
+
+	do {
+		uint32_t now = TIM2_t->CNT;
+		for (uint32_t i = 0; i < txSchedCount; i++) {
+			TX_SchedEntryTypeDef_t *e = &txSchedTable[i];
+			int32_t late = (int32_t) (now - e->NextRelease);
+			if (late < 0) {
+				continue;
+			}
+
+			uint32_t cycles = CYCLE_COUNTER_READ();
+			// CAN1_TxFrame returns 0 or 1: CANTXL_DROPPED or CANTXL_QUEUED
+#if TX_ON_CHANGE
+			uint8_t result = CANTXL_QUEUED;
+			if (CANCHG_FILTER(&hTxChange, &e->Frame) == CANCHG_SUPPRESS) {
+				e->Suppressed++;
+			} else {
+#if TX_LATEST
+				result = CANTXL_SUBMIT(&hTxLatest, &e->Frame);
+#else
+				result = CAN1_TxFrame(&hfdCan1, &e->Frame);
+#endif
+				if (result == CANTXL_DROPPED) {
+					CANCHG_INVALIDATE(&hTxChange, &e->Frame); // Not on the bus
+				}
+			}
+#elif TX_LATEST
+			uint8_t result = CANTXL_SUBMIT(&hTxLatest, &e->Frame);
+#else
+			uint8_t result = CAN1_TxFrame(&hfdCan1, &e->Frame);
+#endif
+			if (result == CANTXL_DROPPED) {
+				e->Dropped++;
+			} else if (result == CANTXL_REPLACED) {
+				e->Replaced++;
+			}
+			if (e->Releases != 0) {
+				// Measured minus scheduled interval, skipped periods included
+				int32_t dev = (int32_t) (cycles - e->LastCycles)
+						- (int32_t) ((e->NextRelease - e->LastRelease)
+								* BOOT_SYSCLK_MHZ);
+				if (dev < e->DevMinCycles) {
+					e->DevMinCycles = dev;
+				}
+				if (dev > e->DevMaxCycles) {
+					e->DevMaxCycles = dev;
+				}
+			}
+			if ((uint32_t) late > e->LateMaxUs) {
+				e->LateMaxUs = (uint32_t) late;
+			}
+			e->LastCycles = cycles;
+			e->LastRelease = e->NextRelease;
+			e->Releases++;
+
+			/* Keep the grid: a release that is a period or more late is
+			 * skipped rather than sent back to back */
+			e->NextRelease += e->PeriodUs;
+			while ((int32_t) (now - e->NextRelease) >= 0) {
+				e->NextRelease += e->PeriodUs;
+				e->Skipped++;
+			}
+			if (e->Update != NULL) {
+				e->Update(&e->Frame);
+			}
+		}
+		TX_SCHED_ARM(now);
+		// A release that fell due while this one ran would wait a full wrap
+	} while ((int32_t) (TIM2_t->CNT - TIM2_t->CCR1) >= 0);
+}
+
+/**
+ * @brief  Print releases and period jitter of every scheduled frame
+ */
+void TX_SCHED_REPORT(void) {
+	printf("TX schedule (TIM2 CC1, 1 us):\n");
+	printf("  ID         Period us  Offset us  Releases  Dropped  Replaced  Skipped"
+			"  Jitter ns (min/max)  Late us  Unchanged\n");
+	for (uint32_t i = 0; i < txSchedCount; i++) {
+		const TX_SchedEntryTypeDef_t *e = &txSchedTable[i];
+		if (e->DevMaxCycles < e->DevMinCycles) {
+			printf("  0x%08lX %9lu  %9lu  %8lu  pending\n",
+					(unsigned long) FDCAN_FRAME_GET_ID(&e->Frame),
+					(unsigned long) e->PeriodUs, (unsigned long) e->OffsetUs,
+					(unsigned long) e->Releases);
+			continue;
+		}
+		printf("  0x%08lX %9lu  %9lu  %8lu  %7lu  %8lu  %7lu  %+8ld/%+8ld  %7lu  %9lu\n",
+				(unsigned long) FDCAN_FRAME_GET_ID(&e->Frame),
+				(unsigned long) e->PeriodUs, (unsigned long) e->OffsetUs,
+				(unsigned long) e->Releases, (unsigned long) e->Dropped,
+				(unsigned long) e->Replaced, (unsigned long) e->Skipped,
+				(long) (e->DevMinCycles * 1000 / (int32_t) BOOT_SYSCLK_MHZ),
+				(long) (e->DevMaxCycles * 1000 / (int32_t) BOOT_SYSCLK_MHZ),
+				(unsigned long) e->LateMaxUs, (unsigned long) e->Suppressed);
+	}
+#if TX_LATEST
+	printf("  Cancels %lu: removed %lu, went out %lu, parked %lu; dropped %lu\n",
+			(unsigned long) hTxLatest.Cancels,
+			(unsigned long) hTxLatest.Cancelled,
+			(unsigned long) hTxLatest.Late, (unsigned long) hTxLatest.Parks,
+			(unsigned long) hTxLatest.Dropped);
+#endif
+}
+
+#if TIME_SYNC == TIME_SYNC_MASTER
+/* SYNC: the next one, built right after the release of the last */
+static void TSYN_SYNC_UPDATE(FDCAN_FrameTypeDef_t *pFrame) {
+	CANTS_MASTER_SYNC(&hTsynMaster, pFrame, TSYN_LOCAL_NS());
+}
+#endif
+
+#if TX_SCHED_VEHICLE
+/* Heartbeat: alive counter advanced after every release */
+static void TX_SCHED_HEARTBEAT_UPDATE(FDCAN_FrameTypeDef_t *pFrame) {
+#if E2E_ENABLE
+	E2E_NODE_PROTECT(pFrame);          // E2E counter and CRC of the next one
+#else
+	VEH_HEARTBEAT_TypeDef_t hb;
+	VEH_HEARTBEAT_UNPACK(&hb, pFrame);
+	hb.Counter++;
+	VEH_HEARTBEAT_PACK(pFrame, &hb);
+#endif
+}
+#endif
+
+/**
+ * @brief  Periodic frames of this node: the "Hi" demo frame of USER_CAN_TX,
+ *         with TX_SCHED_VEHICLE the vehicle signals of Tools/vehicle.dbc
+ */
+void USER_TX_SCHED_CONFIG(void) {
+	FDCAN_FrameTypeDef_t frame = { 0 };
+
+	send = (uint8_t*) "Hi";
+	FDCAN_FRAME_SET_ID(&frame, 0x123, 0);
+	FDCAN_FRAME_SET_CONTROL(&frame, FDCAN_DLC_BYTES_2, 0, 0);
+	FDCAN_FRAME_DATA(&frame)[0] = send[0];
+	FDCAN_FRAME_DATA(&frame)[1] = send[1];
+	TX_SCHED_ADD(&frame, 200000U, TX_SCHED_AUTO_OFFSET, NULL);
+
+#if TX_SCHED_VEHICLE
+	VEH_ENGINEDATA_TypeDef_t engine = { 0 };
+	VEH_ENGINEDATA_PACK(&frame, &engine);
+	TX_SCHED_ADD(&frame, 10000U, TX_SCHED_AUTO_OFFSET, NULL);
+
+	VEH_BRAKESTATUS_TypeDef_t brake = { 0 };
+	VEH_BRAKESTATUS_PACK(&frame, &brake);
+	TX_SCHED_ADD(&frame, 20000U, TX_SCHED_AUTO_OFFSET, NULL);
+
+	VEH_HEARTBEAT_TypeDef_t hb = { .State = 1 };
+	VEH_HEARTBEAT_PACK(&frame, &hb);
+#if E2E_ENABLE
+	FDCAN_FRAME_SET_CONTROL(&frame, E2E_HEARTBEAT_LEN, 0, 0); // CRC in byte 3
+	E2E_NODE_PROTECT(&frame);
+#endif
+	TX_SCHED_ADD(&frame, 100000U, TX_SCHED_AUTO_OFFSET,
+			TX_SCHED_HEARTBEAT_UPDATE);
+#endif
+
+#if TIME_SYNC == TIME_SYNC_MASTER
+	CANTS_MASTER_SYNC(&hTsynMaster, &frame, TSYN_LOCAL_NS());
+	TX_SCHED_ADD(&frame, TIME_SYNC_PERIOD_US, TX_SCHED_AUTO_OFFSET,
+			TSYN_SYNC_UPDATE);
+#endif
+}
+
+#if TX_ON_CHANGE
+/****************************************************************************
+ * Send-on-Change
+ *
+ * The scheduler release and USER_CAN_TX offer every frame to hTxChange
+ * first; a frame equal to the one last sent, up to the deadbands below, is
+ * not queued. Deadbands are in raw signal units (Tools/vehicle.dbc). The
+ * Heartbeat has no entry: its alive counter changes in every frame.
+ ****************************************************************************/
+
+static const CANCHG_SignalTypeDef_t txChangeEngine[] = {
+	{ 0, 16, CANCHG_INTEL, 0, 16 },    // EngineSpeed, 2 rpm
+	{ 24, 10, CANCHG_INTEL, 0, 5 },    // ThrottlePos, 0.5 %
+	{ 34, 12, CANCHG_INTEL, 1, 4 },    // EngineTorque, 2 Nm
+	{ 46, 18, CANCHG_INTEL, 0, 100 },  // FuelRate, 0.1 l/h
+};
+
+static const CANCHG_SignalTypeDef_t txChangeBrake[] = {
+	{ 7, 16, CANCHG_MOTOROLA, 0, 10 }, // WheelSpeedFL, 0.1 km/h
+	{ 23, 8, CANCHG_MOTOROLA, 1, 1 },  // YawRate, 0.5 deg/s
+	{ 31, 16, CANCHG_MOTOROLA, 0, 10 }, // WheelSpeedFR
+	{ 47, 16, CANCHG_MOTOROLA, 0, 10 }, // WheelSpeedRL
+};
+
+static CANCHG_EntryTypeDef_t txChangeEntries[] = {
+	{ .Id = VEH_ENGINEDATA_ID, .RefreshMs = TX_ON_CHANGE_REFRESH_MS,
+		.Signals = txChangeEngine, .SignalCount = 4 },
+	{ .Id = 0x123, .RefreshMs = TX_ON_CHANGE_REFRESH_MS }, // "Hi", exact
+	{ .Id = VEH_BRAKESTATUS_ID, .RefreshMs = TX_ON_CHANGE_REFRESH_MS,
+		.Signals = txChangeBrake, .SignalCount = 4 },
+};
+
+/* Cycle counter as the refresh timebase, wraps after 17 s */
+static uint32_t TX_CHANGE_TICKS(void) {
+	return CYCLE_COUNTER_READ();
+}
+
+/**
+ * @brief  Build the exact-compare masks of txChangeEntries
+ */
+void TX_CHANGE_INIT(void) {
+	hTxChange.Entries = txChangeEntries;
+	hTxChange.EntryCount = sizeof(txChangeEntries) / sizeof(txChangeEntries[0]);
+	hTxChange.TicksPerMs = BOOT_SYSCLK_MHZ * 1000U;
+	hTxChange.GetTicks = TX_CHANGE_TICKS;
+	if (CANCHG_INIT(&hTxChange) != 0) {
+		printf("TX on change: signal table rejected, filter off\n");
+		hTxChange.EntryCount = 0;      // Every frame passes
+	}
+}
+
+/**
+ * @brief  Print offered, sent and refresh-only frames of every filtered ID
+ */
+void TX_CHANGE_REPORT(void) {
+	printf("TX on change: %lu offered, %lu suppressed\n",
+			(unsigned long) hTxChange.Offered,
+			(unsigned long) hTxChange.Suppressed);
+	printf("  ID         Offered  Sent  Refreshed\n");
+	for (uint32_t n = 0; n < hTxChange.EntryCount; n++) {
+		const CANCHG_EntryTypeDef_t *e = &txChangeEntries[n];
+		printf("  0x%08lX %7lu  %4lu  %9lu\n", (unsigned long) e->Id,
+				(unsigned long) e->Offered, (unsigned long) e->Sent,
+				(unsigned long) e->Refreshed);
+	}
+}
+#endif /* TX_ON_CHANGE */
+
+#if TX_RATE_LIMIT
+/****************************************************************************
+ * TX Rate Limiter
+ *
+ * CAN1_TxFrame and CAN1_Tx charge each frame to the bucket of its ID, if it
+ * has one, and to the bucket of its class. The classes follow the ID plan of
+ * the bus: a node that floods the high-priority range would otherwise hold
+ * off every lower-priority control frame. Protocol traffic is queued, never
+ * dropped, so ISO-TP and XCP sequences stay whole.
+ ****************************************************************************/
+
+static CANRL_IdTypeDef_t txRateIds[] = {
+	{ .Id = 0x123, .Bucket = { .RatePerSec = 10, .Burst = 2,
+			.Policy = CANRL_DROP } },  // "Hi", twice its normal rate
+};
+
+static CANRL_ClassTypeDef_t txRateClasses[] = {
+	{ .IdMin = 0x000, .IdMax = 0x0FF, .Bucket = { .RatePerSec = 500,
+			.Burst = 8, .Policy = CANRL_DROP } },  // High priority
+	{ .IdMin = 0x100, .IdMax = 0x3FF, .Bucket = { .RatePerSec = 300,
+			.Burst = 8, .Policy = CANRL_DROP } },  // Vehicle signals, 165/s scheduled
+	{ .IdMin = 0x700, .IdMax = 0x7FF, .Bucket = { .RatePerSec = 2000,
+			.Burst = 16, .Policy = CANRL_QUEUE } }, // UDS and XCP
+	{ .IdMin = 0x00000000, .IdMax = 0x1FFFFFFF, .Extended = 1,
+		.Bucket = { .RatePerSec = 500, .Burst = 16,
+				.Policy = CANRL_QUEUE } },         // J1939
+};
+
+/* TIM2 as the limiter clock, 1 us */
+static uint32_t TX_RATE_US(void) {
+	return TIM2_t->CNT;
+}
+
+/* Held frames skip the limiter, their tokens are taken by CANRL_POLL */
+static uint8_t TX_RATE_TRANSMIT(void *ctx, const FDCAN_FrameTypeDef_t *pFrame) {
+	return CAN1_TX_WRITE((FDCAN_Handle_Typedef_t*) ctx, pFrame);
+}
+
+/**
+ * @brief  Fill the buckets and let TIM2 CC3 interrupt for held frames
+ * @note   Needs TIM2 running
+ */
+void TX_RATE_INIT(void) {
+	hTxRate.Ids = txRateIds;
+	hTxRate.IdCount = sizeof(txRateIds) / sizeof(txRateIds[0]);
+	hTxRate.Classes = txRateClasses;
+	hTxRate.ClassCount = sizeof(txRateClasses) / sizeof(txRateClasses[0]);
+	hTxRate.GetUs = TX_RATE_US;
+	hTxRate.Transmit = TX_RATE_TRANSMIT;
+	hTxRate.Ctx = &hfdCan1;
+	CANRL_INIT(&hTxRate);
+	txRateCycles = txRateCyclesMax = 0;
+	NVIC_ISER0_p[TIM2_IRQ_t / 32] = (1UL << (TIM2_IRQ_t % 32));
+}
+
+/**
+ * @brief  Arm TIM2 CC3 for the first held frame that can go, or disarm it
+ * @note   Called with the TX paths locked: from TIM2, the FDCAN ISR or
+ *         TX_RATE_SUBMIT
+ */
+void TX_RATE_ARM(void) {
+	uint32_t wait = CANRL_NEXT_US(&hTxRate);
+	if (wait == CANRL_IDLE) {
+		CLEAR_BIT_FIELD(TIM2_t->DIER, TIM_DIER_CC3IE_POS);
+		return;
+	}
+	TIM2_t->CCR3 = TIM2_t->CNT + ((wait != 0) ? wait : TX_RATE_RETRY_US);
+	CLEAR_BIT_FIELD(TIM2_t->SR, TIM_SR_CC3IF_POS);
+	SET_BIT_FIELD(TIM2_t->DIER, TIM_DIER_CC3IE_POS);
+}
+
+/* One bucket line of TX_RATE_REPORT */
+static void TX_RATE_REPORT_BUCKET(const char *name, uint32_t lo, uint32_t hi,
+		const CANRL_BucketTypeDef_t *b) {
+	printf("  %-6s 0x%08lX-0x%08lX %5lu/s %5u  %-5s %8lu  %7lu  %7lu\n", name,
+			(unsigned long) lo, (unsigned long) hi,
+			(unsigned long) b->RatePerSec, b->Burst,
+			b->Policy == CANRL_QUEUE ? "queue" : "drop",
+			(unsigned long) b->Passed, (unsigned long) b->Queued,
+			(unsigned long) b->Dropped);
+}
+
+/**
+ * @brief  Print the counters of every bucket and the cost per TX call
+ */
+void TX_RATE_REPORT(void) {
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	uint32_t submitted = hTxRate.Submitted;
+	uint32_t unlimited = hTxRate.Unlimited;
+	uint32_t queueFull = hTxRate.QueueFull;
+	uint32_t held = hTxRate.QueueCount;
+	uint32_t peak = hTxRate.QueuePeak;
+	uint32_t cycles = txRateCycles;
+	uint32_t cyclesMax = txRateCyclesMax;
+	__set_PRIMASK(primask);
+
+	printf("TX rate limit: %lu frames, %lu unlimited, %lu held (peak %lu),"
+			" %lu queue full, %lu cycles/frame (max %lu)\n",
+			(unsigned long) submitted, (unsigned long) unlimited,
+			(unsigned long) held, (unsigned long) peak,
+			(unsigned long) queueFull,
+			(unsigned long) (submitted ? cycles / submitted : 0),
+			(unsigned long) cyclesMax);
+	printf("  Bucket IDs                      Rate  Burst Policy  Passed  Queued"
+			"  Dropped\n");
+	for (uint32_t n = 0; n < hTxRate.IdCount; n++) {
+		const CANRL_IdTypeDef_t *e = &txRateIds[n];
+		TX_RATE_REPORT_BUCKET("ID", e->Id, e->Id, &e->Bucket);
+	}
+	for (uint32_t n = 0; n < hTxRate.ClassCount; n++) {
+		const CANRL_ClassTypeDef_t *c = &txRateClasses[n];
+		TX_RATE_REPORT_BUCKET(c->Extended ? "Ext" : "Class", c->IdMin,
+				c->IdMax, &c->Bucket);
+	}
+}
+#endif /* TX_RATE_LIMIT */
+
+#if E2E_ENABLE || E2E_BENCH
+/****************************************************************************
+ * End-to-End Protection
+ *
+ * The frames of e2eTxChannels carry an E2E counter and CRC written by
+ * E2E_NODE_PROTECT, those of e2eRxChannels are checked in the RX paths.
+ * The CRCs come from the CRC unit: it is set up for the CRC type on every
+ * call, so the profiles can share it, from the TIM2 release and the RX
+ * path alike, with interrupts masked for the few cycles it takes.
+ ****************************************************************************/
+
+/**
+ * @brief  E2E CRC engine on the CRC unit
+ * @note   The unit shifts MSB first. The reflected CRC-32 gets its input
+ *         bits reversed by byte and its result reversed on read, so its
+ *         LSB-first register is loaded bit-reversed. Words are written
+ *         byte-swapped to keep the payload byte order.
+ */
+static uint32_t E2E_HW_CRC(void *ctx, uint8_t type, uint32_t reg,
+		const uint8_t *pData, uint32_t length) {
+	const E2E_CrcParamTypeDef_t *c = &E2E_CRC_PARAMS[type];
+	uint32_t polySize = (c->Width == 32U) ? 0U : (c->Width == 16U) ? 1U : 2U;
+	uint32_t primask = __get_PRIMASK();
+	(void) ctx;
+
+	__disable_irq();
+	WRITE_ALL_REG(CRC_t->CR, (polySize << CRC_CR_POLYSIZE_POS)
+			| (c->Reflected ? (1U << CRC_CR_REV_IN_POS)
+					| (1U << CRC_CR_REV_OUT_POS) : 0U));
+	WRITE_ALL_REG(CRC_t->POL, c->Poly);
+	WRITE_ALL_REG(CRC_t->INIT, c->Reflected ? __RBIT(reg) : reg);
+	SET_BIT_FIELD(CRC_t->CR, CRC_CR_RESET_POS);
+
+	uint32_t i = 0;
+	for (; i + 4U <= length; i += 4U) {
+		WRITE_ALL_REG(CRC_t->DR, __REV(__UNALIGNED_UINT32_READ(&pData[i])));
+	}
+	for (; i < length; i++) {
+		*(volatile uint8_t*) &CRC_t->DR = pData[i];
+	}
+	reg = CRC_t->DR;
+	__set_PRIMASK(primask);
+	return reg;
+}
+
+#if E2E_ENABLE
+/* Frames this node protects: the Heartbeat, Data ID after its identifier */
+static E2E_NodeChannelTypeDef_t e2eTxChannels[] = {
+	{ VEH_HEARTBEAT_ID, { .Profile = E2E_P11, .DataId = VEH_HEARTBEAT_ID,
+			.Offset = 3U, .CounterBit = 0 } },
+};
+
+/* Frames this node checks */
+static E2E_NodeChannelTypeDef_t e2eRxChannels[] = {
+	{ E2E_PEER_HEARTBEAT_ID, { .Profile = E2E_P11,
+			.DataId = E2E_PEER_HEARTBEAT_ID, .Offset = 3U, .CounterBit = 0,
+			.MaxDeltaCounter = 2U } },
+};
+
+#define E2E_TX_COUNT (sizeof(e2eTxChannels) / sizeof(e2eTxChannels[0]))
+#define E2E_RX_COUNT (sizeof(e2eRxChannels) / sizeof(e2eRxChannels[0]))
+
+uint32_t e2eRxCycles;                  // Cycles spent in E2E_NODE_CHECK
+uint32_t e2eRxCyclesMax;
+
+/**
+ * @brief  Clock the CRC unit and reset every channel
+ */
+void E2E_NODE_INIT(void) {
+	CRC_CLK_EN();
+	hE2e.Engine = E2E_HW_CRC;
+	hE2e.Ctx = NULL;
+	hE2e.Tables = NULL;
+	for (uint32_t n = 0; n < E2E_TX_COUNT; n++) {
+		E2E_CHANNEL_INIT(&e2eTxChannels[n].Channel);
+	}
+	for (uint32_t n = 0; n < E2E_RX_COUNT; n++) {
+		E2E_CHANNEL_INIT(&e2eRxChannels[n].Channel);
+	}
+}
+
+/* Channel of a standard frame, NULL if it has none */
+static E2E_ChannelTypeDef_t* E2E_NODE_FIND(E2E_NodeChannelTypeDef_t *pTable,
+		uint32_t count, const FDCAN_FrameTypeDef_t *pFrame) {
+	if (FDCAN_FRAME_IS_EXTENDED(pFrame)) {
+		return NULL;
+	}
+	uint32_t id = FDCAN_FRAME_GET_ID(pFrame);
+	for (uint32_t n = 0; n < count; n++) {
+		if (pTable[n].Id == id) {
+			return &pTable[n].Channel;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief  Write the E2E counter and CRC into a frame of a TX channel
+ * @note   Call on the frame as it will be sent; the counter advances
+ */
+void E2E_NODE_PROTECT(FDCAN_FrameTypeDef_t *pFrame) {
+	E2E_ChannelTypeDef_t *ch = E2E_NODE_FIND(e2eTxChannels, E2E_TX_COUNT,
+			pFrame);
+	if (ch != NULL) {
+		E2E_PROTECT(&hE2e, ch, FDCAN_FRAME_DATA(pFrame),
+				FDCAN_FRAME_GET_LEN(pFrame));
+	}
+}
+
+/**
+ * @brief  Check a received frame of an RX channel, result in its counters
+ */
+void E2E_NODE_CHECK(const FDCAN_FrameTypeDef_t *pFrame) {
+	E2E_ChannelTypeDef_t *ch = E2E_NODE_FIND(e2eRxChannels, E2E_RX_COUNT,
+			pFrame);
+	if (ch == NULL) {
+		return;
+	}
+	uint32_t start = CYCLE_COUNTER_READ();
+	E2E_CHECK(&hE2e, ch, FDCAN_FRAME_CDATA(pFrame),
+			FDCAN_FRAME_GET_LEN(pFrame));
+	uint32_t cycles = CYCLE_COUNTER_READ() - start;
+	e2eRxCycles += cycles;
+	if (cycles > e2eRxCyclesMax) {
+		e2eRxCyclesMax = cycles;
+	}
+}
+
+/**
+ * @brief  Print protected frames and check results per channel
+ */
+void E2E_NODE_REPORT(void) {
+	static const char *const profiles[] = { "P11", "P5", "P4" };
+	uint32_t checked = 0;
+
+	printf("E2E protection:\n");
+	printf("  Dir ID     Profile  Frames      OK  Initial  Repeated  Lost"
+			"  WrongSeq   Error\n");
+	for (uint32_t n = 0; n < E2E_TX_COUNT; n++) {
+		const E2E_ChannelTypeDef_t *ch = &e2eTxChannels[n].Channel;
+		printf("  TX  0x%03lX %-7s %7lu\n", (unsigned long) e2eTxChannels[n].Id,
+				profiles[ch->Profile], (unsigned long) ch->Frames);
+	}
+	for (uint32_t n = 0; n < E2E_RX_COUNT; n++) {
+		const E2E_ChannelTypeDef_t *ch = &e2eRxChannels[n].Channel;
+		printf("  RX  0x%03lX %-7s %7lu %7lu %8lu %9lu %5lu %9lu %7lu\n",
+				(unsigned long) e2eRxChannels[n].Id, profiles[ch->Profile],
+				(unsigned long) ch->Frames,
+				(unsigned long) ch->Status[E2E_OK],
+				(unsigned long) ch->Status[E2E_INITIAL],
+				(unsigned long) ch->Status[E2E_REPEATED],
+				(unsigned long) ch->Status[E2E_OK_SOME_LOST],
+				(unsigned long) ch->Status[E2E_WRONG_SEQUENCE],
+				(unsigned long) ch->Status[E2E_ERROR]);
+		checked += ch->Frames;
+	}
+	printf("  Check cost: %lu cycles avg, %lu max\n",
+			(unsigned long) (checked ? e2eRxCycles / checked : 0),
+			(unsigned long) e2eRxCyclesMax);
+}
+#endif /* E2E_ENABLE */
+
+#if E2E_BENCH
+static E2E_CrcTablesTypeDef_t e2eBenchTables;
+
+/**
+ * @brief  Cycles per protected and per checked frame of each profile, bit by
+ *         bit, with slice tables and on the CRC unit
+ * @note   Also compares the bytes each engine writes: a mismatch on the CRC
+ *         unit means its setup in E2E_HW_CRC is wrong for that CRC type
+ */
+void E2E_BENCHMARK(void) {
+	static const struct {
+		uint8_t Profile;
+		uint8_t Length;
+		const char *Name;
+	} cases[] = {
+		{ E2E_P11, 8U, "P11" }, { E2E_P5, 8U, "P5" }, { E2E_P5, 64U, "P5" },
+		{ E2E_P4, 16U, "P4" }, { E2E_P4, 64U, "P4" },
+	};
+	static const char *const engines[] = { "bitwise", "tables", "CRC unit" };
+	uint8_t payload[64], reference[64];
+
+	CRC_CLK_EN();
+	uint32_t start = CYCLE_COUNTER_READ();
+	E2E_TABLES_INIT(&e2eBenchTables);
+	printf("E2E benchmark: tables built in %lu cycles, %lu frames per case\n",
+			(unsigned long) (CYCLE_COUNTER_READ() - start),
+			(unsigned long) E2E_BENCH_RUNS);
+	printf("  Profile Bytes Engine    Protect  Check (cycles/frame)  Bytes\n");
+
+	for (uint32_t k = 0; k < sizeof(cases) / sizeof(cases[0]); k++) {
+		for (uint8_t engine = 0; engine < 3U; engine++) {
+			E2E_HandleTypeDef_t h = { .Engine = (engine == 2U) ? E2E_HW_CRC : NULL,
+					.Tables = (engine == 1U) ? &e2eBenchTables : NULL };
+			E2E_ChannelTypeDef_t tx = { .Profile = cases[k].Profile,
+					.DataId = 0x0300U, .Offset = 0, .CounterBit = 8U,
+					.MaxDeltaCounter = 1U };
+			E2E_ChannelTypeDef_t rx = tx;
+			E2E_CHANNEL_INIT(&tx);
+			E2E_CHANNEL_INIT(&rx);
+			for (uint32_t i = 0; i < cases[k].Length; i++) {
+				payload[i] = (uint8_t) (i * 37U + 11U);
+			}
+
+			uint32_t primask = __get_PRIMASK();
+			__disable_irq();
+			start = CYCLE_COUNTER_READ();
+			for (uint32_t r = 0; r < E2E_BENCH_RUNS; r++) {
+				E2E_PROTECT(&h, &tx, payload, cases[k].Length);
+			}
+			uint32_t protect = CYCLE_COUNTER_READ() - start;
+			uint32_t errors = 0;
+			start = CYCLE_COUNTER_READ();
+			for (uint32_t r = 0; r < E2E_BENCH_RUNS; r++) {
+				errors += E2E_CHECK(&h, &rx, payload, cases[k].Length)
+						== E2E_ERROR;
+			}
+			uint32_t check = CYCLE_COUNTER_READ() - start;
+			__set_PRIMASK(primask);
+
+			// Every engine must leave the same protected payload
+			uint8_t same = 1;
+			if (engine == 0) {
+				for (uint32_t i = 0; i < cases[k].Length; i++) {
+					reference[i] = payload[i];
+				}
+			} else {
+				for (uint32_t i = 0; i < cases[k].Length; i++) {
+					same &= payload[i] == reference[i];
+				}
+			}
+			printf("  %-7s %5u %-9s %7lu %6lu                 %s\n",
+					cases[k].Name, cases[k].Length, engines[engine],
+					(unsigned long) (protect / E2E_BENCH_RUNS),
+					(unsigned long) (check / E2E_BENCH_RUNS),
+					(same && errors == 0) ? "ok" : "MISMATCH");
+		}
+	}
+}
+#endif /* E2E_BENCH */
+#endif /* E2E_ENABLE || E2E_BENCH */
+
+#if TIME_SYNC
+/****************************************************************************
+ * Time Synchronization
+ *
+ * The local clock is TIM2, 1 us per count, extended to 64 bits here; it
+ * only has to be read once per wrap (71 minutes), which every SYNC does.
+ * The FDCAN timestamp counter gives the start of frame of each SYNC, on
+ * the master from its TX event and on the slave from its RX element; the
+ * time elapsed since then, read from the same counter, is subtracted from
+ * the local clock.
+ ****************************************************************************/
+
+#define SRAMCAN_EFSA FDCAN_TX_EVENT_FIFO_OFFSET // TX event FIFO start address offset
+#define SRAMCAN_EF_SIZE (2U * 4U)      // Size of each TX event element
+#define FDCAN_TX_EVENT_ADDR(idx) ((volatile uint32_t*) (SRAMCAN_BASE_ADDR \
+		+ SRAMCAN_EFSA + ((idx) * SRAMCAN_EF_SIZE)))
+
+static uint64_t tsynLocalUs;           // TIM2 extended to 64 bits
+static uint32_t tsynLastCount;
+
+/**
+ * @brief  Local time in nanoseconds, 1 us resolution
+ */
+uint64_t TSYN_LOCAL_NS(void) {
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	uint32_t count = TIM2_t->CNT;
+	tsynLocalUs += count - tsynLastCount;
+	tsynLastCount = count;
+	uint64_t us = tsynLocalUs;
+	__set_PRIMASK(primask);
+	return us * 1000U;
+}
+
+/* Local time of an FDCAN timestamp less than one counter wrap old */
+static uint64_t TSYN_LOCAL_AT(uint16_t timestamp) {
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	uint16_t now = (uint16_t) hfdCan1.Instace->TSCV;
+	uint64_t localNs = TSYN_LOCAL_NS();
+	__set_PRIMASK(primask);
+	return localNs - (uint64_t) (uint16_t) (now - timestamp) * TIME_SYNC_TICK_NS;
+}
+
+/**
+ * @brief  Start the master (TX event interrupt) or the slave
+ * @note   Needs TIM2 running; before USER_TX_SCHED_CONFIG on the master
+ */
+void TSYN_NODE_INIT(void) {
+	tsynLastCount = TIM2_t->CNT;
+#if TIME_SYNC == TIME_SYNC_MASTER
+	hTsynMaster.Id = TIME_SYNC_ID;
+	hTsynMaster.Extended = 0;
+	hTsynMaster.Domain = TIME_SYNC_DOMAIN;
+	hTsynMaster.EpochNs = 0;           // Time since boot, no external reference
+	CANTS_MASTER_INIT(&hTsynMaster);
+
+	WRITE_REG_BIT(hfdCan1.Instace->IR, 1, FDCAN_IR_TEFN_POS);
+	SET_BIT_FIELD(hfdCan1.Instace->IE, FDCAN_IR_TEFN_POS);
+#else
+	hTsynSlave.Id = TIME_SYNC_ID;
+	hTsynSlave.Extended = 0;
+	hTsynSlave.Domain = TIME_SYNC_DOMAIN;
+	hTsynSlave.FollowUpTimeoutNs = TIME_SYNC_PERIOD_US * 1000ULL / 2U;
+	hTsynSlave.TimeoutNs = TIME_SYNC_PERIOD_US * 5000ULL; // Five SYNCs missed
+	hTsynSlave.RateWindowNs = 1000000000ULL;
+	hTsynSlave.MaxRatePpb = 500000;    // Two crystals of +-250 ppm at most
+	CANTS_SLAVE_INIT(&hTsynSlave);
+#endif
+}
+
+#if TIME_SYNC == TIME_SYNC_MASTER
+/**
+ * @brief  Drain the TX event FIFO, sending the FUP of each confirmed SYNC
+ * @note   Called from the FDCAN interrupt on TEFN
+ */
+void TSYN_NODE_TX_EVENT(void) {
+	while (READ_BIT_FIELD(hfdCan1.Instace->TXEFS, FDCAN_TXEFS_EFFL_POS, 0x7)
+			!= 0) {
+		uint8_t get = READ_BIT_FIELD(hfdCan1.Instace->TXEFS,
+				FDCAN_TXEFS_EFGI_POS, 0x3);
+		uint32_t e1 = FDCAN_TX_EVENT_ADDR(get)[1];
+		WRITE_ALL_REG(hfdCan1.Instace->TXEFA, get);
+
+		FDCAN_FrameTypeDef_t fup;
+		uint64_t t0 = TSYN_LOCAL_AT((uint16_t) (e1 & FDCAN_ELEM_TXTS_MASK));
+		if (CANTS_MASTER_TX_EVENT(&hTsynMaster,
+				(uint8_t) (e1 >> FDCAN_ELEM_MM_POS), t0, &fup)) {
+			CAN1_TxFrame(&hfdCan1, &fup);
+		}
+	}
+}
+#else
+/**
+ * @brief  Take a SYNC or FUP, time-stamped at its start of frame
+ */
+void TSYN_NODE_RX(const FDCAN_FrameTypeDef_t *pFrame) {
+	CANTS_SLAVE_RX(&hTsynSlave, pFrame,
+			TSYN_LOCAL_AT(FDCAN_FRAME_GET_TIMESTAMP(pFrame)));
+}
+#endif
+
+/**
+ * @brief  Print the global time and how the node keeps it
+ */
+void TSYN_NODE_REPORT(void) {
+	uint64_t local = TSYN_LOCAL_NS();
+#if TIME_SYNC == TIME_SYNC_MASTER
+	uint64_t global = CANTS_MASTER_GLOBAL(&hTsynMaster, local);
+	printf("Time sync master: global %lu.%09lu s, %lu SYNC, %lu FUP,"
+			" %lu unmatched, %lu overflows\n",
+			(unsigned long) (global / CANTS_NS_PER_SEC),
+			(unsigned long) (global % CANTS_NS_PER_SEC),
+			(unsigned long) hTsynMaster.Syncs, (unsigned long) hTsynMaster.Fups,
+			(unsigned long) hTsynMaster.Unmatched,
+			(unsigned long) hTsynMaster.Overflows);
+#else
+	static const char *const states[] = { "unsynced", "synced", "timeout" };
+	const CANTS_SlaveTypeDef_t *s = &hTsynSlave;
+	uint64_t global = 0;
+	uint8_t status = CANTS_SLAVE_GLOBAL(s, local, &global);
+	printf("Time sync slave: %s, global %lu.%09lu s, rate %ld ppb\n",
+			states[status], (unsigned long) (global / CANTS_NS_PER_SEC),
+			(unsigned long) (global % CANTS_NS_PER_SEC), (long) s->RatePpb);
+	printf("  %lu SYNC, %lu FUP, %lu pairs, %lu discarded, %lu rate rejected;"
+			" error at last pair %ld ns, max %lu ns\n",
+			(unsigned long) s->Syncs, (unsigned long) s->Fups,
+			(unsigned long) s->Pairs, (unsigned long) s->Discarded,
+			(unsigned long) s->RateRejected, (long) s->LastErrorNs,
+			(unsigned long) s->MaxErrorNs);
+#endif
+}
+#endif /* TIME_SYNC */
+
+/****************************************************************************
+ * Error State Manager
+ *
+ * EP, EW and BO move the state at once from the ISR; the main loop feeds
+ * PSR/ECR every pass as well, so LEC/DLEC codes are counted and the bus-off
+ * backoff runs without the interrupt.
+ ****************************************************************************/
+
+/**
+ * @brief  Keep the FDCAN ISR out while the main loop updates state it shares
+ * @retval 1 if the FDCAN interrupt was enabled, for FDCAN_IRQ_UNLOCK
+ */
+FDCAN_INLINE uint32_t FDCAN_IRQ_LOCK(void) {
+	uint32_t saved = NVIC_IRQ_SAVE(FDCAN1_IT0_IRQ_t);
+
+	__DSB();
+	__ISB();
+	return saved;
+}
+
+FDCAN_INLINE void FDCAN_IRQ_UNLOCK(uint32_t saved) {
+	NVIC_IRQ_RESTORE(FDCAN1_IT0_IRQ_t, saved);
+}
+
+#if CAN_ERR_MANAGER
+
+/* Cycle counter as the manager timebase */
+static uint32_t CAN_ERR_TICKS(void) {
+	return CYCLE_COUNTER_READ();
+}
+
+/* Bus-off left CCCR.INIT set: clearing it starts the 128 x 11 recessive
+ * bit count, after which the controller clears PSR.BO on its own */
+static void CAN_ERR_RESTART(void *ctx) {
+	FDCAN_Handle_Typedef_t *hFDCAN = ctx;
+	CLEAR_BIT_FIELD(hFDCAN->Instace->CCCR, FDCAN_CCCR_INIT_POS);
+}
+
+/**
+ * @brief  Configure the manager and enable the error state interrupts
+ * @note   Called from BOOT_FDCAN_START while FDCAN1 is in init mode
+ */
+void CAN_ERR_INIT(void) {
+	hCanErr.TicksPerUs = BOOT_SYSCLK_MHZ;
+	hCanErr.GetTicks = CAN_ERR_TICKS;
+	hCanErr.Restart = CAN_ERR_RESTART;
+	hCanErr.Ctx = &hfdCan1;
+	CANERR_INIT(&hCanErr);
+
+	WRITE_ALL_REG(hfdCan1.Instace->IR, FDCAN_ERR_IRQ_FLAGS);
+	hfdCan1.Instace->IE |= FDCAN_ERR_IRQ_FLAGS;
+}
+
+/**
+ * @brief  Error flags from FDCAN1_IT0_IRQHandler, already cleared in IR
+ * @note   PEA/PED fire on every protocol error, so CANERR_IRQ has them masked
+ *         here and CAN_ERR_TASK re-arms them: at most one per main loop pass
+ *         or millisecond of delay on a noisy bus.
+ */
+FDCAN_RAMFUNC void CAN_ERR_IRQ(uint32_t flags) {
+	uint32_t mask = CANERR_IRQ(&hCanErr, flags, hfdCan1.Instace->PSR,
+			hfdCan1.Instace->ECR);
+
+	hfdCan1.Instace->IE &= ~mask;
+}
+
+/**
+ * @brief  Poll PSR/ECR, run the backoff and re-arm protocol error interrupts
+ */
+void CAN_ERR_TASK(void) {
+	uint32_t lock = FDCAN_IRQ_LOCK();
+	CANERR_UPDATE(&hCanErr, hfdCan1.Instace->PSR, hfdCan1.Instace->ECR);
+	CANERR_POLL(&hCanErr);
+	hfdCan1.Instace->IE |= CANERR_IR_PROTOCOL_FLAGS;
+	FDCAN_IRQ_UNLOCK(lock);
+}
+
+/**
+ * @brief  Print state, error counters, protocol errors and time per state
+ */
+void CAN_ERR_REPORT(void) {
+	static const char *lecNames[CANERR_LEC_COUNT] = { "-", "Stuff", "Form",
+			"Ack", "Bit1", "Bit0", "CRC", "-" };
+
+	uint32_t lock = FDCAN_IRQ_LOCK();
+	CANERR_HandleTypeDef_t snap = hCanErr;
+	FDCAN_IRQ_UNLOCK(lock);
+
+	printf("CAN error state: %s  TEC %u (max %u)  REC %u (max %u)\n",
+			CANERR_STATE_NAME(snap.State), snap.Tec, snap.TecMax, snap.Rec,
+			snap.RecMax);
+	printf("  %-11s %8s %12s\n", "State", "Entered", "Time ms");
+	for (uint8_t s = 0; s < CANERR_STATE_COUNT; s++) {
+		printf("  %-11s %8lu %12lu\n", CANERR_STATE_NAME(s),
+				(unsigned long) snap.Entered[s],
+				(unsigned long) (CANERR_TIME_IN_STATE_US(&snap, s) / 1000U));
+	}
+	printf("  Recoveries %lu, downtime last %lu us, max %lu us\n",
+			(unsigned long) snap.Recoveries,
+			(unsigned long) snap.DowntimeLastUs,
+			(unsigned long) snap.DowntimeMaxUs);
+	printf("  Protocol errors (arbitration/data):");
+	for (uint8_t c = CANERR_LEC_STUFF; c <= CANERR_LEC_CRC; c++) {
+		printf(" %s %lu/%lu", lecNames[c], (unsigned long) snap.ArbErrors[c],
+				(unsigned long) snap.DataErrors[c]);
+	}
+	printf(", logged %lu\n", (unsigned long) snap.LoggedErrors);
+}
+#endif /* CAN_ERR_MANAGER */
+
+#if CAN_STATS
+/****************************************************************************
+ * Bus Statistics
+ *
+ * CAN1_TxFrame/CAN1_Tx count frames when they are queued and CAN1_RxFrame/
+ * CAN1_Rx when they are read, so RX plus TX is all the traffic this node
+ * sees. Load is charged at the worst-case stuffed length of each frame.
+ ****************************************************************************/
+
+/* Cycle counter as the statistics timebase */
+static uint32_t CAN_STATS_TICKS(void) {
+	return CYCLE_COUNTER_READ();
+}
+
+/**
+ * @brief  Configure the statistics for the FDCAN1 bit rates
+ */
+void CAN_STATS_INIT(void) {
+	hCanStats.NominalKbps = FDCAN1_NOMINAL_KBPS;
+	hCanStats.DataKbps = FDCAN1_DATA_KBPS;
+	hCanStats.BucketMs = CAN_STATS_BUCKET_MS;
+	hCanStats.TicksPerUs = BOOT_SYSCLK_MHZ;
+	hCanStats.GetTicks = CAN_STATS_TICKS;
+	CANSTATS_INIT(&hCanStats);
+	canStatsCycles = canStatsCyclesMax = 0;
+}
+
+/**
+ * @brief  Print bus load over several windows and the counters of every ID
+ * @note   Each read masks interrupts only for itself; the table is not
+ *         copied as a whole to keep the stack small
+ */
+void CAN_STATS_REPORT(void) {
+	static const uint32_t windowsMs[] = { CAN_STATS_BUCKET_MS, 100U, 1000U };
+	uint32_t load[sizeof(windowsMs) / sizeof(windowsMs[0])];
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	for (uint32_t w = 0; w < sizeof(windowsMs) / sizeof(windowsMs[0]); w++) {
+		load[w] = CANSTATS_LOAD_PERMILLE(&hCanStats, windowsMs[w]);
+	}
+	uint32_t peak = CANSTATS_PEAK_PERMILLE(&hCanStats);
+	uint32_t rxFrames = hCanStats.Frames[CANSTATS_RX];
+	uint32_t txFrames = hCanStats.Frames[CANSTATS_TX];
+	uint32_t ids = hCanStats.IdCount;
+	uint32_t untracked = hCanStats.Untracked;
+	uint64_t wireNs = hCanStats.WireNs;
+	uint32_t cycles = canStatsCycles;
+	uint32_t cyclesMax = canStatsCyclesMax;
+	__set_PRIMASK(primask);
+
+	printf("Bus load:");
+	for (uint32_t w = 0; w < sizeof(windowsMs) / sizeof(windowsMs[0]); w++) {
+		printf(" %lums %lu.%lu%%", (unsigned long) windowsMs[w],
+				(unsigned long) (load[w] / 10U), (unsigned long) (load[w] % 10U));
+	}
+	printf(", peak %lu.%lu%%\n", (unsigned long) (peak / 10U),
+			(unsigned long) (peak % 10U));
+	printf("  Frames RX %lu TX %lu, %lu IDs, %lu untracked, %lu cycles/frame"
+			" (max %lu)\n", (unsigned long) rxFrames, (unsigned long) txFrames,
+			(unsigned long) ids, (unsigned long) untracked,
+			(unsigned long) ((rxFrames + txFrames) ?
+					cycles / (rxFrames + txFrames) : 0),
+			(unsigned long) cyclesMax);
+	if (wireNs == 0) {
+		return;
+	}
+
+	printf("  %-10s %8s %8s %10s %7s\n", "ID", "RX", "TX", "Bytes", "Share");
+	for (uint32_t i = 0; i < CANSTATS_ID_SLOTS; i++) {
+		__disable_irq();
+		CANSTATS_IdEntryTypeDef_t e = hCanStats.Ids[i];
+		__set_PRIMASK(primask);
+		if (e.Key == 0) {
+			continue;
+		}
+		uint32_t share = (uint32_t) (e.WireNs * 1000U / wireNs);
+		printf("  0x%08lX%s %8lu %8lu %10lu %5lu.%lu%%\n",
+				(unsigned long) CANSTATS_ENTRY_ID(&e),
+				CANSTATS_ENTRY_EXTENDED(&e) ? "x" : " ",
+				(unsigned long) e.RxFrames, (unsigned long) e.TxFrames,
+				(unsigned long) e.Bytes, (unsigned long) (share / 10U),
+				(unsigned long) (share % 10U));
+	}
+}
+#endif /* CAN_STATS */
+
+#if CAN_SNIFFER
+/****************************************************************************
+ * Bus Sniffer
+ *
+ * FDCAN1 listens in bus monitoring mode and the RX interrupt encodes every
+ * frame into the capture ring (can_capture.c). The main loop only streams
+ * the ring out on ITM stimulus port CAN_SNIFFER_ITM_PORT, four bytes per
+ * SWO packet, without ever waiting on the ITM FIFO.
+ ****************************************************************************/
+
+static uint32_t CAN_SNIFFER_TICKS(void) {
+	return CYCLE_COUNTER_READ();
+}
+
+/* The counter the RX element timestamps are taken from */
+static uint16_t CAN_SNIFFER_TIMESTAMP(void) {
+	return (uint16_t) hfdCan1.Instace->TSCV;
+}
+
+/**
+ * @brief  Start the capture and open the ITM port
+ * @note   Called from BOOT_FDCAN_START; TimestampPrescaler = 1 makes the
+ *         RX timestamps count nominal bit times
+ */
+void CAN_SNIFFER_INIT(void) {
+	hCapture.NominalKbps = FDCAN1_NOMINAL_KBPS;
+	hCapture.DataKbps = FDCAN1_DATA_KBPS ? FDCAN1_DATA_KBPS : FDCAN1_NOMINAL_KBPS;
+	hCapture.TicksPerBit = BOOT_SYSCLK_MHZ * 1000U / FDCAN1_NOMINAL_KBPS;
+	hCapture.GetTicks = CAN_SNIFFER_TICKS;
+	hCapture.GetTimestamp = CAN_SNIFFER_TIMESTAMP;
+	CANCAP_INIT(&hCapture);
+
+	// SWO pin in asynchronous mode, clocked from the core: fix the rate the
+	// stream budget was measured at instead of whatever the probe left
+	DBGMCU->CR = (DBGMCU->CR & ~DBGMCU_CR_TRACE_MODE_Msk)
+			| DBGMCU_CR_TRACE_IOEN | DBGMCU_CR_TRACE_CLKEN;
+	TPI->SPPR = 2U;                    // NRZ (UART)
+	TPI->ACPR = (BOOT_SYSCLK_MHZ * 1000U) / CAN_SNIFFER_SWO_KBPS - 1U;
+	TPI->FFCR = TPI_FFCR_TrigIn_Msk;   // Formatter off, ITM packets only
+
+	// The debugger enables ITM; the port itself may still be off
+	if (ITM->TCR & ITM_TCR_ITMENA_Msk) {
+		ITM->TER |= 1UL << CAN_SNIFFER_ITM_PORT;
+	}
+}
+
+/**
+ * @brief  Move one frame from RX FIFO 0 into the capture ring
+ * @retval 1 if a frame was read (captured or counted as dropped)
+ */
+FDCAN_RAMFUNC uint8_t CAN_SNIFFER_RX(void) {
+	FDCAN_FrameTypeDef_t frame;
+
+	if (!CAN1_RxFrame(&hfdCan1, &frame)) {
+		return 0;
+	}
+	CANCAP_FRAME(&hCapture, &frame);
+	return 1;
+}
+
+/**
+ * @brief  Push as much of the ring to ITM as its FIFO takes right now, keep
+ *         the capture clock in phase and report once per CAN_SNIFFER_REPORT_MS
+ */
+void CAN_SNIFFER_TASK(void) {
+	static uint32_t reportDeadline;
+	volatile ITM_Type *itm = ITM;
+	const uint8_t *data;
+	uint32_t length;
+
+	uint32_t lock = FDCAN_IRQ_LOCK();
+	CANCAP_POLL(&hCapture);
+	FDCAN_IRQ_UNLOCK(lock);
+
+	while ((length = CANCAP_PEEK(&hCapture, &data)) != 0) {
+		uint32_t sent = 0;
+		while (sent < length && itm->PORT[CAN_SNIFFER_ITM_PORT].u32 != 0) {
+			if (length - sent >= 4U) {
+				itm->PORT[CAN_SNIFFER_ITM_PORT].u32 = (uint32_t) data[sent]
+						| ((uint32_t) data[sent + 1U] << 8)
+						| ((uint32_t) data[sent + 2U] << 16)
+						| ((uint32_t) data[sent + 3U] << 24);
+				sent += 4U;
+			} else {
+				itm->PORT[CAN_SNIFFER_ITM_PORT].u8 = data[sent];
+				sent++;
+			}
+		}
+		CANCAP_RELEASE(&hCapture, sent);
+		if (sent < length) {
+			break;                 // ITM FIFO full, come back next pass
+		}
+	}
+
+	if ((int32_t) (CYCLE_COUNTER_READ() - reportDeadline) >= 0) {
+		reportDeadline = CYCLE_COUNTER_READ()
+				+ CAN_SNIFFER_REPORT_MS * 1000U * BOOT_SYSCLK_MHZ;
+		printf("Sniffer: %lu frames, %lu dropped, %lu bytes, ring peak %lu/%u\n",
+				(unsigned long) hCapture.Frames,
+				(unsigned long) hCapture.Dropped,
+				(unsigned long) hCapture.Bytes,
+				(unsigned long) hCapture.HighWater, CANCAP_RING_BYTES);
+	}
+}
+#endif /* CAN_SNIFFER */
+
+#if CAN_TRAFFIC_GEN
+/****************************************************************************
+ * Traffic Generator
+ *
+ * can_traffic.c decides what to send and when; this glue gives it TIM2 as
+ * its clock and CAN1_TX_WRITE as its TX path, so frames skip the printf of
+ * CAN1_Tx and the rate limiter and the bus can be held at line rate. Every
+ * transmission completed interrupt refills the element it freed, and TIM2
+ * CC4 is armed for the next periodic release or the next fill frame the
+ * target allows. Both interrupts run at the same priority, so CANGEN_POLL
+ * never nests.
+ ****************************************************************************/
+
+static CANGEN_StreamTypeDef_t trafficStreams[] = {
+	{ .IdMin = 0x0C0, .IdMax = 0x0C0, .DlcMin = 8, .DlcMax = 8,
+		.PeriodUs = 10000 },              // 10 ms reference frame
+	{ .IdMin = 0x0C1, .IdMax = 0x0C4, .DlcMin = 4, .DlcMax = 8,
+		.PeriodUs = 20000, .JitterUs = 1000 }, // Jittered 20 ms signals
+	{ .IdMin = 0x100, .IdMax = 0x6FF, .DlcMin = 0, .DlcMax = 15,
+		.FdPermille = CAN_TRAFFIC_FD_PERMILLE,
+		.BrsPermille = CAN_TRAFFIC_BRS_PERMILLE, .Weight = 3 }, // Fill
+	{ .IdMin = 0x18FF0000, .IdMax = 0x18FFFFFF, .Extended = 1, .DlcMin = 8,
+		.DlcMax = 8, .Weight = 1 },       // J1939-like extended fill
+};
+
+/* TIM2 as the generator clock, 1 us */
+static uint32_t CAN_TRAFFIC_US(void) {
+	return TIM2_t->CNT;
+}
+
+/* Straight into the TX FIFO: no printf, no rate limiter */
+static uint8_t CAN_TRAFFIC_TRANSMIT(void *ctx,
+		const FDCAN_FrameTypeDef_t *pFrame) {
+	return CAN1_TX_WRITE((FDCAN_Handle_Typedef_t*) ctx, pFrame);
+}
+
+/* Arm TIM2 CC4 for the next frame the target allows; with a frame waiting
+ * for a TX element the transmission completed interrupt comes first */
+static void CAN_TRAFFIC_ARM(void) {
+	uint32_t wait = CANGEN_NEXT_US(&hTraffic);
+
+	if (wait == CANGEN_IDLE) {
+		wait = CAN_TRAFFIC_RETRY_US;   // Keeps it going through bus-off
+	}
+	TIM2_t->CCR4 = TIM2_t->CNT + ((wait != 0) ? wait : 1U);
+	CLEAR_BIT_FIELD(TIM2_t->SR, TIM_SR_CC4IF_POS);
+	SET_BIT_FIELD(TIM2_t->DIER, TIM_DIER_CC4IE_POS);
+}
+
+/**
+ * @brief  Start the generator: TX done interrupts of every TX buffer, the
+ *         TIM2 interrupt, and the first frames
+ * @note   Needs TIM2 running and FDCAN1 out of init mode
+ */
+void CAN_TRAFFIC_INIT(void) {
+	hTraffic.Streams = trafficStreams;
+	hTraffic.StreamCount = sizeof(trafficStreams) / sizeof(trafficStreams[0]);
+	hTraffic.NominalKbps = FDCAN1_NOMINAL_KBPS;
+	hTraffic.DataKbps = FDCAN1_DATA_KBPS;
+	hTraffic.LoadPermille = CAN_TRAFFIC_LOAD_PERMILLE;
+	hTraffic.BurstLoadPermille = CAN_TRAFFIC_BURST_PERMILLE;
+	hTraffic.BurstPeriodUs = CAN_TRAFFIC_BURST_PERIOD_US;
+	hTraffic.BurstLengthUs = CAN_TRAFFIC_BURST_US;
+	hTraffic.GetUs = CAN_TRAFFIC_US;
+	hTraffic.Transmit = CAN_TRAFFIC_TRANSMIT;
+	hTraffic.Ctx = &hfdCan1;
+	CANGEN_INIT(&hTraffic);
+	trafficCycles = trafficCyclesMax = 0;
+
+	// Transmission completed, for all three TX buffers
+	WRITE_ALL_REG(hfdCan1.Instace->TXBTIE, 0x7U);
+	WRITE_REG_BIT(hfdCan1.Instace->IR, 1, FDCAN_IR_TC_POS);
+	SET_BIT_FIELD(hfdCan1.Instace->IE, FDCAN_IR_TC_POS);
+	NVIC_ISER0_p[TIM2_IRQ_t / 32] = (1UL << (TIM2_IRQ_t % 32));
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	CAN_TRAFFIC_POLL();
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @brief  Queue what the generator has due and re-arm TIM2 CC4
+ * @note   From TIM2 CC4 and the FDCAN transmission completed interrupt
+ */
+FDCAN_RAMFUNC void CAN_TRAFFIC_POLL(void) {
+	uint32_t start = CYCLE_COUNTER_READ();
+
+	CANGEN_POLL(&hTraffic);
+	CAN_TRAFFIC_ARM();
+	uint32_t cycles = CYCLE_COUNTER_READ() - start;
+	trafficCycles += cycles;
+	if (cycles > trafficCyclesMax) {
+		trafficCyclesMax = cycles;
+	}
+}
+
+/**
+ * @brief  Report requested and achieved load once per CAN_TRAFFIC_REPORT_MS:
+ *         over the last period, since the start, and as can_stats.c sees it
+ */
+void CAN_TRAFFIC_TASK(void) {
+	static uint32_t reportDeadline;
+	static uint64_t lastUs, lastRequestedNs, lastWireNs;
+	uint32_t requested, skipped = 0;
+
+#if CAN_ERR_MANAGER
+	CAN_ERR_TASK();                    // Bus-off recovery during soak runs
+#endif
+	if ((int32_t) (CYCLE_COUNTER_READ() - reportDeadline) < 0) {
+		return;
+	}
+	reportDeadline = CYCLE_COUNTER_READ()
+			+ CAN_TRAFFIC_REPORT_MS * 1000U * BOOT_SYSCLK_MHZ;
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	uint32_t achieved = CANGEN_LOAD_PERMILLE(&hTraffic, &requested);
+	uint64_t us = hTraffic.ElapsedUs;
+	uint64_t requestedNs = hTraffic.RequestedNs;
+	uint64_t wireNs = hTraffic.WireNs;
+	uint32_t frames = hTraffic.Frames;
+	uint32_t fdFrames = hTraffic.FdFrames;
+	uint32_t brsFrames = hTraffic.BrsFrames;
+	uint32_t fifoFull = hTraffic.FifoFull;
+	for (uint32_t n = 0; n < hTraffic.StreamCount; n++) {
+		skipped += trafficStreams[n].Skipped;
+	}
+	uint64_t cycles = trafficCycles;
+	uint32_t cyclesMax = trafficCyclesMax;
+#if CAN_STATS
+	uint32_t bus = CANSTATS_LOAD_PERMILLE(&hCanStats, CAN_TRAFFIC_REPORT_MS);
+#endif
+	__set_PRIMASK(primask);
+
+	uint64_t periodUs = (us > lastUs) ? us - lastUs : 1U;
+	uint32_t periodRequested = (uint32_t) ((requestedNs - lastRequestedNs) / periodUs);
+	uint32_t periodAchieved = (uint32_t) ((wireNs - lastWireNs) / periodUs);
+	lastUs = us;
+	lastRequestedNs = requestedNs;
+	lastWireNs = wireNs;
+
+	printf("Traffic: last %lu ms %lu.%lu%% of %lu.%lu%% requested,"
+			" total %lu.%lu%% of %lu.%lu%%", (unsigned long) (periodUs / 1000U),
+			(unsigned long) periodAchieved / 10U,
+			(unsigned long) periodAchieved % 10U,
+			(unsigned long) periodRequested / 10U,
+			(unsigned long) periodRequested % 10U,
+			(unsigned long) achieved / 10U, (unsigned long) achieved % 10U,
+			(unsigned long) requested / 10U, (unsigned long) requested % 10U);
+#if CAN_STATS
+	printf(", bus %lu.%lu%%", (unsigned long) bus / 10U,
+			(unsigned long) bus % 10U);
+#endif
+	printf("\n  %lu frames, %lu FD, %lu BRS, %lu FIFO full, %lu periods"
+			" skipped, %lu cycles/frame (max %lu per poll)\n",
+			(unsigned long) frames, (unsigned long) fdFrames,
+			(unsigned long) brsFrames, (unsigned long) fifoFull,
+			(unsigned long) skipped,
+			(unsigned long) (frames ? cycles / frames : 0),
+			(unsigned long) cyclesMax);
+}
+#endif /* CAN_TRAFFIC_GEN */
+
+#if CAN_REPLAY
+/****************************************************************************
+ * Trace Replay
+ *
+ * can_replay.c reads the log and keeps the RX FIFO model; this glue gives it
+ * TIM2 as its clock, the acceptance filters of message RAM at arrival, and
+ * CAN1_RX_DISPATCH for delivery. Replay runs in the main loop only, so the
+ * handlers see it as they see polled RX; the cycles of each delivery are
+ * what the application spends on a frame.
+ ****************************************************************************/
+
+/* Built-in log for CAN_REPLAY_IMAGE_ADDR 0: frames for the 0x125 filter,
+ * five of them within 600 us, more than a 3-element FIFO polled once per ms
+ * holds, and frames the filters or the interface choice leave out */
+static const char canReplayDemo[] =
+	"# Demo log, candump -L\n"
+	"(1700000000.000000) can0 125#4869\n"
+	"(1700000000.010000) can0 125#0102030405060708\n"
+	"(1700000000.010000) can0 200#DEADBEEF\n"
+	"(1700000000.020000) can0 125#R2\n"
+	"(1700000000.030000) can0 18FEF100#1122334455667788\n"
+	"(1700000000.040000) can0 125##1.00.11.22.33.44.55.66.77.88.99.AA.BB\n"
+	"(1700000000.050000) can0 125#10\n"
+	"(1700000000.050150) can0 125#11\n"
+	"(1700000000.050300) can0 125#12\n"
+	"(1700000000.050450) can0 125#13\n"
+	"(1700000000.050600) can0 125#14\n"
+	"(1700000000.100000) can1 125#FF\n"
+	"(1700000000.100000) can0 125#4869\n";
+
+/* TIM2 as the replay clock, 1 us */
+static uint32_t CAN_REPLAY_US(void) {
+	return TIM2_t->CNT;
+}
+
+/**
+ * @brief  Acceptance filtering of FDCAN1 in software: the filter lists in
+ *         message RAM and RXGFC applied to a frame the way the hardware does
+ * @retval 1 if the frame would be stored in RX FIFO 0, with FIDX and ANMF
+ *         set as the hardware sets them
+ */
+static uint8_t FDCAN_RX_FILTER_MATCH(FDCAN_Handle_Typedef_t *hFDCAN,
+		FDCAN_FrameTypeDef_t *pFrame) {
+	uint32_t rxgfc = hFDCAN->Instace->RXGFC;
+	uint8_t extended = FDCAN_FRAME_IS_EXTENDED(pFrame);
+	uint32_t id = FDCAN_FRAME_GET_ID(pFrame);
+
+	pFrame->w1 &= ~((1UL << FDCAN_ELEM_ANMF_POS) | (0x7FUL << FDCAN_ELEM_FIDX_POS));
+	// RRFE/RRFS: remote frames rejected
+	if (FDCAN_FRAME_IS_REMOTE(pFrame) && READ_BIT_FIELD(rxgfc, extended ? 0 : 1, 0x1)) {
+		return 0;
+	}
+
+	// First enabled element that matches decides
+	uint32_t count = extended ? READ_BIT_FIELD(rxgfc, 24, 0xF)
+			: READ_BIT_FIELD(rxgfc, 16, 0x1F);
+	for (uint32_t n = 0; n < count; n++) {
+		uint32_t type, config, id1, id2, match;
+		if (extended) {
+			const volatile uint32_t *f = (const volatile uint32_t*) (SRAMCAN_BASE_ADDR
+					+ FDCAN_EXTID_FILTER_OFFSET + n * SRAMCAN_FLE_SIZE);
+			config = f[0] >> 29;
+			id1 = f[0] & FDCAN_ELEM_EXTID_MASK;
+			type = f[1] >> 30;
+			id2 = f[1] & FDCAN_ELEM_EXTID_MASK;
+		} else {
+			uint32_t f = *(const volatile uint32_t*) (SRAMCAN_BASE_ADDR
+					+ n * SRAMCAN_FLS_SIZE);
+			type = f >> 30;
+			config = (f >> 27) & 0x7U;
+			id1 = (f >> 16) & FDCAN_ELEM_STDID_MASK;
+			id2 = f & FDCAN_ELEM_STDID_MASK;
+			if (type == FDCAN_FILTER_RANGE_NO_EIDM) {
+				continue;              // Standard type 3: element disabled
+			}
+		}
+		if (config == FDCAN_FILTER_DISABLE) {
+			continue;
+		}
+		uint32_t mid = (extended && type != FDCAN_FILTER_RANGE_NO_EIDM) ?
+				(id & hFDCAN->Instace->XIDAM) : id;
+		if (type == FDCAN_FILTER_DUAL) {
+			match = (mid == id1) || (mid == id2);
+		} else if (type == FDCAN_FILTER_MASK) {
+			match = ((mid ^ id1) & id2) == 0;
+		} else {
+			match = (mid >= id1) && (mid <= id2);
+		}
+		if (match) {
+			if (config != FDCAN_FILTER_TO_RXFIFO0
+					&& config != FDCAN_FILTER_SET_PRIORITY_RXFIFO0) {
+				return 0;              // Rejected, FIFO 1 or priority only
+			}
+			pFrame->w1 |= n << FDCAN_ELEM_FIDX_POS;
+			return 1;
+		}
+	}
+
+	// ANFE/ANFS: non-matching frames
+	if (READ_BIT_FIELD(rxgfc, extended ? 2 : 4, 0x3) != FDCAN_ACCEPT_IN_RX_FIFO0_t) {
+		return 0;
+	}
+	pFrame->w1 |= 1UL << FDCAN_ELEM_ANMF_POS;
+	return 1;
+}
+
+/* Arrival: filters, then the RX timestamp of now */
+static uint8_t CAN_REPLAY_ACCEPT(void *ctx, FDCAN_FrameTypeDef_t *pFrame) {
+	FDCAN_Handle_Typedef_t *hFDCAN = (FDCAN_Handle_Typedef_t*) ctx;
+
+	if (!FDCAN_RX_FILTER_MATCH(hFDCAN, pFrame)) {
+		return 0;
+	}
+	pFrame->w1 = (pFrame->w1 & ~FDCAN_ELEM_RXTS_MASK)
+			| (uint16_t) hFDCAN->Instace->TSCV;
+	return 1;
+}
+
+/**
+ * @brief  Route a frame the way USER_CAN_RX routes RX FIFO 0 elements, with
+ *         the hooks of CAN1_RxFrame, and CAN1_RX_DECODE for the rest
+ */
+static void CAN1_RX_DISPATCH(const FDCAN_FrameTypeDef_t *pFrame) {
+	CAN1_RX_TAP(pFrame);
+#if XCP_ENABLE
+	if (!FDCAN_FRAME_IS_EXTENDED(pFrame)
+			&& FDCAN_FRAME_GET_ID(pFrame) == XCP_CRO_ID) {
+		XCP_NODE_FRAME(pFrame);
+		return;
+	}
+#endif
+#if UDS_ENABLE
+	if (!FDCAN_FRAME_IS_EXTENDED(pFrame)
+			&& FDCAN_FRAME_GET_ID(pFrame) == UDS_RX_ID) {
+		UDS_NODE_FRAME(pFrame);
+		return;
+	}
+#endif
+#if J1939_ENABLE
+	if (FDCAN_FRAME_IS_EXTENDED(pFrame)) {
+		uint32_t lock = FDCAN_IRQ_LOCK(); // Frames off the bus reach it from the ISR
+		J1939_RX_FRAME(&hJ1939, pFrame);
+		FDCAN_IRQ_UNLOCK(lock);
+		return;
+	}
+#endif
+	CAN1_RX_DECODE(pFrame, &hRXHeader, receivedData);
+}
+
+/* Delivery: one frame through the RX path, timed */
+static void CAN_REPLAY_DELIVER(void *ctx, const FDCAN_FrameTypeDef_t *pFrame) {
+	(void) ctx;
+	uint32_t start = CYCLE_COUNTER_READ();
+
+	CAN1_RX_DISPATCH(pFrame);
+	uint32_t cycles = CYCLE_COUNTER_READ() - start;
+	replayCycles += cycles;
+	if (cycles > replayCyclesMax) {
+		replayCyclesMax = cycles;
+	}
+}
+
+/**
+ * @brief  Open the log at CAN_REPLAY_IMAGE_ADDR, or the built-in one
+ * @note   Needs TIM2 running and the filters configured; the clock starts
+ *         at the first CAN_REPLAY_TASK
+ */
+void CAN_REPLAY_INIT(void) {
+	if (CAN_REPLAY_IMAGE_ADDR != 0) {
+		hReplay.Image = (const uint8_t*) CAN_REPLAY_IMAGE_ADDR;
+		hReplay.Length = CAN_REPLAY_IMAGE_BYTES;
+	} else {
+		hReplay.Image = (const uint8_t*) canReplayDemo;
+		hReplay.Length = sizeof(canReplayDemo) - 1U;
+	}
+	hReplay.Interface = CAN_REPLAY_INTERFACE;
+	hReplay.Mode = CAN_REPLAY_MODE;
+	hReplay.ScalePermille = CAN_REPLAY_SCALE_PERMILLE;
+	hReplay.FifoDepth = SRAMCAN_RF0_NBR;
+	hReplay.GetUs = CAN_REPLAY_US;
+	hReplay.Accept = CAN_REPLAY_ACCEPT;
+	hReplay.Deliver = CAN_REPLAY_DELIVER;
+	hReplay.Ctx = &hfdCan1;
+	CANRP_INIT(&hReplay);
+	replayCycles = replayCyclesMax = 0;
+}
+
+/**
+ * @brief  Let the frames due arrive and deliver a budget of them
+ * @note   Main loop and delayMS, next to FDCAN_RX_POLL
+ */
+void CAN_REPLAY_TASK(void) {
+	if (hReplay.GetUs == NULL) {
+		return;                        // delayMS before CAN_REPLAY_INIT
+	}
+	CANRP_POLL(&hReplay, (CAN_REPLAY_MODE == CANRP_FAST) ?
+			CAN_REPLAY_FAST_BUDGET : CAN_REPLAY_BUDGET);
+}
+
+/**
+ * @brief  Print frames delivered and lost, latency and RX path throughput
+ */
+void CAN_REPLAY_REPORT(void) {
+	const CANRP_HandleTypeDef_t *r = &hReplay;
+	uint32_t delivered = r->Delivered;
+	uint32_t perFrame = delivered ? (uint32_t) (replayCycles / delivered) : 0;
+	uint64_t us = r->Done ? r->DoneUs : r->ElapsedUs;
+
+	printf("Replay: %lu frames, %lu delivered, %lu overruns, %lu filtered,"
+			" %lu skipped, %lu malformed, %lu lost in capture%s\n",
+			(unsigned long) r->Frames, (unsigned long) delivered,
+			(unsigned long) r->Overruns, (unsigned long) r->Filtered,
+			(unsigned long) r->Skipped, (unsigned long) r->Malformed,
+			(unsigned long) r->SourceDropped, r->Done ? ", done" : "");
+	printf("  %lu cycles/frame (max %lu), %lu frames/s RX path,"
+			" %lu frames/s replayed, FIFO peak %u/%u",
+			(unsigned long) perFrame, (unsigned long) replayCyclesMax,
+			(unsigned long) (perFrame ? BOOT_SYSCLK_MHZ * 1000000UL / perFrame : 0),
+			(unsigned long) (us ? (uint64_t) delivered * 1000000U / us : 0),
+			(unsigned) r->FifoPeak, (unsigned) r->FifoDepth);
+	if (r->Mode != CANRP_FAST) {
+		printf(", latency %lu us avg, %lu us max",
+				(unsigned long) (delivered ? r->LatencySumUs / delivered : 0),
+				(unsigned long) r->LatencyMaxUs);
+	}
+	printf("\n");
+}
+#endif /* CAN_REPLAY */
+
+#if J1939_ENABLE
+/****************************************************************************
+ * J1939 Node
+ ****************************************************************************/
+
+/* Cycle counter as the J1939 timebase */
+static uint32_t J1939_NODE_TICKS(void) {
+	return CYCLE_COUNTER_READ();
+}
+
+/* From the FDCAN ISR and J1939_NODE_POLL: the lock nests in both */
+static uint8_t J1939_NODE_SEND(void *ctx, const FDCAN_FrameTypeDef_t *pFrame) {
+	uint32_t lock = TX_SCHED_LOCK();
+	uint8_t queued = CAN1_TxFrame((FDCAN_Handle_Typedef_t*) ctx, pFrame);
+	TX_SCHED_UNLOCK(lock);
+	return queued;
+}
+
+/**
+ * @brief  Configure the J1939 node and send its Address Claimed
+ * @note   Needs FDCAN1 out of init mode and the cycle counter running
+ */
+void J1939_NODE_INIT(void) {
+	hJ1939.Name = J1939_NODE_NAME;
+	hJ1939.PreferredAddress = J1939_NODE_ADDRESS;
+	hJ1939.TicksPerUs = BOOT_SYSCLK_MHZ;
+	hJ1939.GetTicks = J1939_NODE_TICKS;
+	hJ1939.SendFrame = J1939_NODE_SEND;
+	hJ1939.Ctx = &hfdCan1;
+	uint32_t lock = FDCAN_IRQ_LOCK();
+	J1939_INIT(&hJ1939);
+	FDCAN_IRQ_UNLOCK(lock);
+}
+
+/**
+ * @brief  Run the claim and transport timers
+ * @note   Main loop and delayMS. J1939_RX_FRAME runs in the FDCAN interrupt,
+ *         so sessions and claim state are only touched with it masked.
+ */
+void J1939_NODE_POLL(void) {
+	uint32_t lock = FDCAN_IRQ_LOCK();
+	J1939_POLL(&hJ1939);
+	FDCAN_IRQ_UNLOCK(lock);
+}
+
+/**
+ * @brief  Hand the oldest RX FIFO 0 element to the J1939 node if it is extended
+ * @retval 1 if the element was consumed, 0 if it is left for CAN1_Rx
+ */
+FDCAN_RAMFUNC uint8_t J1939_NODE_RX(void) {
+	uint8_t get_index = FDCAN_RX_FIFO0_GET_INDEX(&hfdCan1);
+
+	if (get_index == 0xFF
+			|| !(FDCAN_RX_ELEMENT_ADDR(get_index)[0]
+					& (1UL << FDCAN_ELEM_XTD_POS))) {
+		return 0;
+	}
+
+	FDCAN_FrameTypeDef_t frame;
+	if (CAN1_RxFrame(&hfdCan1, &frame)) {
+		J1939_RX_FRAME(&hJ1939, &frame);
+	}
+	return 1;
+}
+#endif /* J1939_ENABLE */
+
+#if XCP_ENABLE
+/****************************************************************************
+ * XCP Slave
+ *
+ * TIM2 CC2 fires every XCP_DAQ_TICK_US and samples the event channels that
+ * are due; DAQ packets go out from there and from the TX FIFO empty
+ * interrupt. Both run at the same priority, so only the polled RX path has
+ * to mask interrupts around the slave.
+ ****************************************************************************/
+
+#define XCP_SRAM_BASE               0x20000000U
+#define XCP_SRAM_BYTES              (32U * 1024U)
+
+/* Event channels, all multiples of XCP_DAQ_TICK_US */
+static const XCP_EventTypeDef_t xcpEvents[] = {
+	{ "1ms", 1000U, 2 },
+	{ "10ms", 10000U, 1 },
+	{ "100ms", 100000U, 0 },
+};
+
+/* The calibration block first: the first region holding an address wins */
+static XCP_RegionTypeDef_t xcpRegions[2];
+
+static uint32_t xcpTicks;              // CC2 events since XCP_NODE_INIT
+static uint32_t xcpTicksLate;          // Ticks skipped after a late interrupt
+static uint32_t xcpSamplerCycles;      // Cycles spent in XCP_EVENT
+static uint32_t xcpSamplerCyclesMax;   // Longest tick
+static uint32_t xcpSamplerCalls;
+
+/* TIM2 counts microseconds, the XCP DAQ timestamp unit */
+static uint32_t XCP_NODE_TIMESTAMP(void) {
+	return TIM2_t->CNT;
+}
+
+/* Only called from the TIM2 and FDCAN interrupts or with interrupts masked */
+static uint8_t XCP_NODE_SEND(void *ctx, const FDCAN_FrameTypeDef_t *pFrame) {
+	return CAN1_TxFrame((FDCAN_Handle_Typedef_t*) ctx, pFrame);
+}
+
+/**
+ * @brief  Configure the XCP slave, then start the DAQ clock on TIM2 CC2
+ * @note   Needs TIM2 running and FDCAN1 out of init mode
+ */
+void XCP_NODE_INIT(void) {
+	xcpRegions[0].Address = (uint32_t) &userCal;
+	xcpRegions[0].Base = (uint8_t*) &userCal;
+	xcpRegions[0].Length = sizeof(userCal);
+	xcpRegions[0].Writable = 1;
+	xcpRegions[1].Address = XCP_SRAM_BASE;
+	xcpRegions[1].Base = (uint8_t*) XCP_SRAM_BASE;
+	xcpRegions[1].Length = XCP_SRAM_BYTES;
+	xcpRegions[1].Writable = 0;        // Measurement only
+
+	hXcp.CroId = XCP_CRO_ID;
+	hXcp.DtoId = XCP_DTO_ID;
+	hXcp.FrameBytes = FDCAN1_DATA_KBPS ? XCP_MAX_FRAME_BYTES : 8U;
+	hXcp.BitRateSwitch = FDCAN1_DATA_KBPS != 0;
+	hXcp.Regions = xcpRegions;
+	hXcp.RegionCount = sizeof(xcpRegions) / sizeof(xcpRegions[0]);
+	hXcp.Events = xcpEvents;
+	hXcp.EventCount = sizeof(xcpEvents) / sizeof(xcpEvents[0]);
+	hXcp.Identifier = "stm32h503_can";
+	hXcp.GetTimestamp = XCP_NODE_TIMESTAMP;
+	hXcp.SendFrame = XCP_NODE_SEND;
+	hXcp.Ctx = &hfdCan1;
+	XCP_INIT(&hXcp);
+
+	// The TX FIFO empty interrupt pumps the DAQ queue
+	WRITE_REG_BIT(hfdCan1.Instace->IR, 1, FDCAN_IR_TFE_POS);
+	SET_BIT_FIELD(hfdCan1.Instace->IE, FDCAN_IR_TFE_POS);
+
+	TIM2_t->CCR2 = TIM2_t->CNT + XCP_DAQ_TICK_US;
+	CLEAR_BIT_FIELD(TIM2_t->SR, TIM_SR_CC2IF_POS);
+	SET_BIT_FIELD(TIM2_t->DIER, TIM_DIER_CC2IE_POS);
+	NVIC_ISER0_p[TIM2_IRQ_t / 32] = (1UL << (TIM2_IRQ_t % 32));
+}
+
+/**
+ * @brief  Pass a received command to the XCP slave
+ */
+FDCAN_RAMFUNC void XCP_NODE_FRAME(const FDCAN_FrameTypeDef_t *pFrame) {
+	// RX may be polled from the main loop: keep the DAQ clock out
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	XCP_RX_FRAME(&hXcp, pFrame);
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @brief  Hand the oldest RX FIFO 0 element to the XCP slave if it is a command
+ * @retval 1 if the element was consumed, 0 if it is left for the others
+ */
+FDCAN_RAMFUNC uint8_t XCP_NODE_RX(void) {
+	uint8_t get_index = FDCAN_RX_FIFO0_GET_INDEX(&hfdCan1);
+
+	if (get_index == 0xFF) {
+		return 0;
+	}
+	uint32_t w0 = FDCAN_RX_ELEMENT_ADDR(get_index)[0];
+	if ((w0 & (1UL << FDCAN_ELEM_XTD_POS))
+			|| ((w0 >> FDCAN_ELEM_STDID_POS) & FDCAN_ELEM_STDID_MASK)
+					!= XCP_CRO_ID) {
+		return 0;
+	}
+
+	FDCAN_FrameTypeDef_t frame;
+	if (CAN1_RxFrame(&hfdCan1, &frame)) {
+		XCP_NODE_FRAME(&frame);
+	}
+	return 1;
+}
+
+/**
+ * @brief  TIM2 CC2: sample every event channel due on this tick, then send
+ * @note   A tick that comes a period or more late skips the missed events
+ *         rather than sampling them back to back
+ */
+FDCAN_RAMFUNC void XCP_NODE_TICK(void) {
+	TIM2_t->CCR2 += XCP_DAQ_TICK_US;
+	while ((int32_t) (TIM2_t->CNT - TIM2_t->CCR2) >= 0) {
+		TIM2_t->CCR2 += XCP_DAQ_TICK_US;
+		xcpTicks++;
+		xcpTicksLate++;
+	}
+
+	if (hXcp.DaqRunning) {
+		uint32_t start = CYCLE_COUNTER_READ();
+		for (uint32_t i = 0; i < hXcp.EventCount; i++) {
+			if ((xcpTicks % (xcpEvents[i].PeriodUs / XCP_DAQ_TICK_US)) == 0) {
+				XCP_EVENT(&hXcp, (uint16_t) i);
+			}
+		}
+		uint32_t cycles = CYCLE_COUNTER_READ() - start;
+		xcpSamplerCycles += cycles;
+		xcpSamplerCalls++;
+		if (cycles > xcpSamplerCyclesMax) {
+			xcpSamplerCyclesMax = cycles;
+		}
+	}
+	xcpTicks++;
+	XCP_TX_PUMP(&hXcp);
+}
+
+/**
+ * @brief  TX FIFO empty, from the FDCAN interrupt: send what is queued
+ */
+FDCAN_RAMFUNC void XCP_NODE_TX_EMPTY(void) {
+	XCP_TX_PUMP(&hXcp);
+}
+
+/**
+ * @brief  Print DAQ throughput, losses and the cost of the sampler
+ */
+void XCP_NODE_REPORT(void) {
+	uint32_t calls = xcpSamplerCalls;
+	printf("XCP: %s, %lu commands (%lu negative), DAQ %lu frames %lu bytes\n",
+			hXcp.Connected ? "connected" : "idle",
+			(unsigned long) hXcp.Commands,
+			(unsigned long) hXcp.NegativeResponses,
+			(unsigned long) hXcp.DaqFrames, (unsigned long) hXcp.DaqBytes);
+	printf("  %lu samples lost, queue peak %lu/%u, %lu ticks late\n",
+			(unsigned long) hXcp.Overruns,
+			(unsigned long) hXcp.QueueHighWater, XCP_DTO_QUEUE_FRAMES,
+			(unsigned long) xcpTicksLate);
+	printf("  sampler avg %lu max %lu cycles per tick\n",
+			(unsigned long) (calls ? xcpSamplerCycles / calls : 0),
+			(unsigned long) xcpSamplerCyclesMax);
+}
+#endif /* XCP_ENABLE */
+
+#if UDS_ENABLE || UDS_BENCH
+/****************************************************************************
+ * UDS Server
+ *
+ * A request is served in the FDCAN interrupt as soon as its last frame is
+ * in, so the response time does not depend on the main loop. Hooks that
+ * need longer answer NRC 0x78 and continue from UDS_NODE_POLL; multi-frame
+ * responses are fed from the TX FIFO empty interrupt.
+ ****************************************************************************/
+
+static const char udsPartNumber[] = "H503-CAN-0001";
+static const char udsSoftwareVersion[] = "1.0.0";
+static uint8_t udsVin[17] = "00000000000000000";
+
+/* The download sink only checksums the image */
+static uint32_t udsImageAddress;
+static uint32_t udsImageBytes;
+static uint32_t udsImageSum;           // Byte sum of the completed blocks
+static uint32_t udsBlockSum;           // Byte sum of the current block
+
+/* Cycle counter as the server timebase */
+static uint32_t UDS_NODE_TICKS(void) {
+	return CYCLE_COUNTER_READ();
+}
+
+/* From the FDCAN interrupt, or from the main loop with it masked */
+static uint8_t UDS_NODE_SEND(void *ctx, const FDCAN_FrameTypeDef_t *pFrame) {
+	return CAN1_TxFrame((FDCAN_Handle_Typedef_t*) ctx, pFrame);
+}
+
+static void UDS_PUT_BE32(uint8_t *p, uint32_t value) {
+	p[0] = (uint8_t) (value >> 24);
+	p[1] = (uint8_t) (value >> 16);
+	p[2] = (uint8_t) (value >> 8);
+	p[3] = (uint8_t) value;
+}
+
+static uint8_t UDS_READ_LED_PERIOD(void *ctx, uint16_t did, uint8_t *pOut) {
+	UDS_PUT_BE32(pOut, userCal.LedHalfPeriodMs);
+	return 0;
+}
+
+static uint8_t UDS_WRITE_LED_PERIOD(void *ctx, uint16_t did,
+		const uint8_t *pData) {
+	uint32_t ms = ((uint32_t) pData[0] << 24) | ((uint32_t) pData[1] << 16)
+			| ((uint32_t) pData[2] << 8) | pData[3];
+	if (ms < 10U || ms > 5000U) {
+		return UDS_NRC_REQUEST_OUT_OF_RANGE;
+	}
+	userCal.LedHalfPeriodMs = ms;
+	return 0;
+}
+
+static uint8_t UDS_READ_SESSION(void *ctx, uint16_t did, uint8_t *pOut) {
+	pOut[0] = hUds.Session;
+	return 0;
+}
+
+/* Sorted by Id, UDS_INIT refuses the table otherwise */
+static const UDS_DidTypeDef_t udsDids[] = {
+	{ 0x0100, 4, UDS_IN_ALL, UDS_IN(UDS_SESSION_EXTENDED), NULL,
+			UDS_READ_LED_PERIOD, UDS_WRITE_LED_PERIOD },
+	{ 0xF186, 1, UDS_IN_ALL, 0, NULL, UDS_READ_SESSION, NULL },
+	{ 0xF187, sizeof(udsPartNumber) - 1U, UDS_IN_ALL, 0,
+			(void*) udsPartNumber, NULL, NULL },
+	{ 0xF18C, 12, UDS_IN_ALL, 0, (void*) UID_BASE, NULL, NULL }, // 96-bit UID
+	{ 0xF190, sizeof(udsVin), UDS_IN_ALL, UDS_IN(UDS_SESSION_EXTENDED),
+			udsVin, NULL, NULL },
+	{ 0xF195, sizeof(udsSoftwareVersion) - 1U, UDS_IN_ALL, 0,
+			(void*) udsSoftwareVersion, NULL, NULL },
+};
+
+/* Clear the per-service statistics printed by UDS_NODE_REPORT */
+static uint8_t UDS_CLEAR_STATS(void *ctx, uint16_t rid, const uint8_t *pIn,
+		uint32_t inLength, uint8_t *pOut, uint32_t *pOutLength) {
+	for (uint32_t i = 0; i < UDS_STATS_SERVICES; i++) {
+		hUds.Stats[i].Requests = 0;
+		hUds.Stats[i].Negative = 0;
+		hUds.Stats[i].Pending = 0;
+		hUds.Stats[i].TicksTotal = 0;
+		hUds.Stats[i].TicksMax = 0;
+	}
+	*pOutLength = 0;
+	return 0;
+}
+
+/* Size and byte sum of the last download */
+static uint8_t UDS_CHECK_IMAGE(void *ctx, uint16_t rid, const uint8_t *pIn,
+		uint32_t inLength, uint8_t *pOut, uint32_t *pOutLength) {
+	UDS_PUT_BE32(&pOut[0], udsImageBytes);
+	UDS_PUT_BE32(&pOut[4], udsImageSum);
+	*pOutLength = 8;
+	return 0;
+}
+
+#if FW_UPDATE
+/* Expected CRC-32 in; status (0 = image in flash and matching) and the
+ * CRC-32 read back from flash out */
+static uint8_t UDS_CHECK_FLASH(void *ctx, uint16_t rid, const uint8_t *pIn,
+		uint32_t inLength, uint8_t *pOut, uint32_t *pOutLength) {
+	if (inLength != 4U) {
+		return UDS_NRC_INCORRECT_LENGTH;
+	}
+	uint32_t expected = ((uint32_t) pIn[0] << 24) | ((uint32_t) pIn[1] << 16)
+			| ((uint32_t) pIn[2] << 8) | pIn[3];
+	pOut[0] = (hFwu.State == FWU_STATE_DONE && hFwu.Crc == expected) ? 0 : 1;
+	UDS_PUT_BE32(&pOut[1], hFwu.Crc);
+	*pOutLength = 5;
+	return 0;
+}
+#endif
+
+static const UDS_RoutineTypeDef_t udsRoutines[] = {
+	{ 0x0200, UDS_IN_ALL, UDS_CLEAR_STATS, NULL, NULL },
+	{ 0xFF01, UDS_IN(UDS_SESSION_PROGRAMMING) | UDS_IN(UDS_SESSION_EXTENDED),
+			UDS_CHECK_IMAGE, NULL, UDS_CHECK_IMAGE },
+#if FW_UPDATE
+	{ 0xFF02, UDS_IN(UDS_SESSION_PROGRAMMING), UDS_CHECK_FLASH, NULL, NULL },
+#endif
+};
+
+static uint8_t UDS_SINK_START(void *ctx, uint32_t address, uint32_t size) {
+	udsImageAddress = address;
+	udsImageBytes = 0;
+	udsImageSum = 0;
+	udsBlockSum = 0;
+	return 0;
+}
+
+/* A block sent again after a transport error starts over at its first byte */
+static uint8_t UDS_SINK_WRITE(void *ctx, uint32_t offset, const uint8_t *pData,
+		uint32_t length) {
+	if (offset == hUds.DownloadOffset) {
+		udsBlockSum = 0;
+	}
+	for (uint32_t i = 0; i < length; i++) {
+		udsBlockSum += pData[i];
+	}
+	udsImageBytes = offset + length;
+	return 0;
+}
+
+static uint8_t UDS_SINK_BLOCK_END(void *ctx) {
+	udsImageSum += udsBlockSum;
+	udsBlockSum = 0;
+	return 0;
+}
+
+static const UDS_DownloadSinkTypeDef_t udsSink = {
+	UDS_SINK_START, UDS_SINK_WRITE, UDS_SINK_BLOCK_END, NULL, NULL
+};
+
+#if FW_UPDATE
+/****************************************************************************
+ * Firmware Update
+ *
+ * The flash registers are driven directly: an operation is started and its
+ * end comes back through FLASH_IRQHandler, so nothing waits on BSY. The
+ * image goes to 0x08010000, the bank the CPU is not running from, which
+ * reads on while the other one is busy.
+ ****************************************************************************/
+
+/* Unlock NSCR once, it stays unlocked until reset */
+static uint8_t FWU_FLASH_UNLOCK(void) {
+	if (READ_BIT_FIELD(FLASH_t->NSCR, FLASH_CR_LOCK_POS, 1)) {
+		FLASH_t->NSKEYR = FW_UPDATE_KEY1;
+		FLASH_t->NSKEYR = FW_UPDATE_KEY2;
+	}
+	return READ_BIT_FIELD(FLASH_t->NSCR, FLASH_CR_LOCK_POS, 1);
+}
+
+/* Bank mapped at 0x08010000: bank 2 unless the banks are swapped */
+static uint32_t FWU_FLASH_BANK(void) {
+	return READ_BIT_FIELD(FLASH_t->OPTSR_CUR, FLASH_OPTSR_SWAP_BANK_POS, 1) ?
+			0 : (1UL << FLASH_CR_BKSEL_POS);
+}
+
+static uint8_t FWU_FLASH_ERASE(void *ctx, uint32_t address) {
+	if (FWU_FLASH_UNLOCK()) {
+		return 1;
+	}
+	uint32_t sector = (address - FW_UPDATE_REGION_ADDR) / FW_UPDATE_SECTOR_BYTES;
+
+	FLASH_t->NSCCR = (1UL << FLASH_SR_EOP_POS) | FLASH_SR_ERRORS;
+	REG_WRITE(FLASH_t->NSCR, (1UL << FLASH_CR_SER_POS) | FWU_FLASH_BANK()
+			| FIELD_PREP(FLASH_CR_SNB_FLD, sector)
+			| (1UL << FLASH_CR_EOPIE_POS) | FLASH_CR_ERRIE);
+	SET_BIT_FIELD(FLASH_t->NSCR, FLASH_CR_START_POS);
+	return 0;
+}
+
+/* The quad-word goes into the write buffer with interrupts off, as the
+ * flash expects its four words back to back */
+static uint8_t FWU_FLASH_PROGRAM(void *ctx, uint32_t address,
+		const uint32_t *pQuadWord) {
+	if (FWU_FLASH_UNLOCK()) {
+		return 1;
+	}
+	volatile uint32_t *dest = (volatile uint32_t*) address;
+
+	FLASH_t->NSCCR = (1UL << FLASH_SR_EOP_POS) | FLASH_SR_ERRORS;
+	REG_WRITE(FLASH_t->NSCR, (1UL << FLASH_CR_PG_POS)
+			| (1UL << FLASH_CR_EOPIE_POS) | FLASH_CR_ERRIE);
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	for (uint32_t i = 0; i < FWU_QUAD_WORD / 4U; i++) {
+		dest[i] = pQuadWord[i];
+	}
+	__DSB();
+	__set_PRIMASK(primask);
+	return 0;
+}
+
+static uint8_t FWU_NRC(uint8_t result) {
+	switch (result) {
+	case FWU_OK:
+		return 0;
+	case FWU_BUSY:
+		return UDS_NRC_RESPONSE_PENDING; // Answered from FLASH_IRQHandler
+	case FWU_ERR_RANGE:
+		return UDS_NRC_REQUEST_OUT_OF_RANGE;
+	case FWU_ERR_FLASH:
+		return UDS_NRC_GENERAL_PROGRAMMING_FAILURE;
+	default:
+		return UDS_NRC_TRANSFER_DATA_SUSPENDED;
+	}
+}
+
+static uint8_t FWU_SINK_START(void *ctx, uint32_t address, uint32_t size) {
+	// Old content of the region may still sit in the cache
+	SET_BIT_FIELD(ICACHE_t->CR, ICACHE_CR_CACHEINV_POS);
+	while (READ_BIT_FIELD(ICACHE_t->SR, ICACHE_SR_BUSYF_POS, 1))
+		;
+	uint8_t result = FWU_BEGIN(&hFwu, address, size);
+	return (result == FWU_BUSY) ?
+			UDS_NRC_CONDITIONS_NOT_CORRECT : FWU_NRC(result);
+}
+
+static uint8_t FWU_SINK_WRITE(void *ctx, uint32_t offset, const uint8_t *pData,
+		uint32_t length) {
+	return FWU_NRC(FWU_WRITE(&hFwu, offset, pData, length));
+}
+
+static uint8_t FWU_SINK_BLOCK_END(void *ctx) {
+	return FWU_NRC(FWU_BLOCK_END(&hFwu));
+}
+
+static uint8_t FWU_SINK_EXIT(void *ctx) {
+	return FWU_NRC(FWU_FINISH(&hFwu));
+}
+
+static void FWU_SINK_ABORT(void *ctx) {
+	FWU_ABORT(&hFwu);
+}
+
+static const UDS_DownloadSinkTypeDef_t fwuSink = {
+	FWU_SINK_START, FWU_SINK_WRITE, FWU_SINK_BLOCK_END, FWU_SINK_EXIT,
+	FWU_SINK_ABORT
+};
+
+static void FWU_NODE_INIT(void) {
+	hFwu.RegionAddress = FW_UPDATE_REGION_ADDR;
+	hFwu.RegionSize = FW_UPDATE_REGION_BYTES;
+	hFwu.SectorSize = FW_UPDATE_SECTOR_BYTES;
+	hFwu.RegionData = (const uint8_t*) FW_UPDATE_REGION_ADDR;
+	hFwu.Erase = FWU_FLASH_ERASE;
+	hFwu.Program = FWU_FLASH_PROGRAM;
+	hFwu.Ctx = NULL;
+	FWU_INIT(&hFwu);
+
+	NVIC_ISER0_p[FLASH_IRQ_t / 32] = (1UL << (FLASH_IRQ_t % 32));
+}
+
+/**
+ * @brief  End of an erase or quad-word program: start the next one
+ * @note   Same priority as the FDCAN interrupt, so the two never preempt
+ *         each other. A block or exit waiting for the flash is answered
+ *         from here rather than from the main loop.
+ */
+void FLASH_IRQHandler(void) {
+	uint32_t sr = FLASH_t->NSSR;
+
+	FLASH_t->NSCCR = sr & ((1UL << FLASH_SR_EOP_POS) | FLASH_SR_ERRORS);
+	REG_WRITE(FLASH_t->NSCR, 0);      // Drop PG/SER and the interrupt enables
+	FWU_FLASH_DONE(&hFwu, (sr & FLASH_SR_ERRORS) != 0);
+	if (hUds.Busy) {
+		UDS_POLL(&hUds);
+	}
+}
+#endif /* FW_UPDATE */
+
+/* Give the positive response up to 10 ms to leave the TX FIFO, then reset */
+static void UDS_NODE_RESET(void *ctx, uint8_t resetType) {
+	uint32_t start = CYCLE_COUNTER_READ();
+	while (hfdCan1.Instace->TXBRP != 0
+			&& CYCLE_COUNTER_READ() - start < 10000U * BOOT_SYSCLK_MHZ)
+		;
+	NVIC_SystemReset();
+}
+
+/* Server configuration, shared by the node and the benchmark */
+static void UDS_NODE_SETUP(uint8_t txDataLength, uint8_t bitRateSwitch,
+		uint8_t toFlash) {
+	hUds.IsoTp.TxId = UDS_TX_ID;
+	hUds.IsoTp.RxId = UDS_RX_ID;
+	hUds.IsoTp.IdExtended = 0;
+	hUds.IsoTp.TxDataLength = txDataLength;
+	hUds.IsoTp.BitRateSwitch = bitRateSwitch;
+	hUds.IsoTp.BlockSize = 0;          // Requests are taken from the interrupt
+	hUds.IsoTp.STmin = 0;
+	hUds.IsoTp.PadFrames = 1;
+	hUds.IsoTp.PadByte = 0xCC;
+	hUds.IsoTp.TicksPerUs = BOOT_SYSCLK_MHZ;
+	hUds.IsoTp.GetTicks = UDS_NODE_TICKS;
+	hUds.SendFrame = UDS_NODE_SEND;
+	hUds.Ctx = &hfdCan1;
+	hUds.Dids = udsDids;
+	hUds.DidCount = sizeof(udsDids) / sizeof(udsDids[0]);
+	hUds.Routines = udsRoutines;
+	hUds.RoutineCount = sizeof(udsRoutines) / sizeof(udsRoutines[0]);
+	hUds.Sink = &udsSink;
+	hUds.MaxBlockLength = 0;           // UDS_MAX_BLOCK_LENGTH
+#if FW_UPDATE
+	if (toFlash) {
+		hUds.Sink = &fwuSink;
+		hUds.MaxBlockLength = FWU_BUFFER_BYTES + 2U; // One block per buffer
+	}
+#endif
+	hUds.Reset = UDS_NODE_RESET;
+	UDS_INIT(&hUds);
+}
+
+/**
+ * @brief  Start the UDS server in the default session
+ * @note   Needs FDCAN1 out of init mode
+ */
+void UDS_NODE_INIT(void) {
+#if FW_UPDATE
+	FWU_NODE_INIT();
+#endif
+	UDS_NODE_SETUP(FDCAN1_DATA_KBPS ? 64U : 8U, FDCAN1_DATA_KBPS != 0,
+			FW_UPDATE);
+
+	// Multi-frame responses continue from the TX FIFO empty interrupt
+	WRITE_REG_BIT(hfdCan1.Instace->IR, 1, FDCAN_IR_TFE_POS);
+	SET_BIT_FIELD(hfdCan1.Instace->IE, FDCAN_IR_TFE_POS);
+}
+
+/**
+ * @brief  Pass a received request frame to the server
+ */
+FDCAN_RAMFUNC void UDS_NODE_FRAME(const FDCAN_FrameTypeDef_t *pFrame) {
+	// RX may be polled from the main loop: keep the TX empty interrupt out
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	UDS_RX_FRAME(&hUds, pFrame);
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @brief  Hand the oldest RX FIFO 0 element to the server if it is a request
+ * @retval 1 if the element was consumed, 0 if it is left for the others
+ */
+FDCAN_RAMFUNC uint8_t UDS_NODE_RX(void) {
+	uint8_t get_index = FDCAN_RX_FIFO0_GET_INDEX(&hfdCan1);
+
+	if (get_index == 0xFF) {
+		return 0;
+	}
+	uint32_t w0 = FDCAN_RX_ELEMENT_ADDR(get_index)[0];
+	if ((w0 & (1UL << FDCAN_ELEM_XTD_POS))
+			|| ((w0 >> FDCAN_ELEM_STDID_POS) & FDCAN_ELEM_STDID_MASK)
+					!= UDS_RX_ID) {
+		return 0;
+	}
+
+	FDCAN_FrameTypeDef_t frame;
+	if (CAN1_RxFrame(&hfdCan1, &frame)) {
+		UDS_NODE_FRAME(&frame);
+	}
+	return 1;
+}
+
+/**
+ * @brief  Main loop: pending hooks, queued responses and the S3 timer
+ */
+void UDS_NODE_POLL(void) {
+	uint32_t lock = TX_SCHED_LOCK();   // The FDCAN interrupt serves requests too
+	UDS_POLL(&hUds);
+	TX_SCHED_UNLOCK(lock);
+}
+
+/**
+ * @brief  TX FIFO empty, from the FDCAN interrupt: send the next CFs
+ */
+FDCAN_RAMFUNC void UDS_NODE_TX_EMPTY(void) {
+	ISOTP_POLL(&hUds.IsoTp);
+}
+
+/**
+ * @brief  Print requests and server time per service
+ * @note   Time runs from the last request frame to the response queued,
+ *         UDS_BENCHMARK gives the round trip on the bus
+ */
+void UDS_NODE_REPORT(void) {
+	printf("UDS: session 0x%02X, %lu requests ignored while busy, %lu S3 timeouts\n",
+			hUds.Session, (unsigned long) hUds.Ignored,
+			(unsigned long) hUds.S3Timeouts);
+	for (uint32_t i = 0; i < UDS_STATS_SERVICES; i++) {
+		const UDS_ServiceStatsTypeDef_t *st = &hUds.Stats[i];
+		if (st->Requests == 0) {
+			continue;
+		}
+		printf("  SID %02X: %lu requests, %lu negative, %lu pending, avg %lu max %lu us\n",
+				st->Sid, (unsigned long) st->Requests,
+				(unsigned long) st->Negative, (unsigned long) st->Pending,
+				(unsigned long) (st->TicksTotal / st->Requests / BOOT_SYSCLK_MHZ),
+				(unsigned long) (st->TicksMax / BOOT_SYSCLK_MHZ));
+	}
+#if FW_UPDATE
+	printf("  Update: state %u, %lu/%lu bytes programmed, %lu erases, %lu quad-words, %lu stalls, CRC %08lX\n",
+			hFwu.State, (unsigned long) hFwu.Programmed,
+			(unsigned long) hFwu.Size, (unsigned long) hFwu.Erases,
+			(unsigned long) hFwu.QuadWords, (unsigned long) hFwu.Stalls,
+			(unsigned long) hFwu.Crc);
+#endif
+}
+
+#if UDS_BENCH
+/****************************************************************************
+ * UDS Loopback Benchmark
+ *
+ * A tester ISO-TP channel and the server talk through FDCAN internal
+ * loopback, as in ISOTP_BENCHMARK. The round trip runs from the request
+ * queued to the final response received, frames and bit time included.
+ ****************************************************************************/
+
+static uint8_t udsBenchAnswer[UDS_MAX_RESPONSE];
+static volatile uint8_t udsBenchDone;  // Final response received
+
+/* NRC 0x78 is not the answer: keep waiting */
+static void UDS_BENCH_RX_DONE(void *ctx, uint32_t length, uint8_t result) {
+	if (result != ISOTP_OK
+			|| (length == 3 && udsBenchAnswer[0] == UDS_SID_NEGATIVE_RESPONSE
+					&& udsBenchAnswer[2] == UDS_NRC_RESPONSE_PENDING)) {
+		return;
+	}
+	udsBenchDone = 1;
+}
+
+/**
+ * @brief  Send one request and poll both sides until the final response
+ * @retval Response SID (0x7F for negative), or 0 on timeout
+ */
+static uint8_t UDS_BENCH_REQUEST(ISOTP_HandleTypeDef_t *hTester,
+		const uint8_t *pRequest, uint32_t length, uint32_t *pUs) {
+	FDCAN_FrameTypeDef_t frame;
+	uint32_t start = CYCLE_COUNTER_READ();
+	uint32_t elapsed = 0;
+
+	udsBenchDone = 0;
+	ISOTP_SEND(hTester, pRequest, length);
+	while (!udsBenchDone
+			&& elapsed <= UDS_BENCH_TIMEOUT_MS * 1000U * BOOT_SYSCLK_MHZ) {
+		while (CAN1_RxFrame(&hfdCan1, &frame)) {
+			if (!ISOTP_RX_FRAME(hTester, &frame)) {
+				UDS_RX_FRAME(&hUds, &frame);
+			}
+		}
+		ISOTP_POLL(hTester);
+		UDS_POLL(&hUds);
+		elapsed = CYCLE_COUNTER_READ() - start;
+	}
+	*pUs = elapsed / BOOT_SYSCLK_MHZ;
+	return udsBenchDone ? udsBenchAnswer[0] : 0;
+}
+
+/**
+ * @brief  Measure UDS round trip per service in FDCAN internal loopback
+ * @note   Runs before the node starts, with FDCAN interrupts masked and
+ *         RX FIFO 0 polled, then restores the previous FDCAN mode. Prints
+ *         min/avg/max per service for TX_DL 8 and 64, and download KB/s.
+ */
+void UDS_BENCHMARK(void) {
+	static const uint8_t txdlList[] = { 8, 64 };
+	static uint8_t block[UDS_MAX_BLOCK_LENGTH];
+	const struct {
+		const char *Name;
+		const uint8_t *Request;
+		uint8_t Length;
+		uint8_t Answer;                // Expected response SID
+	} services[] = {
+		{ "10 DiagnosticSessionControl", (const uint8_t[]) { 0x10, 0x03 }, 2, 0x50 },
+		{ "3E TesterPresent", (const uint8_t[]) { 0x3E, 0x00 }, 2, 0x7E },
+		{ "22 ReadDID F186 (1 B)", (const uint8_t[]) { 0x22, 0xF1, 0x86 }, 3, 0x62 },
+		{ "22 ReadDID F190 (17 B)", (const uint8_t[]) { 0x22, 0xF1, 0x90 }, 3, 0x62 },
+		{ "22 ReadDID x5 (47 B)", (const uint8_t[]) { 0x22, 0x01, 0x00, 0xF1,
+				0x86, 0xF1, 0x87, 0xF1, 0x8C, 0xF1, 0x90 }, 11, 0x62 },
+		{ "2E WriteDID F190", (const uint8_t[]) { 0x2E, 0xF1, 0x90, '0', '0',
+				'0', '0', '0', '0', '0', '0', '0', '0', '0', '0', '0', '0',
+				'0', '0', '0' }, 20, 0x6E },
+		{ "31 RoutineControl 0200", (const uint8_t[]) { 0x31, 0x01, 0x02,
+				0x00 }, 4, 0x71 },
+		{ "22 unknown DID (NRC 31)", (const uint8_t[]) { 0x22, 0x12, 0x34 },
+				3, 0x7F },
+	};
+	ISOTP_HandleTypeDef_t tester = { 0 };
+	FDCAN_FrameTypeDef_t frame;
+	FDCAN_TypeDef_t *fdcan = hfdCan1.Instace;
+	uint32_t cccrMask = (1U << FDCAN_CCCR_MON_POS) | (1U << FDCAN_CCCR_TEST_POS)
+			| (1U << FDCAN_CCCR_FDOE_POS);
+	uint32_t us;
+
+	/* Internal loopback, FD frames allowed, accept every standard ID */
+	uint32_t savedIe = fdcan->IE;
+	uint32_t savedCccr = fdcan->CCCR & cccrMask;
+	uint32_t savedRxgfc = fdcan->RXGFC;
+	WRITE_ALL_REG(fdcan->IE, 0);
+	FDCAN_ENTER_INIT_MODE(fdcan);
+	FDCAN_ENABLE_INTERNAL_LOOPBACK(fdcan);
+	FDCAN_ENABLE_FD_MODE(fdcan);
+	REG_MODIFY(fdcan->RXGFC, FDCAN_RXGFC_ANFS_FLD, 0);
+	FDCAN_EXIT_INIT_MODE(fdcan);
+
+	printf("UDS loopback, %lu requests per service:\n",
+			(unsigned long) UDS_BENCH_RUNS);
+
+	for (uint32_t d = 0; d < sizeof(txdlList); d++) {
+		UDS_NODE_SETUP(txdlList[d], 0, 0);
+		tester.TxId = UDS_RX_ID;
+		tester.RxId = UDS_TX_ID;
+		tester.TxDataLength = txdlList[d];
+		tester.PadFrames = 1;
+		tester.PadByte = 0xCC;
+		tester.TicksPerUs = BOOT_SYSCLK_MHZ;
+		tester.GetTicks = UDS_NODE_TICKS;
+		tester.SendFrame = UDS_NODE_SEND;
+		tester.Ctx = &hfdCan1;
+		tester.RxBuffer = udsBenchAnswer;
+		tester.RxBufferSize = sizeof(udsBenchAnswer);
+		tester.RxDone = UDS_BENCH_RX_DONE;
+		ISOTP_INIT(&tester);
+
+		printf("  TX_DL %u                    min us  avg us  max us  result\n",
+				txdlList[d]);
+		for (uint32_t s = 0; s < sizeof(services) / sizeof(services[0]); s++) {
+			uint32_t minUs = 0xFFFFFFFFU, maxUs = 0, sumUs = 0;
+			uint8_t ok = 1;
+			for (uint32_t r = 0; r < UDS_BENCH_RUNS; r++) {
+				ok &= UDS_BENCH_REQUEST(&tester, services[s].Request,
+						services[s].Length, &us) == services[s].Answer;
+				sumUs += us;
+				minUs = us < minUs ? us : minUs;
+				maxUs = us > maxUs ? us : maxUs;
+			}
+			printf("  %-27s %7lu %7lu %7lu  %s\n", services[s].Name,
+					(unsigned long) minUs,
+					(unsigned long) (sumUs / UDS_BENCH_RUNS),
+					(unsigned long) maxUs, ok ? "ok" : "FAIL");
+		}
+
+		/* Download in the largest blocks the server offers */
+		uint32_t expectSum = 0;
+		uint32_t totalUs = 0;
+		uint8_t ok = UDS_BENCH_REQUEST(&tester,
+				(const uint8_t[]) { 0x10, 0x02 }, 2, &us) == 0x50;
+		ok &= UDS_BENCH_REQUEST(&tester, (const uint8_t[]) { 0x34, 0x00, 0x44,
+				0x08, 0x00, 0x00, 0x00, 0x00, 0x00,
+				(uint8_t) (UDS_BENCH_DOWNLOAD >> 8),
+				(uint8_t) UDS_BENCH_DOWNLOAD }, 11, &us) == 0x74;
+		totalUs += us;
+		uint32_t maxData = (((uint32_t) udsBenchAnswer[2] << 8)
+				| udsBenchAnswer[3]) - 2U;
+		uint8_t counter = 1;
+		for (uint32_t at = 0; ok && at < UDS_BENCH_DOWNLOAD; counter++) {
+			uint32_t n = UDS_BENCH_DOWNLOAD - at;
+			n = n < maxData ? n : maxData;
+			block[0] = UDS_SID_TRANSFER_DATA;
+			block[1] = counter;
+			for (uint32_t i = 0; i < n; i++) {
+				block[2 + i] = (uint8_t) ((at + i) * 7U + 1U);
+				expectSum += block[2 + i];
+			}
+			ok &= UDS_BENCH_REQUEST(&tester, block, n + 2U, &us) == 0x76;
+			totalUs += us;
+			at += n;
+		}
+		ok &= UDS_BENCH_REQUEST(&tester, (const uint8_t[]) { 0x37 }, 1, &us)
+				== 0x77;
+		totalUs += us;
+		ok &= udsImageBytes == UDS_BENCH_DOWNLOAD && udsImageSum == expectSum;
+		printf("  34/36/37 download %lu B      %lu us, %lu KB/s  %s\n",
+				(unsigned long) UDS_BENCH_DOWNLOAD, (unsigned long) totalUs,
+				(unsigned long) (totalUs ?
+						(UDS_BENCH_DOWNLOAD * 1000U) / totalUs : 0),
+				ok ? "ok" : "FAIL");
+	}
+
+	/* Drop anything left in RX FIFO 0 and restore the previous mode */
+	while (CAN1_RxFrame(&hfdCan1, &frame))
+		;
+	FDCAN_ENTER_INIT_MODE(fdcan);
+	CLEAR_BIT_FIELD(fdcan->TEST, FDCAN_TEST_LBCK_POS);
+	REG_MODIFY(fdcan->CCCR, cccrMask, savedCccr);
+	WRITE_ALL_REG(fdcan->RXGFC, savedRxgfc);
+	FDCAN_EXIT_INIT_MODE(fdcan);
+	WRITE_ALL_REG(fdcan->IE, savedIe);
+}
+#endif /* UDS_BENCH */
+#endif /* UDS_ENABLE || UDS_BENCH */
+
+/**
+ * @brief  Unpack a received frame into the RX header and receivedData
+ * @note   The part of CAN1_Rx without message RAM access or printf, shared
+ *         with the trace replay
+ */
+FDCAN_RAMFUNC void CAN1_RX_DECODE(const FDCAN_FrameTypeDef_t *pFrame,
+		FDCAN_RX_HEADER *hRXHeader, uint8_t *receivedData) {
+	/* First word (R0) - Contains ID and frame information */
+	hRXHeader->ErrorStateIndicator = FDCAN_FRAME_GET_ESI(pFrame);
+	hRXHeader->IdType = FDCAN_FRAME_IS_EXTENDED(pFrame); // 0=standard, 1=extended
+	hRXHeader->RxFrameType = FDCAN_FRAME_IS_REMOTE(pFrame);
+	hRXHeader->Identifier = FDCAN_FRAME_GET_ID(pFrame);
+
+	/* Second word (R1) - Contains DLC and additional flags */
+	hRXHeader->IsFilterMatchingFrame = FDCAN_FRAME_IS_NON_MATCHING(pFrame);
+	hRXHeader->FilterIndex = FDCAN_FRAME_GET_FILTER_INDEX(pFrame);
+	hRXHeader->FDFormat = FDCAN_FRAME_IS_FD(pFrame);
+	hRXHeader->BitRateSwitch = FDCAN_FRAME_IS_BRS(pFrame);
+	hRXHeader->DataLength = FDCAN_FRAME_GET_DLC(pFrame);
+	hRXHeader->RxTimestamp = FDCAN_FRAME_GET_TIMESTAMP(pFrame);
+	uint8_t DLC = FDCAN_FRAME_GET_LEN(pFrame);
+
+	/* Copy data to the receivedData array */
+	const uint8_t *data_ptr = FDCAN_FRAME_CDATA(pFrame);
+	for (int i = 0; i < DLC && i < 8; i++) {  // Limit to array size
+		receivedData[i] = data_ptr[i];
+	}
+
+	/* Null-terminate if treating as string */
+	if (DLC < 8) {
+		receivedData[DLC] = '\0';
+	}
+}
+
+/**
+ * @brief  Configure and check for received CAN messages with GPIOB indicator
+ * @note   Reads any available messages from RX FIFO 0 and controls GPIOB4-6 based on get_index
+ */
+FDCAN_RAMFUNC void CAN1_Rx(FDCAN_Handle_Typedef_t *hFDCAN, FDCAN_RX_HEADER *hRXHeader,
+		uint8_t *receivedData) {
+	/* 1. Check if there are any messages in RX FIFO 0 */
+	uint8_t fifo_level = FDCAN_GET_FREE_RXFIFO_LEVEL(hFDCAN,
+	FDCAN_RX_FIFO0_t); // F0FL field
+
+	if (fifo_level == 0) {
+		printf("RX FIFO is empty\n");
+		return;  // No messages to process
+	}
+
+	printf("RX FIFO level: %d\n", fifo_level);
+
+	/* 2./3. Get the element to read, skipping the oldest one in overwrite mode */
+	uint8_t get_index = FDCAN_RX_FIFO0_GET_INDEX(hFDCAN);
+	printf("Get index: %d\n", get_index);
+
+	/* Control GPIOB pins based on get_index value */
+	if (get_index == 0) {
+		/* For get_index = 0: Set B4 HIGH, B5 and B6 LOW */
+		GPIO_OUTPUT_t(GPIOB_t, 0, HIGH);
+		GPIO_OUTPUT_t(GPIOB_t, 1, LOW);
+		GPIO_OUTPUT_t(GPIOB_t, 2, LOW);
+	} else if (get_index == 1) {
+		/* For get_index = 1: Set B5 HIGH, B4 and B6 LOW */
+		GPIO_OUTPUT_t(GPIOB_t, 0, LOW);
+		GPIO_OUTPUT_t(GPIOB_t, 1, HIGH);
+		GPIO_OUTPUT_t(GPIOB_t, 2, LOW);
+	} else if (get_index == 2) {
+		/* For get_index = 2: Set B6 HIGH, B4 and B5 LOW */
+		GPIO_OUTPUT_t(GPIOB_t, 0, LOW);
+		GPIO_OUTPUT_t(GPIOB_t, 1, LOW);
+		GPIO_OUTPUT_t(GPIOB_t, 2, HIGH);
+	} else {
+		/* For any other get_index: Set all pins LOW */
+		GPIO_OUTPUT_t(GPIOB_t, 0, LOW);
+		GPIO_OUTPUT_t(GPIOB_t, 1, LOW);
+		GPIO_OUTPUT_t(GPIOB_t, 2, LOW);
+	}
+
+	/* 4. Copy the RX element out of message RAM (two header words + payload) */
+	FDCAN_FrameTypeDef_t rxFrame;
+	printf("RX address: 0x%08X\n",
+			(unsigned int) FDCAN_RX_ELEMENT_ADDR(get_index));
+	FDCAN_READ_RX_ELEMENT(get_index, &rxFrame);
+	FDCAN_RX_ENTRY_SAMPLE();
+	BOOT_MARK(BOOT_PHASE_FIRST_RX);
+	CAN1_RX_TAP(&rxFrame);
+
+	/* 5. Extract message information and data from the RX element */
+	CAN1_RX_DECODE(&rxFrame, hRXHeader, receivedData);
+	uint8_t DLC = FDCAN_FRAME_GET_LEN(&rxFrame);
+
+	/* First word (R0) - Contains ID and frame information */
+	printf("Word1: 0x%08X\n", (unsigned int) rxFrame.w0);
+	printf("ESI: %d, ID Type: %s, RTR: %d\n", hRXHeader->ErrorStateIndicator,
+			(hRXHeader->IdType == 0) ? "Standard" : "Extended",
+			hRXHeader->RxFrameType);
+	printf("ID: 0x%08lX\n", hRXHeader->Identifier);
+
+	/* Second word (R1) - Contains DLC and additional flags */
+	printf("Word2: 0x%08X\n", (unsigned int) rxFrame.w1);
+	printf("ANMF: %d, Frame Format: %d, BRS: %d\n",
+			hRXHeader->IsFilterMatchingFrame, hRXHeader->FDFormat,
+			hRXHeader->BitRateSwitch);
+	printf("DLC: %d\n", DLC);
+
+	const uint8_t *data_ptr = FDCAN_FRAME_CDATA(&rxFrame);
+
+	/* Display in hexadecimal format */
+	printf("Data (hex): ");
+	for (int i = 0; i < DLC; i++) {
+		printf("%02X ", data_ptr[i]);  // Use data_ptr for printf
+	}
+	printf("\n");
+
+	/* Display as ASCII characters if printable */
+	printf("Data (char): ");
 	for (int i = 0; i < DLC; i++) {
 		if (data_ptr[i] >= 32 && data_ptr[i] <= 126) {
 			printf("%c", data_ptr[i]);
@@ -1810,13 +6353,32 @@ void CAN1_Rx(FDCAN_Handle_Typedef_t *hFDCAN, FDCAN_RX_HEADER *hRXHeader,
 }
 
 void delayUS(uint32_t us) {
-	TIM2_t->CNT = 0;
-	while (TIM2_t->CNT < us)
+	uint32_t start = TIM2_t->CNT;      // Free-running, shared with TX_SCHED
+	while ((TIM2_t->CNT - start) < us)
 		;
 }
 void delayMS(uint32_t ms) {
 	for (int i = 0; i < ms; i++) {
 		delayUS(1000);
+		// Busy waiting anyway: service a polled RX FIFO once per millisecond
+		FDCAN_RX_POLL(&hfdCan1, FDCAN_RX_POLL_BUDGET);
+#if CAN_REPLAY
+		CAN_REPLAY_TASK();
+#endif
+#if J1939_ENABLE
+		if (hJ1939.GetTicks) {     // Not before BOOT_FDCAN_START
+			J1939_NODE_POLL();
+		}
+#endif
+#if CAN_ERR_MANAGER
+		if (hCanErr.GetTicks) {    // Bus-off backoff keeps running in delays
+			CAN_ERR_TASK();
+		}
+#endif
+#if FAST_BOOT
+		// Keep the LCD init moving while the main loop waits
+		LCD_BG_TASK();
+#endif
 	}
 }
 
@@ -1829,30 +6391,19 @@ void I2C_INIT() {
 	CLEAR_BIT_FIELD(I2C2_t->CR1, 0);
 
 	// Config ANFOFF and DNF[3:0] in I2C2_CR1
-	// Off Analog noise
-	CLEAR_BIT_FIELD(I2C2_t->CR1, 12);
-	SET_BIT_FIELD(I2C2_t->CR1, 12);
-
-	// Off Digital noise
-	CLEAR_VAL_BIT(I2C2_t->CR1, 0xF, 8);
-
-	// Reset all bit
-	WRITE_ALL_REG(I2C2_t->TIMINGR, 0);
-
-	// Prescale for I2C
-	SET_VAL_BIT(I2C2_t->TIMINGR, 0x2, 28);
-
-	// SCL HIGH
-	SET_VAL_BIT(I2C2_t->TIMINGR, 99, 8);
-
-	// SCL LOW
-	SET_VAL_BIT(I2C2_t->TIMINGR, 107, 0);
-
-	// Data hold time
-	SET_VAL_BIT(I2C2_t->TIMINGR, 25, 16);
-
-	// Data setup time
-	SET_VAL_BIT(I2C2_t->TIMINGR, 25, 20);
+	// Off Analog noise, off Digital noise
+	REG_MODIFY(I2C2_t->CR1, I2C_CR1_ANFOFF_FLD | I2C_CR1_DNF_FLD,
+			FIELD_CONST(I2C_CR1_ANFOFF_FLD, 1) | FIELD_CONST(I2C_CR1_DNF_FLD, 0));
+
+	// Timing: prescaler, SCL high/low, data hold/setup time
+	// SDADEL and SCLDEL are 4-bit fields; the value 25 used to be OR-ed in
+	// and overflowed, leaving 9 in both, which is what is written here
+	REG_WRITE(I2C2_t->TIMINGR,
+			FIELD_CONST(I2C_TIMINGR_PRESC_FLD, 0x2)
+			| FIELD_CONST(I2C_TIMINGR_SCLH_FLD, 99)
+			| FIELD_CONST(I2C_TIMINGR_SCLL_FLD, 107)
+			| FIELD_CONST(I2C_TIMINGR_SDADEL_FLD, 9)
+			| FIELD_CONST(I2C_TIMINGR_SCLDEL_FLD, 9));
 
 	// I2C Peripheral EN
 	SET_BIT_FIELD(I2C2_t->CR1, 0);
@@ -1861,22 +6412,14 @@ void I2C_INIT() {
 void I2C_WRITE(uint8_t addr, uint8_t data) {
 	// Controller mode
 	if (tc == 1) {
-		// 7-bit addressing mode
-		CLEAR_BIT_FIELD(I2C2_t->CR2, 11);
-
-		// Target address to send
+		// 7-bit addressing mode, target address, write direction,
+		// 1 byte to transfer, auto end mode off
 		uint8_t address = (addr >> 1);
-		CLEAR_VAL_BIT(I2C2_t->CR2, 0x7F, 1);
-		SET_VAL_BIT(I2C2_t->CR2, address, 1);
-
-		// Transfer dirrection (Write)
-		CLEAR_BIT_FIELD(I2C2_t->CR2, 10);
-
-		// Number of bytes to transfer (1 bytes)
-		SET_VAL_BIT(I2C2_t->CR2, 0x1, 16);
-
-		// Clear auto end mode
-		CLEAR_BIT_FIELD(I2C2_t->CR2, 25);
+		REG_MODIFY(I2C2_t->CR2,
+				I2C_CR2_ADD10_FLD | I2C_CR2_SADD_FLD | I2C_CR2_RD_WRN_FLD
+				| I2C_CR2_NBYTES_FLD | I2C_CR2_AUTOEND_FLD,
+				FIELD_PREP(I2C_CR2_SADD_FLD, address)
+				| FIELD_CONST(I2C_CR2_NBYTES_FLD, 1));
 
 		data_to_send = data;
 		tc = 0;
@@ -1923,9 +6466,13 @@ void lcd_write_4_bit(uint8_t addr, uint8_t nibble, uint8_t rs, uint8_t rw) {
 	delayUS(50);
 }
 
-void lcd_send_cmd(uint8_t addr, uint8_t cmd) {
+void lcd_write_cmd(uint8_t addr, uint8_t cmd) {
 	lcd_write_4_bit(addr, (cmd >> 4), 0, 0);
 	lcd_write_4_bit(addr, (cmd & 0xF), 0, 0);
+}
+
+void lcd_send_cmd(uint8_t addr, uint8_t cmd) {
+	lcd_write_cmd(addr, cmd);
 
 	// Add proper delays based on command
 	if (cmd == DISPLAY_CLEAR || cmd == RETURN_HOME) {
@@ -0,0 +1,645 @@
+/**
+ ******************************************************************************
+ * @file           : uds.c
+ * @brief          : UDS (ISO 14229-1) diagnostic server over ISO-TP.
+ *
+ * Message layout (byte 0 = SID, positive response = SID + 0x40):
+ *   10 ss                  50 ss P2(2) P2ext(2)    DiagnosticSessionControl
+ *                          (P2 in ms, P2ext = P2* in units of 10 ms)
+ *   11 rt                  51 rt                   ECUReset
+ *   22 did did...          62 did data did data... ReadDataByIdentifier
+ *   2E did data            6E did                  WriteDataByIdentifier
+ *   31 rt rid option...    71 rt rid status...     RoutineControl
+ *   34 dfi alfi addr size  74 20 maxBlockLength(2) RequestDownload
+ *   36 bsc data...         76 bsc                  TransferData
+ *   37                     77                      RequestTransferExit
+ *   3E 00                  7E 00                   TesterPresent
+ *   negative response      7F SID NRC
+ ******************************************************************************
+ */
+
+#include <string.h>
+#include "uds.h"
+
+#define UDS_STREAM_HEADER           2U    // TransferData: SID and counter
+
+/***** Service Table *****/
+typedef uint8_t (*UDS_Service_t)(UDS_HandleTypeDef_t *hUds);
+
+typedef struct {
+	uint8_t Sid;
+	uint8_t SubFunction;           // Byte 1 carries the suppress bit
+	uint8_t Sessions;              // UDS_IN() mask
+	UDS_Service_t Serve;
+} UDS_ServiceTypeDef_t;
+
+/***** Private Helpers *****/
+FDCAN_INLINE uint32_t UDS_NOW(const UDS_HandleTypeDef_t *hUds) {
+	return hUds->IsoTp.GetTicks();
+}
+
+FDCAN_INLINE uint32_t UDS_MS_TO_TICKS(const UDS_HandleTypeDef_t *hUds,
+		uint32_t ms) {
+	return ms * 1000U * hUds->IsoTp.TicksPerUs;
+}
+
+/* Wrap-safe "deadline has passed" on a free-running tick counter */
+FDCAN_INLINE uint8_t UDS_EXPIRED(uint32_t now, uint32_t deadline) {
+	return (int32_t) (now - deadline) >= 0;
+}
+
+FDCAN_INLINE uint16_t UDS_GET16(const uint8_t *p) {
+	return (uint16_t) ((p[0] << 8) | p[1]);
+}
+
+FDCAN_INLINE void UDS_PUT16(uint8_t *p, uint32_t value) {
+	p[0] = (uint8_t) (value >> 8);
+	p[1] = (uint8_t) value;
+}
+
+/* Big-endian field of 1 to 4 bytes */
+static uint32_t UDS_GET_N(const uint8_t *p, uint32_t n) {
+	uint32_t value = 0;
+	for (uint32_t i = 0; i < n; i++) {
+		value = (value << 8) | p[i];
+	}
+	return value;
+}
+
+static void UDS_END_DOWNLOAD(UDS_HandleTypeDef_t *hUds, uint8_t abort) {
+	if (abort && hUds->Downloading && hUds->Sink->Abort != NULL) {
+		hUds->Sink->Abort(hUds->Ctx);
+	}
+	hUds->Downloading = 0;
+}
+
+/***** Services *****/
+static uint8_t UDS_SESSION_CONTROL(UDS_HandleTypeDef_t *hUds) {
+	if (hUds->RequestLength != 2U) {
+		return UDS_NRC_INCORRECT_LENGTH;
+	}
+	uint8_t session = hUds->Request[1] & 0x7FU;
+	if (session < UDS_SESSION_DEFAULT || session > UDS_SESSION_EXTENDED) {
+		return UDS_NRC_SUBFUNCTION_NOT_SUPPORTED;
+	}
+
+	UDS_END_DOWNLOAD(hUds, 1);     // Any session transition ends a download
+	hUds->Session = session;
+	hUds->Response[1] = session;
+	UDS_PUT16(&hUds->Response[2], UDS_P2_MS);
+	UDS_PUT16(&hUds->Response[4], UDS_P2_STAR_MS / 10U);
+	hUds->ResponseLength = 6;
+	return 0;
+}
+
+static uint8_t UDS_ECU_RESET(UDS_HandleTypeDef_t *hUds) {
+	if (hUds->RequestLength != 2U) {
+		return UDS_NRC_INCORRECT_LENGTH;
+	}
+	uint8_t type = hUds->Request[1] & 0x7FU;
+	if (hUds->Reset == NULL || type < 0x01U || type > 0x03U) {
+		return UDS_NRC_SUBFUNCTION_NOT_SUPPORTED;
+	}
+	if (hUds->Downloading) {
+		return UDS_NRC_CONDITIONS_NOT_CORRECT;
+	}
+	hUds->ResetType = type;
+	hUds->Response[1] = type;
+	hUds->ResponseLength = 2;
+	return 0;
+}
+
+/**
+ * @brief  ReadDataByIdentifier, any number of DIDs in one request
+ * @note   DIDs unknown or not readable in this session are left out; only
+ *         a request with none left is refused
+ */
+static uint8_t UDS_READ_DID(UDS_HandleTypeDef_t *hUds) {
+	uint32_t length = hUds->RequestLength;
+	if (length < 3U || (length & 1U) == 0) {
+		return UDS_NRC_INCORRECT_LENGTH;
+	}
+
+	uint32_t pos = 1;
+	for (uint32_t i = 1; i < length; i += 2U) {
+		uint16_t id = UDS_GET16(&hUds->Request[i]);
+		const UDS_DidTypeDef_t *d = UDS_FIND_DID(hUds, id);
+		if (d == NULL || !(d->ReadSessions & UDS_IN(hUds->Session))) {
+			continue;
+		}
+		if (pos + 2U + d->Length > UDS_MAX_RESPONSE) {
+			return UDS_NRC_RESPONSE_TOO_LONG;
+		}
+		UDS_PUT16(&hUds->Response[pos], id);
+		if (d->Read != NULL) {
+			uint8_t nrc = d->Read(hUds->Ctx, id, &hUds->Response[pos + 2U]);
+			if (nrc != 0) {
+				return nrc;
+			}
+		} else {
+			memcpy(&hUds->Response[pos + 2U], d->Data, d->Length);
+		}
+		pos += 2U + d->Length;
+	}
+	if (pos == 1U) {
+		return UDS_NRC_REQUEST_OUT_OF_RANGE;
+	}
+	hUds->ResponseLength = pos;
+	return 0;
+}
+
+static uint8_t UDS_WRITE_DID(UDS_HandleTypeDef_t *hUds) {
+	if (hUds->RequestLength < 4U) {
+		return UDS_NRC_INCORRECT_LENGTH;
+	}
+	uint16_t id = UDS_GET16(&hUds->Request[1]);
+	const UDS_DidTypeDef_t *d = UDS_FIND_DID(hUds, id);
+	if (d == NULL || !(d->WriteSessions & UDS_IN(hUds->Session))) {
+		return UDS_NRC_REQUEST_OUT_OF_RANGE;
+	}
+	if (hUds->RequestLength != 3U + d->Length) {
+		return UDS_NRC_INCORRECT_LENGTH;
+	}
+	if (d->Write != NULL) {
+		uint8_t nrc = d->Write(hUds->Ctx, id, &hUds->Request[3]);
+		if (nrc != 0) {
+			return nrc;
+		}
+	} else if (d->Data != NULL) {
+		memcpy(d->Data, &hUds->Request[3], d->Length);
+	} else {
+		return UDS_NRC_CONDITIONS_NOT_CORRECT;
+	}
+	UDS_PUT16(&hUds->Response[1], id);
+	hUds->ResponseLength = 3;
+	return 0;
+}
+
+static uint8_t UDS_ROUTINE_CONTROL(UDS_HandleTypeDef_t *hUds) {
+	if (hUds->RequestLength < 4U) {
+		return UDS_NRC_INCORRECT_LENGTH;
+	}
+	uint8_t type = hUds->Request[1] & 0x7FU;
+	uint16_t id = UDS_GET16(&hUds->Request[2]);
+	const UDS_RoutineTypeDef_t *r = UDS_FIND_ROUTINE(hUds, id);
+	if (r == NULL || !(r->Sessions & UDS_IN(hUds->Session))) {
+		return UDS_NRC_REQUEST_OUT_OF_RANGE;
+	}
+
+	UDS_Routine_t run = NULL;
+	if (type == UDS_ROUTINE_START) {
+		run = r->Start;
+	} else if (type == UDS_ROUTINE_STOP) {
+		run = r->Stop;
+	} else if (type == UDS_ROUTINE_RESULTS) {
+		run = r->Results;
+	}
+	if (run == NULL) {
+		return UDS_NRC_SUBFUNCTION_NOT_SUPPORTED;
+	}
+
+	uint32_t statusLength = UDS_MAX_RESPONSE - 4U;
+	uint8_t nrc = run(hUds->Ctx, id, &hUds->Request[4],
+			hUds->RequestLength - 4U, &hUds->Response[4], &statusLength);
+	if (nrc != 0) {
+		return nrc;
+	}
+	hUds->Response[1] = type;
+	UDS_PUT16(&hUds->Response[2], id);
+	hUds->ResponseLength = 4U + statusLength;
+	return 0;
+}
+
+static uint8_t UDS_REQUEST_DOWNLOAD(UDS_HandleTypeDef_t *hUds) {
+	if (hUds->RequestLength < 3U) {
+		return UDS_NRC_INCORRECT_LENGTH;
+	}
+	uint32_t addressBytes = hUds->Request[2] & 0x0FU;
+	uint32_t sizeBytes = hUds->Request[2] >> 4;
+	if (hUds->RequestLength != 3U + addressBytes + sizeBytes) {
+		return UDS_NRC_INCORRECT_LENGTH;
+	}
+	if (addressBytes == 0 || addressBytes > 4U || sizeBytes == 0
+			|| sizeBytes > 4U || hUds->Request[1] != 0) {
+		return UDS_NRC_REQUEST_OUT_OF_RANGE;  // No compression or encryption
+	}
+	if (hUds->Sink == NULL || hUds->Downloading) {
+		return UDS_NRC_CONDITIONS_NOT_CORRECT;
+	}
+	uint32_t address = UDS_GET_N(&hUds->Request[3], addressBytes);
+	uint32_t size = UDS_GET_N(&hUds->Request[3 + addressBytes], sizeBytes);
+	if (size == 0) {
+		return UDS_NRC_REQUEST_OUT_OF_RANGE;
+	}
+
+	uint8_t nrc = hUds->Sink->Start(hUds->Ctx, address, size);
+	if (nrc != 0) {
+		return nrc;
+	}
+	hUds->Downloading = 1;
+	hUds->DownloadAddress = address;
+	hUds->DownloadSize = size;
+	hUds->DownloadOffset = 0;
+	hUds->BlockCounter = 1;
+	hUds->Response[1] = 0x20;      // lengthFormatIdentifier: 2 bytes
+	UDS_PUT16(&hUds->Response[2], hUds->MaxBlockLength);
+	hUds->ResponseLength = 4;
+	return 0;
+}
+
+/**
+ * @brief  Check a TransferData header before its data streams in
+ * @retval 0 to hand the data to the sink (unless BlockRepeat), or an NRC
+ */
+static uint8_t UDS_BLOCK_BEGIN(UDS_HandleTypeDef_t *hUds) {
+	uint8_t counter = hUds->Request[1];
+
+	hUds->BlockRepeat = 0;
+	if (!hUds->Downloading) {
+		return UDS_NRC_REQUEST_SEQUENCE_ERROR;
+	}
+	if (hUds->RequestLength <= UDS_STREAM_HEADER) {
+		return UDS_NRC_INCORRECT_LENGTH;
+	}
+	if (counter == hUds->BlockCounter) {
+		if (hUds->RequestLength - UDS_STREAM_HEADER
+				> hUds->DownloadSize - hUds->DownloadOffset) {
+			return UDS_NRC_TRANSFER_DATA_SUSPENDED;
+		}
+		return 0;
+	}
+	if (counter == (uint8_t) (hUds->BlockCounter - 1U)
+			&& hUds->DownloadOffset != 0) {
+		hUds->BlockRepeat = 1;     // Our response was lost: answer, keep nothing
+		return 0;
+	}
+	return UDS_NRC_WRONG_BLOCK_SEQUENCE;
+}
+
+static uint8_t UDS_TRANSFER_DATA(UDS_HandleTypeDef_t *hUds) {
+	if (hUds->RequestLength <= UDS_STREAM_HEADER) {
+		return UDS_NRC_INCORRECT_LENGTH;
+	}
+	if (!hUds->BlockRepeat) {
+		if (hUds->Sink->BlockEnd != NULL) {
+			uint8_t nrc = hUds->Sink->BlockEnd(hUds->Ctx);
+			if (nrc != 0) {
+				return nrc;
+			}
+		}
+		hUds->DownloadOffset += hUds->RequestLength - UDS_STREAM_HEADER;
+		hUds->BlockCounter++;      // 0xFF wraps to 0x00
+	}
+	hUds->Response[1] = hUds->Request[1];
+	hUds->ResponseLength = 2;
+	return 0;
+}
+
+static uint8_t UDS_TRANSFER_EXIT(UDS_HandleTypeDef_t *hUds) {
+	if (!hUds->Downloading || hUds->DownloadOffset != hUds->DownloadSize) {
+		return UDS_NRC_REQUEST_SEQUENCE_ERROR;
+	}
+	if (hUds->Sink->Exit != NULL) {
+		uint8_t nrc = hUds->Sink->Exit(hUds->Ctx);
+		if (nrc != 0) {
+			return nrc;
+		}
+	}
+	UDS_END_DOWNLOAD(hUds, 0);
+	hUds->ResponseLength = 1;
+	return 0;
+}
+
+static uint8_t UDS_TESTER_PRESENT(UDS_HandleTypeDef_t *hUds) {
+	if (hUds->RequestLength != 2U) {
+		return UDS_NRC_INCORRECT_LENGTH;
+	}
+	if ((hUds->Request[1] & 0x7FU) != 0) {
+		return UDS_NRC_SUBFUNCTION_NOT_SUPPORTED;
+	}
+	hUds->Response[1] = 0;
+	hUds->ResponseLength = 2;
+	return 0;
+}
+
+#define UDS_IN_PROGRAMMING          UDS_IN(UDS_SESSION_PROGRAMMING)
+
+static const UDS_ServiceTypeDef_t udsServices[UDS_STATS_SERVICES] = {
+	{ UDS_SID_SESSION_CONTROL, 1, UDS_IN_ALL, UDS_SESSION_CONTROL },
+	{ UDS_SID_ECU_RESET, 1, UDS_IN_ALL, UDS_ECU_RESET },
+	{ UDS_SID_READ_DID, 0, UDS_IN_ALL, UDS_READ_DID },
+	{ UDS_SID_WRITE_DID, 0, UDS_IN_ALL, UDS_WRITE_DID },
+	{ UDS_SID_ROUTINE_CONTROL, 1, UDS_IN_ALL, UDS_ROUTINE_CONTROL },
+	{ UDS_SID_REQUEST_DOWNLOAD, 0, UDS_IN_PROGRAMMING, UDS_REQUEST_DOWNLOAD },
+	{ UDS_SID_TRANSFER_DATA, 0, UDS_IN_PROGRAMMING, UDS_TRANSFER_DATA },
+	{ UDS_SID_TRANSFER_EXIT, 0, UDS_IN_PROGRAMMING, UDS_TRANSFER_EXIT },
+	{ UDS_SID_TESTER_PRESENT, 1, UDS_IN_ALL, UDS_TESTER_PRESENT },
+};
+
+/***** Request and Response Flow *****/
+
+/* Hand the final response to ISO-TP, or leave it queued while 0x78 is sent */
+static void UDS_SEND_RESPONSE(UDS_HandleTypeDef_t *hUds) {
+	if (ISOTP_TX_BUSY(&hUds->IsoTp)) {
+		return;
+	}
+	hUds->ResponseQueued = 0;      // A Single Frame may call TxDone from here
+	if (ISOTP_SEND(&hUds->IsoTp, hUds->Response, hUds->ResponseLength)
+			!= ISOTP_OK) {
+		hUds->ResponseQueued = 1;
+	}
+}
+
+static void UDS_SEND_PENDING(UDS_HandleTypeDef_t *hUds, uint32_t now) {
+	if (ISOTP_TX_BUSY(&hUds->IsoTp)) {
+		return;                    // Retried from the next UDS_POLL
+	}
+	hUds->PendingResponse[0] = UDS_SID_NEGATIVE_RESPONSE;
+	hUds->PendingResponse[1] = hUds->Request[0];
+	hUds->PendingResponse[2] = UDS_NRC_RESPONSE_PENDING;
+	if (ISOTP_SEND(&hUds->IsoTp, hUds->PendingResponse, 3) == ISOTP_OK) {
+		hUds->PendingSent = 1;
+		hUds->PendingDeadline = now
+				+ UDS_MS_TO_TICKS(hUds, UDS_PENDING_REPEAT_MS);
+	}
+}
+
+/**
+ * @brief  Serve the request in Request[], or call its pending hook again
+ */
+static void UDS_SERVE(UDS_HandleTypeDef_t *hUds) {
+	const UDS_ServiceTypeDef_t *svc = NULL;
+	UDS_ServiceStatsTypeDef_t *stats = NULL;
+	uint8_t sid = hUds->Request[0];
+	uint8_t nrc;
+
+	for (uint32_t i = 0; i < UDS_STATS_SERVICES; i++) {
+		if (udsServices[i].Sid == sid) {
+			svc = &udsServices[i];
+			stats = &hUds->Stats[i];
+			break;
+		}
+	}
+
+	if (svc == NULL) {
+		nrc = UDS_NRC_SERVICE_NOT_SUPPORTED;
+	} else if (!(svc->Sessions & UDS_IN(hUds->Session))) {
+		nrc = UDS_NRC_SERVICE_NOT_IN_SESSION;
+	} else if (hUds->RequestNrc != 0) {
+		nrc = hUds->RequestNrc;
+	} else {
+		if (!hUds->Busy) {
+			hUds->Suppress = svc->SubFunction && hUds->RequestLength >= 2U
+					&& (hUds->Request[1] & UDS_SUPPRESS_POS_RSP);
+			hUds->ResetType = 0;
+		}
+		nrc = svc->Serve(hUds);
+	}
+
+	uint32_t now = UDS_NOW(hUds);
+	if (nrc == UDS_NRC_RESPONSE_PENDING) {
+		if (!hUds->Busy && stats != NULL) {
+			stats->Pending++;
+		}
+		hUds->Busy = 1;
+		if (!hUds->PendingSent || UDS_EXPIRED(now, hUds->PendingDeadline)) {
+			UDS_SEND_PENDING(hUds, now);
+		}
+		return;
+	}
+
+	hUds->Busy = 0;
+	hUds->S3Deadline = now + UDS_MS_TO_TICKS(hUds, UDS_S3_MS);
+	if (stats != NULL) {
+		uint32_t ticks = now - hUds->RequestTicks;
+		stats->Requests++;
+		stats->TicksTotal += ticks;
+		if (ticks > stats->TicksMax) {
+			stats->TicksMax = ticks;
+		}
+	}
+
+	if (nrc != 0) {
+		if (stats != NULL) {
+			stats->Negative++;
+		}
+		hUds->ResetType = 0;
+		hUds->Response[0] = UDS_SID_NEGATIVE_RESPONSE;
+		hUds->Response[1] = sid;
+		hUds->Response[2] = nrc;
+		hUds->ResponseLength = 3;
+	} else if (hUds->Suppress && !hUds->PendingSent) {
+		hUds->ResponseLength = 0;
+		if (hUds->ResetType != 0) {
+			uint8_t type = hUds->ResetType;
+			hUds->ResetType = 0;
+			hUds->Reset(hUds->Ctx, type);
+		}
+		return;
+	} else {
+		hUds->Response[0] = (uint8_t) (sid + UDS_POSITIVE_RESPONSE);
+	}
+	hUds->PendingSent = 0;
+	hUds->ResponseQueued = 1;
+	UDS_SEND_RESPONSE(hUds);
+}
+
+/***** ISO-TP Hooks *****/
+static uint8_t UDS_ISOTP_SEND(void *ctx, const FDCAN_FrameTypeDef_t *pFrame) {
+	UDS_HandleTypeDef_t *hUds = ctx;
+	return hUds->SendFrame(hUds->Ctx, pFrame);
+}
+
+static void UDS_ISOTP_RX_START(void *ctx, uint32_t length) {
+	UDS_HandleTypeDef_t *hUds = ctx;
+
+	/* One request at a time: Request[] and Response[] are still in use */
+	hUds->RequestIgnored = hUds->Busy || hUds->ResponseQueued
+			|| ISOTP_TX_BUSY(&hUds->IsoTp);
+	if (hUds->RequestIgnored) {
+		hUds->Ignored++;
+		return;
+	}
+	hUds->RequestLength = length;
+	hUds->RequestNrc = 0;
+	hUds->BlockRepeat = 0;
+}
+
+/**
+ * @brief  Keep request bytes, or stream TransferData into the download sink
+ */
+static void UDS_ISOTP_RX_CHUNK(void *ctx, uint32_t offset,
+		const uint8_t *pData, uint32_t len) {
+	UDS_HandleTypeDef_t *hUds = ctx;
+	uint32_t i = 0;
+
+	if (hUds->RequestIgnored) {
+		return;
+	}
+	for (; i < len && offset + i < UDS_STREAM_HEADER; i++) {
+		hUds->Request[offset + i] = pData[i];
+	}
+	if (offset < UDS_STREAM_HEADER && offset + i == UDS_STREAM_HEADER
+			&& hUds->Request[0] == UDS_SID_TRANSFER_DATA) {
+		hUds->RequestNrc = UDS_BLOCK_BEGIN(hUds);
+	}
+	offset += i;
+	pData += i;
+	len -= i;
+	if (len == 0) {
+		return;
+	}
+
+	if (hUds->Request[0] == UDS_SID_TRANSFER_DATA) {
+		if (hUds->RequestNrc == 0 && !hUds->BlockRepeat) {
+			hUds->RequestNrc = hUds->Sink->Write(hUds->Ctx,
+					hUds->DownloadOffset + offset - UDS_STREAM_HEADER, pData,
+					len);
+		}
+	} else if (offset + len <= UDS_MAX_REQUEST) {
+		memcpy(&hUds->Request[offset], pData, len);
+	} else {
+		hUds->RequestNrc = UDS_NRC_INCORRECT_LENGTH;
+	}
+}
+
+static void UDS_ISOTP_RX_DONE(void *ctx, uint32_t length, uint8_t result) {
+	UDS_HandleTypeDef_t *hUds = ctx;
+
+	if (hUds->RequestIgnored || result != ISOTP_OK) {
+		hUds->RequestIgnored = 0;
+		return;                    // A broken block is sent again in full
+	}
+	hUds->RequestLength = length;
+	hUds->RequestTicks = UDS_NOW(hUds);
+	UDS_SERVE(hUds);
+}
+
+static void UDS_ISOTP_TX_DONE(void *ctx, uint8_t result) {
+	UDS_HandleTypeDef_t *hUds = ctx;
+	(void) result;
+
+	if (hUds->ResponseQueued) {
+		UDS_SEND_RESPONSE(hUds);   // Final answer was waiting behind 0x78
+	} else if (hUds->ResetType != 0 && !hUds->Busy) {
+		uint8_t type = hUds->ResetType;
+		hUds->ResetType = 0;
+		hUds->Reset(hUds->Ctx, type);
+	}
+}
+
+/***** Public API *****/
+
+/**
+ * @brief  Start the server in the default session
+ * @retval 1 if ready, 0 if a DID or routine table is not sorted by Id
+ */
+uint8_t UDS_INIT(UDS_HandleTypeDef_t *hUds) {
+	for (uint32_t i = 1; i < hUds->DidCount; i++) {
+		if (hUds->Dids[i].Id <= hUds->Dids[i - 1U].Id) {
+			return 0;
+		}
+	}
+	for (uint32_t i = 1; i < hUds->RoutineCount; i++) {
+		if (hUds->Routines[i].Id <= hUds->Routines[i - 1U].Id) {
+			return 0;
+		}
+	}
+
+	hUds->IsoTp.SendFrame = UDS_ISOTP_SEND;
+	hUds->IsoTp.Ctx = hUds;
+	hUds->IsoTp.RxBuffer = NULL;
+	if (hUds->MaxBlockLength == 0
+			|| hUds->MaxBlockLength > UDS_MAX_BLOCK_LENGTH) {
+		hUds->MaxBlockLength = UDS_MAX_BLOCK_LENGTH;
+	}
+	hUds->IsoTp.RxBufferSize = hUds->MaxBlockLength; // Longer: FC.OVFLW
+	hUds->IsoTp.RxStart = UDS_ISOTP_RX_START;
+	hUds->IsoTp.RxChunk = UDS_ISOTP_RX_CHUNK;
+	hUds->IsoTp.RxDone = UDS_ISOTP_RX_DONE;
+	hUds->IsoTp.TxDone = UDS_ISOTP_TX_DONE;
+	ISOTP_INIT(&hUds->IsoTp);
+
+	hUds->Session = UDS_SESSION_DEFAULT;
+	hUds->RequestIgnored = 0;
+	hUds->Busy = 0;
+	hUds->PendingSent = 0;
+	hUds->ResponseQueued = 0;
+	hUds->ResetType = 0;
+	hUds->Downloading = 0;
+	hUds->Ignored = 0;
+	hUds->S3Timeouts = 0;
+	for (uint32_t i = 0; i < UDS_STATS_SERVICES; i++) {
+		memset(&hUds->Stats[i], 0, sizeof(hUds->Stats[i]));
+		hUds->Stats[i].Sid = udsServices[i].Sid;
+	}
+	return 1;
+}
+
+/**
+ * @brief  Drive ISO-TP, call pending hooks again and run the S3 timer
+ * @note   Pending hooks run from here, so call it from the main loop
+ */
+void UDS_POLL(UDS_HandleTypeDef_t *hUds) {
+	ISOTP_POLL(&hUds->IsoTp);
+
+	if (hUds->Busy) {
+		UDS_SERVE(hUds);
+	} else if (hUds->ResponseQueued) {
+		UDS_SEND_RESPONSE(hUds);
+	}
+
+	if (hUds->Session != UDS_SESSION_DEFAULT && !hUds->Busy
+			&& !ISOTP_RX_BUSY(&hUds->IsoTp)
+			&& UDS_EXPIRED(UDS_NOW(hUds), hUds->S3Deadline)) {
+		UDS_END_DOWNLOAD(hUds, 1);
+		hUds->Session = UDS_SESSION_DEFAULT;
+		hUds->S3Timeouts++;
+	}
+}
+
+/**
+ * @brief  Binary search of the DID table
+ * @retval The entry, or NULL if the DID is not in the table
+ */
+const UDS_DidTypeDef_t* UDS_FIND_DID(const UDS_HandleTypeDef_t *hUds,
+		uint16_t did) {
+	uint32_t lo = 0, hi = hUds->DidCount;
+
+	while (lo < hi) {
+		uint32_t mid = (lo + hi) >> 1;
+		uint16_t id = hUds->Dids[mid].Id;
+		if (id == did) {
+			return &hUds->Dids[mid];
+		}
+		if (id < did) {
+			lo = mid + 1U;
+		} else {
+			hi = mid;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief  Binary search of the routine table
+ * @retval The entry, or NULL if the routine is not in the table
+ */
+const UDS_RoutineTypeDef_t* UDS_FIND_ROUTINE(const UDS_HandleTypeDef_t *hUds,
+		uint16_t rid) {
+	uint32_t lo = 0, hi = hUds->RoutineCount;
+
+	while (lo < hi) {
+		uint32_t mid = (lo + hi) >> 1;
+		uint16_t id = hUds->Routines[mid].Id;
+		if (id == rid) {
+			return &hUds->Routines[mid];
+		}
+		if (id < rid) {
+			lo = mid + 1U;
+		} else {
+			hi = mid;
+		}
+	}
+	return NULL;
+}
@@ -0,0 +1,863 @@
+/**
+ ******************************************************************************
+ * @file           : xcp.c
+ * @brief          : XCP on CAN slave: command processor, DAQ sampler and
+ *                   DTO queue.
+ *
+ * CONNECT    [FF, RESOURCE, COMM_MODE_BASIC, MAX_CTO, MAX_DTO(2), 1, 1]
+ * ERR        [FE, code]
+ * DAQ packet [PID, timestamp(4) on the first ODT if enabled, entries...]
+ *
+ * Dynamic DAQ follows FREE_DAQ, ALLOC_DAQ, ALLOC_ODT, ALLOC_ODT_ENTRY. ODTs
+ * and entries come from fixed pools in allocation order, so a list's ODTs
+ * are contiguous and the pool index of an ODT is its PID.
+ ******************************************************************************
+ */
+
+#include <string.h>
+#include "xcp.h"
+
+#define XCP_RESOURCE_CAL_PAG        0x01U
+#define XCP_RESOURCE_DAQ            0x04U
+#define XCP_COMM_MODE_OPTIONAL      0x80U // GET_COMM_MODE_INFO available
+#define XCP_SESSION_DAQ_RUNNING     0x40U
+#define XCP_DAQ_PROP_DYNAMIC        0x01U
+#define XCP_DAQ_PROP_PRESCALER      0x02U
+#define XCP_DAQ_PROP_TIMESTAMP      0x10U
+#define XCP_DAQ_PROP_OVERLOAD_MSB   0x40U
+#define XCP_EVENT_PROP_DAQ          0x04U
+#define XCP_TIME_UNIT_1US           3U    // Units step by 10 from here
+#define XCP_VERSION                 0x01U // Protocol and transport layer
+#define XCP_DRIVER_VERSION          0x10U
+
+/***** Private Helpers *****/
+FDCAN_INLINE uint16_t XCP_GET16(const uint8_t *p) {
+	return (uint16_t) (p[0] | (p[1] << 8));
+}
+
+FDCAN_INLINE uint32_t XCP_GET32(const uint8_t *p) {
+	return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16)
+			| ((uint32_t) p[3] << 24);
+}
+
+FDCAN_INLINE void XCP_PUT16(uint8_t *p, uint16_t value) {
+	p[0] = (uint8_t) value;
+	p[1] = (uint8_t) (value >> 8);
+}
+
+FDCAN_INLINE void XCP_PUT32(uint8_t *p, uint32_t value) {
+	p[0] = (uint8_t) value;
+	p[1] = (uint8_t) (value >> 8);
+	p[2] = (uint8_t) (value >> 16);
+	p[3] = (uint8_t) (value >> 24);
+}
+
+/* Frame length on the bus for 'length' bytes of packet */
+FDCAN_INLINE uint8_t XCP_PAD_LENGTH(const XCP_HandleTypeDef_t *hXcp,
+		uint32_t length) {
+	if (hXcp->PadFrames) {
+		length = hXcp->FrameBytes;
+	}
+	return FDCAN_DLC_TO_BYTES(FDCAN_BYTES_TO_DLC(length));
+}
+
+FDCAN_INLINE uint32_t XCP_CONTROL(const XCP_HandleTypeDef_t *hXcp,
+		uint32_t padded) {
+	uint8_t fd = hXcp->FrameBytes > 8U;
+	return ((uint32_t) FDCAN_BYTES_TO_DLC(padded) << FDCAN_ELEM_DLC_POS)
+			| ((uint32_t) fd << FDCAN_ELEM_FDF_POS)
+			| ((uint32_t) (fd & hXcp->BitRateSwitch) << FDCAN_ELEM_BRS_POS);
+}
+
+/**
+ * @brief  Map [address, address + length) onto a region
+ * @param  pLeft: Receives the bytes from 'address' to the end of the region
+ * @retval Pointer to the bytes, NULL if no region holds the whole range
+ */
+static uint8_t* XCP_RESOLVE(const XCP_HandleTypeDef_t *hXcp, uint32_t address,
+		uint32_t length, uint32_t *pLeft, uint8_t *pWritable) {
+	for (uint32_t i = 0; i < hXcp->RegionCount; i++) {
+		const XCP_RegionTypeDef_t *r = &hXcp->Regions[i];
+		uint32_t offset = address - r->Address;
+		if (address >= r->Address && offset < r->Length
+				&& length <= r->Length - offset) {
+			*pLeft = r->Length - offset;
+			*pWritable = r->Writable;
+			return r->Base + offset;
+		}
+	}
+	return NULL;
+}
+
+/* Queue the response in Response[] and try to send it at once */
+static void XCP_RESPOND(XCP_HandleTypeDef_t *hXcp, uint32_t length) {
+	hXcp->ResponseLength = (uint8_t) length;
+	hXcp->ResponsePending = 1;
+	XCP_TX_PUMP(hXcp);
+}
+
+static void XCP_ERROR(XCP_HandleTypeDef_t *hXcp, uint8_t code) {
+	hXcp->Response[0] = XCP_PID_ERR;
+	hXcp->Response[1] = code;
+	hXcp->NegativeResponses++;
+	XCP_RESPOND(hXcp, 2);
+}
+
+/* 1 if the command has its 'need' bytes, else answers ERR_CMD_SYNTAX */
+static uint8_t XCP_LENGTH_OK(XCP_HandleTypeDef_t *hXcp, uint32_t length,
+		uint32_t need) {
+	if (length < need) {
+		XCP_ERROR(hXcp, XCP_ERR_CMD_SYNTAX);
+		return 0;
+	}
+	return 1;
+}
+
+static void XCP_DAQ_UPDATE_RUNNING(XCP_HandleTypeDef_t *hXcp) {
+	uint8_t running = 0;
+	for (uint32_t i = 0; i < hXcp->DaqCount; i++) {
+		running |= hXcp->Daq[i].Mode & XCP_DAQ_MODE_RUNNING;
+	}
+	hXcp->DaqRunning = running != 0;
+}
+
+static void XCP_DAQ_STOP_ALL(XCP_HandleTypeDef_t *hXcp) {
+	for (uint32_t i = 0; i < hXcp->DaqCount; i++) {
+		hXcp->Daq[i].Mode &= (uint8_t) ~(XCP_DAQ_MODE_RUNNING
+				| XCP_DAQ_MODE_SELECTED);
+	}
+	hXcp->DaqRunning = 0;
+	hXcp->QueueTail = hXcp->QueueHead; // Samples of a stopped session are stale
+}
+
+/**
+ * @brief  Check a list and build the frame layout of its ODTs
+ * @retval 1 if the list can run
+ */
+static uint8_t XCP_DAQ_PREPARE(XCP_HandleTypeDef_t *hXcp, XCP_DaqTypeDef_t *d) {
+	if (d->OdtCount == 0) {
+		return 0;
+	}
+	for (uint32_t o = 0; o < d->OdtCount; o++) {
+		XCP_OdtTypeDef_t *odt = &hXcp->Odt[d->FirstOdt + o];
+		uint32_t bytes = 1U + odt->Bytes;
+		if (o == 0 && (d->Mode & XCP_DAQ_MODE_TIMESTAMP)) {
+			bytes += XCP_TIMESTAMP_BYTES;
+		}
+		if (odt->Bytes == 0 || bytes > hXcp->FrameBytes) {
+			return 0;
+		}
+		odt->FrameBytes = (uint8_t) bytes;
+		odt->PadTo = XCP_PAD_LENGTH(hXcp, bytes);
+		odt->Control = XCP_CONTROL(hXcp, odt->PadTo);
+	}
+	d->PrescalerCount = 0;
+	return 1;
+}
+
+/***** Standard Commands *****/
+static void XCP_CONNECT(XCP_HandleTypeDef_t *hXcp) {
+	uint8_t *r = hXcp->Response;
+
+	XCP_DAQ_STOP_ALL(hXcp);
+	hXcp->Connected = 1;
+	hXcp->Mta = NULL;
+	hXcp->MtaLeft = 0;
+	r[0] = XCP_PID_RES;
+	r[1] = XCP_RESOURCE_CAL_PAG | XCP_RESOURCE_DAQ;
+	r[2] = XCP_COMM_MODE_OPTIONAL; // Intel byte order, byte granularity
+	r[3] = hXcp->FrameBytes;       // MAX_CTO
+	XCP_PUT16(&r[4], hXcp->FrameBytes); // MAX_DTO
+	r[6] = XCP_VERSION;
+	r[7] = XCP_VERSION;
+	XCP_RESPOND(hXcp, 8);
+}
+
+/* Point the MTA at a string for the master to UPLOAD */
+static uint32_t XCP_MTA_STRING(XCP_HandleTypeDef_t *hXcp, const char *text) {
+	uint32_t length = (text != NULL) ? (uint32_t) strlen(text) : 0;
+	hXcp->Mta = (uint8_t*) text;
+	hXcp->MtaLeft = length;
+	hXcp->MtaWritable = 0;
+	return length;
+}
+
+static void XCP_UPLOAD(XCP_HandleTypeDef_t *hXcp, const uint8_t *src,
+		uint32_t count) {
+	hXcp->Response[0] = XCP_PID_RES;
+	memcpy(&hXcp->Response[1], src, count);
+	XCP_RESPOND(hXcp, 1U + count);
+}
+
+static void XCP_MEMORY_COMMAND(XCP_HandleTypeDef_t *hXcp, const uint8_t *c,
+		uint32_t length) {
+	uint32_t left;
+	uint8_t writable;
+	uint8_t *p;
+	uint8_t n = c[1];
+
+	switch (c[0]) {
+	case XCP_CMD_SET_MTA:
+		if (!XCP_LENGTH_OK(hXcp, length, 8)) {
+			break;
+		}
+		p = XCP_RESOLVE(hXcp, XCP_GET32(&c[4]), 0, &left, &writable);
+		if (c[3] != 0 || p == NULL) {
+			XCP_ERROR(hXcp, XCP_ERR_OUT_OF_RANGE);
+			break;
+		}
+		hXcp->Mta = p;
+		hXcp->MtaLeft = left;
+		hXcp->MtaWritable = writable;
+		hXcp->Response[0] = XCP_PID_RES;
+		XCP_RESPOND(hXcp, 1);
+		break;
+
+	case XCP_CMD_UPLOAD:
+		if (!XCP_LENGTH_OK(hXcp, length, 2)) {
+			break;
+		}
+		if (n == 0 || n > hXcp->FrameBytes - 1U) {
+			XCP_ERROR(hXcp, XCP_ERR_OUT_OF_RANGE);
+		} else if (n > hXcp->MtaLeft) {
+			XCP_ERROR(hXcp, XCP_ERR_ACCESS_DENIED);
+		} else {
+			XCP_UPLOAD(hXcp, hXcp->Mta, n);
+			hXcp->Mta += n;
+			hXcp->MtaLeft -= n;
+		}
+		break;
+
+	case XCP_CMD_SHORT_UPLOAD:
+		if (!XCP_LENGTH_OK(hXcp, length, 8)) {
+			break;
+		}
+		p = XCP_RESOLVE(hXcp, XCP_GET32(&c[4]), n, &left, &writable);
+		if (n == 0 || n > hXcp->FrameBytes - 1U || c[3] != 0) {
+			XCP_ERROR(hXcp, XCP_ERR_OUT_OF_RANGE);
+		} else if (p == NULL) {
+			XCP_ERROR(hXcp, XCP_ERR_ACCESS_DENIED);
+		} else {
+			XCP_UPLOAD(hXcp, p, n);
+			hXcp->Mta = p + n;
+			hXcp->MtaLeft = left - n;
+			hXcp->MtaWritable = writable;
+		}
+		break;
+
+	case XCP_CMD_DOWNLOAD:
+		if (!XCP_LENGTH_OK(hXcp, length, 2U + n)) {
+			break;
+		}
+		if (n == 0 || n > hXcp->FrameBytes - 2U) {
+			XCP_ERROR(hXcp, XCP_ERR_OUT_OF_RANGE);
+		} else if (n > hXcp->MtaLeft) {
+			XCP_ERROR(hXcp, XCP_ERR_ACCESS_DENIED);
+		} else if (!hXcp->MtaWritable) {
+			XCP_ERROR(hXcp, XCP_ERR_WRITE_PROTECTED);
+		} else {
+			memcpy(hXcp->Mta, &c[2], n);
+			hXcp->Mta += n;
+			hXcp->MtaLeft -= n;
+			hXcp->Response[0] = XCP_PID_RES;
+			XCP_RESPOND(hXcp, 1);
+		}
+		break;
+
+	case XCP_CMD_SHORT_DOWNLOAD:
+		if (!XCP_LENGTH_OK(hXcp, length, 8U + n)) {
+			break;
+		}
+		p = XCP_RESOLVE(hXcp, XCP_GET32(&c[4]), n, &left, &writable);
+		if (n == 0 || n > hXcp->FrameBytes - 8U || c[3] != 0) {
+			XCP_ERROR(hXcp, XCP_ERR_OUT_OF_RANGE);
+		} else if (p == NULL) {
+			XCP_ERROR(hXcp, XCP_ERR_ACCESS_DENIED);
+		} else if (!writable) {
+			XCP_ERROR(hXcp, XCP_ERR_WRITE_PROTECTED);
+		} else {
+			memcpy(p, &c[8], n);
+			hXcp->Mta = p + n;
+			hXcp->MtaLeft = left - n;
+			hXcp->MtaWritable = writable;
+			hXcp->Response[0] = XCP_PID_RES;
+			XCP_RESPOND(hXcp, 1);
+		}
+		break;
+	}
+}
+
+/***** DAQ Commands *****/
+static void XCP_DAQ_ALLOC_COMMAND(XCP_HandleTypeDef_t *hXcp, const uint8_t *c,
+		uint32_t length) {
+	uint16_t daq;
+	XCP_DaqTypeDef_t *d;
+
+	if (hXcp->DaqRunning) {
+		XCP_ERROR(hXcp, XCP_ERR_DAQ_ACTIVE);
+		return;
+	}
+	switch (c[0]) {
+	case XCP_CMD_FREE_DAQ:
+		hXcp->DaqCount = 0;
+		hXcp->OdtCount = 0;
+		hXcp->EntryCount = 0;
+		hXcp->AllocState = XCP_ALLOC_FREED;
+		break;
+
+	case XCP_CMD_ALLOC_DAQ:
+		if (!XCP_LENGTH_OK(hXcp, length, 4)) {
+			return;
+		}
+		daq = XCP_GET16(&c[2]);
+		if (hXcp->AllocState != XCP_ALLOC_FREED) {
+			XCP_ERROR(hXcp, XCP_ERR_SEQUENCE);
+			return;
+		}
+		if (daq > XCP_MAX_DAQ) {
+			XCP_ERROR(hXcp, XCP_ERR_MEMORY_OVERFLOW);
+			return;
+		}
+		memset(hXcp->Daq, 0, sizeof(hXcp->Daq));
+		for (uint32_t i = 0; i < daq; i++) {
+			hXcp->Daq[i].Prescaler = 1;
+		}
+		hXcp->DaqCount = (uint8_t) daq;
+		hXcp->AllocState = XCP_ALLOC_DAQ;
+		break;
+
+	case XCP_CMD_ALLOC_ODT:
+		if (!XCP_LENGTH_OK(hXcp, length, 5)) {
+			return;
+		}
+		daq = XCP_GET16(&c[2]);
+		if (hXcp->AllocState != XCP_ALLOC_DAQ
+				&& hXcp->AllocState != XCP_ALLOC_ODT) {
+			XCP_ERROR(hXcp, XCP_ERR_SEQUENCE);
+			return;
+		}
+		if (daq >= hXcp->DaqCount) {
+			XCP_ERROR(hXcp, XCP_ERR_OUT_OF_RANGE);
+			return;
+		}
+		d = &hXcp->Daq[daq];
+		if (d->OdtCount != 0) {
+			XCP_ERROR(hXcp, XCP_ERR_SEQUENCE); // Pools only grow at the end
+			return;
+		}
+		if ((uint32_t) hXcp->OdtCount + c[4] > XCP_MAX_ODT) {
+			XCP_ERROR(hXcp, XCP_ERR_MEMORY_OVERFLOW);
+			return;
+		}
+		d->FirstOdt = hXcp->OdtCount;
+		d->OdtCount = c[4];
+		memset(&hXcp->Odt[d->FirstOdt], 0, c[4] * sizeof(XCP_OdtTypeDef_t));
+		hXcp->OdtCount += c[4];
+		hXcp->AllocState = XCP_ALLOC_ODT;
+		break;
+
+	case XCP_CMD_ALLOC_ODT_ENTRY:
+		if (!XCP_LENGTH_OK(hXcp, length, 6)) {
+			return;
+		}
+		daq = XCP_GET16(&c[2]);
+		if (hXcp->AllocState != XCP_ALLOC_ODT
+				&& hXcp->AllocState != XCP_ALLOC_ENTRY) {
+			XCP_ERROR(hXcp, XCP_ERR_SEQUENCE);
+			return;
+		}
+		if (daq >= hXcp->DaqCount || c[4] >= hXcp->Daq[daq].OdtCount) {
+			XCP_ERROR(hXcp, XCP_ERR_OUT_OF_RANGE);
+			return;
+		}
+		XCP_OdtTypeDef_t *odt = &hXcp->Odt[hXcp->Daq[daq].FirstOdt + c[4]];
+		if (odt->EntryCount != 0) {
+			XCP_ERROR(hXcp, XCP_ERR_SEQUENCE);
+			return;
+		}
+		if ((uint32_t) hXcp->EntryCount + c[5] > XCP_MAX_ODT_ENTRIES) {
+			XCP_ERROR(hXcp, XCP_ERR_MEMORY_OVERFLOW);
+			return;
+		}
+		odt->FirstEntry = hXcp->EntryCount;
+		odt->EntryCount = c[5];
+		odt->Bytes = 0;
+		memset(&hXcp->Entry[odt->FirstEntry], 0,
+				c[5] * sizeof(XCP_OdtEntryTypeDef_t));
+		hXcp->EntryCount += c[5];
+		hXcp->AllocState = XCP_ALLOC_ENTRY;
+		break;
+	}
+	hXcp->Response[0] = XCP_PID_RES;
+	XCP_RESPOND(hXcp, 1);
+}
+
+static void XCP_WRITE_DAQ(XCP_HandleTypeDef_t *hXcp, const uint8_t *c,
+		uint32_t length) {
+	uint32_t left;
+	uint8_t writable;
+
+	if (!XCP_LENGTH_OK(hXcp, length, 8)) {
+		return;
+	}
+	if (hXcp->PtrDaq >= hXcp->DaqCount) {
+		XCP_ERROR(hXcp, XCP_ERR_OUT_OF_RANGE);
+		return;
+	}
+	XCP_DaqTypeDef_t *d = &hXcp->Daq[hXcp->PtrDaq];
+	if (d->Mode & XCP_DAQ_MODE_RUNNING) {
+		XCP_ERROR(hXcp, XCP_ERR_DAQ_ACTIVE);
+		return;
+	}
+	XCP_OdtTypeDef_t *odt = &hXcp->Odt[d->FirstOdt + hXcp->PtrOdt];
+	uint8_t size = c[2];
+	const uint8_t *p = XCP_RESOLVE(hXcp, XCP_GET32(&c[4]), size, &left,
+			&writable);
+	if (hXcp->PtrOdt >= d->OdtCount || hXcp->PtrEntry >= odt->EntryCount
+			|| c[1] != 0xFFU || c[3] != 0 || size == 0 || p == NULL) {
+		XCP_ERROR(hXcp, XCP_ERR_OUT_OF_RANGE);
+		return;
+	}
+	XCP_OdtEntryTypeDef_t *e = &hXcp->Entry[odt->FirstEntry + hXcp->PtrEntry];
+	uint32_t bytes = odt->Bytes - e->Size + size;
+	if (1U + bytes > hXcp->FrameBytes) {
+		XCP_ERROR(hXcp, XCP_ERR_DAQ_CONFIG);
+		return;
+	}
+	e->Address = p;
+	e->Size = size;
+	odt->Bytes = (uint8_t) bytes;
+	hXcp->PtrEntry++;
+	hXcp->Response[0] = XCP_PID_RES;
+	XCP_RESPOND(hXcp, 1);
+}
+
+static void XCP_START_STOP(XCP_HandleTypeDef_t *hXcp, const uint8_t *c,
+		uint32_t length) {
+	uint8_t *r = hXcp->Response;
+
+	if (c[0] == XCP_CMD_START_STOP_DAQ_LIST) {
+		if (!XCP_LENGTH_OK(hXcp, length, 4)) {
+			return;
+		}
+		uint16_t daq = XCP_GET16(&c[2]);
+		if (daq >= hXcp->DaqCount || c[1] > 2U) {
+			XCP_ERROR(hXcp, XCP_ERR_OUT_OF_RANGE);
+			return;
+		}
+		XCP_DaqTypeDef_t *d = &hXcp->Daq[daq];
+		if (c[1] == 1U) {
+			if (!XCP_DAQ_PREPARE(hXcp, d)) {
+				XCP_ERROR(hXcp, XCP_ERR_DAQ_CONFIG);
+				return;
+			}
+			d->Mode |= XCP_DAQ_MODE_RUNNING;
+		} else if (c[1] == 2U) {
+			d->Mode |= XCP_DAQ_MODE_SELECTED;
+		} else {
+			d->Mode &= (uint8_t) ~XCP_DAQ_MODE_RUNNING;
+		}
+		XCP_DAQ_UPDATE_RUNNING(hXcp);
+		r[0] = XCP_PID_RES;
+		r[1] = d->FirstOdt;        // FIRST_PID
+		XCP_RESPOND(hXcp, 2);
+		return;
+	}
+
+	/* START_STOP_SYNCH */
+	if (!XCP_LENGTH_OK(hXcp, length, 2)) {
+		return;
+	}
+	if (c[1] == 0) {
+		XCP_DAQ_STOP_ALL(hXcp);
+	} else if (c[1] == 1U) {
+		for (uint32_t i = 0; i < hXcp->DaqCount; i++) {
+			if ((hXcp->Daq[i].Mode & XCP_DAQ_MODE_SELECTED)
+					&& !XCP_DAQ_PREPARE(hXcp, &hXcp->Daq[i])) {
+				XCP_ERROR(hXcp, XCP_ERR_DAQ_CONFIG);
+				return;
+			}
+		}
+		for (uint32_t i = 0; i < hXcp->DaqCount; i++) {
+			if (hXcp->Daq[i].Mode & XCP_DAQ_MODE_SELECTED) {
+				hXcp->Daq[i].Mode ^= XCP_DAQ_MODE_SELECTED
+						| XCP_DAQ_MODE_RUNNING;
+			}
+		}
+	} else if (c[1] == 2U) {
+		for (uint32_t i = 0; i < hXcp->DaqCount; i++) {
+			if (hXcp->Daq[i].Mode & XCP_DAQ_MODE_SELECTED) {
+				hXcp->Daq[i].Mode &= (uint8_t) ~(XCP_DAQ_MODE_SELECTED
+						| XCP_DAQ_MODE_RUNNING);
+			}
+		}
+	} else {
+		XCP_ERROR(hXcp, XCP_ERR_OUT_OF_RANGE);
+		return;
+	}
+	XCP_DAQ_UPDATE_RUNNING(hXcp);
+	r[0] = XCP_PID_RES;
+	XCP_RESPOND(hXcp, 1);
+}
+
+static void XCP_DAQ_COMMAND(XCP_HandleTypeDef_t *hXcp, const uint8_t *c,
+		uint32_t length) {
+	uint8_t *r = hXcp->Response;
+	uint16_t index;
+
+	memset(r, 0, 8);
+	r[0] = XCP_PID_RES;
+	switch (c[0]) {
+	case XCP_CMD_SET_DAQ_PTR:
+		if (!XCP_LENGTH_OK(hXcp, length, 6)) {
+			break;
+		}
+		index = XCP_GET16(&c[2]);
+		if (index >= hXcp->DaqCount || c[4] >= hXcp->Daq[index].OdtCount
+				|| c[5] >= hXcp->Odt[hXcp->Daq[index].FirstOdt + c[4]].EntryCount) {
+			XCP_ERROR(hXcp, XCP_ERR_OUT_OF_RANGE);
+			break;
+		}
+		hXcp->PtrDaq = index;
+		hXcp->PtrOdt = c[4];
+		hXcp->PtrEntry = c[5];
+		XCP_RESPOND(hXcp, 1);
+		break;
+
+	case XCP_CMD_SET_DAQ_LIST_MODE:
+		if (!XCP_LENGTH_OK(hXcp, length, 8)) {
+			break;
+		}
+		index = XCP_GET16(&c[2]);
+		if (index >= hXcp->DaqCount || XCP_GET16(&c[4]) >= hXcp->EventCount) {
+			XCP_ERROR(hXcp, XCP_ERR_OUT_OF_RANGE);
+			break;
+		}
+		XCP_DaqTypeDef_t *d = &hXcp->Daq[index];
+		if (d->Mode & XCP_DAQ_MODE_RUNNING) {
+			XCP_ERROR(hXcp, XCP_ERR_DAQ_ACTIVE);
+			break;
+		}
+		if ((c[1] & (uint8_t) ~XCP_DAQ_MODE_TIMESTAMP) != 0
+				|| ((c[1] & XCP_DAQ_MODE_TIMESTAMP) && hXcp->GetTimestamp == NULL)) {
+			XCP_ERROR(hXcp, XCP_ERR_MODE_NOT_VALID); // No STIM, PID_OFF, ...
+			break;
+		}
+		d->Mode = (uint8_t) ((d->Mode & XCP_DAQ_MODE_SELECTED) | c[1]);
+		d->Event = XCP_GET16(&c[4]);
+		d->Prescaler = (c[6] != 0) ? c[6] : 1U;
+		d->Priority = c[7];
+		XCP_RESPOND(hXcp, 1);
+		break;
+
+	case XCP_CMD_GET_DAQ_LIST_MODE:
+		if (!XCP_LENGTH_OK(hXcp, length, 4)) {
+			break;
+		}
+		index = XCP_GET16(&c[2]);
+		if (index >= hXcp->DaqCount) {
+			XCP_ERROR(hXcp, XCP_ERR_OUT_OF_RANGE);
+			break;
+		}
+		r[1] = hXcp->Daq[index].Mode;
+		XCP_PUT16(&r[4], hXcp->Daq[index].Event);
+		r[6] = hXcp->Daq[index].Prescaler;
+		r[7] = hXcp->Daq[index].Priority;
+		XCP_RESPOND(hXcp, 8);
+		break;
+
+	case XCP_CMD_GET_DAQ_CLOCK:
+		XCP_PUT32(&r[4], hXcp->GetTimestamp ? hXcp->GetTimestamp() : 0);
+		XCP_RESPOND(hXcp, 8);
+		break;
+
+	case XCP_CMD_GET_DAQ_PROCESSOR_INFO:
+		r[1] = XCP_DAQ_PROP_DYNAMIC | XCP_DAQ_PROP_PRESCALER
+				| XCP_DAQ_PROP_OVERLOAD_MSB
+				| (hXcp->GetTimestamp ? XCP_DAQ_PROP_TIMESTAMP : 0);
+		XCP_PUT16(&r[2], XCP_MAX_DAQ);
+		XCP_PUT16(&r[4], hXcp->EventCount);
+		r[6] = 0;                  // MIN_DAQ: no predefined lists
+		r[7] = 0;                  // Absolute ODT number, any address extension
+		XCP_RESPOND(hXcp, 8);
+		break;
+
+	case XCP_CMD_GET_DAQ_RESOLUTION_INFO:
+		r[1] = 1;                  // Granularity DAQ
+		r[2] = hXcp->FrameBytes - 1U; // Largest ODT entry
+		r[3] = 1;                  // Granularity STIM
+		r[4] = 0;                  // No STIM
+		if (hXcp->GetTimestamp != NULL) {
+			r[5] = XCP_TIMESTAMP_BYTES | (XCP_TIME_UNIT_1US << 4);
+			XCP_PUT16(&r[6], 1);   // Ticks per unit
+		}
+		XCP_RESPOND(hXcp, 8);
+		break;
+
+	case XCP_CMD_GET_DAQ_EVENT_INFO:
+		if (!XCP_LENGTH_OK(hXcp, length, 4)) {
+			break;
+		}
+		index = XCP_GET16(&c[2]);
+		if (index >= hXcp->EventCount) {
+			XCP_ERROR(hXcp, XCP_ERR_OUT_OF_RANGE);
+			break;
+		}
+		const XCP_EventTypeDef_t *e = &hXcp->Events[index];
+		uint32_t cycle = e->PeriodUs;
+		uint8_t unit = XCP_TIME_UNIT_1US;
+		while (cycle > 0xFFU || (cycle != 0 && cycle % 10U == 0)) {
+			cycle /= 10U;          // Largest unit that still holds it exactly
+			unit++;
+		}
+		r[1] = XCP_EVENT_PROP_DAQ;
+		r[2] = 0xFF;               // Any number of lists per event
+		r[3] = (uint8_t) XCP_MTA_STRING(hXcp, e->Name);
+		r[4] = (uint8_t) cycle;
+		r[5] = unit;
+		r[6] = e->Priority;
+		XCP_RESPOND(hXcp, 7);
+		break;
+
+	case XCP_CMD_FREE_DAQ:
+	case XCP_CMD_ALLOC_DAQ:
+	case XCP_CMD_ALLOC_ODT:
+	case XCP_CMD_ALLOC_ODT_ENTRY:
+		XCP_DAQ_ALLOC_COMMAND(hXcp, c, length);
+		break;
+
+	case XCP_CMD_WRITE_DAQ:
+		XCP_WRITE_DAQ(hXcp, c, length);
+		break;
+
+	case XCP_CMD_START_STOP_DAQ_LIST:
+	case XCP_CMD_START_STOP_SYNCH:
+		XCP_START_STOP(hXcp, c, length);
+		break;
+
+	default:
+		XCP_ERROR(hXcp, XCP_ERR_CMD_UNKNOWN);
+		break;
+	}
+}
+
+/***** Public API *****/
+
+/**
+ * @brief  Reset the session and free every DAQ list
+ */
+void XCP_INIT(XCP_HandleTypeDef_t *hXcp) {
+	hXcp->Connected = 0;
+	hXcp->Mta = NULL;
+	hXcp->MtaLeft = 0;
+	hXcp->ResponsePending = 0;
+	hXcp->DaqCount = 0;
+	hXcp->OdtCount = 0;
+	hXcp->EntryCount = 0;
+	hXcp->AllocState = XCP_ALLOC_FREED;
+	hXcp->PtrDaq = hXcp->PtrOdt = hXcp->PtrEntry = 0;
+	hXcp->DaqRunning = 0;
+	hXcp->Overload = 0;
+	hXcp->QueueHead = hXcp->QueueTail = 0;
+	hXcp->Commands = hXcp->NegativeResponses = 0;
+	hXcp->DaqFrames = hXcp->DaqBytes = 0;
+	hXcp->Overruns = hXcp->QueueHighWater = 0;
+	if (hXcp->FrameBytes < 8U) {
+		hXcp->FrameBytes = 8U;
+	} else if (hXcp->FrameBytes > XCP_MAX_FRAME_BYTES) {
+		hXcp->FrameBytes = XCP_MAX_FRAME_BYTES;
+	}
+
+	FDCAN_FrameTypeDef_t frame;
+	FDCAN_FRAME_SET_ID(&frame, hXcp->DtoId, hXcp->IdExtended);
+	hXcp->DtoWord0 = frame.w0;
+}
+
+/**
+ * @brief  Handle a command frame from the master
+ * @retval 1 if the frame was on CroId, 0 if it belongs to someone else
+ * @note   Not connected, only CONNECT is answered
+ */
+uint8_t XCP_RX_FRAME(XCP_HandleTypeDef_t *hXcp,
+		const FDCAN_FrameTypeDef_t *pFrame) {
+	if (FDCAN_FRAME_GET_ID(pFrame) != hXcp->CroId
+			|| FDCAN_FRAME_IS_EXTENDED(pFrame) != hXcp->IdExtended
+			|| FDCAN_FRAME_IS_REMOTE(pFrame)) {
+		return 0;
+	}
+	const uint8_t *c = FDCAN_FRAME_CDATA(pFrame);
+	uint32_t length = FDCAN_FRAME_GET_LEN(pFrame);
+	if (length == 0) {
+		return 1;
+	}
+	if (c[0] == XCP_CMD_CONNECT) {
+		hXcp->Commands++;
+		XCP_CONNECT(hXcp);
+		return 1;
+	}
+	if (!hXcp->Connected) {
+		return 1;
+	}
+	hXcp->Commands++;
+
+	uint8_t *r = hXcp->Response;
+	switch (c[0]) {
+	case XCP_CMD_DISCONNECT:
+		XCP_DAQ_STOP_ALL(hXcp);
+		hXcp->Connected = 0;
+		r[0] = XCP_PID_RES;
+		XCP_RESPOND(hXcp, 1);
+		break;
+
+	case XCP_CMD_GET_STATUS:
+		memset(r, 0, 6);
+		r[0] = XCP_PID_RES;
+		r[1] = hXcp->DaqRunning ? XCP_SESSION_DAQ_RUNNING : 0;
+		XCP_RESPOND(hXcp, 6);
+		break;
+
+	case XCP_CMD_SYNCH:
+		hXcp->NegativeResponses--; // Expected, not a failure
+		XCP_ERROR(hXcp, XCP_ERR_CMD_SYNCH);
+		break;
+
+	case XCP_CMD_GET_COMM_MODE_INFO:
+		memset(r, 0, 8);
+		r[0] = XCP_PID_RES;
+		r[7] = XCP_DRIVER_VERSION; // No block mode, no interleaved mode
+		XCP_RESPOND(hXcp, 8);
+		break;
+
+	case XCP_CMD_GET_ID:
+		if (!XCP_LENGTH_OK(hXcp, length, 2)) {
+			break;
+		}
+		memset(r, 0, 8);
+		r[0] = XCP_PID_RES;
+		XCP_PUT32(&r[4], XCP_MTA_STRING(hXcp, (c[1] == 1U) ? hXcp->Identifier
+				: NULL));          // Mode 0: UPLOAD it from the MTA
+		XCP_RESPOND(hXcp, 8);
+		break;
+
+	case XCP_CMD_SET_MTA:
+	case XCP_CMD_UPLOAD:
+	case XCP_CMD_SHORT_UPLOAD:
+	case XCP_CMD_DOWNLOAD:
+	case XCP_CMD_SHORT_DOWNLOAD:
+		XCP_MEMORY_COMMAND(hXcp, c, length);
+		break;
+
+	default:
+		XCP_DAQ_COMMAND(hXcp, c, length);
+		break;
+	}
+	return 1;
+}
+
+/**
+ * @brief  Sample every running DAQ list bound to 'event'
+ * @retval Frames queued
+ * @note   Interrupt context. Work is bounded by the entries of the lists on
+ *         this event: each is one copy from an address resolved by
+ *         WRITE_DAQ. A sample that does not fit the queue is dropped whole
+ *         and flagged on the next DAQ packet with XCP_PID_OVERLOAD.
+ */
+uint32_t XCP_EVENT(XCP_HandleTypeDef_t *hXcp, uint16_t event) {
+	uint32_t queued = 0;
+	uint32_t timestamp = 0;
+
+	if (!hXcp->DaqRunning) {
+		return 0;
+	}
+	if (hXcp->GetTimestamp != NULL) {
+		timestamp = hXcp->GetTimestamp(); // Same instant for every list
+	}
+
+	uint32_t head = hXcp->QueueHead;
+	for (uint32_t i = 0; i < hXcp->DaqCount; i++) {
+		XCP_DaqTypeDef_t *d = &hXcp->Daq[i];
+		if (!(d->Mode & XCP_DAQ_MODE_RUNNING) || d->Event != event) {
+			continue;
+		}
+		if (++d->PrescalerCount < d->Prescaler) {
+			continue;
+		}
+		d->PrescalerCount = 0;
+		if (XCP_DTO_QUEUE_FRAMES - (head - hXcp->QueueTail) < d->OdtCount) {
+			d->Overruns++;
+			hXcp->Overruns++;
+			hXcp->Overload = 1;
+			continue;
+		}
+
+		for (uint32_t o = 0; o < d->OdtCount; o++) {
+			const XCP_OdtTypeDef_t *odt = &hXcp->Odt[d->FirstOdt + o];
+			FDCAN_FrameTypeDef_t *f = &hXcp->Queue[head
+					& (XCP_DTO_QUEUE_FRAMES - 1U)];
+			uint8_t *p = FDCAN_FRAME_DATA(f);
+
+			*p++ = (uint8_t) ((d->FirstOdt + o)
+					| (hXcp->Overload ? XCP_PID_OVERLOAD : 0));
+			hXcp->Overload = 0;
+			if (o == 0 && (d->Mode & XCP_DAQ_MODE_TIMESTAMP)) {
+				XCP_PUT32(p, timestamp);
+				p += XCP_TIMESTAMP_BYTES;
+			}
+			const XCP_OdtEntryTypeDef_t *e = &hXcp->Entry[odt->FirstEntry];
+			for (uint32_t n = odt->EntryCount; n != 0; n--, e++) {
+				memcpy(p, e->Address, e->Size);
+				p += e->Size;
+			}
+			if (odt->PadTo > odt->FrameBytes) {
+				memset(p, hXcp->PadByte, odt->PadTo - odt->FrameBytes);
+			}
+			f->w0 = hXcp->DtoWord0;
+			f->w1 = odt->Control;
+			hXcp->DaqBytes += odt->Bytes;
+			head++;
+		}
+		d->Samples++;
+		hXcp->DaqFrames += d->OdtCount;
+		queued += d->OdtCount;
+	}
+
+	hXcp->QueueHead = head;
+	if (head - hXcp->QueueTail > hXcp->QueueHighWater) {
+		hXcp->QueueHighWater = head - hXcp->QueueTail;
+	}
+	return queued;
+}
+
+/**
+ * @brief  Hand the pending response, then queued DAQ frames, to the driver
+ * @retval Frames sent
+ */
+uint32_t XCP_TX_PUMP(XCP_HandleTypeDef_t *hXcp) {
+	uint32_t sent = 0;
+
+	if (hXcp->ResponsePending) {
+		FDCAN_FrameTypeDef_t frame;
+		uint32_t padded = XCP_PAD_LENGTH(hXcp, hXcp->ResponseLength);
+
+		frame.w0 = hXcp->DtoWord0;
+		frame.w1 = XCP_CONTROL(hXcp, padded);
+		memcpy(FDCAN_FRAME_DATA(&frame), hXcp->Response, hXcp->ResponseLength);
+		memset(FDCAN_FRAME_DATA(&frame) + hXcp->ResponseLength, hXcp->PadByte,
+				padded - hXcp->ResponseLength);
+		if (!hXcp->SendFrame(hXcp->Ctx, &frame)) {
+			return 0;
+		}
+		hXcp->ResponsePending = 0;
+		sent++;
+	}
+
+	uint32_t tail = hXcp->QueueTail;
+	while (tail != hXcp->QueueHead
+			&& hXcp->SendFrame(hXcp->Ctx,
+					&hXcp->Queue[tail & (XCP_DTO_QUEUE_FRAMES - 1U)])) {
+		tail++;
+		sent++;
+	}
+	hXcp->QueueTail = tail;
+	return sent;
+}
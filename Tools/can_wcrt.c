@@ -0,0 +1,425 @@
+/**
+ ******************************************************************************
+ * @file           : can_wcrt.c
+ * @brief          : Worst-case response time analysis of a CAN message set.
+ *
+ * Frame lengths come from CANSTATS_WIRE_BITS (Src/can_stats.c), the same
+ * worst-case stuffing math the firmware uses for bus load.
+ *
+ * Messages sent from priority-ordered buffers use the revised analysis of
+ * Davis, Burns, Bril and Lukkien (2007):
+ *   B_m     = longest frame of lower priority
+ *   t_m     = B_m + sum_{k in hep(m)} ceil((t_m + J_k) / T_k) * C_k
+ *   w_m(q)  = B_m + q * C_m + sum_{k in hp(m)} ceil((w + J_k + tbit) / T_k) * C_k
+ *   R_m     = max over q < ceil((t_m + J_m) / T_m) of J_m + w_m(q) - q * T_m + C_m
+ *
+ * A node whose FDCAN runs the TX FIFO (TFQM = 0, FDCAN_TXBUFFER_FIFO) sends
+ * its frames in queueing order. Any of them may wait behind all others of
+ * the same node, and the group competes at the priority of its lowest
+ * member L (Davis, Kollmann, Pollex, Slomka 2011):
+ *   w_m     = B_L + sum_{k in FIFO, k != m} C_k + sum_{k in hp(L), not FIFO}
+ *             ceil((w + J_k + tbit) / T_k) * C_k
+ *   R_m     = J_m + w_m + C_m
+ * The bound needs at most one instance of each message queued at a time,
+ * so R_m must not exceed T_m. Frames of a FIFO node are taken as released
+ * with their own jitter when they interfere with other nodes.
+ *
+ * TX queue mode (TFQM = 1) is priority ordered only while the node has no
+ * more messages than TX buffers; above that a message can find every buffer
+ * taken, and the node is analyzed as FIFO.
+ *
+ * An optional error model adds one error frame (31 bits) plus the
+ * retransmission of the longest frame of priority hep(m) every 'errors'
+ * milliseconds (Tindell, Burns, Wellings 1995).
+ *
+ * Input, one directive per line, '#' starts a comment:
+ *   bitrate <nominal kbit/s> [<data kbit/s>]
+ *   errors <ms between errors>
+ *   node <name> <fifo|queue> [<tx buffers>]
+ *   msg <name> <id> <std|ext> <classic|fd|brs> <bytes> <period ms>
+ *       <deadline ms> [<jitter ms>]
+ * Messages belong to the node declared before them.
+ *
+ * Build and run from the repository root:
+ *   gcc -O2 -IInc -o can_wcrt Tools/can_wcrt.c Src/can_stats.c
+ *   ./can_wcrt Tools/bus_messages.txt
+ * Exit status is 1 if any message can miss its deadline or any TX FIFO
+ * can hold more messages than it has elements.
+ ******************************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "can_stats.h"
+
+#define WCRT_MAX_MSGS               256U
+#define WCRT_MAX_NODES              32U
+#define WCRT_NAME_LEN               32U
+#define WCRT_FDCAN_TX_BUFFERS       3U    // STM32H5 FDCAN message RAM
+#define WCRT_ERROR_FRAME_BITS       31U   // Error flag, echo and delimiter, worst case
+#define WCRT_HORIZON_PERIODS        1000U // Busy period limit, in longest periods
+
+#define WCRT_MODE_QUEUE             0
+#define WCRT_MODE_FIFO              1
+
+typedef struct {
+	char Name[WCRT_NAME_LEN];
+	uint8_t Mode;                  // As configured
+	uint32_t Buffers;
+	uint32_t Messages;
+	uint8_t Fifo;                  // Analyzed as FIFO
+} WCRT_Node_t;
+
+typedef struct {
+	char Name[WCRT_NAME_LEN];
+	uint32_t Id;
+	uint8_t Extended;
+	uint8_t Format;
+	uint8_t Bytes;
+	uint32_t Node;
+	uint32_t Priority;             // Arbitration field, lower wins
+	uint64_t C, T, D, J;           // ns
+	uint64_t R;                    // As configured, UINT64_MAX = unbounded
+	uint64_t RPrio;                // With every node priority ordered
+} WCRT_Msg_t;
+
+static WCRT_Msg_t msgs[WCRT_MAX_MSGS];
+static WCRT_Node_t nodes[WCRT_MAX_NODES];
+static uint32_t msgCount, nodeCount;
+static uint32_t nominalKbps = 500, dataKbps;
+static uint64_t errorPeriodNs;         // 0 = error free bus
+static uint64_t bitNs;
+
+static uint64_t CEIL_DIV(uint64_t a, uint64_t b) {
+	return (a + b - 1U) / b;
+}
+
+/* SRR and IDE are recessive, so an 11-bit frame beats a 29-bit frame with
+ * the same base ID */
+static uint32_t ARBITRATION_KEY(uint32_t id, uint8_t extended) {
+	if (!extended) {
+		return id << 20;
+	}
+	return ((id >> 18) << 20) | (3U << 18) | (id & 0x3FFFFU);
+}
+
+static uint64_t FRAME_NS(uint8_t format, uint8_t extended, uint8_t bytes) {
+	uint32_t dataBits;
+	uint32_t bits = CANSTATS_WIRE_BITS(format, extended, bytes, &dataBits);
+	return CEIL_DIV((uint64_t) (bits - dataBits) * 1000000U, nominalKbps)
+			+ CEIL_DIV((uint64_t) dataBits * 1000000U, dataKbps);
+}
+
+static uint64_t MS_TO_NS(double ms) {
+	return (uint64_t) (ms * 1e6 + 0.5);
+}
+
+static int PARSE(const char *path) {
+	FILE *in = fopen(path, "r");
+	char line[256];
+	uint32_t lineNo = 0;
+
+	if (in == NULL) {
+		perror(path);
+		return -1;
+	}
+	while (fgets(line, sizeof(line), in) != NULL) {
+		char *hash = strchr(line, '#');
+		char word[16], name[WCRT_NAME_LEN], a[16], b[16];
+		lineNo++;
+		if (hash != NULL) {
+			*hash = '\0';
+		}
+		if (sscanf(line, "%15s", word) != 1) {
+			continue;
+		}
+
+		if (strcmp(word, "bitrate") == 0) {
+			unsigned n = 0, d = 0;
+			if (sscanf(line, "%*s %u %u", &n, &d) < 1 || n == 0) {
+				goto bad;
+			}
+			nominalKbps = n;
+			dataKbps = d;
+		} else if (strcmp(word, "errors") == 0) {
+			double ms;
+			if (sscanf(line, "%*s %lf", &ms) != 1) {
+				goto bad;
+			}
+			errorPeriodNs = MS_TO_NS(ms);
+		} else if (strcmp(word, "node") == 0) {
+			unsigned buffers = WCRT_FDCAN_TX_BUFFERS;
+			if (nodeCount >= WCRT_MAX_NODES
+					|| sscanf(line, "%*s %31s %15s %u", name, a, &buffers) < 2) {
+				goto bad;
+			}
+			WCRT_Node_t *n = &nodes[nodeCount++];
+			memset(n, 0, sizeof(*n));
+			strcpy(n->Name, name);
+			n->Mode = (strcmp(a, "fifo") == 0) ? WCRT_MODE_FIFO : WCRT_MODE_QUEUE;
+			n->Buffers = buffers;
+		} else if (strcmp(word, "msg") == 0) {
+			char idText[16];
+			unsigned bytes;
+			double period, deadline, jitter = 0;
+			if (nodeCount == 0 || msgCount >= WCRT_MAX_MSGS
+					|| sscanf(line, "%*s %31s %15s %15s %15s %u %lf %lf %lf",
+							name, idText, a, b, &bytes, &period, &deadline,
+							&jitter) < 7 || period <= 0) {
+				goto bad;
+			}
+			WCRT_Msg_t *m = &msgs[msgCount++];
+			memset(m, 0, sizeof(*m));
+			strcpy(m->Name, name);
+			m->Id = (uint32_t) strtoul(idText, NULL, 0);
+			m->Extended = strcmp(a, "ext") == 0;
+			m->Format = (strcmp(b, "brs") == 0) ? CANSTATS_FMT_FD_BRS :
+						(strcmp(b, "fd") == 0) ? CANSTATS_FMT_FD :
+								CANSTATS_FMT_CLASSIC;
+			m->Bytes = (uint8_t) bytes;
+			m->Node = nodeCount - 1U;
+			m->T = MS_TO_NS(period);
+			m->D = MS_TO_NS(deadline);
+			m->J = MS_TO_NS(jitter);
+			nodes[m->Node].Messages++;
+		} else {
+			goto bad;
+		}
+		continue;
+bad:
+		fprintf(stderr, "%s:%u: cannot parse: %s", path, lineNo, line);
+		fclose(in);
+		return -1;
+	}
+	fclose(in);
+	return 0;
+}
+
+/* Error recovery overhead in an interval of length t */
+static uint64_t ERROR_TERM(uint64_t t, uint64_t longestHep) {
+	if (errorPeriodNs == 0) {
+		return 0;
+	}
+	return CEIL_DIV(t, errorPeriodNs) * (WCRT_ERROR_FRAME_BITS * bitNs + longestHep);
+}
+
+/* Priority of k is higher than that of m */
+static uint8_t HIGHER(const WCRT_Msg_t *k, const WCRT_Msg_t *m) {
+	return k->Priority < m->Priority;
+}
+
+/**
+ * @brief  Response time of m sent from a priority-ordered node
+ */
+static uint64_t RESPONSE_PRIO(const WCRT_Msg_t *m, uint64_t horizon) {
+	uint64_t blocking = 0, longestHep = m->C;
+
+	for (uint32_t k = 0; k < msgCount; k++) {
+		const WCRT_Msg_t *o = &msgs[k];
+		if (!HIGHER(o, m) && o != m && o->C > blocking) {
+			blocking = o->C;
+		}
+		if (HIGHER(o, m) && o->C > longestHep) {
+			longestHep = o->C;
+		}
+	}
+
+	/* Level-m busy period */
+	uint64_t t = m->C, next;
+	for (;;) {
+		next = blocking + ERROR_TERM(t, longestHep);
+		for (uint32_t k = 0; k < msgCount; k++) {
+			const WCRT_Msg_t *o = &msgs[k];
+			if (HIGHER(o, m) || o == m) {
+				next += CEIL_DIV(t + o->J, o->T) * o->C;
+			}
+		}
+		if (next == t) {
+			break;
+		}
+		if (next > horizon) {
+			return UINT64_MAX;
+		}
+		t = next;
+	}
+
+	uint64_t worst = 0;
+	uint64_t instances = CEIL_DIV(t + m->J, m->T);
+	for (uint64_t q = 0; q < instances; q++) {
+		uint64_t w = blocking + q * m->C;
+		for (;;) {
+			next = blocking + q * m->C + ERROR_TERM(w + m->C, longestHep);
+			for (uint32_t k = 0; k < msgCount; k++) {
+				const WCRT_Msg_t *o = &msgs[k];
+				if (HIGHER(o, m)) {
+					next += CEIL_DIV(w + o->J + bitNs, o->T) * o->C;
+				}
+			}
+			if (next == w) {
+				break;
+			}
+			if (next > horizon) {
+				return UINT64_MAX;
+			}
+			w = next;
+		}
+		uint64_t r = m->J + w + m->C - q * m->T;
+		if (r > worst) {
+			worst = r;
+		}
+	}
+	return worst;
+}
+
+/**
+ * @brief  Response time of m queued in the TX FIFO of its node
+ */
+static uint64_t RESPONSE_FIFO(const WCRT_Msg_t *m, uint64_t horizon) {
+	const WCRT_Msg_t *lowest = m;
+	uint64_t ahead = 0, blocking = 0, longestHep = 0;
+
+	for (uint32_t k = 0; k < msgCount; k++) {
+		const WCRT_Msg_t *o = &msgs[k];
+		if (o->Node == m->Node) {
+			if (HIGHER(lowest, o)) {
+				lowest = o;
+			}
+			if (o != m) {
+				ahead += o->C;
+			}
+		}
+	}
+	for (uint32_t k = 0; k < msgCount; k++) {
+		const WCRT_Msg_t *o = &msgs[k];
+		if (o->Node == m->Node) {
+			if (o->C > longestHep) {
+				longestHep = o->C;
+			}
+		} else if (HIGHER(lowest, o)) {
+			if (o->C > blocking) {
+				blocking = o->C;
+			}
+		} else if (o->C > longestHep) {
+			longestHep = o->C;
+		}
+	}
+
+	uint64_t w = blocking + ahead, next;
+	for (;;) {
+		next = blocking + ahead + ERROR_TERM(w + m->C, longestHep);
+		for (uint32_t k = 0; k < msgCount; k++) {
+			const WCRT_Msg_t *o = &msgs[k];
+			if (o->Node != m->Node && HIGHER(o, lowest)) {
+				next += CEIL_DIV(w + o->J + bitNs, o->T) * o->C;
+			}
+		}
+		if (next == w) {
+			break;
+		}
+		if (next > horizon) {
+			return UINT64_MAX;
+		}
+		w = next;
+	}
+	return m->J + w + m->C;
+}
+
+static void PRINT_TIME(uint64_t ns) {
+	if (ns == UINT64_MAX) {
+		printf(" %9s", "unbounded");
+	} else {
+		printf(" %9.3f", ns / 1e6);
+	}
+}
+
+static int BY_PRIORITY(const void *a, const void *b) {
+	const WCRT_Msg_t *x = a, *y = b;
+	return (x->Priority > y->Priority) - (x->Priority < y->Priority);
+}
+
+int main(int argc, char **argv) {
+	if (argc != 2) {
+		fprintf(stderr, "usage: %s <message set>\n", argv[0]);
+		return 2;
+	}
+	if (PARSE(argv[1]) != 0) {
+		return 2;
+	}
+	if (dataKbps == 0) {
+		dataKbps = nominalKbps;
+	}
+	bitNs = CEIL_DIV(1000000U, nominalKbps);
+
+	uint64_t longestPeriod = 0;
+	double utilization = 0;
+	for (uint32_t i = 0; i < msgCount; i++) {
+		WCRT_Msg_t *m = &msgs[i];
+		m->Priority = ARBITRATION_KEY(m->Id, m->Extended);
+		m->C = FRAME_NS(m->Format, m->Extended, m->Bytes);
+		utilization += (double) m->C / (double) m->T;
+		if (m->T > longestPeriod) {
+			longestPeriod = m->T;
+		}
+	}
+	qsort(msgs, msgCount, sizeof(msgs[0]), BY_PRIORITY);
+	for (uint32_t n = 0; n < nodeCount; n++) {
+		nodes[n].Fifo = nodes[n].Mode == WCRT_MODE_FIFO
+				|| nodes[n].Messages > nodes[n].Buffers;
+	}
+
+	uint64_t horizon = longestPeriod * WCRT_HORIZON_PERIODS;
+	uint32_t misses = 0, overflows = 0;
+	for (uint32_t i = 0; i < msgCount; i++) {
+		WCRT_Msg_t *m = &msgs[i];
+		m->RPrio = RESPONSE_PRIO(m, horizon);
+		m->R = nodes[m->Node].Fifo ? RESPONSE_FIFO(m, horizon) : m->RPrio;
+	}
+
+	printf("%u messages, %u nodes, %u/%u kbit/s, utilization %.1f%%",
+			msgCount, nodeCount, nominalKbps, dataKbps, 100.0 * utilization);
+	if (errorPeriodNs != 0) {
+		printf(", one error every %.3f ms", errorPeriodNs / 1e6);
+	}
+	printf("\n\n%-16s %-10s %-9s %5s %9s %9s %9s %9s %9s  %s\n", "Message",
+			"ID", "Node", "Mode", "C ms", "T ms", "D ms", "R ms", "R prio",
+			"Result");
+	for (uint32_t i = 0; i < msgCount; i++) {
+		const WCRT_Msg_t *m = &msgs[i];
+		const WCRT_Node_t *n = &nodes[m->Node];
+		const char *result = "ok";
+
+		if (m->R == UINT64_MAX || m->R > m->D) {
+			result = "DEADLINE MISS";
+			misses++;
+		} else if (n->Fifo && m->R > m->T) {
+			result = "FIFO BOUND INVALID (R > T)";
+			misses++;
+		}
+		printf("%-16s 0x%08X %-9s %5s", m->Name, m->Id, n->Name,
+				n->Fifo ? "fifo" : "prio");
+		PRINT_TIME(m->C);
+		PRINT_TIME(m->T);
+		PRINT_TIME(m->D);
+		PRINT_TIME(m->R);
+		PRINT_TIME(m->RPrio);
+		printf("  %s\n", result);
+	}
+
+	printf("\n");
+	for (uint32_t n = 0; n < nodeCount; n++) {
+		if (nodes[n].Mode == WCRT_MODE_QUEUE && nodes[n].Fifo) {
+			printf("%s: %u messages for %u TX buffers, analyzed as FIFO\n",
+					nodes[n].Name, nodes[n].Messages, nodes[n].Buffers);
+		}
+		if (nodes[n].Mode == WCRT_MODE_FIFO
+				&& nodes[n].Messages > nodes[n].Buffers) {
+			printf("%s: %u messages can be pending in a %u-deep TX FIFO;"
+					" queueing fails when it is full\n", nodes[n].Name,
+					nodes[n].Messages, nodes[n].Buffers);
+			overflows++;
+		}
+	}
+	printf("%u of %u messages can miss their deadline\n", misses, msgCount);
+	return (misses != 0 || overflows != 0);
+}
@@ -0,0 +1,239 @@
+/**
+ ******************************************************************************
+ * @file           : cancap_bench.c
+ * @brief          : Bus sniffer capture (Src/can_capture.c) at full bus load.
+ *
+ * Frames are fed at their shortest (unstuffed) length, back to back for 100%
+ * bus load, which is the highest frame rate a bus can carry, or evenly spaced
+ * for a lower load, with idle gaps of up to 4 timestamp wraps between bursts. The RX timestamp is the low 16 bits of the bit clock
+ * at SOF and CANCAP_FRAME runs at EOF, as from the FDCAN interrupt.
+ *
+ * The consumer streams to SWO in 32-bit ITM packets (5 bytes on the wire
+ * for 4 of payload, 10 bits per byte in NRZ) at the link rate given on the
+ * command line. Every decoded record is checked against what was sent,
+ * timestamp included. Each traffic mix runs at the bus load CAN_SNIFFER is
+ * specified for at 2000 kbit/s (main.c): 100%, except 64-byte FD frames at
+ * 70% (2 Mbit/s data) and 40% (5 Mbit/s). Any dropped frame or mismatch
+ * fails the run with exit code 1.
+ *
+ * Build and run from the repository root:
+ *   gcc -O2 -IInc -o cancap_bench Tools/cancap_bench.c Src/can_capture.c
+ *   ./cancap_bench [SWO kbit/s, default 2000] [capture.bin]
+ * The optional file receives the last capture, for Tools/cancap_decode.c.
+ ******************************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "can_capture.h"
+
+#define BENCH_SECONDS               2U
+#define BENCH_BURST_FRAMES          2000U // Frames between idle gaps
+#define BENCH_MAX_FRAMES            200000U
+
+typedef struct {
+	const char *Name;
+	uint32_t NominalKbps;
+	uint32_t DataKbps;
+	uint8_t Extended;
+	uint8_t Fd;
+	uint8_t Bytes;
+	uint8_t LoadPct;               // Bus load the capture must keep up with
+} Mix_t;
+
+static uint64_t simBits;           // Bit clock of the simulated bus
+
+static uint32_t SIM_TICKS(void) {
+	return (uint32_t) simBits;
+}
+
+static uint16_t SIM_TIMESTAMP(void) {
+	return (uint16_t) simBits;
+}
+
+static uint64_t NOW_NS(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000U + (uint64_t) ts.tv_nsec;
+}
+
+static uint32_t RANDOM(void) {
+	static uint32_t seed = 0x13579BDFU;
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	return seed;
+}
+
+/* Shortest frame in nominal bit times, intermission included */
+static double FRAME_BITS(const Mix_t *m) {
+	if (!m->Fd) {
+		return (m->Extended ? 67.0 : 47.0) + 8.0 * m->Bytes;
+	}
+	double nominal = (m->Extended ? 36.0 : 17.0) + 13.0;
+	double data = 5.0 + 8.0 * m->Bytes + 4.0 + (m->Bytes > 16U ? 28.0 : 23.0);
+	return nominal + data * m->NominalKbps / m->DataKbps;
+}
+
+/* Returns 1 if every frame came through */
+static uint8_t RUN(const Mix_t *m, uint32_t swoKbps, const char *savePath) {
+	static CANCAP_HandleTypeDef_t h;
+	static FDCAN_FrameTypeDef_t sent[BENCH_MAX_FRAMES];
+	static uint64_t sentBits[BENCH_MAX_FRAMES];
+	static uint8_t stream[8U << 20];
+	double frameBits = FRAME_BITS(m);
+	double spacing = frameBits * 100.0 / m->LoadPct; // SOF to SOF
+	double payloadPerBit = swoKbps / 10.0 * 4.0 / 5.0 / m->NominalKbps; // Bytes per bus bit
+	uint32_t frames = (uint32_t) (BENCH_SECONDS * m->NominalKbps * 1000.0 / spacing);
+	size_t streamLen = 0;
+	double credit = 0;
+	uint64_t encodeNs = 0;
+
+	if (frames > BENCH_MAX_FRAMES) {
+		frames = BENCH_MAX_FRAMES;
+	}
+	memset(&h, 0, sizeof(h));
+	simBits = 1000U;
+	h.NominalKbps = m->NominalKbps;
+	h.DataKbps = m->DataKbps;
+	h.TicksPerBit = 1;
+	h.GetTicks = SIM_TICKS;
+	h.GetTimestamp = SIM_TIMESTAMP;
+	CANCAP_INIT(&h);
+	uint64_t startBits = simBits;
+
+	double busBits = (double) simBits;
+	for (uint32_t i = 0; i < frames; i++) {
+		FDCAN_FrameTypeDef_t *f = &sent[i];
+		uint32_t id = m->Extended ? (RANDOM() & FDCAN_ELEM_EXTID_MASK) :
+				(RANDOM() & FDCAN_ELEM_STDID_MASK);
+
+		if (i != 0 && (i % BENCH_BURST_FRAMES) == 0) {
+			busBits += RANDOM() % (4U * 65536U); // Idle, timestamps wrap
+		}
+		memset(f, 0, sizeof(*f));
+		FDCAN_FRAME_SET_ID(f, id, m->Extended);
+		FDCAN_FRAME_SET_CONTROL(f, FDCAN_BYTES_TO_DLC(m->Bytes), m->Fd, m->Fd);
+		for (uint32_t b = 0; b < m->Bytes; b++) {
+			FDCAN_FRAME_DATA(f)[b] = (uint8_t) RANDOM();
+		}
+		sentBits[i] = (uint64_t) busBits;
+		f->w1 |= (uint16_t) sentBits[i];   // RX timestamp at SOF
+
+		/* Consumer: stream what the link carried while the bus was busy */
+		double before = busBits;
+		busBits += spacing;
+		while (simBits + 10000U < (uint64_t) busBits) {
+			simBits += 10000U;     // The main loop keeps the clock in phase
+			CANCAP_POLL(&h);
+		}
+		simBits = (uint64_t) busBits;
+		credit += (busBits - before) * payloadPerBit;
+		const uint8_t *data;
+		uint32_t length;
+		while (credit >= 1.0 && (length = CANCAP_PEEK(&h, &data)) != 0) {
+			if (length > (uint32_t) credit) {
+				length = (uint32_t) credit;
+			}
+			memcpy(&stream[streamLen], data, length);
+			streamLen += length;
+			credit -= length;
+			CANCAP_RELEASE(&h, length);
+		}
+		if (CANCAP_USED(&h) == 0 && credit > 4.0) {
+			credit = 4.0;          // An idle link does not bank capacity
+		}
+
+		uint64_t t0 = NOW_NS();
+		CANCAP_FRAME(&h, f);
+		encodeNs += NOW_NS() - t0;
+	}
+	const uint8_t *data;
+	uint32_t length;
+	while ((length = CANCAP_PEEK(&h, &data)) != 0) {
+		memcpy(&stream[streamLen], data, length);
+		streamLen += length;
+		CANCAP_RELEASE(&h, length);
+	}
+
+	/* Decode and compare */
+	uint32_t errors = 0, next = 0, dropped = 0;
+	uint64_t time = 0;
+	size_t pos = CANCAP_HEADER_BYTES;
+	CANCAP_RecordTypeDef_t r;
+	uint32_t used;
+	if (memcmp(stream, CANCAP_MAGIC, 4) != 0) {
+		errors++;
+	}
+	while ((used = CANCAP_PARSE(&stream[pos], (uint32_t) (streamLen - pos), &r,
+			&time)) != 0) {
+		pos += used;
+		if (r.IsEvent) {
+			if (r.Event == CANCAP_EVT_DROP) {
+				next += r.Args[0];
+				dropped += r.Args[0];
+			}
+			continue;
+		}
+		const FDCAN_FrameTypeDef_t *f = &sent[next++];
+		if (FDCAN_FRAME_GET_ID(&r.Frame) != FDCAN_FRAME_GET_ID(f)
+				|| FDCAN_FRAME_IS_EXTENDED(&r.Frame) != FDCAN_FRAME_IS_EXTENDED(f)
+				|| FDCAN_FRAME_GET_DLC(&r.Frame) != FDCAN_FRAME_GET_DLC(f)
+				|| memcmp(FDCAN_FRAME_CDATA(&r.Frame), FDCAN_FRAME_CDATA(f),
+						m->Bytes) != 0
+				|| r.Time != sentBits[next - 1U] - startBits) {
+			errors++;
+		}
+	}
+	if (pos != streamLen || next + h.PendingDrops != frames
+			|| dropped + h.PendingDrops != h.Dropped) {
+		errors++;
+	}
+
+	/* Rates while the bus is busy; the idle gaps only test the clock */
+	double seconds = frames * spacing / (m->NominalKbps * 1000.0);
+	double perFrame = (double) (h.Bytes - CANCAP_HEADER_BYTES) / h.Frames;
+	double kbPerSec = perFrame * frames / seconds / 1000.0;
+	printf("%-24s %4u%% %7.0f %6.1f %8.1f %8.0f %6u %6u %6.1f %7u\n", m->Name,
+			m->LoadPct, frames / seconds, perFrame, kbPerSec,
+			kbPerSec * 10.0 * 5.0 / 4.0, h.HighWater, h.Dropped,
+			(double) encodeNs / frames, errors);
+
+	if (savePath != NULL) {
+		FILE *out = fopen(savePath, "wb");
+		if (out != NULL) {
+			fwrite(stream, 1, streamLen, out);
+			fclose(out);
+		}
+	}
+	return h.Dropped == 0 && errors == 0;
+}
+
+int main(int argc, char **argv) {
+	static const Mix_t mixes[] = {
+		{ "Classic 11-bit 0 B", 500, 500, 0, 0, 0, 100 },
+		{ "Classic 11-bit 8 B", 500, 500, 0, 0, 8, 100 },
+		{ "Classic 29-bit 8 B", 500, 500, 1, 0, 8, 100 },
+		{ "Classic 11-bit 8 B 1M", 1000, 1000, 0, 0, 8, 100 },
+		{ "FD BRS 11-bit 8 B 2M", 500, 2000, 0, 1, 8, 100 },
+		{ "FD BRS 11-bit 64 B 2M", 500, 2000, 0, 1, 64, 70 },
+		{ "FD BRS 29-bit 64 B 5M", 500, 5000, 1, 1, 64, 40 },
+	};
+	uint32_t swoKbps = (argc > 1) ? (uint32_t) atoi(argv[1]) : 2000U;
+	const char *savePath = (argc > 2) ? argv[2] : NULL;
+
+	printf("%u s each, SWO %u kbit/s, ring %u bytes\n\n", BENCH_SECONDS,
+			swoKbps, CANCAP_RING_BYTES);
+	printf("%-24s %5s %7s %6s %8s %8s %6s %6s %6s %7s\n", "Traffic", "Load",
+			"fr/s", "B/fr", "KB/s", "SWO kb/s", "Peak", "Drop", "ns/fr",
+			"Errors");
+	uint8_t ok = 1;
+	for (uint32_t i = 0; i < sizeof(mixes) / sizeof(mixes[0]); i++) {
+		ok &= RUN(&mixes[i], swoKbps, savePath);
+	}
+	printf("\n%s\n", ok ? "Every frame captured and decoded" :
+			"FAIL: frames dropped or decoded wrong");
+	return ok ? 0 : 1;
+}
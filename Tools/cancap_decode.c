@@ -0,0 +1,228 @@
+/**
+ ******************************************************************************
+ * @file           : cancap_decode.c
+ * @brief          : Convert a bus sniffer capture (Src/can_capture.c) to
+ *                   candump log or Vector ASC text.
+ *
+ * The input is either the raw record stream, or with -itm the SWO byte
+ * stream as saved by the debug probe, from which the instrumentation
+ * packets of one stimulus port are taken (CAN_SNIFFER_ITM_PORT, 1 by
+ * default). Timestamps are seconds from the start of the capture; -t adds
+ * an offset, e.g. the Unix time the capture was started.
+ *
+ * candump output is the -L log format read back by canplayer:
+ *   (0000000000.001234) can0 123#1122334455667788
+ *   (0000000000.001500) can0 18FEF100##1112233
+ * ASC output has one line per frame as written by CANalyzer:
+ *      0.001234 1  123             Rx   d 8 11 22 33 44 55 66 77 88
+ *      0.001500 CANFD   1 Rx 18FEF100x  1 0 8  8 11 22 33 44 55 66 77 88
+ * Dropped frames show up as a comment in both formats.
+ *
+ * Build and run from the repository root:
+ *   gcc -O2 -IInc -o cancap_decode Tools/cancap_decode.c Src/can_capture.c
+ *   ./cancap_decode [-itm [port]] [-asc] [-i can0] [-t offset] capture.bin
+ ******************************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "can_capture.h"
+
+#define DECODE_ITM_DEFAULT_PORT     1U
+
+typedef struct {
+	uint8_t Asc;
+	const char *Interface;
+	double Offset;
+	double BitSeconds;             // Nominal bit time, from the START event
+	uint32_t Frames;
+	uint32_t Dropped;
+} Decode_t;
+
+/**
+ * @brief  Keep the payload bytes of instrumentation packets for one port
+ * @note   ITM packets: a 0x00 run ended by 0x80 is a sync, xxxx0000 headers
+ *         with bit 7 set start timestamps ended by a byte with bit 7 clear,
+ *         0x70 is an overflow, and the low 2 bits of other headers give 1, 2
+ *         or 4 payload bytes (bit 2 set: hardware source, port in bits 7:3)
+ */
+static size_t ITM_EXTRACT(uint8_t *buf, size_t length, uint32_t port) {
+	size_t in = 0, out = 0;
+
+	while (in < length) {
+		uint8_t header = buf[in++];
+		if (header == 0x00U) {
+			while (in < length && buf[in] == 0x00U) {
+				in++;
+			}
+			if (in < length && buf[in] == 0x80U) {
+				in++;
+			}
+		} else if (header == 0x70U) {
+			fprintf(stderr, "ITM overflow: SWO lost data\n");
+		} else if ((header & 0x0FU) == 0x00U) {
+			if (header & 0x80U) {  // Local timestamp with continuation bytes
+				while (in < length && (buf[in++] & 0x80U)) {
+				}
+			}
+		} else if ((header & 0x03U) != 0) {
+			static const uint8_t sizes[4] = { 0, 1, 2, 4 };
+			uint8_t size = sizes[header & 0x03U];
+			if (in + size > length) {
+				break;
+			}
+			if ((header & 0x04U) == 0 && (uint32_t) (header >> 3) == port) {
+				memmove(&buf[out], &buf[in], size);
+				out += size;
+			}
+			in += size;
+		}
+		// Other extension packets carry no payload we need
+	}
+	return out;
+}
+
+static void PRINT_FRAME(Decode_t *d, const CANCAP_RecordTypeDef_t *r) {
+	const FDCAN_FrameTypeDef_t *f = &r->Frame;
+	const uint8_t *data = FDCAN_FRAME_CDATA(f);
+	double t = d->Offset + (double) r->Time * d->BitSeconds;
+	uint32_t id = FDCAN_FRAME_GET_ID(f);
+	uint8_t ext = FDCAN_FRAME_IS_EXTENDED(f);
+	uint8_t fd = FDCAN_FRAME_IS_FD(f);
+	uint8_t remote = !fd && FDCAN_FRAME_IS_REMOTE(f);
+	uint32_t length = remote ? 0 : FDCAN_FRAME_GET_LEN(f);
+
+	if (!fd && length > 8U) {
+		length = 8U;
+	}
+	d->Frames++;
+
+	if (!d->Asc) {
+		printf("(%017.6f) %s ", t, d->Interface);
+		printf(ext ? "%08X" : "%03X", id);
+		if (remote) {
+			printf("#R\n");
+			return;
+		}
+		if (fd) {
+			printf("##%X", FDCAN_FRAME_IS_BRS(f) | (FDCAN_FRAME_GET_ESI(f) << 1));
+		} else {
+			printf("#");
+		}
+		for (uint32_t i = 0; i < length; i++) {
+			printf("%02X", data[i]);
+		}
+		printf("\n");
+		return;
+	}
+
+	char idText[16];
+	snprintf(idText, sizeof(idText), ext ? "%Xx" : "%X", id);
+	if (!fd) {
+		printf("%11.6f 1  %-15s Rx   %c %u", t, idText, remote ? 'r' : 'd',
+				FDCAN_FRAME_GET_DLC(f));
+	} else {
+		printf("%11.6f CANFD   1 Rx %-10s %u %u %X %2u", t, idText,
+				FDCAN_FRAME_IS_BRS(f), FDCAN_FRAME_GET_ESI(f),
+				FDCAN_FRAME_GET_DLC(f), length);
+	}
+	for (uint32_t i = 0; i < length; i++) {
+		printf(" %02X", data[i]);
+	}
+	printf("\n");
+}
+
+int main(int argc, char **argv) {
+	Decode_t d = { 0, "can0", 0.0, 1.0 / 500000.0, 0, 0 };
+	const char *path = NULL;
+	int itmPort = -1;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-itm") == 0) {
+			itmPort = DECODE_ITM_DEFAULT_PORT;
+			if (i + 1 < argc && argv[i + 1][0] >= '0' && argv[i + 1][0] <= '9') {
+				itmPort = atoi(argv[++i]);
+			}
+		} else if (strcmp(argv[i], "-asc") == 0) {
+			d.Asc = 1;
+		} else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+			d.Interface = argv[++i];
+		} else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+			d.Offset = atof(argv[++i]);
+		} else if (path == NULL) {
+			path = argv[i];
+		} else {
+			path = NULL;
+			break;
+		}
+	}
+	if (path == NULL) {
+		fprintf(stderr, "usage: %s [-itm [port]] [-asc] [-i can0] [-t offset]"
+				" capture.bin\n", argv[0]);
+		return 2;
+	}
+
+	FILE *in = fopen(path, "rb");
+	if (in == NULL) {
+		perror(path);
+		return 2;
+	}
+	fseek(in, 0, SEEK_END);
+	long size = ftell(in);
+	fseek(in, 0, SEEK_SET);
+	uint8_t *buf = malloc(size > 0 ? (size_t) size : 1U);
+	size_t length = fread(buf, 1, (size_t) size, in);
+	fclose(in);
+	if (itmPort >= 0) {
+		length = ITM_EXTRACT(buf, length, (uint32_t) itmPort);
+	}
+
+	/* The stream may have been picked up mid-way: find the header */
+	size_t pos = 0;
+	while (pos + CANCAP_HEADER_BYTES <= length
+			&& (memcmp(&buf[pos], CANCAP_MAGIC, 4) != 0
+					|| buf[pos + 4] != CANCAP_VERSION)) {
+		pos++;
+	}
+	if (pos + CANCAP_HEADER_BYTES > length) {
+		fprintf(stderr, "%s: no capture header\n", path);
+		free(buf);
+		return 1;
+	}
+	pos += CANCAP_HEADER_BYTES;
+
+	if (d.Asc) {
+		printf("date Thu Jan 1 00:00:00.000 am 1970\n");
+		printf("base hex  timestamps absolute\n");
+		printf("internal events logged\n");
+		printf("Begin Triggerblock\n");
+	}
+
+	uint64_t time = 0;
+	CANCAP_RecordTypeDef_t r;
+	uint32_t used;
+	while ((used = CANCAP_PARSE(&buf[pos], (uint32_t) (length - pos), &r, &time))
+			!= 0) {
+		pos += used;
+		if (!r.IsEvent) {
+			PRINT_FRAME(&d, &r);
+		} else if (r.Event == CANCAP_EVT_START && r.Args[0] != 0) {
+			d.BitSeconds = 1.0 / (r.Args[0] * 1000.0);
+		} else if (r.Event == CANCAP_EVT_DROP) {
+			d.Dropped += r.Args[0];
+			printf(d.Asc ? "// %u frames dropped\n" : "# %u frames dropped\n",
+					r.Args[0]);
+		}
+	}
+	if (d.Asc) {
+		printf("End TriggerBlock\n");
+	}
+	if (pos != length) {
+		fprintf(stderr, "%s: %zu trailing bytes not decoded\n", path,
+				length - pos);
+	}
+	fprintf(stderr, "%u frames, %u dropped\n", d.Frames, d.Dropped);
+	free(buf);
+	return 0;
+}
@@ -0,0 +1,334 @@
+/**
+ ******************************************************************************
+ * @file           : canerr_sim.c
+ * @brief          : Fault injection test of the CAN error state manager
+ *                   (Src/can_errstate.c) on a simulated controller.
+ *
+ * The simulated controller applies ISO 11898-1 fault confinement: +8 TEC per
+ * transmit error, -1 per successful frame, +1/-1 REC per received frame,
+ * warning at 96, passive at 128, bus-off above 255. In bus-off it holds INIT
+ * until the manager restarts it, then needs 128 occurrences of 11 recessive
+ * bits (2.8 ms at 500 kbit/s), which a disturbed bus does not provide.
+ *
+ * The node queues one frame per millisecond into a 3-deep TX FIFO and hears
+ * one frame per millisecond. Faults are injected as a random per-frame error
+ * rate, periodic EMI bursts that corrupt every frame, and a bus short.
+ * Status changes and protocol errors set IR bits in the STM32H5 layout of
+ * RM0492, written out here apart from can_errstate.h. The interrupt path is
+ * the firmware's: IE enabled from CANERR_IR_FLAGS, IR & CANERR_IR_FLAGS
+ * acknowledged and handed to CANERR_IRQ, the IE bits it returns masked and
+ * re-armed by the millisecond poll (the main loop), which also feeds PSR and
+ * ECR. A status change after which the state does not match PSR counts as
+ * missed by the interrupt, and any miss fails the run.
+ *
+ * Build and run from the repository root:
+ *   gcc -O2 -IInc -o canerr_sim Tools/canerr_sim.c Src/can_errstate.c
+ *   ./canerr_sim
+ ******************************************************************************
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "can_errstate.h"
+
+#define SIM_SECONDS                 60U
+#define SIM_BIT_US                  2U    // 500 kbit/s
+#define SIM_FRAME_BITS              125U  // 11-bit ID, 8 bytes, typical stuffing
+#define SIM_ERROR_BITS              80U   // Error found mid-frame plus error frame
+#define SIM_PERIOD_US               1000U // TX queueing and RX rate
+#define SIM_TX_FIFO                 3U
+#define SIM_RECOVERY_SEQUENCES      128U  // 11-bit recessive sequences to leave bus-off
+
+/* FDCAN IR as the STM32H5 sets it (RM0492), not taken from can_errstate.h */
+#define SIM_IR_EP                   (1UL << 17)
+#define SIM_IR_EW                   (1UL << 18)
+#define SIM_IR_BO                   (1UL << 19)
+#define SIM_IR_PEA                  (1UL << 21)
+
+typedef struct {
+	const char *Name;
+	uint32_t ErrorPpm;             // Random frame errors, parts per million
+	uint32_t BurstPeriodMs;        // EMI burst every ... (0 = none)
+	uint32_t BurstLenMs;
+	uint32_t ShortStartMs;         // Bus short (0 = none)
+	uint32_t ShortLenMs;
+} SimFault_t;
+
+typedef struct {
+	const char *Name;
+	uint32_t FastBackoffMs;
+	uint8_t FastAttempts;
+	uint32_t SlowBackoffMs;
+} SimPolicy_t;
+
+/* Simulated controller */
+static uint32_t simNowUs;
+static uint32_t simTec, simRec;
+static uint8_t simBusOff, simInit;
+static uint32_t simRecoverySeq;
+static uint32_t simLec;
+static uint32_t simSeed;
+static uint32_t simIr, simIe;      // FDCAN IR and IE
+static uint32_t simIrqMissed, simPeIrqs;
+
+static uint32_t SIM_TICKS(void) {
+	return simNowUs;
+}
+
+static void SIM_RESTART(void *ctx) {
+	(void) ctx;
+	simInit = 0;                   // CCCR.INIT cleared: recovery count starts
+	simRecoverySeq = 0;
+}
+
+static uint32_t SIM_RANDOM(void) {
+	simSeed ^= simSeed << 13;
+	simSeed ^= simSeed >> 17;
+	simSeed ^= simSeed << 5;
+	return simSeed;
+}
+
+static uint8_t SIM_DISTURBED(const SimFault_t *f) {
+	uint32_t ms = simNowUs / 1000U;
+	if (f->ShortLenMs != 0 && ms >= f->ShortStartMs
+			&& ms < f->ShortStartMs + f->ShortLenMs) {
+		return 1;
+	}
+	return f->BurstPeriodMs != 0 && (ms % f->BurstPeriodMs) < f->BurstLenMs;
+}
+
+static uint8_t SIM_FRAME_ERROR(const SimFault_t *f) {
+	return SIM_DISTURBED(f) || (SIM_RANDOM() % 1000000U) < f->ErrorPpm;
+}
+
+/* PSR as the manager would read it; reading resets LEC */
+static uint32_t SIM_PSR(void) {
+	uint32_t psr = simLec;
+	simLec = CANERR_LEC_NO_CHANGE;
+	if (simBusOff) {
+		psr |= 1U << CANERR_PSR_BO_POS;
+	}
+	if (simTec >= 128U || simRec >= 128U) {
+		psr |= 1U << CANERR_PSR_EP_POS;
+	}
+	if (simTec >= 96U || simRec >= 96U) {
+		psr |= 1U << CANERR_PSR_EW_POS;
+	}
+	return psr;
+}
+
+static uint32_t SIM_ECR(void) {
+	uint32_t tec = simTec > 255U ? 255U : simTec;
+	return tec | ((simRec > 127U ? 127U : simRec) << CANERR_ECR_REC_POS);
+}
+
+static uint32_t SIM_STATUS_BITS(void) {
+	return (simBusOff << 2) | ((simTec >= 128U || simRec >= 128U) << 1)
+			| (simTec >= 96U || simRec >= 96U);
+}
+
+static void SIM_ERROR(void) {
+	static const uint8_t codes[] = { CANERR_LEC_STUFF, CANERR_LEC_FORM,
+			CANERR_LEC_BIT0, CANERR_LEC_CRC };
+	simLec = codes[SIM_RANDOM() % sizeof(codes)];
+	simIr |= SIM_IR_PEA;           // Classic frames: arbitration phase only
+}
+
+/* IR bits the hardware sets for a change of the EW/EP/BO status bits */
+static void SIM_STATUS_IR(uint32_t from, uint32_t to) {
+	uint32_t changed = from ^ to;
+	if (changed & 0x1U) {
+		simIr |= SIM_IR_EW;
+	}
+	if (changed & 0x2U) {
+		simIr |= SIM_IR_EP;
+	}
+	if (changed & 0x4U) {
+		simIr |= SIM_IR_BO;
+	}
+}
+
+/* State the manager must be in right after the interrupt for 'status' */
+static uint8_t SIM_STATE_OK(const CANERR_HandleTypeDef_t *h, uint32_t status) {
+	if (status & 0x4U) {
+		return CANERR_OFF_BUS(h);
+	}
+	if (status & 0x2U) {
+		return h->State == CANERR_STATE_PASSIVE;
+	}
+	if (status & 0x1U) {
+		return h->State == CANERR_STATE_WARNING;
+	}
+	return h->State == CANERR_STATE_ACTIVE;
+}
+
+/* FDCAN1_IT0_IRQHandler and CAN_ERR_IRQ, when an enabled IR bit is set */
+static void SIM_IRQ(CANERR_HandleTypeDef_t *h) {
+	if ((simIr & simIe) == 0) {
+		return;
+	}
+	uint32_t flags = simIr & CANERR_IR_FLAGS;
+	simIr &= ~flags;
+	if (flags & SIM_IR_PEA) {
+		simPeIrqs++;
+	}
+	simIe &= ~CANERR_IRQ(h, flags, SIM_PSR(), SIM_ECR());
+}
+
+static uint8_t SIM_RUN(const SimFault_t *f, const SimPolicy_t *p) {
+	CANERR_HandleTypeDef_t h;
+	uint32_t queued = 0, generated = 0, sent = 0, dropped = 0;
+	uint32_t nextGen = 0, nextRx = SIM_PERIOD_US / 2U, nextPoll = SIM_PERIOD_US / 4U;
+	uint32_t endUs = SIM_SECONDS * 1000000U;
+
+	simNowUs = 0;
+	simTec = simRec = 0;
+	simBusOff = simInit = 0;
+	simLec = CANERR_LEC_NO_CHANGE;
+	simSeed = 0x2468ACE1U;
+	simIr = 0;
+	simIe = CANERR_IR_FLAGS;       // CAN_ERR_INIT
+	simIrqMissed = simPeIrqs = 0;
+
+	memset(&h, 0, sizeof(h));
+	h.TicksPerUs = 1;
+	h.GetTicks = SIM_TICKS;
+	h.Restart = SIM_RESTART;
+	h.FastBackoffMs = p->FastBackoffMs;
+	h.FastAttempts = p->FastAttempts;
+	h.SlowBackoffMs = p->SlowBackoffMs;
+	h.StableMs = CANERR_STABLE_MS;
+	CANERR_INIT(&h);
+
+	uint32_t status = SIM_STATUS_BITS();
+	while (simNowUs < endUs) {
+		if ((int32_t) (simNowUs - nextGen) >= 0) {
+			nextGen += SIM_PERIOD_US;
+			generated++;
+			if (queued < SIM_TX_FIFO) {
+				queued++;
+			} else {
+				dropped++;
+			}
+		}
+		if ((int32_t) (simNowUs - nextRx) >= 0) {
+			nextRx += SIM_PERIOD_US;
+			if (!simBusOff) {
+				if (SIM_FRAME_ERROR(f)) {
+					simRec++;
+					SIM_ERROR();
+				} else if (simRec > 127U) {
+					simRec = 120U;     // Back below passive after a good frame
+				} else if (simRec > 0) {
+					simRec--;
+				}
+			}
+		}
+		if ((int32_t) (simNowUs - nextPoll) >= 0) {
+			nextPoll += SIM_PERIOD_US;
+			CANERR_UPDATE(&h, SIM_PSR(), SIM_ECR());
+			CANERR_POLL(&h);
+			simIe |= CANERR_IR_PROTOCOL_FLAGS; // CAN_ERR_TASK re-arms
+		}
+
+		/* EP/EW/BO and PEA interrupt */
+		uint32_t now = SIM_STATUS_BITS();
+		if (now != status) {
+			SIM_STATUS_IR(status, now);
+			status = now;
+			SIM_IRQ(&h);
+			if (!SIM_STATE_OK(&h, status)) {
+				simIrqMissed++;
+			}
+		} else {
+			SIM_IRQ(&h);
+		}
+
+		if (simBusOff) {
+			/* One 11-bit slot; only an undisturbed bus counts as recessive */
+			if (!simInit && !SIM_DISTURBED(f)
+					&& ++simRecoverySeq >= SIM_RECOVERY_SEQUENCES) {
+				simBusOff = 0;
+				simTec = simRec = 0;
+			}
+			simNowUs += 11U * SIM_BIT_US;
+			continue;
+		}
+
+		if (queued == 0) {
+			uint32_t next = nextGen;
+			if ((int32_t) (nextRx - next) < 0) {
+				next = nextRx;
+			}
+			if ((int32_t) (nextPoll - next) < 0) {
+				next = nextPoll;
+			}
+			simNowUs = next;
+			continue;
+		}
+
+		/* Transmit attempt, retried automatically on error */
+		if (SIM_FRAME_ERROR(f)) {
+			simTec += 8U;
+			SIM_ERROR();
+			simNowUs += SIM_ERROR_BITS * SIM_BIT_US;
+			if (simTec > 255U) {
+				simBusOff = 1;
+				simInit = 1;       // Hardware sets CCCR.INIT on bus-off
+			}
+		} else {
+			if (simTec > 0) {
+				simTec--;
+			}
+			queued--;
+			sent++;
+			simNowUs += SIM_FRAME_BITS * SIM_BIT_US;
+		}
+	}
+	CANERR_POLL(&h);
+
+	double total = (double) SIM_SECONDS * 1e6;
+	double pct[CANERR_STATE_COUNT];
+	for (uint8_t s = 0; s < CANERR_STATE_COUNT; s++) {
+		pct[s] = 100.0 * (double) CANERR_TIME_IN_STATE_US(&h, s) / total;
+	}
+	printf("%-16s %-14s %5u %6.2f %6.2f %6.2f %6.2f %6.2f %8.1f %7.2f%% %6u %6u %4u\n",
+			f->Name, p->Name, h.Entered[CANERR_STATE_BUS_OFF], pct[0], pct[1],
+			pct[2], pct[3], pct[4], h.DowntimeMaxUs / 1000.0,
+			100.0 * sent / generated, dropped, simPeIrqs, simIrqMissed);
+	return simIrqMissed == 0;
+}
+
+int main(void) {
+	static const SimFault_t faults[] = {
+		{ "Clean", 0, 0, 0, 0, 0 },
+		{ "Noise 1%", 10000, 0, 0, 0, 0 },
+		{ "Noise 10%", 100000, 0, 0, 0, 0 },
+		{ "EMI 50ms/1s", 1000, 1000, 50, 0, 0 },
+		{ "EMI 200ms/2s", 1000, 2000, 200, 0, 0 },
+		{ "Short 5s", 0, 0, 0, 10000, 5000 },
+	};
+	static const SimPolicy_t policies[] = {
+		{ "0ms x5, 1s", 0, 5, 1000 },
+		{ "10ms x5, 1s", 10, 5, 1000 },
+		{ "100ms always", 100, 0, 100 },
+		{ "1s always", 1000, 0, 1000 },
+	};
+
+	printf("%u s at 500 kbit/s, 1 frame/ms each way; time per state in %%\n\n",
+			SIM_SECONDS);
+	printf("%-16s %-14s %5s %6s %6s %6s %6s %6s %8s %8s %6s %6s %4s\n", "Fault",
+			"Backoff", "BOff", "Act", "Warn", "Pass", "BusOff", "Recov",
+			"MaxDown", "Sent", "Drop", "PeIrq", "Miss");
+	printf("%-16s %-14s %5s %6s %6s %6s %6s %6s %8s %8s %6s %6s %4s\n", "", "",
+			"", "", "", "", "", "", "ms", "", "", "", "");
+	uint8_t ok = 1;
+	for (uint32_t i = 0; i < sizeof(faults) / sizeof(faults[0]); i++) {
+		for (uint32_t j = 0; j < sizeof(policies) / sizeof(policies[0]); j++) {
+			ok &= SIM_RUN(&faults[i], &policies[j]);
+		}
+	}
+	printf("\nInterrupt path: %s\n", ok ? "every status change seen" :
+			"FAIL, status changes missed (IR layout?)");
+	return ok ? 0 : 1;
+}
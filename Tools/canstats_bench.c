@@ -0,0 +1,166 @@
+/**
+ ******************************************************************************
+ * @file           : canstats_bench.c
+ * @brief          : Check and time the bus statistics of Src/can_stats.c.
+ *
+ * 1. Frame lengths against hand-computed worst cases (Classic CAN:
+ *    8n + g + 13 + floor((g + 8n - 1) / 4) with g = 34 or 54).
+ * 2. Bus load of synthetic periodic traffic on a simulated clock, against
+ *    the load worked out from those lengths.
+ * 3. Cost of CANSTATS_FRAME for a mix of 48 IDs, Classic and FD.
+ *
+ * Build and run from the repository root:
+ *   gcc -O2 -IInc -o canstats_bench Tools/canstats_bench.c Src/can_stats.c
+ *   ./canstats_bench
+ ******************************************************************************
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "can_stats.h"
+
+#define BENCH_FRAMES                20000000U
+#define BENCH_IDS                   48U
+
+static uint32_t simNowUs;
+
+static uint32_t SIM_TICKS(void) {
+	return simNowUs;
+}
+
+static uint64_t NOW_NS(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000U + (uint64_t) ts.tv_nsec;
+}
+
+static void MAKE_FRAME(FDCAN_FrameTypeDef_t *f, uint32_t id, uint8_t ext,
+		uint8_t fmt, uint8_t bytes) {
+	memset(f, 0, sizeof(*f));
+	FDCAN_FRAME_SET_ID(f, id, ext);
+	FDCAN_FRAME_SET_CONTROL(f, FDCAN_BYTES_TO_DLC(bytes),
+			fmt != CANSTATS_FMT_CLASSIC, fmt == CANSTATS_FMT_FD_BRS);
+}
+
+static uint32_t CHECK_LENGTHS(void) {
+	static const struct {
+		const char *Name;
+		uint8_t Format, Extended, Bytes;
+		uint32_t Bits, DataBits;
+	} cases[] = {
+		{ "Classic 11-bit 0 B", CANSTATS_FMT_CLASSIC, 0, 0, 55, 0 },
+		{ "Classic 11-bit 8 B", CANSTATS_FMT_CLASSIC, 0, 8, 135, 0 },
+		{ "Classic 29-bit 8 B", CANSTATS_FMT_CLASSIC, 1, 8, 160, 0 },
+		{ "FD 11-bit 8 B", CANSTATS_FMT_FD, 0, 8, 147, 0 },
+		{ "FD BRS 11-bit 8 B", CANSTATS_FMT_FD_BRS, 0, 8, 147, 113 },
+		{ "FD BRS 11-bit 64 B", CANSTATS_FMT_FD_BRS, 0, 64, 712, 678 },
+		{ "FD BRS 29-bit 64 B", CANSTATS_FMT_FD_BRS, 1, 64, 736, 679 },
+	};
+	uint32_t failures = 0;
+
+	printf("%-20s %6s %6s %6s %6s\n", "Frame", "Bits", "Want", "Data",
+			"Want");
+	for (uint32_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		uint32_t data;
+		uint32_t bits = CANSTATS_WIRE_BITS(cases[i].Format, cases[i].Extended,
+				cases[i].Bytes, &data);
+		uint8_t ok = bits == cases[i].Bits && data == cases[i].DataBits;
+		failures += !ok;
+		printf("%-20s %6u %6u %6u %6u %s\n", cases[i].Name, bits,
+				cases[i].Bits, data, cases[i].DataBits, ok ? "" : "MISMATCH");
+	}
+	return failures;
+}
+
+/* 'perMs' frames of one kind every millisecond for two seconds */
+static uint32_t CHECK_LOAD(const char *name, uint8_t fmt, uint8_t bytes,
+		uint32_t perMs, uint32_t wantPermille) {
+	static CANSTATS_HandleTypeDef_t h;
+	FDCAN_FrameTypeDef_t f;
+
+	memset(&h, 0, sizeof(h));
+	simNowUs = 0;
+	h.NominalKbps = 500;
+	h.DataKbps = 2000;
+	h.BucketMs = 10;
+	h.TicksPerUs = 1;
+	h.GetTicks = SIM_TICKS;
+	CANSTATS_INIT(&h);
+
+	MAKE_FRAME(&f, 0x100, 0, fmt, bytes);
+	for (uint32_t ms = 0; ms < 2000U; ms++) {
+		for (uint32_t k = 0; k < perMs; k++) {
+			simNowUs = ms * 1000U + k * (1000U / perMs);
+			CANSTATS_FRAME(&h, &f, k & 1U);
+		}
+	}
+	simNowUs = 2000U * 1000U;
+
+	uint32_t l10 = CANSTATS_LOAD_PERMILLE(&h, 10);
+	uint32_t l100 = CANSTATS_LOAD_PERMILLE(&h, 100);
+	uint32_t l1000 = CANSTATS_LOAD_PERMILLE(&h, 1000);
+	uint8_t ok = l10 == wantPermille && l100 == wantPermille
+			&& l1000 == wantPermille;
+	printf("%-26s %5u.%u%% %5u.%u%% %5u.%u%% %5u.%u%% %s\n", name,
+			l10 / 10U, l10 % 10U, l100 / 10U, l100 % 10U, l1000 / 10U,
+			l1000 % 10U, wantPermille / 10U, wantPermille % 10U,
+			ok ? "" : "MISMATCH");
+
+	/* A quiet second must read as idle without any frame to advance the ring */
+	simNowUs += 1000000U;
+	if (CANSTATS_LOAD_PERMILLE(&h, 1000) != 0) {
+		printf("  idle bus not reported as 0%%\n");
+		ok = 0;
+	}
+	return !ok;
+}
+
+static void BENCH_FRAME_COST(void) {
+	static CANSTATS_HandleTypeDef_t h;
+	static FDCAN_FrameTypeDef_t frames[BENCH_IDS];
+
+	memset(&h, 0, sizeof(h));
+	simNowUs = 0;
+	h.NominalKbps = 500;
+	h.DataKbps = 2000;
+	h.TicksPerUs = 1;
+	h.GetTicks = SIM_TICKS;
+	CANSTATS_INIT(&h);
+
+	for (uint32_t i = 0; i < BENCH_IDS; i++) {
+		uint8_t ext = (i % 3U) == 0;
+		uint32_t id = ext ? 0x18FEF000U + i : 0x100U + i * 7U;
+		MAKE_FRAME(&frames[i], id, ext, (uint8_t) (i % CANSTATS_FMT_COUNT),
+				(uint8_t) ((i * 5U) % 9U));
+	}
+
+	uint64_t t0 = NOW_NS();
+	for (uint32_t n = 0; n < BENCH_FRAMES; n++) {
+		simNowUs += 100U;              // 10 000 frames/s of simulated time
+		CANSTATS_FRAME(&h, &frames[n % BENCH_IDS], n & 1U);
+	}
+	uint64_t t1 = NOW_NS();
+
+	printf("\n%u frames, %u IDs: %.1f ns/frame, %u tracked, %u untracked\n",
+			BENCH_FRAMES, BENCH_IDS, (double) (t1 - t0) / BENCH_FRAMES,
+			h.IdCount, h.Untracked);
+	printf("Handle size %zu bytes\n", sizeof(h));
+}
+
+int main(void) {
+	uint32_t failures = CHECK_LENGTHS();
+
+	printf("\n%-26s %7s %7s %7s %7s\n", "Traffic (500k/2M)", "10ms", "100ms",
+			"1s", "Want");
+	/* 135 bits x 2 us = 270 us per ms */
+	failures += CHECK_LOAD("Classic 8 B, 1/ms", CANSTATS_FMT_CLASSIC, 8, 1, 270);
+	/* 4 x 55 bits x 2 us = 440 us per ms */
+	failures += CHECK_LOAD("Classic 0 B, 4/ms", CANSTATS_FMT_CLASSIC, 0, 4, 440);
+	/* 34 bits x 2 us + 678 bits x 0.5 us = 407 us per ms */
+	failures += CHECK_LOAD("FD BRS 64 B, 1/ms", CANSTATS_FMT_FD_BRS, 64, 1, 407);
+
+	BENCH_FRAME_COST();
+	printf("%u failures\n", failures);
+	return failures != 0;
+}
@@ -0,0 +1,479 @@
+/**
+ ******************************************************************************
+ * @file           : dbc_gen.c
+ * @brief          : Generate per-message signal pack/unpack code from a DBC.
+ *
+ * Reads the BO_ (message) and SG_ (signal) lines of a DBC file and writes a
+ * header with, per message:
+ *   - <PREFIX>_<MSG>_ID / _EXTENDED / _LEN constants
+ *   - <PREFIX>_<MSG>_TypeDef_t holding the raw value of every signal
+ *   - <PREFIX>_<MSG>_UNPACK / _PACK working on an FDCAN_FrameTypeDef_t
+ *   - <PREFIX>_<MSG>_<SIG>_FACTOR / _OFFSET: physical = raw * FACTOR + OFFSET
+ *
+ * All bit positions and masks are resolved here, at generation time. The
+ * payload words of the compact frame are word aligned, so every signal is
+ * one load plus a shift/mask (UBFX) or sign extend (SBFX). Motorola signals
+ * are read from the byte-reversed word (REV), so they cost one instruction
+ * more than Intel ones. A signal crossing a 32-bit word boundary is read
+ * from two words as a 64-bit value. PACK builds every payload word in a
+ * register and stores each one once.
+ *
+ * Multiplexed signals are all emitted; the caller checks the multiplexor.
+ * Value tables, attributes and comments are ignored.
+ *
+ * Build and run from the repository root:
+ *   gcc -O2 -o dbc_gen Tools/dbc_gen.c
+ *   ./dbc_gen Tools/vehicle.dbc Inc/vehicle_signals.h VEH
+ ******************************************************************************
+ */
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DBC_MAX_MESSAGES            256U
+#define DBC_MAX_SIGNALS             64U   // Per message
+#define DBC_MAX_NAME                64U
+#define DBC_MAX_NUMBER              32U
+#define DBC_FRAME_WORDS             16U   // 64-byte CAN FD payload
+#define DBC_EXTENDED_FLAG           0x80000000UL // DBC marks 29-bit IDs with bit 31
+
+/* How a signal is read out of the payload words */
+#define DBC_ACCESS_WORD             0     // Inside one 32-bit word
+#define DBC_ACCESS_DWORD            1     // Across words k and k + 1
+
+typedef struct {
+	char Name[DBC_MAX_NAME];
+	char Factor[DBC_MAX_NUMBER];
+	char Offset[DBC_MAX_NUMBER];
+	uint32_t StartBit;             // As written in the DBC
+	uint32_t Length;
+	uint8_t Intel;                 // 1 = little endian (@1), 0 = Motorola (@0)
+	uint8_t Signed;
+
+	/* Resolved layout */
+	uint8_t Access;
+	uint32_t Word;                 // First payload word (k)
+	uint32_t Shift;                // LSB position in the (byte-reversed) word
+} DBC_SignalTypeDef_t;
+
+typedef struct {
+	char Name[DBC_MAX_NAME];
+	uint32_t Id;
+	uint8_t Extended;
+	uint32_t Length;               // Payload bytes
+	uint32_t SignalCount;
+	DBC_SignalTypeDef_t Signals[DBC_MAX_SIGNALS];
+} DBC_MessageTypeDef_t;
+
+static DBC_MessageTypeDef_t dbcMessages[DBC_MAX_MESSAGES];
+static uint32_t dbcMessageCount;
+static const char *dbcPrefix = "DBC";
+
+static void DBC_FAIL(const char *msg, const char *what, unsigned line) {
+	fprintf(stderr, "dbc_gen: line %u: %s: %s\n", line, msg, what);
+	exit(1);
+}
+
+static void DBC_UPPER(char *dst, const char *src, size_t size) {
+	size_t i = 0;
+	for (; src[i] != '\0' && i + 1 < size; i++) {
+		dst[i] = (char) toupper((unsigned char) src[i]);
+	}
+	dst[i] = '\0';
+}
+
+static const char* DBC_SKIP_SPACE(const char *p) {
+	while (*p == ' ' || *p == '\t') {
+		p++;
+	}
+	return p;
+}
+
+/**
+ * @brief  Resolve which payload word(s) a signal lives in and its shift
+ * @retval 0 on success, -1 if the signal spans more than two words
+ */
+static int DBC_LAYOUT(DBC_SignalTypeDef_t *s) {
+	if (s->Intel) {
+		/* Little endian: payload bit n is bit n % 32 of word n / 32 */
+		s->Word = s->StartBit / 32U;
+		s->Shift = s->StartBit % 32U;
+		s->Access = (s->Shift + s->Length <= 32U) ?
+				DBC_ACCESS_WORD : DBC_ACCESS_DWORD;
+		return (s->Shift + s->Length <= 64U) ? 0 : -1;
+	}
+
+	/* Big endian: StartBit is the MSB. With byte b of the frame at bits
+	 * (3 - b % 4) * 8 of REV(word b / 4), a Motorola signal is contiguous. */
+	uint32_t msbByte = s->StartBit / 8U;
+	uint32_t msbBit = s->StartBit % 8U;
+	s->Word = msbByte / 4U;
+	int32_t msb = (int32_t) ((3U - msbByte % 4U) * 8U + msbBit);
+	int32_t lsb = msb - (int32_t) s->Length + 1;
+	if (lsb >= 0) {
+		s->Access = DBC_ACCESS_WORD;
+		s->Shift = (uint32_t) lsb;
+		return 0;
+	}
+	lsb += 32;                     // Same signal seen in REV(k) << 32 | REV(k + 1)
+	s->Access = DBC_ACCESS_DWORD;
+	s->Shift = (uint32_t) lsb;
+	return (lsb >= 0) ? 0 : -1;
+}
+
+/**
+ * @brief  Highest payload byte a signal touches, to check it against the DLC
+ */
+static uint32_t DBC_LAST_BYTE(const DBC_SignalTypeDef_t *s) {
+	if (s->Intel) {
+		return (s->StartBit + s->Length - 1U) / 8U;
+	}
+	uint32_t bit = s->StartBit;
+	for (uint32_t i = 1; i < s->Length; i++) {
+		bit = (bit % 8U == 0U) ? bit + 15U : bit - 1U;
+	}
+	return bit / 8U;
+}
+
+static void DBC_PARSE(FILE *in) {
+	char line[1024];
+	unsigned lineNo = 0;
+	DBC_MessageTypeDef_t *msg = NULL;
+
+	while (fgets(line, sizeof(line), in) != NULL) {
+		lineNo++;
+		const char *p = DBC_SKIP_SPACE(line);
+
+		if (strncmp(p, "BO_ ", 4) == 0) {
+			unsigned long id;
+			unsigned len;
+			char name[DBC_MAX_NAME];
+			if (sscanf(p, "BO_ %lu %63[^: ] : %u", &id, name, &len) != 3) {
+				DBC_FAIL("bad message", p, lineNo);
+			}
+			if (dbcMessageCount == DBC_MAX_MESSAGES) {
+				DBC_FAIL("too many messages", name, lineNo);
+			}
+			/* Vector's pseudo message for unassigned signals */
+			if (strcmp(name, "VECTOR__INDEPENDENT_SIG_MSG") == 0) {
+				msg = NULL;
+				continue;
+			}
+			if (len == 0 || len > DBC_FRAME_WORDS * 4U) {
+				DBC_FAIL("bad payload length", name, lineNo);
+			}
+			msg = &dbcMessages[dbcMessageCount++];
+			memset(msg, 0, sizeof(*msg));
+			strcpy(msg->Name, name);
+			msg->Extended = (id & DBC_EXTENDED_FLAG) != 0;
+			msg->Id = (uint32_t) (id & ~DBC_EXTENDED_FLAG);
+			msg->Length = len;
+			continue;
+		}
+
+		if (strncmp(p, "SG_ ", 4) == 0) {
+			if (msg == NULL) {
+				continue;
+			}
+			DBC_SignalTypeDef_t s;
+			char name[DBC_MAX_NAME];
+			char order, sign;
+			const char *colon = strchr(p, ':');
+			memset(&s, 0, sizeof(s));
+			if (colon == NULL || sscanf(p, "SG_ %63s", name) != 1
+					|| sscanf(colon + 1, " %u|%u@%c%c (%31[^,],%31[^)])",
+							&s.StartBit, &s.Length, &order, &sign,
+							s.Factor, s.Offset) != 6) {
+				DBC_FAIL("bad signal", p, lineNo);
+			}
+			if (msg->SignalCount == DBC_MAX_SIGNALS) {
+				DBC_FAIL("too many signals", name, lineNo);
+			}
+			strcpy(s.Name, name);
+			s.Intel = (order == '1');
+			s.Signed = (sign == '-');
+			if (s.Length == 0 || s.Length > 64U) {
+				DBC_FAIL("bad signal length", name, lineNo);
+			}
+			if (DBC_LAYOUT(&s) != 0) {
+				DBC_FAIL("signal spans more than 64 bits of payload", name,
+						lineNo);
+			}
+			if (DBC_LAST_BYTE(&s) >= msg->Length
+					|| (!s.Intel && s.StartBit / 8U >= msg->Length)) {
+				DBC_FAIL("signal outside the payload", name, lineNo);
+			}
+			msg->Signals[msg->SignalCount++] = s;
+		}
+	}
+}
+
+static const char* DBC_RAW_TYPE(const DBC_SignalTypeDef_t *s) {
+	static const char *const types[2][4] = {
+		{ "uint8_t", "uint16_t", "uint32_t", "uint64_t" },
+		{ "int8_t", "int16_t", "int32_t", "int64_t" } };
+	uint32_t size = (s->Length <= 8U) ? 0 : (s->Length <= 16U) ? 1 :
+					(s->Length <= 32U) ? 2 : 3;
+	return types[s->Signed][size];
+}
+
+static uint64_t DBC_MASK(uint32_t length) {
+	return (length >= 64U) ? ~0ULL : ((1ULL << length) - 1U);
+}
+
+/**
+ * @brief  Expression for the raw value of a signal, read from frame 'f'
+ */
+static void DBC_EMIT_READ(FILE *out, const DBC_SignalTypeDef_t *s) {
+	const char *word = s->Intel ? "f->data[%u]" : "DBC_REV32(f->data[%u])";
+	char src[64];
+
+	if (s->Access == DBC_ACCESS_WORD) {
+		snprintf(src, sizeof(src), word, s->Word);
+		if (s->Signed) {
+			/* Left align, then arithmetic shift right: SBFX */
+			fprintf(out, "(%s) ((int32_t) (%s << %uU) >> %uU)",
+					DBC_RAW_TYPE(s), src, 32U - s->Shift - s->Length,
+					32U - s->Length);
+		} else if (s->Shift + s->Length == 32U) {
+			fprintf(out, "(%s) (%s >> %uU)", DBC_RAW_TYPE(s), src, s->Shift);
+		} else {
+			fprintf(out, "(%s) ((%s >> %uU) & 0x%llXU)", DBC_RAW_TYPE(s), src,
+					s->Shift, (unsigned long long) DBC_MASK(s->Length));
+		}
+		return;
+	}
+
+	snprintf(src, sizeof(src), s->Intel ? "DBC_LE64(f, %u)" : "DBC_BE64(f, %u)",
+			s->Word);
+	if (s->Signed) {
+		fprintf(out, "(%s) ((int64_t) (%s << %uU) >> %uU)", DBC_RAW_TYPE(s),
+				src, 64U - s->Shift - s->Length, 64U - s->Length);
+	} else {
+		fprintf(out, "(%s) ((%s >> %uU) & 0x%llXULL)", DBC_RAW_TYPE(s), src,
+				s->Shift, (unsigned long long) DBC_MASK(s->Length));
+	}
+}
+
+/**
+ * @brief  Statements OR-ing the raw value of a signal into the word registers
+ *         le<k> (Intel) or be<k> (Motorola, byte reversed before the store)
+ */
+static void DBC_EMIT_WRITE(FILE *out, const DBC_SignalTypeDef_t *s,
+		uint8_t *leUsed, uint8_t *beUsed) {
+	const char *reg = s->Intel ? "le" : "be";
+	uint8_t *used = s->Intel ? leUsed : beUsed;
+
+	if (s->Access == DBC_ACCESS_WORD) {
+		used[s->Word] = 1;
+		fprintf(out, "\t%s%u |= ((uint32_t) m->%s & 0x%llXU) << %uU;\n", reg,
+				s->Word, s->Name, (unsigned long long) DBC_MASK(s->Length),
+				s->Shift);
+		return;
+	}
+
+	/* 64-bit value: Intel is word k + 1 : word k, Motorola is k : k + 1 */
+	uint32_t hi = s->Intel ? s->Word + 1U : s->Word;
+	uint32_t lo = s->Intel ? s->Word : s->Word + 1U;
+	used[hi] = 1;
+	used[lo] = 1;
+	fprintf(out, "\t{\n\t\tuint64_t v = ((uint64_t) m->%s & 0x%llXULL) << %uU;\n",
+			s->Name, (unsigned long long) DBC_MASK(s->Length), s->Shift);
+	fprintf(out, "\t\t%s%u |= (uint32_t) v;\n", reg, lo);
+	fprintf(out, "\t\t%s%u |= (uint32_t) (v >> 32);\n\t}\n", reg, hi);
+}
+
+static void DBC_EMIT_MESSAGE(FILE *out, const DBC_MessageTypeDef_t *msg) {
+	char name[DBC_MAX_NAME];
+	char sig[DBC_MAX_NAME];
+	uint32_t words = (msg->Length + 3U) / 4U;
+	uint8_t leUsed[DBC_FRAME_WORDS] = { 0 };
+	uint8_t beUsed[DBC_FRAME_WORDS] = { 0 };
+
+	DBC_UPPER(name, msg->Name, sizeof(name));
+	fprintf(out, "/***** %s *****/\n", msg->Name);
+	fprintf(out, "#define %s_%s_ID %*s0x%XU\n", dbcPrefix, name,
+			(int) (24 - strlen(name)) > 0 ? (int) (24 - strlen(name)) : 1, "",
+			msg->Id);
+	fprintf(out, "#define %s_%s_EXTENDED %*s%u\n", dbcPrefix, name,
+			(int) (18 - strlen(name)) > 0 ? (int) (18 - strlen(name)) : 1, "",
+			msg->Extended);
+	fprintf(out, "#define %s_%s_LEN %*s%uU  // Payload bytes\n", dbcPrefix,
+			name, (int) (23 - strlen(name)) > 0 ? (int) (23 - strlen(name)) : 1,
+			"", msg->Length);
+	for (uint32_t i = 0; i < msg->SignalCount; i++) {
+		const DBC_SignalTypeDef_t *s = &msg->Signals[i];
+		DBC_UPPER(sig, s->Name, sizeof(sig));
+		fprintf(out, "#define %s_%s_%s_FACTOR (%s)\n", dbcPrefix, name, sig,
+				s->Factor);
+		fprintf(out, "#define %s_%s_%s_OFFSET (%s)\n", dbcPrefix, name, sig,
+				s->Offset);
+	}
+	fprintf(out, "\n");
+
+	/* Raw value structure */
+	fprintf(out, "typedef struct {\n");
+	for (uint32_t i = 0; i < msg->SignalCount; i++) {
+		const DBC_SignalTypeDef_t *s = &msg->Signals[i];
+		fprintf(out, "\t%s %s; %*s// %u|%u@%c%c\n", DBC_RAW_TYPE(s), s->Name,
+				(int) (22 - strlen(s->Name) - strlen(DBC_RAW_TYPE(s))) > 0 ?
+						(int) (22 - strlen(s->Name) - strlen(DBC_RAW_TYPE(s))) :
+						0, "", s->StartBit, s->Length, s->Intel ? '1' : '0',
+				s->Signed ? '-' : '+');
+	}
+	fprintf(out, "} %s_%s_TypeDef_t;\n\n", dbcPrefix, name);
+
+	/* Unpack */
+	fprintf(out, "FDCAN_INLINE void %s_%s_UNPACK(%s_%s_TypeDef_t *m,\n"
+			"\t\tconst FDCAN_FrameTypeDef_t *f) {\n", dbcPrefix, name,
+			dbcPrefix, name);
+	for (uint32_t i = 0; i < msg->SignalCount; i++) {
+		fprintf(out, "\tm->%s = ", msg->Signals[i].Name);
+		DBC_EMIT_READ(out, &msg->Signals[i]);
+		fprintf(out, ";\n");
+	}
+	fprintf(out, "}\n\n");
+
+	/* Pack: collect the word registers first, so each word is stored once */
+	char body[16384];
+	FILE *mem = fmemopen(body, sizeof(body), "w");
+	for (uint32_t i = 0; i < msg->SignalCount; i++) {
+		DBC_EMIT_WRITE(mem, &msg->Signals[i], leUsed, beUsed);
+	}
+	fclose(mem);
+
+	fprintf(out, "FDCAN_INLINE void %s_%s_PACK(FDCAN_FrameTypeDef_t *f,\n"
+			"\t\tconst %s_%s_TypeDef_t *m) {\n", dbcPrefix, name, dbcPrefix,
+			name);
+	for (uint32_t k = 0; k < words; k++) {
+		if (leUsed[k]) {
+			fprintf(out, "\tuint32_t le%u = 0;\n", k);
+		}
+		if (beUsed[k]) {
+			fprintf(out, "\tuint32_t be%u = 0;\n", k);
+		}
+	}
+	fputs(body, out);
+	fprintf(out, "\tFDCAN_FRAME_SET_ID(f, %s_%s_ID, %s_%s_EXTENDED);\n",
+			dbcPrefix, name, dbcPrefix, name);
+	fprintf(out, "\tFDCAN_FRAME_SET_CONTROL(f, FDCAN_BYTES_TO_DLC(%s_%s_LEN), "
+			"%u, 0);\n", dbcPrefix, name, msg->Length > 8U);
+	for (uint32_t k = 0; k < words; k++) {
+		fprintf(out, "\tf->data[%u] = ", k);
+		if (leUsed[k] && beUsed[k]) {
+			fprintf(out, "le%u | DBC_REV32(be%u);\n", k, k);
+		} else if (leUsed[k]) {
+			fprintf(out, "le%u;\n", k);
+		} else if (beUsed[k]) {
+			fprintf(out, "DBC_REV32(be%u);\n", k);
+		} else {
+			fprintf(out, "0;\n");
+		}
+	}
+	fprintf(out, "}\n\n");
+}
+
+/**
+ * @brief  Signal descriptors, for generic tools that walk every signal
+ */
+static void DBC_EMIT_TABLE(FILE *out) {
+	char name[DBC_MAX_NAME];
+	uint32_t total = 0;
+
+	fprintf(out, "#ifdef %s_SIGNAL_TABLE\n#include <stddef.h>\n\n", dbcPrefix);
+	fprintf(out, "typedef struct {\n"
+			"\tuint32_t Id;\n"
+			"\tuint16_t StartBit;\n"
+			"\tuint8_t Length;\n"
+			"\tuint8_t Intel;\n"
+			"\tuint8_t Signed;\n"
+			"\tuint8_t Size;                  // Bytes of the raw field\n"
+			"\tuint16_t Offset;               // offsetof the raw field\n"
+			"} %s_SignalInfoTypeDef_t;\n\n", dbcPrefix);
+	fprintf(out, "static const %s_SignalInfoTypeDef_t %sSignalTable[] = {\n",
+			dbcPrefix, dbcPrefix);
+	for (uint32_t i = 0; i < dbcMessageCount; i++) {
+		const DBC_MessageTypeDef_t *msg = &dbcMessages[i];
+		DBC_UPPER(name, msg->Name, sizeof(name));
+		for (uint32_t j = 0; j < msg->SignalCount; j++) {
+			const DBC_SignalTypeDef_t *s = &msg->Signals[j];
+			fprintf(out, "\t{ %s_%s_ID, %u, %u, %u, %u, sizeof(%s), "
+					"offsetof(%s_%s_TypeDef_t, %s) },\n", dbcPrefix, name,
+					s->StartBit, s->Length, s->Intel, s->Signed,
+					DBC_RAW_TYPE(s), dbcPrefix, name, s->Name);
+			total++;
+		}
+	}
+	fprintf(out, "};\n\n#define %s_SIGNAL_COUNT %uU\n#endif /* %s_SIGNAL_TABLE */"
+			"\n\n", dbcPrefix, total, dbcPrefix);
+}
+
+int main(int argc, char **argv) {
+	char guard[DBC_MAX_NAME];
+
+	if (argc < 3) {
+		fprintf(stderr, "usage: %s input.dbc output.h [PREFIX]\n", argv[0]);
+		return 2;
+	}
+	if (argc > 3) {
+		dbcPrefix = argv[3];
+	}
+
+	FILE *in = fopen(argv[1], "r");
+	if (in == NULL) {
+		perror(argv[1]);
+		return 1;
+	}
+	DBC_PARSE(in);
+	fclose(in);
+
+	FILE *out = fopen(argv[2], "w");
+	if (out == NULL) {
+		perror(argv[2]);
+		return 1;
+	}
+	const char *base = strrchr(argv[2], '/');
+	base = (base != NULL) ? base + 1 : argv[2];
+	DBC_UPPER(guard, base, sizeof(guard));
+	for (char *c = guard; *c != '\0'; c++) {
+		if (!isalnum((unsigned char) *c)) {
+			*c = '_';
+		}
+	}
+
+	fprintf(out, "/**\n"
+			" ******************************************************************************\n"
+			" * @file           : %s\n"
+			" * @brief          : Signal pack/unpack for %s.\n"
+			" *\n"
+			" * Generated by Tools/dbc_gen.c, do not edit. Regenerate with:\n"
+			" *   ./dbc_gen %s %s %s\n"
+			" ******************************************************************************\n"
+			" */\n\n", base, argv[1], argv[1], argv[2], dbcPrefix);
+	fprintf(out, "#ifndef __%s\n#define __%s\n\n", guard, guard);
+	fprintf(out, "#include <stdint.h>\n#include \"fdcan_frame.h\"\n\n");
+	fprintf(out, "#ifdef __cplusplus\nextern \"C\" {\n#endif\n\n");
+	fprintf(out, "#ifndef DBC_REV32\n"
+			"#define DBC_REV32(x) __builtin_bswap32(x) // REV on Cortex-M33\n"
+			"#endif\n"
+			"#ifndef DBC_LE64\n"
+			"#define DBC_LE64(f, k) (((uint64_t) (f)->data[(k) + 1] << 32) "
+			"| (f)->data[k])\n"
+			"#define DBC_BE64(f, k) (((uint64_t) DBC_REV32((f)->data[k]) << 32) "
+			"| DBC_REV32((f)->data[(k) + 1]))\n"
+			"#endif\n\n");
+
+	for (uint32_t i = 0; i < dbcMessageCount; i++) {
+		DBC_EMIT_MESSAGE(out, &dbcMessages[i]);
+	}
+	DBC_EMIT_TABLE(out);
+
+	fprintf(out, "#ifdef __cplusplus\n}\n#endif\n\n#endif /* __%s */\n", guard);
+	fclose(out);
+
+	printf("%u messages written to %s\n", dbcMessageCount, argv[2]);
+	return 0;
+}
@@ -0,0 +1,352 @@
+/**
+ ******************************************************************************
+ * @file           : e2e_bench.c
+ * @brief          : Correctness and cost of the E2E profiles of Src/e2e.c,
+ *                   bit by bit, with slice tables and through a model of the
+ *                   STM32H5 CRC unit.
+ *
+ * The CRC unit model follows the reference manual: the register is shifted
+ * MSB first, POLYSIZE selects 7, 8, 16 or 32 bits, REV_IN by byte reverses
+ * the bits of every input byte, REV_OUT reverses the register on read and
+ * RESET loads INIT. E2E_CRC_UNIT below drives it the way E2E_HW_CRC in
+ * main.c drives the real one, so the register handling of that engine is
+ * checked here even though its timing can only be taken on the target
+ * (E2E_BENCH = 1 in main.c).
+ *
+ * Checks: the catalogue check value of every CRC on every engine; random
+ * lengths, split points and start registers agreeing with the bitwise
+ * reference; every profile round-trips, reports the counter cases, and
+ * flags every single-bit error, a wrong Data ID and a wrong length.
+ *
+ * Build and run from the repository root, once per slice count to compare:
+ *   gcc -O2 -IInc -DE2E_SLICES=4 -o e2e_bench Tools/e2e_bench.c Src/e2e.c
+ *   ./e2e_bench
+ ******************************************************************************
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "e2e.h"
+
+#define BENCH_FRAMES                2000000U
+#define RANDOM_CASES                20000U
+
+/***** CRC Unit Model *****/
+typedef struct {
+	uint8_t PolySize;              // CR.POLYSIZE: 0 = 32, 1 = 16, 2 = 8, 3 = 7 bits
+	uint8_t RevIn;                 // CR.REV_IN: 1 = by byte
+	uint8_t RevOut;                // CR.REV_OUT
+	uint32_t Pol;
+	uint32_t Init;
+	uint32_t Reg;
+} CrcUnit_t;
+
+static CrcUnit_t crcUnit;
+
+static const uint8_t unitWidth[] = { 32U, 16U, 8U, 7U };
+
+static uint32_t REVERSE(uint32_t x, uint8_t width) {
+	uint32_t r = 0;
+	for (uint8_t i = 0; i < width; i++) {
+		r = (r << 1) | ((x >> i) & 1U);
+	}
+	return r;
+}
+
+static uint32_t UNIT_MASK(void) {
+	uint8_t w = unitWidth[crcUnit.PolySize];
+	return (w == 32U) ? 0xFFFFFFFFU : ((1UL << w) - 1U);
+}
+
+static void UNIT_RESET(void) {
+	crcUnit.Reg = crcUnit.Init & UNIT_MASK();
+}
+
+/* Shift 'bits' input bits into the register, MSB first */
+static void UNIT_SHIFT(uint32_t in, uint8_t bits) {
+	uint8_t w = unitWidth[crcUnit.PolySize];
+	for (int b = bits - 1; b >= 0; b--) {
+		uint32_t top = (crcUnit.Reg >> (w - 1U)) & 1U;
+		crcUnit.Reg = (crcUnit.Reg << 1) & UNIT_MASK();
+		if (top ^ ((in >> b) & 1U)) {
+			crcUnit.Reg ^= crcUnit.Pol & UNIT_MASK();
+		}
+	}
+}
+
+static void UNIT_WRITE32(uint32_t v) {
+	if (crcUnit.RevIn == 1U) {
+		uint32_t r = 0;
+		for (uint8_t k = 0; k < 4U; k++) {
+			r |= REVERSE((v >> (8U * k)) & 0xFFU, 8U) << (8U * k);
+		}
+		v = r;
+	}
+	UNIT_SHIFT(v, 32U);
+}
+
+static void UNIT_WRITE8(uint8_t v) {
+	UNIT_SHIFT(crcUnit.RevIn == 1U ? REVERSE(v, 8U) : v, 8U);
+}
+
+static uint32_t UNIT_READ(void) {
+	return crcUnit.RevOut ? REVERSE(crcUnit.Reg, 32U) : crcUnit.Reg;
+}
+
+static uint32_t BYTE_SWAP(uint32_t x) {
+	return (x >> 24) | ((x >> 8) & 0xFF00U) | ((x << 8) & 0xFF0000U) | (x << 24);
+}
+
+/* The sequence of E2E_HW_CRC in main.c, on the model */
+static uint32_t E2E_CRC_UNIT(void *ctx, uint8_t type, uint32_t reg,
+		const uint8_t *pData, uint32_t length) {
+	const E2E_CrcParamTypeDef_t *c = &E2E_CRC_PARAMS[type];
+	(void) ctx;
+
+	crcUnit.PolySize = (c->Width == 32U) ? 0U : (c->Width == 16U) ? 1U : 2U;
+	crcUnit.RevIn = c->Reflected ? 1U : 0U;
+	crcUnit.RevOut = c->Reflected;
+	crcUnit.Pol = c->Poly;
+	crcUnit.Init = c->Reflected ? REVERSE(reg, 32U) : reg;
+	UNIT_RESET();
+	uint32_t i = 0;
+	for (; i + 4U <= length; i += 4U) {
+		uint32_t w;
+		memcpy(&w, &pData[i], 4U);   // Little-endian load, as on the target
+		UNIT_WRITE32(BYTE_SWAP(w));
+	}
+	for (; i < length; i++) {
+		UNIT_WRITE8(pData[i]);
+	}
+	return UNIT_READ();
+}
+
+/***** Helpers *****/
+static E2E_CrcTablesTypeDef_t tables;
+
+static uint64_t NOW_NS(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000U + (uint64_t) ts.tv_nsec;
+}
+
+static uint32_t rngState = 0x2545F491U;
+
+static uint32_t RANDOM(void) {
+	rngState ^= rngState << 13;
+	rngState ^= rngState >> 17;
+	rngState ^= rngState << 5;
+	return rngState;
+}
+
+static const char *engineName[] = { "bitwise", "tables", "CRC unit" };
+static const char *crcName[] = { "CRC-8/SAE-J1850", "CRC-16/CCITT-FALSE",
+		"CRC-32/AUTOSAR" };
+static const char *profileName[] = { "P11", "P5", "P4" };
+
+static void SET_ENGINE(E2E_HandleTypeDef_t *h, uint8_t engine) {
+	h->Engine = (engine == 2U) ? E2E_CRC_UNIT : NULL;
+	h->Ctx = NULL;
+	h->Tables = (engine == 1U) ? &tables : NULL;
+}
+
+/* Channel of a profile: CRC at byte 3 for P11, at byte 0 otherwise */
+static void MAKE_CHANNEL(E2E_ChannelTypeDef_t *ch, uint8_t profile) {
+	memset(ch, 0, sizeof(*ch));
+	ch->Profile = profile;
+	ch->DataId = (profile == E2E_P4) ? 0x0A0B0C0DU : 0x0300U;
+	ch->Offset = (profile == E2E_P11) ? 3U : 0U;
+	ch->CounterBit = 0;
+	ch->MaxDeltaCounter = 3U;
+	E2E_CHANNEL_INIT(ch);
+}
+
+/***** Checks *****/
+static uint32_t CHECK_VALUES(void) {
+	static const uint8_t check[] = "123456789";
+	uint32_t failures = 0;
+	E2E_HandleTypeDef_t h;
+
+	printf("CRC                  Engine     Check       Expected\n");
+	for (uint8_t type = 0; type < E2E_CRC_COUNT; type++) {
+		for (uint8_t engine = 0; engine < 3U; engine++) {
+			SET_ENGINE(&h, engine);
+			uint32_t crc = E2E_CRC(&h, type, check, 9U);
+			uint8_t ok = crc == E2E_CRC_PARAMS[type].Check;
+			printf("%-20s %-10s 0x%08lX  0x%08lX %s\n", crcName[type],
+					engineName[engine], (unsigned long) crc,
+					(unsigned long) E2E_CRC_PARAMS[type].Check,
+					ok ? "pass" : "FAIL");
+			failures += !ok;
+		}
+	}
+	return failures;
+}
+
+/* Random buffers split in two at a random point, random start register */
+static uint32_t CHECK_RANDOM(void) {
+	uint8_t buf[80];
+	uint32_t failures = 0;
+	E2E_HandleTypeDef_t h[3];
+
+	for (uint8_t engine = 0; engine < 3U; engine++) {
+		SET_ENGINE(&h[engine], engine);
+	}
+	for (uint32_t n = 0; n < RANDOM_CASES; n++) {
+		uint8_t type = (uint8_t) (n % E2E_CRC_COUNT);
+		uint8_t width = E2E_CRC_PARAMS[type].Width;
+		uint32_t mask = (width == 32U) ? 0xFFFFFFFFU : ((1UL << width) - 1U);
+		uint32_t length = RANDOM() % sizeof(buf);
+		uint32_t split = length ? RANDOM() % (length + 1U) : 0;
+		uint32_t start = RANDOM() & mask;
+		for (uint32_t i = 0; i < length; i++) {
+			buf[i] = (uint8_t) RANDOM();
+		}
+
+		uint32_t ref = E2E_CRC_BITWISE(type, start, buf, length);
+		for (uint8_t engine = 1; engine < 3U; engine++) {
+			uint32_t reg = E2E_CRC_UPDATE(&h[engine], type, start, buf, split);
+			reg = E2E_CRC_UPDATE(&h[engine], type, reg, buf + split,
+					length - split);
+			failures += reg != ref;
+		}
+	}
+	printf("Random lengths and splits against bitwise: %s (%lu mismatches)\n",
+			failures ? "FAIL" : "pass", (unsigned long) failures);
+	return failures;
+}
+
+/* Counter cases, single-bit errors, Data ID and length of one profile */
+static uint32_t CHECK_PROFILE(uint8_t profile, uint32_t length) {
+	E2E_HandleTypeDef_t h;
+	E2E_ChannelTypeDef_t tx, rx;
+	uint8_t buf[64], bad[64];
+	uint32_t failures = 0;
+	uint32_t missed = 0;
+
+	SET_ENGINE(&h, 1U);
+	MAKE_CHANNEL(&tx, profile);
+	MAKE_CHANNEL(&rx, profile);
+	for (uint32_t i = 0; i < length; i++) {
+		buf[i] = (uint8_t) RANDOM();
+	}
+
+	// INITIAL, OK, REPEATED, OK_SOME_LOST, WRONG_SEQUENCE
+	failures += E2E_PROTECT(&h, &tx, buf, length) != 0;
+	failures += E2E_CHECK(&h, &rx, buf, length) != E2E_INITIAL;
+	failures += E2E_CHECK(&h, &rx, buf, length) != E2E_REPEATED;
+	for (uint32_t k = 0; k < 40U; k++) {  // Through the counter wrap of P11
+		E2E_PROTECT(&h, &tx, buf, length);
+		failures += E2E_CHECK(&h, &rx, buf, length) != E2E_OK;
+	}
+	E2E_PROTECT(&h, &tx, buf, length);
+	E2E_PROTECT(&h, &tx, buf, length);
+	failures += E2E_CHECK(&h, &rx, buf, length) != E2E_OK_SOME_LOST;
+	for (uint32_t k = 0; k < 4U; k++) {
+		E2E_PROTECT(&h, &tx, buf, length);
+	}
+	failures += E2E_CHECK(&h, &rx, buf, length) != E2E_WRONG_SEQUENCE;
+	E2E_PROTECT(&h, &tx, buf, length);
+	failures += E2E_CHECK(&h, &rx, buf, length) != E2E_OK;
+
+	// Every single-bit error
+	for (uint32_t bit = 0; bit < length * 8U; bit++) {
+		E2E_ChannelTypeDef_t probe = rx;
+		memcpy(bad, buf, length);
+		bad[bit / 8U] ^= (uint8_t) (1U << (bit % 8U));
+		uint8_t s = E2E_CHECK(&h, &probe, bad, length);
+		missed += s != E2E_ERROR;
+	}
+	failures += missed;
+
+	// Wrong Data ID, then a length one byte short
+	E2E_ChannelTypeDef_t probe = rx;
+	probe.DataId ^= 0x0001U;
+	failures += E2E_CHECK(&h, &probe, buf, length) != E2E_ERROR;
+	probe = rx;
+	failures += E2E_CHECK(&h, &probe, buf, length - 1U) != E2E_ERROR;
+
+	// Same protected bytes on every engine
+	uint8_t ref[64];
+	for (uint8_t engine = 0; engine < 3U; engine++) {
+		E2E_HandleTypeDef_t he;
+		E2E_ChannelTypeDef_t fresh;
+		SET_ENGINE(&he, engine);
+		MAKE_CHANNEL(&fresh, profile);
+		memcpy(bad, buf, length);
+		E2E_PROTECT(&he, &fresh, bad, length);
+		if (engine == 0) {
+			memcpy(ref, bad, length);
+		}
+		failures += memcmp(bad, ref, length) != 0;
+	}
+
+	printf("%-4s %2lu bytes  counter cases, %4lu bit flips, Data ID, length: %s"
+			" (%lu missed flips)\n", profileName[profile], (unsigned long) length,
+			(unsigned long) (length * 8U), failures ? "FAIL" : "pass",
+			(unsigned long) missed);
+	return failures;
+}
+
+/***** Timing *****/
+static void BENCH_PROFILE(uint8_t profile, uint32_t length) {
+	uint8_t buf[64];
+	E2E_ChannelTypeDef_t ch;
+	E2E_HandleTypeDef_t h;
+
+	for (uint32_t i = 0; i < length; i++) {
+		buf[i] = (uint8_t) RANDOM();
+	}
+	for (uint8_t engine = 0; engine < 2U; engine++) {
+		SET_ENGINE(&h, engine);
+		MAKE_CHANNEL(&ch, profile);
+		uint32_t frames = (engine == 0) ? BENCH_FRAMES / 8U : BENCH_FRAMES;
+		uint64_t start = NOW_NS();
+		for (uint32_t k = 0; k < frames; k++) {
+			E2E_PROTECT(&h, &ch, buf, length);
+		}
+		uint64_t protectNs = NOW_NS() - start;
+
+		E2E_ChannelTypeDef_t rx;
+		MAKE_CHANNEL(&rx, profile);
+		uint32_t ok = 0;
+		start = NOW_NS();
+		for (uint32_t k = 0; k < frames; k++) {
+			ok += E2E_CHECK(&h, &rx, buf, length) != E2E_ERROR;
+		}
+		uint64_t checkNs = NOW_NS() - start;
+		printf("%-4s %2lu      %-8s %10.1f %10.1f %10.2f\n", profileName[profile],
+				(unsigned long) length, engineName[engine],
+				(double) protectNs / frames, (double) checkNs / frames,
+				(double) checkNs / frames / length);
+		if (ok != frames) {
+			printf("  unexpected E2E_ERROR on an unchanged frame\n");
+		}
+	}
+}
+
+int main(void) {
+	uint32_t failures = 0;
+
+	E2E_TABLES_INIT(&tables);
+	printf("E2E_SLICES %u, %lu bytes of tables\n\n", E2E_SLICES,
+			(unsigned long) sizeof(tables));
+	failures += CHECK_VALUES();
+	printf("\n");
+	failures += CHECK_RANDOM();
+	failures += CHECK_PROFILE(E2E_P11, 8U);
+	failures += CHECK_PROFILE(E2E_P5, 8U);
+	failures += CHECK_PROFILE(E2E_P5, 64U);
+	failures += CHECK_PROFILE(E2E_P4, 16U);
+	failures += CHECK_PROFILE(E2E_P4, 64U);
+
+	printf("\nHost cost per frame (the CRC unit is timed on the target)\n");
+	printf("Prof Bytes   Engine   Protect ns   Check ns  ns/byte\n");
+	BENCH_PROFILE(E2E_P11, 8U);
+	BENCH_PROFILE(E2E_P5, 8U);
+	BENCH_PROFILE(E2E_P5, 64U);
+	BENCH_PROFILE(E2E_P4, 16U);
+	BENCH_PROFILE(E2E_P4, 64U);
+	return failures ? 1 : 0;
+}
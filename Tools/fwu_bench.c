@@ -0,0 +1,495 @@
+/**
+ ******************************************************************************
+ * @file           : fwu_bench.c
+ * @brief          : Host test of the streaming firmware update (Src/fw_update.c)
+ *                   behind the UDS server, with a simulated flash.
+ *
+ * The tester downloads an image with RequestDownload/TransferData/
+ * RequestTransferExit and checks its CRC-32 with RoutineControl FF02.
+ * Bus: as in uds_bench.c. Flash: one operation at a time, a sector erase
+ * takes SIM_ERASE_US and a quad-word SIM_QUAD_WORD_US, a quad-word can only
+ * be programmed once after an erase (else the operation fails, as PGSERR
+ * would). Completion calls FWU_FLASH_DONE, like the flash interrupt on
+ * target, and so does the server side: TX FIFO empty and flash done drive
+ * the transfer, the main loop only runs every SIM_MAIN_LOOP_US.
+ *
+ * The flash timings are placeholders, not datasheet figures: the "slow
+ * flash" runs take them four times over to show where overlap stops
+ * hiding the flash.
+ *
+ * Build and run from the repository root:
+ *   gcc -O2 -IInc -o fwu_bench Tools/fwu_bench.c Src/fw_update.c Src/uds.c Src/isotp.c Src/can_stats.c
+ *   ./fwu_bench
+ ******************************************************************************
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "fw_update.h"
+#include "uds.h"
+#include "can_stats.h"
+
+#define SIM_TX_FIFO                 3U
+#define SIM_MAIN_LOOP_US            200000U // Two LED half periods on target
+#define SIM_TESTER_ID               0x7E0U
+#define SIM_SERVER_ID               0x7E8U
+#define SIM_REGION_ADDRESS          0x08010000U // Inactive bank
+#define SIM_REGION_BYTES            (64U * 1024U)
+#define SIM_SECTOR_BYTES            8192U
+#define SIM_IMAGE_BYTES             (60U * 1024U + 100U) // Odd tail on purpose
+#define SIM_ERASE_US                2000U // Placeholder timings, see above
+#define SIM_QUAD_WORD_US            60U
+#define SIM_NEVER                   1e18
+
+/***** Simulated Bus *****/
+typedef struct {
+	FDCAN_FrameTypeDef_t Fifo[SIM_TX_FIFO];
+	uint32_t Count;
+} Node_t;
+
+static Node_t tester, server;
+static Node_t *busOwner;
+static double simUs, busFreeUs, nextLoopUs;
+static uint32_t simNominalKbps, simDataKbps;
+
+/***** Simulated Flash *****/
+static uint8_t flashMem[SIM_REGION_BYTES];
+static uint8_t flashWritten[SIM_REGION_BYTES / FWU_QUAD_WORD];
+static uint8_t flashOp;
+static uint32_t flashAddress;
+static uint32_t flashData[4];
+static double flashDoneUs = SIM_NEVER;
+static double flashBusyUs;             // Total time the flash worked
+static uint32_t flashSlowdown = 1;
+static uint32_t flashFailAt;           // Quad-word that fails, 0 = none
+static uint32_t flashQuadWords;
+
+/***** Server Side *****/
+static UDS_HandleTypeDef_t uds;
+static FWU_HandleTypeDef_t fwu;
+static uint8_t useFwu;                 // 0: sink drops the data (bus only)
+
+static uint32_t SIM_TICKS(void) {
+	return (uint32_t) simUs;
+}
+
+static uint8_t SIM_SEND(void *ctx, const FDCAN_FrameTypeDef_t *pFrame) {
+	Node_t *n = ctx;
+	if (n->Count == SIM_TX_FIFO) {
+		return 0;
+	}
+	n->Fifo[n->Count++] = *pFrame;
+	return 1;
+}
+
+static uint8_t SIM_ERASE(void *ctx, uint32_t address) {
+	(void) ctx;
+	flashOp = FWU_OP_ERASE;
+	flashAddress = address;
+	flashDoneUs = simUs + SIM_ERASE_US * flashSlowdown;
+	flashBusyUs += SIM_ERASE_US * flashSlowdown;
+	return 0;
+}
+
+static uint8_t SIM_PROGRAM(void *ctx, uint32_t address,
+		const uint32_t *pQuadWord) {
+	(void) ctx;
+	flashOp = FWU_OP_PROGRAM;
+	flashAddress = address;
+	memcpy(flashData, pQuadWord, sizeof(flashData));
+	flashDoneUs = simUs + SIM_QUAD_WORD_US * flashSlowdown;
+	flashBusyUs += SIM_QUAD_WORD_US * flashSlowdown;
+	return 0;
+}
+
+/* End of the flash operation: apply it, then the "flash interrupt" */
+static void SIM_FLASH_DONE(void) {
+	uint32_t at = flashAddress - SIM_REGION_ADDRESS;
+	uint8_t failed = 0;
+
+	flashDoneUs = SIM_NEVER;
+	if (flashOp == FWU_OP_ERASE) {
+		memset(&flashMem[at], 0xFF, SIM_SECTOR_BYTES);
+		memset(&flashWritten[at / FWU_QUAD_WORD], 0,
+				SIM_SECTOR_BYTES / FWU_QUAD_WORD);
+	} else {
+		flashQuadWords++;
+		failed = flashWritten[at / FWU_QUAD_WORD]
+				|| (flashFailAt != 0 && flashQuadWords == flashFailAt);
+		if (!failed) {
+			memcpy(&flashMem[at], flashData, FWU_QUAD_WORD);
+			flashWritten[at / FWU_QUAD_WORD] = 1;
+		}
+	}
+	flashOp = FWU_OP_NONE;
+	FWU_FLASH_DONE(&fwu, failed);
+	if (uds.Busy) {
+		UDS_POLL(&uds);                // A waiting block or exit can answer now
+	}
+}
+
+/***** Download Sink, as in main.c *****/
+static uint8_t FWU_NRC(uint8_t result) {
+	switch (result) {
+	case FWU_OK:
+		return 0;
+	case FWU_BUSY:
+		return UDS_NRC_RESPONSE_PENDING;
+	case FWU_ERR_RANGE:
+		return UDS_NRC_REQUEST_OUT_OF_RANGE;
+	case FWU_ERR_FLASH:
+		return UDS_NRC_GENERAL_PROGRAMMING_FAILURE;
+	default:
+		return UDS_NRC_TRANSFER_DATA_SUSPENDED;
+	}
+}
+
+static uint8_t SINK_START(void *ctx, uint32_t address, uint32_t size) {
+	(void) ctx;
+	if (!useFwu) {
+		return 0;
+	}
+	uint8_t result = FWU_BEGIN(&fwu, address, size);
+	return result == FWU_BUSY ? UDS_NRC_CONDITIONS_NOT_CORRECT : FWU_NRC(result);
+}
+
+static uint8_t SINK_WRITE(void *ctx, uint32_t offset, const uint8_t *pData,
+		uint32_t length) {
+	(void) ctx;
+	return useFwu ? FWU_NRC(FWU_WRITE(&fwu, offset, pData, length)) : 0;
+}
+
+static uint8_t SINK_BLOCK_END(void *ctx) {
+	(void) ctx;
+	return useFwu ? FWU_NRC(FWU_BLOCK_END(&fwu)) : 0;
+}
+
+static uint8_t SINK_EXIT(void *ctx) {
+	(void) ctx;
+	return useFwu ? FWU_NRC(FWU_FINISH(&fwu)) : 0;
+}
+
+static void SINK_ABORT(void *ctx) {
+	(void) ctx;
+	FWU_ABORT(&fwu);
+}
+
+static const UDS_DownloadSinkTypeDef_t sink = {
+	SINK_START, SINK_WRITE, SINK_BLOCK_END, SINK_EXIT, SINK_ABORT
+};
+
+/* FF02: expected CRC-32 in, 0x00 = image valid, 0x01 = not */
+static uint8_t ROUTINE_CHECK(void *ctx, uint16_t rid, const uint8_t *pIn,
+		uint32_t inLength, uint8_t *pOut, uint32_t *pOutLength) {
+	(void) ctx;
+	(void) rid;
+	if (inLength != 4) {
+		return UDS_NRC_INCORRECT_LENGTH;
+	}
+	uint32_t expected = ((uint32_t) pIn[0] << 24) | ((uint32_t) pIn[1] << 16)
+			| ((uint32_t) pIn[2] << 8) | pIn[3];
+	pOut[0] = (fwu.State == FWU_STATE_DONE && fwu.Crc == expected) ? 0 : 1;
+	*pOutLength = 1;
+	return 0;
+}
+
+static const UDS_RoutineTypeDef_t routines[] = {
+	{ 0xFF02, UDS_IN(UDS_SESSION_PROGRAMMING), ROUTINE_CHECK, NULL, NULL },
+};
+
+/***** Tester Side *****/
+static ISOTP_HandleTypeDef_t isoTester;
+static uint8_t answer[UDS_MAX_RESPONSE];
+static uint32_t answerLength;
+static uint8_t answerReady;
+static uint32_t pendingSeen;
+
+static void TESTER_RX_DONE(void *ctx, uint32_t length, uint8_t result) {
+	(void) ctx;
+	if (result != ISOTP_OK) {
+		return;
+	}
+	if (length == 3 && answer[0] == UDS_SID_NEGATIVE_RESPONSE
+			&& answer[2] == UDS_NRC_RESPONSE_PENDING) {
+		pendingSeen++;
+		return;
+	}
+	answerLength = length;
+	answerReady = 1;
+}
+
+static double FRAME_US(const FDCAN_FrameTypeDef_t *f) {
+	uint8_t format = !FDCAN_FRAME_IS_FD(f) ? CANSTATS_FMT_CLASSIC
+			: FDCAN_FRAME_IS_BRS(f) ? CANSTATS_FMT_FD_BRS : CANSTATS_FMT_FD;
+	uint32_t dataBits = 0;
+	uint32_t bits = CANSTATS_WIRE_BITS(format, FDCAN_FRAME_IS_EXTENDED(f),
+			FDCAN_FRAME_GET_LEN(f), &dataBits);
+	if (format != CANSTATS_FMT_FD_BRS) {
+		return bits * 1000.0 / simNominalKbps;
+	}
+	return (bits - dataBits) * 1000.0 / simNominalKbps
+			+ dataBits * 1000.0 / simDataKbps;
+}
+
+static void BUS_START(void) {
+	if (busOwner != NULL) {
+		return;
+	}
+	if (tester.Count != 0 && (server.Count == 0
+			|| FDCAN_FRAME_GET_ID(&tester.Fifo[0])
+					< FDCAN_FRAME_GET_ID(&server.Fifo[0]))) {
+		busOwner = &tester;
+	} else if (server.Count != 0) {
+		busOwner = &server;
+	} else {
+		return;
+	}
+	busFreeUs = simUs + FRAME_US(&busOwner->Fifo[0]);
+}
+
+/* Advance to 'until', or until a final answer arrives if 'stop' */
+static void SIM_RUN(double until, uint8_t stop) {
+	for (;;) {
+		BUS_START();
+		double tBus = busOwner != NULL ? busFreeUs : SIM_NEVER;
+		double t = tBus < flashDoneUs ? tBus : flashDoneUs;
+		t = t < nextLoopUs ? t : nextLoopUs;
+		if (t > until) {
+			simUs = until;
+			return;
+		}
+		simUs = t;
+		if (t == tBus) {
+			Node_t *n = busOwner;
+			FDCAN_FrameTypeDef_t f = n->Fifo[0];
+			memmove(&n->Fifo[0], &n->Fifo[1], (n->Count - 1U) * sizeof(f));
+			n->Count--;
+			busOwner = NULL;
+			ISOTP_RX_FRAME(&isoTester, &f);
+			UDS_RX_FRAME(&uds, &f);    // FDCAN RX interrupt
+			if (n == &server && server.Count == 0) {
+				ISOTP_POLL(&uds.IsoTp); // TX FIFO empty interrupt
+			}
+			ISOTP_POLL(&isoTester);
+		} else if (t == flashDoneUs) {
+			SIM_FLASH_DONE();
+		} else {
+			nextLoopUs += SIM_MAIN_LOOP_US;
+			UDS_POLL(&uds);
+		}
+		if (stop && answerReady) {
+			return;
+		}
+	}
+}
+
+static uint8_t REQUEST(const uint8_t *req, uint32_t length) {
+	answerReady = 0;
+	answerLength = 0;
+	ISOTP_SEND(&isoTester, req, length);
+	SIM_RUN(simUs + 10000000.0, 1);
+	return answerReady ? answer[0] : 0;
+}
+
+#define REQ(...) REQUEST((const uint8_t[]) { __VA_ARGS__ }, \
+		sizeof((const uint8_t[]) { __VA_ARGS__ }))
+#define NRC(sid, nrc) (answer[0] == UDS_SID_NEGATIVE_RESPONSE \
+		&& answer[1] == (sid) && answer[2] == (nrc))
+
+static void SETUP(uint8_t txdl, uint32_t nominalKbps, uint32_t dataKbps) {
+	memset(&tester, 0, sizeof(tester));
+	memset(&server, 0, sizeof(server));
+	busOwner = NULL;
+	simUs = 0;
+	nextLoopUs = SIM_MAIN_LOOP_US;
+	simNominalKbps = nominalKbps;
+	simDataKbps = dataKbps;
+	flashOp = FWU_OP_NONE;
+	flashDoneUs = SIM_NEVER;
+	flashBusyUs = 0;
+	flashQuadWords = 0;
+	flashFailAt = 0;
+	for (uint32_t i = 0; i < SIM_REGION_BYTES; i++) {
+		flashMem[i] = (uint8_t) (i * 31U);  // Old content, not erased
+	}
+	memset(flashWritten, 1, sizeof(flashWritten));
+
+	memset(&isoTester, 0, sizeof(isoTester));
+	isoTester.TxId = SIM_TESTER_ID;
+	isoTester.RxId = SIM_SERVER_ID;
+	isoTester.TxDataLength = txdl;
+	isoTester.BitRateSwitch = dataKbps != nominalKbps;
+	isoTester.PadFrames = 1;
+	isoTester.PadByte = 0xCC;
+	isoTester.TicksPerUs = 1;
+	isoTester.GetTicks = SIM_TICKS;
+	isoTester.SendFrame = SIM_SEND;
+	isoTester.Ctx = &tester;
+	isoTester.RxBuffer = answer;
+	isoTester.RxBufferSize = sizeof(answer);
+	isoTester.RxDone = TESTER_RX_DONE;
+	ISOTP_INIT(&isoTester);
+
+	memset(&fwu, 0, sizeof(fwu));
+	fwu.RegionAddress = SIM_REGION_ADDRESS;
+	fwu.RegionSize = SIM_REGION_BYTES;
+	fwu.SectorSize = SIM_SECTOR_BYTES;
+	fwu.RegionData = flashMem;
+	fwu.Erase = SIM_ERASE;
+	fwu.Program = SIM_PROGRAM;
+	FWU_INIT(&fwu);
+
+	memset(&uds, 0, sizeof(uds));
+	uds.IsoTp.TxId = SIM_SERVER_ID;
+	uds.IsoTp.RxId = SIM_TESTER_ID;
+	uds.IsoTp.TxDataLength = txdl;
+	uds.IsoTp.BitRateSwitch = dataKbps != nominalKbps;
+	uds.IsoTp.PadFrames = 1;
+	uds.IsoTp.PadByte = 0xCC;
+	uds.IsoTp.TicksPerUs = 1;
+	uds.IsoTp.GetTicks = SIM_TICKS;
+	uds.SendFrame = SIM_SEND;
+	uds.Ctx = &server;
+	uds.Routines = routines;
+	uds.RoutineCount = 1;
+	uds.Sink = &sink;
+	uds.MaxBlockLength = FWU_BUFFER_BYTES + 2U;
+	UDS_INIT(&uds);
+}
+
+/**
+ * @brief  Download 'size' bytes to 'address' in the largest blocks
+ * @retval Response SID of the exit, or of the first request that failed
+ */
+static uint8_t DOWNLOAD(const uint8_t *data, uint32_t address, uint32_t size) {
+	static uint8_t block[UDS_MAX_BLOCK_LENGTH];
+	if (REQ(0x34, 0x00, 0x44, (uint8_t) (address >> 24),
+			(uint8_t) (address >> 16), (uint8_t) (address >> 8),
+			(uint8_t) address, (uint8_t) (size >> 24), (uint8_t) (size >> 16),
+			(uint8_t) (size >> 8), (uint8_t) size) != 0x74) {
+		return answer[0];
+	}
+	uint32_t maxData = (((uint32_t) answer[2] << 8) | answer[3]) - 2U;
+	uint8_t counter = 1;
+	for (uint32_t at = 0; at < size; counter++) {
+		uint32_t n = size - at < maxData ? size - at : maxData;
+		block[0] = UDS_SID_TRANSFER_DATA;
+		block[1] = counter;
+		memcpy(&block[2], &data[at], n);
+		if (REQUEST(block, n + 2U) != 0x76) {
+			return answer[0];
+		}
+		at += n;
+	}
+	return REQ(0x37);
+}
+
+static uint8_t CHECK_CRC(uint32_t crc) {
+	return REQ(0x31, 0x01, 0xFF, 0x02, (uint8_t) (crc >> 24),
+			(uint8_t) (crc >> 16), (uint8_t) (crc >> 8), (uint8_t) crc) == 0x71
+			&& answer[4] == 0x00;
+}
+
+static uint8_t image[SIM_IMAGE_BYTES];
+
+static uint32_t FUNCTIONAL(void) {
+	uint32_t failures = 0;
+	uint32_t crc = FWU_CRC32(0, image, SIM_IMAGE_BYTES);
+	uint8_t ok;
+
+#define CHECK(cond, what) do { if (!(cond)) { failures++; \
+		printf("  FAIL: %s\n", what); } } while (0)
+
+	SETUP(8, 500, 500);
+	useFwu = 1;
+	CHECK(REQ(0x10, 0x02) == 0x50, "programming session");
+	ok = DOWNLOAD(image, SIM_REGION_ADDRESS, SIM_IMAGE_BYTES) == 0x77
+			&& memcmp(flashMem, image, SIM_IMAGE_BYTES) == 0
+			&& fwu.Crc == crc && fwu.Programmed == SIM_IMAGE_BYTES;
+	CHECK(ok, "image programmed and read back");
+	CHECK(CHECK_CRC(crc), "routine FF02 accepts the right CRC");
+	CHECK(!CHECK_CRC(crc ^ 1U), "routine FF02 refuses a wrong CRC");
+	CHECK(fwu.Erases == (SIM_IMAGE_BYTES + SIM_SECTOR_BYTES - 1U)
+			/ SIM_SECTOR_BYTES, "one erase per sector touched");
+
+	/* Flash failure in the middle: 72, then a clean retry */
+	flashFailAt = flashQuadWords + 700U;
+	ok = DOWNLOAD(image, SIM_REGION_ADDRESS, SIM_IMAGE_BYTES) == 0x7F
+			&& (NRC(0x36, 0x72) || NRC(0x37, 0x72));
+	CHECK(ok, "program failure reported as NRC 0x72");
+	flashFailAt = 0;
+	CHECK(REQ(0x10, 0x02) == 0x50, "session restart drops the download");
+	ok = DOWNLOAD(image, SIM_REGION_ADDRESS, SIM_IMAGE_BYTES) == 0x77
+			&& CHECK_CRC(crc);
+	CHECK(ok, "download after a failure");
+
+	/* Abort in the middle: S3 expires during a pause */
+	ok = REQ(0x34, 0x00, 0x44, 0x08, 0x01, 0x00, 0x00, 0x00, 0x00, 0x10,
+			0x00) == 0x74;
+	uint8_t first[2 + 2048] = { 0x36, 0x01 };
+	ok &= REQUEST(first, sizeof(first)) == 0x76;
+	SIM_RUN(simUs + UDS_S3_MS * 1000.0 + 500000.0, 0);
+	ok &= fwu.State == FWU_STATE_IDLE && uds.Session == UDS_SESSION_DEFAULT;
+	CHECK(ok, "S3 timeout aborts the update");
+
+	CHECK(REQ(0x10, 0x02) == 0x50, "programming session again");
+	CHECK(REQ(0x34, 0x00, 0x44, 0x08, 0x01, 0x00, 0x08, 0x00, 0x00, 0x10,
+			0x00) == 0x7F && NRC(0x34, 0x31), "misaligned address refused");
+	CHECK(REQ(0x34, 0x00, 0x44, 0x08, 0x01, 0x80, 0x00, 0x00, 0x01, 0x00,
+			0x00) == 0x7F && NRC(0x34, 0x31), "image beyond the region refused");
+	CHECK(REQ(0x34, 0x00, 0x44, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10,
+			0x00) == 0x7F && NRC(0x34, 0x31), "running bank refused");
+	return failures;
+}
+
+/**
+ * @brief  Time one download: RequestDownload to the TransferExit answer
+ */
+static double TIMED_DOWNLOAD(uint8_t withFwu, uint8_t *pOk) {
+	useFwu = withFwu;
+	REQ(0x10, 0x02);
+	double start = simUs;
+	*pOk = DOWNLOAD(image, SIM_REGION_ADDRESS, SIM_IMAGE_BYTES) == 0x77
+			&& (!withFwu || memcmp(flashMem, image, SIM_IMAGE_BYTES) == 0);
+	return simUs - start;
+}
+
+static void TIMING(const char *busName, uint8_t txdl, uint32_t nominalKbps,
+		uint32_t dataKbps) {
+	for (flashSlowdown = 1; flashSlowdown <= 4; flashSlowdown += 3) {
+		uint8_t okBus, okFwu;
+		SETUP(txdl, nominalKbps, dataKbps);
+		double busUs = TIMED_DOWNLOAD(0, &okBus);
+		SETUP(txdl, nominalKbps, dataKbps);
+		pendingSeen = 0;
+		double fwuUs = TIMED_DOWNLOAD(1, &okFwu);
+		double flashUs = flashBusyUs;
+		printf("%-18s %-6s %9.1f %9.1f %9.1f %9.1f %6.1f%% %6u %6u %s\n",
+				busName, flashSlowdown == 1 ? "x1" : "x4", busUs / 1000.0,
+				flashUs / 1000.0, (busUs + flashUs) / 1000.0, fwuUs / 1000.0,
+				(fwuUs - busUs) * 100.0 / busUs, fwu.Stalls, pendingSeen,
+				okBus && okFwu ? "ok" : "FAIL");
+	}
+}
+
+int main(void) {
+	for (uint32_t i = 0; i < SIM_IMAGE_BYTES; i++) {
+		image[i] = (uint8_t) (i * 7U + (i >> 9));
+	}
+	printf("Firmware update, %u byte image, %u byte double buffer, "
+			"erase %u us, quad-word %u us\n", SIM_IMAGE_BYTES,
+			FWU_BUFFER_BYTES, SIM_ERASE_US, SIM_QUAD_WORD_US);
+	uint32_t failures = FUNCTIONAL();
+	printf("Functional checks: %s (%u failures)\n\n",
+			failures ? "FAIL" : "pass", failures);
+
+	printf("%-18s %-6s %9s %9s %9s %9s %7s %6s %6s\n", "Bus", "Flash",
+			"bus ms", "flash ms", "seq ms", "update ms", "over", "stalls",
+			"0x78");
+	TIMING("Classic 500k", 8, 500, 500);
+	TIMING("FD 500k/2M", 64, 500, 2000);
+	TIMING("FD 1M/5M", 64, 1000, 5000);
+	printf("seq = bus + flash, receiving first and programming after; "
+			"over = update time beyond the bus alone\n");
+	return failures != 0;
+}
@@ -0,0 +1,431 @@
+/**
+ ******************************************************************************
+ * @file           : onchange_bench.c
+ * @brief          : Bus-load reduction of the send-on-change filter
+ *                   (Src/can_onchange.c) on a recorded trace.
+ *
+ * 1. Deadband signal extraction against the generated unpackers of
+ *    Inc/vehicle_signals.h, Intel and Motorola, on random payloads.
+ * 2. The trace is replayed through the filter with the tables of main.c
+ *    (exact compare only, then with deadbands), checking that every
+ *    suppressed frame is within its deadbands of the last one sent and that
+ *    no identifier stays silent longer than its refresh period.
+ * 3. Bus load of the node's frames before and after, at 500 kbit/s with
+ *    worst-case stuffing, and the cost of CANCHG_FILTER.
+ *
+ * The trace is a candump -L log (as written by Tools/cancap_decode) given on
+ * the command line. Without one, a 60 s drive of the node's own frames is
+ * synthesised: idle, acceleration, cruise with a turn, braking, stop, with
+ * one or two LSB of sensor noise on every analog signal.
+ *
+ * Build and run from the repository root:
+ *   gcc -O2 -IInc -o onchange_bench Tools/onchange_bench.c Src/can_onchange.c Src/can_stats.c
+ *   ./onchange_bench [trace.log]
+ ******************************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "can_onchange.h"
+#include "can_stats.h"
+#include "vehicle_signals.h"
+
+#define TRACE_MAX                   200000U
+#define TRACE_SYNTH_MS              60000U
+#define BUS_KBPS                    500U
+#define REFRESH_MS                  1000U // Heartbeat of the filtered IDs
+#define BENCH_CALLS                 10000000U
+
+/***** Deadband Tables, as in main.c *****/
+static const CANCHG_SignalTypeDef_t engineSignals[] = {
+	{ 0, 16, CANCHG_INTEL, 0, 16 },    // EngineSpeed, 2 rpm
+	{ 24, 10, CANCHG_INTEL, 0, 5 },    // ThrottlePos, 0.5 %
+	{ 34, 12, CANCHG_INTEL, 1, 4 },    // EngineTorque, 2 Nm
+	{ 46, 18, CANCHG_INTEL, 0, 100 },  // FuelRate, 0.1 l/h
+};
+
+static const CANCHG_SignalTypeDef_t brakeSignals[] = {
+	{ 7, 16, CANCHG_MOTOROLA, 0, 10 }, // WheelSpeedFL, 0.1 km/h
+	{ 23, 8, CANCHG_MOTOROLA, 1, 1 },  // YawRate, 0.5 deg/s
+	{ 31, 16, CANCHG_MOTOROLA, 0, 10 }, // WheelSpeedFR
+	{ 47, 16, CANCHG_MOTOROLA, 0, 10 }, // WheelSpeedRL
+};
+
+static CANCHG_EntryTypeDef_t entries[] = {
+	{ .Id = VEH_ENGINEDATA_ID, .RefreshMs = REFRESH_MS,
+		.Signals = engineSignals, .SignalCount = 4 },
+	{ .Id = 0x123, .RefreshMs = REFRESH_MS },
+	{ .Id = VEH_BRAKESTATUS_ID, .RefreshMs = REFRESH_MS,
+		.Signals = brakeSignals, .SignalCount = 4 },
+};                                     // Heartbeat: its counter always changes
+#define ENTRY_COUNT                 (sizeof(entries) / sizeof(entries[0]))
+
+/***** Trace *****/
+typedef struct {
+	uint32_t Ms;
+	FDCAN_FrameTypeDef_t Frame;
+} TraceFrame_t;
+
+static TraceFrame_t trace[TRACE_MAX];
+static uint32_t traceCount;
+static uint32_t traceMs;               // Trace length
+static uint64_t otherBits;             // Frames without an entry
+static uint32_t simMs;
+
+static uint32_t SIM_TICKS(void) {
+	return simMs;
+}
+
+static uint32_t rng = 12345U;
+
+static uint32_t RAND(void) {
+	rng = rng * 1664525U + 1013904223U;
+	return rng >> 8;
+}
+
+/* -n..+n */
+static int32_t NOISE(int32_t n) {
+	return (int32_t) (RAND() % (uint32_t) (2 * n + 1)) - n;
+}
+
+static int32_t CLAMP(int32_t v, int32_t lo, int32_t hi) {
+	return v < lo ? lo : (v > hi ? hi : v);
+}
+
+static void ADD(uint32_t ms, const FDCAN_FrameTypeDef_t *f) {
+	if (traceCount < TRACE_MAX) {
+		trace[traceCount].Ms = ms;
+		trace[traceCount].Frame = *f;
+		traceCount++;
+	}
+}
+
+/* Vehicle speed in km/h along the drive */
+static double SPEED(uint32_t ms) {
+	double t = ms / 1000.0;
+	if (t < 5) {
+		return 0;
+	}
+	if (t < 20) {
+		return (t - 5) * 100.0 / 15.0;
+	}
+	if (t < 40) {
+		return 100.0 + 3.0 * ((t > 30) ? 1 : 0);
+	}
+	if (t < 50) {
+		return 103.0 * (50 - t) / 10.0;
+	}
+	return 0;
+}
+
+static void SYNTHESISE(void) {
+	uint8_t counter = 0;
+	for (uint32_t ms = 0; ms < TRACE_SYNTH_MS; ms++) {
+		double v = SPEED(ms);
+		double t = ms / 1000.0;
+		uint8_t braking = (t >= 40 && t < 50);
+		uint8_t accel = (t >= 5 && t < 20);
+		FDCAN_FrameTypeDef_t f;
+
+		if (ms % 10 == 0) {
+			memset(&f, 0, sizeof(f));
+			VEH_ENGINEDATA_TypeDef_t e = { 0 };
+			double rpm = (v < 1) ? 800 : 1200 + v * 22;
+			double throttle = accel ? 45 : (braking || v < 1) ? 0 : 18;
+			e.EngineSpeed = (uint16_t) CLAMP((int32_t) (rpm * 8) + NOISE(6), 0, 0xFFFF);
+			e.CoolantTemp = (uint8_t) (40 + 80 + (uint32_t) (t / 20));
+			e.ThrottlePos = (uint16_t) CLAMP((int32_t) (throttle * 10) + NOISE(2), 0, 1000);
+			e.EngineTorque = (int16_t) CLAMP((int32_t) (throttle * 6) + NOISE(2), -2048, 2047);
+			e.FuelRate = (uint32_t) CLAMP((int32_t) (rpm * throttle * 0.5 + 600) + NOISE(30), 0, 0x3FFFF);
+			VEH_ENGINEDATA_PACK(&f, &e);
+			ADD(ms, &f);
+		}
+		if (ms % 20 == 5) {
+			memset(&f, 0, sizeof(f));
+			VEH_BRAKESTATUS_TypeDef_t b = { 0 };
+			int32_t raw = (int32_t) (v * 100);
+			b.WheelSpeedFL = (uint16_t) CLAMP(raw + NOISE(3), 0, 0xFFFF);
+			b.WheelSpeedFR = (uint16_t) CLAMP(raw + NOISE(3), 0, 0xFFFF);
+			b.WheelSpeedRL = (uint16_t) CLAMP(raw + NOISE(3), 0, 0xFFFF);
+			b.YawRate = (int8_t) (((t >= 25 && t < 30) ? 12 : 0) + NOISE(1));
+			b.BrakePressure = braking ? 10 : 0;
+			b.BrakeActive = braking;
+			VEH_BRAKESTATUS_PACK(&f, &b);
+			ADD(ms, &f);
+		}
+		if (ms % 100 == 15) {
+			memset(&f, 0, sizeof(f));
+			VEH_HEARTBEAT_TypeDef_t h = { .Counter = counter++ & 0xF, .State = 1 };
+			h.SupplyVoltage = (uint16_t) (13800 + NOISE(20));
+			VEH_HEARTBEAT_PACK(&f, &h);
+			ADD(ms, &f);
+		}
+		if (ms % 200 == 25) {
+			memset(&f, 0, sizeof(f));
+			FDCAN_FRAME_SET_ID(&f, 0x123, 0);
+			FDCAN_FRAME_SET_CONTROL(&f, 2, 0, 0);
+			FDCAN_FRAME_DATA(&f)[0] = 'H';
+			FDCAN_FRAME_DATA(&f)[1] = 'i';
+			ADD(ms, &f);
+		}
+	}
+	traceMs = TRACE_SYNTH_MS;
+}
+
+static int HEX(char c) {
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+/* candump -L: "(sec.usec) if ID#data" or "ID##flagsdata" for FD */
+static uint8_t LOAD(const char *path) {
+	FILE *fp = fopen(path, "r");
+	char line[512];
+	double first = -1;
+
+	if (fp == NULL) {
+		return 0;
+	}
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		double ts;
+		char ifname[32], body[300];
+		if (sscanf(line, " (%lf) %31s %299s", &ts, ifname, body) != 3) {
+			continue;
+		}
+		char *hash = strchr(body, '#');
+		if (hash == NULL) {
+			continue;
+		}
+		*hash = 0;
+		uint32_t id = (uint32_t) strtoul(body, NULL, 16);
+		uint8_t ext = strlen(body) > 3;
+		uint8_t fd = (hash[1] == '#');
+		const char *p = fd ? hash + 3 : hash + 1;
+		uint8_t bytes[64];
+		uint32_t n = 0;
+		while (n < 64 && HEX(p[0]) >= 0 && HEX(p[1]) >= 0) {
+			bytes[n++] = (uint8_t) (HEX(p[0]) << 4 | HEX(p[1]));
+			p += 2;
+		}
+
+		FDCAN_FrameTypeDef_t f = { 0 };
+		FDCAN_FRAME_SET_ID(&f, id, ext);
+		FDCAN_FRAME_SET_CONTROL(&f, FDCAN_BYTES_TO_DLC(n), fd,
+				fd && (HEX(hash[2]) & 1));
+		memcpy(FDCAN_FRAME_DATA(&f), bytes, n);
+		if (first < 0) {
+			first = ts;
+		}
+		ADD((uint32_t) ((ts - first) * 1000.0), &f);
+	}
+	fclose(fp);
+	traceMs = traceCount ? trace[traceCount - 1].Ms + 1 : 0;
+	return 1;
+}
+
+/***** Checks *****/
+static uint32_t CHECK_EXTRACTION(void) {
+	CANCHG_HandleTypeDef_t h = { entries, ENTRY_COUNT, 1, SIM_TICKS, 0, 0 };
+	uint32_t failures = 0;
+
+	if (CANCHG_INIT(&h) != 0) {
+		printf("  CANCHG_INIT refused the tables\n");
+		return 1;
+	}
+	for (uint32_t k = 0; k < 100000U; k++) {
+		FDCAN_FrameTypeDef_t f = { 0 };
+		f.data[0] = RAND() ^ (RAND() << 16);
+		f.data[1] = RAND() ^ (RAND() << 16);
+
+		VEH_ENGINEDATA_TypeDef_t e;
+		VEH_ENGINEDATA_UNPACK(&e, &f);
+		failures += CANCHG_SIGNAL_RAW(&entries[0], 0, f.data) != e.EngineSpeed;
+		failures += CANCHG_SIGNAL_RAW(&entries[0], 1, f.data) != e.ThrottlePos;
+		failures += (uint16_t) CANCHG_SIGNAL_RAW(&entries[0], 2, f.data)
+				!= ((uint16_t) e.EngineTorque & 0xFFFU);
+		failures += CANCHG_SIGNAL_RAW(&entries[0], 3, f.data) != e.FuelRate;
+
+		VEH_BRAKESTATUS_TypeDef_t b;
+		VEH_BRAKESTATUS_UNPACK(&b, &f);
+		failures += CANCHG_SIGNAL_RAW(&entries[2], 0, f.data) != b.WheelSpeedFL;
+		failures += CANCHG_SIGNAL_RAW(&entries[2], 1, f.data) != (uint8_t) b.YawRate;
+		failures += CANCHG_SIGNAL_RAW(&entries[2], 2, f.data) != b.WheelSpeedFR;
+		failures += CANCHG_SIGNAL_RAW(&entries[2], 3, f.data) != b.WheelSpeedRL;
+	}
+
+	// Deadband bits leave the exact mask, the others stay
+	uint8_t ok = entries[0].ExactMask[0] == 0x00FF0000U
+			&& entries[0].ExactMask[1] == 0x00000000U
+			&& entries[2].ExactMask[0] == 0x00000000U
+			&& entries[2].ExactMask[1] == 0xFF000000U;
+	failures += !ok;
+	return failures;
+}
+
+/* Last frame sent per entry, kept here to check the filter independently */
+static FDCAN_FrameTypeDef_t lastSent[ENTRY_COUNT];
+static uint32_t lastSentMs[ENTRY_COUNT];
+
+static uint32_t WITHIN_DEADBANDS(uint32_t n, const FDCAN_FrameTypeDef_t *f) {
+	const CANCHG_EntryTypeDef_t *e = &entries[n];
+	const FDCAN_FrameTypeDef_t *l = &lastSent[n];
+	uint32_t length = FDCAN_FRAME_GET_LEN(f);
+
+	for (uint32_t byte = 0; byte < length; byte++) {
+		uint32_t mask = (e->ExactMask[byte / 4U] >> (8U * (byte % 4U))) & 0xFFU;
+		if ((((const uint8_t*) f->data)[byte] ^ ((const uint8_t*) l->data)[byte])
+				& mask) {
+			return 0;
+		}
+	}
+	for (uint32_t i = 0; i < e->SignalCount; i++) {
+		const CANCHG_SignalTypeDef_t *s = &e->Signals[i];
+		int64_t a = CANCHG_SIGNAL_RAW(e, i, f->data);
+		int64_t b = CANCHG_SIGNAL_RAW(e, i, l->data);
+		if (s->Signed) {
+			int64_t half = 1LL << (s->Length - 1);
+			a = (a >= half) ? a - 2 * half : a;
+			b = (b >= half) ? b - 2 * half : b;
+		}
+		if (llabs(a - b) > (int64_t) s->Deadband) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* Replay the trace, deadbands on or off; wire bits per entry before/after */
+static uint32_t REPLAY(uint8_t deadbands, uint64_t *pBitsIn, uint64_t *pBitsOut) {
+	static CANCHG_SignalTypeDef_t none[CANCHG_MAX_SIGNALS];
+	const CANCHG_SignalTypeDef_t *saved[ENTRY_COUNT];
+	CANCHG_HandleTypeDef_t h = { entries, ENTRY_COUNT, 1, SIM_TICKS, 0, 0 };
+	uint32_t failures = 0;
+
+	for (uint32_t n = 0; n < ENTRY_COUNT; n++) {
+		saved[n] = entries[n].Signals;
+		if (!deadbands) {
+			// Deadband 0: the same bits, compared exactly
+			for (uint32_t i = 0; i < entries[n].SignalCount; i++) {
+				none[i] = entries[n].Signals[i];
+				none[i].Deadband = 0;
+			}
+			static CANCHG_SignalTypeDef_t copies[ENTRY_COUNT][CANCHG_MAX_SIGNALS];
+			memcpy(copies[n], none, sizeof(none));
+			entries[n].Signals = copies[n];
+		}
+		pBitsIn[n] = pBitsOut[n] = 0;
+	}
+	otherBits = 0;
+	CANCHG_INIT(&h);
+
+	for (uint32_t k = 0; k < traceCount; k++) {
+		const FDCAN_FrameTypeDef_t *f = &trace[k].Frame;
+		simMs = trace[k].Ms;
+		CANCHG_EntryTypeDef_t *e = CANCHG_FIND(&h, f);
+		uint32_t bits = CANSTATS_WIRE_BITS(
+				FDCAN_FRAME_IS_FD(f) ? CANSTATS_FMT_FD : CANSTATS_FMT_CLASSIC,
+				FDCAN_FRAME_IS_EXTENDED(f), FDCAN_FRAME_GET_LEN(f), NULL);
+		if (e == NULL) {
+			otherBits += bits;         // Passes unfiltered
+			continue;
+		}
+		uint32_t n = (uint32_t) (e - entries);
+		pBitsIn[n] += bits;
+
+		uint8_t seen = e->Valid;
+		if (CANCHG_FILTER(&h, f) == CANCHG_SEND) {
+			pBitsOut[n] += bits;
+			lastSent[n] = *f;
+			lastSentMs[n] = simMs;
+		} else {
+			failures += !seen || !WITHIN_DEADBANDS(n, f)
+					|| simMs - lastSentMs[n] >= REFRESH_MS;
+		}
+	}
+	for (uint32_t n = 0; n < ENTRY_COUNT; n++) {
+		entries[n].Signals = saved[n];
+	}
+	return failures;
+}
+
+static void REPORT(const char *name, const uint64_t *bitsIn,
+		const uint64_t *bitsOut) {
+	uint64_t totalIn = 0, totalOut = 0;
+	double busBits = (double) traceMs * BUS_KBPS;
+
+	printf("%s\n  ID      Frames   Sent  Refresh   Load before  after  (%% of %u kbit/s)\n",
+			name, BUS_KBPS);
+	for (uint32_t n = 0; n < ENTRY_COUNT; n++) {
+		const CANCHG_EntryTypeDef_t *e = &entries[n];
+		printf("  0x%03lX  %6lu  %5lu  %7lu   %10.3f  %6.3f\n",
+				(unsigned long) e->Id, (unsigned long) e->Offered,
+				(unsigned long) e->Sent, (unsigned long) e->Refreshed,
+				100.0 * bitsIn[n] / busBits, 100.0 * bitsOut[n] / busBits);
+		totalIn += bitsIn[n];
+		totalOut += bitsOut[n];
+	}
+	printf("  Other   (no entry, always sent)  %10.3f  %6.3f\n",
+			100.0 * otherBits / busBits, 100.0 * otherBits / busBits);
+	totalIn += otherBits;
+	totalOut += otherBits;
+	printf("  Total                            %10.3f  %6.3f   -%.1f %%\n",
+			100.0 * totalIn / busBits, 100.0 * totalOut / busBits,
+			totalIn ? 100.0 * (totalIn - totalOut) / totalIn : 0.0);
+}
+
+static uint64_t NOW_NS(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000U + (uint64_t) ts.tv_nsec;
+}
+
+int main(int argc, char **argv) {
+	uint64_t bitsIn[ENTRY_COUNT], bitsOut[ENTRY_COUNT];
+	uint32_t failures;
+
+	if (argc > 1) {
+		if (!LOAD(argv[1])) {
+			printf("Cannot read %s\n", argv[1]);
+			return 1;
+		}
+		printf("Trace %s: %lu frames, %.1f s\n", argv[1],
+				(unsigned long) traceCount, traceMs / 1000.0);
+	} else {
+		SYNTHESISE();
+		printf("Synthetic drive: %lu frames, %.1f s\n",
+				(unsigned long) traceCount, traceMs / 1000.0);
+	}
+
+	failures = CHECK_EXTRACTION();
+	printf("Signal extraction against vehicle_signals.h: %s (%lu failures)\n",
+			failures ? "FAIL" : "pass", (unsigned long) failures);
+
+	uint32_t f1 = REPLAY(0, bitsIn, bitsOut);
+	REPORT("Exact compare, refresh 1 s:", bitsIn, bitsOut);
+	uint32_t f2 = REPLAY(1, bitsIn, bitsOut);
+	REPORT("Deadbands, refresh 1 s:", bitsIn, bitsOut);
+	printf("Suppressed frames within deadbands and refresh: %s (%lu failures)\n",
+			(f1 + f2) ? "FAIL" : "pass", (unsigned long) (f1 + f2));
+	failures += f1 + f2;
+
+	// Cost: half the calls find a change, half do not
+	CANCHG_HandleTypeDef_t h = { entries, ENTRY_COUNT, 1, SIM_TICKS, 0, 0 };
+	CANCHG_INIT(&h);
+	FDCAN_FrameTypeDef_t a = trace[0].Frame, b = a;
+	b.data[0] ^= 0x00010000U;          // Outside the deadbands of every table
+	uint64_t start = NOW_NS();
+	uint32_t sent = 0;
+	for (uint32_t k = 0; k < BENCH_CALLS; k++) {
+		simMs = k;
+		sent += CANCHG_FILTER(&h, (k & 2U) ? &a : &b);
+	}
+	uint64_t ns = NOW_NS() - start;
+	printf("CANCHG_FILTER: %.1f ns per frame on this host (%lu sent)\n",
+			(double) ns / BENCH_CALLS, (unsigned long) sent);
+
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,359 @@
+/**
+ ******************************************************************************
+ * @file           : ratelimit_bench.c
+ * @brief          : Latency of lower-priority control traffic behind a
+ *                   babbling producer, with and without the token-bucket
+ *                   limiter of Src/can_ratelimit.c.
+ *
+ * The node's TX FIFO is modelled as the FDCAN one (three elements, the get
+ * index in arbitration). A faulty producer on the node offers ID 0x050
+ * every 100 us, faster than the bus can carry it, and a diagnostic stream
+ * has 40 frames of 0x7E8 to send every 100 ms, retrying a refused frame as
+ * ISO-TP does when CAN1_TxFrame returns 0. Another node sends the
+ * control frames 0x180 to 0x183, 8 bytes every 5 ms, and its latency is
+ * taken from release to end of transmission. The limiter is driven as in
+ * main.c: CANRL_SUBMIT in front of the FIFO, CANRL_POLL at every frame end
+ * and when CANRL_NEXT_US comes due.
+ *
+ * Checks: the 0x050 frames sent in any window never exceed burst + rate *
+ * window, and the diagnostic frames, queued rather than dropped, are all
+ * sent, in order.
+ *
+ * Build and run from the repository root:
+ *   gcc -O2 -IInc -o ratelimit_bench Tools/ratelimit_bench.c Src/can_ratelimit.c Src/can_stats.c
+ *   ./ratelimit_bench
+ ******************************************************************************
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "can_ratelimit.h"
+#include "can_stats.h"
+
+#define SIM_BIT_NS                  2000U // 500 kbit/s
+#define SIM_FIFO                    3U
+#define SIM_RUN_US                  10000000U // 10 s of bus time
+#define SIM_BABBLE_ID               0x050U
+#define SIM_BABBLE_US               100U
+#define SIM_DIAG_ID                 0x7E8U
+#define SIM_DIAG_BURST              40U
+#define SIM_DIAG_PERIOD_US          100000U
+#define SIM_CONTROL_COUNT           4U
+#define SIM_CONTROL_PERIOD_US       5000U
+#define SIM_CONTROL_CAP             64U   // Pending releases per control ID
+#define BENCH_CALLS                 10000000U
+
+/***** Limiter Tables: the high-priority and diagnostic classes of main.c,
+ * and an ID entry for the babbling producer *****/
+static CANRL_IdTypeDef_t rlIds[] = {
+	{ .Id = SIM_BABBLE_ID, .Bucket = { .RatePerSec = 200, .Burst = 4,
+			.Policy = CANRL_DROP } },
+};
+
+static CANRL_ClassTypeDef_t rlClasses[] = {
+	{ .IdMin = 0x000, .IdMax = 0x0FF, .Bucket = { .RatePerSec = 500,
+			.Burst = 8, .Policy = CANRL_DROP } },  // High priority
+	{ .IdMin = 0x700, .IdMax = 0x7FF, .Bucket = { .RatePerSec = 1000,
+			.Burst = 8, .Policy = CANRL_QUEUE } }, // Diagnostics, never lost
+};
+
+/***** Bus Model *****/
+typedef struct {
+	uint8_t Pending;
+	FDCAN_FrameTypeDef_t Frame;
+} Slot_t;
+
+static Slot_t slot[SIM_FIFO];
+static uint8_t getIndex, putIndex, fillLevel;
+static uint64_t nowNs;
+
+static struct {
+	uint32_t Id;
+	uint64_t NextNs;
+	uint64_t ReleasedNs[SIM_CONTROL_CAP];
+	uint32_t Head, Count;
+	uint32_t Sent, Lost;
+	uint64_t LatSumNs, LatMaxNs;
+} control[SIM_CONTROL_COUNT];
+
+static uint32_t babbleOffered, babbleSent;
+static uint32_t babbleSentUs[200000];  // Send times, for the window check
+static uint32_t diagOffered, diagSent, diagOrderErrors, diagNextSeq;
+
+static uint32_t SIM_US(void) {
+	return (uint32_t) (nowNs / 1000U);
+}
+
+static uint8_t FIFO_PUT(void *ctx, const FDCAN_FrameTypeDef_t *pFrame) {
+	(void) ctx;
+	if (fillLevel == SIM_FIFO) {
+		return 0;
+	}
+	slot[putIndex].Pending = 1;
+	slot[putIndex].Frame = *pFrame;
+	putIndex = (uint8_t) ((putIndex + 1U) % SIM_FIFO);
+	fillLevel++;
+	return 1;
+}
+
+static CANRL_HandleTypeDef_t hRl = {
+	.Ids = rlIds, .IdCount = 1, .Classes = rlClasses, .ClassCount = 2,
+	.GetUs = SIM_US, .Transmit = FIFO_PUT, .Ctx = NULL,
+};
+
+/* Node TX path as CAN1_TxFrame: full FIFO first, then the limiter
+ * @retval 1 if the frame was taken, 0 if the caller has to retry or drop */
+static uint8_t NODE_TX(const FDCAN_FrameTypeDef_t *pFrame, uint8_t limit) {
+	if (fillLevel == SIM_FIFO) {
+		return 0;
+	}
+	if (limit) {
+		uint8_t r = CANRL_SUBMIT(&hRl, pFrame);
+		if (r != CANRL_PASS) {
+			return r == CANRL_QUEUED;
+		}
+	}
+	return FIFO_PUT(NULL, pFrame);
+}
+
+static uint64_t FRAME_NS(uint8_t bytes) {
+	return (uint64_t) CANSTATS_WIRE_BITS(CANSTATS_FMT_CLASSIC, 0, bytes, NULL)
+			* SIM_BIT_NS;
+}
+
+static void MAKE(FDCAN_FrameTypeDef_t *f, uint32_t id, uint32_t seq) {
+	memset(f, 0, sizeof(*f));
+	FDCAN_FRAME_SET_ID(f, id, 0);
+	FDCAN_FRAME_SET_CONTROL(f, 8, 0, 0);
+	f->data[0] = seq;
+}
+
+typedef struct {
+	uint32_t CtlMaxUs[SIM_CONTROL_COUNT];
+	double CtlAvgUs[SIM_CONTROL_COUNT];
+	uint32_t CtlLost;
+	uint32_t BabbleSent, BabbleOffered;
+	uint32_t DiagSent, DiagOffered, DiagOrderErrors;
+	uint32_t WindowViolations;
+	uint8_t QueuePeak;
+} Result_t;
+
+static void RUN(uint8_t limit, Result_t *r) {
+	const uint64_t endNs = (uint64_t) SIM_RUN_US * 1000U;
+	uint64_t busEndNs = 0, babbleNs = 0, diagNs = 50000U, pollNs = UINT64_MAX;
+	int busOwn = 0, busCtl = -1;       // Frame on the bus: own slot or control ID
+	uint8_t busIdle = 1;
+	uint32_t babbleSeq = 0, diagSeq = 0, diagPending = 0;
+
+	memset(slot, 0, sizeof(slot));
+	memset(control, 0, sizeof(control));
+	getIndex = putIndex = fillLevel = 0;
+	babbleOffered = babbleSent = diagOffered = diagSent = 0;
+	diagOrderErrors = diagNextSeq = 0;
+	nowNs = 0;
+	CANRL_INIT(&hRl);
+	for (uint32_t c = 0; c < SIM_CONTROL_COUNT; c++) {
+		control[c].Id = 0x180U + c;
+		control[c].NextNs = 1000000ULL + c * 1250000ULL;
+	}
+
+	while (nowNs < endNs) {
+		uint64_t next = endNs;
+		if (!busIdle && busEndNs < next) next = busEndNs;
+		if (babbleNs < next) next = babbleNs;
+		if (diagNs < next) next = diagNs;
+		if (pollNs < next) next = pollNs;
+		for (uint32_t c = 0; c < SIM_CONTROL_COUNT; c++) {
+			if (control[c].NextNs < next) next = control[c].NextNs;
+		}
+		nowNs = next;
+
+		if (!busIdle && busEndNs == nowNs) {
+			if (busCtl >= 0) {
+				uint64_t lat = nowNs - control[busCtl].ReleasedNs[control[busCtl].Head];
+				control[busCtl].Head = (control[busCtl].Head + 1U) % SIM_CONTROL_CAP;
+				control[busCtl].Count--;
+				control[busCtl].Sent++;
+				control[busCtl].LatSumNs += lat;
+				if (lat > control[busCtl].LatMaxNs) control[busCtl].LatMaxNs = lat;
+			} else {
+				const FDCAN_FrameTypeDef_t *f = &slot[busOwn].Frame;
+				if (FDCAN_FRAME_GET_ID(f) == SIM_BABBLE_ID) {
+					if (babbleSent < sizeof(babbleSentUs) / sizeof(babbleSentUs[0])) {
+						babbleSentUs[babbleSent] = SIM_US();
+					}
+					babbleSent++;
+				} else {
+					diagOrderErrors += (f->data[0] != diagNextSeq);
+					diagNextSeq = f->data[0] + 1U;
+					diagSent++;
+				}
+				slot[busOwn].Pending = 0;
+				getIndex = (uint8_t) ((getIndex + 1U) % SIM_FIFO);
+				fillLevel--;
+			}
+			busIdle = 1;
+			if (limit) {
+				CANRL_POLL(&hRl);      // TX FIFO empty interrupt
+			}
+		}
+		if (limit && pollNs == nowNs) {
+			CANRL_POLL(&hRl);          // TIM2 compare
+			pollNs = UINT64_MAX;
+		}
+		if (babbleNs == nowNs) {
+			FDCAN_FrameTypeDef_t f;
+			MAKE(&f, SIM_BABBLE_ID, babbleSeq++);
+			babbleOffered++;
+			NODE_TX(&f, limit);
+			babbleNs += SIM_BABBLE_US * 1000U;
+		}
+		if (diagNs == nowNs) {
+			diagPending += SIM_DIAG_BURST;
+			diagOffered += SIM_DIAG_BURST;
+			diagNs += SIM_DIAG_PERIOD_US * 1000U;
+		}
+		while (diagPending != 0) {
+			FDCAN_FrameTypeDef_t f;
+			MAKE(&f, SIM_DIAG_ID, diagSeq);
+			if (!NODE_TX(&f, limit)) {
+				break;                 // Retried at the next event
+			}
+			diagSeq++;
+			diagPending--;
+		}
+		for (uint32_t c = 0; c < SIM_CONTROL_COUNT; c++) {
+			if (control[c].NextNs == nowNs) {
+				if (control[c].Count < SIM_CONTROL_CAP) {
+					uint32_t tail = (control[c].Head + control[c].Count) % SIM_CONTROL_CAP;
+					control[c].ReleasedNs[tail] = nowNs;
+					control[c].Count++;
+				} else {
+					control[c].Lost++;
+				}
+				control[c].NextNs += SIM_CONTROL_PERIOD_US * 1000U;
+			}
+		}
+		if (limit && pollNs == UINT64_MAX) {
+			uint32_t wait = CANRL_NEXT_US(&hRl);
+			if (wait != CANRL_IDLE) {
+				pollNs = nowNs + (uint64_t) (wait ? wait : 250U) * 1000U;
+			}
+		}
+
+		if (busIdle) {
+			// Lowest identifier wins: node's get index against the control IDs
+			uint32_t bestId = 0xFFFFFFFFU;
+			busCtl = -1;
+			for (uint32_t c = 0; c < SIM_CONTROL_COUNT; c++) {
+				if (control[c].Count != 0 && control[c].Id < bestId) {
+					bestId = control[c].Id;
+					busCtl = (int) c;
+				}
+			}
+			if (fillLevel != 0 && FDCAN_FRAME_GET_ID(&slot[getIndex].Frame) < bestId) {
+				busCtl = -1;
+				busOwn = getIndex;
+				busEndNs = nowNs + FRAME_NS(8);
+				busIdle = 0;
+			} else if (busCtl >= 0) {
+				busEndNs = nowNs + FRAME_NS(8);
+				busIdle = 0;
+			}
+		}
+	}
+
+	r->CtlLost = 0;
+	for (uint32_t c = 0; c < SIM_CONTROL_COUNT; c++) {
+		r->CtlMaxUs[c] = (uint32_t) (control[c].LatMaxNs / 1000U);
+		r->CtlAvgUs[c] = control[c].Sent ? control[c].LatSumNs / 1e3 / control[c].Sent : 0;
+		r->CtlLost += control[c].Lost;
+	}
+	r->BabbleSent = babbleSent;
+	r->BabbleOffered = babbleOffered;
+	r->DiagSent = diagSent;
+	r->DiagOffered = diagOffered;
+	r->DiagOrderErrors = diagOrderErrors;
+	r->QueuePeak = hRl.QueuePeak;
+
+	// burst + rate * window, for windows starting at every send
+	r->WindowViolations = 0;
+	uint32_t n = babbleSent < sizeof(babbleSentUs) / sizeof(babbleSentUs[0]) ?
+			babbleSent : sizeof(babbleSentUs) / sizeof(babbleSentUs[0]);
+	for (uint32_t i = 0; limit && i < n; i++) {
+		for (uint32_t j = i; j < n; j++) {
+			uint32_t window = babbleSentUs[j] - babbleSentUs[i];
+			if (window > 1000000U) {
+				break;
+			}
+			// Tokens a start-of-window send may have had: the class bucket
+			// (500/s, 8) bounds less tightly than the ID one (200/s, 4)
+			uint64_t allowed = 4U + 1U + (uint64_t) window * 200U / 1000000U;
+			if (j - i + 1U > allowed) {
+				r->WindowViolations++;
+				break;
+			}
+		}
+	}
+}
+
+static uint64_t NOW_NS(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000U + (uint64_t) ts.tv_nsec;
+}
+
+int main(void) {
+	Result_t res[2];
+	uint32_t failures = 0;
+
+	printf("Babbling 0x%03X every %u us, diagnostics 0x%03X %u frames per %u ms, "
+			"500 kbit/s, %u s\n", SIM_BABBLE_ID, SIM_BABBLE_US, SIM_DIAG_ID,
+			SIM_DIAG_BURST, SIM_DIAG_PERIOD_US / 1000U, SIM_RUN_US / 1000000U);
+	printf("Limiter  Control ID  Latency avg us  max us   0x050 sent/offered"
+			"  0x7E8 sent/offered  Control lost\n");
+	for (uint8_t limit = 0; limit <= 1; limit++) {
+		Result_t *r = &res[limit];
+		RUN(limit, r);
+		for (uint32_t c = 0; c < SIM_CONTROL_COUNT; c++) {
+			printf("%-7s  0x%03lX       %14.1f  %6lu", limit ? "on" : "off",
+					(unsigned long) (0x180U + c), r->CtlAvgUs[c],
+					(unsigned long) r->CtlMaxUs[c]);
+			if (c == 0) {
+				printf("   %8lu/%-8lu  %8lu/%-8lu  %12lu",
+						(unsigned long) r->BabbleSent, (unsigned long) r->BabbleOffered,
+						(unsigned long) r->DiagSent, (unsigned long) r->DiagOffered,
+						(unsigned long) r->CtlLost);
+			}
+			printf("\n");
+		}
+	}
+	const Result_t *on = &res[1];
+	printf("Limiter queue peak %u of %u\n", on->QueuePeak, CANRL_QUEUE_LEN);
+	printf("0x050 within burst + rate x window: %s (%lu violations)\n",
+			on->WindowViolations ? "FAIL" : "pass",
+			(unsigned long) on->WindowViolations);
+	// The last burst may still be in the queue when the run ends
+	uint8_t diagOk = on->DiagOrderErrors == 0
+			&& on->DiagOffered - on->DiagSent <= SIM_DIAG_BURST;
+	printf("0x7E8 none lost, in order: %s (%lu out of order, %lu unsent)\n",
+			diagOk ? "pass" : "FAIL", (unsigned long) on->DiagOrderErrors,
+			(unsigned long) (on->DiagOffered - on->DiagSent));
+	failures += on->WindowViolations + !diagOk;
+
+	// Cost: one limited frame per call, tokens refilled every call
+	FDCAN_FrameTypeDef_t f;
+	MAKE(&f, SIM_BABBLE_ID, 0);
+	CANRL_INIT(&hRl);
+	uint64_t start = NOW_NS();
+	uint32_t passed = 0;
+	for (uint32_t k = 0; k < BENCH_CALLS; k++) {
+		nowNs = (uint64_t) k * 5000U;  // 5 ms apart, so every call passes
+		passed += CANRL_SUBMIT(&hRl, &f) == CANRL_PASS;
+	}
+	uint64_t ns = NOW_NS() - start;
+	printf("CANRL_SUBMIT: %.1f ns per frame on this host (%lu passed)\n",
+			(double) ns / BENCH_CALLS, (unsigned long) passed);
+	return failures ? 1 : 0;
+}
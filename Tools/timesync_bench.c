@@ -0,0 +1,228 @@
+/**
+ ******************************************************************************
+ * @file           : timesync_bench.c
+ * @brief          : Two-node simulation of the CAN time synchronization of
+ *                   Src/can_timesync.c: how far the slave's global time is
+ *                   from the master's.
+ *
+ * Each node has its own oscillator: the master runs 40 ppm fast, the slave
+ * 60 ppm slow with 5 ppm of slow wander (temperature). Both derive, as on
+ * the target, a 1 us TIM2 count extended to 64 bits and the FDCAN 16-bit
+ * timestamp counter ticking once per bit time (2 us at 500 kbit/s). The
+ * master releases a SYNC every 100 ms; it waits up to 500 us for the bus,
+ * and every interrupt is served 2 us to 2 ms late. Hardware timestamps are
+ * taken at the start of frame and turned into local time at interrupt time
+ * the way TSYN_LOCAL_AT in main.c does. 3 % of SYNCs and FUPs are lost.
+ *
+ * The slave's estimate is compared with the master's global time every
+ * 1 ms of the run, after a 3 s start-up, for three set-ups: hardware
+ * timestamps with rate correction (the main.c configuration), without it,
+ * and software timestamps (local time read in the interrupt).
+ *
+ * Build and run from the repository root:
+ *   gcc -O2 -IInc -o timesync_bench Tools/timesync_bench.c Src/can_timesync.c -lm
+ *   ./timesync_bench
+ ******************************************************************************
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "can_timesync.h"
+
+#define SIM_RUN_S                   120U
+#define SIM_WARMUP_S                3U
+#define SIM_SYNC_PERIOD_NS          100000000ULL
+#define SIM_BIT_NS                  2000U  // 500 kbit/s, one timestamp tick
+#define SIM_FRAME_NS                (130U * SIM_BIT_NS) // 8-byte frame with stuffing
+#define SIM_BUS_WAIT_NS             500000U
+#define SIM_LATENCY_MIN_NS          2000U
+#define SIM_LATENCY_MAX_NS          2000000U
+#define SIM_LOSS_PERMILLE           30U
+#define SIM_SAMPLE_NS               1000000ULL
+#define SIM_ID                      0x0F0U
+#define SIM_EPOCH_NS                (1700000000ULL * CANTS_NS_PER_SEC)
+#define PASS_MAX_ERROR_NS           10000U // Hardware timestamps, rate corrected
+
+/***** Node Clocks *****/
+typedef struct {
+	double OffsetNs;               // Local time at true time 0
+	double DriftPpm;
+	double WanderPpm;              // Amplitude of the slow drift change
+	double WanderPeriodS;
+} Clock_t;
+
+static const Clock_t masterClock = { 3.2e9, 40.0, 0.0, 1.0 };
+static const Clock_t slaveClock = { 7.9e9, -60.0, 5.0, 40.0 };
+
+/* Local nanoseconds at true time t (ns), drift integrated */
+static double LOCAL_EXACT(const Clock_t *c, double t) {
+	double w = 2.0 * M_PI / (c->WanderPeriodS * 1e9);
+	return c->OffsetNs + t + t * c->DriftPpm * 1e-6
+			+ c->WanderPpm * 1e-6 * (1.0 - cos(w * t)) / w;
+}
+
+/* The 64-bit clock of main.c: TIM2 microseconds in nanoseconds */
+static uint64_t LOCAL_TIM2(const Clock_t *c, double t) {
+	return (uint64_t) floor(LOCAL_EXACT(c, t) / 1000.0) * 1000U;
+}
+
+static uint16_t TIMESTAMP(const Clock_t *c, double t) {
+	return (uint16_t) (uint64_t) floor(LOCAL_EXACT(c, t) / SIM_BIT_NS);
+}
+
+/* Local time of a start of frame from its timestamp, at interrupt time */
+static uint64_t LOCAL_AT(const Clock_t *c, double tSof, double tIrq,
+		uint8_t hardware) {
+	if (!hardware) {
+		return LOCAL_TIM2(c, tIrq);
+	}
+	uint16_t age = (uint16_t) (TIMESTAMP(c, tIrq) - TIMESTAMP(c, tSof));
+	return LOCAL_TIM2(c, tIrq) - (uint64_t) age * SIM_BIT_NS;
+}
+
+static uint32_t rngState = 0x9E3779B9U;
+
+static uint32_t RANDOM(void) {
+	rngState ^= rngState << 13;
+	rngState ^= rngState >> 17;
+	rngState ^= rngState << 5;
+	return rngState;
+}
+
+static double UNIFORM(double lo, double hi) {
+	return lo + (hi - lo) * (RANDOM() / 4294967296.0);
+}
+
+static uint8_t LOST(void) {
+	return RANDOM() % 1000U < SIM_LOSS_PERMILLE;
+}
+
+/***** Run *****/
+typedef struct {
+	const char *Name;
+	uint8_t Hardware;
+	uint8_t Rate;
+} Setup_t;
+
+typedef struct {
+	double MaxNs;
+	double RmsNs;
+	double Samples;
+	CANTS_SlaveTypeDef_t Slave;
+	CANTS_MasterTypeDef_t Master;
+} Result_t;
+
+static void RUN(const Setup_t *setup, Result_t *r) {
+	CANTS_MasterTypeDef_t *m = &r->Master;
+	CANTS_SlaveTypeDef_t *s = &r->Slave;
+	FDCAN_FrameTypeDef_t sync, fup;
+	double sumSq = 0;
+
+	rngState = 0x9E3779B9U;
+	memset(r, 0, sizeof(*r));
+	m->Id = SIM_ID;
+	m->EpochNs = SIM_EPOCH_NS;
+	CANTS_MASTER_INIT(m);
+	s->Id = SIM_ID;
+	s->FollowUpTimeoutNs = 50000000ULL;
+	s->TimeoutNs = 500000000ULL;
+	s->RateWindowNs = setup->Rate ? 1000000000ULL : 0;
+	s->MaxRatePpb = 500000;
+	CANTS_SLAVE_INIT(s);
+
+	// The scheduler builds each SYNC right after the previous release
+	CANTS_MASTER_SYNC(m, &sync, LOCAL_TIM2(&masterClock, 0));
+	double sample = 0;
+	for (uint64_t k = 1; k * SIM_SYNC_PERIOD_NS < SIM_RUN_S * CANTS_NS_PER_SEC;
+			k++) {
+		double release = (double) (k * SIM_SYNC_PERIOD_NS);
+		FDCAN_FrameTypeDef_t sent = sync;
+		CANTS_MASTER_SYNC(m, &sync, LOCAL_TIM2(&masterClock, release));
+		double sof = release + UNIFORM(0, SIM_BUS_WAIT_NS);
+		double end = sof + SIM_FRAME_NS;
+		uint8_t syncLost = LOST();
+
+		// Master: TX event interrupt, FUP queued from it
+		double masterIrq = end + UNIFORM(SIM_LATENCY_MIN_NS, SIM_LATENCY_MAX_NS);
+		uint8_t marker = (uint8_t) (sent.w1 >> FDCAN_ELEM_MM_POS);
+		uint8_t haveFup = CANTS_MASTER_TX_EVENT(m, marker,
+				LOCAL_AT(&masterClock, sof, masterIrq, setup->Hardware), &fup);
+		double fupSof = masterIrq + UNIFORM(0, SIM_BUS_WAIT_NS);
+		double fupEnd = fupSof + SIM_FRAME_NS;
+
+		// Slave: both frames in order, each interrupt late by its own amount
+		double slaveIrq = end + UNIFORM(SIM_LATENCY_MIN_NS, SIM_LATENCY_MAX_NS);
+		double fupIrq = fupEnd + UNIFORM(SIM_LATENCY_MIN_NS, SIM_LATENCY_MAX_NS);
+		if (fupIrq < slaveIrq) {
+			fupIrq = slaveIrq;
+		}
+
+		// Compare up to the SYNC interrupt with the estimate held until then
+		for (; sample < slaveIrq; sample += SIM_SAMPLE_NS) {
+			uint64_t est;
+			if (sample < SIM_WARMUP_S * 1e9
+					|| CANTS_SLAVE_GLOBAL(s, LOCAL_TIM2(&slaveClock, sample), &est)
+							== CANTS_UNSYNCED) {
+				continue;
+			}
+			double truth = SIM_EPOCH_NS + LOCAL_EXACT(&masterClock, sample);
+			double err = fabs((double) est - truth);
+			r->MaxNs = (err > r->MaxNs) ? err : r->MaxNs;
+			sumSq += err * err;
+			r->Samples++;
+		}
+
+		if (!syncLost) {
+			CANTS_SLAVE_RX(s, &sent,
+					LOCAL_AT(&slaveClock, sof, slaveIrq, setup->Hardware));
+		}
+		if (haveFup && !LOST()) {
+			CANTS_SLAVE_RX(s, &fup,
+					LOCAL_AT(&slaveClock, fupSof, fupIrq, setup->Hardware));
+		}
+	}
+	r->RmsNs = r->Samples ? sqrt(sumSq / r->Samples) : 0;
+}
+
+int main(void) {
+	static const Setup_t setups[] = {
+		{ "HW timestamps, rate", 1, 1 },
+		{ "HW timestamps", 1, 0 },
+		{ "SW timestamps, rate", 0, 1 },
+	};
+	Result_t res[3];
+	uint32_t failures = 0;
+
+	printf("Master +40 ppm, slave -60 ppm +-5 ppm wander, SYNC every 100 ms,"
+			" %u s\n\n", SIM_RUN_S);
+	printf("Set-up                 Max error us  RMS us  Rate ppm  Pairs"
+			"  Discarded  Unmatched\n");
+	for (uint32_t n = 0; n < 3U; n++) {
+		RUN(&setups[n], &res[n]);
+		const Result_t *r = &res[n];
+		printf("%-22s %12.2f %7.2f %9.3f %6lu %10lu %10lu\n", setups[n].Name,
+				r->MaxNs / 1000.0, r->RmsNs / 1000.0,
+				r->Slave.RatePpb / 1000.0, (unsigned long) r->Slave.Pairs,
+				(unsigned long) r->Slave.Discarded,
+				(unsigned long) r->Master.Unmatched);
+	}
+
+	// True rate of the master against the slave at the end of the run
+	double t = SIM_RUN_S * 1e9;
+	double w = 2.0 * M_PI / (slaveClock.WanderPeriodS * 1e9);
+	double slaveRate = 1.0 + (slaveClock.DriftPpm
+			+ slaveClock.WanderPpm * sin(w * t)) * 1e-6;
+	double masterRate = 1.0 + masterClock.DriftPpm * 1e-6;
+	printf("\nTrue rate at the end: %.3f ppm\n",
+			(masterRate / slaveRate - 1.0) * 1e6);
+
+	uint8_t ok = res[0].MaxNs < PASS_MAX_ERROR_NS;
+	printf("HW timestamps with rate correction within %u us: %s\n",
+			PASS_MAX_ERROR_NS / 1000U, ok ? "pass" : "FAIL");
+	failures += !ok;
+	ok = res[0].MaxNs < res[2].MaxNs;
+	printf("HW timestamps better than SW timestamps: %s\n", ok ? "pass" : "FAIL");
+	failures += !ok;
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,514 @@
+/**
+ ******************************************************************************
+ * @file           : trace_replay.c
+ * @brief          : Replay a candump log or a bus sniffer capture through
+ *                   Src/can_replay.c on the host: frames per ID, frames the
+ *                   receiver could not keep up with, and replay throughput.
+ *
+ * The receiver runs on a virtual microsecond clock: an RX FIFO of -depth
+ * elements (3, as RX FIFO 0 of the target) served every -poll microseconds,
+ * or as soon as a frame arrives with -poll 0 (the RX interrupt), each frame
+ * taking -cost microseconds. A frame arriving at a full FIFO is an overrun.
+ * -scale replays at a multiple of the recorded speed in permille, -fast
+ * delivers each frame as soon as there is room. The host rate printed is
+ * that of parsing, the FIFO model and the per-ID statistics together.
+ *
+ * Without a log, a generated one checks the replay against what was
+ * written: frames and flags, timing as recorded and scaled, the fast mode,
+ * the overruns of a slow receiver, and the same frames as a capture stream.
+ *
+ * Build and run from the repository root:
+ *   gcc -O2 -IInc -o trace_replay Tools/trace_replay.c Src/can_replay.c Src/can_capture.c Src/can_stats.c
+ *   ./trace_replay [-fast | -scale permille] [-depth n] [-poll us] [-cost us]
+ *                  [-i can0] [log]
+ * The exit status is 1 if frames were lost or lines did not parse.
+ ******************************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "can_replay.h"
+#include "can_capture.h"
+#include "can_stats.h"
+
+#define SIM_START_US                0xFFFFF000U // The 32-bit clock wraps early on
+#define SIM_TOP_IDS                 10U
+#define CHECK_FRAMES                2000U
+#define CHECK_SPACING_US            500U
+#define CHECK_BURST_EVERY           100U  // Frames between bursts
+#define CHECK_BURST_FRAMES          6U
+#define CHECK_BURST_GAP_US          20U   // Between the frames of a burst
+#define CHECK_KBPS                  500U
+
+typedef struct {
+	uint8_t Mode;
+	uint32_t ScalePermille;
+	uint8_t Depth;
+	uint32_t PollUs;               // 0 = served when a frame arrives
+	uint32_t CostUs;               // Receiver time per frame
+	const char *Interface;
+} Options_t;
+
+typedef struct {
+	const FDCAN_FrameTypeDef_t *Expect; // Self-check: frames in order
+	uint32_t ExpectCount;
+	uint32_t Index;
+	uint32_t Mismatch;
+} Receiver_t;
+
+static uint64_t simUs;
+static uint64_t simBits;
+static CANSTATS_HandleTypeDef_t stats;
+
+static uint32_t SIM_US(void) {
+	return (uint32_t) simUs;
+}
+
+static uint32_t SIM_TICKS(void) {
+	return (uint32_t) simBits;
+}
+
+static uint16_t SIM_TIMESTAMP(void) {
+	return (uint16_t) simBits;
+}
+
+static uint64_t NOW_NS(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000U + (uint64_t) ts.tv_nsec;
+}
+
+/* Same frame, RX timestamp aside */
+static uint8_t SAME_FRAME(const FDCAN_FrameTypeDef_t *a,
+		const FDCAN_FrameTypeDef_t *b) {
+	if (a->w0 != b->w0
+			|| (a->w1 & ~FDCAN_ELEM_RXTS_MASK) != (b->w1 & ~FDCAN_ELEM_RXTS_MASK)) {
+		return 0;
+	}
+	uint32_t length = FDCAN_FRAME_IS_REMOTE(a) ? 0 : FDCAN_FRAME_GET_LEN(a);
+	return memcmp(FDCAN_FRAME_CDATA(a), FDCAN_FRAME_CDATA(b), length) == 0;
+}
+
+/* The receiver: statistics, the check, and its time per frame */
+static uint32_t costUs;
+
+static void DELIVER(void *ctx, const FDCAN_FrameTypeDef_t *pFrame) {
+	Receiver_t *r = (Receiver_t*) ctx;
+
+	CANSTATS_FRAME(&stats, pFrame, CANSTATS_RX);
+	if (r->Expect != NULL) {
+		if (r->Index >= r->ExpectCount || !SAME_FRAME(pFrame, &r->Expect[r->Index])) {
+			r->Mismatch++;
+		}
+		r->Index++;
+	}
+	simUs += costUs;
+}
+
+/**
+ * @brief  Replay an image on the virtual clock
+ * @retval Host nanoseconds spent
+ */
+static uint64_t RUN(CANRP_HandleTypeDef_t *h, Receiver_t *r,
+		const uint8_t *image, uint32_t length, const Options_t *o) {
+	memset(h, 0, sizeof(*h));
+	h->Image = image;
+	h->Length = length;
+	h->Interface = o->Interface;
+	h->Mode = o->Mode;
+	h->ScalePermille = o->ScalePermille;
+	h->FifoDepth = o->Depth;
+	h->GetUs = SIM_US;
+	h->Deliver = DELIVER;
+	h->Ctx = r;
+	costUs = o->CostUs;
+	simUs = SIM_START_US;
+
+	memset(&stats, 0, sizeof(stats));
+	stats.NominalKbps = CHECK_KBPS;
+	stats.DataKbps = 2000;
+	stats.BucketMs = 100;
+	stats.TicksPerUs = 1;
+	stats.GetTicks = SIM_US;
+	CANSTATS_INIT(&stats);
+
+	uint64_t t0 = NOW_NS();
+	CANRP_INIT(h);
+	while (!h->Done) {
+		CANRP_POLL(h, 0xFFFFFFFFU);
+		uint32_t wait = CANRP_NEXT_US(h);
+		if (wait == CANRP_IDLE) {
+			break;
+		}
+		simUs += o->PollUs ? o->PollUs : wait;
+	}
+	return NOW_NS() - t0;
+}
+
+/***** Generated Log *****/
+
+static uint32_t rngState = 0x9E3779B9U;
+
+static uint32_t RANDOM(void) {
+	rngState ^= rngState << 13;
+	rngState ^= rngState >> 17;
+	rngState ^= rngState << 5;
+	return rngState;
+}
+
+/* One candump -L line, the way Tools/cancap_decode.c writes them */
+static size_t PRINT_FRAME(char *out, uint64_t us, const char *iface,
+		const FDCAN_FrameTypeDef_t *f) {
+	const uint8_t *data = FDCAN_FRAME_CDATA(f);
+	uint8_t fd = FDCAN_FRAME_IS_FD(f);
+	size_t n = (size_t) sprintf(out, "(%llu.%06llu) %s ",
+			(unsigned long long) (us / 1000000U),
+			(unsigned long long) (us % 1000000U), iface);
+	n += (size_t) sprintf(&out[n], FDCAN_FRAME_IS_EXTENDED(f) ? "%08X" : "%03X",
+			(unsigned) FDCAN_FRAME_GET_ID(f));
+	if (FDCAN_FRAME_IS_REMOTE(f)) {
+		return n + (size_t) sprintf(&out[n], "#R%u\n", FDCAN_FRAME_GET_DLC(f));
+	}
+	if (fd) {
+		n += (size_t) sprintf(&out[n], "##%X",
+				FDCAN_FRAME_IS_BRS(f) | (FDCAN_FRAME_GET_ESI(f) << 1));
+	} else {
+		out[n++] = '#';
+	}
+	for (uint32_t i = 0; i < FDCAN_FRAME_GET_LEN(f); i++) {
+		// Byte separators are allowed, write some
+		n += (size_t) sprintf(&out[n], (i == 4U && fd) ? ".%02X" : "%02X", data[i]);
+	}
+	out[n++] = '\n';
+	return n;
+}
+
+/* Frame i of the generated log: every format and flag in turn */
+static void MAKE_FRAME(FDCAN_FrameTypeDef_t *f, uint32_t i) {
+	static const uint8_t fdBytes[] = { 12, 16, 20, 24, 32, 48, 64 };
+	uint32_t bytes = 0;
+
+	memset(f, 0, sizeof(*f));
+	switch (i % 6U) {
+	case 0:
+		FDCAN_FRAME_SET_ID(f, RANDOM() & FDCAN_ELEM_STDID_MASK, 0);
+		bytes = RANDOM() % 9U;
+		FDCAN_FRAME_SET_CONTROL(f, (uint8_t) bytes, 0, 0);
+		break;
+	case 1:
+		FDCAN_FRAME_SET_ID(f, RANDOM() & FDCAN_ELEM_EXTID_MASK, 1);
+		bytes = 8;
+		FDCAN_FRAME_SET_CONTROL(f, 8, 0, 0);
+		break;
+	case 2:
+		FDCAN_FRAME_SET_ID(f, RANDOM() & FDCAN_ELEM_STDID_MASK, 0);
+		bytes = fdBytes[RANDOM() % sizeof(fdBytes)];
+		FDCAN_FRAME_SET_CONTROL(f, FDCAN_BYTES_TO_DLC(bytes), 1, 1);
+		break;
+	case 3:
+		FDCAN_FRAME_SET_ID(f, RANDOM() & FDCAN_ELEM_EXTID_MASK, 1);
+		bytes = RANDOM() % 9U;
+		FDCAN_FRAME_SET_CONTROL(f, (uint8_t) bytes, 1, 0);
+		f->w0 |= 1UL << FDCAN_ELEM_ESI_POS;
+		break;
+	case 4:
+		FDCAN_FRAME_SET_ID(f, RANDOM() & FDCAN_ELEM_STDID_MASK, 0);
+		FDCAN_FRAME_SET_CONTROL(f, (uint8_t) (RANDOM() % 9U), 0, 0);
+		FDCAN_FRAME_SET_REMOTE(f);
+		break;
+	default:
+		FDCAN_FRAME_SET_ID(f, 0x100U + (RANDOM() & 0xFU), 0);
+		bytes = 8;
+		FDCAN_FRAME_SET_CONTROL(f, 8, 0, 0);
+		break;
+	}
+	for (uint32_t b = 0; b < bytes; b++) {
+		FDCAN_FRAME_DATA(f)[b] = (uint8_t) RANDOM();
+	}
+}
+
+typedef struct {
+	FDCAN_FrameTypeDef_t Frames[CHECK_FRAMES];
+	uint64_t OffsetUs[CHECK_FRAMES]; // From the first frame
+	char Text[CHECK_FRAMES * 512U];
+	size_t TextLength;
+	uint32_t SkipLines;            // Comments, can1 and error frames
+	uint32_t BadLines;
+	uint8_t Capture[CHECK_FRAMES * (CANCAP_RECORD_MAX + 1U)];
+	uint32_t CaptureLength;
+	uint64_t SpanUs;
+	uint32_t Bursts;
+} Log_t;
+
+/* The expected frames, as candump text and as a capture stream */
+static void MAKE_LOG(Log_t *log) {
+	static const uint64_t epochUs = 1700000000ULL * 1000000U + 123456U;
+	static CANCAP_HandleTypeDef_t cap;
+	char *t = log->Text;
+	uint64_t us = 0;
+
+	memset(log, 0, sizeof(*log));
+	t += sprintf(t, "# Generated by trace_replay\n\n");
+	log->SkipLines = 1;
+	for (uint32_t i = 0; i < CHECK_FRAMES; i++) {
+		uint32_t inBurst = i % CHECK_BURST_EVERY;
+		if (i != 0) {
+			us += (inBurst != 0 && inBurst < CHECK_BURST_FRAMES) ?
+					CHECK_BURST_GAP_US : CHECK_SPACING_US;
+		}
+		log->Bursts += (inBurst == 0);
+		MAKE_FRAME(&log->Frames[i], i);
+		log->OffsetUs[i] = us;
+		t += PRINT_FRAME(t, epochUs + us, "can0", &log->Frames[i]);
+
+		if (i % 37U == 5U) {
+			FDCAN_FrameTypeDef_t other;
+			MAKE_FRAME(&other, i);
+			t += PRINT_FRAME(t, epochUs + us, "can1", &other);
+			log->SkipLines++;
+		}
+		if (i % 101U == 7U) {
+			t += sprintf(t, "(%llu.%06llu) can0 20000004#0004000000000000\n",
+					(unsigned long long) ((epochUs + us) / 1000000U),
+					(unsigned long long) ((epochUs + us) % 1000000U));
+			log->SkipLines++;
+		}
+		if (i == CHECK_FRAMES / 2U) {
+			t += sprintf(t, "(1700000000.500000) can0 12G#00\n");
+			log->BadLines++;
+		}
+	}
+	log->TextLength = (size_t) (t - log->Text);
+	log->SpanUs = us;
+
+	/* The capture a sniffer would have made of the same bus */
+	memset(&cap, 0, sizeof(cap));
+	simBits = 1000U;
+	cap.NominalKbps = CHECK_KBPS;
+	cap.TicksPerBit = 1;
+	cap.GetTicks = SIM_TICKS;
+	cap.GetTimestamp = SIM_TIMESTAMP;
+	CANCAP_INIT(&cap);
+	uint64_t startBits = simBits;
+	for (uint32_t i = 0; i <= CHECK_FRAMES; i++) {
+		const uint8_t *data;
+		uint32_t length;
+		while ((length = CANCAP_PEEK(&cap, &data)) != 0) {
+			memcpy(&log->Capture[log->CaptureLength], data, length);
+			log->CaptureLength += length;
+			CANCAP_RELEASE(&cap, length);
+		}
+		if (i == CHECK_FRAMES) {
+			break;
+		}
+		FDCAN_FrameTypeDef_t f = log->Frames[i];
+		simBits = startBits + log->OffsetUs[i] * CHECK_KBPS / 1000U;
+		f.w1 |= (uint16_t) simBits;   // RX timestamp at SOF
+		CANCAP_FRAME(&cap, &f);
+	}
+}
+
+static uint32_t failures;
+
+static void CHECK(const char *what, uint8_t ok) {
+	printf("  %-52s %s\n", what, ok ? "pass" : "FAIL");
+	failures += !ok;
+}
+
+static void PRINT_RESULT(const char *name, const CANRP_HandleTypeDef_t *h,
+		uint64_t hostNs) {
+	printf("%-22s %6lu %9lu %8lu %7lu %9lu %10.3f %7.1f %7lu %11.0f\n", name,
+			(unsigned long) h->Frames, (unsigned long) h->Delivered,
+			(unsigned long) h->Overruns, (unsigned long) h->Skipped,
+			(unsigned long) h->Malformed, h->DoneUs / 1e6,
+			h->Delivered ? (double) h->LatencySumUs / h->Delivered : 0.0,
+			(unsigned long) h->LatencyMaxUs,
+			hostNs ? h->Frames * 1e9 / hostNs : 0.0);
+}
+
+static int SELF_CHECK(void) {
+	static Log_t log;
+	static CANRP_HandleTypeDef_t h;
+	Receiver_t r;
+	uint64_t ns;
+
+	MAKE_LOG(&log);
+	const uint8_t *text = (const uint8_t*) log.Text;
+	uint32_t textLength = (uint32_t) log.TextLength;
+	printf("Generated log: %u frames over %.3f s, %u bursts of %u %u us apart,"
+			" %u lines to skip, %u malformed\n\n", CHECK_FRAMES,
+			log.SpanUs / 1e6, log.Bursts, CHECK_BURST_FRAMES, CHECK_BURST_GAP_US,
+			log.SkipLines, log.BadLines);
+	printf("Run                    Frames Delivered Overruns Skipped Malformed"
+			"  Replay s  Lat us  Max us  Host fr/s\n");
+
+	Options_t fast = { CANRP_FAST, 1000, CANRP_FIFO_MAX, 0, 0, "can0" };
+	memset(&r, 0, sizeof(r));
+	r.Expect = log.Frames;
+	r.ExpectCount = CHECK_FRAMES;
+	ns = RUN(&h, &r, text, textLength, &fast);
+	PRINT_RESULT("candump, fast", &h, ns);
+	uint8_t fastOk = r.Mismatch == 0 && h.Delivered == CHECK_FRAMES
+			&& h.Skipped == log.SkipLines && h.Malformed == log.BadLines
+			&& h.Overruns == 0;
+
+	Options_t recorded = { CANRP_AS_RECORDED, 1000, 3, 0, 0, "can0" };
+	memset(&r, 0, sizeof(r));
+	ns = RUN(&h, &r, text, textLength, &recorded);
+	PRINT_RESULT("candump, as recorded", &h, ns);
+	uint8_t recordedOk = h.DoneUs == log.SpanUs && h.LatencyMaxUs == 0
+			&& h.Overruns == 0 && h.Delivered == CHECK_FRAMES;
+
+	Options_t scaled = { CANRP_SCALED, 2000, 3, 0, 0, "can0" };
+	memset(&r, 0, sizeof(r));
+	ns = RUN(&h, &r, text, textLength, &scaled);
+	PRINT_RESULT("candump, scaled x2", &h, ns);
+	uint8_t scaledOk = h.DoneUs == log.SpanUs / 2U && h.LatencyMaxUs == 0
+			&& h.Delivered == CHECK_FRAMES;
+
+	// 100 us per frame: the rest of a burst arrives during its first frame,
+	// three fit, and the third waits three frames less three gaps
+	Options_t slow = { CANRP_AS_RECORDED, 1000, 3, 0, 100, "can0" };
+	memset(&r, 0, sizeof(r));
+	ns = RUN(&h, &r, text, textLength, &slow);
+	PRINT_RESULT("candump, 100 us/frame", &h, ns);
+	uint32_t lost = log.Bursts * (CHECK_BURST_FRAMES - 1U - 3U);
+	uint8_t slowOk = h.Overruns == lost && h.Delivered == CHECK_FRAMES - lost
+			&& h.LatencyMaxUs == 3U * (100U - CHECK_BURST_GAP_US);
+
+	// Polled every 1 ms: what arrived since the last poll, beyond 3, is lost
+	Options_t polled = { CANRP_AS_RECORDED, 1000, 3, 1000, 0, "can0" };
+	memset(&r, 0, sizeof(r));
+	ns = RUN(&h, &r, text, textLength, &polled);
+	PRINT_RESULT("candump, 1 ms polling", &h, ns);
+	uint32_t pollLost = 0;
+	for (uint32_t i = 0, poll = 0; i < CHECK_FRAMES; poll += 1000U) {
+		uint32_t arrived = 0;
+		for (; i < CHECK_FRAMES && log.OffsetUs[i] <= poll; i++) {
+			arrived++;
+		}
+		pollLost += (arrived > 3U) ? arrived - 3U : 0;
+	}
+	uint8_t polledOk = h.Overruns == pollLost && h.LatencyMaxUs < 1000U
+			&& h.Delivered + h.Overruns == CHECK_FRAMES;
+
+	memset(&r, 0, sizeof(r));
+	r.Expect = log.Frames;
+	r.ExpectCount = CHECK_FRAMES;
+	ns = RUN(&h, &r, log.Capture, log.CaptureLength, &fast);
+	PRINT_RESULT("capture, fast", &h, ns);
+	uint8_t captureOk = r.Mismatch == 0 && h.Delivered == CHECK_FRAMES
+			&& h.Format == CANRP_FMT_CAPTURE && h.Malformed == 0;
+	memset(&r, 0, sizeof(r));
+	ns = RUN(&h, &r, log.Capture, log.CaptureLength, &recorded);
+	PRINT_RESULT("capture, as recorded", &h, ns);
+	captureOk = captureOk && h.DoneUs == log.SpanUs && h.LatencyMaxUs == 0;
+
+	printf("\n");
+	CHECK("Fast: every frame as written, skips and errors counted", fastOk);
+	CHECK("As recorded: on time, span as recorded", recordedOk);
+	CHECK("Scaled x2: half the span", scaledOk);
+	CHECK("100 us/frame: burst overruns and latency as expected", slowOk);
+	CHECK("1 ms polling: overruns of a 3-element FIFO", polledOk);
+	CHECK("Capture stream: same frames and span", captureOk);
+	return failures ? 1 : 0;
+}
+
+/***** Log File *****/
+
+static int REPLAY_FILE(const char *path, const Options_t *o) {
+	static CANRP_HandleTypeDef_t h;
+	Receiver_t r;
+
+	FILE *in = fopen(path, "rb");
+	if (in == NULL) {
+		perror(path);
+		return 2;
+	}
+	fseek(in, 0, SEEK_END);
+	long size = ftell(in);
+	fseek(in, 0, SEEK_SET);
+	uint8_t *buf = malloc(size > 0 ? (size_t) size : 1U);
+	size_t length = fread(buf, 1, (size_t) size, in);
+	fclose(in);
+
+	memset(&r, 0, sizeof(r));
+	uint64_t ns = RUN(&h, &r, buf, (uint32_t) length, o);
+	printf("%s: %s, %s", path,
+			(h.Format == CANRP_FMT_CAPTURE) ? "capture" : "candump",
+			(o->Mode == CANRP_FAST) ? "fast" :
+			(o->Mode == CANRP_SCALED) ? "scaled" : "as recorded");
+	if (o->Mode == CANRP_SCALED) {
+		printf(" x%.3f", o->ScalePermille / 1000.0);
+	}
+	printf(", FIFO %u, poll %lu us, %lu us/frame\n\n", h.FifoDepth,
+			(unsigned long) o->PollUs, (unsigned long) o->CostUs);
+	printf("Run                    Frames Delivered Overruns Skipped Malformed"
+			"  Replay s  Lat us  Max us  Host fr/s\n");
+	PRINT_RESULT("replay", &h, ns);
+	printf("\n%lu filtered, %lu lost in the capture itself, FIFO peak %u,"
+			" bus load peak %lu.%lu%% per 100 ms\n", (unsigned long) h.Filtered,
+			(unsigned long) h.SourceDropped, h.FifoPeak,
+			(unsigned long) CANSTATS_PEAK_PERMILLE(&stats) / 10U,
+			(unsigned long) CANSTATS_PEAK_PERMILLE(&stats) % 10U);
+
+	/* Busiest identifiers */
+	uint8_t shown[CANSTATS_ID_SLOTS] = { 0 };
+	printf("\nID           Frames      Bytes\n");
+	for (uint32_t k = 0; k < SIM_TOP_IDS; k++) {
+		int32_t best = -1;
+		for (uint32_t n = 0; n < CANSTATS_ID_SLOTS; n++) {
+			const CANSTATS_IdEntryTypeDef_t *e = &stats.Ids[n];
+			if (e->Key != 0 && !shown[n]
+					&& (best < 0 || e->RxFrames > stats.Ids[best].RxFrames)) {
+				best = (int32_t) n;
+			}
+		}
+		if (best < 0) {
+			break;
+		}
+		const CANSTATS_IdEntryTypeDef_t *e = &stats.Ids[best];
+		shown[best] = 1;
+		printf(CANSTATS_ENTRY_EXTENDED(e) ? "%08lX %10lu %10lu\n" :
+				"%03lX      %10lu %10lu\n",
+				(unsigned long) CANSTATS_ENTRY_ID(e), (unsigned long) e->RxFrames,
+				(unsigned long) e->Bytes);
+	}
+	if (stats.Untracked) {
+		printf("%lu frames of IDs beyond the table\n",
+				(unsigned long) stats.Untracked);
+	}
+	free(buf);
+	return (h.Overruns || h.Malformed) ? 1 : 0;
+}
+
+int main(int argc, char **argv) {
+	Options_t o = { CANRP_AS_RECORDED, 1000, 3, 0, 0, NULL };
+	const char *path = NULL;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-fast") == 0) {
+			o.Mode = CANRP_FAST;
+		} else if (strcmp(argv[i], "-scale") == 0 && i + 1 < argc) {
+			o.Mode = CANRP_SCALED;
+			o.ScalePermille = (uint32_t) atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-depth") == 0 && i + 1 < argc) {
+			o.Depth = (uint8_t) atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-poll") == 0 && i + 1 < argc) {
+			o.PollUs = (uint32_t) atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-cost") == 0 && i + 1 < argc) {
+			o.CostUs = (uint32_t) atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+			o.Interface = argv[++i];
+		} else if (path == NULL && argv[i][0] != '-') {
+			path = argv[i];
+		} else {
+			fprintf(stderr, "usage: %s [-fast | -scale permille] [-depth n]"
+					" [-poll us] [-cost us] [-i can0] [log]\n", argv[0]);
+			return 2;
+		}
+	}
+	return path ? REPLAY_FILE(path, &o) : SELF_CHECK();
+}
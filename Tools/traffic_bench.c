@@ -0,0 +1,337 @@
+/**
+ ******************************************************************************
+ * @file           : traffic_bench.c
+ * @brief          : Load the traffic generator of Src/can_traffic.c puts on
+ *                   a simulated bus, against the load it was asked for.
+ *
+ * The generator is driven as in main.c: CANGEN_POLL from the transmission
+ * completed interrupt of every frame and from a TIM2 compare armed with
+ * CANGEN_NEXT_US, each interrupt served 1 to 5 us late. The TX FIFO is the
+ * FDCAN one, three elements sent in order, and the node is alone on the bus
+ * at 500 kbit/s (2 Mbit/s data phase for BRS); each frame takes its
+ * worst-case wire time.
+ *
+ * Checks, per scenario: the bus load is the requested one within 1 %, or
+ * above 99 % for line rate; bursts reach their load inside the burst
+ * windows; FD and BRS shares, identifier and DLC ranges follow the stream
+ * configuration; periodic streams lose no period below line rate.
+ *
+ * Build and run from the repository root:
+ *   gcc -O2 -IInc -o traffic_bench Tools/traffic_bench.c Src/can_traffic.c Src/can_stats.c
+ *   ./traffic_bench
+ ******************************************************************************
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "can_traffic.h"
+
+#define SIM_NOMINAL_KBPS            500U
+#define SIM_DATA_KBPS               2000U
+#define SIM_FIFO                    3U
+#define SIM_RUN_US                  20000000U // 20 s of bus time
+#define SIM_LATENCY_MIN_NS          1000U
+#define SIM_LATENCY_MAX_NS          5000U
+#define PASS_LOAD_PERMILLE          10U   // Achieved within 1 % of requested
+#define PASS_LINE_RATE_PERMILLE     990U
+#define PASS_BURST_PERMILLE         30U
+#define PASS_SHARE_PERMILLE         20U
+#define BENCH_FRAMES                10000000U
+
+/***** Bus Model *****/
+static FDCAN_FrameTypeDef_t fifo[SIM_FIFO];
+static uint32_t fifoNs[SIM_FIFO];
+static uint8_t getIndex, putIndex, fillLevel;
+static uint64_t nowNs;
+static uint32_t simWireNs[CANSTATS_FMT_COUNT][2][16];
+
+static uint32_t rngState = 0x9E3779B9U;
+
+static uint32_t RANDOM(void) {
+	rngState ^= rngState << 13;
+	rngState ^= rngState >> 17;
+	rngState ^= rngState << 5;
+	return rngState;
+}
+
+static uint64_t LATENCY_NS(void) {
+	return SIM_LATENCY_MIN_NS
+			+ RANDOM() % (SIM_LATENCY_MAX_NS - SIM_LATENCY_MIN_NS + 1U);
+}
+
+static uint32_t SIM_US(void) {
+	return (uint32_t) (nowNs / 1000U);
+}
+
+static uint32_t FRAME_NS(const FDCAN_FrameTypeDef_t *f) {
+	uint8_t format = FDCAN_FRAME_IS_BRS(f) ? CANSTATS_FMT_FD_BRS :
+			(FDCAN_FRAME_IS_FD(f) ? CANSTATS_FMT_FD : CANSTATS_FMT_CLASSIC);
+	return simWireNs[format][FDCAN_FRAME_IS_EXTENDED(f)][FDCAN_FRAME_GET_DLC(f)];
+}
+
+/* CAN1_TX_WRITE: 0 if the FIFO is full */
+static uint8_t FIFO_PUT(void *ctx, const FDCAN_FrameTypeDef_t *pFrame) {
+	(void) ctx;
+	if (fillLevel == SIM_FIFO) {
+		return 0;
+	}
+	fifo[putIndex] = *pFrame;
+	fifoNs[putIndex] = FRAME_NS(pFrame);
+	putIndex = (uint8_t) ((putIndex + 1U) % SIM_FIFO);
+	fillLevel++;
+	return 1;
+}
+
+/***** Scenarios *****/
+typedef struct {
+	const char *Name;
+	uint16_t LoadPermille;
+	uint16_t BurstLoadPermille;
+	uint32_t BurstPeriodUs;
+	uint32_t BurstLengthUs;
+	CANGEN_StreamTypeDef_t Streams[3];
+	uint8_t StreamCount;
+} Scenario_t;
+
+static const Scenario_t scenarios[] = {
+	{ "10 % classic", 100, 0, 0, 0, {
+		{ .IdMin = 0x100, .IdMax = 0x4FF, .DlcMin = 0, .DlcMax = 8, .Weight = 1 },
+	}, 1 },
+	{ "50 % + periodic", 500, 0, 0, 0, {
+		{ .IdMin = 0x080, .IdMax = 0x080, .DlcMin = 8, .DlcMax = 8,
+			.PeriodUs = 10000 },
+		{ .IdMin = 0x0A0, .IdMax = 0x0A3, .DlcMin = 4, .DlcMax = 8,
+			.PeriodUs = 2000, .JitterUs = 500 },
+		{ .IdMin = 0x200, .IdMax = 0x7FF, .DlcMin = 0, .DlcMax = 8, .Weight = 1 },
+	}, 3 },
+	{ "Line rate", 1000, 0, 0, 0, {
+		{ .IdMin = 0x100, .IdMax = 0x7FF, .DlcMin = 8, .DlcMax = 8, .Weight = 3 },
+		{ .IdMin = 0x18FF0000, .IdMax = 0x18FFFFFF, .Extended = 1,
+			.DlcMin = 0, .DlcMax = 8, .Weight = 1 },
+	}, 2 },
+	{ "30 %, 90 % bursts", 300, 900, 100000, 20000, {
+		{ .IdMin = 0x100, .IdMax = 0x4FF, .DlcMin = 1, .DlcMax = 8, .Weight = 1 },
+	}, 1 },
+	{ "60 % FD/BRS mix", 600, 0, 0, 0, {
+		{ .IdMin = 0x300, .IdMax = 0x3FF, .DlcMin = 8, .DlcMax = 15,
+			.FdPermille = 500, .BrsPermille = 500, .Weight = 1 },
+	}, 1 },
+};
+#define SCENARIO_COUNT  (sizeof(scenarios) / sizeof(scenarios[0]))
+
+typedef struct {
+	CANGEN_StreamTypeDef_t Streams[3];
+	CANGEN_HandleTypeDef_t Gen;
+	uint64_t BusyNs;
+	uint64_t BurstBusyNs;          // Inside the burst windows
+	uint64_t BurstNs;
+	uint32_t RangeErrors;          // Identifier or DLC outside its stream
+	uint32_t Polls;
+} Result_t;
+
+/* Part of [start, end) inside the burst windows */
+static uint64_t BURST_OVERLAP(const Scenario_t *sc, uint64_t start,
+		uint64_t end) {
+	uint64_t period = (uint64_t) sc->BurstPeriodUs * 1000U;
+	uint64_t length = (uint64_t) sc->BurstLengthUs * 1000U;
+	uint64_t in = 0;
+
+	for (uint64_t w = start / period * period; w < end; w += period) {
+		uint64_t lo = (start > w) ? start : w;
+		uint64_t hi = (end < w + length) ? end : w + length;
+		in += (hi > lo) ? hi - lo : 0;
+	}
+	return in;
+}
+
+static uint8_t IN_STREAM(const Scenario_t *sc, const FDCAN_FrameTypeDef_t *f) {
+	uint32_t id = FDCAN_FRAME_GET_ID(f);
+	uint8_t dlc = FDCAN_FRAME_GET_DLC(f);
+
+	for (uint8_t n = 0; n < sc->StreamCount; n++) {
+		const CANGEN_StreamTypeDef_t *s = &sc->Streams[n];
+		uint8_t dlcMax = (!FDCAN_FRAME_IS_FD(f) && s->DlcMax > 8U) ? 8U : s->DlcMax;
+		uint8_t dlcMin = (s->DlcMin < dlcMax) ? s->DlcMin : dlcMax;
+		if (s->Extended == FDCAN_FRAME_IS_EXTENDED(f) && id >= s->IdMin
+				&& id <= s->IdMax && dlc >= dlcMin && dlc <= dlcMax
+				&& (FDCAN_FRAME_IS_FD(f) || !FDCAN_FRAME_IS_BRS(f))) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void RUN(const Scenario_t *sc, Result_t *r) {
+	const uint64_t endNs = (uint64_t) SIM_RUN_US * 1000U;
+	CANGEN_HandleTypeDef_t *g = &r->Gen;
+	uint64_t busEndNs = 0, tcNs = UINT64_MAX, timerNs = 0;
+	uint8_t busIdle = 1;
+
+	memset(r, 0, sizeof(*r));
+	memcpy(r->Streams, sc->Streams, sizeof(r->Streams));
+	getIndex = putIndex = fillLevel = 0;
+	nowNs = 0;
+	rngState = 0x9E3779B9U;
+
+	g->Streams = r->Streams;
+	g->StreamCount = sc->StreamCount;
+	g->NominalKbps = SIM_NOMINAL_KBPS;
+	g->DataKbps = SIM_DATA_KBPS;
+	g->LoadPermille = sc->LoadPermille;
+	g->BurstLoadPermille = sc->BurstLoadPermille;
+	g->BurstPeriodUs = sc->BurstPeriodUs;
+	g->BurstLengthUs = sc->BurstLengthUs;
+	g->GetUs = SIM_US;
+	g->Transmit = FIFO_PUT;
+	CANGEN_INIT(g);
+	memcpy(simWireNs, g->WireNsTable, sizeof(simWireNs));
+
+	while (nowNs < endNs) {
+		uint64_t next = endNs;
+		if (!busIdle && busEndNs < next) next = busEndNs;
+		if (tcNs < next) next = tcNs;
+		if (timerNs < next) next = timerNs;
+		nowNs = next;
+
+		if (!busIdle && busEndNs == nowNs) {
+			getIndex = (uint8_t) ((getIndex + 1U) % SIM_FIFO);
+			fillLevel--;
+			busIdle = 1;
+			if (tcNs == UINT64_MAX) {
+				tcNs = nowNs + LATENCY_NS();
+			}
+		}
+		// Either interrupt polls and re-arms the compare, as main.c does
+		uint8_t poll = 0;
+		if (tcNs == nowNs) {
+			tcNs = UINT64_MAX;
+			poll = 1;
+		}
+		if (timerNs == nowNs) {
+			timerNs = UINT64_MAX;
+			poll = 1;
+		}
+		if (poll) {
+			CANGEN_POLL(g);
+			r->Polls++;
+			uint32_t wait = CANGEN_NEXT_US(g);
+			if (wait != CANGEN_IDLE) {
+				// The compare fires on the next microsecond tick at the earliest
+				uint64_t tick = ((uint64_t) SIM_US() + (wait ? wait : 1U)) * 1000U;
+				timerNs = tick + LATENCY_NS();
+			}
+		}
+
+		if (busIdle && fillLevel != 0 && nowNs < endNs) {
+			const FDCAN_FrameTypeDef_t *f = &fifo[getIndex];
+			uint64_t end = nowNs + fifoNs[getIndex];
+			r->RangeErrors += !IN_STREAM(sc, f);
+			r->BusyNs += fifoNs[getIndex];
+			if (sc->BurstPeriodUs != 0) {
+				r->BurstBusyNs += BURST_OVERLAP(sc, nowNs, end);
+			}
+			busEndNs = end;
+			busIdle = 0;
+		}
+	}
+	if (sc->BurstPeriodUs != 0) {
+		r->BurstNs = BURST_OVERLAP(sc, 0, endNs);
+	}
+}
+
+static uint64_t NOW_NS(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000U + (uint64_t) ts.tv_nsec;
+}
+
+static uint32_t Diff(uint32_t a, uint32_t b) {
+	return (a > b) ? a - b : b - a;
+}
+
+int main(void) {
+	static Result_t res[SCENARIO_COUNT];
+	const uint64_t runNs = (uint64_t) SIM_RUN_US * 1000U;
+	uint32_t failures = 0;
+
+	printf("%u kbit/s, %u kbit/s data phase, %u-element TX FIFO, interrupts "
+			"%u-%u us late, %u s\n\n", SIM_NOMINAL_KBPS, SIM_DATA_KBPS, SIM_FIFO,
+			SIM_LATENCY_MIN_NS / 1000U, SIM_LATENCY_MAX_NS / 1000U,
+			SIM_RUN_US / 1000000U);
+	printf("Scenario            Requested  Generator  Bus  Burst  Frames"
+			"     FD  BRS  Polls/frame  Skipped  Range  Result\n");
+	for (uint32_t k = 0; k < SCENARIO_COUNT; k++) {
+		const Scenario_t *sc = &scenarios[k];
+		Result_t *r = &res[k];
+		RUN(sc, r);
+		const CANGEN_HandleTypeDef_t *g = &r->Gen;
+
+		uint32_t requested;
+		uint32_t achieved = CANGEN_LOAD_PERMILLE(g, &requested);
+		uint32_t bus = (uint32_t) (r->BusyNs * 1000U / runNs);
+		uint32_t burst = r->BurstNs ? (uint32_t) (r->BurstBusyNs * 1000U / r->BurstNs) : 0;
+		uint32_t skipped = 0;
+		for (uint8_t n = 0; n < sc->StreamCount; n++) {
+			skipped += r->Streams[n].Skipped;
+		}
+
+		uint8_t ok = (sc->LoadPermille >= 1000U) ?
+				bus >= PASS_LINE_RATE_PERMILLE :
+				Diff(bus, requested) <= PASS_LOAD_PERMILLE && skipped == 0;
+		ok = ok && r->RangeErrors == 0;
+		if (sc->BurstPeriodUs != 0) {
+			ok = ok && Diff(burst, sc->BurstLoadPermille) <= PASS_BURST_PERMILLE;
+		}
+		const CANGEN_StreamTypeDef_t *s = &sc->Streams[0];
+		if (s->FdPermille != 0) {
+			uint32_t fd = (uint32_t) ((uint64_t) g->FdFrames * 1000U / g->Frames);
+			uint32_t brs = (uint32_t) ((uint64_t) g->BrsFrames * 1000U / g->FdFrames);
+			ok = ok && Diff(fd, s->FdPermille) <= PASS_SHARE_PERMILLE
+					&& Diff(brs, s->BrsPermille) <= PASS_SHARE_PERMILLE;
+		}
+		printf("%-19s %7lu.%lu %8lu.%lu %4lu.%lu %4lu.%lu %7lu %6lu %4lu %12.2f"
+				" %8lu %6lu  %s\n", sc->Name,
+				(unsigned long) requested / 10U, (unsigned long) requested % 10U,
+				(unsigned long) achieved / 10U, (unsigned long) achieved % 10U,
+				(unsigned long) bus / 10U, (unsigned long) bus % 10U,
+				(unsigned long) burst / 10U, (unsigned long) burst % 10U,
+				(unsigned long) g->Frames, (unsigned long) g->FdFrames,
+				(unsigned long) g->BrsFrames, (double) r->Polls / g->Frames,
+				(unsigned long) skipped, (unsigned long) r->RangeErrors,
+				ok ? "pass" : "FAIL");
+		failures += !ok;
+	}
+
+	// Periodic streams: one frame per period
+	const Result_t *p = &res[1];
+	for (uint8_t n = 0; n < 2; n++) {
+		uint32_t expect = SIM_RUN_US / scenarios[1].Streams[n].PeriodUs;
+		uint8_t ok = Diff(p->Streams[n].Frames, expect) <= 1U;
+		printf("Periodic 0x%03lX every %lu us: %lu frames, %lu expected: %s\n",
+				(unsigned long) scenarios[1].Streams[n].IdMin,
+				(unsigned long) scenarios[1].Streams[n].PeriodUs,
+				(unsigned long) p->Streams[n].Frames, (unsigned long) expect,
+				ok ? "pass" : "FAIL");
+		failures += !ok;
+	}
+
+	// Cost: line rate fill frames, the FIFO drained after every poll
+	static CANGEN_StreamTypeDef_t stream = { .IdMin = 0x100, .IdMax = 0x7FF,
+			.DlcMin = 0, .DlcMax = 8, .Weight = 1 };
+	static CANGEN_HandleTypeDef_t g = { .Streams = &stream, .StreamCount = 1,
+			.NominalKbps = SIM_NOMINAL_KBPS, .LoadPermille = 1000,
+			.GetUs = SIM_US, .Transmit = FIFO_PUT };
+	nowNs = 0;
+	CANGEN_INIT(&g);
+	uint64_t start = NOW_NS();
+	for (uint32_t k = 0; k < BENCH_FRAMES; k++) {
+		nowNs += 300000U;              // One frame time between polls
+		getIndex = putIndex = fillLevel = 0;
+		CANGEN_POLL(&g);
+	}
+	uint64_t ns = NOW_NS() - start;
+	printf("CANGEN_POLL: %.1f ns per frame on this host (%lu frames)\n",
+			(double) ns / g.Frames, (unsigned long) g.Frames);
+	return failures ? 1 : 0;
+}
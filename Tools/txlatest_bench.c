@@ -0,0 +1,350 @@
+/**
+ ******************************************************************************
+ * @file           : txlatest_bench.c
+ * @brief          : Data age of the scheduled frames under saturated load,
+ *                   TX FIFO drop-new against latest-value (TX_LATEST).
+ *
+ * The node's TX FIFO is modelled as the FDCAN one: three elements, the get
+ * index is the only frame in arbitration, a cancel frees the slot at once
+ * only at the get index and other cancelled slots are skipped when the get
+ * index reaches them, a cancel of the frame on the bus finishes at its end
+ * with TXBTO set. The latest-value releases go through CANTXL_SUBMIT, and
+ * each finished cancel raises TCF, which runs CANTXL_COMPLETE as the FDCAN
+ * interrupt does once the release is over. Other nodes offer
+ * higher-priority traffic at a swept share of the bus plus low-priority
+ * filler, so the bus never idles.
+ *
+ * Data age is taken at the end of each successful transmission: now minus
+ * the release that produced the payload. Bus 500 kbit/s classic, the node's
+ * schedule is USER_TX_SCHED_CONFIG.
+ *
+ * Build and run from the repository root:
+ *   gcc -O2 -IInc -o txlatest_bench Tools/txlatest_bench.c Src/can_stats.c \
+ *       Src/can_txlatest.c
+ *   ./txlatest_bench
+ ******************************************************************************
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "can_stats.h"
+#include "can_txlatest.h"
+
+#define SIM_BIT_NS                  2000U // 500 kbit/s
+#define SIM_FIFO                    3U
+#define SIM_RUN_US                  20000000ULL // 20 s of bus time
+#define SIM_OWN_COUNT               4U
+#define SIM_FOREIGN_COUNT           8U
+#define SIM_FOREIGN_CAP             1000U // Pending frames per foreign ID
+
+#define POLICY_DROP                 0     // CAN1_TxFrame: new release dropped
+#define POLICY_LATEST               1     // CANTXL_SUBMIT
+
+/* Node schedule, as USER_TX_SCHED_CONFIG */
+static const struct {
+	uint32_t Id;
+	uint32_t PeriodUs;
+	uint8_t Bytes;
+	const char *Name;
+} ownTable[SIM_OWN_COUNT] = {
+	{ 0x100, 10000, 8, "EngineData" },
+	{ 0x123, 200000, 2, "Hi" },
+	{ 0x200, 20000, 8, "BrakeStatus" },
+	{ 0x300, 100000, 8, "Heartbeat" },
+};
+
+typedef struct {
+	uint64_t NextNs;
+	uint64_t LastReleaseNs;            // Payload of the newest release
+	uint32_t Releases;
+	uint32_t Sent;
+	uint32_t Dropped;
+	uint32_t Replaced;
+	uint64_t AgeSumNs;
+	uint64_t AgeMaxNs;
+} Own_t;
+
+typedef struct {
+	uint32_t Id;
+	uint64_t PeriodNs;
+	uint64_t NextNs;
+	uint32_t Pending;
+} Foreign_t;
+
+typedef struct {
+	uint8_t Pending;                   // TXBRP
+	uint8_t Sent;                      // TXBTO
+	uint8_t CancelRequested;           // TXBCR, of the frame on the bus
+	uint8_t Own;                       // Index into ownTable, kept once sent as T0 is
+	uint64_t ReleasedNs;               // Payload sampled
+} Slot_t;
+
+static Own_t own[SIM_OWN_COUNT];
+static Foreign_t foreign[SIM_FOREIGN_COUNT];
+static Slot_t slot[SIM_FIFO];
+static uint8_t getIndex, putIndex, fillLevel; // fillLevel counts holes too
+static CANTXL_HandleTypeDef_t hTxl;
+static uint8_t tcfFlag;                // IR.TCF, served after the release
+
+static uint64_t FRAME_NS(uint8_t bytes) {
+	return (uint64_t) CANSTATS_WIRE_BITS(CANSTATS_FMT_CLASSIC, 0, bytes, NULL)
+			* SIM_BIT_NS;
+}
+
+/* Get index past cancelled slots, as the FDCAN does */
+static void SKIP_HOLES(void) {
+	while (fillLevel != 0 && !slot[getIndex].Pending) {
+		getIndex = (uint8_t) ((getIndex + 1U) % SIM_FIFO);
+		fillLevel--;
+	}
+}
+
+static uint8_t FIFO_PUT(uint8_t o, uint64_t releasedNs) {
+	if (fillLevel == SIM_FIFO) {
+		return 0;
+	}
+	slot[putIndex].Pending = 1;
+	slot[putIndex].Sent = 0;
+	slot[putIndex].CancelRequested = 0;
+	slot[putIndex].Own = o;
+	slot[putIndex].ReleasedNs = releasedNs;
+	putIndex = (uint8_t) ((putIndex + 1U) % SIM_FIFO);
+	fillLevel++;
+	return 1;
+}
+
+/* Bus state */
+static uint64_t busEndNs;              // End of the frame on the bus
+static int busSlot = -1;               // FIFO slot on the bus, -1 = foreign or idle
+static uint8_t busIdle = 1;
+
+static void FRAME_END(uint64_t now) {
+	if (busSlot >= 0) {
+		Slot_t *s = &slot[busSlot];
+		Own_t *o = &own[s->Own];
+		uint64_t age = now - s->ReleasedNs;
+		o->Sent++;
+		o->AgeSumNs += age;
+		if (age > o->AgeMaxNs) {
+			o->AgeMaxNs = age;
+		}
+		s->Pending = 0;
+		s->Sent = 1;
+		if (s->CancelRequested) {
+			s->CancelRequested = 0;
+			tcfFlag = 1;               // Cancel finished, too late
+		}
+		SKIP_HOLES();                  // It was at the get index
+	}
+	busSlot = -1;
+	busIdle = 1;
+}
+
+/* CANTXL hooks on the FIFO model */
+static void SIM_READ(void *ctx, CANTXL_FifoTypeDef_t *pFifo) {
+	(void) ctx;
+	pFifo->Pending = pFifo->Sent = 0;
+	for (uint8_t i = 0; i < SIM_FIFO; i++) {
+		FDCAN_FrameTypeDef_t f;
+		FDCAN_FRAME_SET_ID(&f, ownTable[slot[i].Own].Id, 0);
+		pFifo->T0[i] = f.w0;
+		pFifo->Pending |= (uint32_t) slot[i].Pending << i;
+		pFifo->Sent |= (uint32_t) slot[i].Sent << i;
+	}
+	pFifo->FreeLevel = (uint8_t) (SIM_FIFO - fillLevel);
+	pFifo->GetIndex = getIndex;
+}
+
+/* The frame on the bus finishes first, any other slot is removed at once */
+static void SIM_CANCEL(void *ctx, uint8_t i) {
+	(void) ctx;
+	if (!busIdle && busSlot == i) {
+		slot[i].CancelRequested = 1;
+		return;
+	}
+	slot[i].Pending = 0;
+	SKIP_HOLES();
+	tcfFlag = 1;
+}
+
+static uint8_t SIM_TRANSMIT(void *ctx, const FDCAN_FrameTypeDef_t *pFrame) {
+	(void) ctx;
+	uint32_t id = FDCAN_FRAME_GET_ID(pFrame);
+	for (uint8_t o = 0; o < SIM_OWN_COUNT; o++) {
+		if (ownTable[o].Id == id) {
+			return FIFO_PUT(o, own[o].LastReleaseNs);
+		}
+	}
+	return 0;
+}
+
+/* A parked release that found no slot counts as dropped */
+static void SIM_LOST(void *ctx, const FDCAN_FrameTypeDef_t *pFrame) {
+	(void) ctx;
+	uint32_t id = FDCAN_FRAME_GET_ID(pFrame);
+	for (uint8_t o = 0; o < SIM_OWN_COUNT; o++) {
+		if (ownTable[o].Id == id) {
+			own[o].Dropped++;
+		}
+	}
+}
+
+/* Release of own frame 'o' under 'policy' */
+static void RELEASE(uint8_t o, uint64_t now, uint8_t policy) {
+	own[o].Releases++;
+	own[o].LastReleaseNs = now;
+
+	if (policy == POLICY_DROP) {
+		if (!FIFO_PUT(o, now)) {
+			own[o].Dropped++;
+		}
+		return;
+	}
+
+	FDCAN_FrameTypeDef_t f;
+	memset(&f, 0, sizeof(f));
+	FDCAN_FRAME_SET_ID(&f, ownTable[o].Id, 0);
+	uint8_t result = CANTXL_SUBMIT(&hTxl, &f);
+	if (result == CANTXL_DROPPED) {
+		own[o].Dropped++;
+	} else if (result == CANTXL_REPLACED) {
+		own[o].Replaced++;
+	}
+}
+
+static void ARBITRATE(uint64_t now) {
+	int best = -1;
+	uint32_t bestId = 0xFFFFFFFFU;
+	for (uint32_t f = 0; f < SIM_FOREIGN_COUNT; f++) {
+		if (foreign[f].Pending != 0 && foreign[f].Id < bestId) {
+			bestId = foreign[f].Id;
+			best = (int) f;
+		}
+	}
+	SKIP_HOLES();
+	if (fillLevel != 0 && ownTable[slot[getIndex].Own].Id < bestId) {
+		busSlot = getIndex;
+		busEndNs = now + FRAME_NS(ownTable[slot[getIndex].Own].Bytes);
+		busIdle = 0;
+	} else if (best >= 0) {
+		foreign[best].Pending--;
+		busSlot = -1;
+		busEndNs = now + FRAME_NS(8);
+		busIdle = 0;
+	}
+}
+
+/* Higher-priority share 'highPermille' of the bus in four IDs below the
+ * node's, and four low-priority filler IDs offering the rest and more */
+static void SETUP(uint32_t highPermille) {
+	memset(own, 0, sizeof(own));
+	memset(slot, 0, sizeof(slot));
+	getIndex = putIndex = fillLevel = 0;
+	busSlot = -1;
+	busIdle = 1;
+	tcfFlag = 0;
+	hTxl.Read = SIM_READ;
+	hTxl.Cancel = SIM_CANCEL;
+	hTxl.Transmit = SIM_TRANSMIT;
+	hTxl.Lost = SIM_LOST;
+	hTxl.Ctx = NULL;
+	CANTXL_INIT(&hTxl);
+	for (uint32_t o = 0; o < SIM_OWN_COUNT; o++) {
+		own[o].NextNs = (uint64_t) o * 1000000U + 250000U; // Spread offsets
+	}
+
+	uint64_t frameNs = FRAME_NS(8);
+	for (uint32_t f = 0; f < SIM_FOREIGN_COUNT; f++) {
+		Foreign_t *x = &foreign[f];
+		uint32_t share = (f < 4) ? highPermille / 4U : 300U; // 120 % filler
+		x->Id = (f < 4) ? 0x080U + f : 0x600U + f;
+		x->PeriodNs = (share != 0) ? frameNs * 1000U / share : 0;
+		x->NextNs = (uint64_t) f * 137000U;
+		x->Pending = 0;
+	}
+}
+
+static void RUN(uint8_t policy) {
+	uint64_t now = 0;
+	const uint64_t endNs = SIM_RUN_US * 1000U;
+
+	while (now < endNs) {
+		uint64_t next = endNs;
+		if (!busIdle && busEndNs < next) {
+			next = busEndNs;
+		}
+		for (uint32_t o = 0; o < SIM_OWN_COUNT; o++) {
+			if (own[o].NextNs < next) {
+				next = own[o].NextNs;
+			}
+		}
+		for (uint32_t f = 0; f < SIM_FOREIGN_COUNT; f++) {
+			if (foreign[f].PeriodNs != 0 && foreign[f].NextNs < next) {
+				next = foreign[f].NextNs;
+			}
+		}
+		now = next;
+
+		if (!busIdle && busEndNs == now) {
+			FRAME_END(now);
+		}
+		for (uint32_t f = 0; f < SIM_FOREIGN_COUNT; f++) {
+			Foreign_t *x = &foreign[f];
+			if (x->PeriodNs != 0 && x->NextNs == now) {
+				if (x->Pending < SIM_FOREIGN_CAP) {
+					x->Pending++;
+				}
+				x->NextNs += x->PeriodNs;
+			}
+		}
+		for (uint8_t o = 0; o < SIM_OWN_COUNT; o++) {
+			if (own[o].NextNs == now) {
+				RELEASE(o, now, policy);
+				own[o].NextNs += (uint64_t) ownTable[o].PeriodUs * 1000U;
+			}
+		}
+		if (tcfFlag) {
+			tcfFlag = 0;
+			CANTXL_COMPLETE(&hTxl);
+		}
+		if (busIdle) {
+			ARBITRATE(now);
+		}
+	}
+}
+
+int main(void) {
+	static const uint32_t highLoads[] = { 500, 900, 950, 970, 990 };
+
+	printf("Data age of scheduled frames, 500 kbit/s classic, bus saturated "
+			"(low-priority filler), %llu s per run\n",
+			(unsigned long long) (SIM_RUN_US / 1000000U));
+	printf("High  Policy  Frame        Period ms  Sent/Rel    Dropped"
+			"  Replaced  Age avg ms  Age max ms\n");
+	for (uint32_t h = 0; h < sizeof(highLoads) / sizeof(highLoads[0]); h++) {
+		for (uint8_t policy = POLICY_DROP; policy <= POLICY_LATEST; policy++) {
+			SETUP(highLoads[h]);
+			RUN(policy);
+			for (uint32_t o = 0; o < SIM_OWN_COUNT; o++) {
+				const Own_t *x = &own[o];
+				printf("%3lu%%  %-6s  %-11s  %9.0f  %5lu/%-5lu %7lu  %8lu  %10.2f  %10.2f\n",
+						(unsigned long) (highLoads[h] / 10U),
+						policy == POLICY_LATEST ? "latest" : "drop",
+						ownTable[o].Name, ownTable[o].PeriodUs / 1000.0,
+						(unsigned long) x->Sent, (unsigned long) x->Releases,
+						(unsigned long) x->Dropped, (unsigned long) x->Replaced,
+						x->Sent ? x->AgeSumNs / 1e6 / x->Sent : 0.0,
+						x->AgeMaxNs / 1e6);
+			}
+			if (policy == POLICY_LATEST) {
+				printf("      cancels %lu: removed %lu, went out %lu, parked %lu\n",
+						(unsigned long) hTxl.Cancels,
+						(unsigned long) hTxl.Cancelled,
+						(unsigned long) hTxl.Late, (unsigned long) hTxl.Parks);
+			}
+		}
+	}
+	printf("Age = end of transmission minus the release whose payload it "
+			"carries; high = share of the bus taken by higher-priority IDs\n");
+	return 0;
+}
@@ -0,0 +1,547 @@
+/**
+ ******************************************************************************
+ * @file           : uds_bench.c
+ * @brief          : Host tester for the UDS server (Src/uds.c) over ISO-TP.
+ *
+ * Tester and server share a simulated bus: each has a 3-deep TX FIFO like
+ * FDCAN1's, the lower identifier wins arbitration, and bus time advances by
+ * the worst-case length of each frame (can_stats.c wire times). Received
+ * frames reach both sides at once, as from the FDCAN interrupt, and both
+ * are polled every SIM_POLL_US, as from the main loop.
+ *
+ * The tester first checks the server's answers: sessions, batched
+ * ReadDataByIdentifier, WriteDataByIdentifier, RoutineControl with NRC 0x78,
+ * ECUReset, a download with a repeated and a wrong block counter, negative
+ * responses and the S3 timeout. It then times every service: latency is bus
+ * time from the tester queuing the request to the last response frame
+ * received, and CPU is host time spent in the server for one request.
+ *
+ * Build and run from the repository root:
+ *   gcc -O2 -IInc -o uds_bench Tools/uds_bench.c Src/uds.c Src/isotp.c Src/can_stats.c
+ *   ./uds_bench
+ ******************************************************************************
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "uds.h"
+#include "can_stats.h"
+
+#define SIM_TX_FIFO                 3U
+#define SIM_POLL_US                 100U  // Main loop period
+#define SIM_TIMEOUT_US              6000000U // Beyond P2*
+#define SIM_TESTER_ID               0x7E0U
+#define SIM_SERVER_ID               0x7E8U
+#define SIM_RUNS                    200U  // Requests per timed service
+#define SIM_IMAGE_BYTES             (64U * 1024U)
+#define SIM_ROUTINE_US              20000U // Pending routine run time
+
+/***** Simulated Bus *****/
+typedef struct {
+	FDCAN_FrameTypeDef_t Fifo[SIM_TX_FIFO];
+	uint32_t Count;
+	uint32_t Frames;
+} Node_t;
+
+static Node_t tester, server;
+static Node_t *busOwner;
+static double simUs, busFreeUs, nextPollUs;
+static uint32_t simNominalKbps, simDataKbps;
+static uint64_t serverNs;
+
+/***** Server Side *****/
+static UDS_HandleTypeDef_t uds;
+static uint8_t vin[17] = "WDB00000000000000";
+static uint8_t serial[8] = { 'S', 'N', '0', '0', '0', '4', '2', 0 };
+static uint8_t swVersion[4] = { 1, 0, 4, 2 };
+static uint8_t image[SIM_IMAGE_BYTES];
+static uint32_t imageAddress, imageSize, imageWrites;
+static uint32_t resets, aborts;
+static double routineEndUs;
+static uint8_t routineRunning;
+
+static uint64_t NOW_NS(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000U + (uint64_t) ts.tv_nsec;
+}
+
+static uint32_t SIM_TICKS(void) {
+	return (uint32_t) simUs;
+}
+
+static uint8_t SIM_SEND(void *ctx, const FDCAN_FrameTypeDef_t *pFrame) {
+	Node_t *n = ctx;
+	if (n->Count == SIM_TX_FIFO) {
+		return 0;
+	}
+	n->Fifo[n->Count++] = *pFrame;
+	n->Frames++;
+	return 1;
+}
+
+static uint8_t READ_SESSION(void *ctx, uint16_t did, uint8_t *pOut) {
+	(void) ctx;
+	(void) did;
+	pOut[0] = uds.Session;
+	return 0;
+}
+
+static uint8_t READ_COUNTERS(void *ctx, uint16_t did, uint8_t *pOut) {
+	(void) ctx;
+	(void) did;
+	uint32_t values[2] = { uds.IsoTp.RxMessages, uds.IsoTp.TxMessages };
+	for (uint32_t i = 0; i < 8; i++) {
+		pOut[i] = (uint8_t) (values[i / 4] >> (24 - 8 * (i % 4)));
+	}
+	return 0;
+}
+
+/* Sorted by Id */
+static const UDS_DidTypeDef_t dids[] = {
+	{ 0x0100, 8, UDS_IN_ALL, 0, NULL, READ_COUNTERS, NULL },
+	{ 0xF186, 1, UDS_IN_ALL, 0, NULL, READ_SESSION, NULL },
+	{ 0xF18C, sizeof(serial), UDS_IN_ALL, 0, serial, NULL, NULL },
+	{ 0xF190, sizeof(vin), UDS_IN_ALL, UDS_IN(UDS_SESSION_EXTENDED), vin, NULL,
+			NULL },
+	{ 0xF195, sizeof(swVersion), UDS_IN_ALL, 0, swVersion, NULL, NULL },
+};
+
+/* Takes SIM_ROUTINE_US: pending until then */
+static uint8_t ROUTINE_SLOW(void *ctx, uint16_t rid, const uint8_t *pIn,
+		uint32_t inLength, uint8_t *pOut, uint32_t *pOutLength) {
+	(void) ctx;
+	(void) rid;
+	(void) pIn;
+	(void) inLength;
+	if (!routineRunning) {
+		routineRunning = 1;
+		routineEndUs = simUs + SIM_ROUTINE_US;
+	}
+	if (simUs < routineEndUs) {
+		return UDS_NRC_RESPONSE_PENDING;
+	}
+	routineRunning = 0;
+	pOut[0] = 0x00;                // Routine completed
+	*pOutLength = 1;
+	return 0;
+}
+
+static uint8_t ROUTINE_CHECKSUM(void *ctx, uint16_t rid, const uint8_t *pIn,
+		uint32_t inLength, uint8_t *pOut, uint32_t *pOutLength) {
+	(void) ctx;
+	(void) rid;
+	(void) pIn;
+	(void) inLength;
+	uint32_t sum = 0;
+	for (uint32_t i = 0; i < imageSize; i++) {
+		sum += image[i];
+	}
+	for (uint32_t i = 0; i < 4; i++) {
+		pOut[i] = (uint8_t) (sum >> (24 - 8 * i));
+	}
+	*pOutLength = 4;
+	return 0;
+}
+
+static const UDS_RoutineTypeDef_t routines[] = {
+	{ 0x0200, UDS_IN_ALL, ROUTINE_SLOW, NULL, NULL },
+	{ 0x0201, UDS_IN_ALL, ROUTINE_CHECKSUM, NULL, ROUTINE_CHECKSUM },
+};
+
+static uint8_t SINK_START(void *ctx, uint32_t address, uint32_t size) {
+	(void) ctx;
+	if (size > SIM_IMAGE_BYTES) {
+		return UDS_NRC_REQUEST_OUT_OF_RANGE;
+	}
+	imageAddress = address;
+	imageSize = size;
+	memset(image, 0, sizeof(image));
+	return 0;
+}
+
+static uint8_t SINK_WRITE(void *ctx, uint32_t offset, const uint8_t *pData,
+		uint32_t length) {
+	(void) ctx;
+	memcpy(&image[offset], pData, length);
+	imageWrites++;
+	return 0;
+}
+
+static void SINK_ABORT(void *ctx) {
+	(void) ctx;
+	aborts++;
+}
+
+static const UDS_DownloadSinkTypeDef_t sink = {
+	SINK_START, SINK_WRITE, NULL, NULL, SINK_ABORT
+};
+
+static void ECU_RESET(void *ctx, uint8_t type) {
+	(void) ctx;
+	(void) type;
+	resets++;
+}
+
+/***** Tester Side *****/
+static ISOTP_HandleTypeDef_t isoTester;
+static uint8_t answer[UDS_MAX_RESPONSE];
+static uint32_t answerLength;
+static uint8_t answerReady;
+static uint32_t pendingSeen;
+
+static void TESTER_RX_DONE(void *ctx, uint32_t length, uint8_t result) {
+	(void) ctx;
+	if (result != ISOTP_OK) {
+		return;
+	}
+	if (length == 3 && answer[0] == UDS_SID_NEGATIVE_RESPONSE
+			&& answer[2] == UDS_NRC_RESPONSE_PENDING) {
+		pendingSeen++;             // Keep waiting for the final answer
+		return;
+	}
+	answerLength = length;
+	answerReady = 1;
+}
+
+static double FRAME_US(const FDCAN_FrameTypeDef_t *f) {
+	uint8_t format = !FDCAN_FRAME_IS_FD(f) ? CANSTATS_FMT_CLASSIC
+			: FDCAN_FRAME_IS_BRS(f) ? CANSTATS_FMT_FD_BRS : CANSTATS_FMT_FD;
+	uint32_t dataBits = 0;
+	uint32_t bits = CANSTATS_WIRE_BITS(format, FDCAN_FRAME_IS_EXTENDED(f),
+			FDCAN_FRAME_GET_LEN(f), &dataBits);
+	if (format != CANSTATS_FMT_FD_BRS) {
+		return bits * 1000.0 / simNominalKbps;
+	}
+	return (bits - dataBits) * 1000.0 / simNominalKbps
+			+ dataBits * 1000.0 / simDataKbps;
+}
+
+/* Both sides get every frame, the server from "its interrupt" */
+static void DELIVER(const FDCAN_FrameTypeDef_t *f) {
+	ISOTP_RX_FRAME(&isoTester, f);
+	uint64_t t0 = NOW_NS();
+	UDS_RX_FRAME(&uds, f);
+	serverNs += NOW_NS() - t0;
+}
+
+static void POLL(void) {
+	ISOTP_POLL(&isoTester);
+	uint64_t t0 = NOW_NS();
+	UDS_POLL(&uds);
+	serverNs += NOW_NS() - t0;
+}
+
+/* Lower identifier first, as arbitration would */
+static void BUS_START(void) {
+	if (busOwner != NULL) {
+		return;
+	}
+	if (tester.Count != 0 && (server.Count == 0
+			|| FDCAN_FRAME_GET_ID(&tester.Fifo[0])
+					< FDCAN_FRAME_GET_ID(&server.Fifo[0]))) {
+		busOwner = &tester;
+	} else if (server.Count != 0) {
+		busOwner = &server;
+	} else {
+		return;
+	}
+	busFreeUs = simUs + FRAME_US(&busOwner->Fifo[0]);
+}
+
+/* Advance to 'until', or until a final answer arrives if 'stop' */
+static void SIM_RUN(double until, uint8_t stop) {
+	for (;;) {
+		BUS_START();
+		if (busOwner != NULL && busFreeUs <= nextPollUs && busFreeUs <= until) {
+			Node_t *n = busOwner;
+			FDCAN_FrameTypeDef_t f = n->Fifo[0];
+			simUs = busFreeUs;
+			memmove(&n->Fifo[0], &n->Fifo[1], (n->Count - 1U) * sizeof(f));
+			n->Count--;
+			busOwner = NULL;
+			DELIVER(&f);
+		} else if (nextPollUs <= until) {
+			simUs = nextPollUs;
+			nextPollUs += SIM_POLL_US;
+			POLL();
+		} else {
+			simUs = until;
+			return;
+		}
+		if (stop && answerReady) {
+			return;
+		}
+	}
+}
+
+/**
+ * @brief  Send one request and wait for the final answer
+ * @retval Response SID (0x7F for negative), or 0 if none came
+ */
+static uint8_t REQUEST(const uint8_t *req, uint32_t length) {
+	answerReady = 0;
+	answerLength = 0;
+	ISOTP_SEND(&isoTester, req, length);
+	SIM_RUN(simUs + SIM_TIMEOUT_US, 1);
+	return answerReady ? answer[0] : 0;
+}
+
+#define REQ(...) REQUEST((const uint8_t[]) { __VA_ARGS__ }, \
+		sizeof((const uint8_t[]) { __VA_ARGS__ }))
+#define NRC(sid, nrc) (answer[0] == UDS_SID_NEGATIVE_RESPONSE \
+		&& answer[1] == (sid) && answer[2] == (nrc))
+
+static void SETUP(uint8_t txdl, uint32_t nominalKbps, uint32_t dataKbps) {
+	memset(&tester, 0, sizeof(tester));
+	memset(&server, 0, sizeof(server));
+	busOwner = NULL;
+	simUs = 0;
+	nextPollUs = SIM_POLL_US;
+	simNominalKbps = nominalKbps;
+	simDataKbps = dataKbps;
+	imageSize = 0;
+
+	memset(&isoTester, 0, sizeof(isoTester));
+	isoTester.TxId = SIM_TESTER_ID;
+	isoTester.RxId = SIM_SERVER_ID;
+	isoTester.TxDataLength = txdl;
+	isoTester.BitRateSwitch = dataKbps != nominalKbps;
+	isoTester.PadFrames = 1;
+	isoTester.PadByte = 0xCC;
+	isoTester.TicksPerUs = 1;
+	isoTester.GetTicks = SIM_TICKS;
+	isoTester.SendFrame = SIM_SEND;
+	isoTester.Ctx = &tester;
+	isoTester.RxBuffer = answer;
+	isoTester.RxBufferSize = sizeof(answer);
+	isoTester.RxDone = TESTER_RX_DONE;
+	ISOTP_INIT(&isoTester);
+
+	memset(&uds, 0, sizeof(uds));
+	uds.IsoTp.TxId = SIM_SERVER_ID;
+	uds.IsoTp.RxId = SIM_TESTER_ID;
+	uds.IsoTp.TxDataLength = txdl;
+	uds.IsoTp.BitRateSwitch = dataKbps != nominalKbps;
+	uds.IsoTp.PadFrames = 1;
+	uds.IsoTp.PadByte = 0xCC;
+	uds.IsoTp.TicksPerUs = 1;
+	uds.IsoTp.GetTicks = SIM_TICKS;
+	uds.SendFrame = SIM_SEND;
+	uds.Ctx = &server;
+	uds.Dids = dids;
+	uds.DidCount = sizeof(dids) / sizeof(dids[0]);
+	uds.Routines = routines;
+	uds.RoutineCount = sizeof(routines) / sizeof(routines[0]);
+	uds.Sink = &sink;
+	uds.Reset = ECU_RESET;
+	UDS_INIT(&uds);
+}
+
+/* RequestDownload, all blocks with the largest block length, exit */
+static uint8_t DOWNLOAD(const uint8_t *data, uint32_t size, uint32_t address) {
+	static uint8_t block[UDS_MAX_BLOCK_LENGTH];
+	uint8_t ok = REQ(0x34, 0x00, 0x44, (uint8_t) (address >> 24),
+			(uint8_t) (address >> 16), (uint8_t) (address >> 8),
+			(uint8_t) address, (uint8_t) (size >> 24), (uint8_t) (size >> 16),
+			(uint8_t) (size >> 8), (uint8_t) size) == 0x74;
+	uint32_t maxBlock = ((uint32_t) answer[2] << 8) | answer[3];
+	uint8_t counter = 1;
+
+	for (uint32_t at = 0; ok && at < size; counter++) {
+		uint32_t n = size - at;
+		if (n > maxBlock - 2U) {
+			n = maxBlock - 2U;
+		}
+		block[0] = UDS_SID_TRANSFER_DATA;
+		block[1] = counter;
+		memcpy(&block[2], &data[at], n);
+		ok &= REQUEST(block, n + 2U) == 0x76 && answer[1] == counter;
+		at += n;
+	}
+	ok &= REQ(0x37) == 0x77;
+	return ok;
+}
+
+/**
+ * @brief  Check every service against the expected answers
+ * @retval Number of failed checks
+ */
+static uint32_t FUNCTIONAL(void) {
+	static uint8_t data[SIM_IMAGE_BYTES];
+	uint32_t failures = 0;
+	uint8_t ok;
+
+#define CHECK(cond, what) do { if (!(cond)) { failures++; \
+		printf("  FAIL: %s\n", what); } } while (0)
+
+	SETUP(8, 500, 500);
+	ok = REQ(0x10, 0x03) == 0x50 && answerLength == 6 && answer[1] == 0x03
+			&& answer[2] == 0x00 && answer[3] == UDS_P2_MS
+			&& ((answer[4] << 8) | answer[5]) == UDS_P2_STAR_MS / 10U;
+	CHECK(ok, "session control to extended");
+
+	ok = REQ(0x22, 0xF1, 0x86, 0xF1, 0x90, 0x12, 0x34, 0xF1, 0x8C) == 0x62
+			&& answerLength == 1 + 3 + 19 + 10 && answer[3] == 0x03
+			&& memcmp(&answer[6], vin, 17) == 0
+			&& memcmp(&answer[25], serial, 8) == 0;
+	CHECK(ok, "ReadDataByIdentifier batch, unknown DID left out");
+	CHECK(REQ(0x22, 0x12, 0x34) == 0x7F && NRC(0x22, 0x31),
+			"unknown DID alone");
+	CHECK(REQ(0x22, 0xF1) == 0x7F && NRC(0x22, 0x13), "odd length DID read");
+
+	ok = REQ(0x2E, 0xF1, 0x90, 'W', 'V', 'W', 'Z', 'Z', 'Z', '1', 'K', 'Z',
+			'A', 'W', '0', '0', '0', '0', '0', '1') == 0x6E
+			&& memcmp(vin, "WVWZZZ1KZAW000001", 17) == 0;
+	CHECK(ok, "WriteDataByIdentifier");
+	CHECK(REQ(0x2E, 0xF1, 0x90, 1, 2) == 0x7F && NRC(0x2E, 0x13),
+			"write with the wrong record length");
+	CHECK(REQ(0x2E, 0xF1, 0x95, 1, 0, 4, 2) == 0x7F && NRC(0x2E, 0x31),
+			"write of a read-only DID");
+
+	CHECK(REQ(0x3E, 0x00) == 0x7E, "TesterPresent");
+	answerReady = 0;
+	ISOTP_SEND(&isoTester, (const uint8_t[]) { 0x3E, 0x80 }, 2);
+	SIM_RUN(simUs + 100000.0, 1);
+	CHECK(!answerReady, "suppressed positive response");
+
+	pendingSeen = 0;
+	ok = REQ(0x31, 0x01, 0x02, 0x00) == 0x71 && answer[4] == 0x00
+			&& pendingSeen == 1;
+	CHECK(ok, "routine answering NRC 0x78 first");
+	CHECK(REQ(0x31, 0x02, 0x02, 0x00) == 0x7F && NRC(0x31, 0x12),
+			"routine without Stop");
+	CHECK(REQ(0x31, 0x01, 0x09, 0x99) == 0x7F && NRC(0x31, 0x31),
+			"unknown routine");
+
+	CHECK(REQ(0x34, 0x00, 0x44, 0, 0, 0, 0, 0, 0, 1, 0) == 0x7F
+			&& NRC(0x34, 0x7F), "download outside the programming session");
+	CHECK(REQ(0x85, 0x01) == 0x7F && NRC(0x85, 0x11), "unknown service");
+
+	/* Download: normal, repeated block, wrong counter, exit */
+	for (uint32_t i = 0; i < sizeof(data); i++) {
+		data[i] = (uint8_t) (i * 13U + (i >> 8));
+	}
+	CHECK(REQ(0x10, 0x02) == 0x50, "programming session");
+	CHECK(DOWNLOAD(data, 10000, 0x08010000U)
+			&& memcmp(image, data, 10000) == 0 && imageAddress == 0x08010000U,
+			"download of 10000 bytes");
+	ok = REQ(0x34, 0x00, 0x22, 0x10, 0x00, 0x10, 0x00) == 0x74;
+	uint8_t first[10] = { 0x36, 0x01, 1, 2, 3, 4, 5, 6, 7, 8 };
+	ok &= REQUEST(first, 10) == 0x76;
+	uint32_t writes = imageWrites;
+	first[2] = 0xEE;               // A repeat must not be written again
+	ok &= REQUEST(first, 10) == 0x76 && imageWrites == writes
+			&& image[0] == 1;
+	ok &= REQ(0x36, 0x05, 1, 2) == 0x7F && NRC(0x36, 0x73);
+	ok &= REQ(0x37) == 0x7F && NRC(0x37, 0x24);  // 4088 bytes still missing
+	CHECK(ok, "repeated and wrong block counters");
+	uint32_t abortsBefore = aborts;
+	CHECK(REQ(0x10, 0x01) == 0x50 && aborts == abortsBefore + 1,
+			"session change aborts the download");
+
+	CHECK(REQ(0x11, 0x01) == 0x51 && resets == 1, "ECUReset after response");
+
+	/* S3: back to default without TesterPresent */
+	CHECK(REQ(0x10, 0x03) == 0x50, "extended again");
+	SIM_RUN(simUs + UDS_S3_MS * 1000.0 + 200000.0, 0);
+	ok = REQ(0x22, 0xF1, 0x86) == 0x62 && answer[3] == UDS_SESSION_DEFAULT
+			&& uds.S3Timeouts == 1;
+	CHECK(ok, "S3 timeout");
+
+	/* Unsorted tables are refused */
+	static const UDS_DidTypeDef_t unsorted[] = {
+		{ 0xF190, 1, UDS_IN_ALL, 0, vin, NULL, NULL },
+		{ 0xF186, 1, UDS_IN_ALL, 0, vin, NULL, NULL },
+	};
+	uds.Dids = unsorted;
+	uds.DidCount = 2;
+	CHECK(UDS_INIT(&uds) == 0, "unsorted DID table refused");
+	return failures;
+}
+
+typedef struct {
+	const char *Name;
+	const uint8_t *Request;
+	uint32_t Length;
+	uint8_t Session;               // Entered before timing
+} Timed_t;
+
+#define TIMED(name, session, ...) { name, (const uint8_t[]) { __VA_ARGS__ }, \
+		sizeof((const uint8_t[]) { __VA_ARGS__ }), session }
+
+static void LATENCY(const char *busName, uint8_t txdl, uint32_t nominalKbps,
+		uint32_t dataKbps) {
+	const Timed_t timed[] = {
+		TIMED("10 DiagnosticSessionControl", 0x03, 0x10, 0x03),
+		TIMED("3E TesterPresent", 0x03, 0x3E, 0x00),
+		TIMED("22 ReadDID x1 (1 B)", 0x03, 0x22, 0xF1, 0x86),
+		TIMED("22 ReadDID x1 (17 B)", 0x03, 0x22, 0xF1, 0x90),
+		TIMED("22 ReadDID x5 (38 B)", 0x03, 0x22, 0x01, 0x00, 0xF1, 0x86,
+				0xF1, 0x8C, 0xF1, 0x90, 0xF1, 0x95),
+		TIMED("2E WriteDID (17 B)", 0x03, 0x2E, 0xF1, 0x90, 'W', 'V', 'W',
+				'Z', 'Z', 'Z', '1', 'K', 'Z', 'A', 'W', '0', '0', '0', '0',
+				'0', '1'),
+		TIMED("31 RoutineControl", 0x03, 0x31, 0x01, 0x02, 0x01),
+		TIMED("7F negative (NRC 0x31)", 0x03, 0x22, 0x12, 0x34),
+	};
+	static uint8_t data[SIM_IMAGE_BYTES];
+
+	SETUP(txdl, nominalKbps, dataKbps);
+	printf("\n%s, TX_DL %u:\n", busName, txdl);
+	printf("%-30s %5s %5s %6s %8s %8s %8s %7s\n", "Service", "Req B", "Rsp B",
+			"Frames", "min us", "avg us", "max us", "CPU ns");
+	for (uint32_t t = 0; t < sizeof(timed) / sizeof(timed[0]); t++) {
+		const Timed_t *s = &timed[t];
+		double minUs = 1e9, maxUs = 0, sumUs = 0;
+		uint64_t cpuNs = 0;
+		uint32_t frames = 0, failed = 0;
+		REQ(0x10, s->Session);
+		for (uint32_t r = 0; r < SIM_RUNS; r++) {
+			SIM_RUN(simUs + 1000.0 + (r % 7U) * 37.0, 0); // Vary the poll phase
+			uint32_t framesBefore = tester.Frames + server.Frames;
+			serverNs = 0;
+			double start = simUs;
+			if (REQUEST(s->Request, s->Length) == 0) {
+				failed++;
+			}
+			double us = simUs - start;
+			cpuNs += serverNs;
+			frames = tester.Frames + server.Frames - framesBefore;
+			sumUs += us;
+			minUs = us < minUs ? us : minUs;
+			maxUs = us > maxUs ? us : maxUs;
+		}
+		printf("%-30s %5u %5u %6u %8.0f %8.0f %8.0f %7.0f%s\n", s->Name,
+				s->Length, answerLength, frames, minUs, sumUs / SIM_RUNS,
+				maxUs, (double) cpuNs / SIM_RUNS, failed ? "  FAIL" : "");
+	}
+
+	/* Download throughput: 64 KB in the largest blocks */
+	for (uint32_t i = 0; i < sizeof(data); i++) {
+		data[i] = (uint8_t) (i * 7U);
+	}
+	REQ(0x10, 0x02);
+	serverNs = 0;
+	double start = simUs;
+	uint8_t ok = DOWNLOAD(data, sizeof(data), 0x08000000U)
+			&& memcmp(image, data, sizeof(data)) == 0;
+	double us = simUs - start;
+	printf("%-30s %5u %5s %6s %8s %8.0f %8s %7.0f%s\n", "34/36/37 download 64 KB",
+			UDS_MAX_BLOCK_LENGTH, "", "", "", us, "",
+			(double) serverNs / (sizeof(data) / 1024U), ok ? "" : "  FAIL");
+	printf("  %.1f KB/s, server CPU per KB above\n", sizeof(data) / us * 1000.0);
+}
+
+int main(void) {
+	printf("UDS server over ISO-TP, simulated bus, poll every %u us\n",
+			SIM_POLL_US);
+	uint32_t failures = FUNCTIONAL();
+	printf("Functional checks: %s (%u failures)\n", failures ? "FAIL" : "pass",
+			failures);
+
+	LATENCY("Classic 500 kbit/s", 8, 500, 500);
+	LATENCY("CAN FD 500k/2M", 64, 500, 2000);
+	return failures != 0;
+}
@@ -0,0 +1,560 @@
+/**
+ ******************************************************************************
+ * @file           : xcp_master.c
+ * @brief          : Host XCP master stand-in for the XCP slave (Src/xcp.c).
+ *
+ * The slave runs on a simulated bus: every frame it queues goes through a
+ * 3-deep TX FIFO like FDCAN1's, bus time advances by the worst-case length
+ * of each frame (can_stats.c wire times), and a 1 ms tick plays the part of
+ * TIM2 CC2: the ECU variables change, XCP_EVENT samples the lists of the
+ * events due, and the DTO queue is pumped. The FIFO running empty pumps it
+ * again, as the TX FIFO Empty interrupt does on the target. Commands reach
+ * the slave as soon as the master sends them.
+ *
+ * The master connects, reads the DAQ processor and event information,
+ * builds three DAQ lists (1 ms with timestamps, 10 ms, 100 ms), checks that
+ * every sample decodes to the values the ECU held at that tick, with no
+ * sample torn across ODTs, then calibrates a parameter with
+ * SET_MTA/DOWNLOAD and sees it come back on DAQ. A sweep then loads a 1 ms
+ * list with more and more ODTs until samples are lost.
+ *
+ * Build and run from the repository root:
+ *   gcc -O2 -IInc -o xcp_master Tools/xcp_master.c Src/xcp.c Src/can_stats.c
+ *   ./xcp_master
+ ******************************************************************************
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "xcp.h"
+#include "can_stats.h"
+
+#define SIM_TX_FIFO                 3U
+#define SIM_TICK_US                 1000U // TIM2 CC2 period
+#define SIM_RUN_MS                  2000U
+#define SIM_TIMEOUT_US              50000U // XCP T1
+#define SIM_CRO_ID                  0x7F0U
+#define SIM_DTO_ID                  0x7F1U
+#define SIM_MEAS_ADDR               0x20000100U
+#define SIM_CAL_ADDR                0x20000800U
+#define SIM_BULK_ADDR               0x20001000U
+#define SIM_MAX_SIGNALS             8U
+#define SIM_MAX_LISTS               4U
+
+/***** ECU Variables *****/
+typedef struct {
+	uint32_t Counter;              // 1 ms ticks
+	uint16_t Rpm;
+	uint8_t Gear;
+	int16_t Temps[8];
+	float Wave[12];
+	uint32_t CounterEcho;          // Written last: a torn sample shows here
+} EcuMeasure_t;
+
+typedef struct {
+	float Gain;
+	uint16_t Limit;
+} EcuCal_t;
+
+static EcuMeasure_t ecuMeas;
+static EcuCal_t ecuCal = { 1.5f, 300 };
+static uint8_t ecuBulk[512];
+
+static const XCP_RegionTypeDef_t ecuRegions[] = {
+	{ SIM_MEAS_ADDR, (uint8_t*) &ecuMeas, sizeof(ecuMeas), 0 },
+	{ SIM_CAL_ADDR, (uint8_t*) &ecuCal, sizeof(ecuCal), 1 },
+	{ SIM_BULK_ADDR, ecuBulk, sizeof(ecuBulk), 0 },
+};
+
+static const XCP_EventTypeDef_t ecuEvents[] = {
+	{ "1ms", 1000U, 0 },
+	{ "10ms", 10000U, 1 },
+	{ "100ms", 100000U, 2 },
+};
+
+#define MEAS_ADDR(field)            (SIM_MEAS_ADDR + (uint32_t) offsetof(EcuMeasure_t, field))
+#define CAL_ADDR(field)             (SIM_CAL_ADDR + (uint32_t) offsetof(EcuCal_t, field))
+
+/***** Simulated Bus *****/
+static XCP_HandleTypeDef_t slave;
+static FDCAN_FrameTypeDef_t txFifo[SIM_TX_FIFO];
+static uint32_t txCount;
+static uint8_t busBusy;
+static double simUs, busFreeUs, busBusyUs, nextTickUs;
+static uint32_t ticks;
+static uint32_t simNominalKbps, simDataKbps;
+static uint64_t samplerNs, samplerCalls, samplerMaxNs;
+
+/***** Master State *****/
+typedef struct {
+	uint32_t Address;
+	uint8_t Size;
+} Signal_t;
+
+typedef struct {
+	uint16_t Event;
+	uint8_t Timestamp;
+	uint8_t Prescaler;
+	Signal_t Signals[SIM_MAX_SIGNALS];
+	uint32_t SignalCount;
+	/* Filled in while building and decoding */
+	uint8_t FirstPid;
+	uint8_t OdtCount;
+	uint8_t OdtBytes[XCP_MAX_ODT];
+	uint8_t Sample[512];
+	uint32_t SampleBytes;
+	uint32_t Samples;
+	uint32_t LastTimestamp;
+	uint32_t LastCounter;
+	uint32_t LastOverloads;        // Overload flags seen up to the last sample
+} List_t;
+
+static List_t lists[SIM_MAX_LISTS];
+static uint32_t listCount;
+static uint8_t response[XCP_MAX_FRAME_BYTES];
+static uint8_t responseReady;
+static uint32_t daqFrames, daqErrors, overloads;
+static void (*sampleCheck)(List_t *l, uint8_t overload);
+
+static uint64_t NOW_NS(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000U + (uint64_t) ts.tv_nsec;
+}
+
+static uint32_t SIM_TIMESTAMP(void) {
+	return (uint32_t) simUs;
+}
+
+static uint8_t SIM_SEND(void *ctx, const FDCAN_FrameTypeDef_t *pFrame) {
+	(void) ctx;
+	if (txCount == SIM_TX_FIFO) {
+		return 0;
+	}
+	txFifo[txCount++] = *pFrame;
+	return 1;
+}
+
+static double FRAME_US(const FDCAN_FrameTypeDef_t *f) {
+	uint8_t format = !FDCAN_FRAME_IS_FD(f) ? CANSTATS_FMT_CLASSIC
+			: FDCAN_FRAME_IS_BRS(f) ? CANSTATS_FMT_FD_BRS : CANSTATS_FMT_FD;
+	uint32_t dataBits = 0;
+	uint32_t bits = CANSTATS_WIRE_BITS(format, FDCAN_FRAME_IS_EXTENDED(f),
+			FDCAN_FRAME_GET_LEN(f), &dataBits);
+	if (format != CANSTATS_FMT_FD_BRS) {
+		return bits * 1000.0 / simNominalKbps;
+	}
+	return (bits - dataBits) * 1000.0 / simNominalKbps
+			+ dataBits * 1000.0 / simDataKbps;
+}
+
+/* Master side: one DTO frame came in */
+static void MASTER_RX(const FDCAN_FrameTypeDef_t *f) {
+	const uint8_t *p = FDCAN_FRAME_CDATA(f);
+	uint8_t pid = p[0];
+
+	if (pid >= 0xFCU) {
+		memcpy(response, p, FDCAN_FRAME_GET_LEN(f));
+		responseReady = 1;
+		return;
+	}
+	daqFrames++;
+	uint8_t overload = (pid & XCP_PID_OVERLOAD) != 0;
+	pid &= (uint8_t) ~XCP_PID_OVERLOAD;
+	overloads += overload;
+	for (uint32_t i = 0; i < listCount; i++) {
+		List_t *l = &lists[i];
+		if (pid < l->FirstPid || pid >= l->FirstPid + l->OdtCount) {
+			continue;
+		}
+		uint32_t odt = pid - l->FirstPid;
+		uint32_t at = 1;
+		if (odt == 0) {
+			l->SampleBytes = 0;
+			if (l->Timestamp) {
+				memcpy(&l->LastTimestamp, &p[1], 4);
+				at += 4;
+			}
+		}
+		memcpy(&l->Sample[l->SampleBytes], &p[at], l->OdtBytes[odt]);
+		l->SampleBytes += l->OdtBytes[odt];
+		if (odt == l->OdtCount - 1U) {
+			l->Samples++;
+			if (sampleCheck != NULL) {
+				sampleCheck(l, overload);
+			}
+		}
+		return;
+	}
+	daqErrors++;                   // PID of no list
+}
+
+/* ECU side: TIM2 CC2, every SIM_TICK_US */
+static void ECU_TICK(void) {
+	ticks++;
+	ecuMeas.Counter = ticks;
+	ecuMeas.Rpm = (uint16_t) (ticks * 7U);
+	ecuMeas.Gear = (uint8_t) (ticks % 6U);
+	for (uint32_t i = 0; i < 8; i++) {
+		ecuMeas.Temps[i] = (int16_t) (ticks + i);
+	}
+	for (uint32_t i = 0; i < 12; i++) {
+		ecuMeas.Wave[i] = (float) (ticks % 4096U) * 0.5f + (float) i;
+	}
+	ecuMeas.CounterEcho = ticks;
+	memcpy(ecuBulk, &ticks, sizeof(ticks));
+
+	uint64_t t0 = NOW_NS();
+	for (uint16_t e = 0; e < sizeof(ecuEvents) / sizeof(ecuEvents[0]); e++) {
+		if ((ticks * SIM_TICK_US) % ecuEvents[e].PeriodUs == 0) {
+			XCP_EVENT(&slave, e);
+		}
+	}
+	uint64_t ns = NOW_NS() - t0;
+	if (slave.DaqRunning) {
+		samplerNs += ns;
+		samplerCalls++;
+		if (ns > samplerMaxNs) {
+			samplerMaxNs = ns;
+		}
+	}
+	XCP_TX_PUMP(&slave);
+}
+
+static void BUS_START(void) {
+	if (!busBusy && txCount != 0) {
+		busBusy = 1;
+		double length = FRAME_US(&txFifo[0]);
+		busFreeUs = simUs + length;
+		busBusyUs += length;
+	}
+}
+
+/* Advance simulated time to 'until', or until a response arrives if 'stop' */
+static void SIM_RUN(double until, uint8_t stop) {
+	for (;;) {
+		BUS_START();
+		if (busBusy && busFreeUs <= nextTickUs && busFreeUs <= until) {
+			simUs = busFreeUs;
+			MASTER_RX(&txFifo[0]);
+			memmove(&txFifo[0], &txFifo[1], (txCount - 1U) * sizeof(txFifo[0]));
+			txCount--;
+			busBusy = 0;
+			if (txCount == 0) {
+				XCP_TX_PUMP(&slave); // TX FIFO Empty interrupt
+			}
+		} else if (nextTickUs <= until) {
+			simUs = nextTickUs;
+			nextTickUs += SIM_TICK_US;
+			ECU_TICK();
+		} else {
+			simUs = until;
+			return;
+		}
+		if (stop && responseReady) {
+			return;
+		}
+	}
+}
+
+/**
+ * @brief  Send one command and wait for its response
+ * @retval Response PID, or 0 on timeout
+ */
+static uint8_t MASTER_CMD(const uint8_t *cmd, uint32_t length) {
+	FDCAN_FrameTypeDef_t f = { 0 };
+	uint8_t fd = slave.FrameBytes > 8U;
+
+	FDCAN_FRAME_SET_ID(&f, SIM_CRO_ID, 0);
+	FDCAN_FRAME_SET_CONTROL(&f, FDCAN_BYTES_TO_DLC(length), fd, fd);
+	memcpy(FDCAN_FRAME_DATA(&f), cmd, length);
+	responseReady = 0;
+	XCP_RX_FRAME(&slave, &f);
+	SIM_RUN(simUs + SIM_TIMEOUT_US, 1);
+	return responseReady ? response[0] : 0;
+}
+
+#define CMD(...) MASTER_CMD((const uint8_t[]) { __VA_ARGS__ }, \
+		sizeof((const uint8_t[]) { __VA_ARGS__ }))
+#define U16(v)  (uint8_t) (v), (uint8_t) ((v) >> 8)
+#define U32(v)  (uint8_t) (v), (uint8_t) ((v) >> 8), (uint8_t) ((v) >> 16), \
+		(uint8_t) ((v) >> 24)
+
+/**
+ * @brief  Split the signals of every list into ODTs and download the lists
+ * @retval 1 if the slave accepted every command
+ */
+static uint8_t MASTER_BUILD_DAQ(void) {
+	uint8_t ok = 1;
+	uint32_t entries[SIM_MAX_LISTS][XCP_MAX_ODT];
+	uint32_t maxData = slave.FrameBytes - 1U;
+
+	/* Pack: entries never cross an ODT, a signal may be split over two */
+	for (uint32_t i = 0; i < listCount; i++) {
+		List_t *l = &lists[i];
+		uint32_t room = maxData - (l->Timestamp ? 4U : 0U);
+		l->OdtCount = 1;
+		l->OdtBytes[0] = 0;
+		entries[i][0] = 0;
+		for (uint32_t s = 0; s < l->SignalCount; s++) {
+			uint32_t left = l->Signals[s].Size;
+			while (left != 0) {
+				if (room == 0) {
+					l->OdtBytes[l->OdtCount] = 0;
+					entries[i][l->OdtCount] = 0;
+					l->OdtCount++;
+					room = maxData;
+				}
+				uint32_t n = (left < room) ? left : room;
+				l->OdtBytes[l->OdtCount - 1U] += (uint8_t) n;
+				entries[i][l->OdtCount - 1U]++;
+				room -= n;
+				left -= n;
+			}
+		}
+	}
+
+	ok &= CMD(XCP_CMD_FREE_DAQ) == XCP_PID_RES;
+	ok &= CMD(XCP_CMD_ALLOC_DAQ, 0, U16(listCount)) == XCP_PID_RES;
+	for (uint32_t i = 0; i < listCount; i++) {
+		ok &= CMD(XCP_CMD_ALLOC_ODT, 0, U16(i), lists[i].OdtCount) == XCP_PID_RES;
+	}
+	for (uint32_t i = 0; i < listCount; i++) {
+		for (uint32_t o = 0; o < lists[i].OdtCount; o++) {
+			ok &= CMD(XCP_CMD_ALLOC_ODT_ENTRY, 0, U16(i), (uint8_t) o,
+					(uint8_t) entries[i][o]) == XCP_PID_RES;
+		}
+	}
+
+	/* Write the entries in the same order they were packed */
+	for (uint32_t i = 0; i < listCount; i++) {
+		List_t *l = &lists[i];
+		uint32_t odt = 0, entry = 0;
+		uint32_t room = maxData - (l->Timestamp ? 4U : 0U);
+		ok &= CMD(XCP_CMD_SET_DAQ_PTR, 0, U16(i), 0, 0) == XCP_PID_RES;
+		for (uint32_t s = 0; s < l->SignalCount; s++) {
+			uint32_t address = l->Signals[s].Address;
+			uint32_t left = l->Signals[s].Size;
+			while (left != 0) {
+				if (room == 0) {
+					odt++;
+					entry = 0;
+					room = maxData;
+					ok &= CMD(XCP_CMD_SET_DAQ_PTR, 0, U16(i), (uint8_t) odt, 0)
+							== XCP_PID_RES;
+				}
+				uint32_t n = (left < room) ? left : room;
+				ok &= CMD(XCP_CMD_WRITE_DAQ, 0xFF, (uint8_t) n, 0, U32(address))
+						== XCP_PID_RES;
+				address += n;
+				room -= n;
+				left -= n;
+				entry++;
+			}
+		}
+		ok &= CMD(XCP_CMD_SET_DAQ_LIST_MODE,
+				l->Timestamp ? XCP_DAQ_MODE_TIMESTAMP : 0, U16(i), U16(l->Event),
+				l->Prescaler, 0) == XCP_PID_RES;
+		ok &= CMD(XCP_CMD_START_STOP_DAQ_LIST, 2, U16(i)) == XCP_PID_RES;
+		l->FirstPid = response[1];
+		l->Samples = 0;
+		l->LastCounter = 0;
+	}
+	return ok;
+}
+
+static uint32_t GET32(const uint8_t *p) {
+	uint32_t v;
+	memcpy(&v, p, 4);
+	return v;
+}
+
+/* Sample layout of the functional test lists, in signal order. The
+ * overload flag may land on another list's packet, so a gap is only an
+ * error if no flag came in since the previous sample. */
+static void CHECK_SAMPLE(List_t *l, uint8_t overload) {
+	(void) overload;
+	const uint8_t *s = l->Sample;
+	uint32_t counter = GET32(s);
+	uint8_t ok = 1;
+
+	if (l == &lists[0]) {          // Counter, Rpm, Gear, Temps, CounterEcho
+		uint16_t rpm;
+		int16_t temps[8];
+		memcpy(&rpm, &s[4], 2);
+		memcpy(temps, &s[7], 16);
+		ok = rpm == (uint16_t) (counter * 7U) && s[6] == counter % 6U
+				&& GET32(&s[23]) == counter;
+		for (uint32_t i = 0; i < 8; i++) {
+			ok &= temps[i] == (int16_t) (counter + i);
+		}
+		if (l->LastCounter != 0 && overloads == l->LastOverloads) {
+			ok &= counter == l->LastCounter + l->Prescaler;
+		}
+		ok &= l->LastTimestamp == (uint32_t) (counter * SIM_TICK_US);
+	} else if (l == &lists[1]) {   // Counter, Wave
+		for (uint32_t i = 0; i < 12; i++) {
+			float w;
+			memcpy(&w, &s[4 + 4 * i], 4);
+			ok &= w == (float) (counter % 4096U) * 0.5f + (float) i;
+		}
+		ok &= counter % 10U == 0;
+	} else if (l == &lists[2]) {   // Counter, Gain, Limit
+		float gain;
+		uint16_t limit;
+		memcpy(&gain, &s[4], 4);
+		memcpy(&limit, &s[8], 2);
+		ok = gain == ecuCal.Gain && limit == ecuCal.Limit;
+	}
+	if (!ok) {
+		daqErrors++;
+	}
+	l->LastCounter = counter;
+	l->LastOverloads = overloads;
+}
+
+static void SETUP(uint8_t frameBytes, uint32_t nominalKbps, uint32_t dataKbps) {
+	memset(&slave, 0, sizeof(slave));
+	slave.CroId = SIM_CRO_ID;
+	slave.DtoId = SIM_DTO_ID;
+	slave.FrameBytes = frameBytes;
+	slave.BitRateSwitch = 1;
+	slave.Regions = ecuRegions;
+	slave.RegionCount = sizeof(ecuRegions) / sizeof(ecuRegions[0]);
+	slave.Events = ecuEvents;
+	slave.EventCount = sizeof(ecuEvents) / sizeof(ecuEvents[0]);
+	slave.Identifier = "ecu";
+	slave.GetTimestamp = SIM_TIMESTAMP;
+	slave.SendFrame = SIM_SEND;
+	XCP_INIT(&slave);
+
+	simNominalKbps = nominalKbps;
+	simDataKbps = dataKbps;
+	simUs = busFreeUs = busBusyUs = 0;
+	nextTickUs = SIM_TICK_US;
+	txCount = 0;
+	busBusy = 0;
+	ticks = 0;
+	daqFrames = daqErrors = overloads = 0;
+	samplerNs = samplerCalls = samplerMaxNs = 0;
+}
+
+/* Run the DAQ for SIM_RUN_MS and print one results row */
+static void MEASURE(const char *name) {
+	double startUs = simUs, startBusy = busBusyUs;
+	uint32_t startFrames = daqFrames, startBytes = slave.DaqBytes;
+
+	SIM_RUN(simUs + SIM_RUN_MS * 1000.0, 0);
+	double seconds = (simUs - startUs) / 1e6;
+	printf("%-28s %7.0f %8.1f %6.1f %6lu %5lu %7.0f %7lu %6lu\n", name,
+			(daqFrames - startFrames) / seconds,
+			(slave.DaqBytes - startBytes) / seconds / 1000.0,
+			100.0 * (busBusyUs - startBusy) / (simUs - startUs),
+			(unsigned long) slave.Overruns,
+			(unsigned long) slave.QueueHighWater,
+			samplerCalls ? (double) samplerNs / samplerCalls : 0.0,
+			(unsigned long) samplerMaxNs, (unsigned long) daqErrors);
+}
+
+static uint32_t FUNCTIONAL(const char *name, uint8_t frameBytes,
+		uint32_t nominalKbps, uint32_t dataKbps, uint8_t fastPrescaler) {
+	uint32_t fail = 0;
+
+	SETUP(frameBytes, nominalKbps, dataKbps);
+	fail += CMD(XCP_CMD_CONNECT, 0) != XCP_PID_RES || response[3] != frameBytes;
+	fail += CMD(XCP_CMD_GET_DAQ_PROCESSOR_INFO) != XCP_PID_RES
+			|| response[4] != slave.EventCount;
+	fail += CMD(XCP_CMD_GET_DAQ_RESOLUTION_INFO) != XCP_PID_RES
+			|| response[5] != 0x34U; // DWORD, 1 us
+	fail += CMD(XCP_CMD_GET_DAQ_EVENT_INFO, 0, U16(1)) != XCP_PID_RES
+			|| response[3] != 4 || response[4] != 1 || response[5] != 7; // 1 x 10 ms
+	fail += CMD(XCP_CMD_UPLOAD, 4) != XCP_PID_RES
+			|| memcmp(&response[1], "10ms", 4) != 0;
+
+	/* Protection: read-only region, unmapped address, bad order */
+	fail += CMD(XCP_CMD_SET_MTA, 0, 0, 0, U32(MEAS_ADDR(Rpm))) != XCP_PID_RES;
+	fail += CMD(XCP_CMD_DOWNLOAD, 2, 1, 2) != XCP_PID_ERR
+			|| response[1] != XCP_ERR_WRITE_PROTECTED;
+	fail += CMD(XCP_CMD_SHORT_UPLOAD, 4, 0, 0, U32(0x30000000U)) != XCP_PID_ERR
+			|| response[1] != XCP_ERR_ACCESS_DENIED;
+	fail += CMD(XCP_CMD_ALLOC_ODT, 0, U16(0), 1) != XCP_PID_ERR
+			|| response[1] != XCP_ERR_SEQUENCE;
+
+	memset(lists, 0, sizeof(lists));
+	lists[0] = (List_t ) { .Event = 0, .Timestamp = 1,
+			.Prescaler = fastPrescaler,
+			.Signals = { { MEAS_ADDR(Counter), 4 }, { MEAS_ADDR(Rpm), 2 },
+					{ MEAS_ADDR(Gear), 1 }, { MEAS_ADDR(Temps), 16 },
+					{ MEAS_ADDR(CounterEcho), 4 } }, .SignalCount = 5 };
+	lists[1] = (List_t ) { .Event = 1, .Prescaler = 1,
+			.Signals = { { MEAS_ADDR(Counter), 4 }, { MEAS_ADDR(Wave), 48 } },
+			.SignalCount = 2 };
+	lists[2] = (List_t ) { .Event = 2, .Prescaler = 1,
+			.Signals = { { MEAS_ADDR(Counter), 4 }, { CAL_ADDR(Gain), 4 },
+					{ CAL_ADDR(Limit), 2 } }, .SignalCount = 3 };
+	listCount = 3;
+	sampleCheck = CHECK_SAMPLE;
+	fail += !MASTER_BUILD_DAQ();
+	fail += CMD(XCP_CMD_START_STOP_SYNCH, 1) != XCP_PID_RES;
+	MEASURE(name);
+
+	/* Calibrate while DAQ runs: the 100 ms list must carry the new values */
+	float gain = 2.25f;
+	uint8_t g[4];
+	memcpy(g, &gain, 4);
+	fail += CMD(XCP_CMD_SET_MTA, 0, 0, 0, U32(CAL_ADDR(Gain))) != XCP_PID_RES;
+	fail += CMD(XCP_CMD_DOWNLOAD, 6, g[0], g[1], g[2], g[3], U16(450))
+			!= XCP_PID_RES;
+	fail += ecuCal.Gain != gain || ecuCal.Limit != 450;
+	uint32_t before = lists[2].Samples;
+	SIM_RUN(simUs + 300000.0, 0);
+	fail += lists[2].Samples < before + 2U;
+	fail += CMD(XCP_CMD_START_STOP_SYNCH, 0) != XCP_PID_RES;
+	fail += CMD(XCP_CMD_DISCONNECT) != XCP_PID_RES;
+	fail += lists[0].Samples == 0 || lists[1].Samples == 0;
+	return fail + daqErrors;
+}
+
+/* One 1 ms list of 'odts' full ODTs from the bulk region */
+static void SWEEP(const char *bus, uint8_t frameBytes, uint32_t nominalKbps,
+		uint32_t dataKbps) {
+	for (uint32_t odts = 1; odts <= 8; odts++) {
+		char name[48];
+		uint32_t bytes = odts * (frameBytes - 1U);
+		SETUP(frameBytes, nominalKbps, dataKbps);
+		CMD(XCP_CMD_CONNECT, 0);
+		memset(lists, 0, sizeof(lists));
+		lists[0].Prescaler = 1;
+		for (uint32_t s = 0; s < odts; s++) {
+			lists[0].Signals[s].Address = SIM_BULK_ADDR + s * (frameBytes - 1U);
+			lists[0].Signals[s].Size = frameBytes - 1U;
+		}
+		lists[0].SignalCount = odts;
+		listCount = 1;
+		sampleCheck = NULL;
+		MASTER_BUILD_DAQ();
+		CMD(XCP_CMD_START_STOP_SYNCH, 1);
+		snprintf(name, sizeof(name), "%s %lu B/ms", bus, (unsigned long) bytes);
+		MEASURE(name);
+		if (slave.Overruns != 0) {
+			break;
+		}
+	}
+}
+
+int main(void) {
+	uint32_t fail = 0;
+
+	printf("%-28s %7s %8s %6s %6s %5s %7s %7s %6s\n", "DAQ", "fr/s", "KB/s",
+			"Bus %", "Lost", "Queue", "ns/evt", "ns max", "Errors");
+	fail += FUNCTIONAL("Classic 500k: 2/10/100 ms", 8, 500, 500, 2);
+	fail += FUNCTIONAL("FD 500k/2M: 1/10/100 ms", 64, 500, 2000, 1);
+	printf("\nCeiling, one 1 ms list (stops at the first lost sample):\n");
+	SWEEP("Classic 500k", 8, 500, 500);
+	SWEEP("FD 500k/2M", 64, 500, 2000);
+	printf("\nFunctional checks: %s (%lu failures)\n", fail ? "FAIL" : "pass",
+			(unsigned long) fail);
+	return fail != 0;
+}